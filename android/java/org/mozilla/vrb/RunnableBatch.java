@@ -0,0 +1,21 @@
+/* -*- Mode: Java; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil; -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+package org.mozilla.vrb;
+
+import androidx.annotation.Keep;
+
+// Runs the Java runnables drained by the native RunnableQueue, so draining
+// takes a single JNI transition however many runnables were queued.
+@Keep
+class RunnableBatch {
+    @Keep
+    static void run(final Runnable[] aRunnables, final int aCount) {
+        for (int i = 0; i < aCount; i++) {
+            aRunnables[i].run();
+            aRunnables[i] = null;
+        }
+    }
+}
@@ -0,0 +1,38 @@
+/* -*- Mode: Java; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil; -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+package org.mozilla.vrb;
+
+import android.graphics.SurfaceTexture;
+
+import androidx.annotation.Keep;
+
+// Forwards frame available events of a SurfaceTexture to the native
+// SurfaceTextureFactory so that idle surfaces are not updated every frame.
+@Keep
+class SurfaceTextureListener implements SurfaceTexture.OnFrameAvailableListener {
+    private long mHandle;
+
+    @Keep
+    SurfaceTextureListener(final long aHandle) {
+        mHandle = aHandle;
+    }
+
+    @Override
+    public synchronized void onFrameAvailable(SurfaceTexture aSurfaceTexture) {
+        if (mHandle != 0) {
+            FrameAvailable(mHandle);
+        }
+    }
+
+    // Called before the native handle is released. Blocks while a callback
+    // is in progress so the handle is never used once this returns.
+    @Keep
+    synchronized void release() {
+        mHandle = 0;
+    }
+
+    private native static void FrameAvailable(final long aHandle);
+}
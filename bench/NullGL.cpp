@@ -0,0 +1,24 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// A GL implementation that does nothing, so the benchmarks measure the CPU
+// side of the library without a context or driver. Every function of the
+// dispatch table forwards to the null backend, see vrb::GLBackend::Null, so
+// the entry points follow VRB_GL_FUNCTIONS.
+
+// These are the real entry points even when the library routes its calls
+// through the VRB_GL_DISPATCH table.
+#define VRB_GL_DISPATCH_IMPLEMENTATION
+#include "vrb/GLDispatch.h"
+
+#define VRB_NULL_GL_ENTRY(aReturn, aName, aParams, aArgs) \
+  aReturn GL_APIENTRY gl##aName aParams { return vrb::GLDispatchGetNull().aName aArgs; }
+VRB_GL_FUNCTIONS(VRB_NULL_GL_ENTRY)
+#undef VRB_NULL_GL_ENTRY
+
+// GLExtensions takes the address of these instead of loading them.
+void GL_APIENTRY glDispatchCompute(GLuint, GLuint, GLuint) {}
+void GL_APIENTRY glDrawElementsIndirect(GLenum, GLenum, const void*) {}
+void GL_APIENTRY glMemoryBarrier(GLbitfield) {}
@@ -0,0 +1,475 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Micro-benchmarks for the hot paths of the library. GL calls go to NullGL so
+// no context is required. Results are written to stdout as a single JSON
+// object so that they may be tracked per commit. Usage:
+//
+//   vrb_bench [name filter] [cache directory]
+
+#include "vrb/AnimatedTransform.h"
+#include "vrb/CameraSimple.h"
+#include "vrb/CreationContext.h"
+#include "vrb/CullVisitor.h"
+#include "vrb/DataCache.h"
+#include "vrb/DrawableList.h"
+#include "vrb/Frustum.h"
+#include "vrb/Geometry.h"
+#include "vrb/Group.h"
+#include "vrb/JobSystem.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/ParallelCuller.h"
+#include "vrb/ParserObj.h"
+#include "vrb/Program.h"
+#include "vrb/ProgramFactory.h"
+#include "vrb/Quaternion.h"
+#include "vrb/RenderContext.h"
+#include "vrb/RenderState.h"
+#include "vrb/SceneSnapshot.h"
+#include "vrb/Transform.h"
+#include "vrb/TransformAnimator.h"
+#include "vrb/Vector.h"
+#include "vrb/VertexArray.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int kRuns = 5;
+const double kMinRunTime = 0.1;
+
+struct Result {
+  std::string name;
+  double itemsPerRun;
+  double secondsPerRun;
+  std::string unit;
+};
+
+std::vector<Result> sResults;
+std::string sFilter;
+
+double
+Now() {
+  using namespace std::chrono;
+  return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs aBody until kMinRunTime has passed, kRuns times, and records the median
+// time of a single call to aBody. aItems is the amount of work done by one
+// call, reported in aUnit per second.
+bool
+Wanted(const std::string& aName) {
+  return sFilter.empty() || (aName.find(sFilter) != std::string::npos) || (sFilter.find(aName) != std::string::npos);
+}
+
+void
+Run(const std::string& aName, const double aItems, const std::string& aUnit, const std::function<void()>& aBody) {
+  if (!sFilter.empty() && (aName.find(sFilter) == std::string::npos)) {
+    return;
+  }
+  aBody();
+  std::vector<double> times;
+  for (int run = 0; run < kRuns; run++) {
+    int calls = 0;
+    const double kStart = Now();
+    double elapsed = 0.0;
+    do {
+      aBody();
+      calls++;
+      elapsed = Now() - kStart;
+    } while (elapsed < kMinRunTime);
+    times.push_back(elapsed / calls);
+  }
+  std::sort(times.begin(), times.end());
+  sResults.push_back({aName, aItems, times[kRuns / 2], aUnit});
+}
+
+volatile float sSink;
+
+void
+BenchMath() {
+  if (!Wanted("matrix") && !Wanted("quaternion")) {
+    return;
+  }
+  const int kCount = 1024;
+  std::vector<vrb::Matrix> matrices;
+  for (int ix = 0; ix < kCount; ix++) {
+    matrices.push_back(vrb::Matrix::Rotation(vrb::Vector(0.0f, 1.0f, 0.0f), ix * 0.01f)
+                       .Translate(vrb::Vector(ix * 0.1f, 1.0f, -2.0f)));
+  }
+  Run("matrix_multiply", kCount, "matrices", [&]() {
+    vrb::Matrix result = vrb::Matrix::Identity();
+    for (const vrb::Matrix& matrix: matrices) {
+      result = result.PostMultiply(matrix);
+    }
+    sSink = result.At(0, 0);
+  });
+  Run("matrix_inverse", kCount, "matrices", [&]() {
+    float sum = 0.0f;
+    for (const vrb::Matrix& matrix: matrices) {
+      sum += matrix.Inverse().At(3, 0);
+    }
+    sSink = sum;
+  });
+  Run("matrix_afine_inverse", kCount, "matrices", [&]() {
+    float sum = 0.0f;
+    for (const vrb::Matrix& matrix: matrices) {
+      sum += matrix.AfineInverse().At(3, 0);
+    }
+    sSink = sum;
+  });
+
+  std::vector<vrb::Quaternion> quats;
+  for (int ix = 0; ix < kCount; ix++) {
+    quats.push_back(vrb::Quaternion(vrb::Matrix::Rotation(vrb::Vector(1.0f, 0.5f, 0.25f).Normalize(), ix * 0.01f)));
+  }
+  Run("quaternion_multiply", kCount, "quaternions", [&]() {
+    vrb::Quaternion result(0.0f, 0.0f, 0.0f, 1.0f);
+    for (const vrb::Quaternion& quat: quats) {
+      result = (result * quat).Normalize();
+    }
+    sSink = result.x();
+  });
+  Run("quaternion_to_matrix", kCount, "quaternions", [&]() {
+    float sum = 0.0f;
+    for (const vrb::Quaternion& quat: quats) {
+      sum += vrb::Matrix::Rotation(quat).At(1, 1);
+    }
+    sSink = sum;
+  });
+}
+
+// Counts what the parser reports so that only parsing is measured.
+class CountingObserver : public vrb::ParserObserverObj {
+public:
+  size_t vertices = 0;
+  size_t faces = 0;
+  CountingObserver() {}
+  void StartModel(const std::string&) override {}
+  void FinishModel() override {}
+  void LoadMaterialLibrary(const std::string&) override {}
+  void SetGroupNames(const std::vector<std::string>&) override {}
+  void SetObjectName(const std::string&) override {}
+  void SetMaterialName(const std::string&) override {}
+  void AddVertex(const vrb::Vector&, const float) override { vertices++; }
+  void AddNormal(const vrb::Vector&) override {}
+  void AddUV(const float, const float, const float) override {}
+  void AddFace(const std::vector<int>&, const std::vector<int>&, const std::vector<int>&) override { faces++; }
+  void AddVertices(const float*, const size_t aCount) override { vertices += aCount; }
+  void AddNormals(const float*, const size_t) override {}
+  void AddUVs(const float*, const size_t) override {}
+  void AddFaces(const int*, const uint32_t*, const size_t aFaceCount) override { faces += aFaceCount; }
+  void SetSmoothingGroup(const int) override {}
+  void StartMaterialFile(const std::string&) override {}
+  void FinishMaterialFile() override {}
+  void CreateMaterial(const std::string&) override {}
+  void SetAmbientColor(const vrb::Vector&) override {}
+  void SetDiffuseColor(const vrb::Vector&) override {}
+  void SetSpecularColor(const vrb::Vector&) override {}
+  void SetSpecularExponent(const float) override {}
+  void SetIlluniationModel(const int) override {}
+  void SetAmbientTexture(const std::string&) override {}
+  void SetDiffuseTexture(const std::string&) override {}
+  void SetSpecularTexture(const std::string&) override {}
+};
+
+// A aSize by aSize grid of quads in OBJ format.
+std::string
+CreateObjCorpus(const int aSize) {
+  std::string result;
+  char line[128];
+  for (int y = 0; y <= aSize; y++) {
+    for (int x = 0; x <= aSize; x++) {
+      snprintf(line, sizeof(line), "v %f %f %f\nvt %f %f\nvn 0.000000 0.000000 1.000000\n",
+               x * 0.125f, y * 0.125f, (x ^ y) * 0.001f, (float)x / aSize, (float)y / aSize);
+      result += line;
+    }
+  }
+  const int kRow = aSize + 1;
+  for (int y = 0; y < aSize; y++) {
+    for (int x = 0; x < aSize; x++) {
+      const int kA = y * kRow + x + 1;
+      const int kB = kA + 1;
+      const int kC = kA + kRow + 1;
+      const int kD = kA + kRow;
+      snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+               kA, kA, kA, kB, kB, kB, kC, kC, kC, kD, kD, kD);
+      result += line;
+    }
+  }
+  return result;
+}
+
+void
+BenchParser(vrb::CreationContextPtr& aCreate) {
+  if (!Wanted("parser_obj")) {
+    return;
+  }
+  const std::string kCorpus = CreateObjCorpus(256);
+  const size_t kChunkSize = 64 * 1024;
+  vrb::ParserObjPtr parser = vrb::ParserObj::Create(aCreate);
+  std::shared_ptr<CountingObserver> observer = std::make_shared<CountingObserver>();
+  parser->SetObserver(observer);
+  Run("parser_obj", (double)kCorpus.size() / (1024.0 * 1024.0), "MB", [&]() {
+    parser->BindFileHandle("bench.obj", 1);
+    for (size_t offset = 0; offset < kCorpus.size(); offset += kChunkSize) {
+      parser->ProcessRawFileChunk(1, kCorpus.data() + offset, std::min(kChunkSize, kCorpus.size() - offset));
+    }
+    parser->FinishRawFile(1);
+  });
+}
+
+vrb::VertexArrayPtr
+CreateGrid(vrb::CreationContextPtr& aCreate, const int aSize, std::vector<int>& aIndices, std::vector<uint32_t>& aCorners) {
+  vrb::VertexArrayPtr array = vrb::VertexArray::Create(aCreate);
+  for (int y = 0; y <= aSize; y++) {
+    for (int x = 0; x <= aSize; x++) {
+      array->AppendVertex(vrb::Vector(x * 0.125f, y * 0.125f, 0.0f));
+      array->AppendNormal(vrb::Vector(0.0f, 0.0f, 1.0f));
+      array->AppendUV(vrb::Vector((float)x / aSize, (float)y / aSize, 0.0f));
+    }
+  }
+  const int kRow = aSize + 1;
+  for (int y = 0; y < aSize; y++) {
+    for (int x = 0; x < aSize; x++) {
+      const int kCorners[4] = {y * kRow + x + 1, y * kRow + x + 2, (y + 1) * kRow + x + 2, (y + 1) * kRow + x + 1};
+      for (const int corner: kCorners) {
+        aIndices.push_back(corner);
+        aIndices.push_back(corner);
+        aIndices.push_back(corner);
+      }
+      aCorners.push_back(4);
+    }
+  }
+  return array;
+}
+
+vrb::RenderStatePtr
+CreateRenderState(vrb::RenderContextPtr& aRender, vrb::CreationContextPtr& aCreate) {
+  vrb::ProgramPtr program = aRender->GetProgramFactory()->CreateProgram(aCreate, 0);
+  vrb::RenderStatePtr state = vrb::RenderState::Create(aCreate);
+  state->SetProgram(program);
+  return state;
+}
+
+void
+BenchGeometry(vrb::RenderContextPtr& aRender, vrb::CreationContextPtr& aCreate) {
+  if (!Wanted("geometry_")) {
+    return;
+  }
+  const int kSize = 128;
+  std::vector<int> indices;
+  std::vector<uint32_t> corners;
+  vrb::VertexArrayPtr array = CreateGrid(aCreate, kSize, indices, corners);
+  Run("geometry_build", (double)corners.size(), "faces", [&]() {
+    vrb::GeometryPtr geometry = vrb::Geometry::Create(aCreate);
+    geometry->SetVertexArray(array);
+    geometry->AddFaces(indices.data(), corners.data(), corners.size());
+    aRender->Update();
+    geometry->UpdateBuffers();
+  });
+  // The same faces without normals, generated once every face is added.
+  std::vector<int> flatIndices(indices);
+  for (size_t ix = 2; ix < flatIndices.size(); ix += 3) {
+    flatIndices[ix] = 0;
+  }
+  vrb::JobSystemPtr jobs = aCreate->GetJobSystem();
+  Run("geometry_normals", (double)corners.size(), "faces", [&]() {
+    // Generated normals are appended, so each run starts from its own array.
+    vrb::VertexArrayPtr positions = vrb::VertexArray::Create(aCreate);
+    positions->AppendVertices(array->GetVertexData(), (size_t)array->GetVertexCount(), 3);
+    vrb::GeometryPtr geometry = vrb::Geometry::Create(aCreate);
+    geometry->SetVertexArray(positions);
+    geometry->AddFaces(flatIndices.data(), corners.data(), corners.size());
+    vrb::Geometry::GenerateNormals({geometry}, vrb::Geometry::NormalWeighting::Area, jobs);
+  });
+}
+
+void
+BenchCull(vrb::RenderContextPtr& aRender, vrb::CreationContextPtr& aCreate, const int aNodeCount) {
+  const std::string kSuffix = std::to_string(aNodeCount);
+  if (!Wanted("cull_" + kSuffix) && !Wanted("cull_draw_" + kSuffix) && !Wanted("cull_snapshot_" + kSuffix) &&
+      !Wanted("cull_parallel_" + kSuffix)) {
+    return;
+  }
+  // Transforms are arranged in groups of 16 that share a small Geometry so
+  // that the graph has some depth. Sharing one Geometry across the whole
+  // graph would make removing it from its parents quadratic.
+  std::vector<int> indices;
+  std::vector<uint32_t> corners;
+  vrb::VertexArrayPtr array = CreateGrid(aCreate, 2, indices, corners);
+  vrb::RenderStatePtr state = CreateRenderState(aRender, aCreate);
+  std::vector<vrb::GeometryPtr> geometries;
+
+  vrb::GroupPtr root = vrb::Group::Create(aCreate);
+  vrb::GroupPtr group;
+  vrb::GeometryPtr geometry;
+  for (int ix = 0; ix < aNodeCount; ix++) {
+    if ((ix % 16) == 0) {
+      group = vrb::Group::Create(aCreate);
+      root->AddNode(group);
+      geometry = vrb::Geometry::Create(aCreate);
+      geometry->SetVertexArray(array);
+      geometry->AddFaces(indices.data(), corners.data(), corners.size());
+      geometry->SetRenderState(state);
+      geometries.push_back(geometry);
+    }
+    vrb::TransformPtr transform = vrb::Transform::Create(aCreate);
+    // Roughly half of the nodes end up behind the camera.
+    const float kAngle = ix * 2.399963f;
+    transform->SetTransform(vrb::Matrix::Translation(vrb::Vector(std::cos(kAngle) * 20.0f, (ix % 32) - 16.0f, std::sin(kAngle) * 20.0f)));
+    transform->AddNode(geometry);
+    group->AddNode(transform);
+  }
+
+  vrb::CameraSimplePtr camera = vrb::CameraSimple::Create(aCreate);
+  camera->SetViewport(1024, 1024);
+  camera->SetFieldOfView(90.0f, 90.0f);
+  camera->SetClipRange(0.1f, 100.0f);
+  vrb::CullVisitorPtr cullVisitor = vrb::CullVisitor::Create(aCreate);
+  vrb::DrawableListPtr drawList = vrb::DrawableList::Create(aCreate);
+  aRender->Update();
+  for (vrb::GeometryPtr& entry: geometries) {
+    entry->UpdateBuffers();
+  }
+
+  Run("cull_" + kSuffix, aNodeCount, "nodes", [&]() {
+    drawList->Reset();
+    cullVisitor->Reset();
+    cullVisitor->SetFrustum(vrb::Frustum::FromCamera(*camera));
+    cullVisitor->SetCamera(*camera);
+    root->Cull(*cullVisitor, *drawList);
+  });
+  Run("cull_draw_" + kSuffix, aNodeCount, "nodes", [&]() {
+    drawList->Reset();
+    cullVisitor->Reset();
+    cullVisitor->SetFrustum(vrb::Frustum::FromCamera(*camera));
+    cullVisitor->SetCamera(*camera);
+    root->Cull(*cullVisitor, *drawList);
+    drawList->Draw(*camera);
+  });
+  vrb::SceneSnapshotPtr snapshot = vrb::SceneSnapshot::Create(aCreate);
+  snapshot->SetRoot(root);
+  Run("cull_snapshot_" + kSuffix, aNodeCount, "nodes", [&]() {
+    drawList->Reset();
+    cullVisitor->Reset();
+    cullVisitor->SetFrustum(vrb::Frustum::FromCamera(*camera));
+    cullVisitor->SetCamera(*camera);
+    snapshot->Cull(*cullVisitor, *drawList);
+  });
+  vrb::ParallelCullerPtr culler = vrb::ParallelCuller::Create(aCreate);
+  snapshot->SetParallelCuller(culler);
+  Run("cull_parallel_" + kSuffix, aNodeCount, "nodes", [&]() {
+    drawList->Reset();
+    cullVisitor->Reset();
+    cullVisitor->SetFrustum(vrb::Frustum::FromCamera(*camera));
+    cullVisitor->SetCamera(*camera);
+    snapshot->Cull(*cullVisitor, *drawList);
+  });
+  snapshot->SetParallelCuller(nullptr);
+  drawList->Reset();
+}
+
+void
+BenchAnimation(vrb::RenderContextPtr& aRender, vrb::CreationContextPtr& aCreate) {
+  const int kCount = 10000;
+  if (!Wanted("animation_update")) {
+    return;
+  }
+  std::vector<vrb::AnimatedTransformPtr> transforms;
+  for (int ix = 0; ix < kCount; ix++) {
+    vrb::AnimatedTransformPtr transform = vrb::AnimatedTransform::Create(aCreate);
+    transform->AddRotationAnimation(vrb::Vector(0.0f, 1.0f, 0.0f), 1.0f + ix * 0.001f);
+    if (ix % 2) {
+      transform->AddTranslationAnimation(vrb::Vector(1.0f, 0.0f, 0.0f), 0.1f);
+    }
+    transform->SetAnimationState(vrb::AnimationState::Play);
+    transforms.push_back(transform);
+  }
+  // The first update hands the transforms to the TransformAnimator.
+  aRender->Update();
+  vrb::TransformAnimatorPtr& animator = aRender->GetTransformAnimator();
+  double timestamp = aRender->GetTimestamp();
+  Run("animation_update", kCount, "transforms", [&]() {
+    timestamp += 0.01;
+    animator->Update(timestamp);
+  });
+}
+
+void
+BenchDataCache(const std::string& aCachePath) {
+  if (!Wanted("data_cache_round_trip")) {
+    return;
+  }
+  const size_t kSize = 256 * 1024;
+  vrb::DataCachePtr cache = vrb::DataCache::Create();
+  cache->SetCachePath(aCachePath);
+  std::vector<uint8_t> source(kSize);
+  for (size_t ix = 0; ix < kSize; ix++) {
+    source[ix] = (uint8_t)((ix * 31) ^ (ix >> 7));
+  }
+  Run("data_cache_round_trip", (double)kSize / (1024.0 * 1024.0), "MB", [&]() {
+    std::unique_ptr<uint8_t[]> data(new uint8_t[kSize]);
+    memcpy(data.get(), source.data(), kSize);
+    const uint32_t kHandle = cache->CacheData(data, kSize);
+    std::unique_ptr<uint8_t[]> loaded;
+    if (cache->LoadData(kHandle, loaded) != kSize) {
+      VRB_ERROR("DataCache round trip failed");
+    }
+    cache->RemoveData(kHandle);
+  });
+}
+
+void
+PrintResults() {
+  printf("{\n  \"benchmarks\": [\n");
+  for (size_t ix = 0; ix < sResults.size(); ix++) {
+    const Result& result = sResults[ix];
+    printf("    {\"name\": \"%s\", \"ns_per_run\": %.1f, \"items_per_run\": %.3f, \"%s_per_second\": %.3f}%s\n",
+           result.name.c_str(), result.secondsPerRun * 1.0e9, result.itemsPerRun, result.unit.c_str(),
+           result.itemsPerRun / result.secondsPerRun, (ix + 1) < sResults.size() ? "," : "");
+  }
+  printf("  ]\n}\n");
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[]) {
+  if (argc > 1) {
+    sFilter = argv[1];
+  }
+  const std::string kCachePath = argc > 2 ? argv[2] : P_tmpdir;
+  // Keep the library's own logging off the measured paths.
+  vrb::LoggerStartAsync();
+  {
+    vrb::RenderContextPtr render = vrb::RenderContext::Create();
+    vrb::CreationContextPtr create = render->GetRenderThreadCreationContext();
+    render->InitializeGL();
+
+    BenchMath();
+    BenchParser(create);
+    BenchGeometry(render, create);
+    for (const int count: {1000, 10000, 100000}) {
+      BenchCull(render, create, count);
+    }
+    BenchAnimation(render, create);
+    BenchDataCache(kCachePath);
+
+    render->ShutdownGL();
+  }
+  vrb::LoggerStopAsync();
+  PrintResults();
+  return 0;
+}
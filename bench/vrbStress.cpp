@@ -0,0 +1,240 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Stress test of the hand-off of resources created by loader threads to the
+// render thread. Load tasks creating a Geometry and a TextureGL are queued
+// at a fixed rate on a ModelLoaderBasic while a render loop paced at 90 Hz
+// calls RenderContext::Update. With "blocking" each task also waits for the
+// render thread to adopt its resources, as a loader did before
+// CreationContext::Synchronize stopped waiting, so both hand-offs can be
+// compared. GL calls go to NullGL. Results are written to stdout as a single
+// JSON object. Usage:
+//
+//   vrb_stress [loader threads] [loads per second] [seconds] [async|blocking]
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/Geometry.h"
+#include "vrb/Group.h"
+#include "vrb/Logger.h"
+#include "vrb/ModelLoaderBasic.h"
+#include "vrb/RenderContext.h"
+#include "vrb/RenderState.h"
+#include "vrb/TextureGL.h"
+#include "vrb/Vector.h"
+#include "vrb/VertexArray.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const double kFramePeriod = 1.0 / 90.0;
+const int kGridSize = 32;
+const int kTextureSize = 256;
+// Loaded groups are released after this many newer ones, so resources are
+// also deleted while loading.
+const size_t kResidentLoads = 64;
+
+double
+Now() {
+  using namespace std::chrono;
+  return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
+
+// aValues must be sorted.
+double
+Percentile(const std::vector<double>& aValues, const double aPercentile) {
+  if (aValues.empty()) {
+    return 0.0;
+  }
+  const size_t kIndex = std::min((size_t)(aPercentile * 0.01 * (double)aValues.size()), aValues.size() - 1);
+  return aValues[kIndex];
+}
+
+void
+PrintPercentiles(const char* aName, std::vector<double>& aValues, const bool aLast) {
+  std::sort(aValues.begin(), aValues.end());
+  printf("      \"%s\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s\n", aName,
+         Percentile(aValues, 50.0) * 1000.0, Percentile(aValues, 90.0) * 1000.0, Percentile(aValues, 99.0) * 1000.0,
+         aValues.empty() ? 0.0 : aValues.back() * 1000.0, aLast ? "" : ",");
+}
+
+// Waits on the loader thread until the render thread adopted its resources.
+class HandOff {
+public:
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this]() { return mAdopted; });
+  }
+  void Adopted() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mAdopted = true;
+    mCondition.notify_all();
+  }
+  HandOff() : mAdopted(false) {}
+private:
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mAdopted;
+};
+
+struct Shared {
+  std::vector<int> indices;
+  std::vector<uint32_t> corners;
+  std::vector<vrb::Vector> vertices;
+};
+
+vrb::GroupPtr
+CreateLoad(vrb::CreationContextPtr& aContext, const Shared& aShared) {
+  vrb::VertexArrayPtr array = vrb::VertexArray::Create(aContext);
+  for (const vrb::Vector& vertex: aShared.vertices) {
+    array->AppendVertex(vertex);
+    array->AppendNormal(vrb::Vector(0.0f, 0.0f, 1.0f));
+    array->AppendUV(vrb::Vector(vertex.x(), vertex.y(), 0.0f));
+  }
+  const uint64_t kLength = (uint64_t)kTextureSize * kTextureSize * 4;
+  std::unique_ptr<uint8_t[]> image(new uint8_t[kLength]);
+  memset(image.get(), 0x80, kLength);
+  vrb::TextureGLPtr texture = vrb::TextureGL::Create(aContext);
+  texture->SetImageData(image, kLength, kTextureSize, kTextureSize, GL_RGBA);
+
+  vrb::RenderStatePtr state = vrb::RenderState::Create(aContext);
+  state->SetTexture(texture);
+
+  vrb::GeometryPtr geometry = vrb::Geometry::Create(aContext);
+  geometry->SetVertexArray(array);
+  geometry->SetRenderState(state);
+  geometry->AddFaces(aShared.indices.data(), aShared.corners.data(), aShared.corners.size());
+
+  vrb::GroupPtr result = vrb::Group::Create(aContext);
+  result->AddNode(geometry);
+  return result;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[]) {
+  const int kThreads = argc > 1 ? std::max(atoi(argv[1]), 1) : 4;
+  const double kRate = argc > 2 ? std::max(atof(argv[2]), 1.0) : 200.0;
+  const double kDuration = argc > 3 ? std::max(atof(argv[3]), 0.1) : 5.0;
+  const bool kBlocking = (argc > 4) && (strcmp(argv[4], "blocking") == 0);
+
+  Shared shared;
+  for (int y = 0; y <= kGridSize; y++) {
+    for (int x = 0; x <= kGridSize; x++) {
+      shared.vertices.push_back(vrb::Vector((float)x / kGridSize, (float)y / kGridSize, 0.0f));
+    }
+  }
+  const int kRow = kGridSize + 1;
+  for (int y = 0; y < kGridSize; y++) {
+    for (int x = 0; x < kGridSize; x++) {
+      const int kCorners[4] = {y * kRow + x + 1, y * kRow + x + 2, (y + 1) * kRow + x + 2, (y + 1) * kRow + x + 1};
+      for (const int corner: kCorners) {
+        shared.indices.push_back(corner);
+        shared.indices.push_back(corner);
+        shared.indices.push_back(corner);
+      }
+      shared.corners.push_back(4);
+    }
+  }
+
+  std::vector<double> updateTimes;
+  std::vector<double> frameIntervals;
+  std::vector<double> loadLatencies;
+  int submitted = 0;
+  int finished = 0;
+  int missedFrames = 0;
+  double elapsed = 0.0;
+  // Keep the library's own logging off the measured paths.
+  vrb::LoggerStartAsync();
+  {
+    vrb::RenderContextPtr render = vrb::RenderContext::Create();
+    render->InitializeGL();
+    vrb::ModelLoaderBasicPtr loader = vrb::ModelLoaderBasic::Create(render, kThreads);
+    loader->Start();
+    std::deque<vrb::GroupPtr> resident;
+
+    const double kStart = Now();
+    double lastFrame = kStart;
+    double nextFrame = kStart;
+    // Frames keep running after the last submission until every load
+    // finished, blocked loaders wait on them.
+    while ((elapsed < kDuration) || (finished < submitted)) {
+      const int kDue = elapsed < kDuration ? (int)(elapsed * kRate) : submitted;
+      for (; submitted < kDue; submitted++) {
+        const double kSubmitted = Now();
+        vrb::LoadTask task = [&shared, kBlocking](vrb::CreationContextPtr& aContext) -> vrb::GroupPtr {
+          vrb::GroupPtr result = CreateLoad(aContext, shared);
+          if (kBlocking) {
+            std::shared_ptr<HandOff> handOff = std::make_shared<HandOff>();
+            aContext->Synchronize([handOff](vrb::RenderContextPtr&) { handOff->Adopted(); });
+            handOff->Wait();
+          }
+          return result;
+        };
+        vrb::LoadFinishedCallback callback = [&](vrb::GroupPtr& aGroup) {
+          loadLatencies.push_back(Now() - kSubmitted);
+          finished++;
+          resident.push_back(aGroup);
+          if (resident.size() > kResidentLoads) {
+            resident.pop_front();
+          }
+        };
+        loader->RunLoadTask(nullptr, task, callback);
+      }
+
+      const double kFrameStart = Now();
+      render->Update();
+      const double kFrameEnd = Now();
+      updateTimes.push_back(kFrameEnd - kFrameStart);
+      if (kFrameStart > kStart) {
+        frameIntervals.push_back(kFrameStart - lastFrame);
+        if ((kFrameStart - lastFrame) > (kFramePeriod * 1.5)) {
+          missedFrames++;
+        }
+      }
+      lastFrame = kFrameStart;
+      nextFrame += kFramePeriod;
+      if (nextFrame > kFrameEnd) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(nextFrame - kFrameEnd));
+      } else {
+        // Late frames do not accumulate a debt of frames to catch up on.
+        nextFrame = kFrameEnd;
+      }
+      elapsed = Now() - kStart;
+    }
+
+    loader->Stop();
+    resident.clear();
+    render->Update();
+    render->ShutdownGL();
+  }
+  vrb::LoggerStopAsync();
+
+  printf("{\n  \"stress\": {\n");
+  printf("    \"handoff\": \"%s\",\n", kBlocking ? "blocking" : "async");
+  printf("    \"loader_threads\": %d,\n", kThreads);
+  printf("    \"loads\": %d,\n", finished);
+  printf("    \"loads_per_second\": %.1f,\n", elapsed > 0.0 ? finished / elapsed : 0.0);
+  printf("    \"frames\": %d,\n", (int)updateTimes.size());
+  printf("    \"missed_frames\": %d,\n", missedFrames);
+  printf("    \"times_in_ms\": {\n");
+  PrintPercentiles("update", updateTimes, false);
+  PrintPercentiles("frame_interval", frameIntervals, false);
+  PrintPercentiles("load_latency", loadLatencies, true);
+  printf("    }\n  }\n}\n");
+  return 0;
+}
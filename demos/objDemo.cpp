@@ -1,20 +1,27 @@
 #include "vrb/AnimatedTransform.h"
+#include "vrb/BatchMath.h"
 #include "vrb/CameraSimple.h"
 #include "vrb/CreationContext.h"
 #include "vrb/CullVisitor.h"
 #include "vrb/DataCache.h"
 #include "vrb/DrawableList.h"
+#include "vrb/FBO.h"
+#include "vrb/FBOPool.h"
+#include "vrb/Frustum.h"
 #include "vrb/Geometry.h"
 #include "vrb/GLError.h"
 #include "vrb/Group.h"
 #include "vrb/Light.h"
 #include "vrb/Logger.h"
 #include "vrb/Matrix.h"
+#include "vrb/ModelCacheObj.h"
 #include "vrb/Node.h"
 #include "vrb/NodeFactoryObj.h"
 #include "vrb/ObjectCounter.h"
 #include "vrb/ParserObj.h"
+#include "vrb/PerformanceMonitor.h"
 #include "vrb/RenderContext.h"
+#include "vrb/Transform.h"
 #include "vrb/Vector.h"
 #include "vrb/VertexArray.h"
 
@@ -23,6 +30,13 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
 #define WinWidth 1000
 #define WinHeight 1000
 
@@ -57,11 +71,204 @@ PollEvents(SDL_Window* aWindow, const uint32_t aFlags) {
   return running;
 }
 
+static double
+Now() {
+  using namespace std::chrono;
+  return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
+
+static double
+Percentile(std::vector<double> aValues, const double aPercentile) {
+  if (aValues.empty()) {
+    return 0.0;
+  }
+  std::sort(aValues.begin(), aValues.end());
+  const size_t kIndex = std::min(aValues.size() - 1, (size_t)(aPercentile * (aValues.size() - 1) + 0.5));
+  return aValues[kIndex];
+}
+
+static void
+PrintTimes(const char* aName, const std::vector<double>& aTimes, const bool aLast) {
+  if (aTimes.empty()) {
+    printf("    \"%s\": null%s\n", aName, aLast ? "" : ",");
+    return;
+  }
+  printf("    \"%s\": {\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s\n", aName,
+         Percentile(aTimes, 0.5) * 1000.0, Percentile(aTimes, 0.95) * 1000.0,
+         Percentile(aTimes, 0.99) * 1000.0, Percentile(aTimes, 1.0) * 1000.0, aLast ? "" : ",");
+}
+
+// Loads aFile and draws aFrameCount frames into an offscreen target while the
+// camera orbits the model once. The camera path only depends on the frame
+// number so runs are reproducible. Results are printed to stdout as JSON, with
+// times in milliseconds.
+static void
+RunBenchmark(vrb::RenderContextPtr& aRender, const std::string& aFile, const std::string& aCacheDirectory, const int aFrameCount, const bool aLast) {
+  static const int kSize = 1024;
+  static const float kNearClip = 0.1f;
+  vrb::CreationContextPtr create = aRender->GetRenderThreadCreationContext();
+
+  const double kLoadStart = Now();
+  vrb::TransformPtr root = vrb::Transform::Create(create);
+  vrb::LightPtr light = vrb::Light::Create(create);
+  root->AddLight(light);
+  vrb::NodeFactoryObjPtr factory = vrb::NodeFactoryObj::Create(create);
+  vrb::ParserObjPtr parser = vrb::ParserObj::Create(create);
+  parser->SetFileReader(create->GetFileReader());
+  parser->SetObserver(factory);
+  factory->SetModelRoot(root);
+  vrb::ModelCacheObjPtr cache = vrb::ModelCacheObj::Create(create);
+  if (!aCacheDirectory.empty()) {
+    cache->SetCacheDirectory(aCacheDirectory);
+  }
+  vrb::ParserObserverObjPtr recorder;
+  if (!cache->LoadModel(aFile, *factory)) {
+    recorder = cache->CreateRecorder(aFile, factory);
+    parser->SetObserver(recorder);
+    parser->LoadModel(aFile);
+  }
+  const double kLoadTime = Now() - kLoadStart;
+
+  vrb::Vector min = vrb::Vector::Max();
+  vrb::Vector max = vrb::Vector::Min();
+  vrb::NodePtr node = root;
+  vrb::Node::Traverse(node, [&min, &max](const vrb::NodePtr& aNode, const vrb::GroupPtr& aTraversingFrom) -> bool {
+    const vrb::GeometryPtr geo = std::dynamic_pointer_cast<vrb::Geometry>(aNode);
+    if (geo && geo->GetVertexArray()) {
+      vrb::VertexArrayPtr verts = geo->GetVertexArray();
+      vrb::ExtendBounds(verts->GetVertexData(), (size_t)verts->GetVertexCount(), min, max);
+    }
+    return false;
+  });
+  const vrb::Vector kCenter = (min + max) * 0.5f;
+  const float kRadius = std::max((max - min).Magnitude(), 1.0f);
+
+  vrb::CameraSimplePtr camera = vrb::CameraSimple::Create(create);
+  camera->SetViewport(kSize, kSize);
+  camera->SetFieldOfView(60.0f, 60.0f);
+  camera->SetClipRange(kNearClip, kRadius * 4.0f);
+  vrb::CullVisitorPtr cullVisitor = vrb::CullVisitor::Create(create);
+  vrb::DrawableListPtr drawList = vrb::DrawableList::Create(create);
+  vrb::PerformanceMonitorPtr monitor = vrb::PerformanceMonitor::Create(create);
+  monitor->SetGPUTimingEnabled(true);
+  vrb::FBOPtr target = aRender->GetFBOPool()->Acquire(kSize, kSize);
+
+  double firstFrameTime = 0.0;
+  std::vector<double> cpuTimes;
+  std::vector<double> frameTimes;
+  std::vector<double> gpuTimes;
+  for (int frame = 0; frame < aFrameCount; frame++) {
+    const float kAngle = 2.0f * vrb::PI_FLOAT * (float)frame / (float)aFrameCount;
+    const vrb::Vector kEye = kCenter + vrb::Vector(std::sin(kAngle), 0.25f, std::cos(kAngle)) * kRadius;
+    // The camera looks down -Z so its Z axis points away from the model.
+    camera->SetTransform(vrb::Matrix::Rotation(kEye - kCenter).Translate(kEye));
+
+    const double kFrameStart = Now();
+    aRender->Update();
+    if (target) {
+      target->Bind();
+    }
+    VRB_GL_CHECK(glViewport(0, 0, kSize, kSize));
+    VRB_GL_CHECK(glClearColor(0.f, 0.f, 0.f, 0.f));
+    VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    drawList->Reset();
+    cullVisitor->Reset();
+    cullVisitor->SetFrustum(vrb::Frustum::FromCamera(*camera));
+    cullVisitor->SetCamera(*camera);
+    root->Cull(*cullVisitor, *drawList);
+    drawList->Draw(*camera);
+    monitor->EndFrame();
+    if (target) {
+      target->Unbind();
+    }
+    const double kSubmitted = Now();
+    VRB_GL_CHECK(glFinish());
+    const double kFinished = Now();
+
+    if (frame == 0) {
+      // The first frame includes uploading every resource created by the load.
+      firstFrameTime = kFinished - kFrameStart;
+      continue;
+    }
+    cpuTimes.push_back(kSubmitted - kFrameStart);
+    frameTimes.push_back(kFinished - kFrameStart);
+    double cpuTime = 0.0;
+    double gpuTime = 0.0;
+    if (monitor->GetFrameTimes(cpuTime, gpuTime) && (gpuTime > 0.0)) {
+      gpuTimes.push_back(gpuTime);
+    }
+  }
+  drawList->Reset();
+  if (target) {
+    aRender->GetFBOPool()->Release(target);
+  }
+
+  printf("  {\n    \"file\": \"%s\",\n    \"frames\": %d,\n", aFile.c_str(), aFrameCount);
+  printf("    \"load\": %.3f,\n    \"first_frame\": %.3f,\n", kLoadTime * 1000.0, firstFrameTime * 1000.0);
+  PrintTimes("cpu", cpuTimes, false);
+  PrintTimes("frame", frameTimes, false);
+  PrintTimes("gpu", gpuTimes, true);
+  printf("  }%s\n", aLast ? "" : ",");
+}
+
+static int
+RunBenchmarks(const std::vector<std::string>& aFiles, const std::string& aCacheDirectory, const int aFrameCount) {
+  vrb::RenderContextPtr render = vrb::RenderContext::Create();
+  vrb::CreationContextPtr create = render->GetRenderThreadCreationContext();
+  render->GetDataCache()->SetCachePath(P_tmpdir);
+
+  // The window is never shown, it only provides the GL context.
+  SDL_Window* sdlWindow = SDL_CreateWindow("VRB OBJ Benchmark", 0, 0, 64, 64, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  if (!sdlWindow) {
+    VRB_ERROR("SDL Failed to create window.");
+    return 1;
+  }
+  SDL_GLContext sdlContext = SDL_GL_CreateContext(sdlWindow);
+  SDL_GL_SetSwapInterval(0);
+  render->InitializeGL();
+  VRB_GL_CHECK(glEnable(GL_DEPTH_TEST));
+  VRB_GL_CHECK(glEnable(GL_CULL_FACE));
+  VRB_GL_CHECK(glEnable(GL_BLEND));
+  VRB_GL_CHECK(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+
+  printf("[\n");
+  for (size_t ix = 0; ix < aFiles.size(); ix++) {
+    RunBenchmark(render, aFiles[ix], aCacheDirectory, aFrameCount, (ix + 1) == aFiles.size());
+  }
+  printf("]\n");
+
+  render->ShutdownGL();
+  SDL_GL_DeleteContext(sdlContext);
+  SDL_DestroyWindow(sdlWindow);
+  return 0;
+}
+
 int
 main(int argc, char* argv[]) {
   vrb::InitializeObjectCounter();
-  if (argc != 2) {
-    VRB_ERROR("Usage: %s <file name>", argv[0]);
+  if ((argc > 1) && (std::string(argv[1]) == "--bench")) {
+    // --bench <frame count> [--cache <model cache directory>] <file name>...
+    std::vector<std::string> files;
+    std::string cacheDirectory;
+    const int kFrameCount = argc > 2 ? std::max(2, atoi(argv[2])) : 0;
+    for (int ix = 3; ix < argc; ix++) {
+      if ((std::string(argv[ix]) == "--cache") && ((ix + 1) < argc)) {
+        cacheDirectory = argv[++ix];
+      } else {
+        files.push_back(argv[ix]);
+      }
+    }
+    if ((kFrameCount == 0) || files.empty()) {
+      VRB_ERROR("Usage: %s --bench <frame count> [--cache <model cache directory>] <file name>...", argv[0]);
+      return 1;
+    }
+    const int kResult = RunBenchmarks(files, cacheDirectory, kFrameCount);
+    vrb::ShutdownObjectCounter();
+    return kResult;
+  }
+  if ((argc != 2) && (argc != 3)) {
+    VRB_ERROR("Usage: %s <file name> [model cache directory]", argv[0]);
+    VRB_ERROR("       %s --bench <frame count> [--cache <model cache directory>] <file name>...", argv[0]);
     return 1;
   }
 
@@ -93,7 +300,18 @@ main(int argc, char* argv[]) {
   parser->SetObserver(factory);
   vrb::GroupPtr group = vrb::Group::Create(create);
   factory->SetModelRoot(root);
-  parser->LoadModel(argv[1]);
+  vrb::ModelCacheObjPtr cache = vrb::ModelCacheObj::Create(create);
+  if (argc == 3) {
+    cache->SetCacheDirectory(argv[2]);
+  }
+  // The parser only holds a weak reference to its observer so the recorder
+  // must outlive the load.
+  vrb::ParserObserverObjPtr recorder;
+  if (!cache->LoadModel(argv[1], *factory)) {
+    recorder = cache->CreateRecorder(argv[1], factory);
+    parser->SetObserver(recorder);
+    parser->LoadModel(argv[1]);
+  }
 
   vrb::Vector min = vrb::Vector::Max();
   vrb::Vector max = vrb::Vector::Min();
@@ -103,12 +321,7 @@ main(int argc, char* argv[]) {
     if (geo) {
       vrb::VertexArrayPtr verts = geo->GetVertexArray();
       if (verts) {
-        const int size = verts->GetVertexCount();
-        for (int index = 0; index < size; index++) {
-           const vrb::Vector& vertex = verts->GetVertex(index);
-           min.ContractInPlace(vertex);
-           max.ExpandInPlace(vertex);
-        }
+        vrb::ExtendBounds(verts->GetVertexData(), (size_t)verts->GetVertexCount(), min, max);
       }
     }
 
@@ -152,6 +365,9 @@ main(int argc, char* argv[]) {
     camera->SetTransform(vrb::Matrix::Translation(cameraOffset));
     render->Update();
     drawList->Reset();
+    cullVisitor->Reset();
+    cullVisitor->SetFrustum(vrb::Frustum::FromCamera(*camera));
+    cullVisitor->SetCamera(*camera);
     root->Cull(*cullVisitor, *drawList);
     drawList->Draw(*camera);
     SDL_GL_SwapWindow(sdlWindow);
@@ -24,19 +24,24 @@ public:
   AnimatedTransform& AddStaticTransform(const Matrix& aTransform);
   AnimatedTransform& AddRotationAnimation(const Vector& aAxis, const float aAngularVelocity);
   AnimatedTransform& AddTranslationAnimation(const Vector& aDirection, const float aSpeed);
+  // Samples aTrack, which may be shared with other transforms, at the play
+  // time. With aLoop the track starts over after its last key.
+  AnimatedTransform& AddKeyframeAnimation(const KeyframeTrackPtr& aTrack, const bool aLoop = true);
 
   // Transform Interface
+  using Transform::SetTransform;
   void SetTransform(const Matrix& aTransform) override;
 protected:
   struct State;
   AnimatedTransform(State& aState, CreationContextPtr& aContext);
-  ~AnimatedTransform() = default;
+  ~AnimatedTransform();
 
   // Updatable Interface
   void UpdateResource(RenderContext& aContext) override;
 
 private:
   State& m;
+  friend class TransformAnimator;
   VRB_NO_DEFAULTS(AnimatedTransform);
 };
 
@@ -0,0 +1,29 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_ASSET_ID_DOT_H
+#define VRB_ASSET_ID_DOT_H
+
+#include <stdint.h>
+#include <string>
+
+namespace vrb {
+
+// Compact process wide ID of an asset path or shader key. Interning hashes
+// the string once, after which caches are indexed by the ID without hashing
+// or locking, see TextureCache and ProgramFactory. IDs are never reused and
+// are dense, starting at 1.
+typedef uint32_t AssetID;
+const AssetID kInvalidAssetID = 0;
+
+// Returns the ID of aName, assigning one the first time aName is seen. An
+// empty name is kInvalidAssetID. May be called from any thread.
+AssetID InternAsset(const std::string& aName);
+// The name aID was interned from, empty for kInvalidAssetID. Lock free.
+const std::string& GetAssetName(const AssetID aID);
+
+} // namespace vrb
+
+#endif // VRB_ASSET_ID_DOT_H
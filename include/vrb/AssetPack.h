@@ -0,0 +1,51 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_ASSET_PACK_DOT_H
+#define VRB_ASSET_PACK_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vrb {
+
+// Read only archive of many files in a single mapping. A table of contents
+// after the header gives the name, offset and size of each entry, and every
+// entry starts on a 16 KiB boundary so it can be mapped on its own and
+// parsed in place, e.g. the mip chain of a KTX file. Opening a pack costs
+// one mapping instead of one open and mapping per file. Entries are never
+// compressed, store the pack uncompressed in the APK. May be used from any
+// thread once created.
+class AssetPack {
+public:
+  // Parses the table of contents of aMapping, returns nullptr when it is not
+  // a valid pack.
+  static AssetPackPtr Create(const MappedFilePtr& aMapping);
+  // Writes each pair of entry name and source file of aFiles into a new pack
+  // at aFileName. Returns false when a source can not be read or the pack
+  // can not be written.
+  static bool Write(const std::string& aFileName, const std::vector<std::pair<std::string, std::string> >& aFiles);
+  int32_t GetEntryCount() const;
+  bool Contains(const std::string& aName) const;
+  // View of the entry aName that keeps the pack mapped, nullptr when the
+  // pack has no such entry.
+  MappedFilePtr MapEntry(const std::string& aName) const;
+protected:
+  struct State;
+  AssetPack(State& aState);
+  ~AssetPack();
+private:
+  State& m;
+  AssetPack() = delete;
+  VRB_NO_DEFAULTS(AssetPack)
+};
+
+} // namespace vrb
+
+#endif // VRB_ASSET_PACK_DOT_H
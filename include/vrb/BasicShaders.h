@@ -6,7 +6,29 @@
 #ifndef VRB_BASIC_SHADERS_DOT_H
 #define VRB_BASIC_SHADERS_DOT_H
 
-#define VRB_MAX_LIGHTS 2
+// Lights given to a single draw. Point lights are only counted against it
+// for the draws within their range.
+#define VRB_MAX_LIGHTS 4
+// Views drawn by a FeatureMultiview program.
+#define VRB_MAX_VIEWS 2
+// Uniform buffer binding of the vrb_Camera block of FeatureLateLatch programs.
+#define VRB_CAMERA_BLOCK_BINDING 0
+// Uniform buffer binding of the vrb_Material block of FeatureMaterialBlock
+// programs.
+#define VRB_MATERIAL_BLOCK_BINDING 1
+// Size of the joint palette of a FeatureSkinning program. Each joint uses four
+// vertex uniform vectors.
+#define VRB_MAX_JOINTS 64
+// Attribute locations bound before linking, so a vertex array object set up
+// for a program also draws with its FeatureDepthOnly variant. The instance
+// model matrix uses four consecutive locations.
+#define VRB_ATTRIBUTE_POSITION 0
+#define VRB_ATTRIBUTE_NORMAL 1
+#define VRB_ATTRIBUTE_UV 2
+#define VRB_ATTRIBUTE_COLOR 3
+#define VRB_ATTRIBUTE_JOINT_INDICES 4
+#define VRB_ATTRIBUTE_JOINT_WEIGHTS 5
+#define VRB_ATTRIBUTE_INSTANCE_MODEL 6
 
 namespace vrb {
 
@@ -15,6 +37,8 @@ const char* GetFragmentShaderSource();
 const char* GetFragmentTextureShaderSource();
 const char* GetFragmentSurfaceTextureShaderSource();
 const char* GetFragmentCubeMapTextureShaderSource();
+const char* GetFragmentTextureArrayShaderSource();
+const char* GetFragmentDepthOnlyShaderSource();
 
 } // namespace vrb
 
@@ -0,0 +1,47 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_BATCH_MATH_DOT_H
+#define VRB_BATCH_MATH_DOT_H
+
+#include "vrb/Forward.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vrb {
+
+// Kernels over packed arrays of xyz float triples, such as the data returned
+// by VertexArray::GetVertexData(). Input and output may be the same array.
+
+// Affine transform of positions. The w component is assumed to be one.
+void TransformPoints(const Matrix& aTransform, const float* aPoints, float* aResult, const size_t aCount);
+// Transforms directions by the upper 3x3 of aTransform without normalizing.
+void TransformNormals(const Matrix& aTransform, const float* aNormals, float* aResult, const size_t aCount);
+// Grows aMin and aMax to contain every point.
+void ExtendBounds(const float* aPoints, const size_t aCount, Vector& aMin, Vector& aMax);
+// Adds the area weighted normal of each triangle to the three entries of
+// aNormals referenced by its zero based vertex indices.
+void AccumulateNormals(const float* aPoints, const uint32_t* aTriangles, const size_t aTriangleCount, float* aNormals);
+void NormalizeVectors(float* aVectors, const size_t aCount);
+
+// The same kernels over 16 byte aligned xyzw entries, such as
+// VertexArray::GetPaddedVertices(). Every entry is one full width load and
+// store. Points keep w, directions are transformed as if w were zero.
+void TransformPoints(const Matrix& aTransform, const Vector4* aPoints, Vector4* aResult, const size_t aCount);
+void TransformNormals(const Matrix& aTransform, const Vector4* aNormals, Vector4* aResult, const size_t aCount);
+void ExtendBounds(const Vector4* aPoints, const size_t aCount, Vector& aMin, Vector& aMax);
+// Only extends by the points referenced by aIndices. aIndexBase is
+// subtracted from each index, one for the corners of a Geometry, and indices
+// outside of the aPointCount points are skipped.
+void ExtendBounds(const Vector4* aPoints, const size_t aPointCount, const uint32_t* aIndices, const size_t aIndexCount,
+                  const uint32_t aIndexBase, Vector& aMin, Vector& aMax);
+// The w component of aNormals is left unchanged.
+void AccumulateNormals(const Vector4* aPoints, const uint32_t* aTriangles, const size_t aTriangleCount, Vector4* aNormals);
+void NormalizeVectors(Vector4* aVectors, const size_t aCount);
+
+} // namespace vrb
+
+#endif // VRB_BATCH_MATH_DOT_H
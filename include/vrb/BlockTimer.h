@@ -2,6 +2,7 @@
 #define VRB_BLOCK_TIMER_H
 
 #include <functional>
+#include <stdint.h>
 #include "vrb/MacroUtils.h"
 
 namespace vrb {
@@ -27,7 +28,8 @@ private:
   const char* mFunctionName;
   const int mLineNumber;
   const double mMaxTime;
-  double mStartTime;
+  // Nanoseconds from TraceGetTime().
+  uint64_t mStartTime;
   BlockTimerCallback mCallback;
   BlockTimer() = delete;
   VRB_NO_DEFAULTS(BlockTimer)
@@ -0,0 +1,145 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_BOUNDING_VOLUME_HIERARCHY_DOT_H
+#define VRB_BOUNDING_VOLUME_HIERARCHY_DOT_H
+
+#include "vrb/Bounds.h"
+#include "vrb/Vector.h"
+
+#include <cstdint>
+#include <utility>
+#include <limits>
+#include <vector>
+
+namespace vrb {
+
+// Binary tree of boxes over a list of items, each identified by its index in
+// the bounds given to Build. Items must have finite, non empty bounds.
+class BoundingVolumeHierarchy {
+public:
+  BoundingVolumeHierarchy() : mBuiltArea(0.0f) {}
+
+  void Build(const std::vector<Bounds>& aBounds);
+  // Updates the boxes for items that moved without changing the tree. Returns
+  // false when the tree got much worse than when it was built and should be
+  // rebuilt. aBounds must hold as many items as given to Build.
+  bool Refit(const std::vector<Bounds>& aBounds);
+  void Clear();
+  bool IsEmpty() const { return mNodes.empty(); }
+  size_t GetItemCount() const { return mItems.size(); }
+
+  // Appends every item for which aTest(bounds) holds, skipping the subtrees
+  // whose box fails it.
+  template <typename Test>
+  void Query(const Test& aTest, std::vector<uint32_t>& aResult) const {
+    if (mNodes.empty()) {
+      return;
+    }
+    uint32_t stack[kMaxDepth];
+    size_t depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+      const Node& node = mNodes[stack[--depth]];
+      if (!aTest(node.bounds)) {
+        continue;
+      }
+      if (node.count > 0) {
+        aResult.insert(aResult.end(), mItems.begin() + node.first, mItems.begin() + node.first + node.count);
+        continue;
+      }
+      stack[depth++] = node.first;
+      stack[depth++] = (uint32_t)(&node - mNodes.data()) + 1;
+    }
+  }
+
+  // Calls aVisit(item, entry distance, aMaxDistance) for the items whose box
+  // is entered by the ray before aMaxDistance, nearest boxes first. aVisit may lower
+  // aMaxDistance to prune the subtrees that are farther away.
+  template <typename Visit>
+  void RayQuery(const Vector& aOrigin, const Vector& aDirection, float& aMaxDistance, const Visit& aVisit) const {
+    float distance = 0.0f;
+    if (mNodes.empty() || !mNodes[0].bounds.IntersectsRay(aOrigin, aDirection, distance) || (distance > aMaxDistance)) {
+      return;
+    }
+    struct Entry {
+      uint32_t node;
+      float distance;
+    };
+    Entry stack[kMaxDepth];
+    size_t depth = 0;
+    stack[depth++] = Entry{0, distance};
+    while (depth > 0) {
+      const Entry kEntry = stack[--depth];
+      if (kEntry.distance > aMaxDistance) {
+        continue;
+      }
+      const Node& node = mNodes[kEntry.node];
+      if (node.count > 0) {
+        for (uint32_t ix = node.first; ix < (node.first + node.count); ix++) {
+          if (mItemBounds[ix].IntersectsRay(aOrigin, aDirection, distance) && (distance <= aMaxDistance)) {
+            aVisit(mItems[ix], distance, aMaxDistance);
+          }
+        }
+        continue;
+      }
+      Entry near{kEntry.node + 1, 0.0f};
+      Entry far{node.first, 0.0f};
+      const bool kHitNear = mNodes[near.node].bounds.IntersectsRay(aOrigin, aDirection, near.distance) && (near.distance <= aMaxDistance);
+      const bool kHitFar = mNodes[far.node].bounds.IntersectsRay(aOrigin, aDirection, far.distance) && (far.distance <= aMaxDistance);
+      if (kHitNear && kHitFar && (far.distance < near.distance)) {
+        std::swap(near, far);
+      }
+      // The nearest child is pushed last so it is visited first.
+      if (kHitFar) {
+        stack[depth++] = far;
+      }
+      if (kHitNear) {
+        stack[depth++] = near;
+      }
+    }
+  }
+
+  // Returns the nearest item whose box is hit by the ray and for which
+  // aAccept(item) holds, or -1. aDistance receives the entry distance.
+  template <typename Accept>
+  int32_t Raycast(const Vector& aOrigin, const Vector& aDirection, const Accept& aAccept, float& aDistance) const {
+    int32_t result = -1;
+    float nearest = std::numeric_limits<float>::infinity();
+    RayQuery(aOrigin, aDirection, nearest, [&](const uint32_t aItem, const float aDistance, float& aMaxDistance) {
+      if ((aDistance < aMaxDistance) && aAccept(aItem)) {
+        aMaxDistance = aDistance;
+        result = (int32_t)aItem;
+      }
+    });
+    aDistance = nearest;
+    return result;
+  }
+
+private:
+  // Items are split at the median so the depth stays logarithmic.
+  static const size_t kMaxDepth = 64;
+  static const uint32_t kMaxLeafItems = 4;
+
+  // Leaves have a count and index mItems from first. Inner nodes have their
+  // left child just after them and their right child at first.
+  struct Node {
+    Bounds bounds;
+    uint32_t first;
+    uint32_t count;
+  };
+
+  uint32_t BuildNode(const uint32_t aStart, const uint32_t aEnd, const std::vector<Vector>& aCenters);
+  float TotalArea() const;
+
+  std::vector<Node> mNodes;
+  std::vector<uint32_t> mItems;
+  std::vector<Bounds> mItemBounds;
+  float mBuiltArea;
+};
+
+} // namespace vrb
+
+#endif // VRB_BOUNDING_VOLUME_HIERARCHY_DOT_H
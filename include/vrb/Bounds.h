@@ -0,0 +1,165 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_BOUNDS_DOT_H
+#define VRB_BOUNDS_DOT_H
+
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace vrb {
+
+// Axis aligned bounding box. An empty box contains nothing and an infinite
+// box contains everything, which is used for nodes that can not be bounded.
+class Bounds {
+public:
+  static Bounds Empty() { return Bounds(); }
+  static Bounds Infinite() {
+    Bounds result;
+    result.m.infinite = true;
+    return result;
+  }
+
+  Bounds() {}
+  Bounds(const Vector& aMin, const Vector& aMax) {
+    m.min = aMin;
+    m.max = aMax;
+    m.empty = false;
+  }
+
+  bool IsEmpty() const { return m.empty && !m.infinite; }
+  bool IsInfinite() const { return m.infinite; }
+  const Vector& Min() const { return m.min; }
+  const Vector& Max() const { return m.max; }
+  Vector Center() const { return (m.min + m.max) * 0.5f; }
+  Vector Extents() const { return (m.max - m.min) * 0.5f; }
+
+  Bounds& Extend(const Vector& aPoint) {
+    if (m.empty) {
+      m.min = aPoint;
+      m.max = aPoint;
+      m.empty = false;
+      return *this;
+    }
+    m.min.ContractInPlace(aPoint);
+    m.max.ExpandInPlace(aPoint);
+    return *this;
+  }
+
+  Bounds& Extend(const Bounds& aBounds) {
+    if (aBounds.m.infinite) {
+      m.infinite = true;
+    } else if (!aBounds.m.empty) {
+      Extend(aBounds.m.min);
+      Extend(aBounds.m.max);
+    }
+    return *this;
+  }
+
+  // Slab test of the ray starting at aOrigin along aDirection, which does not
+  // need to be normalized. aDistance receives the entry distance along the
+  // ray in units of aDirection, 0 when aOrigin is inside of the box.
+  bool IntersectsRay(const Vector& aOrigin, const Vector& aDirection, float& aDistance) const {
+    if (m.infinite) {
+      aDistance = 0.0f;
+      return true;
+    }
+    if (m.empty) {
+      return false;
+    }
+    float nearest = 0.0f;
+    float farthest = std::numeric_limits<float>::infinity();
+    for (int32_t axis = 0; axis < 3; axis++) {
+      const float kOrigin = Axis(aOrigin, axis);
+      const float kDirection = Axis(aDirection, axis);
+      const float kMin = Axis(m.min, axis);
+      const float kMax = Axis(m.max, axis);
+      if (kDirection == 0.0f) {
+        if ((kOrigin < kMin) || (kOrigin > kMax)) {
+          return false;
+        }
+        continue;
+      }
+      float entry = (kMin - kOrigin) / kDirection;
+      float exit = (kMax - kOrigin) / kDirection;
+      if (entry > exit) {
+        std::swap(entry, exit);
+      }
+      nearest = std::max(nearest, entry);
+      farthest = std::min(farthest, exit);
+      if (nearest > farthest) {
+        return false;
+      }
+    }
+    aDistance = nearest;
+    return true;
+  }
+
+  // Squared distance from aPoint to the nearest point in the box, zero when
+  // the box contains it. Nothing is near an empty box.
+  float DistanceSquared(const Vector& aPoint) const {
+    if (m.infinite) {
+      return 0.0f;
+    }
+    if (m.empty) {
+      return std::numeric_limits<float>::infinity();
+    }
+    float result = 0.0f;
+    for (int32_t axis = 0; axis < 3; axis++) {
+      const float kValue = Axis(aPoint, axis);
+      const float kOutside = std::max(std::max(Axis(m.min, axis) - kValue, kValue - Axis(m.max, axis)), 0.0f);
+      result += kOutside * kOutside;
+    }
+    return result;
+  }
+
+  // Half of the surface area, used to compare the quality of hierarchies.
+  float HalfArea() const {
+    if (m.infinite || m.empty) {
+      return 0.0f;
+    }
+    const Vector size = m.max - m.min;
+    return (size.x() * size.y()) + (size.y() * size.z()) + (size.z() * size.x());
+  }
+
+  // Returns the box enclosing this box after it has been transformed by aTransform.
+  Bounds Transform(const Matrix& aTransform) const {
+    if (m.infinite || m.empty) {
+      return *this;
+    }
+    const Vector center = aTransform.MultiplyPosition(Center());
+    const Vector extents = Extents();
+    float result[3];
+    for (int32_t row = 0; row < 3; row++) {
+      result[row] = std::fabs(aTransform.At(0, row)) * extents.x() +
+                    std::fabs(aTransform.At(1, row)) * extents.y() +
+                    std::fabs(aTransform.At(2, row)) * extents.z();
+    }
+    const Vector transformed(result[0], result[1], result[2]);
+    return Bounds(center - transformed, center + transformed);
+  }
+
+private:
+  static float Axis(const Vector& aVector, const int32_t aAxis) {
+    return aAxis == 0 ? aVector.x() : (aAxis == 1 ? aVector.y() : aVector.z());
+  }
+
+  struct Data {
+    Vector min;
+    Vector max;
+    bool empty;
+    bool infinite;
+    Data() : min(0.0f, 0.0f, 0.0f), max(0.0f, 0.0f, 0.0f), empty(true), infinite(false) {}
+  };
+  Data m;
+};
+
+} // namespace vrb
+
+#endif // VRB_BOUNDS_DOT_H
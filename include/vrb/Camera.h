@@ -16,6 +16,16 @@ public:
   virtual const Matrix& GetTransform() const = 0;
   virtual const Matrix& GetView() const = 0;
   virtual const Matrix& GetPerspective() const = 0;
+  // Perspective * view and its frustum, cached by the camera until either
+  // changes so culling and uniform setup do not rebuild them.
+  virtual const Matrix& GetViewProjection() const = 0;
+  virtual const Frustum& GetFrustum() const = 0;
+  // Cameras rendering several views in a single OVR_multiview pass. The
+  // view and perspective at aIndex are used where gl_ViewID_OVR == aIndex.
+  virtual int GetViewCount() const { return 1; }
+  virtual const Matrix& GetViewAt(const int aIndex) const { return GetView(); }
+  virtual const Matrix& GetPerspectiveAt(const int aIndex) const { return GetPerspective(); }
+  virtual const Matrix& GetViewProjectionAt(const int aIndex) const { return GetViewProjection(); }
 
 protected:
   Camera() {}
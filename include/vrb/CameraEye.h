@@ -20,6 +20,8 @@ public:
   const Matrix& GetTransform() const override;
   const Matrix& GetView() const override;
   const Matrix& GetPerspective() const override;
+  const Matrix& GetViewProjection() const override;
+  const Frustum& GetFrustum() const override;
 
   // CameraEye interface
   void SetPerspective(const Matrix& aPerspective);
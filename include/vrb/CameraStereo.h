@@ -0,0 +1,49 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_CAMERA_STEREO_DOT_H
+#define VRB_CAMERA_STEREO_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include "vrb/Camera.h"
+
+namespace vrb {
+
+// Draws both eyes in one pass into a multiview FBO. Programs created with
+// FeatureMultiview read view ix from eye ix. Culling with
+// Frustum::FromCamera() uses a frustum containing both eyes. The single view
+// accessors return the left eye, which DrawableList uses for depth sorting.
+class CameraStereo : public Camera {
+public:
+  static CameraStereoPtr Create(CreationContextPtr& aContext);
+  // Camera interface
+  const Matrix& GetTransform() const override;
+  const Matrix& GetView() const override;
+  const Matrix& GetPerspective() const override;
+  const Matrix& GetViewProjection() const override;
+  const Frustum& GetFrustum() const override;
+  int GetViewCount() const override;
+  const Matrix& GetViewAt(const int aIndex) const override;
+  const Matrix& GetPerspectiveAt(const int aIndex) const override;
+  const Matrix& GetViewProjectionAt(const int aIndex) const override;
+
+  // CameraStereo interface
+  void SetEyes(const CameraEyePtr& aLeft, const CameraEyePtr& aRight);
+  CameraEyePtr GetEye(const int aIndex) const;
+protected:
+  struct State;
+  CameraStereo(State& aState, CreationContextPtr& aContext);
+  ~CameraStereo();
+private:
+  State& m;
+  CameraStereo() = delete;
+  VRB_NO_DEFAULTS(CameraStereo)
+};
+
+} // namespace vrb
+
+#endif // VRB_CAMERA_STEREO_DOT_H
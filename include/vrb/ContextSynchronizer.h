@@ -19,13 +19,18 @@ public:
 class ContextSynchronizer {
 public:
   static ContextSynchronizerPtr Create(RenderContextPtr& aContext);
-  void BindToThread();
   void RegisterObserver(ContextSynchronizerObserverPtr& aObserver);
   void ReleaseObserver(ContextSynchronizerObserverPtr& aObserver);
+  // Moves the lists into a batch that the render thread adopts during its
+  // next Signal() and returns without waiting. Observers and aCallback, which
+  // may be empty, are called on the render thread once the batch is adopted.
+  // May be called from any number of threads as long as each passes lists
+  // that only it appends to.
   void AdoptLists(
       ResourceGLList& aUninitializedResources,
       ResourceGLList& aResources,
-      UpdatableList& aUpdatables);
+      UpdatableList& aUpdatables,
+      const ContextsSynchronizedLambda& aCallback);
   void Signal(bool& aIsActive);
   void Release();
 protected:
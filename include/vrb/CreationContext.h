@@ -7,23 +7,57 @@
 #define VRB_CREATION_CONTEXT_DOT_H
 
 #include "vrb/Forward.h"
+#include "vrb/AssetID.h"
+#include "vrb/JobSystem.h"
 #include "vrb/MacroUtils.h"
 
 namespace vrb {
 
+// Collects the GL resources and updatables created off the render thread
+// until they are handed to it. Any number of threads may create resources
+// with the same context: the thread it is bound to appends to the context
+// lists and every other thread to lists of its own, so no thread waits on
+// another. Each thread hands off only what it created when it synchronizes.
 class CreationContext {
 public:
   static CreationContextPtr Create(RenderContextPtr& aContext);
+  // Optional. Only resources of the bound thread are seen by
+  // UpdateResourceGL().
   void BindToThread();
+  // Hands resources created on this thread to the render thread without
+  // waiting for it. The render thread adopts them during RenderContext::Update().
   void Synchronize();
+  // As above but always hands off a batch, even an empty one, and calls
+  // aCallback on the render thread once it has been adopted.
+  void Synchronize(const ContextsSynchronizedLambda& aCallback);
 
   void RegisterContextSynchronizerObserver(ContextSynchronizerObserverPtr& aObserver);
   void ReleaseContextSynchronizerObserver(ContextSynchronizerObserverPtr& aObserver);
   void SetFileReader(FileReaderPtr aFileReader);
   DataCachePtr GetDataCache();
   FileReaderPtr GetFileReader();
+  // Shared with the RenderContext, never null.
+  GLDeletionQueuePtr GetGLDeletionQueue();
+  GLExtensionsPtr GetGLExtensions();
+  JobSystemPtr GetJobSystem();
+  KTX2DecoderPtr GetKTX2Decoder();
+  MaterialRegistryPtr GetMaterialRegistry();
   ProgramFactoryPtr GetProgramFactory();
+  SamplerCachePtr GetSamplerCache();
+  StreamBufferPtr GetStreamBuffer();
+  TextureDiskCachePtr GetTextureDiskCache();
+  // Levels stored in the TextureDiskCache by an earlier run are used instead
+  // of decoding the file again.
   TextureGLPtr LoadTexture(const std::string& TextureName, const bool aUseCache = true);
+  // Same as above for an interned texture path. The cache lookup is lock free.
+  TextureGLPtr LoadTexture(const AssetID aTextureID, const bool aUseCache = true);
+  // Same as above but, when the FileReader supports concurrent reads, the
+  // file is read and decoded by a job scheduled as a child of aGroup. aGroup
+  // must be run and waited on before resources are synchronized.
+  TextureGLPtr PrefetchTexture(const AssetID aTextureID, const JobSystem::JobHandle& aGroup);
+  // Initializes the resources of the bound thread that support off render
+  // thread initialization. Must not run while the bound thread creates
+  // resources.
   void UpdateResourceGL();
   void AddResourceGL(ResourceGL* aResource);
   void AddUpdatable(Updatable* aUpdatable);
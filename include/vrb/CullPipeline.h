@@ -0,0 +1,61 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_CULL_PIPELINE_DOT_H
+#define VRB_CULL_PIPELINE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+namespace vrb {
+
+// Culls the next frame on the JobSystem of the CreationContext while the
+// current one is drawn, so a CPU bound frame costs the longer of cull and
+// draw instead of both. Cull() starts culling into one of two DrawableLists
+// and Draw() draws the other one, filled by the previous Cull(), then waits
+// for the cull to finish and swaps them. Each frame is drawn one Cull()
+// after it was culled, the first Draw() draws nothing.
+//
+// Cull() takes the snapshot of the scene: nodes must not be changed, added
+// or removed from Cull() until Draw() returns. Changes are committed after
+// Draw() and before the next Cull(). The lists hold a reference to their
+// drawables, so removed nodes stay alive until drawn. The CullVisitor
+// frustum should cover the head motion of a frame, see
+// Frustum::FromCamera(). Occlusion culling is not supported, the
+// OcclusionCuller queries the bounds of the last cull against the depth
+// drawn after it. Must be used on the render thread.
+class CullPipeline {
+public:
+  static CullPipelinePtr Create(CreationContextPtr& aContext);
+  // aVisitor is used by the cull job and must not be changed until Draw()
+  // returns.
+  void Cull(const NodePtr& aRoot, CullVisitor& aVisitor);
+  // Same as above for a flattened scene graph. See SetParallelCulling.
+  void Cull(const SceneSnapshotPtr& aSnapshot, CullVisitor& aVisitor);
+  void Draw(const Camera& aCamera);
+  // Waits for a pending cull and drops both lists, for example before the
+  // scene graph is destroyed.
+  void Flush();
+  // Every Cull() of a snapshot replaces its ParallelCuller. When enabled it
+  // is given one owned by the pipeline for each list, otherwise none.
+  // Disabled by default.
+  void SetParallelCulling(const bool aEnabled);
+  // See DrawableList::SetSortingEnabled. Enabled by default.
+  void SetSortingEnabled(const bool aEnabled);
+
+protected:
+  struct State;
+  CullPipeline(State& aState, CreationContextPtr& aContext);
+  ~CullPipeline();
+
+private:
+  State& m;
+  CullPipeline() = delete;
+  VRB_NO_DEFAULTS(CullPipeline)
+};
+
+} // namespace vrb
+
+#endif // VRB_CULL_PIPELINE_DOT_H
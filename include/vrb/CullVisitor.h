@@ -16,7 +16,34 @@ public:
   static CullVisitorPtr Create(CreationContextPtr& aContext);
   const Matrix& GetTransform() const;
   void PushTransform(const Matrix& aTransform);
+  // Same as above for a transform known to be affine, see Matrix::IsAffine(),
+  // which is composed with fewer products.
+  void PushAffineTransform(const Matrix& aTransform);
   void PopTransform();
+  // Discards any transforms left on the stack. Storage is kept for the next pass.
+  void Reset();
+  // Copies the frustum, camera and occlusion culler of aParent and starts
+  // from its current transform. Used to continue a pass on another thread.
+  void Inherit(const CullVisitor& aParent);
+  // Bounds are tested against the frustum in world space. Without a frustum
+  // every node is visible.
+  void SetFrustum(const Frustum& aFrustum);
+  void ClearFrustum();
+  bool IsVisible(const Bounds& aBounds) const;
+  // The camera is used to estimate the screen size of nodes.
+  void SetCamera(const Camera& aCamera);
+  void ClearCamera();
+  // Sets aEye to the world space position of the camera. Returns false
+  // without a camera.
+  bool GetEye(Vector& aEye) const;
+  // Fraction of the view height covered by the bounding sphere of aBounds,
+  // in local space. Without a camera every node covers the whole view.
+  float GetScreenCoverage(const Bounds& aBounds) const;
+  // Groups with occlusion culling enabled are checked against aCuller.
+  // Pass nullptr to stop occlusion culling.
+  void SetOcclusionCuller(const OcclusionCullerPtr& aCuller);
+  // True if aNode, with aBounds in local space, was hidden in previous frames.
+  bool IsOccluded(const Node& aNode, const Bounds& aBounds);
 
 protected:
   struct State;
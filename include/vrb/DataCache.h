@@ -9,14 +9,48 @@
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 
+#include <string>
+
 namespace vrb {
 
 class DataCache {
 public:
+  struct Stats {
+    // Bytes stored in and read from the cache files.
+    uint64_t bytesWritten;
+    uint64_t bytesRead;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t compressedEntries;
+    double compressSeconds;
+    double decompressSeconds;
+    Stats()
+        : bytesWritten(0)
+        , bytesRead(0)
+        , hits(0)
+        , misses(0)
+        , compressedEntries(0)
+        , compressSeconds(0.0)
+        , decompressSeconds(0.0)
+    {}
+  };
   static DataCachePtr Create();
   void SetCachePath(const std::string& aPath);
+  // Data can only be cached once a path is set.
+  bool HasCachePath() const;
   uint32_t CacheData(std::unique_ptr<uint8_t[]>& aData, const size_t aDataSize);
+  // Copies the cached data into aData.
   size_t LoadData(const uint32_t aHandle, std::unique_ptr<uint8_t[]>& aData);
+  // Returns a read only view of the cached data, valid until the handle is
+  // removed or the DataCache is destroyed. Returns null for compressed
+  // entries, which must be read with LoadData.
+  const uint8_t* MapData(const uint32_t aHandle, size_t& aSize);
+  // Entries that compress well are stored LZ4 compressed. Off by default.
+  void SetCompressionEnabled(const bool aEnabled);
+  Stats GetStats() const;
+  // Returns without waiting for a write or for loads of the entry, the
+  // writer thread frees it once they are done. The handle must not be used
+  // again.
   void RemoveData(const uint32_t aHandle);
 protected:
   struct State;
@@ -18,6 +18,15 @@ public:
   virtual RenderStatePtr& GetRenderState() = 0;
   virtual void SetRenderState(const RenderStatePtr& aRenderState) = 0;
   virtual void Draw(const Camera& aCamera, const Matrix& aModelTransform) = 0;
+  // Drawables returning the same non-null key and RenderState may be drawn
+  // with a single DrawInstanced call by the DrawableList.
+  virtual const void* GetInstancingKey() { return nullptr; }
+  virtual void DrawInstanced(const Camera& aCamera, const Matrix* aModelTransforms, const int32_t aCount) {}
+  // Drawables returning the same non-null key, RenderState and transform draw
+  // parts of one buffer and may be drawn with a single DrawBatch call on any
+  // of them, which is given every drawable of the batch, itself included.
+  virtual const void* GetBatchKey() { return nullptr; }
+  virtual void DrawBatch(const Camera& aCamera, const Matrix& aModelTransform, Drawable* const* aBatch, const int32_t aCount) {}
 protected:
   struct State;
   Drawable(State& aState, CreationContextPtr& aContext);
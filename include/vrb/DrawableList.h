@@ -9,17 +9,60 @@
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 
+#include <functional>
+#include <vector>
+
 namespace vrb {
 
 class DrawableList {
 public:
+  typedef std::function<void(const int32_t aView)> ViewCallback;
   static DrawableListPtr Create(CreationContextPtr& aContext);
 
   void Reset();
   void PushLight(const Light& aLight);
   void PopLights(const int aCount);
-  void AddDrawable(DrawablePtr&& aDrawable, const Matrix& aTransform);
+  // The opaque drawables added between these calls are first drawn into the
+  // depth buffer only, by the FeatureDepthOnly variant of their program,
+  // then with GL_EQUAL and without depth writes, so each pixel is shaded
+  // once. Segments and recordings added meanwhile are included too. See
+  // Group::SetDepthPrePass().
+  void PushDepthPrePass();
+  void PopDepthPrePass();
+  // The DrawableList does not hold a reference to aDrawable. It must stay
+  // alive until the list is Reset, which the scene graph guarantees.
+  void AddDrawable(Drawable& aDrawable, const Matrix& aTransform);
+  // Resets aSegment and draws its drawables at this point of the list, under
+  // the current lights. aSegment may be filled from another thread until
+  // Draw is called. It must stay alive until this list is Reset.
+  void AddSegment(DrawableList& aSegment);
+  // Resets this list to record drawables for many frames, starting under
+  // the current lights of aParent. The recording stays valid while
+  // HasRecordedLights returns true for the list it is added to.
+  void BeginRecording(const DrawableList& aParent);
+  bool HasRecordedLights(const DrawableList& aParent) const;
+  // Draws the drawables of aRecording at this point of the list without
+  // resetting it. aRecording must not change until this list is Reset.
+  void AddRecording(DrawableList& aRecording);
   void Draw(const Camera& aCamera);
+  // Draws the list once for each camera, such as the CameraEyes of a
+  // device without multiview, after culling once with a frustum containing
+  // every view, see Frustum::FromStereo(). The list is sorted once, by the
+  // depth from the first camera. aBeginView, when set, is called with the
+  // index of each camera before it is drawn to bind its framebuffer or
+  // viewport.
+  void Draw(const std::vector<CameraPtr>& aCameras, const ViewCallback& aBeginView);
+  // When enabled, Draw orders opaque drawables by program, texture, RenderState
+  // and front to back depth, followed by transparent drawables back to front.
+  // Transparent drawables at the same depth keep the order they were added in.
+  // Drawables without a RenderState, such as Group render lambdas, are never
+  // reordered and nothing is moved across them. Enabled by default.
+  void SetSortingEnabled(const bool aEnabled);
+  // When enabled, the list and its segments hold a reference to every
+  // drawable until Reset, so nodes may be released before the list is
+  // drawn. Reset must then be called on the render thread. Disabled by
+  // default.
+  void SetRetainDrawables(const bool aRetain);
 
 protected:
   struct State;
@@ -10,6 +10,8 @@
 #include "vrb/MacroUtils.h"
 
 #include "vrb/gl.h"
+#include <cstdint>
+#include <functional>
 
 namespace vrb {
 
@@ -21,7 +23,22 @@ public:
     bool depth;
     bool multiview;
     int samples;
+    // Attachments whose contents are not needed once the FBO is unbound, so
+    // tiled GPUs may skip writing them back to memory. Depth defaults to true.
+    bool invalidateDepthOnUnbind;
+    bool invalidateColorOnUnbind;
+    // Previous contents are not needed when the FBO is bound, so tiled GPUs
+    // may skip loading them. Use when every frame clears the FBO.
+    bool invalidateOnBind;
+    // Shades the periphery of the color texture at a lower rate with
+    // QCOM_texture_foveated. Dropped when the extension is missing.
+    bool foveated;
   };
+  // Pixels of a frame read back with Readback(), RGBA8 rows bottom up. Only
+  // valid during the call.
+  typedef std::function<void(const uint8_t* aPixels, const int32_t aWidth, const int32_t aHeight)> ReadbackCallback;
+  // Foveation levels, from full rate everywhere to the strongest reduction.
+  static const int32_t kMaxFoveationLevel = 4;
   static FBOPtr Create(RenderContextPtr& aContext);
   bool IsValid() const;
   void SetTextureHandle(const GLuint aHandle,
@@ -29,9 +46,34 @@ public:
                         const int32_t aHeight,
                         const FBO::Attributes& aAttributes = {});
   void Bind(GLenum target = GL_FRAMEBUFFER);
+  // Invalidates the attachments requested in the Attributes before unbinding.
   void Unbind();
   const FBO::Attributes& GetAttributes() const;
   GLuint GetHandle() const;
+  // Color texture and size passed to SetTextureHandle().
+  GLuint GetTextureHandle() const;
+  void GetSize(int32_t& aWidth, int32_t& aHeight) const;
+  // Foveation of a foveated FBO. The level is clamped to
+  // [0, kMaxFoveationLevel] and applies from the next frame rendered into
+  // the FBO. The focal point of each eye, the layer for multiview and eye 0
+  // otherwise, is in normalized device coordinates and defaults to the
+  // center. Kept across SetTextureHandle() calls.
+  bool IsFoveated() const;
+  void SetFoveationLevel(const int32_t aLevel);
+  int32_t GetFoveationLevel() const;
+  void SetFocalPoint(const int32_t aEye, const float aX, const float aY);
+  // Asynchronous readback of the color attachment, for casting and capture.
+  // Readback() copies the current contents into one of a ring of pixel pack
+  // buffers and fences it without waiting. Copies the GPU has finished are
+  // delivered to aCallback from later Readback() calls, usually one or two
+  // frames later. A frame is dropped instead of stalling when every buffer
+  // is still in flight. A size smaller than the FBO downscales with a blit
+  // first, zero keeps the size of the FBO. Multiview FBOs read back layer
+  // 0. A null callback releases the buffers. Requires GLES3.
+  void SetReadbackCallback(const ReadbackCallback& aCallback, const int32_t aWidth = 0, const int32_t aHeight = 0);
+  // Call once the frame is rendered, before the color attachment is
+  // invalidated by Unbind(). Framebuffer bindings are restored.
+  void Readback();
 protected:
   struct State;
   FBO(State& aState);
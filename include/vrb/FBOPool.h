@@ -0,0 +1,48 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_FBO_POOL_DOT_H
+#define VRB_FBO_POOL_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/FBO.h"
+
+#include "vrb/gl.h"
+
+namespace vrb {
+
+// Recycles render targets for transient use. Each pooled FBO owns an RGBA8
+// color texture, a two layer GL_TEXTURE_2D_ARRAY for multiview attributes,
+// available through FBO::GetTextureHandle(). Released targets are reused by
+// later requests with the same size and attributes instead of reallocating
+// GPU memory. Must be used on the render thread.
+class FBOPool {
+public:
+  static FBOPoolPtr Create(RenderContextPtr& aContext);
+  // Returns a free target matching the request, creating one if needed.
+  // Returns nullptr if the FBO could not be created.
+  FBOPtr Acquire(const int32_t aWidth, const int32_t aHeight, const FBO::Attributes& aAttributes = {});
+  // Returns aFBO to the pool. It must not be used again by the caller.
+  void Release(const FBOPtr& aFBO);
+  // Deletes every target not currently acquired.
+  void Trim();
+  // Deletes every target. Acquired targets become invalid.
+  void Clear();
+  size_t GetFreeCount() const;
+  size_t GetAcquiredCount() const;
+protected:
+  struct State;
+  FBOPool(State& aState, RenderContextPtr& aContext);
+  ~FBOPool();
+private:
+  State& m;
+  FBOPool() = delete;
+  VRB_NO_DEFAULTS(FBOPool)
+};
+
+} // namespace vrb
+
+#endif // VRB_FBO_POOL_DOT_H
@@ -12,9 +12,28 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace vrb {
 
+// One mip level of one face of an image file. aTarget is GL_TEXTURE_2D or a
+// GL_TEXTURE_CUBE_MAP_* face target.
+struct ImageLevel {
+  GLenum target;
+  int level;
+  std::unique_ptr<uint8_t[]> data;
+  uint64_t length;
+  int width;
+  int height;
+  GLenum format;
+  ImageLevel() : target(GL_TEXTURE_2D), level(0), length(0), width(0), height(0), format(GL_RGBA) {}
+  ImageLevel(ImageLevel&&) = default;
+  ImageLevel& operator=(ImageLevel&&) = default;
+private:
+  ImageLevel(const ImageLevel&) = delete;
+  ImageLevel& operator=(const ImageLevel&) = delete;
+};
+
 class FileHandler {
 public:
   virtual void BindFileHandle(const std::string& aFileName, const int aFileHandle) = 0;
@@ -22,6 +41,16 @@ public:
   virtual void ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) = 0;
   virtual void FinishRawFile(const int aFileHandle) = 0;
   virtual void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) = 0;
+  // Called instead of ProcessImageFile by readers that decode every level and
+  // face of an image, ordered by face then level. Handlers may take ownership
+  // of the level data. The default passes the first level to ProcessImageFile.
+  virtual void ProcessImageLevels(const int aFileHandle, std::vector<ImageLevel>& aLevels) {
+    if (aLevels.empty()) {
+      return;
+    }
+    ImageLevel& first = aLevels.front();
+    ProcessImageFile(aFileHandle, first.data, first.length, first.width, first.height, first.format);
+  }
 protected:
   FileHandler() {}
   virtual ~FileHandler() {}
@@ -33,6 +62,13 @@ class FileReader {
 public:
   virtual void ReadRawFile(const std::string& aFileName, FileHandlerPtr aHandler) = 0;
   virtual void ReadImageFile(const std::string& aFileName, FileHandlerPtr aHandler) = 0;
+  // True when the read functions may be called from several threads at
+  // once. The handler is then called on the thread that started the read.
+  virtual bool SupportsConcurrentReads() const { return false; }
+  // A read only mapping of the whole file, so that loaders may use its
+  // contents in place for as long as they hold it. nullptr when the reader
+  // can not map the file, which must then be read with ReadRawFile.
+  virtual MappedFilePtr MapFile(const std::string& aFileName) { return nullptr; }
 protected:
   FileReader() {}
   virtual ~FileReader() {}
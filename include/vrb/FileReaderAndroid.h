@@ -21,6 +21,15 @@ public:
   static FileReaderAndroidPtr Create();
   void ReadRawFile(const std::string& aFileName, FileHandlerPtr aHandler) override;
   void ReadImageFile(const std::string& aFileName, FileHandlerPtr aHandler) override;
+  // Files given by absolute path, and assets stored uncompressed in the APK.
+  MappedFilePtr MapFile(const std::string& aFileName) override;
+  // Opens the AssetPack at aFileName, an absolute path or an asset stored
+  // uncompressed. Reads and mappings of a name found in the pack are served
+  // from it, later packs first, before falling back to the assets. Returns
+  // false when aFileName is not a valid pack.
+  bool AddAssetPack(const std::string& aFileName);
+  // Used for .ktx2 files, set by RenderContext.
+  void SetKTX2Decoder(const KTX2DecoderPtr& aDecoder);
   void Init(JNIEnv* aEnv, jobject& aAssetManager, const ClassLoaderAndroidPtr& classLoader);
   void Shutdown();
   void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat);
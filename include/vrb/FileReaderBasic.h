@@ -20,6 +20,15 @@ public:
   static FileReaderBasicPtr Create();
   void ReadRawFile(const std::string& aFileName, FileHandlerPtr aHandler) override;
   void ReadImageFile(const std::string& aFileName, FileHandlerPtr aHandler) override;
+  // Files are read and decoded synchronously by the calling thread.
+  bool SupportsConcurrentReads() const override { return true; }
+  MappedFilePtr MapFile(const std::string& aFileName) override;
+  // Opens the AssetPack at aFileName. Reads and mappings of a name found in
+  // the pack are served from it, later packs first, before falling back to
+  // the file system. Returns false when aFileName is not a valid pack.
+  bool AddAssetPack(const std::string& aFileName);
+  // Used for .ktx2 files, set by RenderContext.
+  void SetKTX2Decoder(const KTX2DecoderPtr& aDecoder);
 protected:
   struct State;
   FileReaderBasic(State& aState);
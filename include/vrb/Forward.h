@@ -14,6 +14,13 @@ namespace vrb {
 class AnimatedTransform;
 typedef  std::shared_ptr<AnimatedTransform> AnimatedTransformPtr;
 
+class AssetPack;
+typedef std::shared_ptr<AssetPack> AssetPackPtr;
+
+class Bounds;
+
+class BoundingVolumeHierarchy;
+
 class Camera;
 typedef std::shared_ptr<Camera> CameraPtr;
 
@@ -23,6 +30,9 @@ typedef std::shared_ptr<CameraEye> CameraEyePtr;
 class CameraSimple;
 typedef std::shared_ptr<CameraSimple> CameraSimplePtr;
 
+class CameraStereo;
+typedef std::shared_ptr<CameraStereo> CameraStereoPtr;
+
 #if defined(ANDROID)
 class ClassLoaderAndroid;
 typedef std::shared_ptr<ClassLoaderAndroid> ClassLoaderAndroidPtr;
@@ -41,6 +51,9 @@ class CreationContext;
 typedef std::shared_ptr<CreationContext> CreationContextPtr;
 typedef std::weak_ptr<CreationContext> CreationContextWeak;
 
+class CullPipeline;
+typedef std::shared_ptr<CullPipeline> CullPipelinePtr;
+
 class CullVisitor;
 typedef std::shared_ptr<CullVisitor> CullVisitorPtr;
 
@@ -55,6 +68,8 @@ typedef std::shared_ptr<DrawableList> DrawableListPtr;
 
 class FBO;
 typedef std::shared_ptr<FBO> FBOPtr;
+class FBOPool;
+typedef std::shared_ptr<FBOPool> FBOPoolPtr;
 
 class FileHandler;
 typedef std::shared_ptr<FileHandler> FileHandlerPtr;
@@ -62,6 +77,8 @@ typedef std::shared_ptr<FileHandler> FileHandlerPtr;
 class FileReader;
 typedef std::shared_ptr<FileReader> FileReaderPtr;
 
+struct ImageLevel;
+
 #if defined(ANDROID)
 class FileReaderAndroid;
 typedef std::shared_ptr<FileReaderAndroid> FileReaderAndroidPtr;
@@ -70,41 +87,106 @@ class FileReaderBasic;
 typedef std::shared_ptr<FileReaderBasic> FileReaderBasicPtr;
 #endif // defined(ANDROID)
 
+class Frustum;
+
 class Geometry;
 typedef std::shared_ptr<Geometry> GeometryPtr;
 
 class GeometryDrawable;
 typedef std::shared_ptr<GeometryDrawable> GeometryDrawablePtr;
 
+class GLDeletionQueue;
+typedef std::shared_ptr<GLDeletionQueue> GLDeletionQueuePtr;
+
 class GLExtensions;
+struct GLStats;
 typedef std::shared_ptr<GLExtensions> GLExtensionsPtr;
 
 class Group;
 typedef std::weak_ptr<Group> GroupWeak;
 typedef std::shared_ptr<Group> GroupPtr;
 
+class Impostor;
+typedef std::shared_ptr<Impostor> ImpostorPtr;
+
+class InstanceCuller;
+typedef std::shared_ptr<InstanceCuller> InstanceCullerPtr;
+
+class JobSystem;
+typedef std::shared_ptr<JobSystem> JobSystemPtr;
+
+class KTX2Decoder;
+typedef std::shared_ptr<KTX2Decoder> KTX2DecoderPtr;
+
+class KeyframeTrack;
+typedef std::shared_ptr<KeyframeTrack> KeyframeTrackPtr;
+
+class LateLatch;
+typedef std::shared_ptr<LateLatch> LateLatchPtr;
+
+class LevelOfDetail;
+typedef std::shared_ptr<LevelOfDetail> LevelOfDetailPtr;
+
 class Light;
 typedef std::shared_ptr<Light> LightPtr;
 
+struct LightBlock;
+typedef std::shared_ptr<const LightBlock> LightBlockPtr;
+
+class LoadReportCollector;
+typedef std::shared_ptr<LoadReportCollector> LoadReportCollectorPtr;
+
 class LoaderThread;
 typedef std::shared_ptr<LoaderThread> LoaderThreadPtr;
 typedef std::weak_ptr<LoaderThread> LoaderThreadWeak;
+class LoadToken;
+typedef std::shared_ptr<LoadToken> LoadTokenPtr;
+
+class MappedFile;
+typedef std::shared_ptr<MappedFile> MappedFilePtr;
+
+class MaterialRegistry;
+typedef std::shared_ptr<MaterialRegistry> MaterialRegistryPtr;
 
 class Matrix;
 
+class ModelCache;
+typedef std::shared_ptr<ModelCache> ModelCachePtr;
+
+class ModelCacheObj;
+typedef std::shared_ptr<ModelCacheObj> ModelCacheObjPtr;
+
 #if defined(ANDROID)
 class ModelLoaderAndroid;
 typedef std::shared_ptr<ModelLoaderAndroid> ModelLoaderAndroidPtr;
+#else
+class ModelLoaderBasic;
+typedef std::shared_ptr<ModelLoaderBasic> ModelLoaderBasicPtr;
 #endif // defined(ANDROID)
 
 class Node;
 typedef std::shared_ptr<Node> NodePtr;
 
+class NodeFactoryGLTF;
+typedef std::shared_ptr<NodeFactoryGLTF> NodeFactoryGLTFPtr;
+
 class NodeFactoryObj;
 typedef std::shared_ptr<NodeFactoryObj> NodeFactoryObjPtr;
 
+class NodeProfiler;
+typedef std::shared_ptr<NodeProfiler> NodeProfilerPtr;
+
+class OcclusionCuller;
+typedef std::shared_ptr<OcclusionCuller> OcclusionCullerPtr;
+
+class OffscreenTexture;
+typedef std::shared_ptr<OffscreenTexture> OffscreenTexturePtr;
+
 class UpdatableStore;
 
+class ParallelCuller;
+typedef std::shared_ptr<ParallelCuller> ParallelCullerPtr;
+
 class ParserObj;
 typedef std::shared_ptr<ParserObj> ParserObjPtr;
 
@@ -123,6 +205,9 @@ typedef std::shared_ptr<Program> ProgramPtr;
 class ProgramFactory;
 typedef std::shared_ptr<ProgramFactory> ProgramFactoryPtr;
 
+class Quaternion;
+
+struct RayHit;
 
 class RenderBuffer;
 typedef std::shared_ptr<RenderBuffer> RenderBufferPtr;
@@ -132,9 +217,17 @@ typedef std::shared_ptr<RenderContext> RenderContextPtr;
 typedef std::weak_ptr<RenderContext> RenderContextWeak;
 
 using RenderLambda = std::function<void()>;
+using ContextsSynchronizedLambda = std::function<void(RenderContextPtr&)>;
+
+class RenderLayer;
+typedef std::shared_ptr<RenderLayer> RenderLayerPtr;
 
 class RenderState;
 typedef std::shared_ptr<RenderState> RenderStatePtr;
+typedef std::weak_ptr<RenderState> RenderStateWeak;
+
+class ResolutionScaler;
+typedef std::shared_ptr<ResolutionScaler> ResolutionScalerPtr;
 
 class ResourceGL;
 class ResourceGLList;
@@ -144,9 +237,21 @@ class RunnableQueue;
 typedef std::shared_ptr<RunnableQueue> RunnableQueuePtr;
 #endif // defined(ANDROID)
 
+class SamplerCache;
+typedef std::shared_ptr<SamplerCache> SamplerCachePtr;
+
+class SceneSnapshot;
+typedef std::shared_ptr<SceneSnapshot> SceneSnapshotPtr;
+
+class ShaderQualityScaler;
+typedef std::shared_ptr<ShaderQualityScaler> ShaderQualityScalerPtr;
+
 class SharedEGLContext;
 typedef std::shared_ptr<SharedEGLContext> SharedEGLContextPtr;
 
+class Skeleton;
+typedef std::shared_ptr<Skeleton> SkeletonPtr;
+
 #if defined(ANDROID)
 class SurfaceTextureFactory;
 typedef std::shared_ptr<SurfaceTextureFactory> SurfaceTextureFactoryPtr;
@@ -155,12 +260,25 @@ class SurfaceTextureObserver;
 typedef std::shared_ptr<SurfaceTextureObserver> SurfaceTextureObserverPtr;
 #endif // defined(ANDROID)
 
+class StreamBuffer;
+typedef std::shared_ptr<StreamBuffer> StreamBufferPtr;
+
 class Texture;
 typedef std::shared_ptr<Texture> TexturePtr;
 
+class TextureArray;
+typedef std::shared_ptr<TextureArray> TextureArrayPtr;
+
+class TextureAtlas;
+typedef std::weak_ptr<TextureAtlas> TextureAtlasWeak;
+typedef std::shared_ptr<TextureAtlas> TextureAtlasPtr;
+
 class TextureCache;
 typedef std::shared_ptr<TextureCache> TextureCachePtr;
 
+class TextureDiskCache;
+typedef std::shared_ptr<TextureDiskCache> TextureDiskCachePtr;
+
 class TextureCubeMap;
 typedef std::shared_ptr<TextureCubeMap> TextureCubeMapPtr;
 
@@ -168,10 +286,22 @@ class TextureGL;
 typedef std::shared_ptr<TextureGL> TextureGLPtr;
 
 #if defined(ANDROID)
+class TextureImageReader;
+typedef std::shared_ptr<TextureImageReader> TextureImageReaderPtr;
+
 class TextureSurface;
 typedef std::shared_ptr<TextureSurface> TextureSurfacePtr;
 #endif // defined(ANDROID)
 
+class TextureTranscoder;
+typedef std::shared_ptr<TextureTranscoder> TextureTranscoderPtr;
+
+class ThermalGovernor;
+typedef std::shared_ptr<ThermalGovernor> ThermalGovernorPtr;
+
+class ThermalGovernorObserver;
+typedef std::shared_ptr<ThermalGovernorObserver> ThermalGovernorObserverPtr;
+
 class ThreadIdentity;
 typedef std::shared_ptr<ThreadIdentity> ThreadIdentityPtr;
 
@@ -181,14 +311,22 @@ typedef std::shared_ptr<Toggle> TogglePtr;
 class Transform;
 typedef std::shared_ptr<Transform> TransformPtr;
 
+class TransformAnimator;
+typedef std::shared_ptr<TransformAnimator> TransformAnimatorPtr;
+typedef std::weak_ptr<TransformAnimator> TransformAnimatorWeak;
+
 class Updatable;
 class UpdatableList;
 
 class Vector;
+class Vector4;
 
 class VertexArray;
 typedef std::shared_ptr<VertexArray> VertexArrayPtr;
 
+class WorldStreamer;
+typedef std::shared_ptr<WorldStreamer> WorldStreamerPtr;
+
 } // namespace vrb
 
 #endif // VRB_FORWARD_DOT_H
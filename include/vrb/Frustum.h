@@ -0,0 +1,116 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_FRUSTUM_DOT_H
+#define VRB_FRUSTUM_DOT_H
+
+#include "vrb/Bounds.h"
+#include "vrb/Camera.h"
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <cmath>
+
+namespace vrb {
+
+// View frustum stored as six world space planes pointing inwards.
+class Frustum {
+public:
+  // Same as Camera::GetFrustum(), which cameras cache.
+  static Frustum FromCamera(const Camera& aCamera) {
+    return aCamera.GetFrustum();
+  }
+
+  // Frustum of aCamera widened by aMargin, a fraction of the extent of its
+  // views, so 0.1 keeps what is within ten percent past each edge. Used to
+  // cull for a LateLatch, whose pose may turn a little further before the
+  // frame is drawn.
+  static Frustum FromCamera(const Camera& aCamera, const float aMargin) {
+    if (aMargin <= 0.0f) {
+      return aCamera.GetFrustum();
+    }
+    const float kScale = 1.0f / (1.0f + aMargin);
+    const Matrix kWiden = Matrix::Identity().Scale(Vector(kScale, kScale, 1.0f));
+    const int kViewCount = aCamera.GetViewCount();
+    if (kViewCount > 1) {
+      return FromStereo(kWiden.PostMultiply(aCamera.GetViewProjectionAt(0)),
+                        kWiden.PostMultiply(aCamera.GetViewProjectionAt(kViewCount - 1)));
+    }
+    return Frustum(kWiden.PostMultiply(aCamera.GetViewProjection()));
+  }
+
+  // Frustum containing both eyes of a stereo pair. The eyes are assumed to
+  // be offset along their shared x axis, as on a head mounted display, so
+  // only the left and right planes differ between them.
+  static Frustum FromStereo(const Matrix& aLeftViewProjection, const Matrix& aRightViewProjection) {
+    Frustum result(aLeftViewProjection);
+    result.SetPlane(1, aRightViewProjection, 0, -1.0f);
+    return result;
+  }
+
+  Frustum() {}
+  // Extracts the planes from a combined projection * view matrix.
+  explicit Frustum(const Matrix& aViewProjection) {
+    for (int32_t ix = 0; ix < 3; ix++) {
+      SetPlane(ix * 2, aViewProjection, ix, 1.0f);
+      SetPlane(ix * 2 + 1, aViewProjection, ix, -1.0f);
+    }
+  }
+
+  // Returns false only when aBounds is completely outside of one of the planes.
+  bool Intersects(const Bounds& aBounds) const {
+    if (aBounds.IsInfinite()) {
+      return true;
+    }
+    if (aBounds.IsEmpty()) {
+      return false;
+    }
+    const Vector center = aBounds.Center();
+    const Vector extents = aBounds.Extents();
+    for (const Plane& plane: mPlanes) {
+      const float distance = plane.normal.Dot(center) + plane.distance;
+      const float radius = std::fabs(plane.normal.x()) * extents.x() +
+                           std::fabs(plane.normal.y()) * extents.y() +
+                           std::fabs(plane.normal.z()) * extents.z();
+      if (distance + radius < 0.0f) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Inward normal and distance of plane aIndex, for testing on the GPU.
+  void GetPlane(const int32_t aIndex, Vector& aNormal, float& aDistance) const {
+    aNormal = mPlanes[aIndex].normal;
+    aDistance = mPlanes[aIndex].distance;
+  }
+
+private:
+  struct Plane {
+    Vector normal;
+    float distance;
+    Plane() : normal(0.0f, 0.0f, 0.0f), distance(0.0f) {}
+  };
+
+  void SetPlane(const int32_t aIndex, const Matrix& aMatrix, const int32_t aRow, const float aSign) {
+    Plane& plane = mPlanes[aIndex];
+    plane.normal.Set(
+        aMatrix.At(0, 3) + aSign * aMatrix.At(0, aRow),
+        aMatrix.At(1, 3) + aSign * aMatrix.At(1, aRow),
+        aMatrix.At(2, 3) + aSign * aMatrix.At(2, aRow));
+    plane.distance = aMatrix.At(3, 3) + aSign * aMatrix.At(3, aRow);
+    const float magnitude = plane.normal.Magnitude();
+    if (magnitude > 0.0f) {
+      plane.normal /= magnitude;
+      plane.distance /= magnitude;
+    }
+  }
+
+  Plane mPlanes[6];
+};
+
+} // namespace vrb
+
+#endif // VRB_FRUSTUM_DOT_H
@@ -0,0 +1,57 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_GL_DELETION_QUEUE_DOT_H
+#define VRB_GL_DELETION_QUEUE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include "vrb/gl.h"
+#include <cstddef>
+
+namespace vrb {
+
+// Collects GL names released by resources on any thread and deletes them on
+// the render thread. RenderContext::Update fences the names queued during
+// the previous frame and deletes those whose fence has signaled, at most a
+// batch per frame, so the driver never waits for the GPU to be done with an
+// object and a large release does not stall a frame. Names of zero are
+// ignored.
+class GLDeletionQueue {
+public:
+  static GLDeletionQueuePtr Create();
+  void DeleteBuffer(const GLuint aBuffer);
+  void DeleteTexture(const GLuint aTexture);
+  void DeleteProgram(const GLuint aProgram);
+  void DeleteFramebuffer(const GLuint aFramebuffer);
+  void DeleteRenderbuffer(const GLuint aRenderbuffer);
+  // Vertex array objects belong to the render thread context, so they must
+  // not be deleted elsewhere.
+  void DeleteVertexArray(const GLuint aVertexArray);
+  // Query objects, including EXT_disjoint_timer_query timestamps, which
+  // share the query namespace of the context.
+  void DeleteQuery(const GLuint aQuery);
+  // Names deleted per frame, 256 by default.
+  void SetBatchSize(const size_t aCount);
+  size_t GetPendingCount() const;
+  // Called by RenderContext::Update.
+  void Update();
+  // Deletes every queued name without waiting for the fences. Called by
+  // RenderContext::ShutdownGL after the resources have released theirs.
+  void ShutdownGL();
+protected:
+  struct State;
+  GLDeletionQueue(State& aState);
+  ~GLDeletionQueue();
+private:
+  State& m;
+  GLDeletionQueue() = delete;
+  VRB_NO_DEFAULTS(GLDeletionQueue)
+};
+
+} // namespace vrb
+
+#endif // VRB_GL_DELETION_QUEUE_DOT_H
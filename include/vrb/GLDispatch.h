@@ -0,0 +1,264 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_GL_DISPATCH_DOT_H
+#define VRB_GL_DISPATCH_DOT_H
+
+// When built with VRB_GL_DISPATCH, the GL entry points listed below are
+// routed through vrb::gGLDispatch instead of being called directly. The table
+// may point at the native GL library or at a null implementation that needs
+// no context, and may be wrapped by a recording layer that counts calls and
+// the bytes they upload. Extension functions loaded by GLExtensions are not
+// routed.
+
+#include "vrb/gl.h"
+
+#include <stdint.h>
+#include <vector>
+
+// X(return type, name without the gl prefix, parameters, arguments)
+#define VRB_GL_FUNCTIONS(X) \
+  X(void, ActiveTexture, (GLenum texture), (texture)) \
+  X(void, AttachShader, (GLuint program, GLuint shader), (program, shader)) \
+  X(void, BeginQuery, (GLenum target, GLuint id), (target, id)) \
+  X(void, BindAttribLocation, (GLuint program, GLuint index, const GLchar* name), (program, index, name)) \
+  X(void, BindBuffer, (GLenum target, GLuint buffer), (target, buffer)) \
+  X(void, BindBufferBase, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer)) \
+  X(void, BindBufferRange, (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size), (target, index, buffer, offset, size)) \
+  X(void, BindFramebuffer, (GLenum target, GLuint framebuffer), (target, framebuffer)) \
+  X(void, BindRenderbuffer, (GLenum target, GLuint renderbuffer), (target, renderbuffer)) \
+  X(void, BindSampler, (GLuint unit, GLuint sampler), (unit, sampler)) \
+  X(void, BindTexture, (GLenum target, GLuint texture), (target, texture)) \
+  X(void, BindVertexArray, (GLuint array), (array)) \
+  X(void, BlendFunc, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor)) \
+  X(void, BlitFramebuffer, (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter), (srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter)) \
+  X(void, BufferData, (GLenum target, GLsizeiptr size, const void* data, GLenum usage), (target, size, data, usage)) \
+  X(void, BufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void* data), (target, offset, size, data)) \
+  X(GLenum, CheckFramebufferStatus, (GLenum target), (target)) \
+  X(void, Clear, (GLbitfield mask), (mask)) \
+  X(void, ClearColor, (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha), (red, green, blue, alpha)) \
+  X(GLenum, ClientWaitSync, (GLsync sync, GLbitfield flags, GLuint64 timeout), (sync, flags, timeout)) \
+  X(void, ColorMask, (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha), (red, green, blue, alpha)) \
+  X(void, CompileShader, (GLuint shader), (shader)) \
+  X(void, CompressedTexImage2D, (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid* data), (target, level, internalformat, width, height, border, imageSize, data)) \
+  X(void, CompressedTexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const GLvoid* data), (target, level, xoffset, yoffset, width, height, format, imageSize, data)) \
+  X(GLuint, CreateProgram, (), ()) \
+  X(GLuint, CreateShader, (GLenum type), (type)) \
+  X(void, DeleteBuffers, (GLsizei n, const GLuint* buffers), (n, buffers)) \
+  X(void, DeleteFramebuffers, (GLsizei n, const GLuint* framebuffers), (n, framebuffers)) \
+  X(void, DeleteProgram, (GLuint program), (program)) \
+  X(void, DeleteQueries, (GLsizei n, const GLuint* ids), (n, ids)) \
+  X(void, DeleteRenderbuffers, (GLsizei n, const GLuint* renderbuffers), (n, renderbuffers)) \
+  X(void, DeleteSamplers, (GLsizei count, const GLuint* samplers), (count, samplers)) \
+  X(void, DeleteShader, (GLuint shader), (shader)) \
+  X(void, DeleteSync, (GLsync sync), (sync)) \
+  X(void, DeleteTextures, (GLsizei n, const GLuint* textures), (n, textures)) \
+  X(void, DeleteVertexArrays, (GLsizei n, const GLuint* arrays), (n, arrays)) \
+  X(void, DepthFunc, (GLenum func), (func)) \
+  X(void, DepthMask, (GLboolean flag), (flag)) \
+  X(void, Disable, (GLenum cap), (cap)) \
+  X(void, DrawElements, (GLenum mode, GLsizei count, GLenum type, const GLvoid* indices), (mode, count, type, indices)) \
+  X(void, DrawElementsInstanced, (GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount), (mode, count, type, indices, instancecount)) \
+  X(void, Enable, (GLenum cap), (cap)) \
+  X(void, EnableVertexAttribArray, (GLuint index), (index)) \
+  X(void, EndQuery, (GLenum target), (target)) \
+  X(GLsync, FenceSync, (GLenum condition, GLbitfield flags), (condition, flags)) \
+  X(void, Finish, (), ()) \
+  X(void, FramebufferRenderbuffer, (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer), (target, attachment, renderbuffertarget, renderbuffer)) \
+  X(void, FramebufferTexture2D, (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level), (target, attachment, textarget, texture, level)) \
+  X(void, FramebufferTextureLayer, (GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer), (target, attachment, texture, level, layer)) \
+  X(void, GenBuffers, (GLsizei n, GLuint* buffers), (n, buffers)) \
+  X(void, GenFramebuffers, (GLsizei n, GLuint* framebuffers), (n, framebuffers)) \
+  X(void, GenQueries, (GLsizei n, GLuint* ids), (n, ids)) \
+  X(void, GenRenderbuffers, (GLsizei n, GLuint* renderbuffers), (n, renderbuffers)) \
+  X(void, GenSamplers, (GLsizei count, GLuint* samplers), (count, samplers)) \
+  X(void, GenTextures, (GLsizei n, GLuint* textures), (n, textures)) \
+  X(void, GenVertexArrays, (GLsizei n, GLuint* arrays), (n, arrays)) \
+  X(GLint, GetAttribLocation, (GLuint program, const GLchar* name), (program, name)) \
+  X(GLenum, GetError, (), ()) \
+  X(void, GetFloatv, (GLenum pname, GLfloat* params), (pname, params)) \
+  X(void, GetIntegerv, (GLenum pname, GLint* params), (pname, params)) \
+  X(void, GetProgramBinary, (GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary), (program, bufSize, length, binaryFormat, binary)) \
+  X(void, GetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog), (program, bufSize, length, infoLog)) \
+  X(void, GetProgramiv, (GLuint program, GLenum pname, GLint* params), (program, pname, params)) \
+  X(void, GetQueryObjectuiv, (GLuint id, GLenum pname, GLuint* params), (id, pname, params)) \
+  X(void, GetShaderInfoLog, (GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog), (shader, bufSize, length, infoLog)) \
+  X(void, GetShaderiv, (GLuint shader, GLenum pname, GLint* params), (shader, pname, params)) \
+  X(const GLubyte*, GetString, (GLenum name), (name)) \
+  X(void, GetTexParameteriv, (GLenum target, GLenum pname, GLint* params), (target, pname, params)) \
+  X(GLuint, GetUniformBlockIndex, (GLuint program, const GLchar* uniformBlockName), (program, uniformBlockName)) \
+  X(GLint, GetUniformLocation, (GLuint program, const GLchar* name), (program, name)) \
+  X(void, LinkProgram, (GLuint program), (program)) \
+  X(void*, MapBufferRange, (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access), (target, offset, length, access)) \
+  X(void, ProgramBinary, (GLuint program, GLenum binaryFormat, const void* binary, GLsizei length), (program, binaryFormat, binary, length)) \
+  X(void, ProgramParameteri, (GLuint program, GLenum pname, GLint value), (program, pname, value)) \
+  X(void, ReadPixels, (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels), (x, y, width, height, format, type, pixels)) \
+  X(void, RenderbufferStorage, (GLenum target, GLenum internalformat, GLsizei width, GLsizei height), (target, internalformat, width, height)) \
+  X(void, SamplerParameterf, (GLuint sampler, GLenum pname, GLfloat param), (sampler, pname, param)) \
+  X(void, SamplerParameteri, (GLuint sampler, GLenum pname, GLint param), (sampler, pname, param)) \
+  X(void, Scissor, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height)) \
+  X(void, ShaderSource, (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length), (shader, count, string, length)) \
+  X(void, TexImage2D, (GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid* pixels), (target, level, internalFormat, width, height, border, format, type, pixels)) \
+  X(void, TexParameteri, (GLenum target, GLenum pname, GLint param), (target, pname, param)) \
+  X(void, TexStorage2D, (GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height), (target, levels, internalformat, width, height)) \
+  X(void, TexStorage3D, (GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth), (target, levels, internalformat, width, height, depth)) \
+  X(void, TexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid* pixels), (target, level, xoffset, yoffset, width, height, format, type, pixels)) \
+  X(void, TexSubImage3D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid* pixels), (target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels)) \
+  X(void, Uniform1f, (GLint location, GLfloat v0), (location, v0)) \
+  X(void, Uniform1i, (GLint location, GLint v0), (location, v0)) \
+  X(void, Uniform1ui, (GLint location, GLuint v0), (location, v0)) \
+  X(void, Uniform3fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value)) \
+  X(void, Uniform4fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value)) \
+  X(void, UniformBlockBinding, (GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding), (program, uniformBlockIndex, uniformBlockBinding)) \
+  X(void, UniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value)) \
+  X(GLboolean, UnmapBuffer, (GLenum target), (target)) \
+  X(void, UseProgram, (GLuint program), (program)) \
+  X(void, VertexAttribDivisor, (GLuint index, GLuint divisor), (index, divisor)) \
+  X(void, VertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer), (index, size, type, normalized, stride, pointer)) \
+  X(void, Viewport, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height))
+
+namespace vrb {
+
+struct GLDispatch {
+#define VRB_GL_DISPATCH_MEMBER(aReturn, aName, aParams, aArgs) aReturn (*aName) aParams;
+  VRB_GL_FUNCTIONS(VRB_GL_DISPATCH_MEMBER)
+#undef VRB_GL_DISPATCH_MEMBER
+};
+
+extern GLDispatch gGLDispatch;
+
+enum class GLBackend {
+  Native,
+  // Does nothing. Names are handed out sequentially, status queries report
+  // success and occlusion queries are available and visible.
+  Null
+};
+
+struct GLCallRecord {
+  const char* name;
+  uint64_t calls;
+  // Bytes passed to buffer and texture uploads. Uncompressed texture uploads
+  // are counted at four bytes per texel.
+  uint64_t bytes;
+};
+
+// Table of the null backend. Always built, so entry points that do nothing
+// may be defined from it without a context, see bench/NullGL.cpp.
+const GLDispatch& GLDispatchGetNull();
+void GLDispatchSetBackend(const GLBackend aBackend);
+GLBackend GLDispatchGetBackend();
+void GLDispatchSetRecording(const bool aEnabled);
+bool GLDispatchIsRecording();
+// Appends a record for every function called since the last reset.
+void GLDispatchGetRecords(std::vector<GLCallRecord>& aRecords);
+// aName is given without the gl prefix, e.g. "BindBuffer".
+uint64_t GLDispatchGetCallCount(const char* aName);
+void GLDispatchResetRecords();
+void GLDispatchLogRecords();
+
+} // namespace vrb
+
+#if !defined(VRB_GL_DISPATCH_IMPLEMENTATION)
+#  define glActiveTexture vrb::gGLDispatch.ActiveTexture
+#  define glAttachShader vrb::gGLDispatch.AttachShader
+#  define glBeginQuery vrb::gGLDispatch.BeginQuery
+#  define glBindAttribLocation vrb::gGLDispatch.BindAttribLocation
+#  define glBindBuffer vrb::gGLDispatch.BindBuffer
+#  define glBindBufferBase vrb::gGLDispatch.BindBufferBase
+#  define glBindBufferRange vrb::gGLDispatch.BindBufferRange
+#  define glBindFramebuffer vrb::gGLDispatch.BindFramebuffer
+#  define glBindRenderbuffer vrb::gGLDispatch.BindRenderbuffer
+#  define glBindSampler vrb::gGLDispatch.BindSampler
+#  define glBindTexture vrb::gGLDispatch.BindTexture
+#  define glBindVertexArray vrb::gGLDispatch.BindVertexArray
+#  define glBlendFunc vrb::gGLDispatch.BlendFunc
+#  define glBlitFramebuffer vrb::gGLDispatch.BlitFramebuffer
+#  define glBufferData vrb::gGLDispatch.BufferData
+#  define glBufferSubData vrb::gGLDispatch.BufferSubData
+#  define glCheckFramebufferStatus vrb::gGLDispatch.CheckFramebufferStatus
+#  define glClear vrb::gGLDispatch.Clear
+#  define glClearColor vrb::gGLDispatch.ClearColor
+#  define glClientWaitSync vrb::gGLDispatch.ClientWaitSync
+#  define glColorMask vrb::gGLDispatch.ColorMask
+#  define glCompileShader vrb::gGLDispatch.CompileShader
+#  define glCompressedTexImage2D vrb::gGLDispatch.CompressedTexImage2D
+#  define glCompressedTexSubImage2D vrb::gGLDispatch.CompressedTexSubImage2D
+#  define glCreateProgram vrb::gGLDispatch.CreateProgram
+#  define glCreateShader vrb::gGLDispatch.CreateShader
+#  define glDeleteBuffers vrb::gGLDispatch.DeleteBuffers
+#  define glDeleteFramebuffers vrb::gGLDispatch.DeleteFramebuffers
+#  define glDeleteProgram vrb::gGLDispatch.DeleteProgram
+#  define glDeleteQueries vrb::gGLDispatch.DeleteQueries
+#  define glDeleteRenderbuffers vrb::gGLDispatch.DeleteRenderbuffers
+#  define glDeleteSamplers vrb::gGLDispatch.DeleteSamplers
+#  define glDeleteShader vrb::gGLDispatch.DeleteShader
+#  define glDeleteSync vrb::gGLDispatch.DeleteSync
+#  define glDeleteTextures vrb::gGLDispatch.DeleteTextures
+#  define glDeleteVertexArrays vrb::gGLDispatch.DeleteVertexArrays
+#  define glDepthFunc vrb::gGLDispatch.DepthFunc
+#  define glDepthMask vrb::gGLDispatch.DepthMask
+#  define glDisable vrb::gGLDispatch.Disable
+#  define glDrawElements vrb::gGLDispatch.DrawElements
+#  define glDrawElementsInstanced vrb::gGLDispatch.DrawElementsInstanced
+#  define glEnable vrb::gGLDispatch.Enable
+#  define glEnableVertexAttribArray vrb::gGLDispatch.EnableVertexAttribArray
+#  define glEndQuery vrb::gGLDispatch.EndQuery
+#  define glFenceSync vrb::gGLDispatch.FenceSync
+#  define glFinish vrb::gGLDispatch.Finish
+#  define glFramebufferRenderbuffer vrb::gGLDispatch.FramebufferRenderbuffer
+#  define glFramebufferTexture2D vrb::gGLDispatch.FramebufferTexture2D
+#  define glFramebufferTextureLayer vrb::gGLDispatch.FramebufferTextureLayer
+#  define glGenBuffers vrb::gGLDispatch.GenBuffers
+#  define glGenFramebuffers vrb::gGLDispatch.GenFramebuffers
+#  define glGenQueries vrb::gGLDispatch.GenQueries
+#  define glGenRenderbuffers vrb::gGLDispatch.GenRenderbuffers
+#  define glGenSamplers vrb::gGLDispatch.GenSamplers
+#  define glGenTextures vrb::gGLDispatch.GenTextures
+#  define glGenVertexArrays vrb::gGLDispatch.GenVertexArrays
+#  define glGetAttribLocation vrb::gGLDispatch.GetAttribLocation
+#  define glGetError vrb::gGLDispatch.GetError
+#  define glGetFloatv vrb::gGLDispatch.GetFloatv
+#  define glGetIntegerv vrb::gGLDispatch.GetIntegerv
+#  define glGetProgramBinary vrb::gGLDispatch.GetProgramBinary
+#  define glGetProgramInfoLog vrb::gGLDispatch.GetProgramInfoLog
+#  define glGetProgramiv vrb::gGLDispatch.GetProgramiv
+#  define glGetQueryObjectuiv vrb::gGLDispatch.GetQueryObjectuiv
+#  define glGetShaderInfoLog vrb::gGLDispatch.GetShaderInfoLog
+#  define glGetShaderiv vrb::gGLDispatch.GetShaderiv
+#  define glGetString vrb::gGLDispatch.GetString
+#  define glGetTexParameteriv vrb::gGLDispatch.GetTexParameteriv
+#  define glGetUniformBlockIndex vrb::gGLDispatch.GetUniformBlockIndex
+#  define glGetUniformLocation vrb::gGLDispatch.GetUniformLocation
+#  define glLinkProgram vrb::gGLDispatch.LinkProgram
+#  define glMapBufferRange vrb::gGLDispatch.MapBufferRange
+#  define glProgramBinary vrb::gGLDispatch.ProgramBinary
+#  define glProgramParameteri vrb::gGLDispatch.ProgramParameteri
+#  define glReadPixels vrb::gGLDispatch.ReadPixels
+#  define glRenderbufferStorage vrb::gGLDispatch.RenderbufferStorage
+#  define glSamplerParameterf vrb::gGLDispatch.SamplerParameterf
+#  define glSamplerParameteri vrb::gGLDispatch.SamplerParameteri
+#  define glScissor vrb::gGLDispatch.Scissor
+#  define glShaderSource vrb::gGLDispatch.ShaderSource
+#  define glTexImage2D vrb::gGLDispatch.TexImage2D
+#  define glTexParameteri vrb::gGLDispatch.TexParameteri
+#  define glTexStorage2D vrb::gGLDispatch.TexStorage2D
+#  define glTexStorage3D vrb::gGLDispatch.TexStorage3D
+#  define glTexSubImage2D vrb::gGLDispatch.TexSubImage2D
+#  define glTexSubImage3D vrb::gGLDispatch.TexSubImage3D
+#  define glUniform1f vrb::gGLDispatch.Uniform1f
+#  define glUniform1i vrb::gGLDispatch.Uniform1i
+#  define glUniform1ui vrb::gGLDispatch.Uniform1ui
+#  define glUniform3fv vrb::gGLDispatch.Uniform3fv
+#  define glUniform4fv vrb::gGLDispatch.Uniform4fv
+#  define glUniformBlockBinding vrb::gGLDispatch.UniformBlockBinding
+#  define glUniformMatrix4fv vrb::gGLDispatch.UniformMatrix4fv
+#  define glUnmapBuffer vrb::gGLDispatch.UnmapBuffer
+#  define glUseProgram vrb::gGLDispatch.UseProgram
+#  define glVertexAttribDivisor vrb::gGLDispatch.VertexAttribDivisor
+#  define glVertexAttribPointer vrb::gGLDispatch.VertexAttribPointer
+#  define glViewport vrb::gGLDispatch.Viewport
+#endif // !defined(VRB_GL_DISPATCH_IMPLEMENTATION)
+
+#endif // VRB_GL_DISPATCH_DOT_H
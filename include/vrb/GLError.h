@@ -7,6 +7,8 @@
 #define VRB_GL_ERROR_DOT_H
 
 #include "vrb/gl.h"
+#include "vrb/GLStats.h"
+#include <atomic>
 #if defined(ANDROID)
 #  include <android/log.h>
 #else
@@ -17,32 +19,68 @@ namespace vrb {
 
 const char* GLErrorString(GLenum aError);
 const char* GLErrorCheck();
+// Logs any GL error raised since the previous check. Called once per frame
+// by RenderContext::Update(). Finding an error turns on the check after
+// every VRB_GL_CHECK call so later errors are reported where they occur.
+void GLErrorCheckFrame();
+// Same as GLErrorCheckFrame() for the work done on another context, such as
+// an upload on a shared loader context. aWork names it in the log.
+void GLErrorCheckWork(const char* aWork);
+// Release builds only check for errors once per frame, since glGetError
+// may stall the pipeline. Enabling this restores the per call check.
+void GLErrorSetCheckEveryCall(const bool aEnabled);
+// Reports GL errors through the KHR_debug callback without calling
+// glGetError. An error reported this way also enables the per call check.
+void GLErrorEnableDebugOutput(PFNGLDEBUGMESSAGECALLBACKKHRPROC aDebugMessageCallback);
+
+// Set by the debug callback, which may run on a driver thread, and read by
+// VRB_GL_CHECK on every thread.
+extern std::atomic<bool> gGLErrorCheckEveryCall;
+
+inline bool
+GLErrorIsCheckingEveryCall() {
+  return gGLErrorCheckEveryCall.load(std::memory_order_relaxed);
+}
 
 #if defined(ANDROID)
+#define VRB_GL_LOG_ERROR(str)                               \
+    __android_log_print(ANDROID_LOG_ERROR, "VRB",           \
+                         "OpenGL Error: %s at%s:%s:%d",     \
+                         str,                               \
+                         __FILE__, __FUNCTION__, __LINE__);
+#else
+#define VRB_GL_LOG_ERROR(str)                               \
+    fprintf(stderr, "VRB: OpenGL Error: %s at%s:%s:%d",     \
+                         str,                               \
+                         __FILE__, __FUNCTION__, __LINE__);
+#endif
 
-#define VRB_GL_CHECK(X) X;                                  \
+#define VRB_GL_CHECK_ERROR()                                \
 {                                                           \
   const char* str = vrb::GLErrorCheck();                    \
   if (str) {                                                \
-    __android_log_print(ANDROID_LOG_ERROR, "VRB",           \
-                         "OpenGL Error: %s at%s:%s:%d",     \
-                         str,                               \
-                         __FILE__, __FUNCTION__, __LINE__); \
+    VRB_GL_LOG_ERROR(str)                                   \
   }                                                         \
 }
 
-#else
+// Checking on every call may be forced in release builds with VRB_GL_CHECK_EVERY_CALL.
+#if defined(NDEBUG) && !defined(VRB_GL_CHECK_EVERY_CALL)
 
 #define VRB_GL_CHECK(X) X;                                  \
 {                                                           \
-  const char* str = vrb::GLErrorCheck();                    \
-  if (str) {                                                \
-    fprintf(stderr, "VRB: OpenGL Error: %s at%s:%s:%d",     \
-                         str,                               \
-                         __FILE__, __FUNCTION__, __LINE__); \
+  VRB_GL_STATS_ADD(Calls, 1);                               \
+  if (vrb::GLErrorIsCheckingEveryCall()) {                  \
+    VRB_GL_CHECK_ERROR()                                    \
   }                                                         \
 }
 
+#else
+
+#define VRB_GL_CHECK(X) X;                                  \
+{                                                           \
+  VRB_GL_STATS_ADD(Calls, 1);                               \
+  VRB_GL_CHECK_ERROR()                                      \
+}
 
 #endif
 
@@ -20,7 +20,25 @@ public:
     EXT_multisampled_render_to_texture,
     OVR_multiview,
     OVR_multiview2,
-    OVR_multiview_multisampled_render_to_texture
+    OVR_multiview_multisampled_render_to_texture,
+    OES_element_index_uint,
+    KHR_parallel_shader_compile,
+    EXT_disjoint_timer_query,
+    KHR_debug,
+    KHR_texture_compression_astc_ldr,
+    // ETC2 and the other GLES3 texture formats, and primitive restart with a
+    // fixed index.
+    ARB_ES3_compatibility,
+    EXT_buffer_storage,
+    QCOM_texture_foveated,
+    EXT_multi_draw_arrays,
+    // Compute shaders, storage buffers and indirect draws of GLES 3.1.
+    ARB_ES3_1_compatibility,
+    // Sampler objects, core in GLES3.
+    ARB_sampler_objects,
+    EXT_texture_filter_anisotropic,
+    // External textures bound to EGLImages, see TextureImageReader.
+    OES_EGL_image_external
   };
 
   // GL extension function pointers
@@ -29,11 +47,28 @@ public:
     PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC glFramebufferTexture2DMultisampleEXT;
     PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC glFramebufferTextureMultiviewOVR;
     PFNGLFRAMEBUFFERTEXTUREMULTISAMPLEMULTIVIEWOVRPROC glFramebufferTextureMultisampleMultiviewOVR;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR;
+    PFNGLGENQUERIESEXTPROC glGenQueriesEXT;
+    PFNGLDELETEQUERIESEXTPROC glDeleteQueriesEXT;
+    PFNGLQUERYCOUNTEREXTPROC glQueryCounterEXT;
+    PFNGLGETQUERYOBJECTIVEXTPROC glGetQueryObjectivEXT;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT;
+    PFNGLDEBUGMESSAGECALLBACKKHRPROC glDebugMessageCallbackKHR;
+    PFNGLBUFFERSTORAGEEXTPROC glBufferStorageEXT;
+    PFNGLTEXTUREFOVEATIONPARAMETERSQCOMPROC glTextureFoveationParametersQCOM;
+    PFNGLMULTIDRAWELEMENTSEXTPROC glMultiDrawElementsEXT;
+    PFNGLDISPATCHCOMPUTEPROC glDispatchCompute;
+    PFNGLMEMORYBARRIERPROC glMemoryBarrier;
+    PFNGLDRAWELEMENTSINDIRECTPROC glDrawElementsIndirect;
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
   };
 
   static GLExtensionsPtr Create(RenderContextPtr& aContext);
   void Initialize();
   bool IsExtensionSupported(GLExtensions::Ext aExtension) const;
+  // True when GL_COMPRESSED_TEXTURE_FORMATS lists aFormat, for example one
+  // of the ASTC block sizes, which drivers may expose only in part.
+  bool IsCompressedFormatSupported(const GLenum aFormat) const;
   const GLExtensions::Functions & GetFunctions() const;
 protected:
   struct State;
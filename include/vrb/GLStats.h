@@ -0,0 +1,50 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_GL_STATS_DOT_H
+#define VRB_GL_STATS_DOT_H
+
+#include <stdint.h>
+
+namespace vrb {
+
+// Per frame GL counters, only collected when the library is built with
+// VRB_GL_STATS defined. Otherwise every counter stays zero and the
+// VRB_GL_STATS_ADD macro compiles to nothing.
+struct GLStats {
+  enum class Counter {
+    // Calls wrapped by VRB_GL_CHECK.
+    Calls,
+    DrawCalls,
+    Triangles,
+    // Texture binds, vertex array binds and light uniform uploads.
+    StateChanges,
+    ProgramSwitches,
+    BufferUploadBytes,
+    TextureUploadBytes,
+    Count
+  };
+  uint64_t values[(int)Counter::Count];
+
+  GLStats() : values() {}
+  uint64_t Get(const Counter aCounter) const {
+    return values[(int)aCounter];
+  }
+};
+
+// Counters may be incremented from any thread with a GL context.
+void GLStatsAdd(const GLStats::Counter aCounter, const uint64_t aAmount);
+// Moves the counters accumulated since the previous call into aResult.
+void GLStatsEndFrame(GLStats& aResult);
+
+} // namespace vrb
+
+#if defined(VRB_GL_STATS)
+#  define VRB_GL_STATS_ADD(aCounter, aAmount) vrb::GLStatsAdd(vrb::GLStats::Counter::aCounter, (uint64_t)(aAmount))
+#else
+#  define VRB_GL_STATS_ADD(aCounter, aAmount)
+#endif
+
+#endif // VRB_GL_STATS_DOT_H
@@ -10,44 +10,164 @@
 #include "vrb/MacroUtils.h"
 #include "vrb/GeometryDrawable.h"
 #include "vrb/ResourceGL.h"
+#include "vrb/Updatable.h"
 #include "vrb/gl.h"
 
+#include <string>
 #include <vector>
 
 namespace vrb {
 
-class Geometry : public GeometryDrawable, protected ResourceGL {
+// Vertex format flags used to store attributes in a compact form.
+// Defaults to 32-bit floats for every attribute.
+const uint32_t VertexFormatHalfPosition = 0x1;
+const uint32_t VertexFormatPackedNormal = 0x1 << 1;
+// Falls back to floats when any UV coordinate is outside of [0, 1].
+const uint32_t VertexFormatNormalizedUV = 0x1 << 2;
+const uint32_t VertexFormatByteColor = 0x1 << 3;
+const uint32_t VertexFormatByteWeight = 0x1 << 4;
+const uint32_t VertexFormatCompact = VertexFormatHalfPosition | VertexFormatPackedNormal |
+                                     VertexFormatNormalizedUV | VertexFormatByteColor |
+                                     VertexFormatByteWeight;
+
+class Geometry : public GeometryDrawable, protected ResourceGL, protected Updatable {
 public:
   static GeometryPtr Create(CreationContextPtr& aContext);
+  // View of the triangulated corners of a face, three per triangle. Indices
+  // are one based and a uv index of zero means the corner has none. A normal
+  // index of zero means the normal is yet to be generated.
   struct Face {
-    std::vector<GLushort> vertices;
-    std::vector<GLushort> uvs;
-    std::vector<GLushort> normals;
+    const GLuint* vertices;
+    const GLuint* uvs;
+    const GLuint* normals;
+    uint32_t cornerCount;
   };
 
+  // Node interface
+  // Geometry is not drawn until its GL resources are initialized.
+  void Cull(CullVisitor& aVisitor, DrawableList& aDrawables) override;
+  // Triangles are indexed by a hierarchy built on the first query after the
+  // faces change. Geometry that released its source data is never hit.
+  bool Intersect(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit) override;
+
   // Geometry interface
   VertexArrayPtr GetVertexArray() const;
   void SetVertexArray(const VertexArrayPtr& aVertexArray);
+  // Must be set before the Geometry is initialized.
+  void SetVertexFormat(const uint32_t aFormat);
+  uint32_t GetVertexFormat() const;
   void UpdateBuffers();
+  // A dynamic Geometry keeps its interleaved vertices in a GL_DYNAMIC_DRAW
+  // buffer. On each RenderContext::Update only the span of vertices using
+  // VertexArray entries changed since the last upload is encoded and
+  // uploaded again. Adding faces rebuilds both buffers. The attributes are
+  // those the VertexArray had when the Geometry was initialized. A dynamic
+  // Geometry never releases its source nor shares its vertex buffer. Must be
+  // set on the creation thread before the Geometry is initialized.
+  void SetDynamic(const bool aDynamic);
+  bool IsDynamic() const;
 
+  // Faces added without normals get them from GenerateNormals(), which runs
+  // on its own when the Geometry first needs them. Faces in the same
+  // smoothing group share the normals of their common vertices. Group zero
+  // turns smoothing off, each face keeping its own normal. Faces added
+  // before any group is set are smoothed together.
+  void SetSmoothingGroup(const int32_t aGroup);
   void AddFace(
     const std::vector<int> &aVerticies,
     const std::vector<int> &aUVs,
     const std::vector<int> &aNormals);
+  // Adds aFaceCount faces whose corners are packed as vertex, uv and normal
+  // index triples. aCornerCounts holds the number of corners of each face.
+  void AddFaces(const int* aIndices, const uint32_t* aCornerCounts, const size_t aFaceCount);
+  // Copies the faces of aSource, which must index the same VertexArray.
+  void AppendFaces(const Geometry& aSource);
 
   int32_t GetFaceCount() const;
-  const Face& GetFace(int32_t aIndex) const;
+  // The view is invalidated by adding faces.
+  Face GetFace(int32_t aIndex) const;
+
+  // Parts name runs of consecutive faces, such as the groups merged into one
+  // Geometry by NodeFactoryObj. Disabled parts are skipped when drawing while
+  // enabled neighbours are still drawn with a single call.
+  int32_t AddPart(const std::string& aName, const int32_t aFirstFace, const int32_t aFaceCount);
+  int32_t GetPartCount() const;
+  const std::string& GetPartName(const int32_t aIndex) const;
+  // Returns -1 if no part is named aName.
+  int32_t FindPart(const std::string& aName) const;
+  void SetPartEnabled(const int32_t aIndex, const bool aEnabled);
+  bool IsPartEnabled(const int32_t aIndex) const;
+
+  // Reorders the triangles of each part, or of the whole Geometry when it has
+  // no parts, for the post transform vertex cache and to reduce overdraw.
+  // Vertices are fetched in the order of first use once uploaded. Faces are
+  // replaced by their triangles. Intended for the loader thread, before the
+  // Geometry is initialized.
+  void OptimizeMesh();
+  // Draws the triangles as strips separated by a primitive restart index
+  // when that takes fewer indices, which mostly holds after OptimizeMesh().
+  // Needs GLES3 or ARB_ES3_compatibility, triangle lists are drawn
+  // otherwise. Must be set before the buffers are built. Off by default.
+  void SetTriangleStrips(const bool aStrips);
+  // Returns a new Geometry drawing about aRatio of the triangles of each part,
+  // built by edge collapses whose error stays below aMaxError relative to the
+  // size of the mesh. The VertexArray, RenderState and parts are shared with
+  // this Geometry. Returns nullptr without faces or with overlapping parts.
+  GeometryPtr CreateSimplified(CreationContextPtr& aContext, const float aRatio, const float aMaxError) const;
+
+  // How the normal of a face counts in the normals of its vertices.
+  enum class NormalWeighting {
+    // Every face counts the same.
+    Face,
+    Area,
+    // The angle of the face at the vertex, independent of how the faces
+    // around it are triangulated.
+    Angle
+  };
+  // Generates the missing normals of aGeometries in one pass, averaging the
+  // faces around each vertex across the geometries using the same
+  // VertexArray. The normals are appended to the VertexArray. Work is split
+  // in chunks run on aJobs, which may be null to run on the calling thread.
+  // Intended for the loader thread, once every face is added.
+  static void GenerateNormals(const std::vector<GeometryPtr>& aGeometries, const NormalWeighting aWeighting,
+                              const JobSystemPtr& aJobs);
+  // Uploads the vertices of aGeometries, which must share one VertexArray and
+  // vertex format, into a single vertex buffer so that each Geometry only owns
+  // an index buffer. The source is only released if every member allows it.
+  static void ShareVertexBuffer(const std::vector<GeometryPtr>& aGeometries);
+  // When enabled, the faces and VertexArray are dropped once uploaded. A
+  // packed copy of the GL buffers is kept in the DataCache, or in memory if
+  // the cache is unavailable, to restore them after the GL context is lost.
+  // Faces added after the upload are ignored. Off by default.
+  void SetReleaseSourceData(const bool aRelease);
+  // Draws vertices already laid out as the RenderBuffer describes and
+  // indices of aIndexType, uploading both as is instead of building them
+  // from the faces. aOwner keeps the data valid for as long as the Geometry
+  // may upload it again after the GL context is lost, for example the
+  // MappedFile the data points into. The Geometry then behaves as one that
+  // released its source and has aBounds. It may not share a vertex buffer.
+  void SetBufferData(const std::shared_ptr<const void>& aOwner,
+                     const uint8_t* aVertices, const size_t aVertexBytes, const GLsizei aVertexCount,
+                     const uint8_t* aIndices, const size_t aIndexBytes, const GLenum aIndexType,
+                     const GLsizei aIndexCount, const Bounds& aBounds);
 
 protected:
   struct State;
+  struct SharedVertices;
   Geometry(State& aState, CreationContextPtr& aContext);
   ~Geometry();
 
+  // Node interface
+  void ComputeBounds(Bounds& aBounds) const override;
+
   // From ResourceGL
   bool SupportOffRenderThreadInitialization() override;
   void InitializeGL() override;
   void ShutdownGL() override;
 
+  // Updatable interface
+  void UpdateResource(RenderContext& aContext) override;
+
 private:
   State& m;
   Geometry() = delete;
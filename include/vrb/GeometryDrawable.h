@@ -23,11 +23,24 @@ public:
   RenderStatePtr& GetRenderState() override;
   void SetRenderState(const RenderStatePtr& aRenderState) override;
   void Draw(const Camera& aCamera, const Matrix& aModelTransform) override;
+  const void* GetInstancingKey() override;
+  void DrawInstanced(const Camera& aCamera, const Matrix* aModelTransforms, const int32_t aCount) override;
+  const void* GetBatchKey() override;
+  void DrawBatch(const Camera& aCamera, const Matrix& aModelTransform, Drawable* const* aBatch, const int32_t aCount) override;
 
   // GeometryDrawable interface
   RenderBufferPtr& GetRenderBuffer();
   void SetRenderBuffer(RenderBufferPtr& aRenderBuffer);
   void SetRenderRange(uint32_t aStartIndex, uint32_t aLength);
+  // Ranges added here are drawn in place of the single range above, with
+  // one call when multi-draw is supported, and disable instancing.
+  // SetRenderRange clears them.
+  void AddRenderRange(uint32_t aStartIndex, uint32_t aLength);
+  void ClearRenderRanges();
+  // Draws the whole geometry once per instance of aCuller visible to the
+  // camera instead of once, see InstanceCuller. The program of the
+  // RenderState must have FeatureInstancing. Null restores regular drawing.
+  void SetInstanceCuller(const InstanceCullerPtr& aCuller);
 
 protected:
   struct State;
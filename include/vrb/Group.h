@@ -10,6 +10,8 @@
 #include "vrb/MacroUtils.h"
 #include "vrb/Node.h"
 
+#include <vector>
+
 namespace vrb {
 
 class Group : public Node {
@@ -18,12 +20,19 @@ public:
 
   // Node interface
   void Cull(CullVisitor& aVisitor, DrawableList& aDrawables) override;
+  void InvalidateWorldTransform() override;
+  void Flatten(SceneSnapshot& aSnapshot) override;
+  bool Intersect(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit) override;
 
   // Group interface
   void AddLight(LightPtr aLight);
   void RemoveLight(const Light& aLight);
   void AddNode(NodePtr aNode);
   virtual void RemoveNode(Node& aNode);
+  // Adds or removes many children at once. Nodes already in, or not in, the
+  // Group are skipped. The remaining children keep their order.
+  void AddNodes(const std::vector<NodePtr>& aNodes);
+  void RemoveNodes(const std::vector<NodePtr>& aNodes);
   void InsertNode(NodePtr aNode, uint32_t aIndex);
   const NodePtr& GetNode(uint32_t aIndex) const;
   int32_t GetNodeCount() const;
@@ -31,14 +40,51 @@ public:
   void TakeChildren(GroupPtr& aGroup);
   void SetPreRenderLambda(CreationContextPtr& aContext, const RenderLambda& aLambda);
   void SetPostRenderLambda(CreationContextPtr& aContext, const RenderLambda& aLambda);
+  // Culls and picks children through a bounding volume hierarchy over their
+  // bounds instead of testing every child. Meant for groups with many mostly
+  // static children. Moved children refit the hierarchy on the next use,
+  // added or removed ones rebuild it. Off by default.
+  void SetSpatialIndex(const bool aEnabled);
+  // Returns the nearest enabled child whose bounds are hit by the ray, in the
+  // local space of the Group, or nullptr. aDistance, when set, receives the
+  // distance to the bounds in units of aDirection.
+  NodePtr PickChild(const Vector& aOrigin, const Vector& aDirection, float* aDistance = nullptr);
+  // Skips the Group while its bounds were hidden behind previously drawn
+  // geometry, see OcclusionCuller. Meant for large subtrees, the hidden state
+  // lags the scene by a frame or more. Off by default.
+  void SetOcclusionCulling(const bool aEnabled);
+  // Records the drawables of the children, culled without a frustum, and
+  // reuses the recording while the Group is visible until the subtree, its
+  // world transform or the lights above it change. Meant for static
+  // content, level of detail selection and occlusion culling below the
+  // Group are frozen. Off by default.
+  void SetStatic(CreationContextPtr& aContext, const bool aStatic);
+  // Draws the opaque drawables of the subtree in a depth only pass before
+  // the color pass, which then shades each of their pixels once. Meant for
+  // overlapping content with costly fragment shaders, at the price of a
+  // second geometry pass. Custom fragment shaders that discard, such as for
+  // alpha testing, are drawn as fully opaque by the depth pass. Off by
+  // default.
+  void SetDepthPrePass(const bool aEnabled);
 
 protected:
   bool Traverse(const GroupPtr& aParent, const Node::TraverseFunction& aTraverseFunction) override;
+  void ComputeBounds(Bounds& aBounds) const override;
+  // Culls lights, lambdas and children without testing the bounds of the Group.
+  void CullChildren(CullVisitor& aVisitor, DrawableList& aDrawables);
+  // Adds the Group to aSnapshot, with aTransform applied to its children.
+  void FlattenGroup(SceneSnapshot& aSnapshot, const Matrix* aTransform);
+  // Intersects the enabled children without testing the bounds of the Group.
+  bool IntersectChildren(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit);
   struct State;
+  // CullChildren without the recording of a static Group.
+  void CullContents(CullVisitor& aVisitor, DrawableList& aDrawables);
   Group(State& aState, CreationContextPtr& aContext);
   ~Group();
 
 private:
+  // Node::GetParents() turns the parent links back into references.
+  friend class Node;
   State& m;
   Group() = delete;
   VRB_NO_DEFAULTS(Group)
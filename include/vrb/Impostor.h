@@ -0,0 +1,79 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_IMPOSTOR_DOT_H
+#define VRB_IMPOSTOR_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/Group.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/ResourceGL.h"
+#include "vrb/Updatable.h"
+
+#include <cstdint>
+
+namespace vrb {
+
+// Group drawn as a single textured quad facing the camera once it covers
+// less of the view than a threshold, so distant detailed models cost two
+// triangles. The children are rendered into an atlas of billboards, one cell
+// per direction around their bounds, by an offscreen FBO during
+// RenderContext::Update(). A cell is captured the first time the children
+// are seen from its direction, within a budget of cells per frame, and
+// captured again once the subtree changes; the previous capture is shown
+// meanwhile. Until a cell is captured the children are drawn instead.
+// Captures only see the lights added to the Impostor itself. Like
+// LevelOfDetail, an Impostor may not be culled by two threads at once. Must
+// be created and used on the render thread.
+class Impostor : public Group, protected ResourceGL, protected Updatable {
+public:
+  static ImpostorPtr Create(RenderContextPtr& aContext);
+
+  // Node interface
+  void Cull(CullVisitor& aVisitor, DrawableList& aDrawables) override;
+  void Flatten(SceneSnapshot& aSnapshot) override;
+
+  // Impostor interface
+  // Screen coverage, see CullVisitor::GetScreenCoverage(), below which the
+  // billboard is drawn. Defaults to 0.1.
+  void SetCoverageThreshold(const float aCoverage);
+  float GetCoverageThreshold() const;
+  // Number of directions around the vertical axis and of elevations from
+  // below to above the children, and the size in pixels of each cell. The
+  // atlas is reallocated and every cell captured again. The cell size is
+  // lowered to keep the atlas within 4096 pixels. Defaults to 8, 3 and 128.
+  void SetAtlasLayout(const int32_t aDirections, const int32_t aElevations, const int32_t aCellSize);
+  // Cells captured per RenderContext::Update(), at least one. Defaults to 2.
+  void SetCaptureBudget(const int32_t aCells);
+  // Captures every cell again as they are needed, for changes the scene
+  // graph does not see, such as new textures.
+  void Invalidate();
+  // Number of cells with a capture, stale or not.
+  int32_t GetCapturedCount() const;
+  // True when the last Cull drew the billboard instead of the children.
+  bool IsShowingImpostor() const;
+
+protected:
+  typedef Group Super;
+  struct State;
+  Impostor(State& aState, RenderContextPtr& aContext);
+  ~Impostor();
+
+  // ResourceGL interface
+  void InitializeGL() override;
+  void ShutdownGL() override;
+
+  // Updatable interface
+  void UpdateResource(RenderContext& aContext) override;
+
+private:
+  State& m;
+  Impostor() = delete;
+  VRB_NO_DEFAULTS(Impostor)
+};
+
+} // namespace vrb
+
+#endif // VRB_IMPOSTOR_DOT_H
@@ -0,0 +1,62 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_INSTANCE_CULLER_DOT_H
+#define VRB_INSTANCE_CULLER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/ResourceGL.h"
+
+#include "vrb/gl.h"
+#include <vector>
+
+namespace vrb {
+
+// Holds a static set of instance transforms, such as vegetation or a crowd,
+// and culls them against the camera frustum every frame, see
+// GeometryDrawable::SetInstanceCuller(). With GLES 3.1 the instances live
+// in a storage buffer and a compute shader writes the visible transforms
+// and the instance count of an indirect draw, so the CPU cost does not grow
+// with the number of instances. Otherwise the instances are tested on the
+// CPU and the visible transforms are uploaded. Must be used on the render
+// thread.
+class InstanceCuller : protected ResourceGL {
+public:
+  static InstanceCullerPtr Create(CreationContextPtr& aContext);
+  // aTransforms place the instances relative to the drawable and aBounds
+  // are the local bounds of the geometry. Uploaded by the next Cull().
+  void SetInstances(const std::vector<Matrix>& aTransforms, const Bounds& aBounds);
+  int32_t GetInstanceCount() const;
+  // Bounds of every instance, relative to the drawable.
+  const Bounds& GetBounds() const;
+  // True once InitializeGL has found compute shader support.
+  bool IsGPUCulling() const;
+  // Writes the world transforms of the instances drawn with aModel that
+  // are visible to aCamera into the instance buffer. Returns false when no
+  // instance is visible, which on the GPU is only known while drawing.
+  bool Cull(const Camera& aCamera, const Matrix& aModel, const GLsizei aIndexCount);
+  GLuint GetInstanceBuffer() const;
+  // Draws the indices of aBuffer, bound through a vertex array, once per
+  // instance left visible by the last Cull().
+  void Draw(const RenderBuffer& aBuffer);
+protected:
+  struct State;
+  InstanceCuller(State& aState, CreationContextPtr& aContext);
+  ~InstanceCuller();
+
+  // ResourceGL interface
+  void InitializeGL() override;
+  void ShutdownGL() override;
+
+private:
+  State& m;
+  InstanceCuller() = delete;
+  VRB_NO_DEFAULTS(InstanceCuller)
+};
+
+} // namespace vrb
+
+#endif // VRB_INSTANCE_CULLER_DOT_H
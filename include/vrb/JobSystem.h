@@ -0,0 +1,75 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_JOB_SYSTEM_DOT_H
+#define VRB_JOB_SYSTEM_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <functional>
+#include <memory>
+
+namespace vrb {
+
+// Work stealing task scheduler shared by the subsystems of a RenderContext,
+// see RenderContext::GetJobSystem. Each worker thread runs the jobs it
+// created itself first, newest first, and takes the oldest jobs of other
+// threads when it runs out. Threads calling Wait run jobs as well.
+//
+// A job finishes once its task and the tasks of all its children have run,
+// so waiting on a parent waits for the whole tree.
+class JobSystem {
+public:
+  struct Job;
+  typedef std::shared_ptr<Job> JobHandle;
+  typedef std::function<void()> Task;
+  // Called on each worker thread, with its index, before it runs any job.
+  typedef std::function<void(const int32_t aWorkerIndex)> ThreadHook;
+
+  static JobSystemPtr Create();
+
+  // Number of worker threads, zero by default meaning one less than the
+  // number of CPUs. With no worker threads jobs only run in Wait. Must be
+  // set before the first job is run.
+  void SetWorkerCount(const int32_t aCount);
+  int32_t GetWorkerCount() const;
+  // Lets the application pin workers to cores or change their priority,
+  // for example to keep them on the big cores of big.LITTLE devices with
+  // SetThreadAffinity. Must be set before the first job is run.
+  void SetThreadHook(const ThreadHook& aHook);
+
+  // aTask may be empty to create a job that only groups its children. The
+  // parent may not finish before aParent is run and must not have finished.
+  JobHandle Create(Task&& aTask, const JobHandle& aParent = nullptr);
+  // Queues a job returned by Create. Threads are started by the first call.
+  void Run(const JobHandle& aJob);
+  // Create followed by Run.
+  JobHandle Schedule(Task&& aTask, const JobHandle& aParent = nullptr);
+  // Runs queued jobs until aJob has finished.
+  void Wait(const JobHandle& aJob);
+  bool IsFinished(const JobHandle& aJob) const;
+  // Runs every queued job and joins the worker threads.
+  void Shutdown();
+
+  // Helpers for ThreadHook. aCPUMask has one bit per CPU. They only affect
+  // the calling thread and return false where unsupported.
+  static bool SetThreadAffinity(const uint64_t aCPUMask);
+  static bool SetThreadNiceness(const int32_t aNiceness);
+
+protected:
+  struct State;
+  JobSystem(State& aState);
+  ~JobSystem();
+
+private:
+  State& m;
+  JobSystem() = delete;
+  VRB_NO_DEFAULTS(JobSystem)
+};
+
+} // namespace vrb
+
+#endif // VRB_JOB_SYSTEM_DOT_H
@@ -0,0 +1,106 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_KTX2_DECODER_DOT_H
+#define VRB_KTX2_DECODER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include "vrb/gl.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace vrb {
+
+struct ImageLevel;
+
+// Reads KTX2 containers for FileReaderBasic and FileReaderAndroid, see
+// RenderContext::GetKTX2Decoder. Levels stored in an ETC2, ASTC or RGBA8
+// format are handed to the FileHandler as is. Basis Universal payloads,
+// BasisLZ or UASTC, are transcoded by the TextureTranscoder to the target
+// picked from the GLExtensions, on the JobSystem one job per face and level.
+class KTX2Decoder {
+public:
+  // Formats Basis Universal payloads are transcoded to, smallest first.
+  enum class Target {
+    ASTC_4x4, // GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+    ETC2,     // GL_COMPRESSED_RGBA8_ETC2_EAC
+    RGBA8     // GL_RGBA
+  };
+
+  struct Level {
+    const uint8_t* data;
+    uint64_t length;
+    uint64_t uncompressedLength;
+    Level() : data(nullptr), length(0), uncompressedLength(0) {}
+  };
+
+  // A parsed container. The pointers reference the file data passed to
+  // Decode and are only valid during the call.
+  struct Image {
+    uint32_t vkFormat;
+    uint32_t width;
+    uint32_t height;
+    uint32_t faceCount;
+    uint32_t supercompression;
+    const uint8_t* dfd;
+    uint32_t dfdLength;
+    const uint8_t* sgd;
+    uint64_t sgdLength;
+    std::vector<Level> levels;
+    Image()
+        : vkFormat(0), width(0), height(0), faceCount(1), supercompression(0)
+        , dfd(nullptr), dfdLength(0), sgd(nullptr), sgdLength(0)
+    {}
+    // True when the payload needs a TextureTranscoder.
+    bool IsBasis() const;
+  };
+
+  static KTX2DecoderPtr Create();
+  static bool IsKTX2(const char* aData, const size_t aSize);
+  // ASTC when supported, ETC2 on GLES3 class hardware and RGBA8 otherwise.
+  static Target SelectTarget(const GLExtensions& aExtensions);
+
+  // Set by RenderContext, the target each time GL is initialized.
+  void SetJobSystem(const JobSystemPtr& aJobSystem);
+  void SetTarget(const Target aTarget);
+  Target GetTarget() const;
+  // vrb does not bundle a Basis Universal transcoder. Applications that ship
+  // Basis textures provide one, without it those files fail to load.
+  void SetTranscoder(const TextureTranscoderPtr& aTranscoder);
+
+  // Fills aLevels ordered by face then level. Blocks until every job has
+  // run. Safe to call from several threads at once.
+  bool Decode(const char* aData, const size_t aSize, std::vector<ImageLevel>& aLevels, std::string& aError);
+protected:
+  struct State;
+  KTX2Decoder(State& aState);
+  ~KTX2Decoder();
+private:
+  State& m;
+  KTX2Decoder() = delete;
+  VRB_NO_DEFAULTS(KTX2Decoder)
+};
+
+// Wraps a Basis Universal transcoder such as basisu's ktx2_transcoder.
+class TextureTranscoder {
+public:
+  // Transcodes aFace of aLevel to aTarget, setting the data, length, width,
+  // height and format of aResult. Called from worker threads, possibly for
+  // several faces and levels of the same image at once.
+  virtual bool Transcode(const KTX2Decoder::Image& aImage, const uint32_t aLevel, const uint32_t aFace,
+                         const KTX2Decoder::Target aTarget, ImageLevel& aResult) = 0;
+protected:
+  TextureTranscoder() {}
+  virtual ~TextureTranscoder() {}
+private:
+  VRB_NO_DEFAULTS(TextureTranscoder)
+};
+
+} // namespace vrb
+
+#endif // VRB_KTX2_DECODER_DOT_H
@@ -0,0 +1,55 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_KEYFRAME_TRACK_DOT_H
+#define VRB_KEYFRAME_TRACK_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <cstdint>
+
+namespace vrb {
+
+class Matrix;
+class Quaternion;
+class Vector;
+
+// Keyframes of one translation, rotation or scale channel, with times in
+// seconds. Values are interpolated linearly, rotations with Slerp. Times and
+// values are stored in two flat arrays. A track may be shared by any number
+// of AnimatedTransforms, see AnimatedTransform::AddKeyframeAnimation.
+class KeyframeTrack {
+public:
+  enum class Target { Translation, Rotation, Scale };
+  static KeyframeTrackPtr Create(const Target aTarget);
+
+  Target GetTarget() const;
+  // Keys must be added in increasing time order. Vector keys are for
+  // translation and scale tracks, Quaternion keys for rotation tracks.
+  void AddKey(const float aTime, const Vector& aValue);
+  void AddKey(const float aTime, const Quaternion& aValue);
+  int32_t GetKeyCount() const;
+  // Time of the last key.
+  float GetDuration() const;
+  // Samples the track at aTime, clamped to the first and last key. aCursor
+  // is the key sampled last. Sampling at or just after it takes constant
+  // time, anything else a binary search. Start it at zero.
+  Matrix Sample(const float aTime, uint32_t& aCursor) const;
+
+protected:
+  struct State;
+  KeyframeTrack(State& aState);
+  ~KeyframeTrack();
+
+private:
+  State& m;
+  KeyframeTrack() = delete;
+  VRB_NO_DEFAULTS(KeyframeTrack)
+};
+
+} // namespace vrb
+
+#endif // VRB_KEYFRAME_TRACK_DOT_H
@@ -0,0 +1,45 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_LATE_LATCH_DOT_H
+#define VRB_LATE_LATCH_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+namespace vrb {
+
+// Feeds the vrb_Camera uniform block of FeatureLateLatch programs from the
+// StreamBuffer. Bind() writes the camera before a frame is drawn and
+// Latch() rewrites it with a newer head pose once every draw has been
+// issued, so the GPU renders with a pose sampled just before submission
+// instead of the one predicted before culling. Cull with a widened frustum,
+// see Frustum::FromCamera(), so content rotated into view by the newer pose
+// is not missing. Must be used on the render thread.
+class LateLatch {
+public:
+  static LateLatchPtr Create(RenderContextPtr& aContext);
+  // Writes the matrices of aCamera into this frame of the StreamBuffer and
+  // binds them to VRB_CAMERA_BLOCK_BINDING. Returns false when the frame is
+  // full or the buffer is not created.
+  bool Bind(const Camera& aCamera);
+  // Replaces the matrices written by the last Bind() of this frame with
+  // those of aCamera. Returns false, leaving the bound pose in use, when
+  // nothing was bound this frame or the StreamBuffer is not persistently
+  // mapped.
+  bool Latch(const Camera& aCamera);
+protected:
+  struct State;
+  LateLatch(State& aState, RenderContextPtr& aContext);
+  ~LateLatch();
+private:
+  State& m;
+  LateLatch() = delete;
+  VRB_NO_DEFAULTS(LateLatch)
+};
+
+} // namespace vrb
+
+#endif // VRB_LATE_LATCH_DOT_H
@@ -0,0 +1,49 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_LEVEL_OF_DETAIL_DOT_H
+#define VRB_LEVEL_OF_DETAIL_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Toggle.h"
+
+namespace vrb {
+
+// Toggle that only enables one of its levels, picked during Cull from the
+// screen coverage reported by the CullVisitor. Children added with AddNode
+// instead of AddLevel are always drawn.
+class LevelOfDetail : public Toggle {
+public:
+  static LevelOfDetailPtr Create(CreationContextPtr& aContext);
+
+  // Node interface
+  void Cull(CullVisitor& aVisitor, DrawableList& aDrawables) override;
+  void Flatten(SceneSnapshot& aSnapshot) override;
+
+  // LevelOfDetail interface
+  // Levels are added from the most to the least detailed. The first level
+  // whose aMinCoverage is reached is drawn, so the last level should use 0
+  // unless the node should disappear when small enough.
+  void AddLevel(NodePtr aNode, const float aMinCoverage);
+  int32_t GetLevelCount() const;
+  // Level picked by the last Cull, -1 if none was.
+  int32_t GetCurrentLevel() const;
+
+protected:
+  typedef Toggle Super;
+  struct State;
+  LevelOfDetail(State& aState, CreationContextPtr& aContext);
+  ~LevelOfDetail();
+
+private:
+  State& m;
+  LevelOfDetail() = delete;
+  VRB_NO_DEFAULTS(LevelOfDetail)
+};
+
+} // namespace vrb
+
+#endif // VRB_LEVEL_OF_DETAIL_DOT_H
@@ -19,11 +19,19 @@ public:
   const Color& GetAmbientColor() const;
   const Color& GetDiffuseColor() const;
   const Color& GetSpecularColor() const;
+  // A light with a range greater than zero is a point light at its world
+  // space position. It fades out at the range and only draws within it are
+  // given the light, so a scene may hold more of them than VRB_MAX_LIGHTS.
+  // Lights are directional when the range is zero, the default.
+  const Vector& GetPosition() const;
+  float GetRange() const;
 
   void SetDirection(const Vector& aDirection);
   void SetAmbientColor(const Color& aColor);
   void SetDiffuseColor(const Color& aColor);
   void SetSpecularColor(const Color& aColor);
+  void SetPosition(const Vector& aPosition);
+  void SetRange(const float aRange);
 protected:
   struct State;
   Light(State& aState, CreationContextPtr& aContext);
@@ -0,0 +1,59 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_LIGHT_BLOCK_DOT_H
+#define VRB_LIGHT_BLOCK_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/Color.h"
+#include "vrb/Vector.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace vrb {
+
+// Immutable set of lights applied to a RenderState. DrawableList interns
+// blocks by content so every draw under the same lights shares one block and
+// a RenderState only has to compare pointers to know its lights are current.
+struct LightBlock {
+  struct Entry {
+    Vector direction;
+    Color ambient;
+    Color diffuse;
+    Color specular;
+    // Point lights have a range greater than zero, see Light::SetRange().
+    Vector position;
+    float range;
+    bool operator==(const Entry& aEntry) const {
+      return (direction == aEntry.direction) && (ambient == aEntry.ambient) &&
+             (diffuse == aEntry.diffuse) && (specular == aEntry.specular) &&
+             (position == aEntry.position) && (range == aEntry.range);
+    }
+  };
+  uint64_t hash;
+  std::vector<Entry> lights;
+  LightBlock() : hash(0) {}
+
+  // FNV-1a over the light values, chained from aHash.
+  static uint64_t Hash(const Entry& aEntry, uint64_t aHash) {
+    const float* values[] = {aEntry.direction.Data(), aEntry.ambient.Data(), aEntry.diffuse.Data(), aEntry.specular.Data(),
+                             aEntry.position.Data(), &aEntry.range};
+    const int counts[] = {3, 4, 4, 4, 3, 1};
+    for (int ix = 0; ix < 6; ix++) {
+      const uint8_t* bytes = (const uint8_t*)values[ix];
+      for (size_t jx = 0; jx < counts[ix] * sizeof(float); jx++) {
+        aHash ^= bytes[jx];
+        aHash *= 0x100000001b3ull;
+      }
+    }
+    return aHash;
+  }
+  static uint64_t EmptyHash() { return 0xcbf29ce484222325ull; }
+};
+
+} // namespace vrb
+
+#endif // VRB_LIGHT_BLOCK_DOT_H
@@ -0,0 +1,125 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_LOAD_REPORT_DOT_H
+#define VRB_LOAD_REPORT_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+
+namespace vrb {
+
+// Where the time of one model load went, see
+// ModelLoaderBasic::SetLoadReportCallback. Times are in seconds and
+// exclusive, a texture decoded while the mesh is parsed is not counted as
+// parse time as well. Work done on other threads, such as prefetched
+// textures, is added too, so the phases may sum to more than the total.
+// File reads through a mapping are counted in the phase that touches the
+// pages.
+struct LoadReport {
+  enum class Phase {
+    Read,
+    Parse,
+    MeshBuild,
+    GeometryUpload,
+    TextureDecode,
+    TextureUpload,
+    // Time spent in the compile and link calls, drivers may finish the
+    // work later.
+    ShaderCompile,
+    Count
+  };
+  enum class Counter {
+    // Counted over every Geometry of the loaded nodes, including each
+    // level of detail. Vertices of a shared VertexArray are counted once.
+    Vertices,
+    Triangles,
+    Draws,
+    VertexBytes,
+    IndexBytes,
+    TextureBytes,
+    Count
+  };
+  std::string name;
+  // Wall clock time of the load task and of the uploads made for it.
+  double total;
+  double times[(int)Phase::Count];
+  uint64_t values[(int)Counter::Count];
+
+  LoadReport() : total(0.0), times(), values() {}
+  double Get(const Phase aPhase) const {
+    return times[(int)aPhase];
+  }
+  uint64_t Get(const Counter aCounter) const {
+    return values[(int)aCounter];
+  }
+  // Single line summary for the log.
+  std::string ToString() const;
+};
+
+typedef std::function<void(GroupPtr& aTarget, const LoadReport& aReport)> LoadReportCallback;
+
+// Accumulates a LoadReport from every thread it is current on. Loaders make
+// it current while a load task and its uploads run. May be used from any
+// thread.
+class LoadReportCollector {
+public:
+  static LoadReportCollectorPtr Create();
+  // Collector current on the calling thread, nullptr when none is.
+  static LoadReportCollectorPtr GetCurrent();
+  void SetName(const std::string& aName);
+  void AddTime(const LoadReport::Phase aPhase, const double aSeconds);
+  void AddValue(const LoadReport::Counter aCounter, const uint64_t aAmount);
+  // Adds the geometry counters of every node below aRoot.
+  void CountNodes(const GroupPtr& aRoot);
+  // Everything added so far, with aTotal as the wall clock time.
+  LoadReport GetReport(const double aTotal) const;
+protected:
+  struct State;
+  LoadReportCollector(State& aState);
+  ~LoadReportCollector();
+private:
+  State& m;
+  LoadReportCollector() = delete;
+  VRB_NO_DEFAULTS(LoadReportCollector)
+};
+
+// Makes aCollector, which may be null, current on the calling thread until
+// the scope ends. Work handed to another thread takes the collector along
+// with a scope of its own.
+class LoadReportScope {
+public:
+  explicit LoadReportScope(const LoadReportCollectorPtr& aCollector);
+  ~LoadReportScope();
+private:
+  LoadReportCollectorPtr mPrevious;
+  LoadReportScope() = delete;
+  VRB_NO_DEFAULTS(LoadReportScope)
+};
+
+// Adds the time until it is destroyed to aPhase of the current collector.
+// A nested timer pauses the enclosing one. Costs a thread local read when
+// no collector is current.
+class LoadReportTimer {
+public:
+  explicit LoadReportTimer(const LoadReport::Phase aPhase);
+  ~LoadReportTimer();
+private:
+  LoadReportCollector* mCollector;
+  LoadReportTimer* mParent;
+  LoadReport::Phase mPhase;
+  double mStart;
+  double mElapsed;
+  LoadReportTimer() = delete;
+  VRB_NO_DEFAULTS(LoadReportTimer)
+};
+
+} // namespace vrb
+
+#endif // VRB_LOAD_REPORT_DOT_H
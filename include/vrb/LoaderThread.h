@@ -8,6 +8,7 @@
 
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
+#include <atomic>
 #include <functional>
 #include <string>
 
@@ -16,12 +17,41 @@ namespace vrb {
 typedef std::function<void(GroupPtr&)> LoadFinishedCallback;
 typedef std::function<GroupPtr(CreationContextPtr&)> LoadTask;
 
+// Shared between the submitter and the loader. Queued tasks with a higher
+// priority run first and the priority may be changed while the task is
+// queued. A cancelled task is dropped before it runs, or after it runs but
+// before its GL resources are uploaded, and its callback is not called.
+class LoadToken {
+public:
+  static LoadTokenPtr Create(const int aPriority) {
+    LoadTokenPtr result = std::make_shared<LoadToken>();
+    result->SetPriority(aPriority);
+    return result;
+  }
+  void Cancel() { mCancelled = true; }
+  bool IsCancelled() const { return mCancelled; }
+  void SetPriority(const int aPriority) { mPriority = aPriority; }
+  int GetPriority() const { return mPriority; }
+  LoadToken() : mCancelled(false), mPriority(0) {}
+private:
+  std::atomic<bool> mCancelled;
+  std::atomic<int> mPriority;
+  VRB_NO_DEFAULTS(LoadToken)
+};
+
 class LoaderThread {
 public:
   virtual void RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask) = 0;
   virtual void RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback) = 0;
+  // aToken may be null, which is the same as a token with priority zero that
+  // is never cancelled.
+  virtual void RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken) = 0;
   virtual void AddFinishedCallback(LoadFinishedCallback& aCallback) = 0;
   virtual bool IsOnLoaderThread() const = 0;
+  // Only the first aLimit workers take new tasks, the others finish the task
+  // they run and wait until the limit is raised. Zero or less, the default,
+  // lets every worker run. May be called on any thread.
+  virtual void SetActiveWorkerLimit(const int aLimit) = 0;
 protected:
   LoaderThread() = default;
   ~LoaderThread() = default;
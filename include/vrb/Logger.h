@@ -6,23 +6,65 @@
 #ifndef VRBROWSER_LOGGER_H
 #define VRBROWSER_LOGGER_H
 
-#if defined(ANDROID)
-#  include <android/log.h>
+#define VRB_LOG_LEVEL_DEBUG 0
+#define VRB_LOG_LEVEL_INFO  1
+#define VRB_LOG_LEVEL_WARN  2
+#define VRB_LOG_LEVEL_ERROR 3
+#define VRB_LOG_LEVEL_NONE  4
+
+// Messages below VRB_LOG_LEVEL are compiled out entirely. Their arguments
+// are still type checked but never evaluated, so values only computed for a
+// message do not become unused.
+#if !defined(VRB_LOG_LEVEL)
 #  if defined(NDEBUG)
-#    define VRB_DEBUG(...)
+#    define VRB_LOG_LEVEL VRB_LOG_LEVEL_INFO
 #  else
-#    define VRB_DEBUG(format, ...) __android_log_print(ANDROID_LOG_DEBUG, "VRB", format, ##__VA_ARGS__);
+#    define VRB_LOG_LEVEL VRB_LOG_LEVEL_DEBUG
 #  endif
-#  define VRB_LOG(format, ...) __android_log_print(ANDROID_LOG_INFO, "VRB", format, ##__VA_ARGS__);
-#  define VRB_WARN(format, ...) __android_log_print(ANDROID_LOG_WARN, "VRB", format, ##__VA_ARGS__);
-#  define VRB_ERROR(format, ...) __android_log_print(ANDROID_LOG_ERROR, "VRB", format, ##__VA_ARGS__);
+#endif
+
+#if VRB_LOG_LEVEL <= VRB_LOG_LEVEL_DEBUG
+#  define VRB_DEBUG(format, ...) vrb::LogMessage(VRB_LOG_LEVEL_DEBUG, format, ##__VA_ARGS__);
+#else
+#  define VRB_DEBUG(...) do { if (0) { vrb::LogMessage(VRB_LOG_LEVEL_DEBUG, __VA_ARGS__); } } while (0);
+#endif
+#if VRB_LOG_LEVEL <= VRB_LOG_LEVEL_INFO
+#  define VRB_LOG(format, ...) vrb::LogMessage(VRB_LOG_LEVEL_INFO, format, ##__VA_ARGS__);
+#else
+#  define VRB_LOG(...) do { if (0) { vrb::LogMessage(VRB_LOG_LEVEL_INFO, __VA_ARGS__); } } while (0);
+#endif
+#if VRB_LOG_LEVEL <= VRB_LOG_LEVEL_WARN
+#  define VRB_WARN(format, ...) vrb::LogMessage(VRB_LOG_LEVEL_WARN, format, ##__VA_ARGS__);
 #else
-#  include <stdio.h>
-#  define VRB_DEBUG(format, ...) fprintf(stderr, "VRB DEBUG: " format "\n", ##__VA_ARGS__);
-#  define VRB_LOG(format, ...) fprintf(stderr, "VRB: " format "\n", ##__VA_ARGS__);
-#  define VRB_WARN(format, ...) fprintf(stderr, "VRB WARNING: " format "\n", ##__VA_ARGS__);
-#  define VRB_ERROR(format, ...) fprintf(stderr, "VRB ERROR: " format "\n", ##__VA_ARGS__);
+#  define VRB_WARN(...) do { if (0) { vrb::LogMessage(VRB_LOG_LEVEL_WARN, __VA_ARGS__); } } while (0);
+#endif
+#if VRB_LOG_LEVEL <= VRB_LOG_LEVEL_ERROR
+#  define VRB_ERROR(format, ...) vrb::LogMessage(VRB_LOG_LEVEL_ERROR, format, ##__VA_ARGS__);
+#else
+#  define VRB_ERROR(...) do { if (0) { vrb::LogMessage(VRB_LOG_LEVEL_ERROR, __VA_ARGS__); } } while (0);
 #endif
 #define VRB_LINE VRB_DEBUG("%s:%s:%d", __FILE__, __FUNCTION__, __LINE__);
 
+namespace vrb {
+
+// Formats and writes a message at one of the VRB_LOG_LEVEL_* levels. While
+// the asynchronous logger is running the message is queued and written by a
+// background thread, otherwise it is written immediately.
+void LogMessage(const int aLevel, const char* aFormat, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+// Starts the background thread that writes queued messages. Messages are
+// dropped rather than blocking the caller when the queue is full.
+void LoggerStartAsync();
+// Writes any queued messages and stops the background thread.
+void LoggerStopAsync();
+// Blocks until every message queued so far has been written.
+void LoggerFlush();
+bool LoggerIsAsync();
+
+} // namespace vrb
+
 #endif //VRBROWSER_LOGGER_H
@@ -0,0 +1,87 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_MAPPED_FILE_DOT_H
+#define VRB_MAPPED_FILE_DOT_H
+
+#include "vrb/MacroUtils.h"
+
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vrb {
+
+// Read only mapping of a whole file, of a region of an open descriptor, or a
+// view into another mapping. IsValid() is false when the file could not be opened or mapped, or is empty.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& aFileName) : mMapping(nullptr), mMappingSize(0), mData(nullptr), mSize(0) {
+    const int fd = open(aFileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info = {};
+    if ((fstat(fd, &info) == 0) && (info.st_size > 0)) {
+      Map(fd, 0, (size_t)info.st_size);
+    }
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+  }
+  // Maps aLength bytes at aOffset of aDescriptor, which may be closed by the
+  // caller once the mapping is created. aOffset need not be page aligned.
+  MappedFile(const int aDescriptor, const off_t aOffset, const size_t aLength) : mMapping(nullptr), mMappingSize(0), mData(nullptr), mSize(0) {
+    if ((aDescriptor >= 0) && (aOffset >= 0) && (aLength > 0)) {
+      Map(aDescriptor, aOffset, aLength);
+    }
+  }
+  // View of aLength bytes at aOffset of aParent, which stays mapped as long
+  // as the view exists. Invalid when the range is outside of aParent.
+  MappedFile(const std::shared_ptr<MappedFile>& aParent, const size_t aOffset, const size_t aLength) : mMapping(nullptr), mMappingSize(0), mData(nullptr), mSize(0) {
+    if (aParent && aParent->IsValid() && (aLength > 0) && (aOffset <= aParent->Size()) && (aLength <= (aParent->Size() - aOffset))) {
+      mParent = aParent;
+      mData = aParent->Data() + aOffset;
+      mSize = aLength;
+    }
+  }
+  ~MappedFile() {
+    if (mMapping) {
+      munmap(mMapping, mMappingSize);
+    }
+  }
+  bool IsValid() const { return mData != nullptr; }
+  const char* Data() const { return mData; }
+  size_t Size() const { return mSize; }
+private:
+  void Map(const int aDescriptor, const off_t aOffset, const size_t aLength) {
+    // mmap offsets must be a multiple of the page size.
+    const off_t kPage = (off_t)sysconf(_SC_PAGESIZE);
+    const off_t kStart = kPage > 0 ? (aOffset / kPage) * kPage : aOffset;
+    const size_t kDelta = (size_t)(aOffset - kStart);
+    void* data = mmap(nullptr, aLength + kDelta, PROT_READ, MAP_PRIVATE, aDescriptor, kStart);
+    if (data == MAP_FAILED) {
+      return;
+    }
+    mMapping = data;
+    mMappingSize = aLength + kDelta;
+    mData = static_cast<const char*>(data) + kDelta;
+    mSize = aLength;
+    madvise(data, mMappingSize, MADV_SEQUENTIAL);
+  }
+  void* mMapping;
+  size_t mMappingSize;
+  const char* mData;
+  size_t mSize;
+  std::shared_ptr<MappedFile> mParent;
+  MappedFile() = delete;
+  VRB_NO_DEFAULTS(MappedFile)
+};
+
+} // namespace vrb
+
+#endif // VRB_MAPPED_FILE_DOT_H
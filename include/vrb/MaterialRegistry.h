@@ -0,0 +1,48 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_MATERIAL_REGISTRY_DOT_H
+#define VRB_MATERIAL_REGISTRY_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <cstddef>
+
+namespace vrb {
+
+// Context wide set of render states keyed by a hash of their program,
+// texture, material colors, specular exponent, tint, UV transform, texture
+// layer, transparency and lights flag. NodeFactoryObj passes each finished
+// material through Share(), so identical materials of different models, or
+// of different loads of a model, end up drawn with one RenderState, which
+// state sorting and automatic instancing batch together. A shared state must
+// not be modified since the change shows on every geometry using it. States
+// with a skeleton are never shared. Only weak references are kept. Disabled
+// by default. Thread safe.
+class MaterialRegistry {
+public:
+  static MaterialRegistryPtr Create();
+  // Returns the registered RenderState matching aState, registering aState
+  // when there is none. Returns aState while disabled.
+  RenderStatePtr Share(const RenderStatePtr& aState);
+  void SetEnabled(const bool aEnabled);
+  bool IsEnabled() const;
+  // Number of registered states still alive.
+  size_t GetCount() const;
+  void Clear();
+protected:
+  struct State;
+  MaterialRegistry(State& aState);
+  ~MaterialRegistry();
+private:
+  State& m;
+  MaterialRegistry() = delete;
+  VRB_NO_DEFAULTS(MaterialRegistry)
+};
+
+} // namespace vrb
+
+#endif // VRB_MATERIAL_REGISTRY_DOT_H
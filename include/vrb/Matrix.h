@@ -14,6 +14,27 @@
 #include <cmath>
 #include <cstdlib>
 
+// Matrix products use NEON or SSE when the target supports them. Define
+// VRB_MATRIX_SCALAR to force the portable loops. The SIMD paths perform the
+// same multiplies and additions in the same order, so results match the
+// scalar loops bit for bit unless the compiler fuses them into FMAs.
+#if !defined(VRB_MATRIX_SCALAR)
+#  if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    include <arm_neon.h>
+#    define VRB_MATRIX_NEON 1
+#  elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#    include <xmmintrin.h>
+#    define VRB_MATRIX_SSE 1
+#  endif
+#endif
+
+// Define VRB_MATRIX_ALIGNED to store Matrix data on a 16 byte boundary.
+#if defined(VRB_MATRIX_ALIGNED)
+#  define VRB_MATRIX_ALIGNMENT alignas(16)
+#else
+#  define VRB_MATRIX_ALIGNMENT
+#endif
+
 #define VRB_IS_ZERO(value) (std::fabs(value) < FLT_EPSILON)
 
 namespace vrb {
@@ -24,7 +45,7 @@ const float ToDegrees = 180.0f / PI_FLOAT;
 
 class Matrix {
 public:
-  static Matrix Identity() {
+  static constexpr Matrix Identity() {
     return Matrix(
       1.0f, 0.0f, 0.0f, 0.0f,
       0.0f, 1.0f, 0.0f, 0.0f,
@@ -32,7 +53,7 @@ public:
       0.0f, 0.0f, 0.0f, 1.0f);
   }
 
-  static Matrix FromColumnMajor(const float aData[4][4]) {
+  static constexpr Matrix FromColumnMajor(const float aData[4][4]) {
     return Matrix(
         aData[0][0], aData[0][1], aData[0][2], aData[0][3],
         aData[1][0], aData[1][1], aData[1][2], aData[1][3],
@@ -40,7 +61,7 @@ public:
         aData[3][0], aData[3][1], aData[3][2], aData[3][3]);
   }
 
-  static Matrix FromColumnMajor(const float aData[16]) {
+  static constexpr Matrix FromColumnMajor(const float aData[16]) {
     return Matrix(
         aData[0], aData[1], aData[2], aData[3],
         aData[4], aData[5], aData[6], aData[7],
@@ -48,7 +69,7 @@ public:
         aData[12], aData[13], aData[14], aData[15]);
   }
 
-  static Matrix FromRowMajor(const float aData[4][4]) {
+  static constexpr Matrix FromRowMajor(const float aData[4][4]) {
     return Matrix(
         aData[0][0], aData[1][0], aData[2][0], aData[3][0],
         aData[0][1], aData[1][1], aData[2][1], aData[3][1],
@@ -56,7 +77,7 @@ public:
         aData[0][3], aData[1][3], aData[2][3], aData[3][3]);
   }
 
-  static Matrix FromRowMajor(const float aData[16]) {
+  static constexpr Matrix FromRowMajor(const float aData[16]) {
     return Matrix(
       aData[0], aData[4], aData[8], aData[12],
       aData[1], aData[5], aData[9], aData[13],
@@ -64,12 +85,33 @@ public:
       aData[3], aData[7], aData[11], aData[15]);
   }
 
-  static Matrix Position(const Vector& aPosition) {
-    return Identity().TranslateInPlace(aPosition);
+  static constexpr Matrix Position(const Vector& aPosition) {
+    return Translation(aPosition);
   }
 
-  static Matrix Translation(const Vector& aTranslation) {
-    return Identity().TranslateInPlace(aTranslation);
+  static constexpr Matrix Translation(const Vector& aTranslation) {
+    return Matrix(
+      1.0f, 0.0f, 0.0f, 0.0f,
+      0.0f, 1.0f, 0.0f, 0.0f,
+      0.0f, 0.0f, 1.0f, 0.0f,
+      aTranslation.x(), aTranslation.y(), aTranslation.z(), 1.0f);
+  }
+
+  static constexpr Matrix Scaling(const Vector& aScale) {
+    return Matrix(
+      aScale.x(), 0.0f, 0.0f, 0.0f,
+      0.0f, aScale.y(), 0.0f, 0.0f,
+      0.0f, 0.0f, aScale.z(), 0.0f,
+      0.0f, 0.0f, 0.0f, 1.0f);
+  }
+
+  // Translation(aTranslation) * Scaling(aScale) without the product.
+  static constexpr Matrix FromTranslationScale(const Vector& aTranslation, const Vector& aScale) {
+    return Matrix(
+      aScale.x(), 0.0f, 0.0f, 0.0f,
+      0.0f, aScale.y(), 0.0f, 0.0f,
+      0.0f, 0.0f, aScale.z(), 0.0f,
+      aTranslation.x(), aTranslation.y(), aTranslation.z(), 1.0f);
   }
 
   static Matrix Rotation(const Vector& aAxis, const float aRotation) {
@@ -149,6 +191,28 @@ public:
     return result;
   }
 
+  // Translation * rotation * uniform scale, the transform of most nodes.
+  static Matrix FromTRS(const Vector& aTranslation, const Quaternion& aRotation, const float aScale) {
+    return FromTRS(aTranslation, aRotation, Vector(aScale, aScale, aScale));
+  }
+
+  // Translation(aTranslation) * Rotation(aRotation) * Scaling(aScale), built
+  // in one pass instead of two full products.
+  static Matrix FromTRS(const Vector& aTranslation, const Quaternion& aRotation, const Vector& aScale) {
+    Matrix result = Rotation(aRotation);
+    auto& m = result.m.m;
+    const float kScale[3] = {aScale.x(), aScale.y(), aScale.z()};
+    for (int32_t column = 0; column < 3; column++) {
+      m[column][0] *= kScale[column];
+      m[column][1] *= kScale[column];
+      m[column][2] *= kScale[column];
+    }
+    m[3][0] = aTranslation.x();
+    m[3][1] = aTranslation.y();
+    m[3][2] = aTranslation.z();
+    return result;
+  }
+
 
   static Matrix PerspectiveMatrix(
       const float aLeft, const float aRight, const float aTop, const float aBottom,
@@ -223,13 +287,13 @@ public:
         aNear, aFar);
   }
 
-  Matrix() : m(
+  constexpr Matrix() : m(
       0.0f, 0.0f, 0.0f, 0.0f,
       0.0f, 0.0f, 0.0f, 0.0f,
       0.0f, 0.0f, 0.0f, 0.0f,
       0.0f, 0.0f, 0.0f, 0.0f) {}
 
-  Matrix(
+  constexpr Matrix(
       float a00, float a01, float a02, float a03,
       float a10, float a11, float a12, float a13,
       float a20, float a21, float a22, float a23,
@@ -255,7 +319,7 @@ public:
     return m.m[aColumn][aRow];
   }
 
-  Matrix(const Matrix& aValue) : m(aValue.m) {}
+  constexpr Matrix(const Matrix& aValue) : m(aValue.m) {}
 
   Matrix& operator=(const Matrix& aMatrix) {
     m.Copy(aMatrix.m);
@@ -307,31 +371,27 @@ public:
 
   Matrix PreMultiply(const Matrix& aMatrix) const {
     Matrix result;
-    for(int ix = 0; ix < 4; ix++) {
-      for(int jy = 0; jy < 4; jy++) {
-        float sum = 0;
-        for(int kz = 0; kz < 4; kz++) {
-           sum += aMatrix.m.m[kz][jy] * m.m[ix][kz];
-        }
-        result.m.m[ix][jy] = sum;
-      }
-    }
-
+    Multiply(aMatrix.m, m, result.m);
     return result;
   }
 
   Matrix PostMultiply(const Matrix& aMatrix) const {
     Matrix result;
-    for(int ix = 0; ix < 4; ix++) {
-      for(int jy = 0; jy < 4; jy++) {
-        float sum = 0;
-        for(int kz = 0; kz < 4; kz++) {
-           sum += m.m[kz][jy] * aMatrix.m.m[ix][kz];
-        }
-        result.m.m[ix][jy] = sum;
-      }
-    }
+    Multiply(m, aMatrix.m, result.m);
+    return result;
+  }
+
+  // True when the bottom row is 0 0 0 1, as for any combination of
+  // translation, rotation and scale.
+  bool IsAffine() const {
+    return (m.m03 == 0.0f) && (m.m13 == 0.0f) && (m.m23 == 0.0f) && (m.m33 == 1.0f);
+  }
 
+  // Same as PostMultiply for an affine aMatrix, skipping the products with
+  // its bottom row.
+  Matrix AffinePostMultiply(const Matrix& aMatrix) const {
+    Matrix result;
+    MultiplyAffine(m, aMatrix.m, result.m);
     return result;
   }
 
@@ -584,7 +644,7 @@ public:
   }
 
 protected:
-  typedef union data {
+  typedef union VRB_MATRIX_ALIGNMENT data {
     float m[4][4];
     struct {
       float m00, m01, m02, m03;
@@ -601,7 +661,7 @@ protected:
       }
     }
 
-    data(
+    constexpr data(
         float a00, float a01, float a02, float a03,
         float a10, float a11, float a12, float a13,
         float a20, float a21, float a22, float a23,
@@ -611,11 +671,94 @@ protected:
         m20(a20), m21(a21), m22(a22), m23(a23),
         m30(a30), m31(a31), m32(a32), m33(a33) {}
 
-    data(const data& aData) {
-      Copy(aData);
-    }
+    constexpr data(const data& aData) :
+        data(
+        aData.m00, aData.m01, aData.m02, aData.m03,
+        aData.m10, aData.m11, aData.m12, aData.m13,
+        aData.m20, aData.m21, aData.m22, aData.m23,
+        aData.m30, aData.m31, aData.m32, aData.m33) {}
   } data_t;
 
+  // aResult = aLeft * aRight. aResult must not alias either operand.
+  static void Multiply(const data_t& aLeft, const data_t& aRight, data_t& aResult) {
+#if defined(VRB_MATRIX_NEON)
+    const float32x4_t left0 = vld1q_f32(aLeft.m[0]);
+    const float32x4_t left1 = vld1q_f32(aLeft.m[1]);
+    const float32x4_t left2 = vld1q_f32(aLeft.m[2]);
+    const float32x4_t left3 = vld1q_f32(aLeft.m[3]);
+    for (int ix = 0; ix < 4; ix++) {
+      // Separate multiply and add so the compiler does not fuse them.
+      float32x4_t column = vmulq_n_f32(left0, aRight.m[ix][0]);
+      column = vaddq_f32(column, vmulq_n_f32(left1, aRight.m[ix][1]));
+      column = vaddq_f32(column, vmulq_n_f32(left2, aRight.m[ix][2]));
+      column = vaddq_f32(column, vmulq_n_f32(left3, aRight.m[ix][3]));
+      vst1q_f32(aResult.m[ix], column);
+    }
+#elif defined(VRB_MATRIX_SSE)
+    const __m128 left0 = _mm_loadu_ps(aLeft.m[0]);
+    const __m128 left1 = _mm_loadu_ps(aLeft.m[1]);
+    const __m128 left2 = _mm_loadu_ps(aLeft.m[2]);
+    const __m128 left3 = _mm_loadu_ps(aLeft.m[3]);
+    for (int ix = 0; ix < 4; ix++) {
+      __m128 column = _mm_mul_ps(left0, _mm_set1_ps(aRight.m[ix][0]));
+      column = _mm_add_ps(column, _mm_mul_ps(left1, _mm_set1_ps(aRight.m[ix][1])));
+      column = _mm_add_ps(column, _mm_mul_ps(left2, _mm_set1_ps(aRight.m[ix][2])));
+      column = _mm_add_ps(column, _mm_mul_ps(left3, _mm_set1_ps(aRight.m[ix][3])));
+      _mm_storeu_ps(aResult.m[ix], column);
+    }
+#else
+    for(int ix = 0; ix < 4; ix++) {
+      for(int jy = 0; jy < 4; jy++) {
+        float sum = 0;
+        for(int kz = 0; kz < 4; kz++) {
+           sum += aLeft.m[kz][jy] * aRight.m[ix][kz];
+        }
+        aResult.m[ix][jy] = sum;
+      }
+    }
+#endif
+  }
+
+  // aRight must be affine.
+  static void MultiplyAffine(const data_t& aLeft, const data_t& aRight, data_t& aResult) {
+#if defined(VRB_MATRIX_NEON)
+    const float32x4_t left0 = vld1q_f32(aLeft.m[0]);
+    const float32x4_t left1 = vld1q_f32(aLeft.m[1]);
+    const float32x4_t left2 = vld1q_f32(aLeft.m[2]);
+    for (int ix = 0; ix < 4; ix++) {
+      float32x4_t column = vmulq_n_f32(left0, aRight.m[ix][0]);
+      column = vaddq_f32(column, vmulq_n_f32(left1, aRight.m[ix][1]));
+      column = vaddq_f32(column, vmulq_n_f32(left2, aRight.m[ix][2]));
+      if (ix == 3) {
+        column = vaddq_f32(column, vld1q_f32(aLeft.m[3]));
+      }
+      vst1q_f32(aResult.m[ix], column);
+    }
+#elif defined(VRB_MATRIX_SSE)
+    const __m128 left0 = _mm_loadu_ps(aLeft.m[0]);
+    const __m128 left1 = _mm_loadu_ps(aLeft.m[1]);
+    const __m128 left2 = _mm_loadu_ps(aLeft.m[2]);
+    for (int ix = 0; ix < 4; ix++) {
+      __m128 column = _mm_mul_ps(left0, _mm_set1_ps(aRight.m[ix][0]));
+      column = _mm_add_ps(column, _mm_mul_ps(left1, _mm_set1_ps(aRight.m[ix][1])));
+      column = _mm_add_ps(column, _mm_mul_ps(left2, _mm_set1_ps(aRight.m[ix][2])));
+      if (ix == 3) {
+        column = _mm_add_ps(column, _mm_loadu_ps(aLeft.m[3]));
+      }
+      _mm_storeu_ps(aResult.m[ix], column);
+    }
+#else
+    for(int ix = 0; ix < 4; ix++) {
+      for(int jy = 0; jy < 4; jy++) {
+        aResult.m[ix][jy] = aLeft.m[0][jy] * aRight.m[ix][0] + aLeft.m[1][jy] * aRight.m[ix][1] + aLeft.m[2][jy] * aRight.m[ix][2];
+      }
+    }
+    for(int jy = 0; jy < 4; jy++) {
+      aResult.m[3][jy] += aLeft.m[3][jy];
+    }
+#endif
+  }
+
   data_t m;
 };
 
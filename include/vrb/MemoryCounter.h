@@ -0,0 +1,72 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_MEMORY_COUNTER_DOT_H
+#define VRB_MEMORY_COUNTER_DOT_H
+
+#include "vrb/MacroUtils.h"
+#include "vrb/gl.h"
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace vrb {
+
+// Bytes held by library objects, tracked per resource type. The counters are
+// atomic so they may be updated and queried from any thread.
+enum class MemoryType {
+  // GPU memory
+  VertexBuffer,
+  IndexBuffer,
+  TextureRGBA,
+  TextureRG,
+  TextureCompressed,
+  FramebufferAttachment,
+  // CPU copies
+  VertexArray,
+  GeometryFaces,
+  ImageData,
+  Count
+};
+
+void AddMemoryUsage(const MemoryType aType, const int64_t aBytes);
+int64_t GetMemoryUsage(const MemoryType aType);
+int64_t GetGPUMemoryUsage();
+int64_t GetCPUMemoryUsage();
+const char* GetMemoryTypeName(const MemoryType aType);
+// GPU texture type for image data of aFormat as uploaded by TextureGL.
+MemoryType GetTextureMemoryType(const GLenum aFormat);
+void LogMemoryUsage();
+
+// The bytes one object contributes to a MemoryType. The contribution is
+// removed when the tracker is destroyed.
+class MemoryTracker {
+public:
+  explicit MemoryTracker(const MemoryType aType) : mType(aType), mBytes(0) {}
+  ~MemoryTracker() { Set(0); }
+  void Set(const size_t aBytes) {
+    if (aBytes != mBytes) {
+      AddMemoryUsage(mType, (int64_t)aBytes - (int64_t)mBytes);
+      mBytes = aBytes;
+    }
+  }
+  void Set(const MemoryType aType, const size_t aBytes) {
+    if (aType != mType) {
+      Set(0);
+      mType = aType;
+    }
+    Set(aBytes);
+  }
+  size_t Get() const { return mBytes; }
+private:
+  MemoryType mType;
+  size_t mBytes;
+  MemoryTracker() = delete;
+  VRB_NO_DEFAULTS(MemoryTracker)
+};
+
+} // namespace vrb
+
+#endif // VRB_MEMORY_COUNTER_DOT_H
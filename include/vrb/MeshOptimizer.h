@@ -0,0 +1,49 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_MESH_OPTIMIZER_DOT_H
+#define VRB_MESH_OPTIMIZER_DOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vrb {
+
+// Kernels over triangle lists of zero based indices into aVertexCount unique
+// vertices. Triangles are reordered in place, the vertices are not touched.
+
+// Average number of vertices transformed per triangle with a FIFO post
+// transform cache of aCacheSize entries. Lower is better, 0.5 is ideal.
+float ComputeACMR(const uint32_t* aIndices, const size_t aIndexCount, const size_t aVertexCount, const size_t aCacheSize = 16);
+// Reorders triangles for the post transform vertex cache using Forsyth's
+// linear speed algorithm. When aClusters is not null it receives the index
+// offset of each run of triangles that started from an empty neighbourhood.
+void OptimizeVertexCache(uint32_t* aIndices, const size_t aIndexCount, const size_t aVertexCount, std::vector<uint32_t>* aClusters);
+// Reorders the clusters found by OptimizeVertexCache, split to at most
+// aMaxClusterTriangles, so that clusters facing away from the center of the
+// mesh are drawn first and occlude the rest. aPositions holds an xyz triple
+// per vertex.
+void OptimizeOverdraw(uint32_t* aIndices, const size_t aIndexCount, const float* aPositions,
+                      const std::vector<uint32_t>& aClusters, const size_t aMaxClusterTriangles = 256);
+// Collapses edges using quadric error metrics until at most aTargetIndexCount
+// indices remain or the next collapse would move the surface further than
+// aMaxError, relative to the size of the mesh. Vertices on open or seam edges
+// are kept so that parts and attribute seams stay closed. The simplified
+// triangles, still indexing the input vertices, are written to aResult.
+// Returns the resulting index count.
+size_t SimplifyMesh(const uint32_t* aIndices, const size_t aIndexCount, const float* aPositions,
+                    const size_t aVertexCount, const size_t aTargetIndexCount, const float aMaxError,
+                    std::vector<uint32_t>& aResult);
+// Appends to aResult triangle strips drawing the same triangles with the
+// same winding, each strip followed by aRestartIndex. Strips are grown
+// greedily from the first triangle left in input order, which mostly keeps
+// the order given by OptimizeVertexCache. Degenerate triangles are dropped.
+void StripifyTriangles(const uint32_t* aIndices, const size_t aIndexCount, const size_t aVertexCount,
+                       const uint32_t aRestartIndex, std::vector<uint32_t>& aResult);
+
+} // namespace vrb
+
+#endif // VRB_MESH_OPTIMIZER_DOT_H
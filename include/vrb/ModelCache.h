@@ -0,0 +1,47 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_MODEL_CACHE_DOT_H
+#define VRB_MODEL_CACHE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <string>
+
+namespace vrb {
+
+// Keeps the nodes of loaded models by path, see ModelLoaderBasic and
+// ModelLoaderAndroid::SetModelCache(). Loading a cached model again returns
+// a new Group over the nodes of the first load, so its Geometry,
+// RenderStates and GL buffers are shared instead of parsed and uploaded
+// again, and the instances are batched by automatic instancing. Changes to
+// the shared nodes show in every instance. Unlike ModelCacheObj, which
+// replays the parser, nothing persists across runs. Thread safe.
+class ModelCache {
+public:
+  static ModelCachePtr Create();
+  // Returns a new Group holding the nodes cached for aPath, or nullptr.
+  GroupPtr Instantiate(CreationContextPtr& aContext, const std::string& aPath);
+  // Caches the children of aModel for aPath unless it is already cached or
+  // has no children.
+  // aModel itself is not kept, so its children may be moved into the scene.
+  void Add(const std::string& aPath, const GroupPtr& aModel);
+  // Later loads of aPath parse the model again. Instances are unaffected.
+  void Remove(const std::string& aPath);
+  void Clear();
+protected:
+  struct State;
+  ModelCache(State& aState);
+  ~ModelCache();
+private:
+  State& m;
+  ModelCache() = delete;
+  VRB_NO_DEFAULTS(ModelCache)
+};
+
+} // namespace vrb
+
+#endif // VRB_MODEL_CACHE_DOT_H
@@ -0,0 +1,44 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_MODEL_CACHE_OBJ_DOT_H
+#define VRB_MODEL_CACHE_OBJ_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <string>
+
+namespace vrb {
+
+// Binary cache of parsed OBJ and MTL files. The cache stores the sequence of
+// ParserObserverObj calls made while a model is parsed and replays them
+// without running the text parser. Entries are keyed by the source path and
+// are discarded when the source file size or modification time changes.
+class ModelCacheObj {
+public:
+  static ModelCacheObjPtr Create(CreationContextPtr& aContext);
+  // Caching is disabled until a directory is set.
+  void SetCacheDirectory(const std::string& aDirectory);
+  // Returns false when no valid cache entry exists for aFileName.
+  bool LoadModel(const std::string& aFileName, ParserObserverObj& aObserver);
+  // Returns an observer that forwards every call to aObserver and writes a
+  // cache entry for aFileName once the model is finished.
+  ParserObserverObjPtr CreateRecorder(const std::string& aFileName, const ParserObserverObjPtr& aObserver);
+
+protected:
+  struct State;
+  ModelCacheObj(State& aState, CreationContextPtr& aContext);
+  ~ModelCacheObj();
+
+private:
+  State& m;
+  ModelCacheObj() = delete;
+  VRB_NO_DEFAULTS(ModelCacheObj)
+};
+
+} // namespace vrb
+
+#endif // VRB_MODEL_CACHE_OBJ_DOT_H
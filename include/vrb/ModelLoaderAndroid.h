@@ -7,6 +7,7 @@
 #define VRB_MODEL_LOADER_ANDROID_DOT_H
 
 #include "vrb/Forward.h"
+#include "vrb/LoadReport.h"
 #include "vrb/LoaderThread.h"
 #include "vrb/MacroUtils.h"
 #include "vrb/ResourceGL.h"
@@ -23,14 +24,38 @@ public:
   void ShutdownJava();
   void InitializeGL();
   void ShutdownGL();
+  // Number of threads running the CPU stage of load tasks. Zero picks a
+  // count from the number of cores. Takes effect the next time the loader
+  // threads start.
+  void SetWorkerCount(const int aCount);
+  // Number of threads uploading the GL resources of finished tasks, each
+  // with a shared EGL context of its own, at most the worker count. Zero,
+  // the default, uses one per worker. Takes effect the next time
+  // InitializeGL() is called.
+  void SetUploadThreadCount(const int aCount);
+  // OBJ models are looked up in aCache before they are parsed and added to
+  // it after, see ModelCache. Null, the default, disables the cache. Must be
+  // called before the loads it should affect are queued.
+  void SetModelCache(const ModelCachePtr& aCache);
+  // Called on the render thread with the LoadReport of each load right
+  // after its finished callback. Reports are only collected while a callback
+  // is set or logging is enabled. Must be set before the loader threads
+  // start.
+  void SetLoadReportCallback(const LoadReportCallback& aCallback);
+  // Logs the LoadReport of each load. Must be set before the loader threads
+  // start.
+  void SetLoadReportLogging(const bool aEnabled);
   void LoadModel(const std::string& aModelName, GroupPtr aTargetNode);
   void LoadModel(vrb::LoadTask aLoadTask, GroupPtr aTargetNode);
   void LoadModel(const std::string& aModelName, GroupPtr aTargetNode, LoadFinishedCallback& aCallback);
+  void LoadModel(const std::string& aModelName, GroupPtr aTargetNode, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken);
   // LoaderThread Interface
   void RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask) override;
   void RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback) override;
+  void RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken) override;
   void AddFinishedCallback(LoadFinishedCallback& aCallback) override;
   bool IsOnLoaderThread() const override;
+  void SetActiveWorkerLimit(const int aLimit) override;
 protected:
   struct State;
   ModelLoaderAndroid(State& aState, RenderContextPtr& aContext);
@@ -38,6 +63,7 @@ protected:
 private:
   State& m;
   static void* Run(void* data);
+  static void* RunWorker(void* data);
   ModelLoaderAndroid() = delete;
   VRB_NO_DEFAULTS(ModelLoaderAndroid);
 };
@@ -0,0 +1,65 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_MODEL_LOADER_BASIC_DOT_H
+#define VRB_MODEL_LOADER_BASIC_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/LoadReport.h"
+#include "vrb/LoaderThread.h"
+#include "vrb/MacroUtils.h"
+#include <functional>
+#include <string>
+
+namespace vrb {
+
+// LoaderThread backed by a fixed pool of worker threads for platforms without
+// a shared GL context. The workers share one CreationContext and
+// FileReaderBasic. GL resources created by a load are initialized on the
+// render thread once the worker synchronizes with RenderContext::Update().
+class ModelLoaderBasic : public LoaderThread {
+public:
+  // A worker count of zero uses the number of hardware threads.
+  static ModelLoaderBasicPtr Create(RenderContextPtr& aContext, const int aWorkerCount);
+  // Must be called on the render thread.
+  void Start();
+  // Must be called on the render thread. Pending loads are discarded.
+  void Stop();
+  // OBJ models are looked up in aCache before they are parsed and added to
+  // it after, see ModelCache. Null, the default, disables the cache. Must be
+  // called before the loads it should affect are queued.
+  void SetModelCache(const ModelCachePtr& aCache);
+  // Called on the render thread with the LoadReport of each load right
+  // after its finished callback. Reports are only collected while a callback
+  // is set or logging is enabled. Must be set before the loader threads
+  // start.
+  void SetLoadReportCallback(const LoadReportCallback& aCallback);
+  // Logs the LoadReport of each load. Must be set before the loader threads
+  // start.
+  void SetLoadReportLogging(const bool aEnabled);
+  void LoadModel(const std::string& aModelName, GroupPtr aTargetNode);
+  void LoadModel(const std::string& aModelName, GroupPtr aTargetNode, LoadFinishedCallback& aCallback);
+  void LoadModel(const std::string& aModelName, GroupPtr aTargetNode, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken);
+  // LoaderThread Interface
+  void RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask) override;
+  void RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback) override;
+  void RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken) override;
+  void AddFinishedCallback(LoadFinishedCallback& aCallback) override;
+  bool IsOnLoaderThread() const override;
+  void SetActiveWorkerLimit(const int aLimit) override;
+protected:
+  struct State;
+  ModelLoaderBasic(State& aState, RenderContextPtr& aContext);
+  ~ModelLoaderBasic();
+private:
+  State& m;
+  static void* Run(void* data);
+  ModelLoaderBasic() = delete;
+  VRB_NO_DEFAULTS(ModelLoaderBasic);
+};
+
+} // namespace vrb
+
+#endif // VRB_MODEL_LOADER_BASIC_DOT_H
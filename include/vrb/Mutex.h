@@ -65,6 +65,68 @@ private:
   VRB_NO_NEW_DELETE
 };
 
+// Shared/exclusive lock for read mostly data. Any number of readers may hold
+// it at once while a writer holds it alone. Not recursive: a thread holding
+// it must not lock it again in either mode.
+class RWMutex {
+public:
+  RWMutex() {
+    pthread_rwlock_init(&mLock, nullptr);
+  }
+  ~RWMutex() {
+    pthread_rwlock_destroy(&mLock);
+  }
+  bool ReadLock() {
+    return pthread_rwlock_rdlock(&mLock) == 0;
+  }
+  bool TryReadLock() {
+    return pthread_rwlock_tryrdlock(&mLock) == 0;
+  }
+  bool WriteLock() {
+    return pthread_rwlock_wrlock(&mLock) == 0;
+  }
+  bool TryWriteLock() {
+    return pthread_rwlock_trywrlock(&mLock) == 0;
+  }
+  bool Unlock() {
+    return pthread_rwlock_unlock(&mLock) == 0;
+  }
+protected:
+  pthread_rwlock_t mLock;
+private:
+  VRB_NO_DEFAULTS(RWMutex)
+};
+
+class ReadAutoLock {
+public:
+  ReadAutoLock(RWMutex& aMutex) : mMutex(aMutex) {
+    mMutex.ReadLock();
+  }
+  ~ReadAutoLock() {
+    mMutex.Unlock();
+  }
+private:
+  RWMutex& mMutex;
+  ReadAutoLock() = delete;
+  VRB_NO_DEFAULTS(ReadAutoLock)
+  VRB_NO_NEW_DELETE
+};
+
+class WriteAutoLock {
+public:
+  WriteAutoLock(RWMutex& aMutex) : mMutex(aMutex) {
+    mMutex.WriteLock();
+  }
+  ~WriteAutoLock() {
+    mMutex.Unlock();
+  }
+private:
+  RWMutex& mMutex;
+  WriteAutoLock() = delete;
+  VRB_NO_DEFAULTS(WriteAutoLock)
+  VRB_NO_NEW_DELETE
+};
+
 } // namespace vrb
 
 #endif //  VRB_MUTEX_DOT_H
@@ -20,18 +20,45 @@ public:
   const std::string& GetName() const;
   void SetName(const std::string& aName);
   void GetParents(std::vector<GroupPtr>& aParents) const;
+  // Same parents without taking references, for walks up the graph. A
+  // Group detaches its children before it is destroyed.
+  int32_t GetParentCount() const;
+  Group* GetParent(const int32_t aIndex) const;
   void RemoveFromParents();
   virtual void Cull(CullVisitor& aVisitor, DrawableList& aDrawables) = 0;
+  // Bounds are in the local space of the node and are cached until invalidated.
+  const Bounds& GetBounds() const;
+  void InvalidateBounds();
+  // Called when a change above the node affects its world transform.
+  virtual void InvalidateWorldTransform();
+  // Finds the nearest triangle hit by the ray, given in the same space as the
+  // bounds, that is closer than aHit.distance. Returns true if aHit was
+  // updated. Nodes without triangles are never hit.
+  virtual bool Intersect(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit);
+  // Adds the node to a flattened copy of the scene graph. By default the node
+  // is kept as a leaf that is culled by calling Cull. Subclasses that override
+  // Cull of a Group must override Flatten as well.
+  virtual void Flatten(SceneSnapshot& aSnapshot);
+  // Incremented when the node or a node below it changes. The layout revision
+  // only changes with the children, lights or enabled state of the subtree.
+  uint32_t GetRevision() const;
+  uint32_t GetLayoutRevision() const;
   using TraverseFunction = std::function<bool(const NodePtr& aNode, const GroupPtr& aTraversingFrom)>;
   static bool Traverse(const NodePtr& aRootNode, const TraverseFunction& aTraverseFunction);
 protected:
   struct State;
   Node(State& aState, CreationContextPtr& aContext);
   virtual ~Node();
-  static void AddToParents(GroupWeak& aParent, Node& aChild);
+  static void AddToParents(Group& aParent, Node& aChild);
   static void RemoveFromParents(Group& aParent, Node& aChild);
+  // Called when the children, lights or culling state of the node change.
+  void InvalidateLayout();
   virtual bool Traverse(const GroupPtr& aParent, const TraverseFunction& aTraverseFunction);
+  // Nodes that do not override ComputeBounds are never culled.
+  virtual void ComputeBounds(Bounds& aBounds) const;
 private:
+  void MarkBoundsDirty();
+  void IncrementRevision(const bool aLayout);
   State& m;
   Node() = delete;
   VRB_NO_DEFAULTS(Node)
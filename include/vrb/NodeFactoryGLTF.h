@@ -0,0 +1,53 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_NODE_FACTORY_GLTF_DOT_H
+#define VRB_NODE_FACTORY_GLTF_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <string>
+
+namespace vrb {
+
+// Builds the default scene of a glTF 2.0 model, a .gltf file with its
+// buffers and images or a single .glb file, as Transform, Group and Geometry
+// nodes. Vertex and index data are never parsed: a primitive whose
+// attributes are interleaved in one buffer view is drawn straight from it,
+// other primitives are interleaved once. Buffers are used in place when the
+// FileReader can map them, see FileReader::MapFile.
+//
+// Materials take the base color factor and texture of the metallic
+// roughness model. Images stored in the buffers must be KTX2, as required by
+// KHR_texture_basisu, KTX or ASTC files, while PNG and JPEG images must be
+// files of their own. Only triangles are drawn. Skins, morph targets,
+// animations, cameras and sparse accessors are ignored.
+class NodeFactoryGLTF {
+public:
+  static NodeFactoryGLTFPtr Create(CreationContextPtr& aContext);
+  // True for the .gltf and .glb extensions.
+  static bool IsGLTFFile(const std::string& aFileName);
+
+  void SetModelRoot(GroupPtr aGroup);
+  GroupPtr& GetModelRoot();
+  // Reads aFileName on the calling thread and adds its scene to the model
+  // root, which is created if not set. Returns false if the file is invalid.
+  bool LoadModel(const std::string& aFileName);
+
+protected:
+  struct State;
+  NodeFactoryGLTF(State& aState, CreationContextPtr& aContext);
+  ~NodeFactoryGLTF();
+
+private:
+  State& m;
+  NodeFactoryGLTF() = delete;
+  VRB_NO_DEFAULTS(NodeFactoryGLTF)
+};
+
+} // namespace vrb
+
+#endif // VRB_NODE_FACTORY_GLTF_DOT_H
@@ -8,6 +8,7 @@
 
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
+#include "vrb/Geometry.h"
 #include "vrb/ParserObj.h"
 
 #include <string>
@@ -33,6 +34,10 @@ public:
       const std::vector<int>& aVerticies,
       const std::vector<int>& aUVs,
       const std::vector<int>& aNormals) override;
+  void AddVertices(const float* aPoints, const size_t aCount) override;
+  void AddNormals(const float* aNormals, const size_t aCount) override;
+  void AddUVs(const float* aUVs, const size_t aCount) override;
+  void AddFaces(const int* aIndices, const uint32_t* aCornerCounts, const size_t aFaceCount) override;
 
   void StartMaterialFile(const std::string& aFileName) override;
   void FinishMaterialFile() override;
@@ -49,6 +54,30 @@ public:
   // NodeFactoryObj interface
   void SetModelRoot(GroupPtr aGroup);
   GroupPtr& GetModelRoot();
+  // When enabled, geometries of a model that share a RenderState are merged
+  // into a single Geometry when the model finishes loading. Each source
+  // geometry remains addressable as a named part of the merged Geometry.
+  void SetMergeGeometry(const bool aMerge);
+  // Runs Geometry::OptimizeMesh on every geometry when the model finishes
+  // loading. Off by default.
+  void SetOptimizeMeshes(const bool aOptimize);
+  // Weighting of the normals generated for faces without any, see
+  // Geometry::GenerateNormals. NormalWeighting::Face by default.
+  void SetNormalWeighting(const Geometry::NormalWeighting aWeighting);
+  // See Geometry::SetTriangleStrips. Off by default.
+  void SetTriangleStrips(const bool aStrips);
+  // Geometries of a model share one vertex buffer by default.
+  void SetShareVertices(const bool aShare);
+  // See Geometry::SetReleaseSourceData.
+  void SetReleaseSourceData(const bool aRelease);
+  // Replaces each geometry with a LevelOfDetail holding aLevelCount levels,
+  // each simplified to half the triangles of the previous one. Defaults to one
+  // level, which disables simplification.
+  void SetLevelsOfDetail(const int32_t aLevelCount);
+  // Diffuse textures of materials whose UVs all lie in [0, 1] are packed
+  // into aAtlas, the others are loaded as their own TextureGL. Unset by
+  // default.
+  void SetTextureAtlas(const TextureAtlasPtr& aAtlas);
 
 protected:
   struct State;
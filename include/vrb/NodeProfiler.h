@@ -0,0 +1,103 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_NODE_PROFILER_DOT_H
+#define VRB_NODE_PROFILER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace vrb {
+
+// Attributes the cost of content to the names of the nodes it came from over
+// a capture window: the time spent culling each named Group subtree, nested
+// named subtrees included, and the draw calls, triangles and, when
+// EXT_disjoint_timer_query is supported, GPU time of each drawable. Unnamed
+// drawables are attributed to their nearest named parent. Subtrees culled
+// through a SceneSnapshot report no cull time. Only one profiler captures at
+// a time, the hooks cost a load of a global when none does. Must be used on
+// the render thread.
+class NodeProfiler {
+public:
+  struct Entry {
+    std::string name;
+    // Totals over the capture.
+    double cullTime;
+    double gpuTime;
+    uint64_t culls;
+    uint64_t drawCalls;
+    uint64_t triangles;
+    Entry() : cullTime(0.0), gpuTime(0.0), culls(0), drawCalls(0), triangles(0) {}
+  };
+  enum class Sort {
+    CullTime,
+    GPUTime,
+    DrawCalls,
+    Triangles
+  };
+  static NodeProfilerPtr Create(RenderContextPtr& aContext);
+  // Profiles the next aFrames frames, as counted by EndFrame(). Entries of a
+  // previous capture are discarded.
+  void StartCapture(const int aFrames);
+  // Waits for the pending GPU times.
+  void StopCapture();
+  bool IsCapturing() const;
+  // Call once per frame after the last draw.
+  void EndFrame();
+  // Frames captured, entries are totals over them.
+  int GetFrameCount() const;
+  // The aCount most expensive entries by aSort.
+  std::vector<Entry> GetTopEntries(const Sort aSort, const size_t aCount) const;
+  // Table of the aCount most expensive entries by aSort, per frame averages.
+  std::string GetReport(const Sort aSort, const size_t aCount) const;
+
+  // Hooks of the Group, DrawableList and GeometryDrawable.
+  class CullScope {
+  public:
+    explicit CullScope(const Node& aNode);
+    ~CullScope();
+  private:
+    const Node* mNode;
+    uint64_t mStart;
+    CullScope() = delete;
+    VRB_NO_DEFAULTS(CullScope)
+    VRB_NO_NEW_DELETE
+  };
+  class DrawScope {
+  public:
+    explicit DrawScope(Drawable& aDrawable);
+    ~DrawScope();
+    void AddDraws(const uint64_t aDrawCalls, const uint64_t aTriangles) {
+      mDrawCalls += aDrawCalls;
+      mTriangles += aTriangles;
+    }
+  private:
+    Drawable* mDrawable;
+    uint64_t mDrawCalls;
+    uint64_t mTriangles;
+    int32_t mQuery;
+    DrawScope() = delete;
+    VRB_NO_DEFAULTS(DrawScope)
+    VRB_NO_NEW_DELETE
+  };
+  // Counts draws issued on this thread toward the drawable being drawn.
+  static void AddDraws(const uint64_t aDrawCalls, const uint64_t aTriangles);
+protected:
+  struct State;
+  NodeProfiler(State& aState, RenderContextPtr& aContext);
+  ~NodeProfiler();
+private:
+  State& m;
+  NodeProfiler() = delete;
+  VRB_NO_DEFAULTS(NodeProfiler)
+};
+
+} // namespace vrb
+
+#endif // VRB_NODE_PROFILER_DOT_H
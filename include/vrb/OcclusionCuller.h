@@ -0,0 +1,55 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_OCCLUSION_CULLER_DOT_H
+#define VRB_OCCLUSION_CULLER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/ResourceGL.h"
+
+namespace vrb {
+
+// Skips the Groups with occlusion culling enabled whose bounding box was
+// hidden by the depth buffer in previous frames. Queries are read back once
+// available, one or more frames later, so drawing never waits on the GPU.
+// Nodes that move are drawn until they are queried again.
+class OcclusionCuller : protected ResourceGL {
+public:
+  static OcclusionCullerPtr Create(CreationContextPtr& aContext);
+
+  // Called by CullVisitor with the world space bounds of a Group. Returns
+  // true if the last aFrames queries of the Group, see SetHysteresis, all
+  // reported it hidden. The bounds are queued for the next Draw. Safe to
+  // call from several cull threads.
+  bool IsOccluded(const Node& aNode, const Bounds& aWorldBounds);
+  // Reads the available results and queries the bounds queued by the last
+  // cull against the depth buffer left by drawing it. Must be called on the
+  // render thread after the DrawableList is drawn with aCamera.
+  void Draw(const Camera& aCamera);
+  // Number of consecutive hidden results before a Group is skipped. Visible
+  // results show the Group again immediately. Defaults to 2.
+  void SetHysteresis(const int32_t aFrames);
+  // Groups skipped by the last cull.
+  int32_t GetOccludedCount() const;
+
+protected:
+  struct State;
+  OcclusionCuller(State& aState, CreationContextPtr& aContext);
+  ~OcclusionCuller();
+
+  // ResourceGL interface
+  void InitializeGL() override;
+  void ShutdownGL() override;
+
+private:
+  State& m;
+  OcclusionCuller() = delete;
+  VRB_NO_DEFAULTS(OcclusionCuller)
+};
+
+} // namespace vrb
+
+#endif // VRB_OCCLUSION_CULLER_DOT_H
@@ -0,0 +1,33 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_OFFSCREEN_RENDER_SCOPE_DOT_H
+#define VRB_OFFSCREEN_RENDER_SCOPE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+namespace vrb {
+
+// Renders a subtree into aFBO from Updatable::UpdateResource(). Binds the
+// FBO with depth test and writes enabled, the scissor test disabled and a
+// transparent clear color. On destruction the FBO is unbound and the
+// framebuffer, viewport, scissor and depth tests, depth mask and clear color
+// of the application are restored. The RenderContext reads that state from
+// GL once per Update(), so any number of scopes cost one round trip.
+class OffscreenRenderScope {
+public:
+  OffscreenRenderScope(RenderContext& aContext, FBO& aFBO);
+  ~OffscreenRenderScope();
+private:
+  RenderContext& mContext;
+  FBO& mFBO;
+  OffscreenRenderScope() = delete;
+  VRB_NO_DEFAULTS(OffscreenRenderScope)
+};
+
+} // namespace vrb
+
+#endif // VRB_OFFSCREEN_RENDER_SCOPE_DOT_H
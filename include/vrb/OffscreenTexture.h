@@ -0,0 +1,37 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_OFFSCREEN_TEXTURE_DOT_H
+#define VRB_OFFSCREEN_TEXTURE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Texture.h"
+
+#include "vrb/gl.h"
+
+namespace vrb {
+
+// Texture for the color attachment of an FBO that a node renders into, such
+// as an Impostor atlas or a RenderLayer target. The GL texture is owned by
+// whoever owns the FBO, the OffscreenTexture never creates or deletes it.
+class OffscreenTexture : public Texture {
+public:
+  static OffscreenTexturePtr Create(CreationContextPtr& aContext);
+  // Zero once the FBO is released.
+  void SetTextureHandle(const GLuint aHandle);
+protected:
+  struct State;
+  OffscreenTexture(State& aState, CreationContextPtr& aContext);
+  ~OffscreenTexture();
+private:
+  State& m;
+  OffscreenTexture() = delete;
+  VRB_NO_DEFAULTS(OffscreenTexture)
+};
+
+} // namespace vrb
+
+#endif // VRB_OFFSCREEN_TEXTURE_DOT_H
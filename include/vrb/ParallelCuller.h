@@ -0,0 +1,53 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_PARALLEL_CULLER_DOT_H
+#define VRB_PARALLEL_CULLER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <functional>
+
+namespace vrb {
+
+// Culls parts of a scene graph on the JobSystem of the CreationContext.
+// Each job culls into its own DrawableList segment, which is drawn in place
+// of the point where the job was queued, so the result does not depend on
+// which thread ran it.
+// Used by SceneSnapshot, see SceneSnapshot::SetParallelCuller.
+//
+// Nodes culled by jobs must not be culled by other jobs of the same pass.
+// Nodes added to more than one Group of the graph may be culled twice at
+// the same time, which LevelOfDetail and Groups with a spatial index do
+// not support.
+class ParallelCuller {
+public:
+  typedef std::function<void(CullVisitor& aVisitor, DrawableList& aDrawables)> Job;
+  static ParallelCullerPtr Create(CreationContextPtr& aContext);
+
+  // Worker threads of the JobSystem, the thread calling Wait runs jobs as well.
+  int32_t GetWorkerCount() const;
+  // Queues aJob with a CullVisitor that inherits the state of aVisitor. The
+  // segment it fills is added to aDrawables with the lights current at the
+  // time of the call. aDrawables may not be reset before Wait returns.
+  void Queue(const CullVisitor& aVisitor, DrawableList& aDrawables, Job&& aJob);
+  // Runs queued jobs until every job has finished.
+  void Wait();
+
+protected:
+  struct State;
+  ParallelCuller(State& aState, CreationContextPtr& aContext);
+  ~ParallelCuller();
+
+private:
+  State& m;
+  ParallelCuller() = delete;
+  VRB_NO_DEFAULTS(ParallelCuller)
+};
+
+} // namespace vrb
+
+#endif // VRB_PARALLEL_CULLER_DOT_H
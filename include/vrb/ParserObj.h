@@ -34,6 +34,15 @@ public:
       const std::vector<int>& aUVs,
       const std::vector<int>& aNormals) = 0;
   virtual void SetSmoothingGroup(const int aGroup) = 0;
+  // Bulk Geometry Interface. The parser delivers runs of consecutive records
+  // through these calls. The default implementations forward each element to
+  // the per record calls above. Vertices are packed as xyzw, normals as xyz
+  // and UVs as uvw with v already flipped. Face corners are packed as vertex,
+  // uv and normal index triples and aCornerCounts holds the size of each face.
+  virtual void AddVertices(const float* aPoints, const size_t aCount);
+  virtual void AddNormals(const float* aNormals, const size_t aCount);
+  virtual void AddUVs(const float* aUVs, const size_t aCount);
+  virtual void AddFaces(const int* aIndices, const uint32_t* aCornerCounts, const size_t aFaceCount);
   // Material Interface
   virtual void StartMaterialFile(const std::string& aFileName) = 0;
   virtual void FinishMaterialFile() = 0;
@@ -28,8 +28,21 @@ protected:
 
 class PerformanceMonitor : protected Updatable {
 public:
+  // Per frame statistics, in seconds, over a window of recent frames.
+  struct FrameStats {
+    size_t frames = 0;
+    // Frames that took longer than 1.5 times the average frame rate interval.
+    size_t dropped = 0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+  };
   static PerformanceMonitorPtr Create(CreationContextPtr& aContext);
   double GetAverageFrameRate() const;
+  // Statistics for the frames rendered during the last aSeconds, up to the
+  // capacity of the frame history. Returns false if no frame was recorded.
+  bool GetFrameStats(const double aSeconds, FrameStats& aStats) const;
   double GetPerfomranceDelta() const;
   void SetPerformanceDelta(const double aDelta);
   void Pause();
@@ -37,6 +50,20 @@ public:
   void Resample();
   void AddPerformanceMonitorObserver(PerformanceMonitorObserverPtr aObserver);
   void RemovePerformanceMonitorObserver(const PerformanceMonitorObserver& aObserver);
+  // GPU timing uses EXT_disjoint_timer_query timestamps. A frame starts when
+  // the monitor is updated by RenderContext::Update() and ends with EndFrame().
+  // Results are read a few frames later without stalling, so the reported
+  // times lag the current frame. Has no effect if the extension is missing.
+  void SetGPUTimingEnabled(const bool aEnabled);
+  bool IsGPUTimingEnabled() const;
+  void EndFrame();
+  // Passes are timed between matching BeginPass() and EndPass() calls within a frame.
+  void BeginPass(const std::string& aName);
+  void EndPass(const std::string& aName);
+  // Times in seconds of the most recent frame with available GPU results.
+  // Returns false if no frame has been timed yet.
+  bool GetFrameTimes(double& aCPUTime, double& aGPUTime) const;
+  bool GetPassTimes(const std::string& aName, double& aCPUTime, double& aGPUTime) const;
 
 protected:
   struct State;
@@ -7,25 +7,99 @@
 #define VRB_PROGRAM_DOT_H
 
 #include "vrb/Forward.h"
+#include "vrb/BasicShaders.h"
 #include "vrb/MacroUtils.h"
 #include "vrb/gl.h"
 
+#include <functional>
 #include <string>
 
 namespace vrb {
 
 class Program {
 public:
+  // Uniform and attribute locations used by the built-in shaders. Locations
+  // not used by the program's features are -1.
+  struct Locations {
+    struct Light {
+      GLint direction;
+      GLint position;
+      GLint ambient;
+      GLint diffuse;
+      GLint specular;
+    };
+    // Only FeatureMultiview programs use more than the first view.
+    GLint viewProjection[VRB_MAX_VIEWS];
+    GLint view[VRB_MAX_VIEWS];
+    // Per draw products of the model, set when the program has no
+    // per vertex model: neither FeatureInstancing nor FeatureSkinning.
+    GLint modelViewProjection[VRB_MAX_VIEWS];
+    GLint modelView[VRB_MAX_VIEWS];
+    GLint model;
+    // Location of u_joints[0] in FeatureSkinning programs.
+    GLint joints;
+    GLint uvTransform;
+    GLint lightCount;
+    Light lights[VRB_MAX_LIGHTS];
+    GLint materialAmbient;
+    GLint materialDiffuse;
+    GLint materialSpecular;
+    GLint materialSpecularExponent;
+    GLint texture0;
+    // u_textureLayer of FeatureTextureArray programs.
+    GLint textureLayer;
+    GLint tintColor;
+    GLint position;
+    GLint normal;
+    GLint uv;
+    GLint color;
+    GLint instanceModel;
+    GLint jointIndices;
+    GLint jointWeights;
+    Locations();
+  };
   static ProgramPtr Create();
   bool Enable();
+  // Returns true once the program is linked and may be enabled without blocking.
+  bool IsReady();
   void SetFeatures(const uint32_t aFeatures);
+  uint32_t GetFeatures() const;
   bool SupportsFeatures(const uint32_t aFeatures);
+  // Number of lights the vertex shader is compiled for with its light loop
+  // unrolled, or -1, the default, when it loops up to u_lightCount.
+  void SetLightCount(const int aLightCount);
+  int GetLightCount() const;
+  // Returns the variant of this program compiled for exactly aLightCount
+  // lights once it may be enabled, nullptr until then. The first call for a
+  // count requests the variant through the factory set by the
+  // ProgramFactory. Programs without one always return nullptr.
+  ProgramPtr GetLightCountVariant(const int aLightCount);
+  void SetLightCountVariantFactory(const std::function<ProgramPtr(const int)>& aFactory);
   void SetProgram(GLuint aProgram);
+  // aProgram is still being compiled by the driver. Enable() returns false
+  // without blocking until it completes, then calls aLinked once. The program
+  // is dropped if aLinked returns false.
+  void SetPendingProgram(GLuint aProgram, const std::function<bool(const GLuint)>& aLinked);
   GLuint GetProgram() const;
   GLint GetAttributeLocation(const char* aName);
   GLint GetAttributeLocation(const std::string &aName) { return GetAttributeLocation(aName.c_str()); }
   GLint GetUniformLocation(const char* aName);
   GLint GetUniformLocation(const std::string &aName) { return GetUniformLocation(aName.c_str()); }
+  // Queried once per linked program so render states sharing the program
+  // do not repeat the lookups. FeatureMaterialBlock programs have no material
+  // or tint locations, their vrb_Material block is bound to
+  // VRB_MATERIAL_BLOCK_BINDING instead.
+  const Locations& GetLocations();
+  // Uniform setters that skip the GL call when the program already holds the value.
+  // The program must be enabled before calling them.
+  void SetUniform1i(const GLint aLocation, const GLint aValue);
+  void SetUniform1f(const GLint aLocation, const GLfloat aValue);
+  void SetUniform3fv(const GLint aLocation, const GLfloat* aValues);
+  void SetUniform4fv(const GLint aLocation, const GLfloat* aValues);
+  void SetUniformMatrix4fv(const GLint aLocation, const GLfloat* aValues);
+  // Uploads aCount consecutive matrices of a uniform array. Arrays are not
+  // shadowed and are always uploaded.
+  void SetUniformMatrix4fv(const GLint aLocation, const GLsizei aCount, const GLfloat* aValues);
 protected:
   struct State;
   Program(State& aState);
@@ -6,9 +6,12 @@
 #ifndef VRB_PROGRAM_FACTORY_DOT_H
 #define VRB_PROGRAM_FACTORY_DOT_H
 
+#include "vrb/AssetID.h"
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 
+#include <string>
+
 namespace vrb {
 
 const uint32_t FeatureTexture = 0x1;
@@ -19,14 +22,79 @@ const uint32_t FeatureVertexColor = 0x1 << 4;
 // Defaults to medium precision
 const uint32_t FeatureHighPrecision = 0x01 << 5;
 const uint32_t FeatureLowPrecision = 0x01 << 6;
+// The model matrix is read from a per instance attribute instead of a uniform.
+const uint32_t FeatureInstancing = 0x01 << 7;
+// Draws both eyes in one pass with OVR_multiview2. The camera and model
+// matrix uniforms are arrays indexed by gl_ViewID_OVR and the shaders are built as GLSL ES 3.00.
+const uint32_t FeatureMultiview = 0x01 << 8;
+// Vertices are blended by up to four joints of the u_joints palette, see Skeleton.
+const uint32_t FeatureSkinning = 0x01 << 9;
+// Samples a TextureArray, see RenderState::SetTextureLayer. Requires GLES 3.0
+// and builds the shaders as GLSL ES 3.00.
+const uint32_t FeatureTextureArray = 0x01 << 10;
+// Leaves out the specular term of the lighting, a cheaper quality tier, see
+// RenderState::SetQualityFallbacks().
+const uint32_t FeatureNoSpecular = 0x01 << 11;
+// The camera matrices are read from the vrb_Camera uniform block bound by a
+// LateLatch instead of uniforms, so they can be rewritten after the draws
+// have been issued. Requires GLES 3.0 and builds the shaders as GLSL ES 3.00.
+const uint32_t FeatureLateLatch = 0x01 << 12;
+// The material and tint colors are read from the vrb_Material uniform block
+// of each RenderState, bound with one call when the material changes instead
+// of being uploaded as uniforms by every draw. Requires GLES 3.0 and builds
+// the shaders as GLSL ES 3.00.
+const uint32_t FeatureMaterialBlock = 0x01 << 13;
+// Only writes the depth of the vertices, for the depth pre-pass of the
+// DrawableList, see Group::SetDepthPrePass(). Lighting, texturing and custom
+// fragment shaders are left out.
+const uint32_t FeatureDepthOnly = 0x01 << 14;
 
 
 class ProgramFactory {
 public:
   static ProgramFactoryPtr Create();
   void SetLoaderThread(LoaderThreadPtr aLoader);
+  // Linked programs are saved to and reloaded from aPath as program
+  // binaries. Must be set before programs are created. Empty, the default,
+  // always compiles from source.
+  void SetCachePath(const std::string& aPath);
+  // Set by the RenderContext when KHR_parallel_shader_compile is supported.
+  // Programs are then usable once the driver has finished compiling them.
+  void SetParallelCompileEnabled(const bool aEnabled);
+  // When enabled, FeatureMultiview is added to every program created
+  // afterwards so content can be drawn with a CameraStereo into a multiview
+  // FBO. Ignored unless OVR_multiview2 is supported.
+  void SetMultiviewEnabled(const bool aEnabled);
+  // Set by the RenderContext from the GL extensions.
+  void SetMultiviewSupported(const bool aSupported);
+  // When enabled, FeatureLateLatch is added to every program created
+  // afterwards. Only enable it on GLES 3.0 contexts and bind a LateLatch
+  // before drawing.
+  void SetLateLatchEnabled(const bool aEnabled);
+  // When enabled, FeatureMaterialBlock is added to every program created
+  // afterwards. Only enable it on GLES 3.0 contexts.
+  void SetMaterialBlockEnabled(const bool aEnabled);
   ProgramPtr CreateProgram(CreationContextPtr& aContext, const uint32_t aFeatureMask);
   ProgramPtr CreateProgram(CreationContextPtr& aContext, const uint32_t aFeatureMask, const std::string& aCustomFragShader);
+  // Same as above with the shader source interned by the caller, which skips
+  // hashing it. Lookups of existing programs do not lock.
+  ProgramPtr CreateProgram(CreationContextPtr& aContext, const uint32_t aFeatureMask, const AssetID aCustomFragShader);
+  // Variant of the program above whose vertex shader handles exactly
+  // aLightCount lights, at most VRB_MAX_LIGHTS, instead of looping up to
+  // u_lightCount. RenderState::Enable switches to these by itself once they
+  // are compiled, see Program::GetLightCountVariant().
+  ProgramPtr CreateProgram(CreationContextPtr& aContext, const uint32_t aFeatureMask, const AssetID aCustomFragShader,
+                           const int aLightCount);
+  // Declares a variant to compile ahead of its first use, for example while
+  // a loading screen is shown, so that content appearing later does not
+  // compile during interactive frames. It is compiled like any program
+  // created with aContext.
+  void Precompile(CreationContextPtr& aContext, const uint32_t aFeatureMask);
+  void Precompile(CreationContextPtr& aContext, const uint32_t aFeatureMask, const std::string& aCustomFragShader);
+  // Returns how many of the declared variants have finished compiling, and
+  // the number declared in aTotal. Variants that failed to compile count as
+  // finished. Must be called on the render thread.
+  int GetPrecompileProgress(int& aTotal);
 protected:
   struct State;
   ProgramFactory(State& aState);
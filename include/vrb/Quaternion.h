@@ -17,21 +17,21 @@ class Matrix;
 
 class Quaternion {
 public:
-  Quaternion() {}
-  Quaternion(const float aX, const float aY, const float aZ, const float aW) : m(aX, aY, aZ, aW) {}
-  Quaternion(const Quaternion& aValue) : m(aValue.m) {}
+  constexpr Quaternion() {}
+  constexpr Quaternion(const float aX, const float aY, const float aZ, const float aW) : m(aX, aY, aZ, aW) {}
+  constexpr Quaternion(const Quaternion& aValue) : m(aValue.m) {}
   // Assumes [x, y, z, w] data layout
-  Quaternion(const float aData[4]) : m(aData[0], aData[1], aData[2], aData[3]) {}
+  constexpr Quaternion(const float aData[4]) : m(aData[0], aData[1], aData[2], aData[3]) {}
   Quaternion(const Matrix &aMatrix) { SetFromRotationMatrix(aMatrix); }
 
   float& x() { return m.mX; }
   float& y() { return m.mY; }
   float& z() { return m.mZ; }
   float& w() { return m.mW; }
-  float x() const { return m.mX; }
-  float y() const { return m.mY; }
-  float z() const { return m.mZ; }
-  float w() const { return m.mW; }
+  constexpr float x() const { return m.mX; }
+  constexpr float y() const { return m.mY; }
+  constexpr float z() const { return m.mZ; }
+  constexpr float w() const { return m.mW; }
 
   Quaternion& operator=(const Quaternion& aValue) {
     m = aValue.m;
@@ -105,6 +105,9 @@ public:
     return Conjugate().Normalize();
   }
 
+  // Spherical interpolation along the shortest arc, aAmount in [0, 1].
+  static Quaternion Slerp(const Quaternion& aFrom, const Quaternion& aTo, const float aAmount);
+
   void ToEulerAngles(float& aX, float& aY, float& aZ) const;
   void SetFromEulerAngles(float aX, float aY, float aZ);
 
@@ -126,9 +129,9 @@ protected:
     struct {
       float mX, mY, mZ, mW;
     };
-    Data() : mX(0.0f), mY(0.0f), mZ(0.0f), mW(1.0f) {}
-    Data(const float aX, const float aY, const float aZ, const float aW) : mX(aX), mY(aY), mZ(aZ), mW(aW) {}
-    Data(const Data& aData) : mX(aData.mX), mY(aData.mY), mZ(aData.mZ), mW(aData.mW) {}
+    constexpr Data() : mX(0.0f), mY(0.0f), mZ(0.0f), mW(1.0f) {}
+    constexpr Data(const float aX, const float aY, const float aZ, const float aW) : mX(aX), mY(aY), mZ(aZ), mW(aW) {}
+    constexpr Data(const Data& aData) : mX(aData.mX), mY(aData.mY), mZ(aData.mZ), mW(aData.mW) {}
     Data& operator=(const Data& aData) {
       mX = aData.mX;
       mY = aData.mY;
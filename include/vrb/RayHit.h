@@ -0,0 +1,41 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_RAY_HIT_DOT_H
+#define VRB_RAY_HIT_DOT_H
+
+#include "vrb/Forward.h"
+
+#include <cstdint>
+#include <limits>
+
+namespace vrb {
+
+// Result of Node::Intersect. Only hits closer than distance are reported, so
+// it may be set to limit the length of the ray before the query.
+struct RayHit {
+  // The Geometry that was hit.
+  NodePtr node;
+  // Along the ray, in units of its direction which is kept by transforms.
+  float distance;
+  // Index of the triangle within the Geometry and of the face it belongs to.
+  int32_t triangle;
+  int32_t face;
+  // Barycentric weights of the second and third corners of the triangle.
+  float u;
+  float v;
+
+  RayHit()
+      : distance(std::numeric_limits<float>::infinity())
+      , triangle(-1)
+      , face(-1)
+      , u(0.0f)
+      , v(0.0f)
+  {}
+};
+
+} // namespace vrb
+
+#endif // VRB_RAY_HIT_DOT_H
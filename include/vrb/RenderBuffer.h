@@ -22,23 +22,60 @@ public:
   GLuint GetIndexObject() const;
   GLsizei VertexCount() const;
   GLsizei VertexSize() const;
+  // Vertices are packed by default, one attribute after the other. A stride
+  // of aStride bytes describes interleaved data laid out by another tool,
+  // such as a glTF buffer view. Zero restores the packed layout.
+  void SetVertexStride(const GLsizei aStride);
   GLsizei IndexCount() const;
-  void DefinePosition(const size_t aOffset, const GLsizei aLength = 3);
+  void SetIndexType(const GLenum aType);
+  GLenum IndexType() const;
+  GLsizei IndexSize() const;
+  // GL_TRIANGLES by default. GL_TRIANGLE_STRIP indices are drawn with
+  // GL_PRIMITIVE_RESTART_FIXED_INDEX, the largest value of the index type
+  // ending a strip.
+  void SetPrimitiveType(const GLenum aType);
+  GLenum PrimitiveType() const;
+  // Number of triangles drawn by aIndexCount indices, an upper bound for
+  // strips.
+  GLsizei TriangleCount(const GLsizei aIndexCount) const;
+  void DefinePosition(const size_t aOffset, const GLsizei aLength = 3, const GLenum aType = GL_FLOAT, const bool aNormalized = false);
   size_t PositionOffset() const;
   GLsizei PositionSize() const;
   GLsizei PositionLength() const;
-  void DefineNormal(const size_t aOffset, const GLsizei aLength = 3);
+  GLenum PositionType() const;
+  GLboolean PositionNormalized() const;
+  void DefineNormal(const size_t aOffset, const GLsizei aLength = 3, const GLenum aType = GL_FLOAT, const bool aNormalized = false);
   size_t NormalOffset() const;
   GLsizei NormalSize() const;
   GLsizei NormalLength() const;
-  void DefineUV(const size_t aOffset, const GLsizei aLength = 2);
+  GLenum NormalType() const;
+  GLboolean NormalNormalized() const;
+  void DefineUV(const size_t aOffset, const GLsizei aLength = 2, const GLenum aType = GL_FLOAT, const bool aNormalized = false);
   size_t UVOffset() const;
   GLsizei UVSize() const;
   GLsizei UVLength() const;
-  void DefineColor(const size_t aOffset, const GLsizei aLength = 4);
+  GLenum UVType() const;
+  GLboolean UVNormalized() const;
+  void DefineColor(const size_t aOffset, const GLsizei aLength = 4, const GLenum aType = GL_FLOAT, const bool aNormalized = false);
   size_t ColorOffset() const;
   GLsizei ColorSize() const;
   GLsizei ColorLength() const;
+  GLenum ColorType() const;
+  GLboolean ColorNormalized() const;
+  // Indices of the four joints blending each vertex of a skinned geometry.
+  void DefineJoint(const size_t aOffset, const GLsizei aLength = 4, const GLenum aType = GL_UNSIGNED_BYTE, const bool aNormalized = false);
+  size_t JointOffset() const;
+  GLsizei JointSize() const;
+  GLsizei JointLength() const;
+  GLenum JointType() const;
+  GLboolean JointNormalized() const;
+  // Weights of the joints defined by DefineJoint.
+  void DefineWeight(const size_t aOffset, const GLsizei aLength = 4, const GLenum aType = GL_FLOAT, const bool aNormalized = false);
+  size_t WeightOffset() const;
+  GLsizei WeightSize() const;
+  GLsizei WeightLength() const;
+  GLenum WeightType() const;
+  GLboolean WeightNormalized() const;
   void Bind();
   void Unbind();
 
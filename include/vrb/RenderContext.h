@@ -16,7 +16,31 @@ namespace vrb {
 
 class RenderContext {
 public:
+  // Points of the cold start, see GetStartupTime().
+  enum class StartupPhase {
+    // Create() returned.
+    Created,
+    // InitializeGL() returned the first time.
+    GLInitialized,
+    // The first Update() after InitializeGL().
+    FirstUpdate,
+    // The second Update() after InitializeGL(), the first frame was drawn.
+    FirstFrame,
+    Count
+  };
+  // Tiers of TrimMemory(), each also releases what the ones before do.
+  enum class MemoryPressure {
+    // Frees the image data kept in memory after the upload.
+    Moderate,
+    // Evicts the cached textures the last frame did not bind, deletes the
+    // unused FBOPool targets and destroys the disposed nodes at once.
+    Low,
+    // Clears the model caches added with AddModelCache().
+    Critical
+  };
   static RenderContextPtr Create();
+  // Tier for an android.content.ComponentCallbacks2 onTrimMemory() level.
+  static MemoryPressure GetMemoryPressure(const int aTrimLevel);
 
 #if defined(ANDROID)
   void InitializeJava(JNIEnv* aEnv, jobject& aActivity, jobject& aAssetManager);
@@ -26,15 +50,68 @@ public:
   bool InitializeGL();
   void ShutdownGL();
   void Update();
+  // Limits the time Update() spends initializing new GL resources. Resources
+  // that do not fit are initialized in later frames, those needed by visible
+  // nodes first. Zero, the default, initializes every resource immediately.
+  void SetResourceInitializationBudget(const double aSeconds);
+  double GetResourceInitializationBudget() const;
+  // Detaches aNode from its parents and destroys it over the following
+  // Update() calls instead of at once. The children of disposed Groups are
+  // destroyed one by one within the disposal budget, while nodes that are
+  // still owned elsewhere are only released. Must be called on the render
+  // thread.
+  void Dispose(NodePtr aNode);
+  // Seconds each Update() may spend destroying disposed nodes, at least one
+  // is destroyed per frame. Zero or less destroys them all in the next
+  // Update(). Defaults to one millisecond.
+  void SetDisposalBudget(const double aSeconds);
+  // Releases memory for aPressure, as the system asks when it runs low.
+  // Everything released is recreated or read again when it is next used.
+  // Returns the bytes freed according to the memory counters, see
+  // MemoryCounter.h. Must be called on the render thread.
+  size_t TrimMemory(const MemoryPressure aPressure);
+  // Held weakly, see MemoryPressure::Critical.
+  void AddModelCache(const ModelCachePtr& aCache);
+  // With a budget, InitializeGL() after ShutdownGL(), as on Android resume,
+  // does not recreate every resource at once. Programs and the resources of
+  // visible nodes are recreated first and the rest within the budget of
+  // later frames. Nodes appear as their resources are ready.
+  bool IsRecoveringContext() const;
+  // Seconds the last recovery took from InitializeGL() until every resource
+  // was recreated, zero if there has been none.
+  double GetContextRecoveryTime() const;
+  // Seconds from the start of Create() until aPhase was reached, negative
+  // if it has not been yet. The timeline is logged once the first frame is
+  // drawn and added to a running trace capture, see TraceProfiler.h.
+  double GetStartupTime(const StartupPhase aPhase) const;
   double GetTimestamp();
   double GetFrameDelta();
+  // GL counters of the previous frame, see GLStats.h.
+  const GLStats& GetGLStats() const;
 
   ThreadIdentityPtr& GetRenderThreadIdentity();
   DataCachePtr& GetDataCache();
+  // Worker threads shared by the subsystems, see JobSystem.
+  JobSystemPtr& GetJobSystem();
+  // Loads KTX2 textures for the FileReader, see KTX2Decoder.
+  KTX2DecoderPtr& GetKTX2Decoder();
+  // Animates every AnimatedTransform, see TransformAnimator.
+  TransformAnimatorPtr& GetTransformAnimator();
   TextureCachePtr& GetTextureCache();
+  // Decoded textures kept across runs, disabled until a directory is set.
+  TextureDiskCachePtr& GetTextureDiskCache();
   ProgramFactoryPtr& GetProgramFactory();
   CreationContextPtr& GetRenderThreadCreationContext();
   GLExtensionsPtr GetGLExtensions() const;
+  FBOPoolPtr& GetFBOPool();
+  // Per frame streaming storage, see StreamBuffer.
+  StreamBufferPtr& GetStreamBuffer();
+  // Deletes the GL names released by resources, see GLDeletionQueue.
+  GLDeletionQueuePtr& GetGLDeletionQueue();
+  // Render states shared by loaded models, see MaterialRegistry.
+  MaterialRegistryPtr& GetMaterialRegistry();
+  // Sampler objects shared by textures, see SamplerCache.
+  SamplerCachePtr& GetSamplerCache();
 #if defined(ANDROID)
   SurfaceTextureFactoryPtr GetSurfaceTextureFactory();
 #endif // defined(ANDROID)
@@ -44,6 +121,10 @@ public:
   ResourceGLList& GetResourceGLList();
   UpdatableList& GetUpdatableList();
   void RegisterContextSynchronizer(ContextSynchronizerPtr& aSynchronizer);
+  // Used by OffscreenRenderScope. The GL state is only read by the first
+  // save of each Update(), later ones reuse it.
+  void SaveOffscreenGLState();
+  void RestoreOffscreenGLState();
 protected:
   struct State;
   RenderContext(State& aState);
@@ -0,0 +1,70 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_RENDER_LAYER_DOT_H
+#define VRB_RENDER_LAYER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/Group.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/ResourceGL.h"
+#include "vrb/Updatable.h"
+
+#include <cstdint>
+
+namespace vrb {
+
+// Group drawn as a single textured quad, for UI panels and other subtrees
+// that face +Z and change rarely, so their many draws cost two triangles per
+// eye. The children are rendered, seen from +Z, into an FBO from the
+// RenderContext FBOPool during RenderContext::Update(), and rendered again
+// only once the subtree changes or Invalidate() is called. The quad covers
+// the front, +Z, face of the bounds. Renders only happen after the layer was
+// seen by a Cull, and the children are drawn instead until the first one.
+// Renders only see the lights added to the RenderLayer itself. Must be
+// created and used on the render thread.
+class RenderLayer : public Group, protected ResourceGL, protected Updatable {
+public:
+  static RenderLayerPtr Create(RenderContextPtr& aContext);
+
+  // Node interface
+  void Cull(CullVisitor& aVisitor, DrawableList& aDrawables) override;
+  void Flatten(SceneSnapshot& aSnapshot) override;
+
+  // RenderLayer interface
+  // Size in pixels of the texture, best matched to the aspect of the bounds
+  // and the size the layer covers on screen. The children are rendered again
+  // into a new target. Defaults to 512 by 512.
+  void SetResolution(const int32_t aWidth, const int32_t aHeight);
+  // Renders the children again before the next frame, for changes the scene
+  // graph does not see, such as new textures.
+  void Invalidate();
+  // Number of times the children were rendered into the texture.
+  uint32_t GetRenderCount() const;
+  // True when the last Cull drew the quad instead of the children.
+  bool IsShowingLayer() const;
+
+protected:
+  typedef Group Super;
+  struct State;
+  RenderLayer(State& aState, RenderContextPtr& aContext);
+  ~RenderLayer();
+
+  // ResourceGL interface
+  void InitializeGL() override;
+  void ShutdownGL() override;
+
+  // Updatable interface
+  void UpdateResource(RenderContext& aContext) override;
+
+private:
+  State& m;
+  RenderLayer() = delete;
+  VRB_NO_DEFAULTS(RenderLayer)
+};
+
+} // namespace vrb
+
+#endif // VRB_RENDER_LAYER_DOT_H
@@ -11,6 +11,7 @@
 #include "vrb/ResourceGL.h"
 
 #include "vrb/gl.h"
+#include <vector>
 
 namespace vrb {
 
@@ -18,13 +19,41 @@ class RenderState : protected ResourceGL {
 public:
   static RenderStatePtr Create(CreationContextPtr& aContext);
   void SetProgram(ProgramPtr& aProgram);
+  ProgramPtr GetProgram() const;
+  // Feature masks of cheaper programs, such as FeatureLowPrecision,
+  // FeatureNoSpecular or FeatureVertexColor without FeatureTexture, drawn
+  // with instead of the program while the quality tier is lowered:
+  // aFeatureMasks[0] at tier one, the next at tier two and the last one for
+  // every tier below. They keep the FeatureInstancing and FeatureSkinning
+  // bits of the program and are compiled when set, a tier only switches to
+  // a fallback once it is ready so lowering the tier never stalls a frame.
+  void SetQualityFallbacks(const std::vector<uint32_t>& aFeatureMasks);
+  // Quality tier of every RenderState, zero for full quality, the default.
+  // Usually set by a ShaderQualityScaler.
+  static void SetQualityTier(const int aTier);
+  static int GetQualityTier();
+  // While set, Enable binds the FeatureDepthOnly variant of the program and
+  // only uploads the matrices, for the depth pre-pass of the DrawableList.
+  // Render states not yet drawn with their program, or whose variant is
+  // still compiling, are enabled as usual, so color writes are expected to
+  // be disabled. Applies to the calling thread, off by default.
+  static void SetDepthOnly(const bool aDepthOnly);
+  static bool IsDepthOnly();
   GLint AttributePosition() const;
   GLint AttributeNormal() const;
   GLint AttributeUV() const;
   GLint AttributeColor() const;
+  // Location of the per instance model matrix, -1 if the program is not instanced.
+  GLint AttributeInstanceModel() const;
+  // Locations of the joint indices and weights, -1 if the program is not skinned.
+  GLint AttributeJoint() const;
+  GLint AttributeWeight() const;
   uint32_t GetLightId() const;
   void ResetLights(const uint32_t aId);
   void AddLight(const Vector& aDirection, const Color& aAmbient, const Color& aDiffuse, const Color& aSpecular);
+  // Replaces the lights with a shared block. The block must not be modified.
+  void SetLights(const uint32_t aId, const LightBlockPtr& aLights);
+  const LightBlockPtr& GetLights() const;
   void SetMaterial(const Color& aAmbient, const Color& aDiffuse, const Color& aSpecular, const float aSpecularExponent);
   void SetAmbient(const Color& aColor);
   void SetDiffuse(const Color& aColor);
@@ -35,14 +64,41 @@ public:
   bool HasTexture() const;
   const Color& GetTintColor() const;
   void SetTintColor(const Color& aColor);
+  // A RenderState is transparent if it has been flagged as such or if the
+  // tint or diffuse color has an alpha less than one.
+  bool IsTransparent() const;
+  void SetTransparent(const bool aTransparent);
   bool Enable(const Matrix& aPerspective, const Matrix& aView, const Matrix& aModel);
+  // Uploads every view of aCamera when the program has FeatureMultiview.
+  bool Enable(const Camera& aCamera, const Matrix& aModel);
+  // aBounds are the world space bounds of the draw. Only the point lights
+  // reaching them are uploaded, nearest first, after the directional lights.
+  // The other overloads give every light up to VRB_MAX_LIGHTS.
+  bool Enable(const Camera& aCamera, const Matrix& aModel, const Bounds& aBounds);
   void Disable();
+  // Forgets the program and texture bindings made by Enable and unbinds the
+  // sampler of texture unit 0, see SamplerCache. Must be called when GL
+  // bindings were changed outside of RenderState. DrawableList::Draw calls it
+  // at the start of every pass and once done.
+  static void InvalidateBindings();
+  bool GetLightsEnabled() const;
   void SetLightsEnabled(bool aEnabled);
+  const vrb::Matrix& GetUVTransform() const;
   void SetUVTransform(const vrb::Matrix& aMatrix);
+  // Layer of a TextureArray sampled by a FeatureTextureArray program. It is
+  // added to the third UV component when the vertices have one, so render
+  // states sharing an array and program differ only by a uniform, or not at
+  // all when each vertex selects its layer.
+  float GetTextureLayer() const;
+  void SetTextureLayer(const float aLayer);
+  // The joint palette of aSkeleton is uploaded by Enable when the program has
+  // FeatureSkinning. A skeleton may be shared by several render states.
+  void SetSkeleton(const SkeletonPtr& aSkeleton);
+  const SkeletonPtr& GetSkeleton() const;
 protected:
   struct State;
   RenderState(State& aState, CreationContextPtr& aContext);
-  ~RenderState() = default;
+  ~RenderState();
 
   // ResourceGL interface
   void InitializeGL() override;
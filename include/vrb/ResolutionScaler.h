@@ -0,0 +1,72 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_RESOLUTION_SCALER_DOT_H
+#define VRB_RESOLUTION_SCALER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/FBO.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/PerformanceMonitor.h"
+#include "vrb/Updatable.h"
+
+#include "vrb/gl.h"
+
+#include <vector>
+
+namespace vrb {
+
+// Render target that lowers its resolution in steps while the
+// PerformanceMonitor it observes reports poor performance, and raises it
+// again once performance has been restored for a while. A target for every
+// scale is acquired up front from the FBOPool of the RenderContext, so
+// changing scale never allocates. With foveated attributes the foveation level is raised before
+// the resolution is lowered, see SetFoveationLevels(). Must be used on the
+// render thread.
+class ResolutionScaler : protected Updatable {
+public:
+  static ResolutionScalerPtr Create(RenderContextPtr& aContext);
+  // Observes aMonitor until destroyed or another monitor is set.
+  void SetPerformanceMonitor(const PerformanceMonitorPtr& aMonitor);
+  // Scales in decreasing order. The first is used while performance is good.
+  // Defaults to 1.0, 0.85, 0.7 and 0.5.
+  void SetScales(const std::vector<float>& aScales);
+  // Range of FBO foveation levels stepped through at full scale. Defaults to
+  // 0 and 0, which leaves foveation off.
+  void SetFoveationLevels(const int32_t aMin, const int32_t aMax);
+  int32_t GetFoveationLevel() const;
+  // The scaler steps down through the foveation levels and then the scales.
+  // It is not raised above aStep, and is lowered to it right away, even while
+  // performance is good. Used to lower quality ahead of a drop, see
+  // ThermalGovernor. Steps past the last one use the last. Defaults to 0.
+  void SetStepFloor(const int32_t aStep);
+  int32_t GetStep() const;
+  // Focal point of aEye on every render target, see FBO::SetFocalPoint().
+  void SetFocalPoint(const int32_t aEye, const float aX, const float aY);
+  // Allocates the render targets for a full resolution of aWidth by aHeight.
+  void SetSize(const int32_t aWidth, const int32_t aHeight, const FBO::Attributes& aAttributes = {});
+  float GetScale() const;
+  // Size of the current render target.
+  void GetSize(int32_t& aWidth, int32_t& aHeight) const;
+  // Render target and its color texture at the current scale. The texture is
+  // a two layer GL_TEXTURE_2D_ARRAY for multiview attributes.
+  FBOPtr GetFBO() const;
+  GLuint GetTextureHandle() const;
+protected:
+  struct State;
+  ResolutionScaler(State& aState, RenderContextPtr& aContext);
+  ~ResolutionScaler();
+
+  // Updatable interface
+  void UpdateResource(RenderContext& aContext) override;
+private:
+  State& m;
+  ResolutionScaler() = delete;
+  VRB_NO_DEFAULTS(ResolutionScaler)
+};
+
+} // namespace vrb
+
+#endif // VRB_RESOLUTION_SCALER_DOT_H
@@ -9,17 +9,25 @@
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 
+#include <functional>
 #include <jni.h>
 
 namespace vrb {
 
+// Queue of work posted from any thread and run by ProcessRunnables() on the
+// thread that owns the queue. Adding is lock free. Java runnables and native
+// tasks run in the order they were added.
 class RunnableQueue {
 public:
-  static RunnableQueuePtr Create(JavaVM* aVM);
+  // With a class loader that finds org.mozilla.vrb.RunnableBatch, each run of
+  // consecutive Java runnables is passed to Java in a single call.
+  static RunnableQueuePtr Create(JavaVM* aVM, const ClassLoaderAndroidPtr& aClassLoader = nullptr);
 
   bool AttachToThread();
   void Clear();
   void AddRunnable(JNIEnv* aEnv, jobject aRunnable);
+  // Runs aTask without any JNI call.
+  void AddTask(std::function<void()>&& aTask);
   void ProcessRunnables();
 protected:
   struct State;
@@ -0,0 +1,60 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_SAMPLER_CACHE_DOT_H
+#define VRB_SAMPLER_CACHE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include "vrb/gl.h"
+#include <cstddef>
+#include <vector>
+
+namespace vrb {
+
+// Context wide sampler objects, one per set of filtering and wrap parameters
+// of the textures drawn, bound with each texture by RenderState::Enable so
+// textures with the same parameters share one sampler. Mipmapped samplers
+// get the maximum anisotropy, which may change at any time, or with the
+// quality tier, without touching the textures. Without sampler objects, as
+// in GLES2, textures keep using their own parameters. Must be used on the
+// render thread.
+class SamplerCache {
+public:
+  static SamplerCachePtr Create(RenderContextPtr& aContext);
+  bool IsSupported() const;
+  // Returns the sampler matching the parameters of aTexture, creating it
+  // when there is none yet. Returns zero, the texture parameters, when
+  // sampler objects are not supported or for external textures.
+  GLuint GetSampler(const Texture& aTexture);
+  // Clamped to the maximum of the driver. 1, no anisotropic filtering, by
+  // default or without EXT_texture_filter_anisotropic.
+  void SetMaxAnisotropy(const float aAnisotropy);
+  float GetMaxAnisotropy() const;
+  // Maximum anisotropy of each quality tier, see RenderState::SetQualityTier(),
+  // starting with tier zero. Tiers past the end use the last one. Overrides
+  // SetMaxAnisotropy() when not empty.
+  void SetTierAnisotropy(const std::vector<float>& aAnisotropy);
+  size_t GetCount() const;
+
+  // Internal interface, called by the RenderContext.
+  void InitializeGL();
+  void ShutdownGL();
+  // Follows changes of the quality tier.
+  void Update();
+protected:
+  struct State;
+  SamplerCache(State& aState, RenderContextPtr& aContext);
+  ~SamplerCache();
+private:
+  State& m;
+  SamplerCache() = delete;
+  VRB_NO_DEFAULTS(SamplerCache)
+};
+
+} // namespace vrb
+
+#endif // VRB_SAMPLER_CACHE_DOT_H
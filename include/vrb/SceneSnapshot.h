@@ -0,0 +1,58 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_SCENE_SNAPSHOT_DOT_H
+#define VRB_SCENE_SNAPSHOT_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <vector>
+
+namespace vrb {
+
+// Flattened copy of a scene graph, in depth first order, that is culled with
+// a linear walk instead of recursive Cull calls. Each Group holds its world
+// transform and bounds, nodes culled by other means, such as Geometry or
+// LevelOfDetail, are kept as leaves. Transform and bounds changes update the
+// entries in place, changes to the children, lights or toggles of any Group
+// flatten the graph again.
+class SceneSnapshot {
+public:
+  static SceneSnapshotPtr Create(CreationContextPtr& aContext);
+
+  void SetRoot(const GroupPtr& aRoot);
+  // Same result as calling Cull on the root with an empty transform stack.
+  void Cull(CullVisitor& aVisitor, DrawableList& aDrawables);
+  int32_t GetEntryCount() const;
+  // Splits Cull into jobs of sibling subtrees run by aCuller. The drawables
+  // are added in the same order as without it. Every Node culled as a leaf,
+  // such as Geometry or LevelOfDetail, must appear once in the graph and
+  // only read shared state from its Cull. Pass nullptr to cull on the
+  // calling thread only.
+  void SetParallelCuller(const ParallelCullerPtr& aCuller);
+
+  // Called from Node::Flatten while the snapshot is built.
+  void AddNode(Node& aNode);
+  // aTransform, when set, is applied to the children and must stay valid
+  // until the layout of the node changes.
+  void BeginGroup(Node& aNode, const Matrix* aTransform, const std::vector<LightPtr>& aLights,
+                  Drawable* aPreRender, Drawable* aPostRender);
+  void EndGroup();
+
+protected:
+  struct State;
+  SceneSnapshot(State& aState, CreationContextPtr& aContext);
+  ~SceneSnapshot();
+
+private:
+  State& m;
+  SceneSnapshot() = delete;
+  VRB_NO_DEFAULTS(SceneSnapshot)
+};
+
+} // namespace vrb
+
+#endif // VRB_SCENE_SNAPSHOT_DOT_H
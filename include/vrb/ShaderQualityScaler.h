@@ -0,0 +1,47 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_SHADER_QUALITY_SCALER_DOT_H
+#define VRB_SHADER_QUALITY_SCALER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Updatable.h"
+
+namespace vrb {
+
+// Lowers the global quality tier, see RenderState::SetQualityFallbacks(), one
+// step at a time while the PerformanceMonitor it observes reports poor
+// performance, and raises it again once performance has been restored for a
+// while. Must be used on the render thread.
+class ShaderQualityScaler : protected Updatable {
+public:
+  static ShaderQualityScalerPtr Create(RenderContextPtr& aContext);
+  // Observes aMonitor until destroyed or another monitor is set.
+  void SetPerformanceMonitor(const PerformanceMonitorPtr& aMonitor);
+  // Lowest tier stepped to, usually the number of fallbacks given to the
+  // render states. Defaults to 1.
+  void SetMaxTier(const int aTier);
+  // Tier the scaler is not raised above, and is lowered to right away even
+  // while performance is good. Used to lower quality ahead of a drop, see
+  // ThermalGovernor. Clamped to the max tier. Defaults to 0.
+  void SetMinTier(const int aTier);
+  int GetTier() const;
+protected:
+  struct State;
+  ShaderQualityScaler(State& aState, RenderContextPtr& aContext);
+  ~ShaderQualityScaler();
+
+  // Updatable interface
+  void UpdateResource(RenderContext& aContext) override;
+private:
+  State& m;
+  ShaderQualityScaler() = delete;
+  VRB_NO_DEFAULTS(ShaderQualityScaler)
+};
+
+} // namespace vrb
+
+#endif // VRB_SHADER_QUALITY_SCALER_DOT_H
@@ -17,6 +17,18 @@ GLint GetUniformLocation(GLuint aProgram, const char* aName);
 GLint GetUniformLocation(GLuint aProgram, const std::string& aName);
 GLuint LoadShader(GLenum type, const char* src);
 GLuint CreateProgram (GLuint aVertexShader, GLuint aFragmentShader);
+// aRetrievable hints the driver that glGetProgramBinary will be used.
+GLuint CreateProgram (GLuint aVertexShader, GLuint aFragmentShader, const bool aRetrievable);
+// CompileShader and LinkProgram only submit the work and never query its
+// status, so a driver supporting KHR_parallel_shader_compile can finish it
+// in the background. Poll IsProgramComplete before calling CheckProgramLinked.
+GLuint CompileShader(GLenum aType, const char* aSrc);
+GLuint LinkProgram(GLuint aVertexShader, GLuint aFragmentShader, const bool aRetrievable);
+bool IsProgramComplete(GLuint aProgram);
+// Logs the shader and program info logs on failure.
+bool CheckProgramLinked(GLuint aProgram, GLuint aVertexShader, GLuint aFragmentShader);
+// Links aComputeShader on its own, returns 0 on failure.
+GLuint CreateComputeProgram(GLuint aComputeShader);
 
 } // namespace vrb
 
@@ -0,0 +1,103 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_SHARDED_MAP_DOT_H
+#define VRB_SHARDED_MAP_DOT_H
+
+#include "vrb/MacroUtils.h"
+#include "vrb/Mutex.h"
+
+#include <functional>
+#include <stddef.h>
+#include <unordered_map>
+
+namespace vrb {
+
+// Hash map split into shards that each have their own RWMutex, so threads
+// only contend when they touch the same shard and lookups share it with
+// other lookups. Values are returned by copy since another thread may erase
+// them once the shard is unlocked. Callbacks run with the shard locked and
+// must not use the map.
+template<typename Key, typename Value, typename Hash = std::hash<Key>, size_t kShardCount = 16>
+class ShardedMap {
+public:
+  ShardedMap() = default;
+
+  bool Find(const Key& aKey, Value& aValue) const {
+    const Shard& shard = GetShard(aKey);
+    ReadAutoLock lock(shard.lock);
+    auto found = shard.map.find(aKey);
+    if (found == shard.map.end()) {
+      return false;
+    }
+    aValue = found->second;
+    return true;
+  }
+
+  // Returns the value of aKey, storing aCreate() first if there is none.
+  // aCreate is called at most once per key.
+  template<typename Create>
+  Value FindOrCreate(const Key& aKey, const Create& aCreate) {
+    Value result;
+    if (Find(aKey, result)) {
+      return result;
+    }
+    Shard& shard = GetShard(aKey);
+    WriteAutoLock lock(shard.lock);
+    auto found = shard.map.find(aKey);
+    if (found == shard.map.end()) {
+      found = shard.map.emplace(aKey, aCreate()).first;
+    }
+    return found->second;
+  }
+
+  void Set(const Key& aKey, const Value& aValue) {
+    Shard& shard = GetShard(aKey);
+    WriteAutoLock lock(shard.lock);
+    shard.map[aKey] = aValue;
+  }
+
+  bool Erase(const Key& aKey) {
+    Shard& shard = GetShard(aKey);
+    WriteAutoLock lock(shard.lock);
+    return shard.map.erase(aKey) > 0;
+  }
+
+  void Clear() {
+    for (Shard& shard: mShards) {
+      WriteAutoLock lock(shard.lock);
+      shard.map.clear();
+    }
+  }
+
+  // Calls aCallback with every key and value, one shard at a time.
+  template<typename Callback>
+  void ForEach(const Callback& aCallback) const {
+    for (const Shard& shard: mShards) {
+      ReadAutoLock lock(shard.lock);
+      for (const auto& entry: shard.map) {
+        aCallback(entry.first, entry.second);
+      }
+    }
+  }
+
+private:
+  struct Shard {
+    mutable RWMutex lock;
+    std::unordered_map<Key, Value, Hash> map;
+  };
+  Shard& GetShard(const Key& aKey) {
+    return mShards[Hash()(aKey) % kShardCount];
+  }
+  const Shard& GetShard(const Key& aKey) const {
+    return mShards[Hash()(aKey) % kShardCount];
+  }
+  Shard mShards[kShardCount];
+  VRB_NO_DEFAULTS(ShardedMap)
+};
+
+} // namespace vrb
+
+#endif // VRB_SHARDED_MAP_DOT_H
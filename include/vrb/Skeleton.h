@@ -0,0 +1,53 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_SKELETON_DOT_H
+#define VRB_SKELETON_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Updatable.h"
+
+#include <cstdint>
+
+namespace vrb {
+
+class Matrix;
+
+// Joint hierarchy of a skinned geometry. The pose is read from the local
+// matrix of each joint Transform, usually an AnimatedTransform, and the joint
+// palette is rebuilt with the animations by the TransformAnimator. The
+// palette is uploaded to FeatureSkinning programs by RenderState::Enable so a
+// deforming mesh is drawn with a single draw call.
+class Skeleton : protected Updatable {
+public:
+  static SkeletonPtr Create(CreationContextPtr& aContext);
+  // Joints must be added after their parent. A joint without a parent is
+  // relative to the skinned geometry. aInverseBind maps the geometry to the
+  // joint in the bind pose. Returns the index used by VertexArray::AppendSkin.
+  int32_t AddJoint(const TransformPtr& aTransform, const Matrix& aInverseBind, const int32_t aParent = -1);
+  int32_t GetJointCount() const;
+  TransformPtr GetJoint(const int32_t aIndex) const;
+  // One matrix per joint from the bind pose to the current pose, in the
+  // space of the skinned geometry. Null when no joints have been added.
+  const Matrix* GetPalette() const;
+protected:
+  struct State;
+  Skeleton(State& aState, CreationContextPtr& aContext);
+  ~Skeleton();
+
+  // Updatable Interface
+  void UpdateResource(RenderContext& aContext) override;
+
+private:
+  State& m;
+  friend class TransformAnimator;
+  Skeleton() = delete;
+  VRB_NO_DEFAULTS(Skeleton)
+};
+
+} // namespace vrb
+
+#endif // VRB_SKELETON_DOT_H
@@ -0,0 +1,59 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_STREAM_BUFFER_DOT_H
+#define VRB_STREAM_BUFFER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include "vrb/gl.h"
+#include <cstddef>
+
+namespace vrb {
+
+// A ring of three per frame regions in a single GL buffer for data written
+// every frame, such as instance matrices. RenderContext::Update fences the
+// region of the frame that ended and moves to the next one, only waiting
+// when the GPU still reads it. With EXT_buffer_storage the buffer is mapped
+// once, persistently and coherently, so a write is a memcpy. Otherwise each
+// write maps its range unsynchronized, which the fences make safe. Must be
+// used on the render thread.
+class StreamBuffer {
+public:
+  static StreamBufferPtr Create(RenderContextPtr& aContext);
+  // Bytes available to each frame, 1 MiB by default. Takes effect the next
+  // time the buffer is created.
+  void SetFrameSize(const size_t aSize);
+  size_t GetFrameSize() const;
+  // Copies aSize bytes into the region of the current frame. Returns their
+  // offset in the buffer, a multiple of aAlignment, or -1 if the frame is
+  // full or the buffer is not created.
+  GLintptr Write(const void* aData, const size_t aSize, const size_t aAlignment = 16);
+  // Copies aSize bytes over a range written earlier in the current frame,
+  // even though draws reading it may already have been issued. Only a
+  // persistent buffer can, returns false otherwise or when the range is not
+  // part of the current frame.
+  bool Overwrite(const GLintptr aOffset, const void* aData, const size_t aSize);
+  GLuint GetHandle() const;
+  bool IsPersistent() const;
+
+  // Internal interface, called by the RenderContext.
+  void InitializeGL();
+  void ShutdownGL();
+  void NextFrame();
+protected:
+  struct State;
+  StreamBuffer(State& aState, RenderContextPtr& aContext);
+  ~StreamBuffer();
+private:
+  State& m;
+  StreamBuffer() = delete;
+  VRB_NO_DEFAULTS(StreamBuffer)
+};
+
+} // namespace vrb
+
+#endif // VRB_STREAM_BUFFER_DOT_H
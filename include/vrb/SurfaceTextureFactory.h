@@ -13,6 +13,7 @@
 #include "vrb/Updatable.h"
 
 #include "vrb/gl.h"
+#include <cstdint>
 #include <jni.h>
 #include <string>
 
@@ -34,7 +35,10 @@ private:
 class SurfaceTextureFactory : protected Updatable, protected ResourceGL {
 public:
   static SurfaceTextureFactoryPtr Create(CreationContextPtr& aContext);
-  void InitializeJava(JNIEnv* aEnv);
+  // With aClassLoader surfaces are only updated after onFrameAvailable,
+  // otherwise every surface is updated each frame. The Java classes are
+  // looked up when the first surface is created.
+  void InitializeJava(JNIEnv* aEnv, const ClassLoaderAndroidPtr& aClassLoader = nullptr);
   void ShutdownJava();
 
   void CreateSurfaceTexture(const std::string& aName, SurfaceTextureObserverPtr aObserver);
@@ -43,6 +47,9 @@ public:
   void RemoveGlobalObserver(const SurfaceTextureObserver& aObserver);
 
   jobject LookupSurfaceTexture(const std::string& aName);
+  // SurfaceTexture.getTimestamp of the frame last latched for aName, in
+  // nanoseconds of CLOCK_MONOTONIC. Zero before the first frame.
+  int64_t GetSurfaceTimestamp(const std::string& aName) const;
 
 protected:
   struct State;
@@ -22,7 +22,12 @@ public:
   GLenum GetTarget() const;
   void SetName(const std::string& aName);
   void SetTextureParameter(GLenum aName, GLint aParam);
+  // Value given to aName, or aDefault when it has not been set.
+  GLint GetTextureParameter(const GLenum aName, const GLint aDefault) const;
   GLuint GetHandle() const;
+  // Bound instead of this texture while it has no GL texture, for example
+  // before its image has been loaded. Must have the same target.
+  void SetPlaceholder(const TexturePtr& aTexture);
 protected:
   struct State;
   Texture(State& aState, CreationContextPtr& aContext);
@@ -0,0 +1,58 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TEXTURE_ARRAY_DOT_H
+#define VRB_TEXTURE_ARRAY_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/ResourceGL.h"
+#include "vrb/Texture.h"
+
+#include "vrb/gl.h"
+#include <string>
+
+namespace vrb {
+
+// A GL_TEXTURE_2D_ARRAY of RGBA layers that all have the same size, for
+// GLES 3.0. Render states drawing different layers with the same
+// FeatureTextureArray program share one texture binding, see
+// RenderState::SetTextureLayer. The layer count is fixed at creation.
+class TextureArray : public Texture, protected ResourceGL {
+public:
+  static TextureArrayPtr Create(CreationContextPtr& aContext, const int aWidth, const int aHeight, const int32_t aLayerCount);
+
+  // Reserves a layer and loads aFileName into it. Returns the layer, or -1
+  // when every layer is taken. The layer content is undefined until loaded.
+  static int32_t Load(CreationContextPtr& aContext, const TextureArrayPtr& aTexture, const std::string& aFileName);
+  // Returns the next free layer, or -1 when every layer is taken.
+  int32_t ReserveLayer();
+  // Images must be GL_RGBA and match the size of the array.
+  bool SetLayerData(const int32_t aLayer, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat);
+  int GetWidth() const;
+  int GetHeight() const;
+  int32_t GetLayerCount() const;
+protected:
+  struct State;
+  TextureArray(State& aState, CreationContextPtr& aContext);
+  ~TextureArray();
+
+  // Texture interface
+  void AboutToBind() override;
+
+  // ResourceGL interface
+  bool SupportOffRenderThreadInitialization() override;
+  void InitializeGL() override;
+  void ShutdownGL() override;
+
+private:
+  State& m;
+  TextureArray() = delete;
+  VRB_NO_DEFAULTS(TextureArray)
+};
+
+} // namespace vrb
+
+#endif // VRB_TEXTURE_ARRAY_DOT_H
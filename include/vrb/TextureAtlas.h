@@ -0,0 +1,53 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TEXTURE_ATLAS_DOT_H
+#define VRB_TEXTURE_ATLAS_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Updatable.h"
+
+#include <string>
+
+namespace vrb {
+
+// Packs small RGBA textures into shared square pages as they are loaded, so
+// that the RenderStates using them bind the same TextureGL and sort next to
+// each other in the DrawableList. Each RenderState gets the page as its
+// texture and a UV transform to its region, so its Program must be created
+// with FeatureUVTransform. The mapping only holds for UVs in [0, 1], the
+// pages clamp rather than repeat.
+//
+// Images that are compressed or larger than the maximum size are loaded as
+// textures of their own. Textures are assigned on the render thread by
+// RenderContext::Update, until then the default texture is bound.
+class TextureAtlas : protected Updatable {
+public:
+  static TextureAtlasPtr Create(CreationContextPtr& aContext);
+  // Both must be set before the first texture is added. Pages are 1024
+  // pixels wide and tall by default, textures up to 256 pixels are packed.
+  void SetPageSize(const int32_t aSize);
+  void SetMaxTextureSize(const int32_t aSize);
+  // Loads aTextureName, once per name, and assigns it to aState.
+  void AddTexture(const std::string& aTextureName, const RenderStatePtr& aState);
+  int32_t GetPageCount() const;
+protected:
+  struct State;
+  TextureAtlas(State& aState, CreationContextPtr& aContext);
+  ~TextureAtlas();
+
+  // Updatable Interface
+  void UpdateResource(RenderContext& aContext) override;
+
+private:
+  State& m;
+  TextureAtlas() = delete;
+  VRB_NO_DEFAULTS(TextureAtlas)
+};
+
+} // namespace vrb
+
+#endif // VRB_TEXTURE_ATLAS_DOT_H
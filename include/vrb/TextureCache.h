@@ -6,6 +6,7 @@
 #ifndef VRB_TEXTURE_CACHE_DOT_H
 #define VRB_TEXTURE_CACHE_DOT_H
 
+#include "vrb/AssetID.h"
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 
@@ -19,8 +20,31 @@ public:
   void Init(CreationContextPtr& aContext);
   void Shutdown();
   TextureGLPtr FindTexture(const std::string& aTextureName);
+  // Lock free, may be called from any thread.
+  TextureGLPtr FindTexture(const AssetID aTextureID);
   void AddTexture(const std::string& aTextureName, TextureGLPtr& aTexture);
+  void AddTexture(const AssetID aTextureID, TextureGLPtr& aTexture);
   TextureGLPtr GetDefaultTexture();
+  // Cached textures are evicted, least recently bound first, once their
+  // GL memory exceeds aBytes. Zero, the default, disables eviction.
+  void SetBudget(const size_t aBytes);
+  size_t GetBudget() const;
+  // When enabled, CreationContext::LoadTexture only reads an image once a
+  // RenderState using it is drawn, which is after it has survived culling.
+  // The default texture is bound until then, so hidden content costs no
+  // I/O, decode or GL memory. Disabled by default.
+  void SetDeferredLoading(const bool aEnabled);
+  bool IsDeferredLoading() const;
+  // Enforces the budget. Called once per frame by RenderContext::Update().
+  void Update();
+  // Frees the image data the cached textures keep in memory, see
+  // TextureGL::ReleaseImageData(). Returns the bytes freed. Must be called
+  // on the render thread.
+  size_t ReleaseImageData();
+  // Evicts the cached textures that were not bound during the last frame
+  // and frees their image data. Returns the bytes freed. Must be called on
+  // the render thread.
+  size_t EvictUnused();
 protected:
   struct State;
   TextureCache(State& aState);
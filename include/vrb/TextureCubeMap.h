@@ -13,6 +13,7 @@
 
 #include "vrb/gl.h"
 #include <string>
+#include <vector>
 
 namespace vrb {
 
@@ -20,11 +21,18 @@ class TextureCubeMap : public Texture, protected ResourceGL {
 public:
   static TextureCubeMapPtr Create(CreationContextPtr& aContext, GLuint aExternalTexture = 0);
 
+  // The faces are read concurrently on the JobSystem when the FileReader
+  // supports it, and handed to the texture together once all six loaded.
   static void Load(CreationContextPtr& aContext, const TextureCubeMapPtr& aTexture,
                    const std::string& aFileXPos, const std::string& aFileXNeg,
                    const std::string& aFileYPos, const std::string& aFileYNeg,
                    const std::string& aFileZPos, const std::string& aFileZNeg);
+  // Loads a file holding all six faces, such as a KTX cube map with mips.
+  static void Load(CreationContextPtr& aContext, const TextureCubeMapPtr& aTexture, const std::string& aFile);
   void SetImageData(const GLenum aFaceTarget, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat);
+  // Takes the GL_TEXTURE_CUBE_MAP_* levels of aLevels, replacing the faces
+  // they belong to. Faces must have the same format, size and level count.
+  void SetImageLevels(std::vector<ImageLevel>& aLevels);
 protected:
   struct State;
   TextureCubeMap(State& aState, CreationContextPtr& aContext);
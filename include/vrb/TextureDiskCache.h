@@ -0,0 +1,62 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TEXTURE_DISK_CACHE_DOT_H
+#define VRB_TEXTURE_DISK_CACHE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vrb {
+
+// Persistent cache of decoded and transcoded image levels, so later launches
+// upload them without running the image decoders. Entries are named after
+// the source path and hold a hash of the source contents, or of its size and
+// modification time when the FileReader can not map it, and are discarded
+// when it changes. The least recently used entries are removed once the
+// cache grows past its size limit. All functions may be called from any
+// thread.
+class TextureDiskCache {
+public:
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    // Bytes held by the entries in the cache directory.
+    uint64_t size;
+    Stats() : hits(0), misses(0), evictions(0), size(0) {}
+  };
+  static TextureDiskCachePtr Create();
+  // Caching is disabled until a directory is set. Entries left in it by
+  // earlier runs are kept as long as they fit the size limit.
+  void SetCacheDirectory(const std::string& aDirectory);
+  // Defaults to 256 MB.
+  void SetMaxSize(const uint64_t aBytes);
+  bool IsEnabled() const;
+  // Computes the key the entry of aFileName is validated with. Returns false
+  // when caching is disabled or the source can not be found.
+  bool GetSourceKey(const std::string& aFileName, FileReader& aReader, uint64_t& aKey) const;
+  // Returns false when no entry of aFileName matches aKey.
+  bool LoadLevels(const std::string& aFileName, const uint64_t aKey, std::vector<ImageLevel>& aLevels);
+  // Replaces the entry of aFileName. Does not take ownership of the data.
+  void StoreLevels(const std::string& aFileName, const uint64_t aKey, const std::vector<ImageLevel>& aLevels);
+  Stats GetStats() const;
+protected:
+  struct State;
+  TextureDiskCache(State& aState);
+  ~TextureDiskCache();
+private:
+  State& m;
+  TextureDiskCache() = delete;
+  VRB_NO_DEFAULTS(TextureDiskCache)
+};
+
+} // namespace vrb
+
+#endif // VRB_TEXTURE_DISK_CACHE_DOT_H
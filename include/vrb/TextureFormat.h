@@ -0,0 +1,44 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TEXTURE_FORMAT_DOT_H
+#define VRB_TEXTURE_FORMAT_DOT_H
+
+#include "vrb/gl.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace vrb {
+
+struct ImageLevel;
+
+// True for the ETC1, ETC2/EAC, ASTC LDR and S3TC formats, which TextureGL
+// uploads with glCompressedTexImage2D.
+bool IsCompressedTextureFormat(const GLenum aFormat);
+// The sized format glTexStorage2D takes for aFormat, or zero when aFormat
+// needs mutable storage, as ETC1 does.
+GLenum GetTextureStorageFormat(const GLenum aFormat);
+// Block dimensions of an ASTC format, false for other formats.
+bool GetASTCBlockSize(const GLenum aFormat, int& aBlockWidth, int& aBlockHeight);
+// The 2D ASTC LDR format with the given block dimensions or zero.
+GLenum GetASTCFormat(const int aBlockWidth, const int aBlockHeight, const bool aSRGB);
+// Bytes of a aWidth by aHeight level, rounded up to whole blocks for
+// compressed formats. Zero for unknown formats.
+uint64_t GetTextureLevelSize(const GLenum aFormat, const int aWidth, const int aHeight);
+// Levels of a full mip chain for a aWidth by aHeight texture, at most 32.
+// Texture files declaring more levels are invalid.
+uint32_t GetMipLevelCount(const uint32_t aWidth, const uint32_t aHeight);
+
+// Files written by astcenc, a single 2D level.
+bool IsASTCFile(const char* aData, const size_t aSize);
+bool ReadASTCFile(const char* aData, const size_t aSize, std::vector<ImageLevel>& aLevels, std::string& aError);
+// KTX 1.1 files with any compressed or 8 bit per channel format, including
+// ASTC. Fills aLevels ordered by face then level.
+bool ReadKTXFile(const char* aData, const size_t aSize, std::vector<ImageLevel>& aLevels, std::string& aError);
+
+} // namespace vrb
+
+#endif // VRB_TEXTURE_FORMAT_DOT_H
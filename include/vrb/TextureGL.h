@@ -12,7 +12,9 @@
 #include "vrb/Texture.h"
 
 #include "vrb/gl.h"
+#include <functional>
 #include <string>
+#include <vector>
 
 namespace vrb {
 
@@ -20,7 +22,43 @@ class TextureGL : public Texture, protected ResourceGL {
 public:
   static TextureGLPtr Create(CreationContextPtr& aContext);
 
+  // aLoad is called on the render thread by the first bind instead of
+  // loading the image up front, see TextureCache::SetDeferredLoading.
+  void SetDeferredLoad(const std::function<void()>& aLoad);
+  bool IsLoadDeferred() const;
   void SetImageData(std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat);
+  // Takes the GL_TEXTURE_2D levels of aLevels. When more than one level is
+  // set the min filter is switched to its mipmapped variant.
+  void SetImageLevels(std::vector<ImageLevel>& aLevels);
+  // A non-zero budget streams a mip chain in over several frames: the
+  // coarsest levels are uploaded first and at most aBytes, but at least one
+  // level, per bind. Zero, the default, uploads every level at once.
+  void SetStreamingBudget(const size_t aBytes);
+  // Streamed levels finer than aLevel are not kept resident. Raising the
+  // limit frees their storage, lowering it streams them back in.
+  void SetStreamingLevelLimit(const int aLevel);
+  // The finest level that has been uploaded, or -1 if none has.
+  int GetResidentLevel() const;
+  // Bytes of image data held by the GL texture, zero when it does not exist.
+  size_t GetGPUSize() const;
+  // The bind sequence value of the last bind of this texture.
+  uint64_t GetLastBound() const;
+  // Deletes the GL texture. It is recreated from the retained image data on
+  // the next bind. Must be called on the render thread.
+  void Evict();
+  // Reads the image again, like the deferred load, once it is needed after
+  // ReleaseImageData() dropped it. Set by CreationContext::LoadTexture.
+  void SetReload(const std::function<void()>& aReload);
+  // Frees the image data kept in memory. It is moved to the DataCache when
+  // it has a cache path, otherwise it is dropped if the texture has a reload
+  // and kept if not. A dropped image is read again by the first bind that
+  // needs it, after Evict() or the loss of the GL context, and the
+  // placeholder is bound until it is uploaded. New data waiting to replace
+  // an uploaded image is kept. Returns the bytes freed. Must be called on
+  // the render thread.
+  size_t ReleaseImageData();
+  // Counts texture binds on the render thread.
+  static uint64_t GetBindSequence();
   GLsizei GetWidth() const;
   GLsizei GetHeight() const;
 protected:
@@ -0,0 +1,76 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TEXTURE_IMAGE_READER_DOT_H
+#define VRB_TEXTURE_IMAGE_READER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/ResourceGL.h"
+#include "vrb/Texture.h"
+#include "vrb/Updatable.h"
+
+#include "vrb/gl.h"
+#include <cstdint>
+#include <jni.h>
+#include <string>
+
+struct ANativeWindow;
+
+namespace vrb {
+
+// External texture showing the latest frame queued to an AImageReader, for
+// video decoders and cameras, without the SurfaceTexture and JNI round trip
+// of TextureSurface. Each AHardwareBuffer of the reader is wrapped once in an
+// EGLImage and texture of its own, kept in a small pool, so a new frame only
+// switches the texture handle. Frames are waited on and released with native
+// fences when EGL_ANDROID_native_fence_sync is available. Requires API 26,
+// EGL_ANDROID_get_native_client_buffer and GL_OES_EGL_image_external; check
+// IsSupported() once GL is initialized and fall back to TextureSurface
+// otherwise. Must be used on the render thread.
+class TextureImageReader : public Texture, protected Updatable, protected ResourceGL {
+public:
+  static TextureImageReaderPtr Create(RenderContextPtr& aContext, const std::string& aName);
+  // Size, AIMAGE_FORMAT and number of images of the reader created when GL
+  // is initialized. Defaults to 1920 by 1080, AIMAGE_FORMAT_PRIVATE and 3
+  // images, one shown, one released and one being filled.
+  void SetImageFormat(const int32_t aWidth, const int32_t aHeight, const int32_t aFormat, const int32_t aMaxImages);
+  bool IsSupported() const;
+  // Window the producer renders to, owned by the reader. Null until GL is
+  // initialized or when not supported.
+  ANativeWindow* GetWindow() const;
+  // android.view.Surface of GetWindow() as a new local reference, for
+  // MediaCodec or the camera. Null when there is no window.
+  jobject GetSurface(JNIEnv* aEnv) const;
+  // AImage timestamp of the frame shown, in nanoseconds. Zero before the
+  // first frame.
+  int64_t GetTimestamp() const;
+  // Number of buffers wrapped in the pool.
+  size_t GetPoolSize() const;
+
+protected:
+  struct State;
+  TextureImageReader(State& aState, CreationContextPtr& aContext);
+  ~TextureImageReader();
+
+  // Texture interface
+  void AboutToBind() override;
+
+  // Updatable interface
+  void UpdateResource(RenderContext& aContext) override;
+
+  // ResourceGL interface
+  void InitializeGL() override;
+  void ShutdownGL() override;
+
+private:
+  State& m;
+  TextureImageReader() = delete;
+  VRB_NO_DEFAULTS(TextureImageReader)
+};
+
+} // namespace vrb
+
+#endif // VRB_TEXTURE_IMAGE_READER_DOT_H
@@ -0,0 +1,87 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_THERMAL_GOVERNOR_DOT_H
+#define VRB_THERMAL_GOVERNOR_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Updatable.h"
+
+#include <cstdint>
+
+namespace vrb {
+
+class ThermalGovernorObserver {
+public:
+  // aLevel is the new ThermalGovernor level, aHeadroom the forecast headroom
+  // that led to it, negative when unknown.
+  virtual void ThermalLevelChanged(const int32_t aLevel, const float aHeadroom) = 0;
+protected:
+  explicit ThermalGovernorObserver() = default;
+  ~ThermalGovernorObserver() = default;
+  VRB_NO_DEFAULTS(ThermalGovernorObserver)
+  VRB_NO_NEW_DELETE
+};
+
+// Lowers quality ahead of thermal throttling instead of after the frame rate
+// drops, as the PerformanceMonitor does. The thermal headroom forecast and
+// status of the device are read every couple of seconds and mapped to a
+// level, from 0, no pressure, to kMaxLevel. Each level sets the step floor of
+// a ResolutionScaler, the min tier of a ShaderQualityScaler and the active
+// worker limit of a LoaderThread. Levels are raised as soon as the pressure
+// rises and lowered one at a time once it stayed lower for a while.
+// On Android the readings come from the AThermal API of the NDK when the
+// device has it, elsewhere they must be given with ReportThermalState(). Must
+// be used on the render thread.
+class ThermalGovernor : protected Updatable {
+public:
+  static const int32_t kMaxLevel = 3;
+  // What a level applies. Negative values leave the target untouched.
+  struct Throttle {
+    // See ResolutionScaler::SetStepFloor().
+    int32_t resolutionStep;
+    // See ShaderQualityScaler::SetMinTier().
+    int32_t shaderTier;
+    // See LoaderThread::SetActiveWorkerLimit(), zero removes the limit.
+    int32_t loaderWorkers;
+  };
+  static ThermalGovernorPtr Create(RenderContextPtr& aContext);
+  // Targets are held weakly, null ones are skipped.
+  void SetResolutionScaler(const ResolutionScalerPtr& aScaler);
+  void SetShaderQualityScaler(const ShaderQualityScalerPtr& aScaler);
+  void SetLoaderThread(const LoaderThreadPtr& aLoader);
+  // Replaces the throttle of aLevel, 1 to kMaxLevel. Level 0 always restores
+  // the targets. Defaults step the resolution one step per level, raise the
+  // shader tier from level 2 and limit the loader to 2 workers at level 2
+  // and 1 at level 3.
+  void SetThrottle(const int32_t aLevel, const Throttle& aThrottle);
+  // Seconds ahead the headroom is forecast. Defaults to 10.
+  void SetForecast(const int32_t aSeconds);
+  // Uses aHeadroom, where 1.0 is severe throttling, and aStatus, an
+  // AThermalStatus value, instead of reading the platform. Either may be
+  // negative when unknown. Takes effect at the next update.
+  void ReportThermalState(const float aHeadroom, const int32_t aStatus);
+  int32_t GetLevel() const;
+  // Last forecast headroom, negative when unknown.
+  float GetHeadroom() const;
+  void AddThermalGovernorObserver(ThermalGovernorObserverPtr aObserver);
+  void RemoveThermalGovernorObserver(const ThermalGovernorObserver& aObserver);
+protected:
+  struct State;
+  ThermalGovernor(State& aState, RenderContextPtr& aContext);
+  ~ThermalGovernor();
+
+  // Updatable interface
+  void UpdateResource(RenderContext& aContext) override;
+private:
+  State& m;
+  ThermalGovernor() = delete;
+  VRB_NO_DEFAULTS(ThermalGovernor)
+};
+
+} // namespace vrb
+
+#endif // VRB_THERMAL_GOVERNOR_DOT_H
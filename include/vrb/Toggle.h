@@ -16,9 +16,6 @@ class Toggle : public Group {
 public:
   static TogglePtr Create(CreationContextPtr& aContext);
 
-  // Group interface
-  void RemoveNode(Node& aNode) override;
-
   // Toggle interface
   void ToggleAll(const bool aEnabled);
   bool IsEnabled(const Node& aNode);
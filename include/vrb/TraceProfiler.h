@@ -0,0 +1,67 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TRACE_PROFILER_DOT_H
+#define VRB_TRACE_PROFILER_DOT_H
+
+#include "vrb/MacroUtils.h"
+
+#include <stdint.h>
+#include <string>
+
+// Trace zones are compiled in for debug builds, or when VRB_TRACE is defined.
+#if !defined(NDEBUG) || defined(VRB_TRACE)
+#  define VRB_TRACE_ENABLED 1
+#endif
+
+#define VRB_TRACE_CONCAT_IMPL(a, b) a##b
+#define VRB_TRACE_CONCAT(a, b) VRB_TRACE_CONCAT_IMPL(a, b)
+
+#if defined(VRB_TRACE_ENABLED)
+// aName must be a string literal or otherwise outlive the capture.
+#  define VRB_TRACE_ZONE(aName) vrb::TraceZone VRB_TRACE_CONCAT(vrbTraceZone, __LINE__)(aName)
+#  define VRB_TRACE_FUNCTION VRB_TRACE_ZONE(__FUNCTION__)
+#  define VRB_TRACE_FRAME vrb::TraceFrameMark()
+#else
+#  define VRB_TRACE_ZONE(aName)
+#  define VRB_TRACE_FUNCTION
+#  define VRB_TRACE_FRAME
+#endif
+
+namespace vrb {
+
+// Records trace zones from every thread for the next aFrames frames, as
+// counted by TraceFrameMark(). Previously captured events are discarded.
+void TraceStartCapture(const int aFrames);
+void TraceStopCapture();
+bool TraceIsCapturing();
+void TraceFrameMark();
+// Records a zone that has already finished. Times are from TraceGetTime().
+void TraceAddEvent(const char* aName, const uint64_t aStart, const uint64_t aEnd);
+// Monotonic time in nanoseconds.
+uint64_t TraceGetTime();
+// Writes the captured events in the Chrome trace event JSON format, which
+// chrome://tracing and Perfetto open. Must be called once the capture has
+// stopped.
+std::string TraceGetJSON();
+bool TraceWriteJSON(const std::string& aFileName);
+
+// Records the time between construction and destruction. Zones nest per
+// thread. Writing an event is lock free, each thread has its own buffer.
+class TraceZone {
+public:
+  explicit TraceZone(const char* aName);
+  ~TraceZone();
+private:
+  const char* mName;
+  uint64_t mStart;
+  TraceZone() = delete;
+  VRB_NO_DEFAULTS(TraceZone)
+  VRB_NO_NEW_DELETE
+};
+
+} // namespace vrb
+
+#endif // VRB_TRACE_PROFILER_DOT_H
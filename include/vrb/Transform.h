@@ -17,11 +17,22 @@ public:
   static TransformPtr Create(CreationContextPtr& aContext);
   // Node interface
   void Cull(CullVisitor& aVisitor, DrawableList& aDrawables) override;
+  void InvalidateWorldTransform() override;
+  void Flatten(SceneSnapshot& aSnapshot) override;
+  bool Intersect(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit) override;
   // Transform interface
-  const Matrix GetWorldTransform() const;
+  // Cached until the transform of the node or of an ancestor changes,
+  // or the node is reparented.
+  const Matrix& GetWorldTransform() const;
   const Matrix& GetTransform() const;
   virtual void SetTransform(const Matrix& aTransform);
+  // Translation, rotation and uniform scale, applied in that order from the
+  // left. Goes through SetTransform above so subclasses see it.
+  void SetTransform(const Vector& aTranslation, const Quaternion& aRotation, const float aScale);
 protected:
+  // Node interface
+  void ComputeBounds(Bounds& aBounds) const override;
+
   struct State;
   Transform(State& aState, CreationContextPtr& aContext);
   ~Transform();
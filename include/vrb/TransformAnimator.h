@@ -0,0 +1,52 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TRANSFORM_ANIMATOR_DOT_H
+#define VRB_TRANSFORM_ANIMATOR_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+namespace vrb {
+
+// Samples the animations of every playing AnimatedTransform in one pass,
+// instead of one Updatable call per transform. Animation parameters are kept
+// in flat arrays grouped by kind, rebuilt when an animation is added, removed,
+// played or stopped. The joint palettes of every Skeleton are rebuilt once
+// the transforms are set. Updated by RenderContext::Update.
+class TransformAnimator {
+public:
+  static TransformAnimatorPtr Create();
+
+  // With a JobSystem, frames with many playing transforms sample them on
+  // its worker threads. The transforms are always set on the calling thread.
+  void SetJobSystem(const JobSystemPtr& aJobs);
+  int32_t GetPlayingCount() const;
+  // Timestamp of the last Update, which every playing transform was sampled at.
+  double GetTimestamp() const;
+  void Update(const double aTimestamp);
+
+  // Internal interface, used by AnimatedTransform on the render thread.
+  void Add(AnimatedTransform& aTransform);
+  void Remove(AnimatedTransform& aTransform);
+  void Invalidate();
+  // Used by Skeleton on the render thread.
+  void AddSkeleton(Skeleton& aSkeleton);
+  void RemoveSkeleton(Skeleton& aSkeleton);
+
+protected:
+  struct State;
+  TransformAnimator(State& aState);
+  ~TransformAnimator();
+
+private:
+  State& m;
+  TransformAnimator() = delete;
+  VRB_NO_DEFAULTS(TransformAnimator)
+};
+
+} // namespace vrb
+
+#endif // VRB_TRANSFORM_ANIMATOR_DOT_H
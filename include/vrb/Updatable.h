@@ -19,6 +19,16 @@ protected:
   Updatable(State& aState, CreationContextPtr& aContext);
   Updatable(State& aState);
   virtual ~Updatable();
+  // Stops the UpdateResource() calls until Wake(). Only called from
+  // UpdateResource() itself, with the context it was given.
+  void Sleep(RenderContext& aContext);
+  // Same as Sleep(), and also woken by the first update at or after the
+  // RenderContext timestamp aTimestamp.
+  void SleepUntil(RenderContext& aContext, const double aTimestamp);
+  // Resumes the calls from the next update. Must be called on the render
+  // thread, does nothing unless asleep.
+  void Wake();
+  bool IsSleeping() const;
 private:
   State& m;
   Updatable() = delete;
@@ -20,15 +20,15 @@ public:
   static const Vector& Zero();
   static const Vector& Min();
   static const Vector& Max();
-  Vector() {}
-  Vector(const float aX, const float aY, const float aZ) : m(aX, aY, aZ) {}
-  Vector(const Vector& aValue) : m(aValue.m) {}
+  constexpr Vector() {}
+  constexpr Vector(const float aX, const float aY, const float aZ) : m(aX, aY, aZ) {}
+  constexpr Vector(const Vector& aValue) : m(aValue.m) {}
   float& x() { return m.mX; }
   float& y() { return m.mY; }
   float& z() { return m.mZ; }
-  float x() const { return m.mX; }
-  float y() const { return m.mY; }
-  float z() const { return m.mZ; }
+  constexpr float x() const { return m.mX; }
+  constexpr float y() const { return m.mY; }
+  constexpr float z() const { return m.mZ; }
   Vector& Set(const float aX, const float aY, const float aZ) {
     m.mX = aX;
     m.mY = aY;
@@ -169,9 +169,9 @@ protected:
     struct {
       float mX, mY, mZ;
     };
-    Data() : mX(0.0f), mY(0.0f), mZ(0.0f) {}
-    Data(const float aX, const float aY, const float aZ) : mX(aX), mY(aY), mZ(aZ) {}
-    Data(const Data& aData) : mX(aData.mX), mY(aData.mY), mZ(aData.mZ) {}
+    constexpr Data() : mX(0.0f), mY(0.0f), mZ(0.0f) {}
+    constexpr Data(const float aX, const float aY, const float aZ) : mX(aX), mY(aY), mZ(aZ) {}
+    constexpr Data(const Data& aData) : mX(aData.mX), mY(aData.mY), mZ(aData.mZ) {}
     Data& operator=(const Data& aData) {
       mX = aData.mX;
       mY = aData.mY;
@@ -0,0 +1,40 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_VECTOR4_DOT_H
+#define VRB_VECTOR4_DOT_H
+
+#include "vrb/Vector.h"
+
+namespace vrb {
+
+// Four floats on a 16 byte boundary, so the SIMD kernels of BatchMath.h load
+// and store each one whole. Points have w set to one and directions zero.
+// Arrays of them must come from an aligned allocator, see
+// VertexArray::GetPaddedVertices().
+class alignas(16) Vector4 {
+public:
+  Vector4() : mV{0.0f, 0.0f, 0.0f, 0.0f} {}
+  Vector4(const float aX, const float aY, const float aZ, const float aW) : mV{aX, aY, aZ, aW} {}
+  Vector4(const Vector& aVector, const float aW) : mV{aVector.x(), aVector.y(), aVector.z(), aW} {}
+
+  float x() const { return mV[0]; }
+  float y() const { return mV[1]; }
+  float z() const { return mV[2]; }
+  float w() const { return mV[3]; }
+  Vector ToVector() const { return Vector(mV[0], mV[1], mV[2]); }
+
+  float* Data() { return mV; }
+  const float* Data() const { return mV; }
+
+private:
+  float mV[4];
+};
+
+static_assert(sizeof(Vector4) == 16, "Vector4 must be four packed floats");
+
+} // namespace vrb
+
+#endif // VRB_VECTOR4_DOT_H
@@ -19,6 +19,7 @@ public:
   int GetNormalCount() const;
   int GetUVCount() const;
   int GetColorCount() const;
+  int GetSkinCount() const;
 
   void SetNormalCount(const int aCount);
 
@@ -29,19 +30,49 @@ public:
   const Vector& GetNormal(const int aIndex) const;
   const Vector& GetUV(const int aIndex) const;
   const Color& GetColor(const int aIndex) const;
+  // Four joint indices and their weights, indexed like the vertices.
+  const float* GetJoints(const int aIndex) const;
+  const float* GetWeights(const int aIndex) const;
+  // Vertices packed as consecutive xyz floats, for use with BatchMath.
+  const float* GetVertexData() const;
+  // Keeps a 16 byte aligned xyzw copy of the vertices, w set to one, for the
+  // full width Vector4 kernels of BatchMath. It costs a third more memory
+  // than the vertices and is refreshed from the first changed vertex when
+  // read. Disabled by default.
+  void SetPaddedStorage(const bool aEnabled);
+  bool IsPaddedStorage() const;
+  // Indexed like the vertices, nullptr unless padded storage is enabled.
+  const Vector4* GetPaddedVertices() const;
 
   void SetVertex(const int aIndex, const Vector& aPoint);
   void SetNormal(const int aIndex, const Vector& aNormal);
   void SetUV(const int aIndex, const Vector& aUV);
   void SetColor(const int aIndex, const Color& aColor);
+  void SetSkin(const int aIndex, const float* aJoints, const float* aWeights);
 
   int AppendVertex(const Vector& aPoint);
   int AppendNormal(const Vector& aNormal);
   int AppendUV(const Vector& aUV);
   int AppendColor(const Color& aUV);
+  // aJoints and aWeights hold four values each. Unused joints have a zero weight.
+  int AppendSkin(const float* aJoints, const float* aWeights);
+  // Append aCount entries whose first three floats are aStride floats apart.
+  void AppendVertices(const float* aPoints, const size_t aCount, const size_t aStride);
+  void AppendNormals(const float* aNormals, const size_t aCount, const size_t aStride);
+  void AppendUVs(const float* aUVs, const size_t aCount, const size_t aStride);
 
   void AddNormal(const int aIndex, const Vector& aNormal);
 
+  // Every setter and append records the entries it touched so that a dynamic
+  // Geometry uploads only the vertices using them, see Geometry::SetDynamic.
+  // Colors and skins are indexed like the vertices. Ranges grow to cover
+  // every change until cleared by the Geometry after its upload.
+  enum class Attribute { Vertex, Normal, UV, Color, Skin };
+  bool IsDirty() const;
+  // aEnd is one past the last changed entry. Returns false if unchanged.
+  bool GetDirtyRange(const Attribute aAttribute, int& aFirst, int& aEnd) const;
+  void ClearDirty();
+
 protected:
   struct State;
   VertexArray(State& aState, CreationContextPtr& aContext);
@@ -0,0 +1,84 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_WORLD_STREAMER_DOT_H
+#define VRB_WORLD_STREAMER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/LoaderThread.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Updatable.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vrb {
+
+// Streams a world divided into square cells on the XZ plane, so only the
+// part around the camera is in memory. Each cell has a LoadTask, run on the
+// LoaderThread once the camera comes within the load radius of the cell
+// center, nearest cells first. Cells ahead of the camera, where its smoothed
+// velocity takes it within the prefetch time, are loaded as well after the
+// cells around it. Cells beyond the unload radius are passed to
+// RenderContext::Dispose() and queued loads of them are cancelled. With a
+// memory budget the farthest cells are unloaded, or not loaded, to keep the
+// loaded cells within it. Loaded cells are added to GetRoot(), which must
+// not be transformed. Must be used on the render thread.
+class WorldStreamer : protected Updatable {
+public:
+  static WorldStreamerPtr Create(RenderContextPtr& aContext);
+  // Group the loaded cells are added to, to be added to the scene.
+  GroupPtr GetRoot() const;
+  // Both are held weakly and nothing is loaded without them. The viewer
+  // position is the camera transform translation.
+  void SetLoaderThread(const LoaderThreadPtr& aLoader);
+  void SetCamera(const CameraPtr& aCamera);
+  // Length of a cell side. Cell (x, z) spans [x, x + 1) * aSize on X and
+  // [z, z + 1) * aSize on Z. Must be set before cells are added. Defaults to
+  // 64.
+  void SetCellSize(const float aSize);
+  float GetCellSize() const;
+  // Distances from the viewer to the cell centers within which cells are
+  // loaded and beyond which they are unloaded. The unload radius is raised
+  // to the load radius and the gap keeps cells on the edge from being
+  // loaded and unloaded over and over. Default to 128 and 160.
+  void SetRadii(const float aLoadRadius, const float aUnloadRadius);
+  // Seconds of the current velocity the viewer is looked ahead for
+  // prefetching, zero disables it. The look ahead is limited to the load
+  // radius. Defaults to 2.
+  void SetPrefetchTime(const float aSeconds);
+  // Bytes the loaded and loading cells may add up to, zero, the default,
+  // for no limit.
+  void SetMemoryBudget(const size_t aBytes);
+  // Loads queued on the LoaderThread at once, at least one, so far cells do
+  // not hold back nearer ones found later. Defaults to 2.
+  void SetMaxPendingLoads(const int32_t aCount);
+  // Adds or replaces cell (aX, aZ). aBytes is the memory the cell takes once
+  // loaded. Zero measures the vertex and index buffers of the loaded nodes,
+  // textures are not counted, and counts nothing until the cell is loaded.
+  void AddCell(const int32_t aX, const int32_t aZ, const LoadTask& aTask, const size_t aBytes);
+  // Unloads cell (aX, aZ) and forgets it.
+  void RemoveCell(const int32_t aX, const int32_t aZ);
+  bool IsCellLoaded(const int32_t aX, const int32_t aZ) const;
+  int32_t GetLoadedCount() const;
+  int32_t GetPendingCount() const;
+  // Bytes of the loaded cells, see AddCell().
+  size_t GetLoadedBytes() const;
+protected:
+  struct State;
+  WorldStreamer(State& aState, RenderContextPtr& aContext);
+  ~WorldStreamer();
+
+  // Updatable interface
+  void UpdateResource(RenderContext& aContext) override;
+private:
+  State& m;
+  WorldStreamer() = delete;
+  VRB_NO_DEFAULTS(WorldStreamer)
+};
+
+} // namespace vrb
+
+#endif // VRB_WORLD_STREAMER_DOT_H
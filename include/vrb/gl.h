@@ -39,4 +39,104 @@ typedef void (GL_APIENTRY* PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC) (GLenum targ
 typedef void (GL_APIENTRY* PFNGLFRAMEBUFFERTEXTUREMULTISAMPLEMULTIVIEWOVRPROC)(GLenum target, GLenum attachment, GLuint texture, GLint level, GLsizei samples, GLint baseViewIndex, GLsizei numViews);
 #endif
 
+#if !defined(GL_KHR_parallel_shader_compile)
+static const int GL_COMPLETION_STATUS_KHR = 0x91B1;
+typedef void (GL_APIENTRY* PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) (GLuint count);
+#endif
+
+#if !defined(GL_EXT_disjoint_timer_query)
+static const int GL_QUERY_RESULT_EXT           = 0x8866;
+static const int GL_QUERY_RESULT_AVAILABLE_EXT = 0x8867;
+static const int GL_TIMESTAMP_EXT              = 0x8E28;
+static const int GL_GPU_DISJOINT_EXT           = 0x8FBB;
+typedef void (GL_APIENTRY* PFNGLGENQUERIESEXTPROC) (GLsizei n, GLuint *ids);
+typedef void (GL_APIENTRY* PFNGLDELETEQUERIESEXTPROC) (GLsizei n, const GLuint *ids);
+typedef void (GL_APIENTRY* PFNGLQUERYCOUNTEREXTPROC) (GLuint id, GLenum target);
+typedef void (GL_APIENTRY* PFNGLGETQUERYOBJECTIVEXTPROC) (GLuint id, GLenum pname, GLint *params);
+typedef void (GL_APIENTRY* PFNGLGETQUERYOBJECTUI64VEXTPROC) (GLuint id, GLenum pname, GLuint64 *params);
+#endif
+
+#if !defined(GL_DEBUG_OUTPUT_KHR)
+static const int GL_DEBUG_OUTPUT_KHR         = 0x92E0;
+static const int GL_DEBUG_TYPE_ERROR_KHR     = 0x824C;
+static const int GL_DEBUG_SEVERITY_HIGH_KHR  = 0x9146;
+typedef void (GL_APIENTRY* GLDEBUGPROCKHR) (GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void *userParam);
+typedef void (GL_APIENTRY* PFNGLDEBUGMESSAGECALLBACKKHRPROC) (GLDEBUGPROCKHR callback, const void *userParam);
+#endif
+
+#if !defined(GL_EXT_buffer_storage)
+static const int GL_MAP_PERSISTENT_BIT_EXT = 0x0040;
+static const int GL_MAP_COHERENT_BIT_EXT   = 0x0080;
+typedef void (GL_APIENTRY* PFNGLBUFFERSTORAGEEXTPROC) (GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+#endif
+
+#if !defined(GL_EXT_multi_draw_arrays)
+typedef void (GL_APIENTRY* PFNGLMULTIDRAWELEMENTSEXTPROC) (GLenum mode, const GLsizei *count, GLenum type, const void *const *indices, GLsizei primcount);
+#endif
+
+#if !defined(GL_COMPUTE_SHADER)
+static const int GL_COMPUTE_SHADER                  = 0x91B9;
+static const int GL_SHADER_STORAGE_BUFFER           = 0x90D2;
+static const int GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT = 0x0001;
+static const int GL_COMMAND_BARRIER_BIT             = 0x0040;
+typedef void (GL_APIENTRY* PFNGLDISPATCHCOMPUTEPROC) (GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void (GL_APIENTRY* PFNGLMEMORYBARRIERPROC) (GLbitfield barriers);
+#endif
+
+#if !defined(GL_DRAW_INDIRECT_BUFFER)
+static const int GL_DRAW_INDIRECT_BUFFER = 0x8F3F;
+typedef void (GL_APIENTRY* PFNGLDRAWELEMENTSINDIRECTPROC) (GLenum mode, GLenum type, const void *indirect);
+#endif
+
+#if !defined(GL_QCOM_texture_foveated)
+static const int GL_FOVEATION_ENABLE_BIT_QCOM                     = 0x0001;
+static const int GL_FOVEATION_SCALED_BIN_METHOD_BIT_QCOM          = 0x0002;
+static const int GL_TEXTURE_FOVEATED_FEATURE_BITS_QCOM            = 0x8BFB;
+static const int GL_TEXTURE_FOVEATED_MIN_PIXEL_DENSITY_QCOM       = 0x8BFC;
+static const int GL_TEXTURE_FOVEATED_FEATURE_QUERY_QCOM           = 0x8BFD;
+static const int GL_TEXTURE_FOVEATED_NUM_FOCAL_POINTS_QUERY_QCOM  = 0x8BFE;
+typedef void (GL_APIENTRY* PFNGLTEXTUREFOVEATIONPARAMETERSQCOMPROC) (GLuint texture, GLuint layer, GLuint focalPoint, GLfloat focalX, GLfloat focalY, GLfloat gainX, GLfloat gainY, GLfloat foveaArea);
+#endif
+
+#if !defined(GL_PRIMITIVE_RESTART_FIXED_INDEX)
+static const int GL_PRIMITIVE_RESTART_FIXED_INDEX = 0x8D69;
+#endif
+
+#if !defined(GL_EXT_texture_filter_anisotropic)
+static const int GL_TEXTURE_MAX_ANISOTROPY_EXT     = 0x84FE;
+static const int GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FF;
+#endif
+
+// Compressed texture formats read from texture files.
+#if !defined(GL_ETC1_RGB8_OES)
+static const int GL_ETC1_RGB8_OES = 0x8D64;
+#endif
+
+#if !defined(GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+static const int GL_COMPRESSED_RGB_S3TC_DXT1_EXT  = 0x83F0;
+static const int GL_COMPRESSED_RGBA_S3TC_DXT5_EXT = 0x83F3;
+#endif
+
+#if !defined(GL_COMPRESSED_R11_EAC)
+static const int GL_COMPRESSED_R11_EAC               = 0x9270;
+static const int GL_COMPRESSED_RGB8_ETC2             = 0x9274;
+static const int GL_COMPRESSED_RGBA8_ETC2_EAC        = 0x9278;
+static const int GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC = 0x9279;
+#endif
+
+#if !defined(GL_COMPRESSED_RGBA_ASTC_4x4_KHR)
+static const int GL_COMPRESSED_RGBA_ASTC_4x4_KHR           = 0x93B0;
+static const int GL_COMPRESSED_RGBA_ASTC_12x12_KHR         = 0x93BD;
+static const int GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR   = 0x93D0;
+static const int GL_COMPRESSED_SRGB8_ALPHA8_ASTC_12x12_KHR = 0x93DD;
+#endif
+
+#if !defined(GL_OES_EGL_image)
+typedef void (GL_APIENTRY* PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) (GLenum target, void* image);
+#endif
+
+#if defined(VRB_GL_DISPATCH)
+#  include "vrb/GLDispatch.h"
+#endif
+
 #endif //  VRB_GL_DOT_H
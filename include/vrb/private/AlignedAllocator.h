@@ -0,0 +1,51 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_ALIGNED_ALLOCATOR_DOT_H
+#define VRB_ALIGNED_ALLOCATOR_DOT_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace vrb {
+
+// std::allocator only honors alignof(max_align_t) before C++17, which is 8
+// on 32 bit Android. Containers of over aligned types use this one instead.
+template <typename T, size_t Alignment = alignof(T)>
+class AlignedAllocator {
+public:
+  typedef T value_type;
+  template <typename U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+  T* allocate(const size_t aCount) {
+    const size_t kAlignment = Alignment < sizeof(void*) ? sizeof(void*) : Alignment;
+    void* result = nullptr;
+    if (posix_memalign(&result, kAlignment, aCount * sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(result);
+  }
+
+  void deallocate(T* aPointer, const size_t) {
+    free(aPointer);
+  }
+};
+
+template <typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return true; }
+template <typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return false; }
+
+} // namespace vrb
+
+#endif // VRB_ALIGNED_ALLOCATOR_DOT_H
@@ -0,0 +1,58 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_ANIMATED_TRANSFORM_STATE_DOT_H
+#define VRB_ANIMATED_TRANSFORM_STATE_DOT_H
+
+#include "vrb/AnimatedTransform.h"
+#include "vrb/private/TransformState.h"
+#include "vrb/private/UpdatableState.h"
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <vector>
+
+namespace vrb {
+
+struct AnimatedTransform::State : public Transform::State, Updatable::State {
+  // Plain description of an animation, sampled by TransformAnimator.
+  struct Sampler {
+    enum class Kind { Static, Rotation, Translation, Keyframe };
+    Kind kind;
+    // Normalized rotation axis or direction of travel.
+    Vector axis;
+    // Angular velocity in radians or speed per second.
+    float rate;
+    Matrix value;
+    KeyframeTrackPtr track = nullptr;
+    // Keyframe tracks restart after their last key when set.
+    bool loop = false;
+  };
+  AnimationState state = AnimationState::Stop;
+  Matrix startTransform;
+  Matrix currentAnimationTransform;
+  double startTime = -1.0;
+  // Set from the animator when the animation stops.
+  double lastAnimationTime = -1.0;
+  float previousDeltaTime = 0.0;
+  std::vector<Sampler> samplers;
+  // Set once the transform is animated by the TransformAnimator of the
+  // RenderContext, see AnimatedTransform::UpdateResource.
+  TransformAnimatorWeak animator;
+  // Index in the animator, -1 when not added.
+  int32_t animatorSlot = -1;
+  void Reset() {
+    state = AnimationState::Stop;
+    currentAnimationTransform.SetIdentity();
+    startTime = -1.0;
+    lastAnimationTime = -1.0;
+    previousDeltaTime = 0.0;
+  }
+  void Changed();
+};
+
+} // namespace vrb
+
+#endif // VRB_ANIMATED_TRANSFORM_STATE_DOT_H
@@ -0,0 +1,107 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_ASSET_TABLE_DOT_H
+#define VRB_ASSET_TABLE_DOT_H
+
+#include "vrb/AssetID.h"
+#include "vrb/MacroUtils.h"
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+namespace vrb {
+
+// Shared pointers indexed by AssetID. Pages of slots are allocated as IDs
+// are first set and never freed until the table is destroyed, so Find()
+// only does atomic loads and may run concurrently with Set() on any thread.
+template<typename T>
+class AssetTable {
+public:
+  static const size_t kPageBits = 8;
+  static const size_t kPageSize = size_t(1) << kPageBits;
+  // Covers about a million IDs.
+  static const size_t kMaxPages = 4096;
+
+  AssetTable() {
+    for (std::atomic<Page*>& page: mPages) {
+      page.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+  ~AssetTable() {
+    for (std::atomic<Page*>& page: mPages) {
+      delete page.load(std::memory_order_relaxed);
+    }
+  }
+
+  std::shared_ptr<T> Find(const AssetID aID) const {
+    const size_t kPage = aID >> kPageBits;
+    if (kPage >= kMaxPages) {
+      return nullptr;
+    }
+    const Page* page = mPages[kPage].load(std::memory_order_acquire);
+    return page ? std::atomic_load(&page->slots[aID & (kPageSize - 1)]) : nullptr;
+  }
+
+  // Returns false if aID is outside the table.
+  bool Set(const AssetID aID, const std::shared_ptr<T>& aValue) {
+    const size_t kPage = aID >> kPageBits;
+    if ((aID == kInvalidAssetID) || (kPage >= kMaxPages)) {
+      return false;
+    }
+    Page* page = mPages[kPage].load(std::memory_order_acquire);
+    if (!page) {
+      Page* created = new Page;
+      if (mPages[kPage].compare_exchange_strong(page, created, std::memory_order_acq_rel)) {
+        page = created;
+      } else {
+        delete created;
+      }
+    }
+    std::atomic_store(&page->slots[aID & (kPageSize - 1)], aValue);
+    return true;
+  }
+
+  // Calls aCallback with the ID and value of every set slot.
+  template<typename Callback>
+  void ForEach(const Callback& aCallback) const {
+    for (size_t ix = 0; ix < kMaxPages; ix++) {
+      const Page* page = mPages[ix].load(std::memory_order_acquire);
+      if (!page) {
+        continue;
+      }
+      for (size_t slot = 0; slot < kPageSize; slot++) {
+        std::shared_ptr<T> value = std::atomic_load(&page->slots[slot]);
+        if (value) {
+          aCallback((AssetID)((ix << kPageBits) | slot), value);
+        }
+      }
+    }
+  }
+
+  void Clear() {
+    for (std::atomic<Page*>& entry: mPages) {
+      Page* page = entry.load(std::memory_order_acquire);
+      if (!page) {
+        continue;
+      }
+      for (std::shared_ptr<T>& slot: page->slots) {
+        std::atomic_store(&slot, std::shared_ptr<T>());
+      }
+    }
+  }
+
+private:
+  struct Page {
+    std::shared_ptr<T> slots[kPageSize];
+  };
+  std::atomic<Page*> mPages[kMaxPages];
+  VRB_NO_DEFAULTS(AssetTable)
+};
+
+} // namespace vrb
+
+#endif // VRB_ASSET_TABLE_DOT_H
@@ -0,0 +1,129 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_CACHE_FILE_DOT_H
+#define VRB_CACHE_FILE_DOT_H
+
+#include "vrb/MacroUtils.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace vrb {
+
+// Helpers shared by the on disk caches. Entries are written in the byte
+// order of the device and rejected by their magic and version when stale.
+
+const uint64_t kCacheFileHashSeed = 0xcbf29ce484222325ull;
+
+// FNV-1a, used so cache file names are stable across builds. Pass the
+// previous result as aHash to hash several values.
+inline uint64_t
+CacheFileHash(const std::string& aValue, uint64_t aHash = kCacheFileHashSeed) {
+  for (const char value: aValue) {
+    aHash ^= (uint8_t)value;
+    aHash *= 0x100000001b3ull;
+  }
+  return aHash;
+}
+
+// Builds an entry, or part of one, in memory.
+class CacheFileWriter {
+public:
+  CacheFileWriter() {}
+  void Put(const void* aData, const size_t aSize) {
+    const uint8_t* data = static_cast<const uint8_t*>(aData);
+    mBuffer.insert(mBuffer.end(), data, data + aSize);
+  }
+  void PutU8(const uint8_t aValue) { mBuffer.push_back(aValue); }
+  void PutU32(const uint32_t aValue) { Put(&aValue, sizeof(aValue)); }
+  void PutI32(const int32_t aValue) { Put(&aValue, sizeof(aValue)); }
+  void PutU64(const uint64_t aValue) { Put(&aValue, sizeof(aValue)); }
+  void PutI64(const int64_t aValue) { Put(&aValue, sizeof(aValue)); }
+  void PutFloat(const float aValue) { Put(&aValue, sizeof(aValue)); }
+  void PutString(const std::string& aValue) {
+    PutU32((uint32_t)aValue.size());
+    Put(aValue.data(), aValue.size());
+  }
+  const std::vector<uint8_t>& Buffer() const { return mBuffer; }
+  void Clear() { mBuffer.clear(); }
+private:
+  std::vector<uint8_t> mBuffer;
+};
+
+// Reads an entry in place. Reading past the end returns zeros and marks the
+// reader invalid, so callers check IsValid() once after a group of reads.
+class CacheFileReader {
+public:
+  CacheFileReader(const char* aData, const size_t aSize) : mPlace(aData), mEnd(aData + aSize), mValid(true) {}
+  bool Get(void* aData, const size_t aSize) {
+    if (!mValid || ((size_t)(mEnd - mPlace) < aSize)) {
+      mValid = false;
+      memset(aData, 0, aSize);
+      return false;
+    }
+    memcpy(aData, mPlace, aSize);
+    mPlace += aSize;
+    return true;
+  }
+  uint8_t GetU8() { uint8_t value = 0; Get(&value, sizeof(value)); return value; }
+  uint32_t GetU32() { uint32_t value = 0; Get(&value, sizeof(value)); return value; }
+  int32_t GetI32() { int32_t value = 0; Get(&value, sizeof(value)); return value; }
+  uint64_t GetU64() { uint64_t value = 0; Get(&value, sizeof(value)); return value; }
+  int64_t GetI64() { int64_t value = 0; Get(&value, sizeof(value)); return value; }
+  float GetFloat() { float value = 0.0f; Get(&value, sizeof(value)); return value; }
+  std::string GetString() {
+    const uint32_t length = GetU32();
+    const char* data = Skip(length);
+    return data ? std::string(data, length) : std::string();
+  }
+  // Returns the next aSize bytes in place.
+  const char* Skip(const uint64_t aSize) {
+    if (!mValid || ((uint64_t)(mEnd - mPlace) < aSize)) {
+      mValid = false;
+      return nullptr;
+    }
+    const char* result = mPlace;
+    mPlace += aSize;
+    return result;
+  }
+  bool AtEnd() const { return mPlace == mEnd; }
+  bool IsValid() const { return mValid; }
+private:
+  const char* mPlace;
+  const char* mEnd;
+  bool mValid;
+};
+
+// Writes an entry to a temporary file next to aPath and renames it over
+// aPath in Commit(), so a partially written entry is never read. The
+// temporary name is unique, so threads may write the same entry at once.
+// The temporary file is removed if the output is destroyed before Commit().
+// aKind names the entry in warnings, such as "texture cache".
+class CacheFileOutput {
+public:
+  CacheFileOutput(const std::string& aPath, const char* aKind);
+  ~CacheFileOutput();
+  bool IsOpen() const;
+  void Write(const void* aData, const size_t aSize);
+  void Write(const CacheFileWriter& aWriter);
+  // Returns false if any write failed or the rename did not happen.
+  bool Commit();
+private:
+  std::string mPath;
+  std::string mTemporary;
+  const char* mKind;
+  std::ofstream mOutput;
+  bool mCommitted;
+  CacheFileOutput() = delete;
+  VRB_NO_DEFAULTS(CacheFileOutput)
+};
+
+} // namespace vrb
+
+#endif // VRB_CACHE_FILE_DOT_H
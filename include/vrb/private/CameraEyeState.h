@@ -8,6 +8,7 @@
 
 #include "vrb/CameraEye.h"
 
+#include "vrb/Frustum.h"
 #include "vrb/Matrix.h"
 
 namespace vrb {
@@ -22,6 +23,9 @@ struct CameraEye::State {
   Matrix transform;
   // calculated from (headTransform * eyeTransform).Inverse()
   Matrix view;
+  // calculated from perspective * view
+  Matrix viewProjection;
+  Frustum frustum;
 
   State();
   void Update();
@@ -8,6 +8,7 @@
 
 #include "vrb/CameraSimple.h"
 
+#include "vrb/Frustum.h"
 #include "vrb/Matrix.h"
 
 namespace vrb {
@@ -22,9 +23,12 @@ struct CameraSimple::State {
   Matrix transform;
   Matrix view;
   Matrix perspective;
+  Matrix viewProjection;
+  Frustum frustum;
 
   State();
   void UpdatePerspective();
+  void UpdateViewProjection();
 };
 
 } // namespace vrb
@@ -0,0 +1,33 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_CLOCK_DOT_H
+#define VRB_CLOCK_DOT_H
+
+#include <stdint.h>
+#include <time.h>
+
+namespace vrb {
+
+// The monotonic clock behind every timer of the library, including
+// RenderContext::GetTimestamp() and TraceGetTime(), so their times compare.
+// Both return zero if the clock can not be read.
+inline uint64_t
+GetMonotonicNanoseconds() {
+  timespec spec = {};
+  if (clock_gettime(CLOCK_MONOTONIC, &spec) != 0) {
+    return 0;
+  }
+  return ((uint64_t)spec.tv_sec * 1000000000ull) + (uint64_t)spec.tv_nsec;
+}
+
+inline double
+GetMonotonicSeconds() {
+  return (double)GetMonotonicNanoseconds() * 1.0e-9;
+}
+
+} // namespace vrb
+
+#endif // VRB_CLOCK_DOT_H
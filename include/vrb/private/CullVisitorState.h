@@ -7,23 +7,37 @@
 #define VRB_CULL_VISITOR_STATE_DOT_H
 
 #include "vrb/CullVisitor.h"
+#include "vrb/Frustum.h"
 #include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <vector>
 
 namespace vrb {
 
 struct CullVisitor::State {
-  struct TransformNode {
-    TransformNode* prev;
-    Matrix transform;
-    TransformNode() : prev(nullptr), transform(Matrix::Identity()) {}
-  };
-
   const Matrix identity;
-  TransformNode* transformList;
-
-  State() : identity(Matrix::Identity()), transformList(nullptr) {}
-  ~State() { Reset(); }
-  void Reset();
+  // Accumulated transforms. Entries past depth are kept so the storage is
+  // reused by the next cull pass instead of being reallocated.
+  std::vector<Matrix> transforms;
+  size_t depth;
+  Frustum frustum;
+  bool frustumEnabled;
+  Vector eye;
+  // Cotangent of half the vertical field of view.
+  float projectionScale;
+  bool cameraEnabled;
+  OcclusionCullerPtr occlusion;
+
+  State()
+      : identity(Matrix::Identity())
+      , depth(0)
+      , frustumEnabled(false)
+      , projectionScale(1.0f)
+      , cameraEnabled(false) {
+    transforms.reserve(16);
+  }
+  const Matrix& Current() const { return depth > 0 ? transforms[depth - 1] : identity; }
 };
 
 } // namespace vrb
@@ -9,49 +9,141 @@
 #include "vrb/DrawableList.h"
 #include "vrb/Color.h"
 #include "vrb/Light.h"
+#include "vrb/LightBlock.h"
 #include "vrb/Matrix.h"
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 namespace vrb {
 
 struct DrawableList::State {
+  // Hands out objects from fixed size blocks. Reset() recycles every object
+  // at once and keeps the blocks so a steady state frame does not allocate.
+  template<typename T>
+  struct FramePool {
+    static const size_t kBlockSize = 256;
+    std::vector<std::unique_ptr<T[]>> blocks;
+    size_t count = 0;
+
+    T* Allocate() {
+      const size_t block = count / kBlockSize;
+      if (block == blocks.size()) {
+        blocks.emplace_back(new T[kBlockSize]);
+      }
+      T* result = &blocks[block][count % kBlockSize];
+      count++;
+      return result;
+    }
+    void Reset() { count = 0; }
+  };
+
   struct LightSnapshot {
     LightSnapshot* next;
-    LightSnapshot* masterNext;
-    const uint32_t id;
-    const int depth;
-    const Vector direction;
-    const Color ambient;
-    const Color diffuse;
-    const Color specular;
-    LightSnapshot(const uint32_t aId, const int aDepth, const Light& aLight)
-      : next(nullptr)
-      , masterNext(nullptr)
-      , id(aId)
-      , depth(aDepth)
-      , direction(aLight.GetDirection())
-      , ambient(aLight.GetAmbientColor())
-      , diffuse(aLight.GetDiffuseColor())
-      , specular(aLight.GetSpecularColor()) {}
-    ~LightSnapshot() {}
+    uint32_t id;
+    int depth;
+    // Every light from this one to the end of the list.
+    LightBlockPtr block;
+    LightSnapshot() : next(nullptr), id(0), depth(0) {}
   };
+  // The Drawable is not owned. The scene graph keeps it alive for the frame.
+  // Nodes added by AddSegment or AddRecording have no drawable and draw the
+  // segment instead. Recordings outlive the list and are not reset with it.
+  // The drawables of a segment added below a depth pre-pass have one too.
   struct DrawNode {
     DrawNode* next;
     LightSnapshot* lights;
-    DrawablePtr drawable;
+    Drawable* drawable;
+    State* segment;
+    bool recording;
+    bool depthPrePass;
     Matrix transform;
 
-    DrawNode() : next(nullptr), lights(nullptr) {}
+    DrawNode() : next(nullptr), lights(nullptr), drawable(nullptr), segment(nullptr), recording(false), depthPrePass(false) {}
+  };
+
+  struct SortEntry {
+    uint64_t key;
+    const void* instancingKey;
+    const void* batchKey;
+    DrawNode* node;
+    // Opaque drawable drawn by the depth pre-pass.
+    bool depthPrePass;
   };
 
   DrawNode* drawables;
   LightSnapshot* currentLights;
-  LightSnapshot* lights;
+  FramePool<DrawNode> drawNodePool;
+  FramePool<LightSnapshot> lightPool;
   uint32_t idCount;
   int depth;
+  // Nesting of PushDepthPrePass.
+  int depthPrePass;
+  // Entries of sortList drawn by the depth pre-pass.
+  size_t depthPrePassCount;
+  // Depth state of the context during a pass, see SetDepthEqual().
+  uint32_t depthFunc;
+  bool depthWrite;
+  bool depthEqual;
+  bool colorWrite[4];
+  bool sortingEnabled;
+  // References taken by AddDrawable when retaining, released by Reset.
+  bool retainDrawables;
+  std::vector<DrawablePtr> retained;
+  // Light block current when BeginRecording was called.
+  LightBlockPtr recordedLights;
+  // Interned light blocks keyed by hash. They outlive the frame so render
+  // states drawn under unchanged lights keep their block between frames.
+  std::unordered_map<uint64_t, LightBlockPtr> lightBlocks;
+  std::vector<SortEntry> sortList;
+  std::vector<Matrix> instanceTransforms;
+  std::vector<Drawable*> batch;
 
-  State() : drawables(nullptr), currentLights(nullptr), lights(nullptr), idCount(0), depth(0) {}
-  ~State() { Reset(); }
+  State()
+      : drawables(nullptr)
+      , currentLights(nullptr)
+      , idCount(0)
+      , depth(0)
+      , depthPrePass(0)
+      , depthPrePassCount(0)
+      , depthFunc(0)
+      , depthWrite(true)
+      , depthEqual(false)
+      , colorWrite{true, true, true, true}
+      , sortingEnabled(true)
+      , retainDrawables(false)
+  {}
   void Reset();
+  // Takes a reference to every drawable of aList, including its segments.
+  void RetainAll(const State& aList);
+  LightBlockPtr InternLights(const Light& aLight, const LightBlockPtr& aParent);
+  void ApplyLights(DrawNode& aNode);
+  void DrawNodeWithLights(DrawNode& aNode, const Camera& aCamera);
+  // Sorts the entries of sortList from aStart, the ones before it are
+  // separated by a barrier.
+  void SortFrom(const size_t aStart);
+  // Fills sortList with every drawable in draw order, sorted by their keys
+  // between barriers. aCamera is used for the depth of the keys.
+  void BuildSortList(const Camera& aCamera);
+  // Draws the depth pre-pass, when there is one, then every entry.
+  void DrawSorted(const Camera& aCamera);
+  // Draws the entries of sortList, only the pre-passed ones with aDepthOnly.
+  void DrawSortedEntries(const Camera& aCamera, const bool aDepthOnly);
+  // Same as DrawSorted without sorting.
+  void DrawUnsorted(const Camera& aCamera);
+  // Walks aNode and the nodes after it, descending into segments in place.
+  // aDepthPrePass is set for the nodes of a segment below a pre-pass.
+  void DrawUnsortedNodes(DrawNode* aNode, const Camera& aCamera, const bool aDepthPrePass, const bool aDepthOnly);
+  bool HasDepthPrePass(const DrawNode* aNode, const bool aDepthPrePass) const;
+  void CollectSorted(DrawNode* aNode, const Camera& aCamera, size_t& aStart, const bool aDepthPrePass);
+  // Saves the depth state of the context and disables the color writes.
+  void BeginDepthPrePass();
+  void EndDepthPrePass();
+  // Switches the color pass between the saved depth state and GL_EQUAL
+  // without depth writes for the drawables of the pre-pass.
+  void SetDepthEqual(const bool aEqual);
+  void EndColorPass();
 };
 
 }
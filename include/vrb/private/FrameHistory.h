@@ -0,0 +1,79 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_FRAME_HISTORY_DOT_H
+#define VRB_FRAME_HISTORY_DOT_H
+
+#include "vrb/MacroUtils.h"
+
+#include <algorithm>
+#include <array>
+#include <stddef.h>
+#include <vector>
+
+namespace vrb {
+
+// Fixed size ring of per frame deltas in seconds. Pushing never allocates.
+// Only used from the render thread, so no locking is needed.
+class FrameHistory {
+public:
+  // About 17 seconds at 120Hz.
+  static const size_t kCapacity = 2048;
+
+  struct Window {
+    size_t frames = 0;
+    double total = 0.0;
+  };
+
+  FrameHistory() : mHead(0), mSize(0) {}
+  void Push(const double aDelta) {
+    mDeltas[mHead] = (float)aDelta;
+    mHead = (mHead + 1) % kCapacity;
+    if (mSize < kCapacity) {
+      mSize++;
+    }
+  }
+  void Clear() {
+    mHead = 0;
+    mSize = 0;
+  }
+  size_t GetSize() const {
+    return mSize;
+  }
+  // Newest first, aIndex must be less than GetSize().
+  double Get(const size_t aIndex) const {
+    return mDeltas[(mHead + kCapacity - 1 - aIndex) % kCapacity];
+  }
+  // Number of the most recent frames that fit in aSeconds.
+  Window GetWindow(const double aSeconds) const {
+    Window result;
+    for (size_t ix = 0; ix < mSize; ix++) {
+      const double delta = Get(ix);
+      if ((result.frames > 0) && ((result.total + delta) > aSeconds)) {
+        break;
+      }
+      result.frames++;
+      result.total += delta;
+    }
+    return result;
+  }
+  // Copies the most recent aFrames deltas into aResult, reusing its storage.
+  void Copy(const size_t aFrames, std::vector<float>& aResult) const {
+    aResult.clear();
+    const size_t kCount = std::min(aFrames, mSize);
+    for (size_t ix = 0; ix < kCount; ix++) {
+      aResult.push_back((float)Get(ix));
+    }
+  }
+private:
+  std::array<float, kCapacity> mDeltas;
+  size_t mHead;
+  size_t mSize;
+  VRB_NO_DEFAULTS(FrameHistory)
+};
+
+} // namespace vrb
+
+#endif // VRB_FRAME_HISTORY_DOT_H
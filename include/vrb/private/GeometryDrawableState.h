@@ -11,8 +11,12 @@
 #include <vrb/Logger.h>
 #include "vrb/private/DrawableState.h"
 #include "vrb/private/NodeState.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/RenderBuffer.h"
 #include "vrb/RenderState.h"
+#include "vrb/Texture.h"
+
+#include <vector>
 
 namespace vrb {
 
@@ -22,12 +26,72 @@ struct GeometryDrawable::State : public Node::State, public Drawable::State {
 
   uint32_t rangeStart = 0;
   uint32_t rangeLength = 0;
+  // Start and length pairs added by AddRenderRange.
+  std::vector<uint32_t> ranges;
+
+  // The attribute layout recorded in the cached vertex array object. The
+  // VAO is rebuilt when the RenderState attribute locations or the
+  // RenderBuffer objects change.
+  struct VertexArrayKey {
+    GLuint vertexObject = 0;
+    GLuint indexObject = 0;
+    GLint position = -1;
+    GLint normal = -1;
+    GLint uv = -1;
+    GLint color = -1;
+    GLint instanceModel = -1;
+    GLint joint = -1;
+    GLint weight = -1;
+    bool operator==(const VertexArrayKey& aOther) const {
+      return (vertexObject == aOther.vertexObject) && (indexObject == aOther.indexObject) &&
+             (position == aOther.position) && (normal == aOther.normal) &&
+             (uv == aOther.uv) && (color == aOther.color) &&
+             (instanceModel == aOther.instanceModel) &&
+             (joint == aOther.joint) && (weight == aOther.weight);
+    }
+  };
+  GLuint vertexArrayObject = 0;
+  VertexArrayKey vertexArrayKey;
+  // Holds the per instance model matrices when the program is instanced
+  // and the StreamBuffer is full or unavailable.
+  GLuint instanceBuffer = 0;
+  StreamBufferPtr streamBuffer;
+  GLDeletionQueuePtr glDeletions;
+  GLExtensionsPtr glExtensions;
+  InstanceCullerPtr instanceCuller;
+  // Index counts and offsets of the ranges drawn by MultiDraw.
+  std::vector<GLsizei> drawCounts;
+  std::vector<const void*> drawOffsets;
+
+  ~State() {
+    glDeletions->DeleteVertexArray(vertexArrayObject);
+    glDeletions->DeleteBuffer(instanceBuffer);
+  }
+
+  bool UseInstancing() const;
+  void BindVertexArray();
+  void PointInstanceAttributes(const GLuint aBuffer, const size_t aOffset);
+  void DrawElements(const GLsizei aInstanceCount);
+  void DrawRange(const uint32_t aStart, const uint32_t aLength, const GLsizei aInstanceCount);
+  bool GetRange(const uint32_t aStart, const uint32_t aLength, GLsizei& aCount, size_t& aOffset) const;
+  void AppendRanges(std::vector<GLsizei>& aCounts, std::vector<const void*>& aOffsets) const;
+  // Draws every range of drawCounts and drawOffsets, with a single call when
+  // GL_EXT_multi_draw_arrays is supported.
+  void MultiDraw();
+  void DrawCulledInstances(const Camera& aCamera, const Matrix& aModelTransform);
+  void InvalidateVertexArray() {
+    vertexArrayKey = VertexArrayKey();
+  }
 
   bool UseTexture() const {
     if (!renderState || !renderBuffer) {
       return false;
     }
-    if (renderState->UVLength() != renderBuffer->UVLength()) {
+    // Texture arrays take the layer from the RenderState alone when the
+    // vertices have no third UV component.
+    const bool kLayerFromState = (renderBuffer->UVLength() == 2) && renderState->HasTexture() &&
+                                 (renderState->GetTexture()->GetTarget() == GL_TEXTURE_2D_ARRAY);
+    if ((renderState->UVLength() != renderBuffer->UVLength()) && !kLayerFromState) {
       //VRB_WARN("RenderState UVLength(%d) != RenderBuffer UVLength(%d)", renderState->UVLength(),
       //         renderBuffer->UVLength());
       return false;
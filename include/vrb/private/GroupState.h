@@ -7,25 +7,175 @@
 #define VRB_GROUP_STATE_DOT_H
 
 #include "vrb/Forward.h"
+#include "vrb/BoundingVolumeHierarchy.h"
+#include "vrb/Matrix.h"
 #include "vrb/private/NodeState.h"
+#include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 namespace vrb {
 
+// One bit per child slot, kept parallel to Group::State::children by the
+// Group operations. Slots past the stored words read as clear, so a Group
+// that never sets a bit stores nothing.
+class ChildBits {
+public:
+  bool Test(const uint32_t aSlot) const {
+    const size_t kWord = aSlot >> 6;
+    return (kWord < mWords.size()) && ((mWords[kWord] >> (aSlot & 63)) & 1) != 0;
+  }
+  // Returns true if the bit changed.
+  bool Set(const uint32_t aSlot, const bool aValue) {
+    const size_t kWord = aSlot >> 6;
+    const uint64_t kBit = uint64_t(1) << (aSlot & 63);
+    if (kWord >= mWords.size()) {
+      if (!aValue) {
+        return false;
+      }
+      mWords.resize(kWord + 1, 0);
+    }
+    const uint64_t kOld = mWords[kWord];
+    mWords[kWord] = aValue ? (kOld | kBit) : (kOld & ~kBit);
+    return mWords[kWord] != kOld;
+  }
+  uint64_t Word(const size_t aWord) const { return aWord < mWords.size() ? mWords[aWord] : 0; }
+  bool Any() const {
+    for (const uint64_t kWord: mWords) {
+      if (kWord) {
+        return true;
+      }
+    }
+    return false;
+  }
+  // Sets the first aCount bits and clears the others.
+  void Fill(const uint32_t aCount) {
+    mWords.assign((aCount + 63) >> 6, ~uint64_t(0));
+    if ((aCount & 63) != 0) {
+      mWords.back() = (uint64_t(1) << (aCount & 63)) - 1;
+    }
+  }
+  void Clear() { mWords.clear(); }
+  // A clear bit is opened at aSlot, the ones from it on move up one slot.
+  void Insert(const uint32_t aSlot) {
+    const size_t kWord = aSlot >> 6;
+    if (kWord >= mWords.size()) {
+      return;
+    }
+    if ((mWords.back() >> 63) != 0) {
+      mWords.push_back(0);
+    }
+    for (size_t ix = mWords.size() - 1; ix > kWord; ix--) {
+      mWords[ix] = (mWords[ix] << 1) | (mWords[ix - 1] >> 63);
+    }
+    const uint64_t kLow = (uint64_t(1) << (aSlot & 63)) - 1;
+    const uint64_t kValue = mWords[kWord];
+    mWords[kWord] = (kValue & kLow) | ((kValue & ~kLow) << 1);
+  }
+  // Drops the bit of aSlot, the ones after it move down one slot.
+  void Erase(const uint32_t aSlot) {
+    const size_t kWord = aSlot >> 6;
+    if (kWord >= mWords.size()) {
+      return;
+    }
+    const uint64_t kLow = (uint64_t(1) << (aSlot & 63)) - 1;
+    const uint64_t kValue = mWords[kWord];
+    // Shifted in two steps, by 64 is undefined for the last bit.
+    mWords[kWord] = (kValue & kLow) | (((kValue >> 1) >> (aSlot & 63)) << (aSlot & 63));
+    for (size_t ix = kWord; ix + 1 < mWords.size(); ix++) {
+      mWords[ix] |= mWords[ix + 1] << 63;
+      mWords[ix + 1] >>= 1;
+    }
+  }
+  // Clears every bit from aCount on.
+  void Truncate(const uint32_t aCount) {
+    const size_t kWords = (aCount + 63) >> 6;
+    if (kWords < mWords.size()) {
+      mWords.resize(kWords);
+    }
+    if (!mWords.empty() && ((aCount & 63) != 0) && (kWords == mWords.size())) {
+      mWords.back() &= (uint64_t(1) << (aCount & 63)) - 1;
+    }
+  }
+
+private:
+  std::vector<uint64_t> mWords;
+};
+
 class LambdaDrawable;
 typedef std::shared_ptr<LambdaDrawable> LambdaDrawablePtr;
 
 struct Group::State : public Node::State {
   std::vector<NodePtr> children;
+  // Last known slot of each child in children. Insertions and removals
+  // shift the slots after them, FindChild searches from the recorded one.
+  std::unordered_map<const Node*, uint32_t> childSlots;
   std::vector<LightPtr> lights;
   GroupWeak self;
   LambdaDrawablePtr preRenderLambda;
   LambdaDrawablePtr postRenderLambda;
+  // Children indexed by the hierarchy, and the unbounded ones always culled.
+  bool spatialIndexEnabled = false;
+  bool spatialRebuild = true;
+  bool spatialRefit = false;
+  BoundingVolumeHierarchy spatialIndex;
+  std::vector<uint32_t> indexedChildren;
+  std::vector<uint32_t> unboundedChildren;
+  std::vector<Bounds> childBounds;
+  std::vector<uint32_t> visibleChildren;
+  bool occlusionCulling = false;
+  bool depthPrePass = false;
+  // Draw lists recorded by a static Group with the visitor used to record
+  // them. The two recordings alternate so the one a pipelined frame still
+  // draws is not overwritten, see CullPipeline.
+  CullVisitorPtr recordVisitor;
+  DrawableListPtr recordings[2];
+  int32_t recording = -1;
+  uint32_t recordedRevision = 0;
+  Matrix recordedTransform;
+  // Children turned off with Toggle::ToggleChild, and the ones a subclass
+  // leaves out on its own, such as the unselected LevelOfDetail levels.
+  ChildBits toggledOff;
+  ChildBits filtered;
   LambdaDrawablePtr createLambdaDrawable(CreationContextPtr& aContext, const RenderLambda& aLambda);
-  bool Contains(const Node& aNode);
+  bool Contains(const Node& aNode) const { return childSlots.count(&aNode) > 0; }
+  int32_t FindChild(const Node& aNode);
+  void AppendChild(NodePtr&& aNode);
+  void UpdateChildSlots();
   bool Contains(const Light& aLight);
-  virtual bool IsEnabled(const Node&) { return true; }
-  virtual void Clear() { children.clear(); }
+  bool UseSpatialIndex();
+  bool IsEnabled(const uint32_t aSlot) const { return !toggledOff.Test(aSlot) && !filtered.Test(aSlot); }
+  // Nodes that are not children count as enabled.
+  bool IsEnabled(const Node& aNode) {
+    const int32_t kSlot = FindChild(aNode);
+    return (kSlot < 0) || IsEnabled((uint32_t)kSlot);
+  }
+  // Calls aCallback with the slot of each enabled child in order, testing
+  // 64 children at a time.
+  template <typename T>
+  void ForEachEnabled(const T& aCallback) const {
+    const uint32_t kCount = (uint32_t)children.size();
+    for (uint32_t base = 0; base < kCount; base += 64) {
+      const size_t kWord = base >> 6;
+      uint64_t enabled = ~(toggledOff.Word(kWord) | filtered.Word(kWord));
+      if ((kCount - base) < 64) {
+        enabled &= (uint64_t(1) << (kCount - base)) - 1;
+      }
+      while (enabled) {
+        aCallback(base + (uint32_t)__builtin_ctzll(enabled));
+        enabled &= enabled - 1;
+      }
+    }
+  }
+  // Called for each child removed by RemoveNode or RemoveNodes.
+  virtual void Detach(const Node&) {}
+  virtual void Clear() {
+    children.clear();
+    childSlots.clear();
+    toggledOff.Clear();
+    filtered.Clear();
+    spatialRebuild = true;
+  }
 };
 
 }
@@ -19,12 +19,15 @@ struct Light::State {
   Color ambient;
   Color diffuse;
   Color specular;
+  Vector position;
+  float range;
 
   State()
       : direction(-1.0f, -1.0f, -1.0f)
       , ambient(0.4f, 0.4f, 0.4f)
       , diffuse(1.0f, 1.0f, 1.0f)
       , specular(1.0f, 1.0f, 1.0f)
+      , range(0.0f)
   {
     direction = direction.Normalize();
   }
@@ -0,0 +1,31 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_LITTLE_ENDIAN_DOT_H
+#define VRB_LITTLE_ENDIAN_DOT_H
+
+#include <stdint.h>
+
+namespace vrb {
+
+// Reads little endian values from unaligned file data on any host.
+inline uint32_t
+ReadLittleEndian24(const uint8_t* aData) {
+  return (uint32_t)aData[0] | ((uint32_t)aData[1] << 8) | ((uint32_t)aData[2] << 16);
+}
+
+inline uint32_t
+ReadLittleEndian32(const uint8_t* aData) {
+  return ReadLittleEndian24(aData) | ((uint32_t)aData[3] << 24);
+}
+
+inline uint64_t
+ReadLittleEndian64(const uint8_t* aData) {
+  return (uint64_t)ReadLittleEndian32(aData) | ((uint64_t)ReadLittleEndian32(aData + 4) << 32);
+}
+
+} // namespace vrb
+
+#endif // VRB_LITTLE_ENDIAN_DOT_H
@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_LOAD_QUEUE_DOT_H
+#define VRB_LOAD_QUEUE_DOT_H
+
+#include "vrb/Group.h"
+#include "vrb/LoadReport.h"
+#include "vrb/LoaderThread.h"
+#include "vrb/Logger.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace vrb {
+
+struct LoadInfo {
+  GroupPtr target;
+  LoadTask task;
+  LoadFinishedCallback callback;
+  LoadTokenPtr token;
+  LoadInfo(GroupPtr& aGroup, LoadTask& aTask, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken)
+      : target(aGroup)
+      , task(aTask)
+      , callback(aCallback)
+      , token(aToken)
+  {}
+  bool IsCancelled() const {
+    return token && token->IsCancelled();
+  }
+  int GetPriority() const {
+    return token ? token->GetPriority() : 0;
+  }
+private:
+  LoadInfo() = delete;
+};
+
+// Completes the report of a load task that produced aSource, logging it
+// when aLog is set. Returns the callback handing it to aCallback, empty when
+// there is no report or no callback.
+inline LoadFinishedCallback
+FinishLoadReport(const LoadReportCollectorPtr& aReport, const GroupPtr& aSource, const double aTotal,
+                 const LoadReportCallback& aCallback, const bool aLog) {
+  if (!aReport) {
+    return nullptr;
+  }
+  if (aSource) {
+    aReport->CountNodes(aSource);
+  }
+  const LoadReport kReport = aReport->GetReport(aTotal);
+  if (aLog) {
+    VRB_LOG("%s", kReport.ToString().c_str());
+  }
+  if (!aCallback) {
+    return nullptr;
+  }
+  LoadReportCallback callback = aCallback;
+  return [callback, kReport](GroupPtr& aTarget) {
+    callback(aTarget, kReport);
+  };
+}
+
+// Returns the lambda passed to CreationContext::Synchronize() once a load
+// task has run. It moves the loaded nodes into the target on the render
+// thread, unless the task was cancelled in the meantime, and keeps them alive
+// until then. aReportCallback, see FinishLoadReport(), is called right after
+// the finished callback. aFinishCallbacks is emptied.
+inline ContextsSynchronizedLambda
+CreateLoadFinalizer(GroupPtr& aSource, LoadInfo& aInfo, std::vector<LoadFinishedCallback>& aFinishCallbacks,
+                    const LoadFinishedCallback& aReportCallback) {
+  GroupPtr source = aSource;
+  GroupPtr target = aInfo.target;
+  LoadFinishedCallback callback = aInfo.callback;
+  LoadFinishedCallback reportCallback = aReportCallback;
+  LoadTokenPtr token = aInfo.token;
+  std::vector<LoadFinishedCallback> finishCallbacks;
+  finishCallbacks.swap(aFinishCallbacks);
+  return [source, target, callback, reportCallback, token, finishCallbacks](RenderContextPtr&) mutable {
+    if (!token || !token->IsCancelled()) {
+      if (target && source) {
+        target->TakeChildren(source);
+      }
+      if (callback) {
+        callback(target);
+      }
+      if (reportCallback) {
+        reportCallback(target);
+      }
+    }
+    GroupPtr nullGroup;
+    for (LoadFinishedCallback& cb : finishCallbacks) {
+      if (cb) {
+        cb(nullGroup);
+      }
+    }
+  };
+}
+
+// Pending load tasks shared by the loader threads. Not thread safe, callers
+// hold the loader lock.
+class LoadQueue {
+public:
+  LoadQueue() {}
+  void Push(LoadInfo&& aInfo) {
+    mList.push_back(std::move(aInfo));
+  }
+  // Drops cancelled tasks and takes the task with the highest current
+  // priority. Tasks of equal priority run in submission order.
+  bool Pop(std::unique_ptr<LoadInfo>& aResult) {
+    mList.erase(std::remove_if(mList.begin(), mList.end(),
+                               [](const LoadInfo& aInfo) { return aInfo.IsCancelled(); }),
+                mList.end());
+    if (mList.empty()) {
+      return false;
+    }
+    size_t best = 0;
+    int bestPriority = mList[0].GetPriority();
+    for (size_t ix = 1; ix < mList.size(); ix++) {
+      const int priority = mList[ix].GetPriority();
+      if (priority > bestPriority) {
+        best = ix;
+        bestPriority = priority;
+      }
+    }
+    aResult.reset(new LoadInfo(std::move(mList[best])));
+    mList.erase(mList.begin() + best);
+    return true;
+  }
+  void Clear() {
+    mList.clear();
+  }
+private:
+  std::vector<LoadInfo> mList;
+  VRB_NO_DEFAULTS(LoadQueue)
+};
+
+} // namespace vrb
+
+#endif // VRB_LOAD_QUEUE_DOT_H
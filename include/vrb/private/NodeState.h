@@ -7,15 +7,67 @@
 #define VRB_NODE_STATE_DOT_H
 
 #include "vrb/Node.h"
+#include "vrb/Bounds.h"
 #include "vrb/Group.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 namespace vrb {
 struct Node::State {
   std::string name;
-  std::vector<GroupWeak> parents;
+  // Groups holding the node. Most nodes have a single parent, which is kept
+  // inline, the others are only allocated for multi-parenting.
+  Group* parent = nullptr;
+  std::vector<Group*> moreParents;
+  Bounds bounds;
+  bool boundsDirty = true;
+  uint32_t revision = 0;
+  uint32_t layoutRevision = 0;
+
+  int32_t ParentCount() const { return parent ? 1 + (int32_t)moreParents.size() : 0; }
+  Group* Parent(const int32_t aIndex) const {
+    if ((aIndex < 0) || (aIndex >= ParentCount())) {
+      return nullptr;
+    }
+    return aIndex == 0 ? parent : moreParents[aIndex - 1];
+  }
+  template <typename T>
+  void ForEachParent(const T& aCallback) const {
+    if (!parent) {
+      return;
+    }
+    aCallback(*parent);
+    for (Group* group: moreParents) {
+      aCallback(*group);
+    }
+  }
+  void AddParent(Group& aParent) {
+    if (!parent) {
+      parent = &aParent;
+    } else {
+      moreParents.push_back(&aParent);
+    }
+  }
+  // Returns false if aParent was not a parent.
+  bool RemoveParent(const Group& aParent) {
+    if (parent == &aParent) {
+      if (moreParents.empty()) {
+        parent = nullptr;
+      } else {
+        parent = moreParents.front();
+        moreParents.erase(moreParents.begin());
+      }
+      return true;
+    }
+    auto it = std::find(moreParents.begin(), moreParents.end(), &aParent);
+    if (it == moreParents.end()) {
+      return false;
+    }
+    moreParents.erase(it);
+    return true;
+  }
 };
 
 }
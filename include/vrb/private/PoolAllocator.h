@@ -0,0 +1,86 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_POOL_ALLOCATOR_DOT_H
+#define VRB_POOL_ALLOCATOR_DOT_H
+
+#include "vrb/MacroUtils.h"
+#include "vrb/Mutex.h"
+#include "vrb/private/AlignedAllocator.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace vrb {
+
+// Fixed size slots carved from large chunks. Released slots go on a free
+// list and are reused before a new chunk is allocated, chunks are never
+// returned to the system. Safe to use from any thread.
+class MemoryPool {
+public:
+  MemoryPool(const size_t aSize, const size_t aAlignment);
+  void* Allocate();
+  void Release(void* aSlot);
+private:
+  struct Slot {
+    Slot* next;
+  };
+  Mutex mLock;
+  size_t mSlotSize;
+  size_t mAlignment;
+  size_t mChunkSlots;
+  Slot* mFree;
+  std::vector<void*> mChunks;
+  MemoryPool() = delete;
+  VRB_NO_DEFAULTS(MemoryPool)
+};
+
+// Allocator for std::allocate_shared() that places objects of the same type
+// next to each other in a MemoryPool, which makes mass creation and
+// destruction cheap and keeps nodes traversed together close in memory.
+// Anything but single objects falls back to the AlignedAllocator.
+template <typename T>
+class PoolAllocator {
+public:
+  typedef T value_type;
+  template <typename U>
+  struct rebind {
+    typedef PoolAllocator<U> other;
+  };
+
+  PoolAllocator() {}
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) {}
+
+  T* allocate(const size_t aCount) {
+    if (aCount != 1) {
+      return AlignedAllocator<T>().allocate(aCount);
+    }
+    return static_cast<T*>(GetPool().Allocate());
+  }
+
+  void deallocate(T* aPointer, const size_t aCount) {
+    if (aCount != 1) {
+      AlignedAllocator<T>().deallocate(aPointer, aCount);
+      return;
+    }
+    GetPool().Release(aPointer);
+  }
+
+  static MemoryPool& GetPool() {
+    // Leaked so objects released during static destruction still find it.
+    static MemoryPool* sPool = new MemoryPool(sizeof(T), alignof(T));
+    return *sPool;
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+} // namespace vrb
+
+#endif // VRB_POOL_ALLOCATOR_DOT_H
@@ -8,14 +8,25 @@
 
 #include "vrb/ResourceGL.h"
 #include "vrb/Logger.h"
+#include "vrb/private/Clock.h"
 
 namespace vrb {
 
 struct ResourceGL::State {
   ResourceGL* prevResource;
   ResourceGL* nextResource;
-
-  State() : prevResource(nullptr), nextResource(nullptr) {}
+  // Only accessed on the render thread once the resource has been adopted.
+  bool initializedGL;
+  // Set when something visible is waiting on the resource so that it is
+  // initialized first by a budgeted ResourceGLList::Update.
+  bool initializePriority;
+
+  State()
+      : prevResource(nullptr)
+      , nextResource(nullptr)
+      , initializedGL(false)
+      , initializePriority(false)
+  {}
   ~State() {
     if (prevResource) { prevResource->m.nextResource = nextResource; }
     if (nextResource) { nextResource->m.prevResource = prevResource; }
@@ -26,6 +37,8 @@ struct ResourceGL::State {
       ResourceGL* tmp = current;
       current = current->m.nextResource;
       tmp->InitializeGL();
+      tmp->m.initializedGL = true;
+      tmp->m.initializePriority = false;
     }
   }
   void CallAllShutdownGL() {
@@ -34,6 +47,7 @@ struct ResourceGL::State {
       ResourceGL* tmp = current;
       current = current->m.nextResource;
       tmp->ShutdownGL();
+      tmp->m.initializedGL = false;
     }
   }
 
@@ -78,6 +92,7 @@ struct ResourceGL::State {
   }
 
   void GetOffRenderThreadResources(ResourceGLList& aTail);
+  bool InitializeWithBudget(ResourceGLList& aInitialized, const double aBudget);
 };
 
 class ResourceGLTail : public ResourceGL {
@@ -121,6 +136,14 @@ public:
     return true;
   }
 
+  // Initializes resources and moves them into aInitialized until aBudget
+  // seconds have passed. Prioritized resources are initialized first and at
+  // least one resource is initialized per call. A budget of zero or less
+  // initializes everything. Returns true if resources are left over.
+  bool Update(ResourceGLList& aInitialized, const double aBudget) {
+    return m.InitializeWithBudget(aInitialized, aBudget);
+  }
+
   bool IsDirty() {
     return m.nextResource != &mTail;
   }
@@ -158,6 +181,34 @@ ResourceGL::State::GetOffRenderThreadResources(ResourceGLList& aList) {
   }
 }
 
+inline bool
+ResourceGL::State::InitializeWithBudget(ResourceGLList& aInitialized, const double aBudget) {
+  const double kDeadline = aBudget > 0.0 ? GetMonotonicSeconds() + aBudget : 0.0;
+  bool first = true;
+  for (int pass = 0; pass < 2; pass++) {
+    const bool kPriorityPass = (pass == 0);
+    ResourceGL* current = nextResource;
+    // The tail is the only entry without a next resource.
+    while (current && current->m.nextResource) {
+      ResourceGL* resource = current;
+      current = current->m.nextResource;
+      if (kPriorityPass && !resource->m.initializePriority) {
+        continue;
+      }
+      if (!first && (kDeadline > 0.0) && (GetMonotonicSeconds() >= kDeadline)) {
+        return true;
+      }
+      first = false;
+      resource->m.RemoveFromCurrentList();
+      resource->InitializeGL();
+      resource->m.initializedGL = true;
+      resource->m.initializePriority = false;
+      aInitialized.Append(resource);
+    }
+  }
+  return false;
+}
+
 } // namespace vrb
 
 #endif // VRB_RESOURCE_GL_STATE_DOT_H
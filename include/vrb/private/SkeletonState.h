@@ -0,0 +1,39 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_SKELETON_STATE_DOT_H
+#define VRB_SKELETON_STATE_DOT_H
+
+#include "vrb/Skeleton.h"
+#include "vrb/private/UpdatableState.h"
+
+#include "vrb/Matrix.h"
+
+#include <vector>
+
+namespace vrb {
+
+struct Skeleton::State : public Updatable::State {
+  struct Joint {
+    TransformPtr transform;
+    // Index of the parent joint, always lower than the index of the joint.
+    int32_t parent;
+    Matrix inverseBind;
+  };
+  std::vector<Joint> joints;
+  // Current pose of each joint relative to the skinned geometry.
+  std::vector<Matrix> poses;
+  std::vector<Matrix> palette;
+  // Set once the palette is rebuilt by the TransformAnimator of the
+  // RenderContext, see Skeleton::UpdateResource.
+  TransformAnimatorWeak animator;
+  // Index in the animator, -1 when not added.
+  int32_t animatorSlot = -1;
+  void UpdatePalette();
+};
+
+} // namespace vrb
+
+#endif // VRB_SKELETON_STATE_DOT_H
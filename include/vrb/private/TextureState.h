@@ -19,6 +19,7 @@ struct Texture::State {
   std::string name;
   GLenum target;
   GLuint texture;
+  TexturePtr placeholder;
 
   State() : target(GL_TEXTURE_2D), texture(0) {
     intMap[GL_TEXTURE_MAG_FILTER] = GL_NEAREST;
@@ -0,0 +1,21 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TOGGLE_STATE_DOT_H
+#define VRB_TOGGLE_STATE_DOT_H
+
+#include "vrb/Toggle.h"
+#include "vrb/private/GroupState.h"
+
+namespace vrb {
+
+// The enabled state lives in Group::State::toggledOff, which the Group
+// keeps in step with the children.
+struct Toggle::State : public Group::State {
+};
+
+}
+
+#endif // VRB_TOGGLE_STATE_DOT_H
@@ -14,8 +14,12 @@ namespace vrb {
 
 struct Transform::State : public Group::State {
   Matrix transform;
+  Matrix worldTransform;
+  bool worldTransformDirty;
+  // Set when transform is affine so it is composed with fewer products.
+  bool affine;
 
-  State() : transform(Matrix::Identity()) {}
+  State() : transform(Matrix::Identity()), worldTransform(Matrix::Identity()), worldTransformDirty(true), affine(true) {}
 };
 
 }
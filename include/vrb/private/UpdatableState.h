@@ -10,15 +10,40 @@
 
 namespace vrb {
 
+class UpdatableList;
+
 struct Updatable::State {
   Updatable* prevUpdatable;
   Updatable* nextUpdatable;
+  // Set while asleep, the list Wake() returns it to.
+  UpdatableList* sleepList;
+  // RenderContext timestamp a timed sleep ends at, negative without a timer.
+  double wakeTime;
 
-  State() : prevUpdatable(nullptr), nextUpdatable(nullptr) {}
+  State() : prevUpdatable(nullptr), nextUpdatable(nullptr), sleepList(nullptr), wakeTime(-1.0) {}
   ~State() {
+    Unlink();
+  }
+  // Leaves the list. Safe to call from UpdateResource while the list is walked.
+  void Unlink() {
     if (prevUpdatable) { prevUpdatable->m.nextUpdatable = nextUpdatable; }
     if (nextUpdatable) { nextUpdatable->m.prevUpdatable = prevUpdatable; }
+    prevUpdatable = nullptr;
+    nextUpdatable = nullptr;
+    sleepList = nullptr;
+    wakeTime = -1.0;
   }
+  // Moves aUpdatable from wherever it is linked to right before aNext.
+  static void InsertBefore(Updatable* aUpdatable, Updatable* aNext) {
+    aUpdatable->m.Unlink();
+    Updatable* prev = aNext->m.prevUpdatable;
+    aUpdatable->m.prevUpdatable = prev;
+    aUpdatable->m.nextUpdatable = aNext;
+    prev->m.nextUpdatable = aUpdatable;
+    aNext->m.prevUpdatable = aUpdatable;
+  }
+  static Updatable* Next(const Updatable* aUpdatable) { return aUpdatable->m.nextUpdatable; }
+  static State& From(Updatable* aUpdatable) { return aUpdatable->m; }
   void CallAllUpdateResources(RenderContext& aContext) {
     Updatable* current = nextUpdatable;
     while(current) {
@@ -74,6 +99,10 @@ public:
   void SetHead(Updatable* aHead) {
     m.prevUpdatable = aHead;
   }
+
+  void SetNext(Updatable* aNext) {
+    m.nextUpdatable = aNext;
+  }
 protected:
   Updatable::State m;
 };
@@ -83,12 +112,38 @@ public:
   UpdatableList() : Updatable(m) {
     m.nextUpdatable = &mTail;
     mTail.SetHead(this);
+    mSleepingHead.SetNext(&mSleepingTail);
+    mSleepingTail.SetHead(&mSleepingHead);
+    mTimedHead.SetNext(&mTimedTail);
+    mTimedTail.SetHead(&mTimedHead);
   }
   ~UpdatableList() {}
 
   // vrb::Updatable interface
-  void UpdateResource(RenderContext& aContext) override  {
-    m.CallAllUpdateResources(aContext);
+  void UpdateResource(RenderContext& aContext) override;
+
+  // Sleeping Updatables are kept out of the walk, so an update only costs
+  // as much as the awake ones. Those with a wake time are sorted by it and
+  // woken from the front.
+  void Sleep(Updatable* aUpdatable, const double aWakeTime) {
+    Updatable* next = &mSleepingTail;
+    if (aWakeTime >= 0.0) {
+      next = Updatable::State::Next(&mTimedHead);
+      while ((next != &mTimedTail) && (Updatable::State::From(next).wakeTime <= aWakeTime)) {
+        next = Updatable::State::Next(next);
+      }
+    }
+    Updatable::State::InsertBefore(aUpdatable, next);
+    Updatable::State& state = Updatable::State::From(aUpdatable);
+    state.sleepList = this;
+    state.wakeTime = aWakeTime;
+  }
+
+  void Wake(Updatable* aUpdatable) {
+    Updatable::State::InsertBefore(aUpdatable, &mTail);
+    Updatable::State& state = Updatable::State::From(aUpdatable);
+    state.sleepList = nullptr;
+    state.wakeTime = -1.0;
   }
 
   bool IsDirty() {
@@ -104,6 +159,10 @@ public:
   }
 protected:
   UpdatableTail mTail;
+  UpdatableTail mSleepingHead;
+  UpdatableTail mSleepingTail;
+  UpdatableTail mTimedHead;
+  UpdatableTail mTimedTail;
   Updatable::State m;
 };
 
@@ -0,0 +1,61 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/AssetID.h"
+#include "vrb/private/AssetTable.h"
+
+#include "vrb/Logger.h"
+#include "vrb/ShardedMap.h"
+
+#include <atomic>
+
+namespace {
+
+struct Interned {
+  // Loader threads intern the same paths repeatedly, so hits only take a
+  // shared lock on one shard.
+  vrb::ShardedMap<std::string, vrb::AssetID> ids;
+  vrb::AssetTable<const std::string> names;
+  std::atomic<vrb::AssetID> next;
+  Interned() : next(vrb::kInvalidAssetID + 1) {}
+};
+
+// Never destroyed, IDs may be used by static objects during exit.
+Interned&
+GetInterned() {
+  static Interned* sInterned = new Interned;
+  return *sInterned;
+}
+
+const std::string sEmpty;
+
+} // namespace
+
+namespace vrb {
+
+AssetID
+InternAsset(const std::string& aName) {
+  if (aName.empty()) {
+    return kInvalidAssetID;
+  }
+  Interned& interned = GetInterned();
+  return interned.ids.FindOrCreate(aName, [&interned, &aName]() -> AssetID {
+    const AssetID kID = interned.next.fetch_add(1);
+    if (!interned.names.Set(kID, std::make_shared<const std::string>(aName))) {
+      VRB_ERROR("Too many interned assets, unable to intern: %s", aName.c_str());
+      return kInvalidAssetID;
+    }
+    return kID;
+  });
+}
+
+const std::string&
+GetAssetName(const AssetID aID) {
+  // The table holds every name until exit, so the reference stays valid.
+  std::shared_ptr<const std::string> name = GetInterned().names.Find(aID);
+  return name ? *name : sEmpty;
+}
+
+} // namespace vrb
@@ -0,0 +1,205 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/AssetPack.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Logger.h"
+#include "vrb/MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+
+namespace {
+
+// Layout, all integers little endian:
+//   char[8]  kMagic
+//   uint32   version
+//   uint32   entry count
+//   entries  uint64 offset, uint64 size, uint32 name length, name bytes
+//   payloads each at a multiple of kAlignment from the start of the pack
+const char kMagic[8] = {'V', 'R', 'B', 'P', 'A', 'C', 'K', '\0'};
+const uint32_t kVersion = 1;
+const size_t kHeaderSize = sizeof(kMagic) + 2 * sizeof(uint32_t);
+const size_t kEntryHeaderSize = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+// Largest page size in use on Android, so entries are page aligned on
+// 4 KiB and 16 KiB page devices alike.
+const uint64_t kAlignment = 16 * 1024;
+
+uint64_t
+Align(const uint64_t aOffset) {
+  return ((aOffset + kAlignment - 1) / kAlignment) * kAlignment;
+}
+
+template <typename T>
+bool
+ReadValue(const char* aData, const size_t aSize, size_t& aOffset, T& aValue) {
+  if ((aSize < sizeof(T)) || (aOffset > (aSize - sizeof(T)))) {
+    return false;
+  }
+  memcpy(&aValue, aData + aOffset, sizeof(T));
+  aOffset += sizeof(T);
+  return true;
+}
+
+template <typename T>
+void
+WriteValue(std::ofstream& aOutput, const T aValue) {
+  aOutput.write(reinterpret_cast<const char*>(&aValue), sizeof(T));
+}
+
+void
+WritePadding(std::ofstream& aOutput, const uint64_t aFrom, const uint64_t aTo) {
+  static const char kZeros[1024] = {};
+  uint64_t remaining = aTo - aFrom;
+  while (remaining > 0) {
+    const uint64_t kCount = remaining < sizeof(kZeros) ? remaining : sizeof(kZeros);
+    aOutput.write(kZeros, (std::streamsize)kCount);
+    remaining -= kCount;
+  }
+}
+
+}
+
+namespace vrb {
+
+struct AssetPack::State {
+  struct Entry {
+    size_t offset;
+    size_t size;
+  };
+  MappedFilePtr mapping;
+  std::unordered_map<std::string, Entry> entries;
+  State() {}
+
+  bool Parse() {
+    const char* data = mapping->Data();
+    const size_t kSize = mapping->Size();
+    if ((kSize < kHeaderSize) || (memcmp(data, kMagic, sizeof(kMagic)) != 0)) {
+      VRB_ERROR("AssetPack: missing header");
+      return false;
+    }
+    size_t offset = sizeof(kMagic);
+    uint32_t version = 0;
+    uint32_t count = 0;
+    ReadValue(data, kSize, offset, version);
+    ReadValue(data, kSize, offset, count);
+    if (version != kVersion) {
+      VRB_ERROR("AssetPack: unsupported version %u", version);
+      return false;
+    }
+    entries.reserve(count);
+    for (uint32_t ix = 0; ix < count; ix++) {
+      uint64_t entryOffset = 0;
+      uint64_t entrySize = 0;
+      uint32_t nameLength = 0;
+      if (!ReadValue(data, kSize, offset, entryOffset) ||
+          !ReadValue(data, kSize, offset, entrySize) ||
+          !ReadValue(data, kSize, offset, nameLength) ||
+          (nameLength > (kSize - offset))) {
+        VRB_ERROR("AssetPack: truncated table of contents");
+        return false;
+      }
+      if ((entryOffset > kSize) || (entrySize > (kSize - entryOffset))) {
+        VRB_ERROR("AssetPack: entry %u is outside of the pack", ix);
+        return false;
+      }
+      Entry& entry = entries[std::string(data + offset, nameLength)];
+      entry.offset = (size_t)entryOffset;
+      entry.size = (size_t)entrySize;
+      offset += nameLength;
+    }
+    return true;
+  }
+};
+
+AssetPackPtr
+AssetPack::Create(const MappedFilePtr& aMapping) {
+  if (!aMapping || !aMapping->IsValid()) {
+    return nullptr;
+  }
+  AssetPackPtr result = std::make_shared<ConcreteClass<AssetPack, AssetPack::State> >();
+  result->m.mapping = aMapping;
+  if (!result->m.Parse()) {
+    return nullptr;
+  }
+  return result;
+}
+
+bool
+AssetPack::Write(const std::string& aFileName, const std::vector<std::pair<std::string, std::string> >& aFiles) {
+  std::vector<uint64_t> sizes;
+  uint64_t tableEnd = kHeaderSize;
+  for (const std::pair<std::string, std::string>& file: aFiles) {
+    std::ifstream input(file.second, std::ios::binary | std::ios::ate);
+    if (!input) {
+      VRB_ERROR("AssetPack: unable to read '%s'", file.second.c_str());
+      return false;
+    }
+    sizes.push_back((uint64_t)input.tellg());
+    tableEnd += kEntryHeaderSize + file.first.size();
+  }
+
+  std::ofstream output(aFileName, std::ios::binary | std::ios::trunc);
+  if (!output) {
+    VRB_ERROR("AssetPack: unable to create '%s'", aFileName.c_str());
+    return false;
+  }
+  output.write(kMagic, sizeof(kMagic));
+  WriteValue(output, kVersion);
+  WriteValue(output, (uint32_t)aFiles.size());
+  uint64_t offset = Align(tableEnd);
+  for (size_t ix = 0; ix < aFiles.size(); ix++) {
+    WriteValue(output, offset);
+    WriteValue(output, sizes[ix]);
+    WriteValue(output, (uint32_t)aFiles[ix].first.size());
+    output.write(aFiles[ix].first.data(), (std::streamsize)aFiles[ix].first.size());
+    offset = Align(offset + sizes[ix]);
+  }
+
+  uint64_t written = tableEnd;
+  for (size_t ix = 0; ix < aFiles.size(); ix++) {
+    const uint64_t kStart = Align(written);
+    WritePadding(output, written, kStart);
+    if (sizes[ix] > 0) {
+      std::ifstream input(aFiles[ix].second, std::ios::binary);
+      output << input.rdbuf();
+    }
+    written = kStart + sizes[ix];
+  }
+  output.flush();
+  if (!output || ((uint64_t)output.tellp() != written)) {
+    VRB_ERROR("AssetPack: failed to write '%s'", aFileName.c_str());
+    return false;
+  }
+  return true;
+}
+
+int32_t
+AssetPack::GetEntryCount() const {
+  return (int32_t)m.entries.size();
+}
+
+bool
+AssetPack::Contains(const std::string& aName) const {
+  return m.entries.find(aName) != m.entries.end();
+}
+
+MappedFilePtr
+AssetPack::MapEntry(const std::string& aName) const {
+  auto it = m.entries.find(aName);
+  if (it == m.entries.end()) {
+    return nullptr;
+  }
+  MappedFilePtr result = std::make_shared<MappedFile>(m.mapping, it->second.offset, it->second.size);
+  return result->IsValid() ? result : nullptr;
+}
+
+AssetPack::AssetPack(State& aState) : m(aState) {}
+AssetPack::~AssetPack() {}
+
+} // namespace vrb
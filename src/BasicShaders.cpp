@@ -3,14 +3,10 @@ namespace vrb {
 static const char* sVertexShaderSource = R"SHADER(
 #version 100
 
-#define MAX_LIGHTS 2
-#define VRB_USE_TEXTURE VRB_TEXTURE_STATE
-#define VRB_UV_TYPE VRB_TEXTURE_UV_TYPE
-#define VRB_UV_TRANSFORM VRB_UV_TRANSFORM_ENABLED
-#define VRB_VERTEX_COLOR VRB_VERTEX_COLOR_ENABLED
-
 struct Light {
   vec3 direction;
+  // World space position and range of point lights, zero for directional.
+  vec4 position;
   vec4 ambient;
   vec4 diffuse;
   vec4 specular;
@@ -23,20 +19,91 @@ struct Material {
   float specularExponent;
 };
 
-uniform mat4 u_perspective;
+#if VRB_LATE_LATCH == 1
+// Written by LateLatch, std140 keeps the layout independent of the driver.
+layout(std140) uniform vrb_Camera {
+  mat4 u_viewProjection[2];
+  mat4 u_view[2];
+};
+#if VRB_MULTIVIEW == 1
+#define VRB_VIEW_PROJECTION u_viewProjection[gl_ViewID_OVR]
+#define VRB_VIEW u_view[gl_ViewID_OVR]
+#else
+#define VRB_VIEW_PROJECTION u_viewProjection[0]
+#define VRB_VIEW u_view[0]
+#endif
+#elif VRB_MULTIVIEW == 1
+uniform mat4 u_viewProjection[2];
+uniform mat4 u_view[2];
+#define VRB_VIEW_PROJECTION u_viewProjection[gl_ViewID_OVR]
+#define VRB_VIEW u_view[gl_ViewID_OVR]
+#else
+uniform mat4 u_viewProjection;
 uniform mat4 u_view;
+#define VRB_VIEW_PROJECTION u_viewProjection
+#define VRB_VIEW u_view
+#endif
+#if VRB_INSTANCED == 1
+attribute mat4 a_instanceModel;
+#define VRB_MODEL a_instanceModel
+#else
 uniform mat4 u_model;
+#define VRB_MODEL u_model
+#endif
+// The model is constant for the draw, so the matrices using it are
+// multiplied once on the CPU instead of for every vertex. Not when late
+// latched, the view may change after the draw has been issued.
+#if (VRB_INSTANCED != 1) && (VRB_SKINNED != 1) && (VRB_LATE_LATCH != 1)
+#define VRB_PRECOMPUTED_MVP 1
+#else
+#define VRB_PRECOMPUTED_MVP 0
+#endif
+#if VRB_PRECOMPUTED_MVP == 1
+#if VRB_MULTIVIEW == 1
+uniform mat4 u_modelViewProjection[2];
+uniform mat4 u_modelView[2];
+#define VRB_MODEL_VIEW_PROJECTION u_modelViewProjection[gl_ViewID_OVR]
+#define VRB_MODEL_VIEW u_modelView[gl_ViewID_OVR]
+#else
+uniform mat4 u_modelViewProjection;
+uniform mat4 u_modelView;
+#define VRB_MODEL_VIEW_PROJECTION u_modelViewProjection
+#define VRB_MODEL_VIEW u_modelView
+#endif
+#endif
+#if VRB_SKINNED == 1
+uniform mat4 u_joints[VRB_MAX_JOINTS];
+attribute vec4 a_jointIndices;
+attribute vec4 a_jointWeights;
+#endif
 uniform int u_lightCount;
-uniform Light u_lights[MAX_LIGHTS];
+uniform Light u_lights[VRB_MAX_LIGHTS];
+#if VRB_MATERIAL_BLOCK == 1
+// Written by RenderState, laid out as its MaterialBlock.
+layout(std140) uniform vrb_Material {
+  Material u_material;
+  vec4 u_tintColor;
+};
+#else
 uniform Material u_material;
 uniform vec4 u_tintColor;
+#endif
 #if VRB_UV_TRANSFORM == 1
 uniform mat4 u_uv_transform;
 #endif
+#if VRB_TEXTURE_ARRAY == 1
+// Added to the layer in the third UV component, which is zero when the
+// vertices only have two.
+uniform float u_textureLayer;
+#endif
 
 attribute vec3 a_position;
 attribute vec3 a_normal;
 
+// FeatureDepthOnly variants must write the same depth for the color pass to
+// be drawn with GL_EQUAL.
+invariant gl_Position;
+
 varying vec4 v_color;
 
 #ifdef VRB_USE_TEXTURE
@@ -49,30 +116,65 @@ attribute vec4 a_color;
 #endif
 
 vec4 normal;
+vec4 viewPosition;
 
 vec4
 calculate_light(int index) {
   vec4 result = vec4(0, 0, 0, 0);
-  vec4 direction = -normalize(u_view * vec4(u_lights[index].direction.xyz, 0));
+  vec4 direction;
   vec4 hvec;
   float ndotl;
   float ndoth;
+  float attenuation = 1.0;
+  if (u_lights[index].position.w > 0.0) {
+    // Point lights fade out quadratically to nothing at their range.
+    vec4 toLight = (VRB_VIEW * vec4(u_lights[index].position.xyz, 1)) - viewPosition;
+    float distance = length(toLight.xyz);
+    attenuation = clamp(1.0 - (distance / u_lights[index].position.w), 0.0, 1.0);
+    attenuation *= attenuation;
+    direction = toLight / max(distance, 0.0001);
+  } else {
+    direction = -normalize(VRB_VIEW * vec4(u_lights[index].direction.xyz, 0));
+  }
   result += u_lights[index].ambient * u_material.ambient;
   ndotl = max(0.0, dot(normal, direction));
   result += (ndotl * u_lights[index].diffuse * u_material.diffuse);
+#if VRB_SPECULAR == 1
   hvec = normalize(direction + vec4(0.0, 0.0, 1.0, 0.0));
   ndoth = dot(normal, hvec);
   if (ndoth > 0.0) {
     result += (pow(ndoth, u_material.specularExponent) * u_material.specular * u_lights[index].specular);
   }
-  return result;
+#endif // VRB_SPECULAR
+  return result * attenuation;
 }
 
 void main(void) {
   int ix;
+#if VRB_PRECOMPUTED_MVP == 1
+  normal = normalize(VRB_MODEL_VIEW * vec4(a_normal.xyz, 0));
+  viewPosition = VRB_MODEL_VIEW * vec4(a_position.xyz, 1);
+#else
+#if VRB_SKINNED == 1
+  mat4 model = VRB_MODEL * (a_jointWeights.x * u_joints[int(a_jointIndices.x)] +
+                            a_jointWeights.y * u_joints[int(a_jointIndices.y)] +
+                            a_jointWeights.z * u_joints[int(a_jointIndices.z)] +
+                            a_jointWeights.w * u_joints[int(a_jointIndices.w)]);
+#else
+  mat4 model = VRB_MODEL;
+#endif
+  normal = normalize(VRB_VIEW * (model * vec4(a_normal.xyz, 0)));
+  viewPosition = VRB_VIEW * (model * vec4(a_position.xyz, 1));
+#endif // VRB_PRECOMPUTED_MVP
+#if VRB_DEPTH_ONLY != 1
   v_color = vec4(0, 0, 0, 0);
-  normal = normalize(u_view * u_model * vec4(a_normal.xyz, 0));
-  for(ix = 0; ix < MAX_LIGHTS; ix++) {
+#if VRB_LIGHT_COUNT == 0
+  v_color = u_material.diffuse;
+#elif VRB_LIGHT_COUNT > 0
+  VRB_APPLY_LIGHTS
+  v_color.a = u_material.diffuse.a;
+#else
+  for(ix = 0; ix < VRB_MAX_LIGHTS; ix++) {
     if (ix >= u_lightCount) {
       break;
     }
@@ -82,18 +184,30 @@ void main(void) {
   if (u_lightCount == 0) {
     v_color = u_material.diffuse;
   }
+#endif // VRB_LIGHT_COUNT
 #if VRB_VERTEX_COLOR == 1
   v_color *= a_color;
 #endif
   v_color *= u_tintColor;
 #ifdef VRB_USE_TEXTURE
+#if VRB_TEXTURE_ARRAY == 1
 #if VRB_UV_TRANSFORM == 1
+  v_uv = vec3((u_uv_transform * vec4(a_uv.xy, 0, 1)).xy, a_uv.z + u_textureLayer);
+#else
+  v_uv = vec3(a_uv.xy, a_uv.z + u_textureLayer);
+#endif // VRB_UV_TRANSFORM
+#elif VRB_UV_TRANSFORM == 1
   v_uv = (u_uv_transform * vec4(a_uv.xy, 0, 1)).xy;
 #else
   v_uv = a_uv;
 #endif // VRB_UV_TRANSFORM
 #endif // VRB_USE_TEXTURE
-  gl_Position = u_perspective * u_view * u_model * vec4(a_position.xyz, 1);
+#endif // VRB_DEPTH_ONLY
+#if VRB_PRECOMPUTED_MVP == 1
+  gl_Position = VRB_MODEL_VIEW_PROJECTION * vec4(a_position.xyz, 1);
+#else
+  gl_Position = VRB_VIEW_PROJECTION * (model * vec4(a_position.xyz, 1));
+#endif
 }
 
 )SHADER";
@@ -153,6 +267,33 @@ void main() {
 
 )SHADER";
 
+// Only built as GLSL ES 3.00, the layer is rounded to the nearest integer.
+static const char* sFragmentTextureArrayShaderSource = R"SHADER(
+#version 100
+precision VRB_FRAGMENT_PRECISION float;
+precision VRB_FRAGMENT_PRECISION sampler2DArray;
+
+uniform sampler2DArray u_texture0;
+varying vec4 v_color;
+varying vec3 v_uv;
+
+void main() {
+  gl_FragColor = texture(u_texture0, v_uv) * v_color;
+}
+
+)SHADER";
+
+// Drawn with the color writes disabled.
+static const char* sFragmentDepthOnlyShaderSource = R"SHADER(
+#version 100
+precision VRB_FRAGMENT_PRECISION float;
+
+void main() {
+  gl_FragColor = vec4(0);
+}
+
+)SHADER";
+
 const char*
 GetVertexShaderSource() { return sVertexShaderSource; }
 
@@ -168,4 +309,10 @@ GetFragmentSurfaceTextureShaderSource() { return sFragmentSurfaceTextureShaderSo
 const char*
 GetFragmentCubeMapTextureShaderSource() { return sFragmentCubeMapTextureShaderSource; }
 
+const char*
+GetFragmentTextureArrayShaderSource() { return sFragmentTextureArrayShaderSource; }
+
+const char*
+GetFragmentDepthOnlyShaderSource() { return sFragmentDepthOnlyShaderSource; }
+
 } // namespace vrb
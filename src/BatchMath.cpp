@@ -0,0 +1,348 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/BatchMath.h"
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+#include "vrb/Vector4.h"
+
+#include <cmath>
+
+namespace {
+
+// Scalar transform of a single xyz triple. aW is 1 for points and 0 for directions.
+inline void
+TransformScalar(const float* aMatrix, const float* aInput, float* aOutput, const float aW) {
+  const float x = aInput[0];
+  const float y = aInput[1];
+  const float z = aInput[2];
+  aOutput[0] = aMatrix[0] * x + aMatrix[4] * y + aMatrix[8] * z + aMatrix[12] * aW;
+  aOutput[1] = aMatrix[1] * x + aMatrix[5] * y + aMatrix[9] * z + aMatrix[13] * aW;
+  aOutput[2] = aMatrix[2] * x + aMatrix[6] * y + aMatrix[10] * z + aMatrix[14] * aW;
+}
+
+void
+TransformArray(const vrb::Matrix& aTransform, const float* aInput, float* aOutput, const size_t aCount, const bool aIsPoint) {
+  const float* matrix = aTransform.Data();
+  const float kW = aIsPoint ? 1.0f : 0.0f;
+#if defined(VRB_MATRIX_NEON)
+  const float32x4_t column0 = vld1q_f32(matrix);
+  const float32x4_t column1 = vld1q_f32(matrix + 4);
+  const float32x4_t column2 = vld1q_f32(matrix + 8);
+  const float32x4_t column3 = vmulq_n_f32(vld1q_f32(matrix + 12), kW);
+  float result[4];
+  for (size_t ix = 0; ix < aCount; ix++) {
+    const float* input = aInput + (ix * 3);
+    float32x4_t value = vaddq_f32(vmulq_n_f32(column0, input[0]), vmulq_n_f32(column1, input[1]));
+    value = vaddq_f32(value, vaddq_f32(vmulq_n_f32(column2, input[2]), column3));
+    vst1q_f32(result, value);
+    // Only three floats may be written since aOutput may alias the next input.
+    float* output = aOutput + (ix * 3);
+    output[0] = result[0];
+    output[1] = result[1];
+    output[2] = result[2];
+  }
+#elif defined(VRB_MATRIX_SSE)
+  const __m128 column0 = _mm_loadu_ps(matrix);
+  const __m128 column1 = _mm_loadu_ps(matrix + 4);
+  const __m128 column2 = _mm_loadu_ps(matrix + 8);
+  const __m128 column3 = _mm_mul_ps(_mm_loadu_ps(matrix + 12), _mm_set1_ps(kW));
+  float result[4];
+  for (size_t ix = 0; ix < aCount; ix++) {
+    const float* input = aInput + (ix * 3);
+    __m128 value = _mm_add_ps(_mm_mul_ps(column0, _mm_set1_ps(input[0])), _mm_mul_ps(column1, _mm_set1_ps(input[1])));
+    value = _mm_add_ps(value, _mm_add_ps(_mm_mul_ps(column2, _mm_set1_ps(input[2])), column3));
+    _mm_storeu_ps(result, value);
+    // Only three floats may be written since aOutput may alias the next input.
+    float* output = aOutput + (ix * 3);
+    output[0] = result[0];
+    output[1] = result[1];
+    output[2] = result[2];
+  }
+#else
+  for (size_t ix = 0; ix < aCount; ix++) {
+    TransformScalar(matrix, aInput + (ix * 3), aOutput + (ix * 3), kW);
+  }
+#endif
+}
+
+// Four float lanes for the Vector4 kernels, which are written once for every
+// target. The scalar fallback is what the NEON and SSE versions compute.
+#if defined(VRB_MATRIX_NEON)
+typedef float32x4_t Lanes;
+inline Lanes Load(const float* aData) { return vld1q_f32(aData); }
+inline Lanes LoadUnaligned(const float* aData) { return vld1q_f32(aData); }
+inline void Store(float* aData, const Lanes aValue) { vst1q_f32(aData, aValue); }
+inline Lanes Splat(const float aValue) { return vdupq_n_f32(aValue); }
+inline Lanes Add(const Lanes aLeft, const Lanes aRight) { return vaddq_f32(aLeft, aRight); }
+inline Lanes Sub(const Lanes aLeft, const Lanes aRight) { return vsubq_f32(aLeft, aRight); }
+inline Lanes Mul(const Lanes aLeft, const Lanes aRight) { return vmulq_f32(aLeft, aRight); }
+inline Lanes Min(const Lanes aLeft, const Lanes aRight) { return vminq_f32(aLeft, aRight); }
+inline Lanes Max(const Lanes aLeft, const Lanes aRight) { return vmaxq_f32(aLeft, aRight); }
+// [x y z w] to [y z x w].
+inline Lanes RotateYZX(const Lanes aValue) {
+  const float32x2_t kLow = vget_low_f32(aValue);
+  const float32x2_t kHigh = vget_high_f32(aValue);
+  return vcombine_f32(vext_f32(kLow, kHigh, 1), vset_lane_f32(vget_lane_f32(kLow, 0), kHigh, 0));
+}
+#elif defined(VRB_MATRIX_SSE)
+typedef __m128 Lanes;
+inline Lanes Load(const float* aData) { return _mm_load_ps(aData); }
+inline Lanes LoadUnaligned(const float* aData) { return _mm_loadu_ps(aData); }
+inline void Store(float* aData, const Lanes aValue) { _mm_store_ps(aData, aValue); }
+inline Lanes Splat(const float aValue) { return _mm_set1_ps(aValue); }
+inline Lanes Add(const Lanes aLeft, const Lanes aRight) { return _mm_add_ps(aLeft, aRight); }
+inline Lanes Sub(const Lanes aLeft, const Lanes aRight) { return _mm_sub_ps(aLeft, aRight); }
+inline Lanes Mul(const Lanes aLeft, const Lanes aRight) { return _mm_mul_ps(aLeft, aRight); }
+inline Lanes Min(const Lanes aLeft, const Lanes aRight) { return _mm_min_ps(aLeft, aRight); }
+inline Lanes Max(const Lanes aLeft, const Lanes aRight) { return _mm_max_ps(aLeft, aRight); }
+inline Lanes RotateYZX(const Lanes aValue) { return _mm_shuffle_ps(aValue, aValue, _MM_SHUFFLE(3, 0, 2, 1)); }
+#else
+struct Lanes {
+  float v[4];
+};
+inline Lanes Load(const float* aData) { return Lanes{{aData[0], aData[1], aData[2], aData[3]}}; }
+inline Lanes LoadUnaligned(const float* aData) { return Load(aData); }
+inline void Store(float* aData, const Lanes aValue) {
+  for (int ix = 0; ix < 4; ix++) { aData[ix] = aValue.v[ix]; }
+}
+inline Lanes Splat(const float aValue) { return Lanes{{aValue, aValue, aValue, aValue}}; }
+#  define VRB_LANES_OP(aName, aExpression)                         \
+  inline Lanes aName(const Lanes aLeft, const Lanes aRight) {      \
+    Lanes result;                                                  \
+    for (int ix = 0; ix < 4; ix++) {                               \
+      const float left = aLeft.v[ix], right = aRight.v[ix];        \
+      result.v[ix] = (aExpression);                                \
+    }                                                              \
+    return result;                                                 \
+  }
+VRB_LANES_OP(Add, left + right)
+VRB_LANES_OP(Sub, left - right)
+VRB_LANES_OP(Mul, left * right)
+VRB_LANES_OP(Min, right < left ? right : left)
+VRB_LANES_OP(Max, right > left ? right : left)
+#  undef VRB_LANES_OP
+inline Lanes RotateYZX(const Lanes aValue) { return Lanes{{aValue.v[1], aValue.v[2], aValue.v[0], aValue.v[3]}}; }
+#endif
+
+void
+TransformArray4(const vrb::Matrix& aTransform, const vrb::Vector4* aInput, vrb::Vector4* aOutput,
+                const size_t aCount, const bool aIsPoint) {
+  const float* matrix = aTransform.Data();
+  // Matrix is only aligned when built with VRB_MATRIX_ALIGNED.
+  const Lanes kColumn0 = LoadUnaligned(matrix);
+  const Lanes kColumn1 = LoadUnaligned(matrix + 4);
+  const Lanes kColumn2 = LoadUnaligned(matrix + 8);
+  const Lanes kColumn3 = LoadUnaligned(matrix + 12);
+  for (size_t ix = 0; ix < aCount; ix++) {
+    const float* input = aInput[ix].Data();
+    Lanes value = Add(Mul(kColumn0, Splat(input[0])), Mul(kColumn1, Splat(input[1])));
+    value = Add(value, Mul(kColumn2, Splat(input[2])));
+    if (aIsPoint) {
+      value = Add(value, Mul(kColumn3, Splat(input[3])));
+    }
+    Store(aOutput[ix].Data(), value);
+  }
+}
+
+inline void
+FoldBounds(const Lanes aMin, const Lanes aMax, vrb::Vector& aResultMin, vrb::Vector& aResultMax) {
+  vrb::Vector4 min;
+  vrb::Vector4 max;
+  Store(min.Data(), aMin);
+  Store(max.Data(), aMax);
+  aResultMin.ContractInPlace(min.ToVector());
+  aResultMax.ExpandInPlace(max.ToVector());
+}
+
+} // namespace
+
+namespace vrb {
+
+void
+TransformPoints(const Matrix& aTransform, const float* aPoints, float* aResult, const size_t aCount) {
+  TransformArray(aTransform, aPoints, aResult, aCount, true);
+}
+
+void
+TransformNormals(const Matrix& aTransform, const float* aNormals, float* aResult, const size_t aCount) {
+  TransformArray(aTransform, aNormals, aResult, aCount, false);
+}
+
+void
+ExtendBounds(const float* aPoints, const size_t aCount, Vector& aMin, Vector& aMax) {
+  size_t ix = 0;
+#if defined(VRB_MATRIX_NEON) || defined(VRB_MATRIX_SSE)
+  // Four packed points span three vectors: [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3].
+  // Each lane keeps its own running min and max and they are folded per axis at the end.
+  const size_t kGroups = aCount / 4;
+  if (kGroups > 0) {
+    float minLanes[12];
+    float maxLanes[12];
+#  if defined(VRB_MATRIX_NEON)
+    float32x4_t min0 = vld1q_f32(aPoints), min1 = vld1q_f32(aPoints + 4), min2 = vld1q_f32(aPoints + 8);
+    float32x4_t max0 = min0, max1 = min1, max2 = min2;
+    for (size_t group = 1; group < kGroups; group++) {
+      const float* points = aPoints + (group * 12);
+      const float32x4_t v0 = vld1q_f32(points);
+      const float32x4_t v1 = vld1q_f32(points + 4);
+      const float32x4_t v2 = vld1q_f32(points + 8);
+      min0 = vminq_f32(min0, v0); max0 = vmaxq_f32(max0, v0);
+      min1 = vminq_f32(min1, v1); max1 = vmaxq_f32(max1, v1);
+      min2 = vminq_f32(min2, v2); max2 = vmaxq_f32(max2, v2);
+    }
+    vst1q_f32(minLanes, min0); vst1q_f32(minLanes + 4, min1); vst1q_f32(minLanes + 8, min2);
+    vst1q_f32(maxLanes, max0); vst1q_f32(maxLanes + 4, max1); vst1q_f32(maxLanes + 8, max2);
+#  else
+    __m128 min0 = _mm_loadu_ps(aPoints), min1 = _mm_loadu_ps(aPoints + 4), min2 = _mm_loadu_ps(aPoints + 8);
+    __m128 max0 = min0, max1 = min1, max2 = min2;
+    for (size_t group = 1; group < kGroups; group++) {
+      const float* points = aPoints + (group * 12);
+      const __m128 v0 = _mm_loadu_ps(points);
+      const __m128 v1 = _mm_loadu_ps(points + 4);
+      const __m128 v2 = _mm_loadu_ps(points + 8);
+      min0 = _mm_min_ps(min0, v0); max0 = _mm_max_ps(max0, v0);
+      min1 = _mm_min_ps(min1, v1); max1 = _mm_max_ps(max1, v1);
+      min2 = _mm_min_ps(min2, v2); max2 = _mm_max_ps(max2, v2);
+    }
+    _mm_storeu_ps(minLanes, min0); _mm_storeu_ps(minLanes + 4, min1); _mm_storeu_ps(minLanes + 8, min2);
+    _mm_storeu_ps(maxLanes, max0); _mm_storeu_ps(maxLanes + 4, max1); _mm_storeu_ps(maxLanes + 8, max2);
+#  endif
+    // The lanes are laid out exactly like four packed points.
+    for (int point = 0; point < 4; point++) {
+      aMin.ContractInPlace(Vector(minLanes[point * 3], minLanes[point * 3 + 1], minLanes[point * 3 + 2]));
+      aMax.ExpandInPlace(Vector(maxLanes[point * 3], maxLanes[point * 3 + 1], maxLanes[point * 3 + 2]));
+    }
+    ix = kGroups * 4;
+  }
+#endif
+  for (; ix < aCount; ix++) {
+    const float* point = aPoints + (ix * 3);
+    const Vector value(point[0], point[1], point[2]);
+    aMin.ContractInPlace(value);
+    aMax.ExpandInPlace(value);
+  }
+}
+
+void
+AccumulateNormals(const float* aPoints, const uint32_t* aTriangles, const size_t aTriangleCount, float* aNormals) {
+  for (size_t ix = 0; ix < aTriangleCount; ix++) {
+    const uint32_t* triangle = aTriangles + (ix * 3);
+    const float* p0 = aPoints + (triangle[0] * 3);
+    const float* p1 = aPoints + (triangle[1] * 3);
+    const float* p2 = aPoints + (triangle[2] * 3);
+    const float e1x = p1[0] - p0[0], e1y = p1[1] - p0[1], e1z = p1[2] - p0[2];
+    const float e2x = p2[0] - p0[0], e2y = p2[1] - p0[1], e2z = p2[2] - p0[2];
+    // The unnormalized cross product is proportional to the triangle area.
+    const float nx = (e1y * e2z) - (e1z * e2y);
+    const float ny = (e1z * e2x) - (e1x * e2z);
+    const float nz = (e1x * e2y) - (e1y * e2x);
+    for (int corner = 0; corner < 3; corner++) {
+      float* normal = aNormals + (triangle[corner] * 3);
+      normal[0] += nx;
+      normal[1] += ny;
+      normal[2] += nz;
+    }
+  }
+}
+
+void
+NormalizeVectors(float* aVectors, const size_t aCount) {
+  for (size_t ix = 0; ix < aCount; ix++) {
+    float* vector = aVectors + (ix * 3);
+    const float magnitude = std::sqrt((vector[0] * vector[0]) + (vector[1] * vector[1]) + (vector[2] * vector[2]));
+    if (magnitude > 0.0f) {
+      const float scale = 1.0f / magnitude;
+      vector[0] *= scale;
+      vector[1] *= scale;
+      vector[2] *= scale;
+    }
+  }
+}
+
+void
+TransformPoints(const Matrix& aTransform, const Vector4* aPoints, Vector4* aResult, const size_t aCount) {
+  TransformArray4(aTransform, aPoints, aResult, aCount, true);
+}
+
+void
+TransformNormals(const Matrix& aTransform, const Vector4* aNormals, Vector4* aResult, const size_t aCount) {
+  TransformArray4(aTransform, aNormals, aResult, aCount, false);
+}
+
+void
+ExtendBounds(const Vector4* aPoints, const size_t aCount, Vector& aMin, Vector& aMax) {
+  if (aCount == 0) {
+    return;
+  }
+  Lanes min = Load(aPoints[0].Data());
+  Lanes max = min;
+  for (size_t ix = 1; ix < aCount; ix++) {
+    const Lanes kPoint = Load(aPoints[ix].Data());
+    min = Min(min, kPoint);
+    max = Max(max, kPoint);
+  }
+  FoldBounds(min, max, aMin, aMax);
+}
+
+void
+ExtendBounds(const Vector4* aPoints, const size_t aPointCount, const uint32_t* aIndices, const size_t aIndexCount,
+             const uint32_t aIndexBase, Vector& aMin, Vector& aMax) {
+  bool found = false;
+  Lanes min = Splat(0.0f);
+  Lanes max = min;
+  for (size_t ix = 0; ix < aIndexCount; ix++) {
+    // Indices below the base wrap around and are skipped too.
+    const uint32_t kIndex = aIndices[ix] - aIndexBase;
+    if (kIndex >= aPointCount) {
+      continue;
+    }
+    const Lanes kPoint = Load(aPoints[kIndex].Data());
+    if (!found) {
+      min = max = kPoint;
+      found = true;
+      continue;
+    }
+    min = Min(min, kPoint);
+    max = Max(max, kPoint);
+  }
+  if (found) {
+    FoldBounds(min, max, aMin, aMax);
+  }
+}
+
+void
+AccumulateNormals(const Vector4* aPoints, const uint32_t* aTriangles, const size_t aTriangleCount, Vector4* aNormals) {
+  for (size_t ix = 0; ix < aTriangleCount; ix++) {
+    const uint32_t* triangle = aTriangles + (ix * 3);
+    const Lanes kP0 = Load(aPoints[triangle[0]].Data());
+    const Lanes kE1 = Sub(Load(aPoints[triangle[1]].Data()), kP0);
+    const Lanes kE2 = Sub(Load(aPoints[triangle[2]].Data()), kP0);
+    // (e1 * e2.yzx - e1.yzx * e2).yzx is the unnormalized cross product. The
+    // w lanes cancel to zero.
+    const Lanes kNormal = RotateYZX(Sub(Mul(kE1, RotateYZX(kE2)), Mul(RotateYZX(kE1), kE2)));
+    for (int corner = 0; corner < 3; corner++) {
+      float* normal = aNormals[triangle[corner]].Data();
+      Store(normal, Add(Load(normal), kNormal));
+    }
+  }
+}
+
+void
+NormalizeVectors(Vector4* aVectors, const size_t aCount) {
+  for (size_t ix = 0; ix < aCount; ix++) {
+    float* vector = aVectors[ix].Data();
+    const Lanes kValue = Load(vector);
+    Vector4 squared;
+    Store(squared.Data(), Mul(kValue, kValue));
+    const float magnitude = std::sqrt(squared.x() + squared.y() + squared.z());
+    if (magnitude > 0.0f) {
+      const float scale = 1.0f / magnitude;
+      Store(vector, Mul(kValue, Load(Vector4(scale, scale, scale, 1.0f).Data())));
+    }
+  }
+}
+
+} // namespace vrb
@@ -1,7 +1,7 @@
 #include "vrb/BlockTimer.h"
 
-#include <ctime>
 #include <vrb/Logger.h>
+#include <vrb/TraceProfiler.h>
 
 namespace {
 const double kNanosecondsToSeconds = 1.0e9;
@@ -14,23 +14,23 @@ BlockTimer::BlockTimer(const char* aFileName, const char* aFunctionName, const i
     mFunctionName(aFunctionName ? aFunctionName : "Unknown Function"),
     mLineNumber(aLineNumber),
     mMaxTime(aMaxTime),
-    mStartTime(0.0),
-    mCallback(aCallback) {
-  timespec spec = {};
-  if (clock_gettime(CLOCK_MONOTONIC, &spec) == 0) {
-    mStartTime = (double)spec.tv_sec + (spec.tv_nsec / kNanosecondsToSeconds);
-  }
-}
+    mStartTime(TraceGetTime()),
+    mCallback(aCallback) {}
 
 BlockTimer::~BlockTimer() {
-  timespec spec = {};
-  if (clock_gettime(CLOCK_MONOTONIC, &spec) == 0) {
-    const double value = ((double)spec.tv_sec + (spec.tv_nsec / kNanosecondsToSeconds)) - mStartTime;
-    if (mMaxTime < value) {
-      VRB_ERROR("*** Block overrun: %s:%s[%d] %f(sec) > %f(sec)", mFileName, mFunctionName, mLineNumber, value, mMaxTime);
-      if (mCallback) {
-        mCallback();
-      }
+  const uint64_t end = TraceGetTime();
+  if (!mStartTime || !end) {
+    return;
+  }
+#if defined(VRB_TRACE_ENABLED)
+  // Timed blocks also show up in trace captures.
+  TraceAddEvent(mFunctionName, mStartTime, end);
+#endif
+  const double value = (double)(end - mStartTime) / kNanosecondsToSeconds;
+  if (mMaxTime < value) {
+    VRB_ERROR("*** Block overrun: %s:%s[%d] %f(sec) > %f(sec)", mFileName, mFunctionName, mLineNumber, value, mMaxTime);
+    if (mCallback) {
+      mCallback();
     }
   }
 }
@@ -0,0 +1,117 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+
+namespace {
+
+// Refitted trees are rebuilt once their boxes cover this much more area.
+const float kMaxAreaGrowth = 2.0f;
+
+float
+Axis(const vrb::Vector& aVector, const int32_t aAxis) {
+  return aAxis == 0 ? aVector.x() : (aAxis == 1 ? aVector.y() : aVector.z());
+}
+
+}
+
+namespace vrb {
+
+void
+BoundingVolumeHierarchy::Build(const std::vector<Bounds>& aBounds) {
+  Clear();
+  if (aBounds.empty()) {
+    return;
+  }
+  std::vector<Vector> centers;
+  centers.reserve(aBounds.size());
+  mItems.resize(aBounds.size());
+  for (size_t ix = 0; ix < aBounds.size(); ix++) {
+    mItems[ix] = (uint32_t)ix;
+    centers.push_back(aBounds[ix].Center());
+  }
+  mNodes.reserve(((aBounds.size() / kMaxLeafItems) + 1) * 2);
+  BuildNode(0, (uint32_t)mItems.size(), centers);
+  mItemBounds.resize(mItems.size());
+  // Boxes are computed bottom up once every item is in place.
+  Refit(aBounds);
+  mBuiltArea = TotalArea();
+}
+
+bool
+BoundingVolumeHierarchy::Refit(const std::vector<Bounds>& aBounds) {
+  if (mNodes.empty() || (aBounds.size() != mItems.size())) {
+    return false;
+  }
+  for (size_t ix = 0; ix < mItems.size(); ix++) {
+    mItemBounds[ix] = aBounds[mItems[ix]];
+  }
+  // Children always follow their parent so a reverse walk visits them first.
+  for (size_t ix = mNodes.size(); ix-- > 0;) {
+    Node& node = mNodes[ix];
+    node.bounds = Bounds::Empty();
+    if (node.count > 0) {
+      for (uint32_t item = node.first; item < (node.first + node.count); item++) {
+        node.bounds.Extend(mItemBounds[item]);
+      }
+    } else {
+      node.bounds.Extend(mNodes[ix + 1].bounds);
+      node.bounds.Extend(mNodes[node.first].bounds);
+    }
+  }
+  return TotalArea() <= ((mBuiltArea * kMaxAreaGrowth) + std::numeric_limits<float>::epsilon());
+}
+
+void
+BoundingVolumeHierarchy::Clear() {
+  mNodes.clear();
+  mItems.clear();
+  mItemBounds.clear();
+  mBuiltArea = 0.0f;
+}
+
+uint32_t
+BoundingVolumeHierarchy::BuildNode(const uint32_t aStart, const uint32_t aEnd, const std::vector<Vector>& aCenters) {
+  const uint32_t kIndex = (uint32_t)mNodes.size();
+  mNodes.push_back(Node{Bounds::Empty(), aStart, aEnd - aStart});
+  if ((aEnd - aStart) <= kMaxLeafItems) {
+    return kIndex;
+  }
+  Bounds centers;
+  for (uint32_t ix = aStart; ix < aEnd; ix++) {
+    centers.Extend(aCenters[mItems[ix]]);
+  }
+  const Vector kSize = centers.Max() - centers.Min();
+  int32_t axis = 0;
+  if (kSize.y() > Axis(kSize, axis)) {
+    axis = 1;
+  }
+  if (kSize.z() > Axis(kSize, axis)) {
+    axis = 2;
+  }
+  const uint32_t kMiddle = aStart + ((aEnd - aStart) / 2);
+  std::nth_element(mItems.begin() + aStart, mItems.begin() + kMiddle, mItems.begin() + aEnd,
+                   [&aCenters, axis](const uint32_t aLeft, const uint32_t aRight) {
+    return Axis(aCenters[aLeft], axis) < Axis(aCenters[aRight], axis);
+  });
+  BuildNode(aStart, kMiddle, aCenters);
+  const uint32_t kRight = BuildNode(kMiddle, aEnd, aCenters);
+  mNodes[kIndex].first = kRight;
+  mNodes[kIndex].count = 0;
+  return kIndex;
+}
+
+float
+BoundingVolumeHierarchy::TotalArea() const {
+  float result = 0.0f;
+  for (const Node& node: mNodes) {
+    result += node.bounds.HalfArea();
+  }
+  return result;
+}
+
+} // namespace vrb
@@ -0,0 +1,79 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/private/CacheFile.h"
+
+#include "vrb/Logger.h"
+
+#include <atomic>
+#include <cstdio>
+
+namespace {
+
+std::atomic<uint32_t> sTemporarySerial(0);
+
+std::string
+CreateTemporaryName(const std::string& aPath) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%u.tmp", (unsigned)++sTemporarySerial);
+  return aPath + suffix;
+}
+
+}
+
+namespace vrb {
+
+CacheFileOutput::CacheFileOutput(const std::string& aPath, const char* aKind)
+    : mPath(aPath)
+    , mTemporary(CreateTemporaryName(aPath))
+    , mKind(aKind)
+    , mOutput(mTemporary, std::ios::binary | std::ios::trunc)
+    , mCommitted(false) {
+  if (!mOutput) {
+    VRB_WARN("Unable to write %s: '%s'", mKind, mTemporary.c_str());
+  }
+}
+
+CacheFileOutput::~CacheFileOutput() {
+  if (!mCommitted) {
+    mOutput.close();
+    remove(mTemporary.c_str());
+  }
+}
+
+bool
+CacheFileOutput::IsOpen() const {
+  return mOutput.is_open();
+}
+
+void
+CacheFileOutput::Write(const void* aData, const size_t aSize) {
+  mOutput.write(static_cast<const char*>(aData), aSize);
+}
+
+void
+CacheFileOutput::Write(const CacheFileWriter& aWriter) {
+  Write(aWriter.Buffer().data(), aWriter.Buffer().size());
+}
+
+bool
+CacheFileOutput::Commit() {
+  if (!IsOpen()) {
+    return false;
+  }
+  mOutput.close();
+  if (!mOutput) {
+    VRB_WARN("Failed writing %s: '%s'", mKind, mTemporary.c_str());
+    return false;
+  }
+  if (rename(mTemporary.c_str(), mPath.c_str()) != 0) {
+    VRB_WARN("Unable to replace %s: '%s'", mKind, mPath.c_str());
+    return false;
+  }
+  mCommitted = true;
+  return true;
+}
+
+} // namespace vrb
@@ -17,6 +17,8 @@ CameraEye::State::State()
     , perspective(Matrix::Identity())
     , transform(Matrix::Identity())
     , view(transform.AfineInverse())
+    , viewProjection(perspective.PostMultiply(view))
+    , frustum(viewProjection)
 {}
 
 void
@@ -24,6 +26,8 @@ CameraEye::State::Update() {
   dirty = false;
   transform = headTransform.PostMultiply(eyeTransform);
   view = transform.AfineInverse();
+  viewProjection = perspective.PostMultiply(view);
+  frustum = Frustum(viewProjection);
 }
 
 CameraEyePtr
@@ -49,10 +53,23 @@ CameraEye::GetPerspective() const {
   return m.perspective;
 }
 
+const Matrix&
+CameraEye::GetViewProjection() const {
+  if (m.dirty) { m.Update(); }
+  return m.viewProjection;
+}
+
+const Frustum&
+CameraEye::GetFrustum() const {
+  if (m.dirty) { m.Update(); }
+  return m.frustum;
+}
+
   // CameraEye interface
 void
 CameraEye::SetPerspective(const Matrix& aPerspective) {
   m.perspective = aPerspective;
+  m.dirty = true;
 }
 
 const Matrix&
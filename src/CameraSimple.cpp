@@ -23,6 +23,8 @@ CameraSimple::State::State()
         width, height,
         horizontalFOV, verticalFOV,
         nearClip, farClip))
+    , viewProjection(perspective.PostMultiply(view))
+    , frustum(viewProjection)
 {}
 
 void
@@ -31,6 +33,13 @@ CameraSimple::State::UpdatePerspective() {
       width, height,
       horizontalFOV, verticalFOV,
       nearClip, farClip);
+  UpdateViewProjection();
+}
+
+void
+CameraSimple::State::UpdateViewProjection() {
+  viewProjection = perspective.PostMultiply(view);
+  frustum = Frustum(viewProjection);
 }
 
 CameraSimplePtr
@@ -54,11 +63,22 @@ CameraSimple::GetPerspective() const {
   return m.perspective;
 }
 
+const Matrix&
+CameraSimple::GetViewProjection() const {
+  return m.viewProjection;
+}
+
+const Frustum&
+CameraSimple::GetFrustum() const {
+  return m.frustum;
+}
+
 // CameraSimple interface
 void
 CameraSimple::SetTransform(const Matrix& aTransform) {
   m.transform = aTransform;
   m.view = m.transform.AfineInverse();
+  m.UpdateViewProjection();
 }
 
 float
@@ -0,0 +1,104 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/CameraStereo.h"
+
+#include "vrb/CameraEye.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Frustum.h"
+#include "vrb/Matrix.h"
+
+namespace vrb {
+
+struct CameraStereo::State {
+  CameraEyePtr eyes[2];
+  Matrix identity;
+  Frustum frustum;
+  State() : identity(Matrix::Identity()), frustum(identity) {}
+  const Camera* GetEye(const int aIndex) const {
+    if ((aIndex < 0) || (aIndex > 1)) {
+      return nullptr;
+    }
+    return eyes[aIndex].get();
+  }
+};
+
+CameraStereoPtr
+CameraStereo::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<CameraStereo, CameraStereo::State> >(aContext);
+}
+
+// Camera interface
+const Matrix&
+CameraStereo::GetTransform() const {
+  const Camera* eye = m.GetEye(0);
+  return eye ? eye->GetTransform() : m.identity;
+}
+
+const Matrix&
+CameraStereo::GetView() const {
+  return GetViewAt(0);
+}
+
+const Matrix&
+CameraStereo::GetPerspective() const {
+  return GetPerspectiveAt(0);
+}
+
+const Matrix&
+CameraStereo::GetViewProjection() const {
+  return GetViewProjectionAt(0);
+}
+
+const Frustum&
+CameraStereo::GetFrustum() const {
+  // The eyes change on their own so the planes are rebuilt from their
+  // cached matrices, once per cull.
+  m.frustum = Frustum::FromStereo(GetViewProjectionAt(0), GetViewProjectionAt(1));
+  return m.frustum;
+}
+
+int
+CameraStereo::GetViewCount() const {
+  return 2;
+}
+
+const Matrix&
+CameraStereo::GetViewAt(const int aIndex) const {
+  const Camera* eye = m.GetEye(aIndex);
+  return eye ? eye->GetView() : m.identity;
+}
+
+const Matrix&
+CameraStereo::GetPerspectiveAt(const int aIndex) const {
+  const Camera* eye = m.GetEye(aIndex);
+  return eye ? eye->GetPerspective() : m.identity;
+}
+
+const Matrix&
+CameraStereo::GetViewProjectionAt(const int aIndex) const {
+  const Camera* eye = m.GetEye(aIndex);
+  return eye ? eye->GetViewProjection() : m.identity;
+}
+
+// CameraStereo interface
+void
+CameraStereo::SetEyes(const CameraEyePtr& aLeft, const CameraEyePtr& aRight) {
+  m.eyes[0] = aLeft;
+  m.eyes[1] = aRight;
+}
+
+CameraEyePtr
+CameraStereo::GetEye(const int aIndex) const {
+  if ((aIndex < 0) || (aIndex > 1)) {
+    return nullptr;
+  }
+  return m.eyes[aIndex];
+}
+
+CameraStereo::CameraStereo(State& aState, CreationContextPtr& aContext) : m(aState) {}
+CameraStereo::~CameraStereo() {}
+
+} // namespace vrb
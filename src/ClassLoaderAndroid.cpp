@@ -61,6 +61,10 @@ ClassLoaderAndroid::Shutdown() {
 
 jclass
 ClassLoaderAndroid::FindClass(const std::string& aClassName) const {
+  if (!m.classLoader) {
+    VRB_ERROR("Unable to find class %s, ClassLoaderAndroid is not initialized", aClassName.c_str());
+    return nullptr;
+  }
   jstring name = m.env->NewStringUTF(aClassName.c_str());
   jclass result = (jclass)(m.env->CallObjectMethod(m.classLoader, m.findClass, name));
   VRB_CHECK_JNI_EXCEPTION(m.env);
@@ -5,8 +5,8 @@
 
 #include "vrb/ContextSynchronizer.h"
 #include "vrb/ConcreteClass.h"
-#include "vrb/ConditionVariable.h"
 #include "vrb/Logger.h"
+#include "vrb/Mutex.h"
 #include "vrb/RenderContext.h"
 #include "vrb/ThreadIdentity.h"
 
@@ -15,39 +15,59 @@
 
 #include <pthread.h>
 #include <algorithm>
+#include <atomic>
 #include <vector>
 
-#define ASSERT_ON_CREATION_THREAD()                                          \
-  if (!m.IsOnCreationThread()) {                                             \
-    VRB_ERROR("ContextSynchronizer::%s called on wrong thread", __FUNCTION__); \
-    return;                                                                  \
-  }
-
 namespace vrb {
 
 struct ContextSynchronizer::State {
+  // Lists handed off by the creation thread, waiting to be adopted.
+  struct Batch {
+    ResourceGLList uninitializedResources;
+    ResourceGLList resources;
+    UpdatableList updatables;
+    ContextsSynchronizedLambda callback;
+    Batch* next;
+    Batch() : next(nullptr) {}
+  };
   RenderContextWeak renderContext;
   ThreadIdentityPtr renderThread;
-  ThreadIdentityPtr threadSelf;
-  Mutex observerLock;
+  // Observers are notified every frame but rarely change.
+  RWMutex observerLock;
   std::vector<ContextSynchronizerObserverPtr> observers;
-  ConditionVariable cond;
+  Mutex activeLock;
   bool active;
-  bool waiting;
-  ResourceGLList* uninitializedResources;
-  ResourceGLList* resources;
-  UpdatableList* updatables;
+  // Lock free stack of batches. Creation threads push and only the render
+  // thread takes, so the ABA problem can not occur.
+  std::atomic<Batch*> pending;
 
   State()
-      : threadSelf(0)
-      , active(true)
-      , waiting(false)
-      , uninitializedResources(nullptr)
-      , resources(nullptr)
-      , updatables(nullptr)
+      : active(true)
+      , pending(nullptr)
   {}
-  bool IsOnCreationThread() {
-    return threadSelf->IsOnInitializationThread();
+  ~State() {
+    Batch* batch = pending.exchange(nullptr);
+    while (batch) {
+      Batch* next = batch->next;
+      delete batch;
+      batch = next;
+    }
+  }
+  void Push(Batch* aBatch) {
+    aBatch->next = pending.load(std::memory_order_relaxed);
+    while (!pending.compare_exchange_weak(aBatch->next, aBatch, std::memory_order_release, std::memory_order_relaxed)) {}
+  }
+  // Returns every pending batch in the order it was pushed.
+  Batch* TakeAll() {
+    Batch* batch = pending.exchange(nullptr, std::memory_order_acquire);
+    Batch* result = nullptr;
+    while (batch) {
+      Batch* next = batch->next;
+      batch->next = result;
+      result = batch;
+      batch = next;
+    }
+    return result;
   }
 };
 
@@ -60,20 +80,15 @@ ContextSynchronizer::Create(RenderContextPtr& aContext) {
   return result;
 }
 
-void
-ContextSynchronizer::BindToThread() {
-  m.threadSelf = ThreadIdentity::Create();
-}
-
 void
 ContextSynchronizer::RegisterObserver(ContextSynchronizerObserverPtr& aObserver) {
-  MutexAutoLock lock(m.observerLock);
+  WriteAutoLock lock(m.observerLock);
   m.observers.push_back(aObserver);
 }
 
 void
 ContextSynchronizer::ReleaseObserver(ContextSynchronizerObserverPtr& aObserver) {
-  MutexAutoLock lock(m.observerLock);
+  WriteAutoLock lock(m.observerLock);
   m.observers.erase(std::remove_if(m.observers.begin(), m.observers.end(),
                            [&aObserver](const ContextSynchronizerObserverPtr& value){ return aObserver.get() == value.get(); }),
                     m.observers.end());
@@ -83,8 +98,8 @@ void
 ContextSynchronizer::AdoptLists(
     ResourceGLList& aUninitializedResources,
     ResourceGLList& aResources,
-    UpdatableList& aUpdatables) {
-  ASSERT_ON_CREATION_THREAD();
+    UpdatableList& aUpdatables,
+    const ContextsSynchronizedLambda& aCallback) {
   if (!m.renderThread) {
     VRB_ERROR("ContextSynchronizer failed, no RenderContext defined");
     return;
@@ -103,30 +118,23 @@ ContextSynchronizer::AdoptLists(
     if (aUpdatables.IsDirty()) {
       context->GetUpdatableList().AppendAndAdoptList(aUpdatables);
     }
-  } else {
-    MutexAutoLock lock(m.cond);
-    if (aUninitializedResources.IsDirty()) {
-      m.uninitializedResources = &aUninitializedResources;
-    }
-    if (aResources.IsDirty()) {
-      m.resources = &aResources;
-    }
-    if (aUpdatables.IsDirty()) {
-      m.updatables = &aUpdatables;
-    }
-    if (m.uninitializedResources|| m.resources || m.updatables) {
-      m.waiting = true;
-      while (m.waiting) {
-        if (!m.cond.Wait()) {
-          m.waiting = false;
-          VRB_WARN("Condition variable Wait failed in ContextSynchronizer");
-        }
-      }
-      m.uninitializedResources = nullptr;
-      m.resources = nullptr;
-      m.updatables = nullptr;
+    if (aCallback) {
+      aCallback(context);
     }
+    return;
+  }
+  State::Batch* batch = new State::Batch;
+  if (aUninitializedResources.IsDirty()) {
+    batch->uninitializedResources.AppendAndAdoptList(aUninitializedResources);
+  }
+  if (aResources.IsDirty()) {
+    batch->resources.AppendAndAdoptList(aResources);
+  }
+  if (aUpdatables.IsDirty()) {
+    batch->updatables.AppendAndAdoptList(aUpdatables);
   }
+  batch->callback = aCallback;
+  m.Push(batch);
 }
 
 void
@@ -136,49 +144,51 @@ ContextSynchronizer::Signal(bool& aIsActive) {
     aIsActive = false;
     return;
   }
-  if (!m.threadSelf) {
+  if (!m.renderThread->IsOnInitializationThread()) {
+    VRB_ERROR("ContextSynchronizer::Signal() failed. Must be called on main render thread");
+    aIsActive = false;
     return;
   }
-  if (m.threadSelf->IsSameThread(*m.renderThread)) {
+  {
+    // Read before draining so batches pushed before Release() are still adopted.
+    MutexAutoLock lock(m.activeLock);
     aIsActive = m.active;
-    return;
   }
-  if (!m.renderThread->IsOnInitializationThread()) {
-    VRB_ERROR("ContextSynchronizer::Signal() failed. Must be called on main render thread");
-    aIsActive = false;
+  State::Batch* batch = m.TakeAll();
+  if (!batch) {
     return;
   }
-  MutexAutoLock lock(m.cond);
-  aIsActive = m.active;
-  if (m.waiting) {
-    m.waiting = false;
-    RenderContextPtr context = m.renderContext.lock();
-    if (!context) {
-      return;
-    }
-    if (m.uninitializedResources) {
-      context->GetUninitializedResourceGLList().AppendAndAdoptList(*m.uninitializedResources);
-    }
-    if (m.resources) {
-      context->GetResourceGLList().AppendAndAdoptList(*m.resources);
-    }
-    if (m.updatables) {
-      context->GetUpdatableList().AppendAndAdoptList(*m.updatables);
-    }
-    {
-      MutexAutoLock observerLock(m.observerLock);
-
-      for (ContextSynchronizerObserverPtr& observer: m.observers) {
-        observer->ContextsSynchronized(context);
+  RenderContextPtr context = m.renderContext.lock();
+  while (batch) {
+    State::Batch* next = batch->next;
+    if (context) {
+      if (batch->uninitializedResources.IsDirty()) {
+        context->GetUninitializedResourceGLList().AppendAndAdoptList(batch->uninitializedResources);
+      }
+      if (batch->resources.IsDirty()) {
+        context->GetResourceGLList().AppendAndAdoptList(batch->resources);
+      }
+      if (batch->updatables.IsDirty()) {
+        context->GetUpdatableList().AppendAndAdoptList(batch->updatables);
+      }
+      {
+        ReadAutoLock observerLock(m.observerLock);
+        for (ContextSynchronizerObserverPtr& observer: m.observers) {
+          observer->ContextsSynchronized(context);
+        }
+      }
+      if (batch->callback) {
+        batch->callback(context);
       }
     }
-    m.cond.Signal();
+    delete batch;
+    batch = next;
   }
 }
 
 void
 ContextSynchronizer::Release() {
-  MutexAutoLock lock(m.cond);
+  MutexAutoLock lock(m.activeLock);
   m.active = false;
 }
 
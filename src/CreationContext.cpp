@@ -9,47 +9,56 @@
 #include "vrb/ContextSynchronizer.h"
 #include "vrb/DataCache.h"
 #include "vrb/FileReader.h"
+#include "vrb/LoadReport.h"
 #include "vrb/Logger.h"
 #include "vrb/RenderContext.h"
 #include "vrb/TextureCache.h"
+#include "vrb/TextureDiskCache.h"
 #include "vrb/TextureGL.h"
 
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/private/UpdatableState.h"
 
+#include <atomic>
 #include <pthread.h>
 
-#define ASSERT_ON_CREATION_THREAD()                                          \
-  if (pthread_equal(m.threadSelf, pthread_self()) == 0) {                    \
-    VRB_ERROR("CreationContext::%s called on wrong thread", __FUNCTION__);     \
-    return;                                                                  \
-  }
-
 namespace {
 
+std::atomic<uint64_t> sContextSerial(0);
+
 class TextureHandler;
 typedef std::shared_ptr<TextureHandler> TextureHandlerPtr;
 
 class TextureHandler : public vrb::FileHandler {
 public:
-  static TextureHandlerPtr Create(const vrb::TextureGLPtr& aTexture);
+  // Decoded images are stored in aDiskCache, when not null, under aFileName and aKey.
+  static TextureHandlerPtr Create(const vrb::TextureGLPtr& aTexture, const vrb::TextureDiskCachePtr& aDiskCache,
+                                  const std::string& aFileName, const uint64_t aKey);
   void BindFileHandle(const std::string& aFileName, const int aFileHandle) override;
   void LoadFailed(const int aFileHandle, const std::string& aReason) override;
   void ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) override {};
   void FinishRawFile(const int aFileHandle) override {};
   void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) override;
-  TextureHandler() {}
+  void ProcessImageLevels(const int aFileHandle, std::vector<vrb::ImageLevel>& aLevels) override;
+  TextureHandler() : mKey(0) {}
   ~TextureHandler() {}
 protected:
   vrb::TextureGLPtr mTexture;
+  vrb::TextureDiskCachePtr mDiskCache;
+  std::string mFileName;
+  uint64_t mKey;
 private:
   VRB_NO_DEFAULTS(TextureHandler)
 };
 
 TextureHandlerPtr
-TextureHandler::Create(const vrb::TextureGLPtr& aTexture) {
+TextureHandler::Create(const vrb::TextureGLPtr& aTexture, const vrb::TextureDiskCachePtr& aDiskCache,
+                       const std::string& aFileName, const uint64_t aKey) {
   TextureHandlerPtr result = std::make_shared<TextureHandler>();
   result->mTexture = aTexture;
+  result->mDiskCache = aDiskCache;
+  result->mFileName = aFileName;
+  result->mKey = aKey;
   return result;
 }
 
@@ -65,30 +74,192 @@ TextureHandler::LoadFailed(const int aFileHandle, const std::string& aReason) {
 
 void
 TextureHandler::ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
+  if (mDiskCache && aImage) {
+    std::vector<vrb::ImageLevel> levels(1);
+    vrb::ImageLevel& level = levels.front();
+    level.data = std::move(aImage);
+    level.length = aImageLength;
+    level.width = aWidth;
+    level.height = aHeight;
+    level.format = aFormat;
+    mDiskCache->StoreLevels(mFileName, mKey, levels);
+    aImage = std::move(level.data);
+  }
   if (mTexture) {
     mTexture->SetImageData(aImage, aImageLength, aWidth, aHeight, aFormat);
   }
 }
 
+void
+TextureHandler::ProcessImageLevels(const int aFileHandle, std::vector<vrb::ImageLevel>& aLevels) {
+  if (mDiskCache) {
+    mDiskCache->StoreLevels(mFileName, mKey, aLevels);
+  }
+  if (mTexture) {
+    mTexture->SetImageLevels(aLevels);
+  }
+}
+
+// Uses the levels stored by an earlier run when the source has not changed,
+// otherwise reads and decodes the source and stores the result.
+void
+ReadTexture(const vrb::FileReaderPtr& aReader, const vrb::TextureDiskCachePtr& aDiskCache,
+            const std::string& aFileName, const vrb::TextureGLPtr& aTexture) {
+  uint64_t key = 0;
+  const bool kCached = aDiskCache && aDiskCache->GetSourceKey(aFileName, *aReader, key);
+  if (kCached) {
+    std::vector<vrb::ImageLevel> levels;
+    if (aDiskCache->LoadLevels(aFileName, key, levels)) {
+      aTexture->SetImageLevels(levels);
+      return;
+    }
+  }
+  aReader->ReadImageFile(aFileName, TextureHandler::Create(aTexture, kCached ? aDiskCache : nullptr, aFileName, key));
+}
+
 }
 
 namespace vrb {
 
 struct CreationContext::State {
+  // Resources created by a thread other than the bound one. Each thread
+  // appends to its own staging without locking and hands it to the render
+  // thread when it synchronizes. Stagings are kept until the context is
+  // destroyed so a thread that exits leaves one for the next thread with
+  // the same id.
+  struct Staging {
+    pthread_t thread;
+    ResourceGLList uninitializedResources;
+    ResourceGLList resources;
+    UpdatableList updatables;
+    Staging* next;
+    Staging() : thread(pthread_self()), next(nullptr) {}
+  };
   CreationContextWeak self;
   ContextSynchronizerPtr sync;
   ResourceGLList uninitializedResources;
   ResourceGLList resources;
   UpdatableList updatables;
   FileReaderPtr fileReader;
+  GLExtensionsPtr glExtensions;
   ProgramFactoryPtr programFactory;
   DataCachePtr dataCache;
   TextureCachePtr textureCache;
+  TextureDiskCachePtr textureDiskCache;
+  JobSystemPtr jobSystem;
+  KTX2DecoderPtr ktx2Decoder;
+  StreamBufferPtr streamBuffer;
+  GLDeletionQueuePtr glDeletions;
+  MaterialRegistryPtr materials;
+  SamplerCachePtr samplers;
   pthread_t threadSelf;
+  bool bound;
+  // Push only stack of stagings, entries are never removed while in use.
+  std::atomic<Staging*> stagings;
+  // Tells apart contexts allocated at the same address for the staging
+  // lookup cache.
+  const uint64_t serial;
+
+  State()
+      : threadSelf()
+      , bound(false)
+      , stagings(nullptr)
+      , serial(++sContextSerial)
+  {}
+  ~State() {
+    Staging* staging = stagings.exchange(nullptr);
+    while (staging) {
+      Staging* next = staging->next;
+      delete staging;
+      staging = next;
+    }
+  }
+
+  bool IsOnBoundThread() const {
+    return bound && (pthread_equal(threadSelf, pthread_self()) != 0);
+  }
+
+  Staging* GetStaging() {
+    // Most threads only use one context, remember the last lookup.
+    static thread_local uint64_t sLastSerial = 0;
+    static thread_local Staging* sLastStaging = nullptr;
+    if (sLastSerial == serial) {
+      return sLastStaging;
+    }
+    const pthread_t self = pthread_self();
+    Staging* result = stagings.load(std::memory_order_acquire);
+    while (result && (pthread_equal(result->thread, self) == 0)) {
+      result = result->next;
+    }
+    if (!result) {
+      result = new Staging;
+      result->next = stagings.load(std::memory_order_relaxed);
+      while (!stagings.compare_exchange_weak(result->next, result, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+    sLastSerial = serial;
+    sLastStaging = result;
+    return result;
+  }
 
-  State() {}
+  TextureGLPtr LoadTexture(const AssetID aTextureID, const bool aUseCache, const JobSystem::JobHandle& aGroup);
 };
 
+TextureGLPtr
+CreationContext::State::LoadTexture(const AssetID aTextureID, const bool aUseCache, const JobSystem::JobHandle& aGroup) {
+  if (aTextureID == kInvalidAssetID) {
+    return textureCache->GetDefaultTexture();
+  }
+  const std::string& textureName = GetAssetName(aTextureID);
+  TextureGLPtr result;
+  if (aUseCache) {
+    result = textureCache->FindTexture(aTextureID);
+    if (result) {
+      return result;
+    }
+  }
+
+  if (!fileReader) {
+    return textureCache->GetDefaultTexture();
+  }
+
+  CreationContextPtr context = self.lock();
+  if (!context) {
+    return textureCache->GetDefaultTexture();
+  }
+  result = TextureGL::Create(context);
+  textureCache->AddTexture(aTextureID, result);
+  result->SetName(textureName);
+  FileReaderPtr reader = fileReader;
+  TextureDiskCachePtr diskCache = textureDiskCache;
+  // The texture owns the loader so it only holds a weak reference back.
+  std::weak_ptr<TextureGL> weak = result;
+  const std::function<void()> kRead = [reader, diskCache, weak, textureName]() {
+    TextureGLPtr texture = weak.lock();
+    if (texture) {
+      ReadTexture(reader, diskCache, textureName, texture);
+    }
+  };
+  // Lets TextureGL::ReleaseImageData() drop the image under memory pressure.
+  result->SetReload(kRead);
+  if (textureCache->IsDeferredLoading()) {
+    result->SetPlaceholder(textureCache->GetDefaultTexture());
+    result->SetDeferredLoad(kRead);
+  } else if (aGroup && jobSystem && reader->SupportsConcurrentReads()) {
+    TextureGLPtr texture = result;
+    LoadReportCollectorPtr report = LoadReportCollector::GetCurrent();
+    jobSystem->Schedule([reader, diskCache, texture, textureName, report]() {
+      LoadReportScope scope(report);
+      LoadReportTimer timer(LoadReport::Phase::TextureDecode);
+      ReadTexture(reader, diskCache, textureName, texture);
+    }, aGroup);
+  } else {
+    LoadReportTimer timer(LoadReport::Phase::TextureDecode);
+    ReadTexture(reader, diskCache, textureName, result);
+  }
+
+  return result;
+}
+
 CreationContextPtr
 CreationContext::Create(RenderContextPtr& aContext) {
   if (!aContext->IsOnRenderThread()) {
@@ -98,9 +269,17 @@ CreationContext::Create(RenderContextPtr& aContext) {
   CreationContextPtr result = std::make_shared<ConcreteClass<CreationContext, CreationContext::State> >();
   result->m.self = result;
   result->m.sync = ContextSynchronizer::Create(aContext);
+  result->m.glExtensions = aContext->GetGLExtensions();
   result->m.programFactory = aContext->GetProgramFactory();
   result->m.dataCache = aContext->GetDataCache();
   result->m.textureCache = aContext->GetTextureCache();
+  result->m.textureDiskCache = aContext->GetTextureDiskCache();
+  result->m.jobSystem = aContext->GetJobSystem();
+  result->m.ktx2Decoder = aContext->GetKTX2Decoder();
+  result->m.streamBuffer = aContext->GetStreamBuffer();
+  result->m.glDeletions = aContext->GetGLDeletionQueue();
+  result->m.materials = aContext->GetMaterialRegistry();
+  result->m.samplers = aContext->GetSamplerCache();
   return result;
 }
 
@@ -118,17 +297,33 @@ void
 CreationContext::BindToThread() {
   VRB_LOG("CreationContext::BindToThread()");
   m.threadSelf = pthread_self();
-  m.sync->BindToThread();
+  m.bound = true;
 }
 
 void
 CreationContext::Synchronize() {
-  ASSERT_ON_CREATION_THREAD();
+  if (!m.IsOnBoundThread()) {
+    State::Staging* staging = m.GetStaging();
+    if (staging->uninitializedResources.IsDirty() || staging->resources.IsDirty() || staging->updatables.IsDirty()) {
+      m.sync->AdoptLists(staging->uninitializedResources, staging->resources, staging->updatables, nullptr);
+    }
+    return;
+  }
   if (m.uninitializedResources.IsDirty() || m.resources.IsDirty() || m.updatables.IsDirty()) {
-    m.sync->AdoptLists(m.uninitializedResources, m.resources, m.updatables);
+    m.sync->AdoptLists(m.uninitializedResources, m.resources, m.updatables, nullptr);
   }
 }
 
+void
+CreationContext::Synchronize(const ContextsSynchronizedLambda& aCallback) {
+  if (!m.IsOnBoundThread()) {
+    State::Staging* staging = m.GetStaging();
+    m.sync->AdoptLists(staging->uninitializedResources, staging->resources, staging->updatables, aCallback);
+    return;
+  }
+  m.sync->AdoptLists(m.uninitializedResources, m.resources, m.updatables, aCallback);
+}
+
 void
 CreationContext::SetFileReader(FileReaderPtr aFileReader) {
   m.fileReader = std::move(aFileReader);
@@ -144,35 +339,64 @@ CreationContext::GetFileReader() {
   return m.fileReader;
 }
 
+GLExtensionsPtr
+CreationContext::GetGLExtensions() {
+  return m.glExtensions;
+}
+
+JobSystemPtr
+CreationContext::GetJobSystem() {
+  return m.jobSystem;
+}
+
+KTX2DecoderPtr
+CreationContext::GetKTX2Decoder() {
+  return m.ktx2Decoder;
+}
+
+MaterialRegistryPtr
+CreationContext::GetMaterialRegistry() {
+  return m.materials;
+}
+
 ProgramFactoryPtr
 CreationContext::GetProgramFactory() {
   return m.programFactory;
 }
 
+TextureDiskCachePtr
+CreationContext::GetTextureDiskCache() {
+  return m.textureDiskCache;
+}
+
+SamplerCachePtr
+CreationContext::GetSamplerCache() {
+  return m.samplers;
+}
+
+StreamBufferPtr
+CreationContext::GetStreamBuffer() {
+  return m.streamBuffer;
+}
+
+GLDeletionQueuePtr
+CreationContext::GetGLDeletionQueue() {
+  return m.glDeletions;
+}
+
 TextureGLPtr
 CreationContext::LoadTexture(const std::string& aTextureName, const bool aUseCache) {
-  TextureGLPtr result;
-  if (aUseCache) {
-    result = m.textureCache->FindTexture(aTextureName);
-    if (result) {
-      return result;
-    }
-  }
-
-  if (!m.fileReader) {
-    return m.textureCache->GetDefaultTexture();
-  }
+  return LoadTexture(InternAsset(aTextureName), aUseCache);
+}
 
-  CreationContextPtr context = m.self.lock();
-  if (!context) {
-    return m.textureCache->GetDefaultTexture();
-  }
-  result = TextureGL::Create(context);
-  m.textureCache->AddTexture(aTextureName, result);
-  m.fileReader->ReadImageFile(aTextureName, TextureHandler::Create(result));
-  result->SetName(aTextureName);
+TextureGLPtr
+CreationContext::LoadTexture(const AssetID aTextureID, const bool aUseCache) {
+  return m.LoadTexture(aTextureID, aUseCache, nullptr);
+}
 
-  return result;
+TextureGLPtr
+CreationContext::PrefetchTexture(const AssetID aTextureID, const JobSystem::JobHandle& aGroup) {
+  return m.LoadTexture(aTextureID, true, aGroup);
 }
 
 void
@@ -186,13 +410,19 @@ CreationContext::UpdateResourceGL() {
 
 void
 CreationContext::AddResourceGL(ResourceGL* aResource) {
-  ASSERT_ON_CREATION_THREAD();
+  if (!m.IsOnBoundThread()) {
+    m.GetStaging()->uninitializedResources.Append(aResource);
+    return;
+  }
   m.uninitializedResources.Append(aResource);
 }
 
 void
 CreationContext::AddUpdatable(Updatable* aUpdatable) {
-  ASSERT_ON_CREATION_THREAD();
+  if (!m.IsOnBoundThread()) {
+    m.GetStaging()->updatables.Append(aUpdatable);
+    return;
+  }
   m.updatables.Append(aUpdatable);
 }
 
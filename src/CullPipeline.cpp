@@ -0,0 +1,143 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/CullPipeline.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/CullVisitor.h"
+#include "vrb/DrawableList.h"
+#include "vrb/JobSystem.h"
+#include "vrb/Node.h"
+#include "vrb/ParallelCuller.h"
+#include "vrb/SceneSnapshot.h"
+#include "vrb/TraceProfiler.h"
+
+namespace vrb {
+
+struct CullPipeline::State {
+  CreationContextWeak context;
+  JobSystemPtr jobs;
+  DrawableListPtr lists[2];
+  // A ParallelCuller reuses its segments on its next pass, so each list has
+  // its own.
+  ParallelCullerPtr cullers[2];
+  // List filled by Cull(), the other one is drawn.
+  int32_t back;
+  bool parallel;
+  JobSystem::JobHandle pending;
+
+  State()
+      : back(0)
+      , parallel(false)
+  {}
+
+  void Finish() {
+    if (pending) {
+      jobs->Wait(pending);
+      pending = nullptr;
+    }
+  }
+
+  void Start(JobSystem::Task&& aTask) {
+    // Culling twice before a Draw replaces the first result.
+    Finish();
+    lists[back]->Reset();
+    if (!jobs) {
+      aTask();
+      return;
+    }
+    pending = jobs->Schedule(std::move(aTask));
+  }
+};
+
+CullPipelinePtr
+CullPipeline::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<CullPipeline, CullPipeline::State> >(aContext);
+}
+
+void
+CullPipeline::Cull(const NodePtr& aRoot, CullVisitor& aVisitor) {
+  if (!aRoot) {
+    return;
+  }
+  NodePtr root = aRoot;
+  CullVisitor* visitor = &aVisitor;
+  DrawableList* list = m.lists[m.back].get();
+  m.Start([root, visitor, list]() {
+    VRB_TRACE_ZONE("CullPipeline::Cull");
+    root->Cull(*visitor, *list);
+  });
+}
+
+void
+CullPipeline::Cull(const SceneSnapshotPtr& aSnapshot, CullVisitor& aVisitor) {
+  if (!aSnapshot) {
+    return;
+  }
+  ParallelCullerPtr culler;
+  if (m.parallel) {
+    CreationContextPtr context = m.context.lock();
+    if (!m.cullers[m.back] && context) {
+      m.cullers[m.back] = ParallelCuller::Create(context);
+    }
+    culler = m.cullers[m.back];
+  }
+  // Set before the job starts, the snapshot is only used by the job after that.
+  m.Finish();
+  aSnapshot->SetParallelCuller(culler);
+  SceneSnapshotPtr snapshot = aSnapshot;
+  CullVisitor* visitor = &aVisitor;
+  DrawableList* list = m.lists[m.back].get();
+  m.Start([snapshot, visitor, list]() {
+    VRB_TRACE_ZONE("CullPipeline::Cull");
+    snapshot->Cull(*visitor, *list);
+  });
+}
+
+void
+CullPipeline::Draw(const Camera& aCamera) {
+  VRB_TRACE_ZONE("CullPipeline::Draw");
+  const int32_t kFront = 1 - m.back;
+  m.lists[kFront]->Draw(aCamera);
+  m.Finish();
+  // Releases the drawables of the frame on the render thread.
+  m.lists[kFront]->Reset();
+  m.back = kFront;
+}
+
+void
+CullPipeline::Flush() {
+  m.Finish();
+  m.lists[0]->Reset();
+  m.lists[1]->Reset();
+}
+
+void
+CullPipeline::SetParallelCulling(const bool aEnabled) {
+  m.parallel = aEnabled;
+}
+
+void
+CullPipeline::SetSortingEnabled(const bool aEnabled) {
+  m.Finish();
+  m.lists[0]->SetSortingEnabled(aEnabled);
+  m.lists[1]->SetSortingEnabled(aEnabled);
+}
+
+CullPipeline::CullPipeline(State& aState, CreationContextPtr& aContext) : m(aState) {
+  m.context = aContext;
+  m.jobs = aContext->GetJobSystem();
+  for (DrawableListPtr& list: m.lists) {
+    list = DrawableList::Create(aContext);
+    list->SetRetainDrawables(true);
+  }
+}
+
+CullPipeline::~CullPipeline() {
+  Flush();
+}
+
+} // namespace vrb
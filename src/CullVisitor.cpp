@@ -6,19 +6,14 @@
 #include "vrb/CullVisitor.h"
 #include "vrb/private/CullVisitorState.h"
 
+#include "vrb/Bounds.h"
+#include "vrb/Camera.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/OcclusionCuller.h"
 
-namespace vrb {
+#include <limits>
 
-void
-CullVisitor::State::Reset() {
-  TransformNode* current = transformList;
-  while (current) {
-    TransformNode* tmp = current;
-    current = current->prev;
-    delete tmp;
-  }
-}
+namespace vrb {
 
 CullVisitorPtr
 CullVisitor::Create(CreationContextPtr& aContext) {
@@ -27,32 +22,132 @@ CullVisitor::Create(CreationContextPtr& aContext) {
 
 const Matrix&
 CullVisitor::GetTransform() const {
-  if (!m.transformList) {
-    return m.identity;
-  }
-
-  return m.transformList->transform;
+  return m.Current();
 }
 
 void
 CullVisitor::PushTransform(const Matrix& aTransform) {
-  State::TransformNode* node = new State::TransformNode;
-  if (m.transformList) {
-    node->transform = m.transformList->transform.PostMultiply(aTransform);
+  const Matrix transform = m.depth > 0 ? m.transforms[m.depth - 1].PostMultiply(aTransform) : aTransform;
+  if (m.depth < m.transforms.size()) {
+    m.transforms[m.depth] = transform;
   } else {
-    node->transform = aTransform;
+    m.transforms.push_back(transform);
   }
-  node->prev = m.transformList;
-  m.transformList = node;
+  m.depth++;
+}
+
+void
+CullVisitor::PushAffineTransform(const Matrix& aTransform) {
+  const Matrix transform = m.depth > 0 ? m.transforms[m.depth - 1].AffinePostMultiply(aTransform) : aTransform;
+  if (m.depth < m.transforms.size()) {
+    m.transforms[m.depth] = transform;
+  } else {
+    m.transforms.push_back(transform);
+  }
+  m.depth++;
 }
 
 void
 CullVisitor::PopTransform() {
-  State::TransformNode* node = m.transformList;
-  if (node) {
-    m.transformList = node->prev;
-    delete node;
+  if (m.depth > 0) {
+    m.depth--;
+  }
+}
+
+void
+CullVisitor::Reset() {
+  m.depth = 0;
+}
+
+void
+CullVisitor::Inherit(const CullVisitor& aParent) {
+  const State& parent = aParent.m;
+  m.frustum = parent.frustum;
+  m.frustumEnabled = parent.frustumEnabled;
+  m.eye = parent.eye;
+  m.projectionScale = parent.projectionScale;
+  m.cameraEnabled = parent.cameraEnabled;
+  m.occlusion = parent.occlusion;
+  m.depth = 0;
+  if (parent.depth > 0) {
+    PushTransform(parent.Current());
+  }
+}
+
+void
+CullVisitor::SetFrustum(const Frustum& aFrustum) {
+  m.frustum = aFrustum;
+  m.frustumEnabled = true;
+}
+
+void
+CullVisitor::ClearFrustum() {
+  m.frustumEnabled = false;
+}
+
+bool
+CullVisitor::IsVisible(const Bounds& aBounds) const {
+  if (!m.frustumEnabled || aBounds.IsInfinite()) {
+    return true;
+  }
+  if (m.depth == 0) {
+    return m.frustum.Intersects(aBounds);
+  }
+  return m.frustum.Intersects(aBounds.Transform(m.Current()));
+}
+
+void
+CullVisitor::SetCamera(const Camera& aCamera) {
+  m.eye = aCamera.GetTransform().GetTranslation();
+  m.projectionScale = aCamera.GetPerspective().At(1, 1);
+  m.cameraEnabled = true;
+}
+
+void
+CullVisitor::ClearCamera() {
+  m.cameraEnabled = false;
+}
+
+bool
+CullVisitor::GetEye(Vector& aEye) const {
+  if (!m.cameraEnabled) {
+    return false;
+  }
+  aEye = m.eye;
+  return true;
+}
+
+float
+CullVisitor::GetScreenCoverage(const Bounds& aBounds) const {
+  if (!m.cameraEnabled || aBounds.IsInfinite()) {
+    return std::numeric_limits<float>::max();
+  }
+  if (aBounds.IsEmpty()) {
+    return 0.0f;
+  }
+  const Bounds kWorld = m.depth > 0 ? aBounds.Transform(m.Current()) : aBounds;
+  const float kRadius = kWorld.Extents().Magnitude();
+  const float kDistance = (kWorld.Center() - m.eye).Magnitude();
+  if (kDistance <= kRadius) {
+    return std::numeric_limits<float>::max();
+  }
+  return (kRadius * m.projectionScale) / kDistance;
+}
+
+void
+CullVisitor::SetOcclusionCuller(const OcclusionCullerPtr& aCuller) {
+  m.occlusion = aCuller;
+}
+
+bool
+CullVisitor::IsOccluded(const Node& aNode, const Bounds& aBounds) {
+  if (!m.occlusion || aBounds.IsEmpty() || aBounds.IsInfinite()) {
+    return false;
+  }
+  if (m.depth == 0) {
+    return m.occlusion->IsOccluded(aNode, aBounds);
   }
+  return m.occlusion->IsOccluded(aNode, aBounds.Transform(m.Current()));
 }
 
 CullVisitor::CullVisitor(State& aState, CreationContextPtr& aContext) : m(aState) {}
@@ -5,40 +5,307 @@
 
 #include "vrb/DataCache.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/private/Clock.h"
+#include "vrb/private/LittleEndian.h"
 
+#include "vrb/ConditionVariable.h"
 #include "vrb/Logger.h"
-#include "vrb/Mutex.h"
 
+#include <algorithm>
+#include <cstring>
+#include <deque>
 #include <fcntl.h>
+#include <map>
+#include <memory>
+#include <pthread.h>
 #include <string>
+#include <sys/mman.h>
 #include <sys/types.h>
-#include <sys/uio.h>
 #include <unistd.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace {
 static const std::string sFilePrefix = "/vrb_data_cache_";
-struct CachedData {
+// Cache files are created and mapped in segments of at least this size.
+// Segments are never remapped so views returned by MapData stay valid.
+const size_t kSegmentSize = 64 * 1024 * 1024;
+const size_t kAlignment = 64;
+// Bytes of data waiting for the writer thread. Once exceeded CacheData
+// writes inline.
+const size_t kMaxPendingBytes = 64 * 1024 * 1024;
+
+size_t
+Align(const size_t aSize) {
+  return (aSize + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+// A shared mapping of one cache file with a first fit offset allocator.
+struct Segment {
   std::string path;
+  int file;
+  uint8_t* data;
   size_t size;
+  // Free blocks keyed by offset.
+  std::map<size_t, size_t> freeBlocks;
 
-  CachedData() : size(0) {}
-  CachedData(const CachedData& aData) : path(aData.path), size(aData.size) {}
-  CachedData& operator=(const CachedData& aData) {
-    path = aData.path;
-    size = aData.size;
-    return *this;
+  Segment() : file(-1), data(nullptr), size(0) {}
+  ~Segment() {
+    if (data) {
+      munmap(data, size);
+    }
+    if (file >= 0) {
+      close(file);
+      if (remove(path.c_str()) < 0) {
+        VRB_ERROR("Failed to remove cache file: %s", path.c_str());
+      }
+    }
+  }
+
+  bool Open(const std::string& aPath, const size_t aSize) {
+    path = aPath;
+    file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0660);
+    if (file < 0) {
+      VRB_ERROR("Failed to open cache file: %s", path.c_str());
+      return false;
+    }
+    // The blocks are reserved up front, a store through the mapping into a
+    // page the disk has no room for would raise SIGBUS.
+    const int kError = posix_fallocate(file, 0, (off_t)aSize);
+    if (kError != 0) {
+      VRB_ERROR("Failed to reserve %u bytes for cache file: %s (%s)", (uint32_t)aSize, path.c_str(), strerror(kError));
+      return false;
+    }
+    void* mapping = mmap(nullptr, aSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (mapping == MAP_FAILED) {
+      VRB_ERROR("Failed to map cache file: %s", path.c_str());
+      return false;
+    }
+    data = static_cast<uint8_t*>(mapping);
+    size = aSize;
+    freeBlocks[0] = size;
+    return true;
+  }
+
+  bool Allocate(const size_t aSize, size_t& aOffset) {
+    for (auto block = freeBlocks.begin(); block != freeBlocks.end(); block++) {
+      if (block->second < aSize) {
+        continue;
+      }
+      aOffset = block->first;
+      const size_t kRemaining = block->second - aSize;
+      freeBlocks.erase(block);
+      if (kRemaining > 0) {
+        freeBlocks[aOffset + aSize] = kRemaining;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void Free(const size_t aOffset, const size_t aSize) {
+    auto block = freeBlocks.emplace(aOffset, aSize).first;
+    auto next = std::next(block);
+    if ((next != freeBlocks.end()) && (block->first + block->second == next->first)) {
+      block->second += next->second;
+      freeBlocks.erase(next);
+    }
+    if (block != freeBlocks.begin()) {
+      auto prev = std::prev(block);
+      if (prev->first + prev->second == block->first) {
+        prev->second += block->second;
+        freeBlocks.erase(block);
+      }
+    }
   }
-};
-class CloseFileOnReturn {
-  int file;
-public:
-  CloseFileOnReturn(const int aFile) : file(aFile) {}
-  ~CloseFileOnReturn() { if (file >= 0) { close(file); } }
 private:
-  CloseFileOnReturn() = delete;
-  VRB_NO_DEFAULTS(CloseFileOnReturn)
-  VRB_NO_NEW_DELETE
+  VRB_NO_DEFAULTS(Segment)
+};
+
+// Minimal LZ4 block format codec. Only used for DataCache entries so the
+// stream never leaves this process.
+const size_t kLZ4MinMatch = 4;
+const size_t kLZ4LastLiterals = 5;
+const size_t kLZ4MatchFindLimit = 12;
+const size_t kLZ4MaxOffset = 65535;
+const int kLZ4HashLog = 14;
+
+size_t
+LZ4Bound(const size_t aSize) {
+  return aSize + (aSize / 255) + 16;
+}
+
+bool
+LZ4WriteLength(size_t aLength, uint8_t*& aTarget, const uint8_t* aEnd) {
+  while (aLength >= 255) {
+    if (aTarget >= aEnd) { return false; }
+    *aTarget++ = 255;
+    aLength -= 255;
+  }
+  if (aTarget >= aEnd) { return false; }
+  *aTarget++ = (uint8_t)aLength;
+  return true;
+}
+
+// Emits literals [aAnchor, aMatchStart) followed by a match of aMatchLength
+// bytes at aOffset, or only the literals when aMatchLength is zero.
+bool
+LZ4WriteSequence(const uint8_t* aLiterals, const size_t aLiteralLength, const size_t aMatchLength,
+                 const size_t aOffset, uint8_t*& aTarget, const uint8_t* aEnd) {
+  if (aTarget >= aEnd) { return false; }
+  uint8_t* token = aTarget++;
+  *token = (uint8_t)(std::min(aLiteralLength, (size_t)15) << 4);
+  if ((aLiteralLength >= 15) && !LZ4WriteLength(aLiteralLength - 15, aTarget, aEnd)) {
+    return false;
+  }
+  if ((size_t)(aEnd - aTarget) < aLiteralLength) { return false; }
+  memcpy(aTarget, aLiterals, aLiteralLength);
+  aTarget += aLiteralLength;
+  if (aMatchLength == 0) {
+    return true;
+  }
+  if ((aEnd - aTarget) < 2) { return false; }
+  *aTarget++ = (uint8_t)(aOffset & 0xff);
+  *aTarget++ = (uint8_t)(aOffset >> 8);
+  const size_t kLength = aMatchLength - kLZ4MinMatch;
+  *token |= (uint8_t)std::min(kLength, (size_t)15);
+  if ((kLength >= 15) && !LZ4WriteLength(kLength - 15, aTarget, aEnd)) {
+    return false;
+  }
+  return true;
+}
+
+// Returns the compressed size or zero if it does not fit in aCapacity.
+size_t
+LZ4Compress(const uint8_t* aSource, const size_t aSize, uint8_t* aTarget, const size_t aCapacity) {
+  uint8_t* target = aTarget;
+  const uint8_t* kEnd = aTarget + aCapacity;
+  size_t anchor = 0;
+  if (aSize >= kLZ4MatchFindLimit) {
+    std::vector<uint32_t> table((size_t)1 << kLZ4HashLog, 0);
+    const size_t kMatchLimit = aSize - kLZ4LastLiterals;
+    size_t misses = 0;
+    size_t ip = 0;
+    while (ip + kLZ4MatchFindLimit <= aSize) {
+      const uint32_t kSequence = vrb::ReadLittleEndian32(aSource + ip);
+      const uint32_t kHash = (kSequence * 2654435761u) >> (32 - kLZ4HashLog);
+      const size_t kCandidate = table[kHash];
+      table[kHash] = (uint32_t)(ip + 1);
+      if ((kCandidate == 0) || ((ip - (kCandidate - 1)) > kLZ4MaxOffset) ||
+          (vrb::ReadLittleEndian32(aSource + kCandidate - 1) != kSequence)) {
+        // Skip faster through data that does not compress.
+        ip += 1 + (misses++ >> 6);
+        continue;
+      }
+      misses = 0;
+      const size_t kReference = kCandidate - 1;
+      size_t length = kLZ4MinMatch;
+      while ((ip + length < kMatchLimit) && (aSource[kReference + length] == aSource[ip + length])) {
+        length++;
+      }
+      if (!LZ4WriteSequence(aSource + anchor, ip - anchor, length, ip - kReference, target, kEnd)) {
+        return 0;
+      }
+      ip += length;
+      anchor = ip;
+    }
+  }
+  if (!LZ4WriteSequence(aSource + anchor, aSize - anchor, 0, 0, target, kEnd)) {
+    return 0;
+  }
+  return (size_t)(target - aTarget);
+}
+
+// Rejects any stream that would read past aSource, write past aTarget or
+// copy a match from before aTarget. Following the block format, the stream
+// has to end with literals and matches must leave kLZ4LastLiterals bytes.
+bool
+LZ4Decompress(const uint8_t* aSource, const size_t aSize, uint8_t* aTarget, const size_t aTargetSize) {
+  size_t ip = 0;
+  size_t op = 0;
+  // Lengths never exceed the target, so a longer run is corrupt and the sum
+  // can not overflow.
+  auto readLength = [&](size_t& aLength) -> bool {
+    uint8_t value = 255;
+    while (value == 255) {
+      if ((ip >= aSize) || (aLength > aTargetSize)) { return false; }
+      value = aSource[ip++];
+      aLength += value;
+    }
+    return true;
+  };
+  if (aSize == 0) {
+    return false;
+  }
+  while (ip < aSize) {
+    const uint8_t kToken = aSource[ip++];
+    size_t literals = kToken >> 4;
+    if ((literals == 15) && !readLength(literals)) {
+      return false;
+    }
+    if ((literals > aSize - ip) || (literals > aTargetSize - op)) {
+      return false;
+    }
+    memcpy(aTarget + op, aSource + ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == aSize) {
+      // The last sequence only has literals.
+      return op == aTargetSize;
+    }
+    if (aSize - ip < 2) {
+      return false;
+    }
+    const size_t kOffset = aSource[ip] | ((size_t)aSource[ip + 1] << 8);
+    ip += 2;
+    size_t length = kToken & 15;
+    if ((length == 15) && !readLength(length)) {
+      return false;
+    }
+    length += kLZ4MinMatch;
+    if ((kOffset == 0) || (kOffset > op) || (aTargetSize - op < kLZ4LastLiterals) ||
+        (length > aTargetSize - op - kLZ4LastLiterals)) {
+      return false;
+    }
+    const uint8_t* match = aTarget + op - kOffset;
+    if (kOffset >= length) {
+      memcpy(aTarget + op, match, length);
+    } else {
+      for (size_t ix = 0; ix < length; ix++) {
+        aTarget[op + ix] = match[ix];
+      }
+    }
+    op += length;
+  }
+  // The stream ended on a match.
+  return false;
+}
+
+// Entries are only stored compressed when this saves at least 1/8 of the
+// size. A leading sample is tried first so incompressible data is cheap.
+const size_t kCompressionSample = 64 * 1024;
+
+bool
+WorthStoring(const size_t aCompressed, const size_t aSize) {
+  return (aCompressed > 0) && (aCompressed <= aSize - (aSize / 8));
+}
+
+struct CachedData {
+  size_t segment;
+  size_t offset;
+  size_t size;
+  // Zero until a block has been allocated for the data.
+  size_t reserved;
+  // Bytes stored in the segment, less than size when compressed.
+  size_t stored;
+  bool compressed;
+  // The data while it waits for the writer thread.
+  std::unique_ptr<uint8_t[]> pending;
+
+  CachedData() : segment(0), offset(0), size(0), reserved(0), stored(0), compressed(false) {}
+  CachedData(CachedData&&) = default;
+  CachedData& operator=(CachedData&&) = default;
 };
 typedef std::unordered_map<uint32_t, CachedData>::iterator cacheIterator_t;
 
@@ -47,11 +314,232 @@ typedef std::unordered_map<uint32_t, CachedData>::iterator cacheIterator_t;
 namespace vrb {
 
 struct DataCache::State {
-  Mutex cacheLock;
+  ConditionVariable cacheLock;
   std::string cachePath;
   uint32_t handleCount;
   std::unordered_map<uint32_t, CachedData> cache;
-  State() : handleCount(0) {}
+  std::vector<std::unique_ptr<Segment>> segments;
+  // Write-behind state, guarded by cacheLock.
+  std::deque<uint32_t> writeQueue;
+  // Handles RemoveData left to the writer thread, which may have to wait
+  // for a write or for loads reading the block.
+  std::deque<uint32_t> removeQueue;
+  size_t pendingBytes;
+  // Handles encoded without cacheLock, by the writer thread or WriteNow().
+  std::unordered_set<uint32_t> writing;
+  bool writerStarted;
+  bool quit;
+  pthread_t writer;
+  bool compression;
+  // Held shared while LoadData reads a stored block without cacheLock, so
+  // loads decompress in parallel, and exclusive while a block is freed.
+  RWMutex blockLock;
+  Mutex statsLock;
+  Stats stats;
+  State()
+      : handleCount(0)
+      , pendingBytes(0)
+      , writerStarted(false)
+      , quit(false)
+      , writer()
+      , compression(false)
+  {}
+
+  bool Allocate(const size_t aSize, CachedData& aInfo) {
+    aInfo.reserved = Align(std::max(aSize, (size_t)1));
+    for (size_t ix = 0; ix < segments.size(); ix++) {
+      if (segments[ix]->Allocate(aInfo.reserved, aInfo.offset)) {
+        aInfo.segment = ix;
+        return true;
+      }
+    }
+    std::unique_ptr<Segment> segment(new Segment);
+    const size_t kSize = std::max(kSegmentSize, aInfo.reserved);
+    if (!segment->Open(cachePath + sFilePrefix + std::to_string(segments.size()), kSize)) {
+      // Most likely out of space. Entries already stored stay readable.
+      VRB_ERROR("DataCache disabled");
+      cachePath.clear();
+      aInfo.reserved = 0;
+      return false;
+    }
+    if (!segment->Allocate(aInfo.reserved, aInfo.offset)) {
+      aInfo.reserved = 0;
+      return false;
+    }
+    aInfo.segment = segments.size();
+    segments.push_back(std::move(segment));
+    return true;
+  }
+
+  uint8_t* GetData(const CachedData& aInfo) {
+    return segments[aInfo.segment]->data + aInfo.offset;
+  }
+
+  // Compresses aData when enabled and worthwhile. On return aData holds the
+  // bytes to store. Called without cacheLock.
+  void Encode(std::unique_ptr<uint8_t[]>& aData, const size_t aSize, const bool aCompress,
+              size_t& aStored, bool& aCompressed) {
+    aStored = aSize;
+    aCompressed = false;
+    if (!aCompress || (aSize < kCompressionSample)) {
+      return;
+    }
+    const double kStart = GetMonotonicSeconds();
+    std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(LZ4Bound(aSize));
+    size_t result = LZ4Compress(aData.get(), kCompressionSample, buffer.get(), LZ4Bound(kCompressionSample));
+    if (WorthStoring(result, kCompressionSample)) {
+      result = LZ4Compress(aData.get(), aSize, buffer.get(), LZ4Bound(aSize));
+      if (WorthStoring(result, aSize)) {
+        aData = std::move(buffer);
+        aStored = result;
+        aCompressed = true;
+      }
+    }
+    const double kSeconds = GetMonotonicSeconds() - kStart;
+    MutexAutoLock lock(statsLock);
+    stats.compressSeconds += kSeconds;
+  }
+
+  // Stores encoded data in a newly allocated block with cacheLock held.
+  bool Store(CachedData& aInfo, const uint8_t* aData, const size_t aStored, const bool aCompressed) {
+    if (!Allocate(aStored, aInfo)) {
+      VRB_ERROR("Failed to allocate %u bytes in the data cache", (uint32_t)aStored);
+      return false;
+    }
+    aInfo.stored = aStored;
+    aInfo.compressed = aCompressed;
+    memcpy(GetData(aInfo), aData, aStored);
+    return true;
+  }
+
+  // Writes pending data with cacheLock held. Used when the writer thread is
+  // behind or the data is needed right away. The lock is released while the
+  // data is encoded, the loads and RemoveData wait for aHandle meanwhile.
+  bool WriteNow(const uint32_t aHandle, CachedData& aInfo) {
+    if (!aInfo.pending) {
+      return aInfo.reserved > 0;
+    }
+    std::unique_ptr<uint8_t[]> data = std::move(aInfo.pending);
+    pendingBytes -= aInfo.size;
+    const size_t kSize = aInfo.size;
+    const bool kCompress = compression;
+    size_t stored = 0;
+    bool compressed = false;
+    writing.insert(aHandle);
+    {
+      MutexAutoUnlock unlock(cacheLock);
+      Encode(data, kSize, kCompress, stored, compressed);
+    }
+    const bool kStored = Store(aInfo, data.get(), stored, compressed);
+    if (kStored) {
+      AddWritten(aInfo, stored);
+    }
+    writing.erase(aHandle);
+    cacheLock.Broadcast();
+    return kStored;
+  }
+
+  void AddWritten(const CachedData& aInfo, const size_t aStored) {
+    MutexAutoLock lock(statsLock);
+    stats.bytesWritten += aStored;
+    if (aInfo.compressed) {
+      stats.compressedEntries++;
+    }
+  }
+
+  // Waits with cacheLock held until aHandle is no longer being encoded.
+  void WaitForWriter(const uint32_t aHandle) {
+    while (writing.count(aHandle) > 0) {
+      cacheLock.Wait();
+    }
+  }
+
+  // Frees the entry of aHandle with cacheLock held.
+  void Remove(const uint32_t aHandle) {
+    WaitForWriter(aHandle);
+    cacheIterator_t found = cache.find(aHandle);
+    if (found == cache.end()) {
+      VRB_ERROR("Failed to find cache data for removal from handle: %u", aHandle);
+      return;
+    }
+    const CachedData& info = found->second;
+    if (info.pending) {
+      pendingBytes -= info.size;
+    }
+    if (info.reserved > 0) {
+      // Waits for loads still reading the block.
+      WriteAutoLock blocks(blockLock);
+      segments[info.segment]->Free(info.offset, info.reserved);
+    }
+    cache.erase(found);
+  }
+
+  bool StartWriter() {
+    if (writerStarted) {
+      return true;
+    }
+    if (pthread_create(&writer, nullptr, &State::RunWriter, this) != 0) {
+      VRB_ERROR("Failed to start DataCache writer thread");
+      return false;
+    }
+    writerStarted = true;
+    return true;
+  }
+
+  static void* RunWriter(void* aState) {
+    State& m = *(State*)aState;
+    MutexAutoLock lock(m.cacheLock);
+    while (true) {
+      while (!m.quit && m.writeQueue.empty() && m.removeQueue.empty()) {
+        m.cacheLock.Wait();
+      }
+      if (m.quit) {
+        break;
+      }
+      if (!m.removeQueue.empty()) {
+        const uint32_t kHandle = m.removeQueue.front();
+        m.removeQueue.pop_front();
+        m.Remove(kHandle);
+        continue;
+      }
+      const uint32_t kHandle = m.writeQueue.front();
+      m.writeQueue.pop_front();
+      cacheIterator_t found = m.cache.find(kHandle);
+      // Entries removed or already written inline are skipped.
+      if ((found == m.cache.end()) || !found->second.pending) {
+        continue;
+      }
+      std::unique_ptr<uint8_t[]> data = std::move(found->second.pending);
+      const size_t kSize = found->second.size;
+      const bool kCompress = m.compression;
+      // RemoveData and the loads wait while the entry is being written so
+      // compression and the copy do not need the lock.
+      m.writing.insert(kHandle);
+      size_t stored = 0;
+      bool compressed = false;
+      {
+        MutexAutoUnlock unlock(m.cacheLock);
+        m.Encode(data, kSize, kCompress, stored, compressed);
+      }
+      CachedData& info = m.cache[kHandle];
+      if (m.Allocate(stored, info)) {
+        info.stored = stored;
+        info.compressed = compressed;
+        uint8_t* target = m.GetData(info);
+        {
+          MutexAutoUnlock unlock(m.cacheLock);
+          memcpy(target, data.get(), stored);
+        }
+        m.AddWritten(info, stored);
+      } else {
+        VRB_ERROR("Failed to allocate %u bytes in the data cache", (uint32_t)stored);
+      }
+      m.writing.erase(kHandle);
+      m.pendingBytes -= kSize;
+      m.cacheLock.Broadcast();
+    }
+    return nullptr;
+  }
 };
 
 DataCachePtr
@@ -62,99 +550,147 @@ DataCache::Create() {
 
 uint32_t
 DataCache::CacheData(std::unique_ptr<uint8_t[]>& aData, const size_t aDataSize) {
-  uint32_t handle = 0;
-  std::string root;
-  {
-    MutexAutoLock lock(m.cacheLock);
-    root = m.cachePath;
-    if (root.empty()) {
-      VRB_ERROR("Failed to cache data, root path not set");
-      return 0;
-    }
-    m.handleCount++;
-    handle = m.handleCount;
-  }
-
-  CachedData info;
-  info.size = aDataSize;
-  info.path = root + sFilePrefix + std::to_string(handle);
-  int file = open(info.path.c_str(), O_WRONLY | O_CREAT, 0660);
-  if (file < 0) {
-    VRB_ERROR("Failed to open cache file: %s for writing", info.path.c_str());
+  MutexAutoLock lock(m.cacheLock);
+  if (m.cachePath.empty()) {
+    VRB_ERROR("Failed to cache data, root path not set");
     return 0;
   }
-  CloseFileOnReturn hold(file);
-  size_t toWrite = aDataSize;
-  size_t place = 0;
-  while (toWrite > 0) {
-    ssize_t written = write(file, &(aData[place]), toWrite);
-    if (written < 0) {
-      VRB_ERROR("Failed writing to cache file: %s", info.path.c_str());
+  m.handleCount++;
+  const uint32_t kHandle = m.handleCount;
+  CachedData& info = m.cache[kHandle];
+  info.size = aDataSize;
+  info.pending = std::move(aData);
+  m.pendingBytes += aDataSize;
+  if ((m.pendingBytes > kMaxPendingBytes) || !m.StartWriter()) {
+    if (!m.WriteNow(kHandle, info)) {
+      m.cache.erase(kHandle);
       return 0;
     }
-    toWrite -= (size_t)written;
-    place = aDataSize - toWrite;
+  } else {
+    m.writeQueue.push_back(kHandle);
+    m.cacheLock.Broadcast();
   }
-  // Keep data for deletion
-  std::unique_ptr<uint8_t[]> data = std::move(aData);
-  {
-    MutexAutoLock lock(m.cacheLock);
-    m.cache[handle] = info;
+  VRB_LOG("Cached data: %u size: %u", kHandle, (uint32_t)aDataSize);
+  return kHandle;
+}
+
+const uint8_t*
+DataCache::MapData(const uint32_t aHandle, size_t& aSize) {
+  MutexAutoLock lock(m.cacheLock);
+  m.WaitForWriter(aHandle);
+  aSize = 0;
+  cacheIterator_t found = m.cache.find(aHandle);
+  if (found == m.cache.end()) {
+    VRB_ERROR("Failed to find cache data from handle: %u", aHandle);
+    MutexAutoLock statsLock(m.statsLock);
+    m.stats.misses++;
+    return nullptr;
   }
-  VRB_LOG("Cached data: %u size: %u", handle, (uint32_t)aDataSize);
-  return handle;
+  CachedData& info = found->second;
+  // The view must outlive the pending buffer so the write happens now.
+  if (!m.WriteNow(aHandle, info) || info.compressed) {
+    return nullptr;
+  }
+  aSize = info.size;
+  MutexAutoLock statsLock(m.statsLock);
+  m.stats.hits++;
+  m.stats.bytesRead += info.size;
+  return m.GetData(info);
 }
 
 size_t
 DataCache::LoadData(const uint32_t aHandle, std::unique_ptr<uint8_t[]>& aData) {
-  cacheIterator_t found;
+  std::unique_ptr<uint8_t[]> result;
+  const uint8_t* source = nullptr;
+  size_t size = 0;
+  size_t stored = 0;
+  bool compressed = false;
   {
     MutexAutoLock lock(m.cacheLock);
-    found = m.cache.find(aHandle);
+    m.WaitForWriter(aHandle);
+    cacheIterator_t found = m.cache.find(aHandle);
     if (found == m.cache.end()) {
-      VRB_ERROR("Failed to find cache file from handle: %u", aHandle);
+      VRB_ERROR("Failed to find cache data from handle: %u", aHandle);
+      MutexAutoLock statsLock(m.statsLock);
+      m.stats.misses++;
       return 0;
     }
+    const CachedData& info = found->second;
+    size = info.size;
+    stored = info.stored;
+    compressed = info.compressed;
+    result = std::make_unique<uint8_t[]>(size);
+    if (info.pending) {
+      memcpy(result.get(), info.pending.get(), size);
+    } else if (info.reserved == 0) {
+      return 0;
+    } else {
+      // Taken before cacheLock is released so RemoveData can not free the
+      // block in between. Released below without cacheLock held.
+      m.blockLock.ReadLock();
+      source = m.GetData(info);
+    }
   }
-  CachedData info = found->second;
-  int file = open(info.path.c_str(), O_RDONLY);
-  if (file < 0) {
-    VRB_ERROR("Failed to open cache file: %s for reading", info.path.c_str());
-    return 0;
-  }
-  CloseFileOnReturn hold(file);
-  aData = std::make_unique<uint8_t[]>(info.size);
-  size_t toRead = info.size;
-  size_t place = 0;
-  while (toRead > 0) {
-    ssize_t dataRead = read(file, &(aData[place]), toRead);
-    if (dataRead < 0) {
-      VRB_ERROR("Failed to read from cache file: %s", info.path.c_str());
+  if (source) {
+    bool decoded = true;
+    const double kStart = GetMonotonicSeconds();
+    if (compressed) {
+      decoded = LZ4Decompress(source, stored, result.get(), size);
+    } else {
+      memcpy(result.get(), source, size);
+    }
+    m.blockLock.Unlock();
+    if (!decoded) {
+      VRB_ERROR("Failed to decompress cache data: %u", aHandle);
       return 0;
     }
-    toRead -= (size_t)dataRead;
-    place = info.size - toRead;
+    if (compressed) {
+      MutexAutoLock statsLock(m.statsLock);
+      m.stats.decompressSeconds += GetMonotonicSeconds() - kStart;
+    }
+  }
+  aData = std::move(result);
+  {
+    MutexAutoLock statsLock(m.statsLock);
+    m.stats.hits++;
+    m.stats.bytesRead += stored ? stored : size;
   }
-  VRB_LOG("Loaded cached data: %u size: %u", aHandle, (uint32_t)info.size);
-  return info.size;
+  VRB_LOG("Loaded cached data: %u size: %u", aHandle, (uint32_t)size);
+  return size;
 }
 
 void
 DataCache::RemoveData(const uint32_t aHandle) {
-  std::string path;
-  {
-    MutexAutoLock lock(m.cacheLock);
-    cacheIterator_t found = m.cache.find(aHandle);
-    if (found == m.cache.end()) {
-      VRB_ERROR("Failed to find cache file for removal from handle: %u", aHandle);
-      return;
-    }
-    path = found->second.path;
-    m.cache.erase(found);
+  MutexAutoLock lock(m.cacheLock);
+  if (!m.writerStarted) {
+    m.Remove(aHandle);
+    return;
   }
-  if (remove(path.c_str()) < 0) {
-    VRB_ERROR("Failed to remove cache file: %s", path.c_str());
+  cacheIterator_t found = m.cache.find(aHandle);
+  if (found == m.cache.end()) {
+    VRB_ERROR("Failed to find cache data for removal from handle: %u", aHandle);
+    return;
   }
+  // Data still waiting to be written is dropped now so the writer skips it.
+  CachedData& info = found->second;
+  if (info.pending) {
+    info.pending.reset();
+    m.pendingBytes -= info.size;
+  }
+  m.removeQueue.push_back(aHandle);
+  m.cacheLock.Broadcast();
+}
+
+void
+DataCache::SetCompressionEnabled(const bool aEnabled) {
+  MutexAutoLock lock(m.cacheLock);
+  m.compression = aEnabled;
+}
+
+DataCache::Stats
+DataCache::GetStats() const {
+  MutexAutoLock lock(m.statsLock);
+  return m.stats;
 }
 
 void
@@ -164,14 +700,24 @@ DataCache::SetCachePath(const std::string& aPath) {
   m.cachePath = aPath;
 }
 
+bool
+DataCache::HasCachePath() const {
+  MutexAutoLock lock(m.cacheLock);
+  return !m.cachePath.empty();
+}
+
 DataCache::DataCache(State& aState) : m(aState) {}
 DataCache::~DataCache() {
-  // No need to lock since if destructor is called, no references are left
-  for (cacheIterator_t info = m.cache.begin(); info != m.cache.end(); info++) {
-    if (remove(info->second.path.c_str()) < 0) {
-      VRB_ERROR("Failed to remove cache file: %s", info->second.path.c_str());
+  if (m.writerStarted) {
+    {
+      MutexAutoLock lock(m.cacheLock);
+      m.quit = true;
+      m.cacheLock.Broadcast();
     }
+    pthread_join(m.writer, nullptr);
   }
+  // Segments unmap and remove their files.
+  m.segments.clear();
 }
 
 } // namespace vrb
@@ -9,27 +9,361 @@
 #include "vrb/Camera.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/Drawable.h"
+#include "vrb/GLError.h"
+#include "vrb/NodeProfiler.h"
+#include "vrb/Program.h"
 #include "vrb/RenderState.h"
+#include "vrb/Texture.h"
+#include "vrb/TraceProfiler.h"
+#include "vrb/gl.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+const uint64_t kTransparentBit = 0x1ull << 63;
+// Animated lights create a block per frame, the table is dropped past this.
+const size_t kMaxLightBlocks = 256;
+
+// Maps a non-negative distance to 16 bits that sort in the same order.
+uint64_t
+QuantizeDepth(const float aDistance) {
+  const float kDistance = aDistance > 0.0f ? aDistance : 0.0f;
+  uint32_t bits = 0;
+  memcpy(&bits, &kDistance, sizeof(bits));
+  return (bits >> 16) & 0xffff;
+}
+
+uint64_t
+CreateSortKey(vrb::RenderState& aState, const void* aInstancingKey, const vrb::Matrix& aView, const vrb::Matrix& aTransform) {
+  vrb::ProgramPtr program = aState.GetProgram();
+  vrb::TexturePtr texture = aState.GetTexture();
+  const uint64_t kProgram = (program ? program->GetProgram() : 0) & 0xffff;
+  const uint64_t kTexture = (texture ? texture->GetHandle() : 0) & 0xffff;
+  const uint64_t kState = (reinterpret_cast<uintptr_t>(&aState) >> 4) & 0x7fff;
+  const float kDistance = -aView.MultiplyPosition(aTransform.GetTranslation()).z();
+  uint64_t depth = QuantizeDepth(kDistance);
+  if (aState.IsTransparent()) {
+    // Blending depends on the order, entries at the same depth, such as
+    // coplanar UI quads, keep the order they were added in since the sort
+    // is stable.
+    return kTransparentBit | ((0xffff - depth) << 47);
+  }
+  if (aInstancingKey) {
+    // Instances are drawn in one call so their depth order does not matter.
+    // Keying on the instancing key instead keeps them adjacent in the list.
+    depth = (reinterpret_cast<uintptr_t>(aInstancingKey) >> 4) & 0xffff;
+  }
+  return (kProgram << 47) | (kTexture << 31) | (kState << 16) | depth;
+}
+
+bool
+SameTransform(const vrb::Matrix& aLeft, const vrb::Matrix& aRight) {
+  return memcmp(aLeft.Data(), aRight.Data(), sizeof(float) * 16) == 0;
+}
+
+const vrb::LightBlockPtr sNoLights;
+
+}
 
 namespace vrb {
 
 void
 DrawableList::State::Reset() {
+  if (retainDrawables) {
+    // Segments are reused by their next pass, release their references on
+    // this thread now.
+    for (DrawNode* node = drawables; node; node = node->next) {
+      if (node->segment && !node->recording) {
+        node->segment->Reset();
+      }
+    }
+    retained.clear();
+  }
   depth = 0;
-  DrawNode* current = drawables;
+  depthPrePass = 0;
   drawables = nullptr;
-  while (current) {
-    DrawNode* tmp = current;
-    current = current->next;
-    delete tmp;
+  currentLights = nullptr;
+  drawNodePool.Reset();
+  lightPool.Reset();
+  if (lightBlocks.size() > kMaxLightBlocks) {
+    lightBlocks.clear();
+  }
+}
+
+void
+DrawableList::State::RetainAll(const State& aList) {
+  for (const DrawNode* node = aList.drawables; node; node = node->next) {
+    if (node->segment) {
+      RetainAll(*node->segment);
+    } else {
+      retained.push_back(node->drawable->CreateDrawablePtr());
+    }
+  }
+}
+
+LightBlockPtr
+DrawableList::State::InternLights(const Light& aLight, const LightBlockPtr& aParent) {
+  LightBlock::Entry entry = {aLight.GetDirection(), aLight.GetAmbientColor(), aLight.GetDiffuseColor(), aLight.GetSpecularColor(),
+                             aLight.GetPosition(), aLight.GetRange()};
+  const uint64_t kHash = LightBlock::Hash(entry, aParent ? aParent->hash : LightBlock::EmptyHash());
+  auto found = lightBlocks.find(kHash);
+  if (found != lightBlocks.end()) {
+    const LightBlock& block = *found->second;
+    const size_t kParentCount = aParent ? aParent->lights.size() : 0;
+    if ((block.lights.size() == kParentCount + 1) && (block.lights[0] == entry) &&
+        (!aParent || std::equal(aParent->lights.begin(), aParent->lights.end(), block.lights.begin() + 1))) {
+      return found->second;
+    }
+  }
+  // The newest light comes first, matching the order of the light list.
+  std::shared_ptr<LightBlock> block = std::make_shared<LightBlock>();
+  block->hash = kHash;
+  block->lights.reserve((aParent ? aParent->lights.size() : 0) + 1);
+  block->lights.push_back(entry);
+  if (aParent) {
+    block->lights.insert(block->lights.end(), aParent->lights.begin(), aParent->lights.end());
+  }
+  if (found == lightBlocks.end()) {
+    lightBlocks[kHash] = block;
+  }
+  return block;
+}
+
+void
+DrawableList::State::ApplyLights(DrawNode& aNode) {
+  RenderStatePtr& state = aNode.drawable->GetRenderState();
+  if (state) {
+    const LightBlockPtr& kBlock = aNode.lights ? aNode.lights->block : sNoLights;
+    if (kBlock != state->GetLights()) {
+      state->SetLights(aNode.lights ? aNode.lights->id : 0, kBlock);
+    }
+  }
+}
+
+void
+DrawableList::State::DrawNodeWithLights(DrawNode& aNode, const Camera& aCamera) {
+  ApplyLights(aNode);
+  NodeProfiler::DrawScope profile(*aNode.drawable);
+  aNode.drawable->Draw(aCamera, aNode.transform);
+}
+
+void
+DrawableList::State::SortFrom(const size_t aStart) {
+  std::stable_sort(sortList.begin() + aStart, sortList.end(), [](const SortEntry& aLeft, const SortEntry& aRight) {
+    return aLeft.key < aRight.key;
+  });
+}
+
+void
+DrawableList::State::DrawSorted(const Camera& aCamera) {
+  if (depthPrePassCount == 0) {
+    DrawSortedEntries(aCamera, false);
+    return;
   }
-  LightSnapshot* currentLight = lights;
-  lights = nullptr;
-  while(currentLight) {
-    LightSnapshot* tmp = currentLight;
-    currentLight = currentLight->masterNext;
-    delete tmp;
+  BeginDepthPrePass();
+  DrawSortedEntries(aCamera, true);
+  EndDepthPrePass();
+  DrawSortedEntries(aCamera, false);
+  EndColorPass();
+}
+
+void
+DrawableList::State::DrawSortedEntries(const Camera& aCamera, const bool aDepthOnly) {
+  const size_t kCount = sortList.size();
+  size_t ix = 0;
+  while (ix < kCount) {
+    SortEntry& entry = sortList[ix];
+    size_t end = ix + 1;
+    const RenderState* kState = entry.node->drawable->GetRenderState().get();
+    if (entry.instancingKey) {
+      while ((end < kCount) && (sortList[end].instancingKey == entry.instancingKey) &&
+             (sortList[end].node->lights == entry.node->lights) &&
+             (sortList[end].node->drawable->GetRenderState().get() == kState) &&
+             (sortList[end].depthPrePass == entry.depthPrePass)) {
+        end++;
+      }
+    } else if (entry.batchKey) {
+      // Parts drawn with the same transform have the same depth, so they
+      // are already adjacent unless another drawable has the same key.
+      while ((end < kCount) && (sortList[end].batchKey == entry.batchKey) &&
+             (sortList[end].node->lights == entry.node->lights) &&
+             (sortList[end].node->drawable->GetRenderState().get() == kState) &&
+             (sortList[end].depthPrePass == entry.depthPrePass) &&
+             SameTransform(sortList[end].node->transform, entry.node->transform)) {
+        end++;
+      }
+    }
+    if (aDepthOnly && !entry.depthPrePass) {
+      ix = end;
+      continue;
+    }
+    if (!aDepthOnly) {
+      SetDepthEqual(entry.depthPrePass);
+    }
+    if (((end - ix) > 1) && entry.batchKey) {
+      batch.clear();
+      for (size_t jx = ix; jx < end; jx++) {
+        batch.push_back(sortList[jx].node->drawable);
+      }
+      ApplyLights(*entry.node);
+      // The batch is attributed to the drawable issuing it.
+      NodeProfiler::DrawScope profile(*entry.node->drawable);
+      entry.node->drawable->DrawBatch(aCamera, entry.node->transform, batch.data(), (int32_t)batch.size());
+    } else if ((end - ix) > 1) {
+      instanceTransforms.clear();
+      for (size_t jx = ix; jx < end; jx++) {
+        instanceTransforms.push_back(sortList[jx].node->transform);
+      }
+      ApplyLights(*entry.node);
+      NodeProfiler::DrawScope profile(*entry.node->drawable);
+      entry.node->drawable->DrawInstanced(aCamera, instanceTransforms.data(), (int32_t)instanceTransforms.size());
+    } else {
+      DrawNodeWithLights(*entry.node, aCamera);
+    }
+    ix = end;
+  }
+}
+
+void
+DrawableList::State::DrawUnsorted(const Camera& aCamera) {
+  if (!HasDepthPrePass(drawables, false)) {
+    DrawUnsortedNodes(drawables, aCamera, false, false);
+    return;
+  }
+  BeginDepthPrePass();
+  DrawUnsortedNodes(drawables, aCamera, false, true);
+  EndDepthPrePass();
+  DrawUnsortedNodes(drawables, aCamera, false, false);
+  EndColorPass();
+}
+
+void
+DrawableList::State::DrawUnsortedNodes(DrawNode* aNode, const Camera& aCamera, const bool aDepthPrePass, const bool aDepthOnly) {
+  while (aNode) {
+    const bool kDepthPrePass = aDepthPrePass || aNode->depthPrePass;
+    if (aNode->segment) {
+      DrawUnsortedNodes(aNode->segment->drawables, aCamera, kDepthPrePass, aDepthOnly);
+      aNode = aNode->next;
+      continue;
+    }
+    RenderStatePtr& state = aNode->drawable->GetRenderState();
+    const bool kPrePassed = kDepthPrePass && state && !state->IsTransparent();
+    if (!aDepthOnly) {
+      SetDepthEqual(kPrePassed);
+      DrawNodeWithLights(*aNode, aCamera);
+    } else if (kPrePassed) {
+      DrawNodeWithLights(*aNode, aCamera);
+    }
+    aNode = aNode->next;
+  }
+}
+
+bool
+DrawableList::State::HasDepthPrePass(const DrawNode* aNode, const bool aDepthPrePass) const {
+  for (; aNode; aNode = aNode->next) {
+    const bool kDepthPrePass = aDepthPrePass || aNode->depthPrePass;
+    if (aNode->segment) {
+      if (HasDepthPrePass(aNode->segment->drawables, kDepthPrePass)) {
+        return true;
+      }
+    } else if (kDepthPrePass) {
+      RenderStatePtr& state = aNode->drawable->GetRenderState();
+      if (state && !state->IsTransparent()) {
+        return true;
+      }
+    }
   }
+  return false;
+}
+
+void
+DrawableList::State::CollectSorted(DrawNode* aNode, const Camera& aCamera, size_t& aStart, const bool aDepthPrePass) {
+  const Matrix& kView = aCamera.GetView();
+  while (aNode) {
+    const bool kDepthPrePass = aDepthPrePass || aNode->depthPrePass;
+    if (aNode->segment) {
+      CollectSorted(aNode->segment->drawables, aCamera, aStart, kDepthPrePass);
+      aNode = aNode->next;
+      continue;
+    }
+    RenderStatePtr& state = aNode->drawable->GetRenderState();
+    if (state) {
+      const bool kTransparent = state->IsTransparent();
+      const void* instancingKey = kTransparent ? nullptr : aNode->drawable->GetInstancingKey();
+      const void* batchKey = instancingKey ? nullptr : aNode->drawable->GetBatchKey();
+      const bool kPrePassed = kDepthPrePass && !kTransparent;
+      sortList.push_back(SortEntry{CreateSortKey(*state, instancingKey, kView, aNode->transform), instancingKey, batchKey, aNode, kPrePassed});
+      if (kPrePassed) {
+        depthPrePassCount++;
+      }
+    } else {
+      // Drawables without a RenderState, such as render lambdas, act as
+      // barriers that must keep their position in the list. Without keys
+      // they are never merged with the entries around them.
+      SortFrom(aStart);
+      sortList.push_back(SortEntry{0, nullptr, nullptr, aNode, false});
+      aStart = sortList.size();
+    }
+    aNode = aNode->next;
+  }
+}
+
+void
+DrawableList::State::BuildSortList(const Camera& aCamera) {
+  sortList.clear();
+  depthPrePassCount = 0;
+  size_t start = 0;
+  CollectSorted(drawables, aCamera, start, false);
+  SortFrom(start);
+}
+
+void
+DrawableList::State::BeginDepthPrePass() {
+  GLint value = GL_LESS;
+  VRB_GL_CHECK(glGetIntegerv(GL_DEPTH_FUNC, &value));
+  depthFunc = (uint32_t)value;
+  value = GL_TRUE;
+  VRB_GL_CHECK(glGetIntegerv(GL_DEPTH_WRITEMASK, &value));
+  depthWrite = value != 0;
+  GLint mask[4] = {GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE};
+  VRB_GL_CHECK(glGetIntegerv(GL_COLOR_WRITEMASK, mask));
+  for (int ix = 0; ix < 4; ix++) {
+    colorWrite[ix] = mask[ix] != 0;
+  }
+  depthEqual = false;
+  VRB_GL_CHECK(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+  VRB_GL_CHECK(glDepthMask(GL_TRUE));
+  RenderState::SetDepthOnly(true);
+}
+
+void
+DrawableList::State::EndDepthPrePass() {
+  RenderState::SetDepthOnly(false);
+  VRB_GL_CHECK(glColorMask(colorWrite[0], colorWrite[1], colorWrite[2], colorWrite[3]));
+  VRB_GL_CHECK(glDepthMask(depthWrite ? GL_TRUE : GL_FALSE));
+}
+
+void
+DrawableList::State::SetDepthEqual(const bool aEqual) {
+  if (aEqual == depthEqual) {
+    return;
+  }
+  depthEqual = aEqual;
+  VRB_GL_STATS_ADD(StateChanges, 1);
+  if (aEqual) {
+    VRB_GL_CHECK(glDepthFunc(GL_EQUAL));
+    VRB_GL_CHECK(glDepthMask(GL_FALSE));
+  } else {
+    VRB_GL_CHECK(glDepthFunc((GLenum)depthFunc));
+    VRB_GL_CHECK(glDepthMask(depthWrite ? GL_TRUE : GL_FALSE));
+  }
+}
+
+void
+DrawableList::State::EndColorPass() {
+  SetDepthEqual(false);
 }
 
 DrawableListPtr
@@ -47,11 +381,12 @@ DrawableList::PushLight(const Light& aLight) {
   m.depth++;
   m.idCount++;
   if (m.idCount == 0) { m.idCount++; }
-  State::LightSnapshot* light = new State::LightSnapshot(m.idCount, m.depth, aLight);
+  State::LightSnapshot* light = m.lightPool.Allocate();
+  light->id = m.idCount;
+  light->depth = m.depth;
+  light->block = m.InternLights(aLight, m.currentLights ? m.currentLights->block : sNoLights);
   light->next = m.currentLights;
   m.currentLights = light;
-  light->masterNext = m.lights;
-  m.lights = light;
 }
 
 void
@@ -68,33 +403,148 @@ DrawableList::PopLights(const int aCount) {
 }
 
 void
-DrawableList::AddDrawable(DrawablePtr&& aDrawable, const Matrix& aTransform) {
-  State::DrawNode* node = new State::DrawNode;
-  node->drawable = aDrawable;
+DrawableList::PushDepthPrePass() {
+  m.depthPrePass++;
+}
+
+void
+DrawableList::PopDepthPrePass() {
+  m.depthPrePass--;
+  if (m.depthPrePass < 0) {
+    VRB_ERROR("Depth pre-pass depth in DrawableList is less than zero!");
+    m.depthPrePass = 0;
+  }
+}
+
+void
+DrawableList::AddDrawable(Drawable& aDrawable, const Matrix& aTransform) {
+  State::DrawNode* node = m.drawNodePool.Allocate();
+  node->drawable = &aDrawable;
+  node->segment = nullptr;
+  node->recording = false;
+  node->depthPrePass = m.depthPrePass > 0;
   node->transform = aTransform;
   node->lights = m.currentLights;
   node->next = m.drawables;
   m.drawables = node;
+  if (m.retainDrawables) {
+    m.retained.push_back(aDrawable.CreateDrawablePtr());
+  }
+}
+
+void
+DrawableList::AddSegment(DrawableList& aSegment) {
+  State& segment = aSegment.m;
+  segment.Reset();
+  segment.retainDrawables = m.retainDrawables;
+  // The segment continues the light list of this one. Its nodes are only
+  // read, so the segment may push and pop its own lights on another thread.
+  segment.currentLights = m.currentLights;
+  segment.depth = m.depth;
+  State::DrawNode* node = m.drawNodePool.Allocate();
+  node->drawable = nullptr;
+  node->segment = &segment;
+  node->recording = false;
+  node->depthPrePass = m.depthPrePass > 0;
+  node->lights = m.currentLights;
+  node->next = m.drawables;
+  m.drawables = node;
+}
+
+void
+DrawableList::BeginRecording(const DrawableList& aParent) {
+  m.Reset();
+  m.retained.clear();
+  m.retainDrawables = false;
+  m.recordedLights = aParent.m.currentLights ? aParent.m.currentLights->block : sNoLights;
+  m.depth = aParent.m.depth;
+  if (aParent.m.currentLights) {
+    // Copied into this list so the recording does not point into the light
+    // pool of the parent, which is recycled every frame.
+    State::LightSnapshot* light = m.lightPool.Allocate();
+    light->id = aParent.m.currentLights->id;
+    light->depth = aParent.m.currentLights->depth;
+    light->block = m.recordedLights;
+    light->next = nullptr;
+    m.currentLights = light;
+  }
+}
+
+bool
+DrawableList::HasRecordedLights(const DrawableList& aParent) const {
+  const LightBlockPtr& kLights = aParent.m.currentLights ? aParent.m.currentLights->block : sNoLights;
+  return kLights == m.recordedLights;
+}
+
+void
+DrawableList::AddRecording(DrawableList& aRecording) {
+  State::DrawNode* node = m.drawNodePool.Allocate();
+  node->drawable = nullptr;
+  node->segment = &aRecording.m;
+  node->recording = true;
+  node->depthPrePass = m.depthPrePass > 0;
+  node->lights = m.currentLights;
+  node->next = m.drawables;
+  m.drawables = node;
+  if (m.retainDrawables) {
+    m.RetainAll(aRecording.m);
+  }
 }
 
 void
 DrawableList::Draw(const Camera& aCamera) {
-  State::DrawNode* current = m.drawables;
-  while (current) {
-    if (current->drawable->GetRenderState()) {
-      const uint32_t id = current->lights ? current->lights->id : 0;
-      if (id != current->drawable->GetRenderState()->GetLightId()) {
-        current->drawable->GetRenderState()->ResetLights(id);
-        State::LightSnapshot* snapshot = current->lights;
-        while (snapshot) {
-          current->drawable->GetRenderState()->AddLight(snapshot->direction, snapshot->ambient,
-                                                        snapshot->diffuse, snapshot->specular);
-          snapshot = snapshot->next;
-        }
-      }
+  VRB_TRACE_ZONE("DrawableList::Draw");
+  RenderState::InvalidateBindings();
+  if (!m.sortingEnabled) {
+    m.DrawUnsorted(aCamera);
+  } else {
+    m.BuildSortList(aCamera);
+    m.DrawSorted(aCamera);
+    m.sortList.clear();
+  }
+  // Leaves no shared sampler bound for the code drawing after the list.
+  RenderState::InvalidateBindings();
+}
+
+void
+DrawableList::Draw(const std::vector<CameraPtr>& aCameras, const ViewCallback& aBeginView) {
+  VRB_TRACE_ZONE("DrawableList::Draw");
+  if (aCameras.empty() || !aCameras[0]) {
+    return;
+  }
+  if (m.sortingEnabled) {
+    m.BuildSortList(*aCameras[0]);
+  }
+  for (size_t ix = 0; ix < aCameras.size(); ix++) {
+    if (!aCameras[ix]) {
+      continue;
+    }
+    if (aBeginView) {
+      aBeginView((int32_t)ix);
     }
-    current->drawable->Draw(aCamera, current->transform);
-    current = current->next;
+    // The callback may bind anything, nothing is assumed to be left bound
+    // by the previous view.
+    RenderState::InvalidateBindings();
+    if (m.sortingEnabled) {
+      m.DrawSorted(*aCameras[ix]);
+    } else {
+      m.DrawUnsorted(*aCameras[ix]);
+    }
+  }
+  m.sortList.clear();
+  RenderState::InvalidateBindings();
+}
+
+void
+DrawableList::SetSortingEnabled(const bool aEnabled) {
+  m.sortingEnabled = aEnabled;
+}
+
+void
+DrawableList::SetRetainDrawables(const bool aRetain) {
+  m.retainDrawables = aRetain;
+  if (!aRetain) {
+    m.retained.clear();
   }
 }
 
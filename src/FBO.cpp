@@ -7,37 +7,281 @@
 #include "vrb/ConcreteClass.h"
 
 #include "vrb/RenderContext.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLError.h"
 #include "vrb/GLExtensions.h"
 #include "vrb/Logger.h"
+#include "vrb/MemoryCounter.h"
+
+#include <algorithm>
+
+namespace {
+
+// Gain of the falloff away from the focal point and size of the full rate
+// area around it, indexed by foveation level.
+struct Foveation {
+  float gain;
+  float area;
+};
+const Foveation kFoveation[] = {
+  {0.0f, 0.0f},
+  {2.0f, 1.0f},
+  {4.0f, 0.5f},
+  {6.0f, 0.25f},
+  {8.0f, 0.1f}
+};
+const int32_t kEyeCount = 2;
+// Readbacks in flight. Results usually arrive one or two frames later.
+const size_t kReadbackSlots = 3;
+static_assert(sizeof(kFoveation) / sizeof(kFoveation[0]) == vrb::FBO::kMaxFoveationLevel + 1, "One foveation per level");
+
+} // namespace
 
 namespace vrb {
 
+const int32_t FBO::kMaxFoveationLevel;
+
 struct FBO::State {
   RenderContextWeak context;
+  GLDeletionQueuePtr glDeletions;
   bool valid;
   GLuint depth;
   GLuint fbo;
+  GLuint texture;
+  int32_t width;
+  int32_t height;
   Attributes attributes;
   GLenum boundTarget;
+  MemoryTracker depthMemory;
+  int32_t foveationLevel;
+  float focalPoints[kEyeCount][2];
+  // A pixel pack buffer and the fence of the copy into it, null when free.
+  struct ReadbackSlot {
+    GLuint buffer;
+    GLsync fence;
+    int32_t width;
+    int32_t height;
+  };
+  ReadbackCallback readbackCallback;
+  int32_t readbackWidth;
+  int32_t readbackHeight;
+  ReadbackSlot readbackSlots[kReadbackSlots];
+  // Slot written next, which is also the oldest one in flight.
+  size_t readbackNext;
+  // Layer 0 of a multiview color texture.
+  GLuint layerFBO;
+  // Downscale target.
+  GLuint scaleFBO;
+  GLuint scaleColor;
+  int32_t scaleWidth;
+  int32_t scaleHeight;
+  MemoryTracker readbackMemory;
+
+  State()
+      : valid(false)
+      , depth(0)
+      , fbo(0)
+      , texture(0)
+      , width(0)
+      , height(0)
+      , boundTarget(GL_FRAMEBUFFER)
+      , depthMemory(MemoryType::FramebufferAttachment)
+      , foveationLevel(0)
+      , focalPoints()
+      , readbackWidth(0)
+      , readbackHeight(0)
+      , readbackSlots()
+      , readbackNext(0)
+      , layerFBO(0)
+      , scaleFBO(0)
+      , scaleColor(0)
+      , scaleWidth(0)
+      , scaleHeight(0)
+      , readbackMemory(MemoryType::FramebufferAttachment)
+  {}
+  void UpdateMemory(const int32_t aWidth, const int32_t aHeight) {
+    if (!depth) {
+      depthMemory.Set(0);
+      return;
+    }
+    // 24 bit depth buffers are assumed to be padded to 32 bits.
+    size_t bytes = (size_t)aWidth * (size_t)aHeight * 4;
+    if (attributes.samples > 1) {
+      bytes *= (size_t)attributes.samples;
+    }
+    if (attributes.multiview) {
+      bytes *= 2;
+    }
+    depthMemory.Set(bytes);
+  }
+  void Invalidate(const bool aColor, const bool aDepth) {
+#if defined(ANDROID)
+    GLenum attachments[2];
+    GLsizei count = 0;
+    if (aColor) {
+      attachments[count++] = GL_COLOR_ATTACHMENT0;
+    }
+    if (aDepth && attributes.depth) {
+      attachments[count++] = GL_DEPTH_ATTACHMENT;
+    }
+    if (count > 0) {
+      VRB_GL_CHECK(glInvalidateFramebuffer(boundTarget, count, attachments));
+    }
+#endif // defined(ANDROID)
+  }
 
-  State() : boundTarget(GL_FRAMEBUFFER), depth(0), fbo(0), valid(false) {}
   void Clear() {
     if (depth) {
       if (attributes.multiview) {
-        glDeleteTextures(1, &depth);
+        glDeletions->DeleteTexture(depth);
       } else {
-        glDeleteRenderbuffers(1, &depth);
+        glDeletions->DeleteRenderbuffer(depth);
       }
       depth = 0;
     }
-    if (fbo) {
-      glDeleteFramebuffers(1, &fbo);
-      fbo = 0;
-    }
+    depthMemory.Set(0);
+    glDeletions->DeleteFramebuffer(fbo);
+    fbo = 0;
+    glDeletions->DeleteFramebuffer(layerFBO);
+    layerFBO = 0;
+    texture = 0;
+    width = 0;
+    height = 0;
     valid = false;
   }
 
+  void UpdateReadbackMemory() {
+    size_t bytes = (size_t)scaleWidth * (size_t)scaleHeight * 4;
+    for (const ReadbackSlot& slot: readbackSlots) {
+      bytes += (size_t)slot.width * (size_t)slot.height * 4;
+    }
+    readbackMemory.Set(bytes);
+  }
+
+  void ReleaseReadbacks() {
+    for (ReadbackSlot& slot: readbackSlots) {
+      if (slot.fence) {
+        VRB_GL_CHECK(glDeleteSync(slot.fence));
+      }
+      glDeletions->DeleteBuffer(slot.buffer);
+      slot = ReadbackSlot();
+    }
+    glDeletions->DeleteFramebuffer(scaleFBO);
+    glDeletions->DeleteRenderbuffer(scaleColor);
+    scaleFBO = 0;
+    scaleColor = 0;
+    scaleWidth = 0;
+    scaleHeight = 0;
+    readbackNext = 0;
+    UpdateReadbackMemory();
+  }
+
+  // Hands the finished copies to the callback, oldest first, without waiting.
+  void DeliverReadbacks() {
+    for (size_t ix = 0; ix < kReadbackSlots; ix++) {
+      ReadbackSlot& slot = readbackSlots[(readbackNext + ix) % kReadbackSlots];
+      if (!slot.fence) {
+        continue;
+      }
+      const GLenum kStatus = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+      if (kStatus == GL_TIMEOUT_EXPIRED) {
+        // The ones after it are newer.
+        return;
+      }
+      VRB_GL_CHECK(glDeleteSync(slot.fence));
+      slot.fence = nullptr;
+      if (kStatus == GL_WAIT_FAILED) {
+        continue;
+      }
+      const GLsizeiptr kSize = (GLsizeiptr)slot.width * slot.height * 4;
+      VRB_GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer));
+      const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, kSize, GL_MAP_READ_BIT);
+      if (pixels) {
+        readbackCallback((const uint8_t*)pixels, slot.width, slot.height);
+        VRB_GL_CHECK(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+      } else {
+        VRB_ERROR("FBO failed to map a readback buffer");
+      }
+      VRB_GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    }
+  }
+
+  // Framebuffer reading the color attachment at full size.
+  GLuint GetReadSource() {
+    if (!attributes.multiview) {
+      return fbo;
+    }
+    if (!layerFBO) {
+      VRB_GL_CHECK(glGenFramebuffers(1, &layerFBO));
+      VRB_GL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, layerFBO));
+      VRB_GL_CHECK(glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, 0));
+    }
+    return layerFBO;
+  }
+
+  void UpdateScaleTarget(const int32_t aWidth, const int32_t aHeight) {
+    if (scaleFBO && (scaleWidth == aWidth) && (scaleHeight == aHeight)) {
+      return;
+    }
+    if (!scaleFBO) {
+      VRB_GL_CHECK(glGenFramebuffers(1, &scaleFBO));
+      VRB_GL_CHECK(glGenRenderbuffers(1, &scaleColor));
+    }
+    VRB_GL_CHECK(glBindRenderbuffer(GL_RENDERBUFFER, scaleColor));
+    VRB_GL_CHECK(glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, aWidth, aHeight));
+    VRB_GL_CHECK(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+    VRB_GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scaleFBO));
+    VRB_GL_CHECK(glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, scaleColor));
+    scaleWidth = aWidth;
+    scaleHeight = aHeight;
+    UpdateReadbackMemory();
+  }
+
+  void Readback() {
+    DeliverReadbacks();
+    ReadbackSlot& slot = readbackSlots[readbackNext];
+    if (slot.fence) {
+      VRB_DEBUG("FBO readback dropped, every buffer is in flight");
+      return;
+    }
+    int32_t readWidth = width;
+    int32_t readHeight = height;
+    if ((readbackWidth > 0) && (readbackHeight > 0)) {
+      readWidth = std::min(readbackWidth, width);
+      readHeight = std::min(readbackHeight, height);
+    }
+    GLint previousRead = 0;
+    GLint previousDraw = 0;
+    VRB_GL_CHECK(glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead));
+    VRB_GL_CHECK(glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw));
+
+    const GLuint kSource = GetReadSource();
+    VRB_GL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, kSource));
+    if ((readWidth != width) || (readHeight != height)) {
+      UpdateScaleTarget(readWidth, readHeight);
+      VRB_GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scaleFBO));
+      VRB_GL_CHECK(glBlitFramebuffer(0, 0, width, height, 0, 0, readWidth, readHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR));
+      VRB_GL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, scaleFBO));
+    }
+    if (!slot.buffer) {
+      VRB_GL_CHECK(glGenBuffers(1, &slot.buffer));
+    }
+    VRB_GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer));
+    if ((slot.width != readWidth) || (slot.height != readHeight)) {
+      VRB_GL_CHECK(glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)readWidth * readHeight * 4, nullptr, GL_STREAM_READ));
+      slot.width = readWidth;
+      slot.height = readHeight;
+      UpdateReadbackMemory();
+    }
+    VRB_GL_CHECK(glReadPixels(0, 0, readWidth, readHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+    VRB_GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    VRB_GL_CHECK(slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    readbackNext = (readbackNext + 1) % kReadbackSlots;
+
+    VRB_GL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)previousRead));
+    VRB_GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)previousDraw));
+  }
+
   void UpdateAttributes(const FBO::Attributes& aAttributes) {
     attributes = aAttributes;
     RenderContextPtr ctx = context.lock();
@@ -58,6 +302,46 @@ struct FBO::State {
       attributes.samples = 1;
       VRB_WARN("Multiview multisampled not supported");
     }
+    if (attributes.foveated && !ext->IsExtensionSupported(GLExtensions::Ext::QCOM_texture_foveated)) {
+      attributes.foveated = false;
+      VRB_WARN("Foveated rendering not supported");
+    }
+  }
+
+  // Foveation is enabled on the color texture before it is attached and can
+  // not be disabled afterwards, level 0 only sets a gain of zero.
+  void EnableFoveation(const GLuint aHandle) {
+    const GLenum kTarget = attributes.multiview ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    GLint supported = 0;
+    VRB_GL_CHECK(glBindTexture(kTarget, aHandle));
+    VRB_GL_CHECK(glGetTexParameteriv(kTarget, GL_TEXTURE_FOVEATED_FEATURE_QUERY_QCOM, &supported));
+    if (supported & GL_FOVEATION_ENABLE_BIT_QCOM) {
+      const GLint kBits = GL_FOVEATION_ENABLE_BIT_QCOM | (supported & GL_FOVEATION_SCALED_BIN_METHOD_BIT_QCOM);
+      VRB_GL_CHECK(glTexParameteri(kTarget, GL_TEXTURE_FOVEATED_FEATURE_BITS_QCOM, kBits));
+    } else {
+      attributes.foveated = false;
+      VRB_WARN("Foveated rendering not supported by the color texture");
+    }
+    VRB_GL_CHECK(glBindTexture(kTarget, 0));
+  }
+
+  void ApplyFoveation() {
+    if (!attributes.foveated || !texture) {
+      return;
+    }
+    RenderContextPtr ctx = context.lock();
+    if (!ctx) {
+      return;
+    }
+    const GLExtensions::Functions& ext = ctx->GetGLExtensions()->GetFunctions();
+    const Foveation& kFoveationLevel = kFoveation[foveationLevel];
+    const int32_t kLayers = attributes.multiview ? kEyeCount : 1;
+    for (int32_t layer = 0; layer < kLayers; layer++) {
+      VRB_GL_CHECK(ext.glTextureFoveationParametersQCOM(texture, (GLuint)layer, 0,
+                                                        focalPoints[layer][0], focalPoints[layer][1],
+                                                        kFoveationLevel.gain, kFoveationLevel.gain,
+                                                        kFoveationLevel.area));
+    }
   }
 
   void InitializeMultiview(const GLuint aHandle, int32_t aWidth, int32_t aHeight) {
@@ -116,17 +400,26 @@ struct FBO::State {
 FBO::Attributes::Attributes()
   : depth(true)
   , multiview(false)
-  , samples(0) {}
+  , samples(0)
+  , invalidateDepthOnUnbind(true)
+  , invalidateColorOnUnbind(false)
+  , invalidateOnBind(false)
+  , foveated(false) {}
 
 FBO::Attributes::Attributes(bool aDepth, bool aMultiview, int aSamples)
   : depth(aDepth)
   , multiview(aMultiview)
-  , samples(aSamples) {}
+  , samples(aSamples)
+  , invalidateDepthOnUnbind(true)
+  , invalidateColorOnUnbind(false)
+  , invalidateOnBind(false)
+  , foveated(false) {}
 
 FBOPtr
 FBO::Create(RenderContextPtr& aContext) {
   FBOPtr result = std::make_shared<ConcreteClass<FBO, FBO::State> >();
   result->m.context = aContext;
+  result->m.glDeletions = aContext->GetGLDeletionQueue();
   return result;
 }
 
@@ -143,6 +436,9 @@ FBO::SetTextureHandle(const GLuint aHandle,
   m.Clear();
   if (aHandle) {
     m.UpdateAttributes(aAttributtes);
+    if (m.attributes.foveated) {
+      m.EnableFoveation(aHandle);
+    }
 
     if (m.attributes.multiview) {
       m.InitializeMultiview(aHandle, aWidth, aHeight);
@@ -152,11 +448,16 @@ FBO::SetTextureHandle(const GLuint aHandle,
 
     if (GL_FRAMEBUFFER_COMPLETE == glCheckFramebufferStatus(GL_FRAMEBUFFER)) {
       m.valid = true;
+      m.texture = aHandle;
+      m.width = aWidth;
+      m.height = aHeight;
+      m.UpdateMemory(aWidth, aHeight);
+      m.ApplyFoveation();
     } else {
       VRB_ERROR("Failed to create valid frame buffer object");
       m.Clear();
     }
-    Unbind();
+    VRB_GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
   }
 }
 
@@ -166,10 +467,16 @@ FBO::Bind(GLenum aTarget) {
 
   m.boundTarget = aTarget;
   VRB_GL_CHECK(glBindFramebuffer(aTarget, m.fbo));
+  if (m.attributes.invalidateOnBind && (aTarget != GL_READ_FRAMEBUFFER)) {
+    m.Invalidate(true, true);
+  }
 }
 
 void
 FBO::Unbind() {
+  if (m.valid && (m.boundTarget != GL_READ_FRAMEBUFFER)) {
+    m.Invalidate(m.attributes.invalidateColorOnUnbind, m.attributes.invalidateDepthOnUnbind);
+  }
   VRB_GL_CHECK(glBindFramebuffer(m.boundTarget, 0));
 }
 
@@ -183,7 +490,69 @@ FBO::GetHandle() const {
   return m.fbo;
 }
 
+GLuint
+FBO::GetTextureHandle() const {
+  return m.texture;
+}
+
+void
+FBO::GetSize(int32_t& aWidth, int32_t& aHeight) const {
+  aWidth = m.width;
+  aHeight = m.height;
+}
+
+bool
+FBO::IsFoveated() const {
+  return m.valid && m.attributes.foveated;
+}
+
+void
+FBO::SetFoveationLevel(const int32_t aLevel) {
+  const int32_t kLevel = std::max(0, std::min(aLevel, kMaxFoveationLevel));
+  if (kLevel == m.foveationLevel) {
+    return;
+  }
+  m.foveationLevel = kLevel;
+  m.ApplyFoveation();
+}
+
+int32_t
+FBO::GetFoveationLevel() const {
+  return m.foveationLevel;
+}
+
+void
+FBO::SetFocalPoint(const int32_t aEye, const float aX, const float aY) {
+  if ((aEye < 0) || (aEye >= kEyeCount)) {
+    VRB_ERROR("FBO::SetFocalPoint invalid eye: %d", aEye);
+    return;
+  }
+  m.focalPoints[aEye][0] = aX;
+  m.focalPoints[aEye][1] = aY;
+  m.ApplyFoveation();
+}
+
+void
+FBO::SetReadbackCallback(const ReadbackCallback& aCallback, const int32_t aWidth, const int32_t aHeight) {
+  if (!aCallback) {
+    m.ReleaseReadbacks();
+  }
+  m.readbackCallback = aCallback;
+  m.readbackWidth = aWidth;
+  m.readbackHeight = aHeight;
+}
+
+void
+FBO::Readback() {
+  if (m.valid && m.readbackCallback) {
+    m.Readback();
+  }
+}
+
 FBO::FBO(State& aState) : m(aState) {}
-FBO::~FBO() { m.Clear(); }
+FBO::~FBO() {
+  m.ReleaseReadbacks();
+  m.Clear();
+}
 
 } // namespace vrb
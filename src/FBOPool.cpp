@@ -0,0 +1,189 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/FBOPool.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/GLDeletionQueue.h"
+
+#include "vrb/GLError.h"
+#include "vrb/Logger.h"
+#include "vrb/MemoryCounter.h"
+#include "vrb/RenderContext.h"
+
+#include <vector>
+
+namespace {
+
+bool
+SameAttributes(const vrb::FBO::Attributes& aLeft, const vrb::FBO::Attributes& aRight) {
+  return (aLeft.depth == aRight.depth) &&
+         (aLeft.multiview == aRight.multiview) &&
+         (aLeft.samples == aRight.samples) &&
+         (aLeft.invalidateDepthOnUnbind == aRight.invalidateDepthOnUnbind) &&
+         (aLeft.invalidateColorOnUnbind == aRight.invalidateColorOnUnbind) &&
+         (aLeft.invalidateOnBind == aRight.invalidateOnBind) &&
+         (aLeft.foveated == aRight.foveated);
+}
+
+int64_t
+ColorBytes(const int32_t aWidth, const int32_t aHeight, const bool aMultiview) {
+  return (int64_t)aWidth * (int64_t)aHeight * 4 * (aMultiview ? 2 : 1);
+}
+
+} // namespace
+
+namespace vrb {
+
+struct FBOPool::State {
+  struct Entry {
+    FBOPtr fbo;
+    GLuint texture;
+    int32_t width;
+    int32_t height;
+    // The requested attributes, FBO::GetAttributes() may be downgraded.
+    FBO::Attributes attributes;
+    bool acquired;
+    Entry() : texture(0), width(0), height(0), acquired(false) {}
+  };
+  RenderContextWeak context;
+  GLDeletionQueuePtr glDeletions;
+  std::vector<Entry> entries;
+
+  State() {}
+
+  void Delete(Entry& aEntry) {
+    aEntry.fbo = nullptr;
+    if (aEntry.texture) {
+      glDeletions->DeleteTexture(aEntry.texture);
+      AddMemoryUsage(MemoryType::FramebufferAttachment, -ColorBytes(aEntry.width, aEntry.height, aEntry.attributes.multiview));
+      aEntry.texture = 0;
+    }
+  }
+
+  void Clear() {
+    for (Entry& entry: entries) {
+      Delete(entry);
+    }
+    entries.clear();
+  }
+
+  bool Allocate(Entry& aEntry) {
+    RenderContextPtr render = context.lock();
+    if (!render) {
+      return false;
+    }
+    const GLenum kTarget = aEntry.attributes.multiview ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    VRB_GL_CHECK(glGenTextures(1, &aEntry.texture));
+    VRB_GL_CHECK(glBindTexture(kTarget, aEntry.texture));
+    if (aEntry.attributes.multiview) {
+      VRB_GL_CHECK(glTexStorage3D(kTarget, 1, GL_RGBA8, aEntry.width, aEntry.height, 2));
+    } else {
+      VRB_GL_CHECK(glTexStorage2D(kTarget, 1, GL_RGBA8, aEntry.width, aEntry.height));
+    }
+    AddMemoryUsage(MemoryType::FramebufferAttachment, ColorBytes(aEntry.width, aEntry.height, aEntry.attributes.multiview));
+    VRB_GL_CHECK(glTexParameteri(kTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    VRB_GL_CHECK(glTexParameteri(kTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    VRB_GL_CHECK(glTexParameteri(kTarget, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    VRB_GL_CHECK(glTexParameteri(kTarget, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    VRB_GL_CHECK(glBindTexture(kTarget, 0));
+    aEntry.fbo = FBO::Create(render);
+    aEntry.fbo->SetTextureHandle(aEntry.texture, aEntry.width, aEntry.height, aEntry.attributes);
+    if (!aEntry.fbo->IsValid()) {
+      Delete(aEntry);
+      return false;
+    }
+    return true;
+  }
+};
+
+FBOPoolPtr
+FBOPool::Create(RenderContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<FBOPool, FBOPool::State> >(aContext);
+}
+
+FBOPtr
+FBOPool::Acquire(const int32_t aWidth, const int32_t aHeight, const FBO::Attributes& aAttributes) {
+  if ((aWidth <= 0) || (aHeight <= 0)) {
+    VRB_ERROR("FBOPool::Acquire invalid size: %dx%d", aWidth, aHeight);
+    return nullptr;
+  }
+  for (State::Entry& entry: m.entries) {
+    if (!entry.acquired && (entry.width == aWidth) && (entry.height == aHeight) &&
+        SameAttributes(entry.attributes, aAttributes)) {
+      entry.acquired = true;
+      return entry.fbo;
+    }
+  }
+  State::Entry entry;
+  entry.width = aWidth;
+  entry.height = aHeight;
+  entry.attributes = aAttributes;
+  if (!m.Allocate(entry)) {
+    VRB_ERROR("FBOPool failed to create a %dx%d render target", aWidth, aHeight);
+    return nullptr;
+  }
+  entry.acquired = true;
+  m.entries.push_back(entry);
+  return entry.fbo;
+}
+
+void
+FBOPool::Release(const FBOPtr& aFBO) {
+  if (!aFBO) {
+    return;
+  }
+  for (State::Entry& entry: m.entries) {
+    if (entry.fbo == aFBO) {
+      entry.acquired = false;
+      return;
+    }
+  }
+  VRB_WARN("FBOPool::Release called with an FBO not from this pool");
+}
+
+void
+FBOPool::Trim() {
+  std::vector<State::Entry> kept;
+  for (State::Entry& entry: m.entries) {
+    if (entry.acquired) {
+      kept.push_back(entry);
+    } else {
+      m.Delete(entry);
+    }
+  }
+  m.entries.swap(kept);
+}
+
+void
+FBOPool::Clear() {
+  m.Clear();
+}
+
+size_t
+FBOPool::GetFreeCount() const {
+  size_t result = 0;
+  for (const State::Entry& entry: m.entries) {
+    if (!entry.acquired) {
+      result++;
+    }
+  }
+  return result;
+}
+
+size_t
+FBOPool::GetAcquiredCount() const {
+  return m.entries.size() - GetFreeCount();
+}
+
+FBOPool::FBOPool(State& aState, RenderContextPtr& aContext) : m(aState) {
+  m.context = aContext;
+  m.glDeletions = aContext->GetGLDeletionQueue();
+}
+
+FBOPool::~FBOPool() {
+  m.Clear();
+}
+
+} // namespace vrb
@@ -6,17 +6,34 @@
 #include "vrb/FileReaderAndroid.h"
 #include "vrb/ConcreteClass.h"
 
+#include "vrb/AssetPack.h"
 #include "vrb/ClassLoaderAndroid.h"
 #include "vrb/JNIException.h"
+#include "vrb/KTX2Decoder.h"
+#include "vrb/LoadReport.h"
 #include "vrb/Logger.h"
+#include "vrb/MappedFile.h"
+#include "vrb/TextureFormat.h"
+#include "vrb/Mutex.h"
 
 
 #include <jni.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
 #include <fstream>
+#include <memory>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #include <android/asset_manager.h>
 #include <android/asset_manager_jni.h>
+#if __ANDROID_API__ >= 30
+#include <android/imagedecoder.h>
+#include <fcntl.h>
+#endif // __ANDROID_API__ >= 30
 
 #define JNI_METHOD(return_type, method_name) \
   JNIEXPORT return_type JNICALL              \
@@ -25,6 +42,48 @@
 
 namespace {
 
+// Same chunk sizes as FileReaderBasic. Compressed assets are inflated into
+// a buffer of kRawChunkSize, uncompressed assets are mapped and handed out
+// in slices of kMappedChunkSize.
+const size_t kRawChunkSize = 256 * 1024;
+const size_t kMappedChunkSize = 16 * 1024 * 1024;
+
+bool
+EndsWith(const std::string& aValue, const char* aSuffix) {
+  const size_t kLength = strlen(aSuffix);
+  if (aValue.size() < kLength) {
+    return false;
+  }
+  for (size_t ix = 0; ix < kLength; ix++) {
+    if (tolower(aValue[aValue.size() - kLength + ix]) != aSuffix[ix]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#if __ANDROID_API__ >= 30
+// Decodes aDecoder as premultiplied RGBA, like BitmapFactory, straight into
+// the buffer that is handed to the FileHandler.
+bool
+DecodeImage(AImageDecoder* aDecoder, std::unique_ptr<uint8_t[]>& aImage, uint64_t& aLength, int& aWidth, int& aHeight) {
+  if (AImageDecoder_setAndroidBitmapFormat(aDecoder, ANDROID_BITMAP_FORMAT_RGBA_8888) != ANDROID_IMAGE_DECODER_SUCCESS) {
+    return false;
+  }
+  const AImageDecoderHeaderInfo* info = AImageDecoder_getHeaderInfo(aDecoder);
+  aWidth = AImageDecoderHeaderInfo_getWidth(info);
+  aHeight = AImageDecoderHeaderInfo_getHeight(info);
+  if ((aWidth <= 0) || (aHeight <= 0)) {
+    return false;
+  }
+  // Rows are tightly packed, which is the minimum stride for RGBA_8888.
+  const size_t kStride = (size_t)aWidth * 4;
+  aLength = (uint64_t)kStride * (uint64_t)aHeight;
+  aImage = std::make_unique<uint8_t[]>((size_t)aLength);
+  return AImageDecoder_decodeImage(aDecoder, aImage.get(), kStride, (size_t)aLength) == ANDROID_IMAGE_DECODER_SUCCESS;
+}
+#endif // __ANDROID_API__ >= 30
+
 inline jlong jptr(vrb::FileReaderAndroid* ptr) { return reinterpret_cast<intptr_t>(ptr); }
 inline vrb::FileReaderAndroid* ptr(jlong jptr) { return reinterpret_cast<vrb::FileReaderAndroid*>(jptr); }
 
@@ -33,29 +92,225 @@ inline vrb::FileReaderAndroid* ptr(jlong jptr) { return reinterpret_cast<vrb::Fi
 namespace vrb {
 
 struct FileReaderAndroid::State {
-  int trackingHandleCount;
+  std::atomic<int> trackingHandleCount;
   JNIEnv* env;
+  JavaVM* vm;
   jobject jassetManager;
   AAssetManager* am;
   jclass imageLoaderClass;
   jmethodID loadFromAssets;
   jmethodID loadFromRawFile;
-  int imageTargetHandle;
-  FileHandlerPtr imageTarget;
+  KTX2DecoderPtr ktx2Decoder;
+  // Images may be read from several threads at once, each in flight load
+  // is tracked by handle until it completes or fails.
+  Mutex imageLock;
+  std::unordered_map<int, FileHandlerPtr> imageTargets;
+  Mutex packLock;
+  std::vector<AssetPackPtr> packs;
   State()
       : trackingHandleCount(0)
       , env(nullptr)
+      , vm(nullptr)
       , jassetManager(nullptr)
       , am(nullptr)
       , imageLoaderClass(nullptr)
       , loadFromAssets(nullptr)
       , loadFromRawFile(nullptr)
-      , imageTargetHandle(0)
   {}
 
   int nextHandle() {
-    trackingHandleCount++;
-    return trackingHandleCount;
+    return ++trackingHandleCount;
+  }
+
+  FileHandlerPtr takeImageTarget(const int aHandle) {
+    MutexAutoLock lock(imageLock);
+    auto it = imageTargets.find(aHandle);
+    if (it == imageTargets.end()) {
+      return nullptr;
+    }
+    FileHandlerPtr result = std::move(it->second);
+    imageTargets.erase(it);
+    return result;
+  }
+
+  MappedFilePtr mapPackEntry(const std::string& aFileName) {
+    MutexAutoLock lock(packLock);
+    for (auto it = packs.rbegin(); it != packs.rend(); ++it) {
+      MappedFilePtr result = (*it)->MapEntry(aFileName);
+      if (result) {
+        return result;
+      }
+    }
+    return nullptr;
+  }
+
+  // Files given by absolute path, and assets stored uncompressed in the APK.
+  MappedFilePtr mapFile(const std::string& aFileName) {
+    MappedFilePtr result;
+    if (aFileName.size() && aFileName[0] == '/') {
+      result = std::make_shared<MappedFile>(aFileName);
+    } else if (am) {
+      AAsset* asset = AAssetManager_open(am, aFileName.c_str(), AASSET_MODE_RANDOM);
+      off64_t start = 0;
+      off64_t length = 0;
+      const int fd = asset ? AAsset_openFileDescriptor64(asset, &start, &length) : -1;
+      if (fd >= 0) {
+        result = std::make_shared<MappedFile>(fd, (off_t)start, (size_t)length);
+        close(fd);
+      }
+      if (asset) {
+        AAsset_close(asset);
+      }
+    }
+    return (result && result->IsValid()) ? result : nullptr;
+  }
+
+  // The JNIEnv of the calling thread, which is attached to the VM if needed.
+  JNIEnv* currentEnv() {
+    if (!vm) {
+      return env;
+    }
+    JNIEnv* result = nullptr;
+    if (vm->GetEnv((void**)&result, JNI_VERSION_1_6) == JNI_OK) {
+      return result;
+    }
+    if (vm->AttachCurrentThread(&result, nullptr) != 0) {
+      VRB_ERROR("Unable to attach image loading thread to the JavaVM");
+      return nullptr;
+    }
+    return result;
+  }
+
+  // Decodes PNG, JPEG, WebP and the other formats of AImageDecoder without
+  // going through ImageLoader.java. Returns false, leaving the image to the
+  // Java loader, for compressed texture files or when decoding fails.
+  bool decodeImageFile(const std::string& aFileName, std::unique_ptr<uint8_t[]>& aImage, uint64_t& aLength, int& aWidth, int& aHeight) {
+#if __ANDROID_API__ >= 30
+    if (EndsWith(aFileName, ".pkm")) {
+      return false;
+    }
+    AAsset* asset = nullptr;
+    int fd = -1;
+    AImageDecoder* decoder = nullptr;
+    int result = ANDROID_IMAGE_DECODER_INVALID_INPUT;
+    if (aFileName.size() && aFileName[0] == '/') {
+      fd = open(aFileName.c_str(), O_RDONLY);
+      if (fd >= 0) {
+        result = AImageDecoder_createFromFd(fd, &decoder);
+      }
+    } else if (am) {
+      asset = AAssetManager_open(am, aFileName.c_str(), AASSET_MODE_STREAMING);
+      if (asset) {
+        result = AImageDecoder_createFromAAsset(asset, &decoder);
+      }
+    }
+    bool decoded = false;
+    if (result == ANDROID_IMAGE_DECODER_SUCCESS) {
+      decoded = DecodeImage(decoder, aImage, aLength, aWidth, aHeight);
+      AImageDecoder_delete(decoder);
+    }
+    // The decoder reads from the asset or descriptor until it is deleted.
+    if (asset) {
+      AAsset_close(asset);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (!decoded) {
+      VRB_DEBUG("Native decoding failed for '%s', using ImageLoader", aFileName.c_str());
+      aImage.reset();
+    }
+    return decoded;
+#else
+    return false;
+#endif // __ANDROID_API__ >= 30
+  }
+
+  // Same as decodeImageFile() for an image held in aMapping, e.g. an entry
+  // of an AssetPack.
+  bool decodeImageData(const MappedFile& aMapping, std::unique_ptr<uint8_t[]>& aImage, uint64_t& aLength, int& aWidth, int& aHeight) {
+#if __ANDROID_API__ >= 30
+    AImageDecoder* decoder = nullptr;
+    if (AImageDecoder_createFromBuffer(aMapping.Data(), aMapping.Size(), &decoder) != ANDROID_IMAGE_DECODER_SUCCESS) {
+      return false;
+    }
+    const bool decoded = DecodeImage(decoder, aImage, aLength, aWidth, aHeight);
+    AImageDecoder_delete(decoder);
+    if (!decoded) {
+      aImage.reset();
+    }
+    return decoded;
+#else
+    return false;
+#endif // __ANDROID_API__ >= 30
+  }
+
+  // KTX, KTX2 and ASTC files are parsed straight from aEntry of an AssetPack
+  // or from a mapping of the file or of the asset when it is stored
+  // uncompressed, from an asset buffer otherwise.
+  void readTextureFile(const std::string& aFileName, const MappedFilePtr& aEntry, const int aHandle, FileHandlerPtr& aHandler) {
+    MappedFilePtr mapping = aEntry;
+    AAsset* asset = nullptr;
+    if (mapping) {
+      // Parsed in place from the pack.
+    } else if (aFileName.size() && aFileName[0] == '/') {
+      mapping = std::make_shared<MappedFile>(aFileName);
+    } else if (am) {
+      asset = AAssetManager_open(am, aFileName.c_str(), AASSET_MODE_BUFFER);
+      off64_t start = 0;
+      off64_t length = 0;
+      const int fd = asset ? AAsset_openFileDescriptor64(asset, &start, &length) : -1;
+      if (fd >= 0) {
+        mapping = std::make_shared<MappedFile>(fd, (off_t)start, (size_t)length);
+        close(fd);
+      }
+    }
+    const char* data = nullptr;
+    size_t size = 0;
+    if (mapping && mapping->IsValid()) {
+      data = mapping->Data();
+      size = mapping->Size();
+    } else if (asset) {
+      data = (const char*)AAsset_getBuffer(asset);
+      size = data ? (size_t)AAsset_getLength64(asset) : 0;
+    }
+    std::vector<ImageLevel> levels;
+    std::string error("Unable to load file");
+    bool loaded = false;
+    if (data && KTX2Decoder::IsKTX2(data, size)) {
+      if (ktx2Decoder) {
+        loaded = ktx2Decoder->Decode(data, size, levels, error);
+      } else {
+        error = "No KTX2Decoder";
+      }
+    } else if (data && IsASTCFile(data, size)) {
+      loaded = ReadASTCFile(data, size, levels, error);
+    } else if (data) {
+      loaded = ReadKTXFile(data, size, levels, error);
+    }
+    if (loaded) {
+      aHandler->ProcessImageLevels(aHandle, levels);
+    } else {
+      aHandler->LoadFailed(aHandle, error + ": " + aFileName);
+    }
+    if (asset) {
+      AAsset_close(asset);
+    }
+  }
+
+  bool readPackFile(const std::string& aFileName, FileHandlerPtr& aHandler) {
+    MappedFilePtr mapping = mapPackEntry(aFileName);
+    if (!mapping) {
+      return false;
+    }
+    const int handle = nextHandle();
+    aHandler->BindFileHandle(aFileName, handle);
+    for (size_t offset = 0; offset < mapping->Size(); offset += kMappedChunkSize) {
+      const size_t count = std::min(kMappedChunkSize, mapping->Size() - offset);
+      aHandler->ProcessRawFileChunk(handle, mapping->Data() + offset, count);
+    }
+    aHandler->FinishRawFile(handle);
+    return true;
   }
 
   void readRawAssetsFile(const std::string& aFileName, FileHandlerPtr aHandler) {
@@ -72,11 +327,29 @@ struct FileReaderAndroid::State {
       return;
     }
 
-    const int bufferSize = 1024;
-    char buffer[bufferSize];
+    // Only assets stored uncompressed in the APK have a file descriptor.
+    off64_t start = 0;
+    off64_t length = 0;
+    const int fd = AAsset_openFileDescriptor64(asset, &start, &length);
+    if (fd >= 0) {
+      MappedFile mapping(fd, (off_t)start, (size_t)length);
+      close(fd);
+      if (mapping.IsValid()) {
+        AAsset_close(asset);
+        // Chunks point straight into the mapping so nothing is copied.
+        for (size_t offset = 0; offset < mapping.Size(); offset += kMappedChunkSize) {
+          const size_t count = std::min(kMappedChunkSize, mapping.Size() - offset);
+          aHandler->ProcessRawFileChunk(handle, mapping.Data() + offset, count);
+        }
+        aHandler->FinishRawFile(handle);
+        return;
+      }
+    }
+
+    std::unique_ptr<char[]> buffer = std::make_unique<char[]>(kRawChunkSize);
     int read = 0;
-    while ((read = AAsset_read(asset, buffer, bufferSize)) > 0) {
-      aHandler->ProcessRawFileChunk(handle, buffer, read);
+    while ((read = AAsset_read(asset, buffer.get(), kRawChunkSize)) > 0) {
+      aHandler->ProcessRawFileChunk(handle, buffer.get(), (size_t)read);
     }
     if (read == 0) {
       aHandler->FinishRawFile(handle);
@@ -90,6 +363,17 @@ struct FileReaderAndroid::State {
   void readRawFile(const std::string& aFileName, FileHandlerPtr aHandler) {
     const int handle = nextHandle();
     aHandler->BindFileHandle(aFileName, handle);
+    {
+      MappedFile mapping(aFileName);
+      if (mapping.IsValid()) {
+        for (size_t offset = 0; offset < mapping.Size(); offset += kMappedChunkSize) {
+          const size_t count = std::min(kMappedChunkSize, mapping.Size() - offset);
+          aHandler->ProcessRawFileChunk(handle, mapping.Data() + offset, count);
+        }
+        aHandler->FinishRawFile(handle);
+        return;
+      }
+    }
     std::ifstream input(aFileName, std::ios::binary);
     if (!input) {
       aHandler->LoadFailed(handle, "Unable to load file: No Android AssetManager.");
@@ -117,7 +401,11 @@ FileReaderAndroid::Create() {
 
 void
 FileReaderAndroid::ReadRawFile(const std::string& aFileName, FileHandlerPtr aHandler) {
-  if (aFileName.size() && aFileName[0] == '/') {
+  // Paused while the handler runs.
+  LoadReportTimer timer(LoadReport::Phase::Read);
+  if (m.readPackFile(aFileName, aHandler)) {
+    return;
+  } else if (aFileName.size() && aFileName[0] == '/') {
     m.readRawFile(aFileName, aHandler);
   } else {
     m.readRawAssetsFile(aFileName, aHandler);
@@ -129,23 +417,82 @@ FileReaderAndroid::ReadImageFile(const std::string& aFileName, FileHandlerPtr aH
   if (!aHandler) {
     return;
   }
-  m.imageTarget = aHandler;
-  m.imageTargetHandle = m.nextHandle();
-  m.imageTarget->BindFileHandle(aFileName, m.imageTargetHandle);
+  const int handle = m.nextHandle();
+  aHandler->BindFileHandle(aFileName, handle);
+  const bool kTexture = EndsWith(aFileName, ".ktx") || EndsWith(aFileName, ".ktx2") || EndsWith(aFileName, ".astc");
+  MappedFilePtr entry = m.mapPackEntry(aFileName);
+  if (entry && kTexture) {
+    m.readTextureFile(aFileName, entry, handle, aHandler);
+    return;
+  }
+
+  std::unique_ptr<uint8_t[]> image;
+  uint64_t length = 0;
+  int width = 0;
+  int height = 0;
+  // Without AImageDecoder other images of a pack are read from the loose
+  // file by ImageLoader.
+  if (entry && m.decodeImageData(*entry, image, length, width, height)) {
+    aHandler->ProcessImageFile(handle, image, length, width, height, GL_RGBA);
+    return;
+  }
+
   if (!m.loadFromAssets || !m.am) {
-    m.imageTarget->LoadFailed(m.imageTargetHandle, "FileReaderAndroid is not initialized.");
+    aHandler->LoadFailed(handle, "FileReaderAndroid is not initialized.");
+    return;
+  }
+
+  if (kTexture) {
+    m.readTextureFile(aFileName, nullptr, handle, aHandler);
+    return;
+  }
+
+  if (m.decodeImageFile(aFileName, image, length, width, height)) {
+    aHandler->ProcessImageFile(handle, image, length, width, height, GL_RGBA);
     return;
   }
 
-  jstring jFileName = m.env->NewStringUTF(aFileName.c_str());
+  JNIEnv* env = m.currentEnv();
+  if (!env) {
+    aHandler->LoadFailed(handle, "FileReaderAndroid has no JNIEnv on this thread.");
+    return;
+  }
+  {
+    MutexAutoLock lock(m.imageLock);
+    m.imageTargets[handle] = aHandler;
+  }
+  jstring jFileName = env->NewStringUTF(aFileName.c_str());
   if (aFileName.size() && aFileName[0] == '/') {
-    m.env->CallStaticVoidMethod(m.imageLoaderClass, m.loadFromRawFile, jFileName, jptr(this), m.imageTargetHandle);
-    VRB_CHECK_JNI_EXCEPTION(m.env);
+    env->CallStaticVoidMethod(m.imageLoaderClass, m.loadFromRawFile, jFileName, jptr(this), handle);
+    VRB_CHECK_JNI_EXCEPTION(env);
   } else {
-    m.env->CallStaticVoidMethod(m.imageLoaderClass, m.loadFromAssets, m.jassetManager, jFileName, jptr(this), m.imageTargetHandle);
-    VRB_CHECK_JNI_EXCEPTION(m.env);
+    env->CallStaticVoidMethod(m.imageLoaderClass, m.loadFromAssets, m.jassetManager, jFileName, jptr(this), handle);
+    VRB_CHECK_JNI_EXCEPTION(env);
+  }
+  env->DeleteLocalRef(jFileName);
+}
+
+MappedFilePtr
+FileReaderAndroid::MapFile(const std::string& aFileName) {
+  MappedFilePtr result = m.mapPackEntry(aFileName);
+  return result ? result : m.mapFile(aFileName);
+}
+
+bool
+FileReaderAndroid::AddAssetPack(const std::string& aFileName) {
+  AssetPackPtr pack = AssetPack::Create(m.mapFile(aFileName));
+  if (!pack) {
+    VRB_ERROR("Unable to open asset pack: %s", aFileName.c_str());
+    return false;
   }
-  m.env->DeleteLocalRef(jFileName);
+  MutexAutoLock lock(m.packLock);
+  m.packs.push_back(pack);
+  return true;
+}
+
+void
+FileReaderAndroid::SetKTX2Decoder(const KTX2DecoderPtr& aDecoder) {
+  m.ktx2Decoder = aDecoder;
 }
 
 void
@@ -154,6 +501,9 @@ FileReaderAndroid::Init(JNIEnv* aEnv, jobject &aAssetManager, const ClassLoaderA
   if (!m.env) {
     return;
   }
+  if (m.env->GetJavaVM(&m.vm) != 0) {
+    m.vm = nullptr;
+  }
   m.jassetManager = m.env->NewGlobalRef(aAssetManager);
   m.am = AAssetManager_fromJava(m.env, m.jassetManager);
   jclass localImageLoaderClass = classLoader->FindClass("org/mozilla/vrb/ImageLoader");
@@ -175,35 +525,30 @@ FileReaderAndroid::Shutdown() {
     m.env->DeleteGlobalRef(m.imageLoaderClass);
     m.am = nullptr;
     m.env = nullptr;
+    m.vm = nullptr;
     m.loadFromAssets = 0;
   }
 }
 
 void
 FileReaderAndroid::ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]> &aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
-  if (m.imageTargetHandle != aFileHandle) {
-    return;
-  }
-
-  m.imageTargetHandle = 0;
-  if (!m.imageTarget) {
+  FileHandlerPtr target = m.takeImageTarget(aFileHandle);
+  if (!target) {
     return;
   }
 
-  m.imageTarget->ProcessImageFile(aFileHandle, aImage, aImageLength, aWidth, aHeight, aFormat);
-  m.imageTarget = nullptr;
+  target->ProcessImageFile(aFileHandle, aImage, aImageLength, aWidth, aHeight, aFormat);
 }
 
 
 void
 FileReaderAndroid::ImageFileLoadFailed(const int aFileHandle, const std::string& aReason) {
-  if (!m.imageTarget || (m.imageTargetHandle != aFileHandle)) {
+  FileHandlerPtr target = m.takeImageTarget(aFileHandle);
+  if (!target) {
     return;
   }
 
-  m.imageTarget->LoadFailed(aFileHandle, aReason);
-  m.imageTargetHandle = 0;
-  m.imageTarget = nullptr;
+  target->LoadFailed(aFileHandle, aReason);
 }
 
 FileReaderAndroid::FileReaderAndroid(State& aState) : m(aState) {}
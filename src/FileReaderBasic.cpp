@@ -6,9 +6,17 @@
 #include "vrb/FileReaderBasic.h"
 #include "vrb/Logger.h"
 
+#include "vrb/AssetPack.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/KTX2Decoder.h"
+#include "vrb/LoadReport.h"
+#include "vrb/MappedFile.h"
+#include "vrb/Mutex.h"
+#include "vrb/TextureFormat.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <cstring>
 #include <fstream>
 #include <vector>
@@ -16,22 +24,63 @@
 #define GLIML_NO_PVR
 #include "gliml/gliml.h"
 
+namespace {
+
+// Raw files are delivered to the FileHandler in chunks of this size so the
+// whole file never has to be held in memory.
+const size_t kRawChunkSize = 256 * 1024;
+// Mapped files cost no extra memory per chunk, so they are handed out in
+// larger slices that the parser can split across threads.
+const size_t kMappedChunkSize = 16 * 1024 * 1024;
+
+}
+
 namespace vrb {
 
 struct FileReaderBasic::State {
-  int trackingHandleCount;
+  std::atomic<int> trackingHandleCount;
+  KTX2DecoderPtr ktx2Decoder;
+  Mutex packLock;
+  std::vector<AssetPackPtr> packs;
   State()
       : trackingHandleCount(0)
   {}
 
   int nextHandle() {
-    trackingHandleCount++;
-    return trackingHandleCount;
+    return ++trackingHandleCount;
+  }
+
+  MappedFilePtr mapPackEntry(const std::string& aFileName) {
+    MutexAutoLock lock(packLock);
+    for (auto it = packs.rbegin(); it != packs.rend(); ++it) {
+      MappedFilePtr result = (*it)->MapEntry(aFileName);
+      if (result) {
+        return result;
+      }
+    }
+    return nullptr;
   }
 
   void readRawFile(const std::string& aFileName, FileHandlerPtr aHandler) {
+    // Paused while the handler runs.
+    LoadReportTimer timer(LoadReport::Phase::Read);
     const int handle = nextHandle();
     aHandler->BindFileHandle(aFileName, handle);
+    {
+      MappedFilePtr mapping = mapPackEntry(aFileName);
+      if (!mapping) {
+        mapping = std::make_shared<MappedFile>(aFileName);
+      }
+      if (mapping->IsValid()) {
+        // Chunks point straight into the mapping so nothing is copied.
+        for (size_t offset = 0; offset < mapping->Size(); offset += kMappedChunkSize) {
+          const size_t count = std::min(kMappedChunkSize, mapping->Size() - offset);
+          aHandler->ProcessRawFileChunk(handle, mapping->Data() + offset, count);
+        }
+        aHandler->FinishRawFile(handle);
+        return;
+      }
+    }
     std::ifstream input(aFileName, std::ios::binary);
     if (!input) {
       std::string message("Unable to load file: ");
@@ -40,13 +89,22 @@ struct FileReaderBasic::State {
       return;
     }
 
-    std::vector<char> buffer((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
-    if (buffer.size() > 0) {
-      aHandler->ProcessRawFileChunk(handle, buffer.data(), buffer.size());
-      aHandler->FinishRawFile(handle);
-    } else {
+    std::unique_ptr<char[]> buffer = std::make_unique<char[]>(kRawChunkSize);
+    size_t total = 0;
+    while (input) {
+      input.read(buffer.get(), kRawChunkSize);
+      const size_t count = (size_t)input.gcount();
+      if (count == 0) {
+        break;
+      }
+      aHandler->ProcessRawFileChunk(handle, buffer.get(), count);
+      total += count;
+    }
+    if (input.bad() || (total == 0)) {
       aHandler->LoadFailed(handle, "Error while reading file");
+      return;
     }
+    aHandler->FinishRawFile(handle);
   }
 
 private:
@@ -72,34 +130,120 @@ FileReaderBasic::ReadImageFile(const std::string& aFileName, FileHandlerPtr aHan
   const int imageTargetHandle = m.nextHandle();
   aHandler->BindFileHandle(aFileName, imageTargetHandle);
 
-  std::ifstream input(aFileName, std::ios::binary);
-  if (!input) {
-    std::string message("Unable to load file: ");
-    aHandler->LoadFailed(imageTargetHandle, message + aFileName);
-    return;
+  // Parse the KTX container directly from the mapping when possible.
+  MappedFilePtr mapping = m.mapPackEntry(aFileName);
+  if (!mapping) {
+    mapping = std::make_shared<MappedFile>(aFileName);
+  }
+  std::vector<char> buffer;
+  const char* data = mapping->Data();
+  size_t size = mapping->Size();
+  if (!mapping->IsValid()) {
+    std::ifstream input(aFileName, std::ios::binary);
+    if (!input) {
+      std::string message("Unable to load file: ");
+      aHandler->LoadFailed(imageTargetHandle, message + aFileName);
+      return;
+    }
+    buffer.assign((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
   }
 
-  std::vector<char> buffer((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
-  if (buffer.size() == 0) {
+  if (size == 0) {
     std::string message("File is empty: ");
     aHandler->LoadFailed(imageTargetHandle, message + aFileName);
     return;
   }
 
+  if (KTX2Decoder::IsKTX2(data, size)) {
+    std::vector<ImageLevel> levels;
+    std::string error;
+    if (!m.ktx2Decoder) {
+      error = "No KTX2Decoder";
+    } else if (m.ktx2Decoder->Decode(data, size, levels, error)) {
+      aHandler->ProcessImageLevels(imageTargetHandle, levels);
+      return;
+    }
+    aHandler->LoadFailed(imageTargetHandle, error + ": " + aFileName);
+    return;
+  }
+
+  if (IsASTCFile(data, size)) {
+    std::vector<ImageLevel> levels;
+    std::string error;
+    if (!ReadASTCFile(data, size, levels, error)) {
+      aHandler->LoadFailed(imageTargetHandle, error + ": " + aFileName);
+      return;
+    }
+    aHandler->ProcessImageLevels(imageTargetHandle, levels);
+    return;
+  }
+
   gliml::context loader;
   loader.enable_etc2(true);
 
-  if (!loader.load_ktx(buffer.data(), buffer.size())) {
+  if (!loader.load_ktx(data, size)) {
+    // gliml does not know ASTC and the uncompressed formats.
+    std::vector<ImageLevel> levels;
+    std::string error;
+    if (ReadKTXFile(data, size, levels, error)) {
+      aHandler->ProcessImageLevels(imageTargetHandle, levels);
+      return;
+    }
     std::string message("Failed to parse file: ");
-    VRB_ERROR("Error code: %d", loader.error());
+    VRB_ERROR("Error code: %d, %s", loader.error(), error.c_str());
     aHandler->LoadFailed(imageTargetHandle, message + aFileName);
     return;
   }
 
-  const size_t length = loader.image_size(0, 0);
-  std::unique_ptr<uint8_t[]> image = std::make_unique<uint8_t[]>(length);
-  memcpy(image.get(), loader.image_data(0, 0), length);
-  aHandler->ProcessImageFile(imageTargetHandle, image, (uint64_t)length, loader.image_width(0, 0), loader.image_height(0, 0), (GLenum)loader.image_internal_format());
+  // The handler takes ownership of the levels, so each one is copied once
+  // out of the mapping.
+  const int kFaceCount = loader.num_faces();
+  std::vector<ImageLevel> levels;
+  for (int face = 0; face < kFaceCount; face++) {
+    const int kMipCount = loader.num_mipmaps(face);
+    for (int mip = 0; mip < kMipCount; mip++) {
+      ImageLevel level;
+      level.target = kFaceCount == 6 ? (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) : (GLenum)GL_TEXTURE_2D;
+      level.level = mip;
+      level.length = (uint64_t)loader.image_size(face, mip);
+      level.width = loader.image_width(face, mip);
+      level.height = loader.image_height(face, mip);
+      level.format = (GLenum)loader.image_internal_format();
+      level.data = std::make_unique<uint8_t[]>((size_t)level.length);
+      memcpy(level.data.get(), loader.image_data(face, mip), (size_t)level.length);
+      levels.push_back(std::move(level));
+    }
+  }
+  aHandler->ProcessImageLevels(imageTargetHandle, levels);
+}
+
+MappedFilePtr
+FileReaderBasic::MapFile(const std::string& aFileName) {
+  MappedFilePtr result = m.mapPackEntry(aFileName);
+  if (result) {
+    return result;
+  }
+  result = std::make_shared<MappedFile>(aFileName);
+  return result->IsValid() ? result : nullptr;
+}
+
+bool
+FileReaderBasic::AddAssetPack(const std::string& aFileName) {
+  AssetPackPtr pack = AssetPack::Create(std::make_shared<MappedFile>(aFileName));
+  if (!pack) {
+    VRB_ERROR("Unable to open asset pack: %s", aFileName.c_str());
+    return false;
+  }
+  MutexAutoLock lock(m.packLock);
+  m.packs.push_back(pack);
+  return true;
+}
+
+void
+FileReaderBasic::SetKTX2Decoder(const KTX2DecoderPtr& aDecoder) {
+  m.ktx2Decoder = aDecoder;
 }
 
 FileReaderBasic::FileReaderBasic(State& aState) : m(aState) {}
@@ -0,0 +1,233 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/GLError.h"
+#include "vrb/Mutex.h"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+namespace {
+
+const size_t kDefaultBatchSize = 256;
+
+enum NameType {
+  NameBuffer,
+  NameTexture,
+  NameProgram,
+  NameFramebuffer,
+  NameRenderbuffer,
+  NameVertexArray,
+  NameQuery,
+  NameTypeCount
+};
+
+struct Names {
+  std::vector<GLuint> lists[NameTypeCount];
+
+  bool Empty() const {
+    for (const std::vector<GLuint>& list: lists) {
+      if (!list.empty()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Deletes up to aCount names from the end of the lists and returns how
+  // many were deleted.
+  size_t Delete(const size_t aCount) {
+    size_t deleted = 0;
+    for (int type = 0; (type < NameTypeCount) && (deleted < aCount); type++) {
+      std::vector<GLuint>& list = lists[type];
+      const size_t kCount = std::min(list.size(), aCount - deleted);
+      if (kCount == 0) {
+        continue;
+      }
+      GLuint* names = list.data() + (list.size() - kCount);
+      const GLsizei kSize = (GLsizei)kCount;
+      switch (type) {
+        case NameBuffer:
+          VRB_GL_CHECK(glDeleteBuffers(kSize, names));
+          break;
+        case NameTexture:
+          VRB_GL_CHECK(glDeleteTextures(kSize, names));
+          break;
+        case NameProgram:
+          for (size_t ix = 0; ix < kCount; ix++) {
+            VRB_GL_CHECK(glDeleteProgram(names[ix]));
+          }
+          break;
+        case NameFramebuffer:
+          VRB_GL_CHECK(glDeleteFramebuffers(kSize, names));
+          break;
+        case NameRenderbuffer:
+          VRB_GL_CHECK(glDeleteRenderbuffers(kSize, names));
+          break;
+        case NameVertexArray:
+          VRB_GL_CHECK(glDeleteVertexArrays(kSize, names));
+          break;
+        case NameQuery:
+          VRB_GL_CHECK(glDeleteQueries(kSize, names));
+          break;
+      }
+      list.resize(list.size() - kCount);
+      deleted += kCount;
+    }
+    return deleted;
+  }
+};
+
+// Names queued during one frame, deleted once the GPU passed the fence
+// inserted at the start of the next.
+struct Batch {
+  GLsync fence = nullptr;
+  Names names;
+};
+
+} // namespace
+
+namespace vrb {
+
+struct GLDeletionQueue::State {
+  mutable Mutex lock;
+  // Guarded by lock.
+  Names incoming;
+  size_t pending;
+  // Only used on the render thread.
+  std::deque<Batch> fenced;
+  size_t batchSize;
+
+  State()
+      : pending(0)
+      , batchSize(kDefaultBatchSize)
+  {}
+
+  void Queue(const NameType aType, const GLuint aName) {
+    if (aName == 0) {
+      return;
+    }
+    MutexAutoLock guard(lock);
+    incoming.lists[aType].push_back(aName);
+    pending++;
+  }
+
+  void Deleted(const size_t aCount) {
+    if (aCount == 0) {
+      return;
+    }
+    MutexAutoLock guard(lock);
+    pending -= aCount;
+  }
+};
+
+GLDeletionQueuePtr
+GLDeletionQueue::Create() {
+  return std::make_shared<ConcreteClass<GLDeletionQueue, GLDeletionQueue::State> >();
+}
+
+void
+GLDeletionQueue::DeleteBuffer(const GLuint aBuffer) {
+  m.Queue(NameBuffer, aBuffer);
+}
+
+void
+GLDeletionQueue::DeleteTexture(const GLuint aTexture) {
+  m.Queue(NameTexture, aTexture);
+}
+
+void
+GLDeletionQueue::DeleteProgram(const GLuint aProgram) {
+  m.Queue(NameProgram, aProgram);
+}
+
+void
+GLDeletionQueue::DeleteFramebuffer(const GLuint aFramebuffer) {
+  m.Queue(NameFramebuffer, aFramebuffer);
+}
+
+void
+GLDeletionQueue::DeleteRenderbuffer(const GLuint aRenderbuffer) {
+  m.Queue(NameRenderbuffer, aRenderbuffer);
+}
+
+void
+GLDeletionQueue::DeleteVertexArray(const GLuint aVertexArray) {
+  m.Queue(NameVertexArray, aVertexArray);
+}
+
+void
+GLDeletionQueue::DeleteQuery(const GLuint aQuery) {
+  m.Queue(NameQuery, aQuery);
+}
+
+void
+GLDeletionQueue::SetBatchSize(const size_t aCount) {
+  m.batchSize = std::max(aCount, (size_t)1);
+}
+
+size_t
+GLDeletionQueue::GetPendingCount() const {
+  MutexAutoLock guard(m.lock);
+  return m.pending;
+}
+
+void
+GLDeletionQueue::Update() {
+  Batch batch;
+  {
+    MutexAutoLock guard(m.lock);
+    std::swap(batch.names, m.incoming);
+  }
+  if (!batch.names.Empty()) {
+    VRB_GL_CHECK(batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    m.fenced.push_back(std::move(batch));
+  }
+  size_t deleted = 0;
+  while ((deleted < m.batchSize) && !m.fenced.empty()) {
+    Batch& front = m.fenced.front();
+    if (front.fence) {
+      if (glClientWaitSync(front.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        break;
+      }
+      // Signaled, or the wait failed and there is nothing left to wait for.
+      glDeleteSync(front.fence);
+      front.fence = nullptr;
+    }
+    deleted += front.names.Delete(m.batchSize - deleted);
+    if (front.names.Empty()) {
+      m.fenced.pop_front();
+    }
+  }
+  m.Deleted(deleted);
+}
+
+void
+GLDeletionQueue::ShutdownGL() {
+  Names names;
+  {
+    MutexAutoLock guard(m.lock);
+    std::swap(names, m.incoming);
+  }
+  size_t deleted = names.Delete(SIZE_MAX);
+  for (Batch& batch: m.fenced) {
+    if (batch.fence) {
+      glDeleteSync(batch.fence);
+    }
+    deleted += batch.names.Delete(SIZE_MAX);
+  }
+  m.fenced.clear();
+  m.Deleted(deleted);
+}
+
+GLDeletionQueue::GLDeletionQueue(State& aState) : m(aState) {}
+
+GLDeletionQueue::~GLDeletionQueue() {}
+
+} // namespace vrb
@@ -0,0 +1,404 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// The native table takes the address of the real entry points.
+#define VRB_GL_DISPATCH_IMPLEMENTATION
+#include "vrb/GLDispatch.h"
+#include "vrb/Logger.h"
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Null implementation. Functions without an override below return a zero value.
+template <typename T> T ZeroValue() { return T(); }
+template <> void ZeroValue<void>() {}
+
+#define VRB_GL_DISPATCH_NULL(aReturn, aName, aParams, aArgs) aReturn Zero##aName aParams { return ZeroValue<aReturn>(); }
+VRB_GL_FUNCTIONS(VRB_GL_DISPATCH_NULL)
+#undef VRB_GL_DISPATCH_NULL
+
+GLuint sNextName = 1;
+GLuint sPackBuffer = 0;
+std::vector<uint8_t> sMapped;
+
+void
+NullGenNames(GLsizei aCount, GLuint* aNames) {
+  for (GLsizei ix = 0; ix < aCount; ix++) {
+    aNames[ix] = sNextName++;
+  }
+}
+
+// Number of values a state query writes. The lists a count query reports
+// empty, such as GL_COMPRESSED_TEXTURE_FORMATS, write none.
+GLsizei
+NullStateValueCount(const GLenum aName) {
+  switch (aName) {
+    case GL_VIEWPORT:
+    case GL_SCISSOR_BOX:
+    case GL_COLOR_CLEAR_VALUE:
+    case GL_COLOR_WRITEMASK:
+    case GL_BLEND_COLOR:
+      return 4;
+    case GL_MAX_VIEWPORT_DIMS:
+    case GL_DEPTH_RANGE:
+    case GL_ALIASED_LINE_WIDTH_RANGE:
+    case GL_ALIASED_POINT_SIZE_RANGE:
+      return 2;
+    case GL_COMPRESSED_TEXTURE_FORMATS:
+    case GL_PROGRAM_BINARY_FORMATS:
+    case GL_SHADER_BINARY_FORMATS:
+      return 0;
+    default:
+      return 1;
+  }
+}
+
+GLsizei
+NullPixelSize(const GLenum aFormat, const GLenum aType) {
+  switch (aType) {
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+      return 2;
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+      return 4;
+    default:
+      break;
+  }
+  GLsizei components = 4;
+  switch (aFormat) {
+    case GL_RED:
+    case GL_RED_INTEGER:
+    case GL_ALPHA:
+    case GL_LUMINANCE:
+      components = 1;
+      break;
+    case GL_RG:
+    case GL_RG_INTEGER:
+    case GL_LUMINANCE_ALPHA:
+      components = 2;
+      break;
+    case GL_RGB:
+    case GL_RGB_INTEGER:
+      components = 3;
+      break;
+    default:
+      break;
+  }
+  switch (aType) {
+    case GL_UNSIGNED_BYTE:
+    case GL_BYTE:
+      return components;
+    case GL_UNSIGNED_SHORT:
+    case GL_SHORT:
+    case GL_HALF_FLOAT:
+      return components * 2;
+    default:
+      return components * 4;
+  }
+}
+
+GLuint NullCreateName() { return sNextName++; }
+GLuint NullCreateShaderName(GLenum) { return sNextName++; }
+GLenum NullFramebufferStatus(GLenum) { return GL_FRAMEBUFFER_COMPLETE; }
+GLenum NullClientWaitSync(GLsync, GLbitfield, GLuint64) { return GL_ALREADY_SIGNALED; }
+GLsync NullFenceSync(GLenum, GLbitfield) { return (GLsync)&sNextName; }
+const GLubyte* NullGetString(GLenum) { return (const GLubyte*)""; }
+GLboolean NullUnmapBuffer(GLenum) { return GL_TRUE; }
+void NullGetQueryObjectuiv(GLuint, GLenum, GLuint* aParams) { *aParams = 1; }
+void NullGetTexParameteriv(GLenum, GLenum, GLint* aParams) { *aParams = 0; }
+
+void
+NullBindBuffer(GLenum aTarget, GLuint aBuffer) {
+  if (aTarget == GL_PIXEL_PACK_BUFFER) {
+    sPackBuffer = aBuffer;
+  }
+}
+
+void
+NullGetIntegerv(GLenum aName, GLint* aParams) {
+  for (GLsizei ix = 0; ix < NullStateValueCount(aName); ix++) {
+    aParams[ix] = 0;
+  }
+}
+
+void
+NullGetFloatv(GLenum aName, GLfloat* aParams) {
+  for (GLsizei ix = 0; ix < NullStateValueCount(aName); ix++) {
+    aParams[ix] = 0.0f;
+  }
+}
+
+void
+NullGetObjectiv(GLuint, GLenum aName, GLint* aParams) {
+  // Compile, link and validate status succeed with empty logs.
+  *aParams = ((aName == GL_INFO_LOG_LENGTH) || (aName == GL_PROGRAM_BINARY_LENGTH)) ? 0 : GL_TRUE;
+}
+
+void
+NullGetInfoLog(GLuint, GLsizei, GLsizei* aLength, GLchar* aLog) {
+  if (aLength) { *aLength = 0; }
+  if (aLog) { *aLog = '\0'; }
+}
+
+void
+NullGetProgramBinary(GLuint, GLsizei, GLsizei* aLength, GLenum* aFormat, void*) {
+  if (aLength) { *aLength = 0; }
+  if (aFormat) { *aFormat = 0; }
+}
+
+void
+NullReadPixels(GLint, GLint, GLsizei aWidth, GLsizei aHeight, GLenum aFormat, GLenum aType, void* aPixels) {
+  // With a pack buffer bound aPixels is an offset into it.
+  if (sPackBuffer || !aPixels || (aWidth <= 0) || (aHeight <= 0)) {
+    return;
+  }
+  // Rows are padded to the default GL_PACK_ALIGNMENT of 4.
+  const size_t kRow = (size_t)aWidth * NullPixelSize(aFormat, aType);
+  const size_t kStride = (kRow + 3) & ~(size_t)3;
+  memset(aPixels, 0, (kStride * (aHeight - 1)) + kRow);
+}
+
+void*
+NullMapBufferRange(GLenum, GLintptr, GLsizeiptr aLength, GLbitfield) {
+  if (sMapped.size() < (size_t)aLength) {
+    sMapped.resize((size_t)aLength);
+  }
+  return sMapped.data();
+}
+
+vrb::GLDispatch
+CreateNull() {
+  vrb::GLDispatch result = {
+#define VRB_GL_DISPATCH_NULL_ENTRY(aReturn, aName, aParams, aArgs) &Zero##aName,
+    VRB_GL_FUNCTIONS(VRB_GL_DISPATCH_NULL_ENTRY)
+#undef VRB_GL_DISPATCH_NULL_ENTRY
+  };
+  result.GenBuffers = &NullGenNames;
+  result.GenFramebuffers = &NullGenNames;
+  result.GenRenderbuffers = &NullGenNames;
+  result.GenSamplers = &NullGenNames;
+  result.GenTextures = &NullGenNames;
+  result.GenVertexArrays = &NullGenNames;
+  result.GenQueries = &NullGenNames;
+  result.CreateProgram = &NullCreateName;
+  result.CreateShader = &NullCreateShaderName;
+  result.BindBuffer = &NullBindBuffer;
+  result.CheckFramebufferStatus = &NullFramebufferStatus;
+  result.ClientWaitSync = &NullClientWaitSync;
+  result.FenceSync = &NullFenceSync;
+  result.GetString = &NullGetString;
+  result.UnmapBuffer = &NullUnmapBuffer;
+  result.GetIntegerv = &NullGetIntegerv;
+  result.GetFloatv = &NullGetFloatv;
+  result.GetTexParameteriv = &NullGetTexParameteriv;
+  result.GetShaderiv = &NullGetObjectiv;
+  result.GetProgramiv = &NullGetObjectiv;
+  result.GetQueryObjectuiv = &NullGetQueryObjectuiv;
+  result.GetShaderInfoLog = &NullGetInfoLog;
+  result.GetProgramInfoLog = &NullGetInfoLog;
+  result.GetProgramBinary = &NullGetProgramBinary;
+  result.ReadPixels = &NullReadPixels;
+  result.MapBufferRange = &NullMapBufferRange;
+  return result;
+}
+
+} // namespace
+
+namespace vrb {
+
+const GLDispatch&
+GLDispatchGetNull() {
+  static const GLDispatch sNull = CreateNull();
+  return sNull;
+}
+
+} // namespace vrb
+
+#if defined(VRB_GL_DISPATCH)
+
+namespace {
+
+enum class Function {
+#define VRB_GL_DISPATCH_INDEX(aReturn, aName, aParams, aArgs) aName,
+  VRB_GL_FUNCTIONS(VRB_GL_DISPATCH_INDEX)
+#undef VRB_GL_DISPATCH_INDEX
+  Count
+};
+
+const size_t kFunctionCount = (size_t)Function::Count;
+
+const char* const kNames[] = {
+#define VRB_GL_DISPATCH_NAME(aReturn, aName, aParams, aArgs) #aName,
+  VRB_GL_FUNCTIONS(VRB_GL_DISPATCH_NAME)
+#undef VRB_GL_DISPATCH_NAME
+};
+
+std::atomic<uint64_t> sCalls[kFunctionCount];
+std::atomic<uint64_t> sBytes[kFunctionCount];
+
+#define VRB_GL_DISPATCH_NATIVE(aReturn, aName, aParams, aArgs) &gl##aName,
+const vrb::GLDispatch kNative = {
+  VRB_GL_FUNCTIONS(VRB_GL_DISPATCH_NATIVE)
+};
+
+// The table the recording layer forwards to.
+vrb::GLDispatch sBackendTable = kNative;
+vrb::GLBackend sBackend = vrb::GLBackend::Native;
+bool sRecording = false;
+
+void
+Record(const Function aFunction, const uint64_t aBytes) {
+  sCalls[(size_t)aFunction].fetch_add(1, std::memory_order_relaxed);
+  if (aBytes) {
+    sBytes[(size_t)aFunction].fetch_add(aBytes, std::memory_order_relaxed);
+  }
+}
+
+#define VRB_GL_DISPATCH_RECORD(aReturn, aName, aParams, aArgs) \
+aReturn Record##aName aParams { Record(Function::aName, 0); return sBackendTable.aName aArgs; }
+VRB_GL_FUNCTIONS(VRB_GL_DISPATCH_RECORD)
+#undef VRB_GL_DISPATCH_RECORD
+
+void
+RecordBytesBufferData(GLenum aTarget, GLsizeiptr aSize, const void* aData, GLenum aUsage) {
+  Record(Function::BufferData, (uint64_t)aSize);
+  sBackendTable.BufferData(aTarget, aSize, aData, aUsage);
+}
+
+void
+RecordBytesBufferSubData(GLenum aTarget, GLintptr aOffset, GLsizeiptr aSize, const void* aData) {
+  Record(Function::BufferSubData, (uint64_t)aSize);
+  sBackendTable.BufferSubData(aTarget, aOffset, aSize, aData);
+}
+
+void
+RecordBytesTexImage2D(GLenum aTarget, GLint aLevel, GLint aInternalFormat, GLsizei aWidth, GLsizei aHeight, GLint aBorder, GLenum aFormat, GLenum aType, const GLvoid* aPixels) {
+  Record(Function::TexImage2D, aPixels ? (uint64_t)aWidth * (uint64_t)aHeight * 4 : 0);
+  sBackendTable.TexImage2D(aTarget, aLevel, aInternalFormat, aWidth, aHeight, aBorder, aFormat, aType, aPixels);
+}
+
+void
+RecordBytesTexSubImage2D(GLenum aTarget, GLint aLevel, GLint aX, GLint aY, GLsizei aWidth, GLsizei aHeight, GLenum aFormat, GLenum aType, const GLvoid* aPixels) {
+  Record(Function::TexSubImage2D, (uint64_t)aWidth * (uint64_t)aHeight * 4);
+  sBackendTable.TexSubImage2D(aTarget, aLevel, aX, aY, aWidth, aHeight, aFormat, aType, aPixels);
+}
+
+void
+RecordBytesTexSubImage3D(GLenum aTarget, GLint aLevel, GLint aX, GLint aY, GLint aZ, GLsizei aWidth, GLsizei aHeight, GLsizei aDepth, GLenum aFormat, GLenum aType, const GLvoid* aPixels) {
+  Record(Function::TexSubImage3D, (uint64_t)aWidth * (uint64_t)aHeight * (uint64_t)aDepth * 4);
+  sBackendTable.TexSubImage3D(aTarget, aLevel, aX, aY, aZ, aWidth, aHeight, aDepth, aFormat, aType, aPixels);
+}
+
+void
+RecordBytesCompressedTexImage2D(GLenum aTarget, GLint aLevel, GLenum aFormat, GLsizei aWidth, GLsizei aHeight, GLint aBorder, GLsizei aSize, const GLvoid* aData) {
+  Record(Function::CompressedTexImage2D, (uint64_t)aSize);
+  sBackendTable.CompressedTexImage2D(aTarget, aLevel, aFormat, aWidth, aHeight, aBorder, aSize, aData);
+}
+
+void
+RecordBytesCompressedTexSubImage2D(GLenum aTarget, GLint aLevel, GLint aX, GLint aY, GLsizei aWidth, GLsizei aHeight, GLenum aFormat, GLsizei aSize, const GLvoid* aData) {
+  Record(Function::CompressedTexSubImage2D, (uint64_t)aSize);
+  sBackendTable.CompressedTexSubImage2D(aTarget, aLevel, aX, aY, aWidth, aHeight, aFormat, aSize, aData);
+}
+
+vrb::GLDispatch
+CreateRecording() {
+  vrb::GLDispatch result = {
+#define VRB_GL_DISPATCH_RECORD_ENTRY(aReturn, aName, aParams, aArgs) &Record##aName,
+    VRB_GL_FUNCTIONS(VRB_GL_DISPATCH_RECORD_ENTRY)
+#undef VRB_GL_DISPATCH_RECORD_ENTRY
+  };
+  result.BufferData = &RecordBytesBufferData;
+  result.BufferSubData = &RecordBytesBufferSubData;
+  result.TexImage2D = &RecordBytesTexImage2D;
+  result.TexSubImage2D = &RecordBytesTexSubImage2D;
+  result.TexSubImage3D = &RecordBytesTexSubImage3D;
+  result.CompressedTexImage2D = &RecordBytesCompressedTexImage2D;
+  result.CompressedTexSubImage2D = &RecordBytesCompressedTexSubImage2D;
+  return result;
+}
+
+void
+UpdateTable() {
+  sBackendTable = sBackend == vrb::GLBackend::Null ? vrb::GLDispatchGetNull() : kNative;
+  vrb::gGLDispatch = sRecording ? CreateRecording() : sBackendTable;
+}
+
+} // namespace
+
+namespace vrb {
+
+// Statically initialized so GL may be called before any dynamic initializer.
+GLDispatch gGLDispatch = {
+  VRB_GL_FUNCTIONS(VRB_GL_DISPATCH_NATIVE)
+};
+#undef VRB_GL_DISPATCH_NATIVE
+
+void
+GLDispatchSetBackend(const GLBackend aBackend) {
+  sBackend = aBackend;
+  UpdateTable();
+}
+
+GLBackend
+GLDispatchGetBackend() {
+  return sBackend;
+}
+
+void
+GLDispatchSetRecording(const bool aEnabled) {
+  sRecording = aEnabled;
+  UpdateTable();
+}
+
+bool
+GLDispatchIsRecording() {
+  return sRecording;
+}
+
+void
+GLDispatchGetRecords(std::vector<GLCallRecord>& aRecords) {
+  for (size_t ix = 0; ix < kFunctionCount; ix++) {
+    const uint64_t kCalls = sCalls[ix].load(std::memory_order_relaxed);
+    if (kCalls > 0) {
+      aRecords.push_back({kNames[ix], kCalls, sBytes[ix].load(std::memory_order_relaxed)});
+    }
+  }
+}
+
+uint64_t
+GLDispatchGetCallCount(const char* aName) {
+  for (size_t ix = 0; ix < kFunctionCount; ix++) {
+    if (strcmp(kNames[ix], aName) == 0) {
+      return sCalls[ix].load(std::memory_order_relaxed);
+    }
+  }
+  return 0;
+}
+
+void
+GLDispatchResetRecords() {
+  for (size_t ix = 0; ix < kFunctionCount; ix++) {
+    sCalls[ix].store(0, std::memory_order_relaxed);
+    sBytes[ix].store(0, std::memory_order_relaxed);
+  }
+}
+
+void
+GLDispatchLogRecords() {
+  std::vector<GLCallRecord> records;
+  GLDispatchGetRecords(records);
+  for (const GLCallRecord& record: records) {
+    VRB_LOG("gl%s calls: %llu bytes: %llu", record.name, (unsigned long long)record.calls, (unsigned long long)record.bytes);
+  }
+}
+
+} // namespace vrb
+
+#endif // defined(VRB_GL_DISPATCH)
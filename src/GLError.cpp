@@ -5,10 +5,46 @@
 
 #include "vrb/GLError.h"
 
+#include "vrb/Logger.h"
 #include "vrb/gl.h"
 
+namespace {
+
+void GL_APIENTRY
+DebugMessage(GLenum aSource, GLenum aType, GLuint aId, GLenum aSeverity, GLsizei aLength,
+             const GLchar* aMessage, const void* aUserParam) {
+  if ((aType != GL_DEBUG_TYPE_ERROR_KHR) && (aSeverity != GL_DEBUG_SEVERITY_HIGH_KHR)) {
+    return;
+  }
+  VRB_ERROR("OpenGL debug message: %s", aMessage ? aMessage : "");
+  if (!vrb::gGLErrorCheckEveryCall.exchange(true, std::memory_order_relaxed)) {
+    VRB_WARN("Checking every GL call for errors");
+  }
+}
+
+void
+ReportErrors(const char* aWork) {
+  bool found = false;
+  // Each flag is cleared as it is read, there may be several.
+  for (int ix = 0; ix < 8; ix++) {
+    const char* error = vrb::GLErrorCheck();
+    if (!error) {
+      break;
+    }
+    VRB_ERROR("OpenGL Error during %s: %s", aWork, error);
+    found = true;
+  }
+  if (found && !vrb::gGLErrorCheckEveryCall.exchange(true, std::memory_order_relaxed)) {
+    VRB_WARN("Checking every GL call for errors");
+  }
+}
+
+} // namespace
+
 namespace vrb {
 
+std::atomic<bool> gGLErrorCheckEveryCall(false);
+
 const char *
 GLErrorString(GLenum aError) {
   const char *result = nullptr;
@@ -60,4 +96,29 @@ GLErrorCheck() {
   return nullptr;
 }
 
+void
+GLErrorCheckFrame() {
+  ReportErrors("the previous frame");
+}
+
+void
+GLErrorCheckWork(const char* aWork) {
+  ReportErrors(aWork);
+}
+
+void
+GLErrorSetCheckEveryCall(const bool aEnabled) {
+  gGLErrorCheckEveryCall.store(aEnabled, std::memory_order_relaxed);
+}
+
+void
+GLErrorEnableDebugOutput(PFNGLDEBUGMESSAGECALLBACKKHRPROC aDebugMessageCallback) {
+  if (!aDebugMessageCallback) {
+    return;
+  }
+  aDebugMessageCallback(&DebugMessage, nullptr);
+  glEnable(GL_DEBUG_OUTPUT_KHR);
+  glGetError(); // Not every context accepts GL_DEBUG_OUTPUT_KHR.
+}
+
 } // namespace vrb
@@ -8,9 +8,11 @@
 #include "vrb/GLError.h"
 #include "vrb/GLExtensions.h"
 
+#include <cstdio>
 #include <cstring>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #if defined(ANDROID)
 #include <EGL/egl.h>
@@ -20,6 +22,7 @@ namespace vrb {
 
 struct GLExtensions::State {
   std::unordered_set<GLExtensions::Ext> supportedExtensions;
+  std::unordered_set<GLenum> compressedFormats;
   Functions functions;
 
   State() {
@@ -28,13 +31,67 @@ struct GLExtensions::State {
 
   void Initialize() {
     supportedExtensions.clear();
+    compressedFormats.clear();
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &formatCount);
+    if (formatCount > 0) {
+      std::vector<GLint> formats((size_t)formatCount, 0);
+      glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+      for (const GLint format: formats) {
+        compressedFormats.insert((GLenum)format);
+      }
+    }
 
     const char * glStr = (const char *) glGetString( GL_EXTENSIONS );
+    if (!glStr) {
+      glStr = "";
+    }
 #define ADD_EXT(n, v) if (strstr(glStr, n)) { supportedExtensions.insert(v); }
     ADD_EXT("GL_EXT_multisampled_render_to_texture", Ext::EXT_multisampled_render_to_texture);
     ADD_EXT("GL_OVR_multiview", Ext::OVR_multiview);
     ADD_EXT("GL_OVR_multiview2", Ext::OVR_multiview2);
     ADD_EXT("OVR_multiview_multisampled_render_to_texture", Ext::OVR_multiview_multisampled_render_to_texture);
+    ADD_EXT("GL_OES_element_index_uint", Ext::OES_element_index_uint);
+    ADD_EXT("GL_KHR_parallel_shader_compile", Ext::KHR_parallel_shader_compile);
+    ADD_EXT("GL_EXT_disjoint_timer_query", Ext::EXT_disjoint_timer_query);
+    ADD_EXT("GL_KHR_debug", Ext::KHR_debug);
+    ADD_EXT("GL_KHR_texture_compression_astc_ldr", Ext::KHR_texture_compression_astc_ldr);
+    ADD_EXT("GL_ARB_ES3_compatibility", Ext::ARB_ES3_compatibility);
+    ADD_EXT("GL_EXT_buffer_storage", Ext::EXT_buffer_storage);
+    ADD_EXT("GL_QCOM_texture_foveated", Ext::QCOM_texture_foveated);
+    ADD_EXT("GL_EXT_multi_draw_arrays", Ext::EXT_multi_draw_arrays);
+    ADD_EXT("GL_ARB_ES3_1_compatibility", Ext::ARB_ES3_1_compatibility);
+    ADD_EXT("GL_ARB_sampler_objects", Ext::ARB_sampler_objects);
+    ADD_EXT("GL_EXT_texture_filter_anisotropic", Ext::EXT_texture_filter_anisotropic);
+    ADD_EXT("GL_OES_EGL_image_external", Ext::OES_EGL_image_external);
+    // Core in GLES 3.1, which is not advertised as an extension.
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int esMajor = 0;
+    int esMinor = 0;
+    if (version && (sscanf(version, "OpenGL ES %d.%d", &esMajor, &esMinor) == 2)) {
+      if ((esMajor > 3) || ((esMajor == 3) && (esMinor >= 1))) {
+        supportedExtensions.insert(Ext::ARB_ES3_1_compatibility);
+      }
+      // As are sampler objects and the rest of ES3 compatibility in GLES3.
+      if (esMajor >= 3) {
+        supportedExtensions.insert(Ext::ARB_sampler_objects);
+        supportedExtensions.insert(Ext::ARB_ES3_compatibility);
+      }
+    }
+#if defined(ANDROID)
+    // 32-bit indices are core in GLES3, where the extension may not be advertised.
+    GLint majorVersion = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+    glGetError(); // GL_MAJOR_VERSION is not a valid enum in a GLES2 context.
+    if (majorVersion >= 3) {
+      supportedExtensions.insert(Ext::OES_element_index_uint);
+      // So are the ETC2 formats, which desktop GL gets from ES3 compatibility.
+      supportedExtensions.insert(Ext::ARB_ES3_compatibility);
+    }
+#else
+    // 32-bit indices are always available in desktop GL.
+    supportedExtensions.insert(Ext::OES_element_index_uint);
+#endif
 
 #if defined(ANDROID)
 #define GET_PROC(n) functions.n = (decltype(functions.n))eglGetProcAddress(#n);
@@ -42,7 +99,53 @@ struct GLExtensions::State {
     GET_PROC(glFramebufferTexture2DMultisampleEXT);
     GET_PROC(glFramebufferTextureMultiviewOVR);
     GET_PROC(glFramebufferTextureMultisampleMultiviewOVR);
+    GET_PROC(glMaxShaderCompilerThreadsKHR);
+    GET_PROC(glGenQueriesEXT);
+    GET_PROC(glDeleteQueriesEXT);
+    GET_PROC(glQueryCounterEXT);
+    GET_PROC(glGetQueryObjectivEXT);
+    GET_PROC(glGetQueryObjectui64vEXT);
+    GET_PROC(glDebugMessageCallbackKHR);
+    GET_PROC(glBufferStorageEXT);
+    GET_PROC(glTextureFoveationParametersQCOM);
+    GET_PROC(glMultiDrawElementsEXT);
+    GET_PROC(glDispatchCompute);
+    GET_PROC(glMemoryBarrier);
+    GET_PROC(glDrawElementsIndirect);
+    GET_PROC(glEGLImageTargetTexture2DOES);
+#elif !defined(__APPLE__)
+    // Declared by glext.h, see GL_GLEXT_PROTOTYPES in gl.h.
+    functions.glDispatchCompute = glDispatchCompute;
+    functions.glMemoryBarrier = glMemoryBarrier;
+    functions.glDrawElementsIndirect = glDrawElementsIndirect;
 #endif
+    if (!functions.glGenQueriesEXT || !functions.glDeleteQueriesEXT || !functions.glQueryCounterEXT ||
+        !functions.glGetQueryObjectivEXT || !functions.glGetQueryObjectui64vEXT) {
+      supportedExtensions.erase(Ext::EXT_disjoint_timer_query);
+    }
+    if (!functions.glDebugMessageCallbackKHR) {
+      supportedExtensions.erase(Ext::KHR_debug);
+    }
+    if (!functions.glBufferStorageEXT) {
+      supportedExtensions.erase(Ext::EXT_buffer_storage);
+    }
+    if (!functions.glTextureFoveationParametersQCOM) {
+      supportedExtensions.erase(Ext::QCOM_texture_foveated);
+    }
+    if (!functions.glMultiDrawElementsEXT) {
+      supportedExtensions.erase(Ext::EXT_multi_draw_arrays);
+    }
+    if (!functions.glEGLImageTargetTexture2DOES) {
+      supportedExtensions.erase(Ext::OES_EGL_image_external);
+    }
+    if (!functions.glDispatchCompute || !functions.glMemoryBarrier || !functions.glDrawElementsIndirect) {
+      supportedExtensions.erase(Ext::ARB_ES3_1_compatibility);
+    }
+    if (functions.glMaxShaderCompilerThreadsKHR &&
+        (supportedExtensions.find(Ext::KHR_parallel_shader_compile) != supportedExtensions.end())) {
+      // Let the driver pick how many compiler threads to use.
+      functions.glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    }
   }
 };
 
@@ -61,6 +164,11 @@ GLExtensions::IsExtensionSupported(GLExtensions::Ext aExtension) const {
   return m.supportedExtensions.find(aExtension) != m.supportedExtensions.end();
 }
 
+bool
+GLExtensions::IsCompressedFormatSupported(const GLenum aFormat) const {
+  return m.compressedFormats.find(aFormat) != m.compressedFormats.end();
+}
+
 const GLExtensions::Functions &
 GLExtensions::GetFunctions() const {
   return m.functions;
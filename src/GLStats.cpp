@@ -0,0 +1,30 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/GLStats.h"
+
+#include <atomic>
+
+namespace {
+
+std::atomic<uint64_t> sCounters[(int)vrb::GLStats::Counter::Count];
+
+} // namespace
+
+namespace vrb {
+
+void
+GLStatsAdd(const GLStats::Counter aCounter, const uint64_t aAmount) {
+  sCounters[(int)aCounter].fetch_add(aAmount, std::memory_order_relaxed);
+}
+
+void
+GLStatsEndFrame(GLStats& aResult) {
+  for (int ix = 0; ix < (int)GLStats::Counter::Count; ix++) {
+    aResult.values[ix] = sCounters[ix].exchange(0, std::memory_order_relaxed);
+  }
+}
+
+} // namespace vrb
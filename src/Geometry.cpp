@@ -5,56 +5,1258 @@
 
 #include "vrb/Geometry.h"
 
+#include "vrb/private/Clock.h"
 #include "vrb/private/GeometryDrawableState.h"
+#include "vrb/private/PoolAllocator.h"
 #include "vrb/private/ResourceGLState.h"
+#include "vrb/private/UpdatableState.h"
+#include "vrb/BatchMath.h"
+#include "vrb/BoundingVolumeHierarchy.h"
+#include "vrb/Bounds.h"
 
 #include "vrb/Camera.h"
 #include "vrb/Color.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
 #include "vrb/CullVisitor.h"
+#include "vrb/DataCache.h"
 #include "vrb/DrawableList.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLError.h"
+#include "vrb/GLExtensions.h"
+#include "vrb/JobSystem.h"
+#include "vrb/LoadReport.h"
 #include "vrb/Logger.h"
 #include "vrb/Matrix.h"
+#include "vrb/MemoryCounter.h"
+#include "vrb/MeshOptimizer.h"
+#include "vrb/Mutex.h"
+#include "vrb/RayHit.h"
 #include "vrb/RenderBuffer.h"
 #include "vrb/RenderState.h"
 #include "vrb/Texture.h"
+#include "vrb/TraceProfiler.h"
 #include "vrb/VertexArray.h"
 #include "vrb/Vector.h"
+#include "vrb/Vector4.h"
 
+#include <algorithm>
 #include <limits>
+#include <math.h>
+#include <string.h>
+#include <unordered_map>
 #include <vector>
 
 namespace {
 
+struct WeldKey {
+  GLuint vertex;
+  GLuint normal;
+  GLuint uv;
+  bool operator==(const WeldKey& aOther) const {
+    return (vertex == aOther.vertex) && (normal == aOther.normal) && (uv == aOther.uv);
+  }
+};
+
+struct WeldKeyHash {
+  size_t operator()(const WeldKey& aKey) const {
+    uint64_t hash = aKey.vertex;
+    hash = (hash * 0x9E3779B97F4A7C15ull) ^ aKey.normal;
+    hash = (hash * 0x9E3779B97F4A7C15ull) ^ aKey.uv;
+    return (size_t)(hash ^ (hash >> 29));
+  }
+};
+
+uint16_t
+FloatToHalf(const float aValue) {
+  uint32_t bits = 0;
+  memcpy(&bits, &aValue, sizeof(bits));
+  const uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+  const uint32_t rawExponent = (bits >> 23) & 0xff;
+  const int32_t exponent = (int32_t)rawExponent - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+  if (rawExponent == 0xff) {
+    // Infinity or NaN
+    return sign | (uint16_t)0x7c00 | (uint16_t)(mantissa ? 0x200 : 0);
+  }
+  if (exponent >= 31) {
+    return sign | (uint16_t)0x7c00;
+  }
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return sign;
+    }
+    // Denormalized half
+    mantissa |= 0x800000;
+    const uint32_t shift = (uint32_t)(14 - exponent);
+    uint32_t half = mantissa >> shift;
+    if ((mantissa >> (shift - 1)) & 0x1) {
+      half++;
+    }
+    return sign | (uint16_t)half;
+  }
+  uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000) {
+    // Rounding may carry into the exponent which is the correct result.
+    half++;
+  }
+  return sign | (uint16_t)half;
+}
+
+float
+Clamp(const float aValue, const float aMin, const float aMax) {
+  return aValue < aMin ? aMin : (aValue > aMax ? aMax : aValue);
+}
+
+// Writes aLength floats from aSource to aTarget in the GL attribute format aType.
 void
-CopyIndices(std::vector<GLushort> &aTarget, const std::vector<int> &aSource) {
-  aTarget.reserve(aSource.size());
-  for (auto value: aSource) {
-    if (value >= std::numeric_limits<GLushort>::max()) {
-      VRB_ERROR("Index is greater than max size of GLushort: %d", value);
+EncodeAttribute(uint8_t* aTarget, const float* aSource, const GLsizei aLength, const GLenum aType) {
+  if (aType == GL_HALF_FLOAT) {
+    uint16_t* target = reinterpret_cast<uint16_t*>(aTarget);
+    for (GLsizei ix = 0; ix < aLength; ix++) {
+      target[ix] = FloatToHalf(aSource[ix]);
+    }
+  } else if (aType == GL_INT_2_10_10_10_REV) {
+    uint32_t packed = 0;
+    for (GLsizei ix = 0; (ix < aLength) && (ix < 3); ix++) {
+      const int32_t value = (int32_t)roundf(Clamp(aSource[ix], -1.0f, 1.0f) * 511.0f);
+      packed |= ((uint32_t)value & 0x3ff) << (10 * ix);
+    }
+    memcpy(aTarget, &packed, sizeof(packed));
+  } else if (aType == GL_UNSIGNED_SHORT) {
+    uint16_t* target = reinterpret_cast<uint16_t*>(aTarget);
+    for (GLsizei ix = 0; ix < aLength; ix++) {
+      target[ix] = (uint16_t)roundf(Clamp(aSource[ix], 0.0f, 1.0f) * 65535.0f);
     }
-    aTarget.push_back(static_cast<GLushort>(value));
+  } else if (aType == GL_UNSIGNED_BYTE) {
+    for (GLsizei ix = 0; ix < aLength; ix++) {
+      aTarget[ix] = (uint8_t)roundf(Clamp(aSource[ix], 0.0f, 1.0f) * 255.0f);
+    }
+  } else {
+    memcpy(aTarget, aSource, aLength * sizeof(float));
+  }
+}
+
+// Joint indices are small integers and are not normalized.
+void
+EncodeJoints(uint8_t* aTarget, const float* aSource, const GLsizei aLength, const GLenum aType) {
+  if (aType == GL_UNSIGNED_BYTE) {
+    for (GLsizei ix = 0; ix < aLength; ix++) {
+      aTarget[ix] = (uint8_t)Clamp(aSource[ix], 0.0f, 255.0f);
+    }
+  } else {
+    EncodeAttribute(aTarget, aSource, aLength, aType);
+  }
+}
+
+template <typename T>
+void
+PackIndices(const std::vector<GLuint>& aIndices, std::vector<uint8_t>& aResult) {
+  aResult.resize(aIndices.size() * sizeof(T));
+  T* target = reinterpret_cast<T*>(aResult.data());
+  for (GLuint index: aIndices) {
+    *target = static_cast<T>(index);
+    target++;
+  }
+}
+
+// Smoothing group of the faces added before any group is set.
+const int32_t kNoSmoothingGroup = -1;
+// Faces, or vertices, handled by each job of the normal generation.
+const size_t kNormalJobSize = 8192;
+
+// Runs aWork(aBegin, aEnd) over chunks of [0, aCount) on aJobs and waits for
+// them, or over the whole range on the calling thread without workers.
+template <typename T>
+void
+RunChunks(const vrb::JobSystemPtr& aJobs, const size_t aCount, const T& aWork) {
+  if (!aJobs || (aJobs->GetWorkerCount() <= 0) || (aCount <= kNormalJobSize)) {
+    aWork(0, aCount);
+    return;
   }
+  vrb::JobSystem::JobHandle parent = aJobs->Create(nullptr);
+  for (size_t begin = 0; begin < aCount; begin += kNormalJobSize) {
+    const size_t kEnd = std::min(aCount, begin + kNormalJobSize);
+    aJobs->Schedule([&aWork, begin, kEnd]() { aWork(begin, kEnd); }, parent);
+  }
+  aJobs->Run(parent);
+  aJobs->Wait(parent);
+}
+
+// Packed buffer contents kept once the source of a Geometry is released so
+// that the buffer may be restored after the GL context is lost. The copy
+// lives in the DataCache when possible and in memory otherwise.
+struct RetainedBuffer {
+  uint32_t handle = 0;
+  size_t size = 0;
+  std::unique_ptr<uint8_t[]> data;
+  // Data owned by someone else, see Geometry::SetBufferData.
+  std::shared_ptr<const void> owner;
+  const uint8_t* view = nullptr;
+};
+
+void
+Retain(const vrb::DataCachePtr& aCache, const std::vector<uint8_t>& aSource, RetainedBuffer& aTarget) {
+  aTarget.size = aSource.size();
+  aTarget.data.reset(new uint8_t[aTarget.size]);
+  memcpy(aTarget.data.get(), aSource.data(), aTarget.size);
+  if (!aCache || (aTarget.size == 0)) {
+    return;
+  }
+  // CacheData takes ownership of the copy, even when it fails.
+  std::unique_ptr<uint8_t[]> copy(new uint8_t[aTarget.size]);
+  memcpy(copy.get(), aSource.data(), aTarget.size);
+  aTarget.handle = aCache->CacheData(copy, aTarget.size);
+  if (aTarget.handle > 0) {
+    aTarget.data = nullptr;
+  }
+}
+
+// Returns the retained contents, loading them into aScratch if cached.
+const uint8_t*
+Restore(const vrb::DataCachePtr& aCache, const RetainedBuffer& aSource, std::unique_ptr<uint8_t[]>& aScratch) {
+  if (aSource.data) {
+    return aSource.data.get();
+  }
+  if (aSource.view) {
+    return aSource.view;
+  }
+  if (aCache && (aSource.handle > 0) && (aCache->LoadData(aSource.handle, aScratch) == aSource.size)) {
+    return aScratch.get();
+  }
+  return nullptr;
+}
+
+void
+Forget(const vrb::DataCachePtr& aCache, RetainedBuffer& aBuffer) {
+  if (aCache && (aBuffer.handle > 0)) {
+    aCache->RemoveData(aBuffer.handle);
+  }
+  aBuffer.handle = 0;
+  aBuffer.size = 0;
+  aBuffer.data = nullptr;
+  aBuffer.owner = nullptr;
+  aBuffer.view = nullptr;
+}
+
+enum class BufferStorage {
+  Unallocated,
+  Immutable,
+  Mutable
+};
+
+// Uploads static vertex or index data into aBuffer. With EXT_buffer_storage
+// the first upload allocates immutable storage, which lets the driver skip
+// the bookkeeping needed for a store that may be respecified. Immutable
+// storage cannot be uploaded again, so a buffer updated after its first
+// upload is replaced by a new name that stays mutable. Returns true when
+// aBuffer was replaced.
+bool
+UploadStaticBuffer(const vrb::GLExtensionsPtr& aExtensions, const GLenum aTarget, GLuint& aBuffer,
+                   BufferStorage& aStorage, const GLsizeiptr aSize, const void* aData) {
+  const bool kReplace = aStorage == BufferStorage::Immutable;
+  if (kReplace) {
+    // The new name is generated first so that it differs from the old one.
+    GLuint buffer = 0;
+    VRB_GL_CHECK(glGenBuffers(1, &buffer));
+    VRB_GL_CHECK(glDeleteBuffers(1, &aBuffer));
+    aBuffer = buffer;
+  }
+  VRB_GL_CHECK(glBindBuffer(aTarget, aBuffer));
+  if ((aStorage == BufferStorage::Unallocated) && (aSize > 0) && aExtensions &&
+      aExtensions->IsExtensionSupported(vrb::GLExtensions::Ext::EXT_buffer_storage)) {
+    VRB_GL_CHECK(aExtensions->GetFunctions().glBufferStorageEXT(aTarget, aSize, aData, 0));
+    aStorage = BufferStorage::Immutable;
+  } else {
+    VRB_GL_CHECK(glBufferData(aTarget, aSize, aData, GL_STATIC_DRAW));
+    aStorage = BufferStorage::Mutable;
+  }
+  return kReplace;
 }
 
 }
 
 namespace vrb {
 
-struct Geometry::State : public GeometryDrawable::State, public ResourceGL::State {
+struct Geometry::State : public GeometryDrawable::State, public ResourceGL::State, public Updatable::State {
+  CreationContextWeak context;
   VertexArrayPtr vertexArray;
-  std::vector<Face> faces;
+  // Faces are stored triangulated as parallel arrays of one based corner
+  // indices. faceOffsets holds the first corner of each face.
+  std::vector<GLuint> cornerVertices;
+  std::vector<GLuint> cornerUVs;
+  std::vector<GLuint> cornerNormals;
+  std::vector<uint32_t> faceOffsets;
+  // Smoothing group of each face, empty until a group is set.
+  std::vector<int32_t> faceGroups;
+  int32_t smoothingGroup = kNoSmoothingGroup;
+  // Set while faces are waiting for generated normals.
+  bool normalsPending = false;
+  GLExtensionsPtr glExtensions;
+  uint32_t vertexFormat = 0;
+  // Polygon corners added, an upper bound of the unique vertex count.
   GLsizei vertexCount = 0;
-  GLsizei triangleCount = 0;
+  struct Part {
+    std::string name;
+    int32_t firstFace = 0;
+    int32_t faceCount = 0;
+    // Location in the index buffer, known once the buffers are built.
+    uint32_t indexStart = 0;
+    uint32_t indexLength = 0;
+    bool enabled = true;
+  };
+  std::vector<Part> parts;
+  bool partsHidden = false;
+  std::shared_ptr<SharedVertices> shared;
+  // Indices into the shared vertex buffer, waiting to be uploaded.
+  std::vector<GLuint> sharedIndices;
+  DataCachePtr dataCache;
+  GLDeletionQueuePtr glDeletions;
+  bool releaseSource = false;
+  bool sourceReleased = false;
+  Bounds sourceBounds;
+  RetainedBuffer retainedVertices;
+  RetainedBuffer retainedIndices;
+  GLenum retainedIndexType = GL_UNSIGNED_SHORT;
+  GLsizei retainedIndexCount = 0;
+  GLuint retainedVertexCount = 0;
+  BufferStorage vertexStorage = BufferStorage::Unallocated;
+  BufferStorage indexStorage = BufferStorage::Unallocated;
+  bool dynamic = false;
+  bool strips = false;
+  // Set when the faces change so that a dynamic Geometry is rebuilt.
+  bool facesChanged = false;
+  // The key of each uploaded vertex and a copy of the vertex buffer, kept by
+  // dynamic Geometry to encode changed vertices in place.
+  std::vector<WeldKey> dynamicKeys;
+  std::vector<uint8_t> dynamicVertices;
+  MemoryTracker vertexMemory;
+  MemoryTracker indexMemory;
+  MemoryTracker faceMemory;
+  // Built from the triangles when first intersected.
+  BoundingVolumeHierarchy triangleIndex;
+  bool triangleIndexDirty = true;
 
-  State() = default;
+  State()
+      : vertexMemory(MemoryType::VertexBuffer)
+      , indexMemory(MemoryType::IndexBuffer)
+      , faceMemory(MemoryType::GeometryFaces)
+  {}
   ~State() = default;
+  void AddFace(const int* aVertices, const int* aUVs, const int* aNormals, const size_t aCount, const size_t aStride);
+  void ReserveFaces(const size_t aFaceCount, const size_t aTriangleCount);
+  size_t FaceCount() const { return faceOffsets.size(); }
+  uint32_t FaceEnd(const size_t aFace) const {
+    return (aFace + 1) < faceOffsets.size() ? faceOffsets[aFace + 1] : (uint32_t)cornerVertices.size();
+  }
+  void UpdateFaceMemory();
+  void UpdatePartRanges();
+  void ResolveNormals();
+  static void GenerateNormals(const std::vector<State*>& aMembers, const NormalWeighting aWeighting,
+                              const JobSystemPtr& aJobs);
+  bool Stripify(std::vector<GLuint>& aIndices);
+  void ExtendBounds(Bounds& aBounds) const;
+  // Queues the buffers owned by the Geometry for deletion, the shared
+  // vertex buffer goes with the SharedVertices.
+  void ReleaseBuffers() {
+    if (!glDeletions || !renderBuffer) {
+      return;
+    }
+    if (!shared) {
+      glDeletions->DeleteBuffer(renderBuffer->GetVertexObject());
+    }
+    glDeletions->DeleteBuffer(renderBuffer->GetIndexObject());
+  }
+  void EncodeVertex(const RenderBuffer& aLayout, const WeldKey& aKey, const bool aUV, const bool aColor,
+                    const bool aSkin, uint8_t* aVertex) const;
+  void Weld(const RenderBuffer& aLayout,
+            std::unordered_map<WeldKey, GLuint, WeldKeyHash>& aWelded,
+            std::vector<uint8_t>& aVertices,
+            std::vector<GLuint>& aIndices,
+            std::vector<WeldKey>* aKeys = nullptr);
+  bool UpdateDirtyVertices();
+  void ReleaseSource();
+  bool RestoreBuffers();
+  bool GetTriangle(const size_t aTriangle, Vector& aA, Vector& aB, Vector& aC) const;
+  void BuildTriangleIndex();
+  bool IsFaceDrawn(const size_t aFace) const;
+  size_t FaceOfTriangle(const size_t aTriangle) const {
+    return (size_t)(std::upper_bound(faceOffsets.begin(), faceOffsets.end(), (uint32_t)(aTriangle * 3)) - faceOffsets.begin()) - 1;
+  }
+  typedef std::vector<std::pair<uint32_t, uint32_t>> IndexRanges;
+  void NumberCorners(std::vector<WeldKey>& aKeys, std::vector<uint32_t>& aIndices, std::vector<float>& aPositions) const;
+  bool GetPartIndexRanges(IndexRanges& aPartRanges, IndexRanges& aRanges) const;
+  void SetTriangles(const std::vector<WeldKey>& aKeys, const std::vector<uint32_t>& aIndices, const IndexRanges& aPartRanges);
 };
 
+struct Geometry::SharedVertices {
+  Mutex lock;
+  std::vector<Geometry::State*> members;
+  VertexArrayPtr vertexArray;
+  DataCachePtr dataCache;
+  GLDeletionQueuePtr glDeletions;
+  // Set once every member releases its source.
+  bool releaseSource = false;
+  RetainedBuffer retainedVertices;
+  bool built = false;
+  GLuint vertexObject = 0;
+  BufferStorage vertexStorage = BufferStorage::Unallocated;
+  GLuint vertexCount = 0;
+  // Members whose index buffer has not been uploaded yet.
+  size_t pending = 0;
+  MemoryTracker vertexMemory;
+
+  SharedVertices() : vertexMemory(MemoryType::VertexBuffer) {}
+  ~SharedVertices() {
+    Forget(dataCache, retainedVertices);
+    if (glDeletions) {
+      glDeletions->DeleteBuffer(vertexObject);
+    }
+  }
+  bool Build(const RenderBuffer& aLayout, const GLExtensionsPtr& aExtensions);
+  void Remove(Geometry::State* aMember);
+};
+
+bool
+Geometry::State::GetTriangle(const size_t aTriangle, Vector& aA, Vector& aB, Vector& aC) const {
+  const GLuint* corners = cornerVertices.data() + (aTriangle * 3);
+  const GLuint kVertexCount = (GLuint)vertexArray->GetVertexCount();
+  if ((corners[0] == 0) || (corners[0] > kVertexCount) || (corners[1] == 0) || (corners[1] > kVertexCount) ||
+      (corners[2] == 0) || (corners[2] > kVertexCount)) {
+    return false;
+  }
+  aA = vertexArray->GetVertex(corners[0] - 1);
+  aB = vertexArray->GetVertex(corners[1] - 1);
+  aC = vertexArray->GetVertex(corners[2] - 1);
+  return true;
+}
+
+void
+Geometry::State::BuildTriangleIndex() {
+  VRB_TRACE_ZONE("Geometry::BuildTriangleIndex");
+  std::vector<Bounds> bounds(cornerVertices.size() / 3);
+  Vector a, b, c;
+  for (size_t ix = 0; ix < bounds.size(); ix++) {
+    // Triangles with invalid corners keep empty bounds and are never hit.
+    if (GetTriangle(ix, a, b, c)) {
+      bounds[ix].Extend(a).Extend(b).Extend(c);
+    }
+  }
+  triangleIndex.Build(bounds);
+  triangleIndexDirty = false;
+}
+
+// Mirrors UpdatePartRanges: with some parts disabled only the enabled parts
+// are drawn.
+bool
+Geometry::State::IsFaceDrawn(const size_t aFace) const {
+  if (ranges.empty()) {
+    return !partsHidden;
+  }
+  for (const Part& part: parts) {
+    if (part.enabled && (aFace >= (size_t)part.firstFace) && (aFace < (size_t)(part.firstFace + part.faceCount))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Numbers the unique corners the same way Weld does. aPositions receives the
+// position of each unique corner.
+void
+Geometry::State::NumberCorners(std::vector<WeldKey>& aKeys, std::vector<uint32_t>& aIndices, std::vector<float>& aPositions) const {
+  std::unordered_map<WeldKey, GLuint, WeldKeyHash> welded;
+  welded.reserve(vertexCount);
+  aIndices.clear();
+  aIndices.reserve(cornerVertices.size());
+  for (size_t corner = 0; corner < cornerVertices.size(); corner++) {
+    const WeldKey kKey{cornerVertices[corner], cornerNormals[corner], cornerUVs[corner]};
+    auto result = welded.emplace(kKey, (GLuint)aKeys.size());
+    if (result.second) {
+      aKeys.push_back(kKey);
+    }
+    aIndices.push_back(result.first->second);
+  }
+  aPositions.assign(aKeys.size() * 3, 0.0f);
+  const GLuint kVertexCount = vertexArray ? (GLuint)vertexArray->GetVertexCount() : 0;
+  for (size_t ix = 0; ix < aKeys.size(); ix++) {
+    if ((aKeys[ix].vertex > 0) && (aKeys[ix].vertex <= kVertexCount)) {
+      memcpy(&aPositions[ix * 3], vertexArray->GetVertex(aKeys[ix].vertex - 1).Data(), sizeof(float) * 3);
+    }
+  }
+}
+
+// aPartRanges receives the corner range of each part and aRanges the sorted
+// ranges to process separately, the whole Geometry when there are no parts.
+// Returns false if parts overlap.
+bool
+Geometry::State::GetPartIndexRanges(IndexRanges& aPartRanges, IndexRanges& aRanges) const {
+  for (const Part& part: parts) {
+    const size_t kFirst = std::min((size_t)part.firstFace, FaceCount());
+    const size_t kLast = std::min((size_t)part.firstFace + (size_t)part.faceCount, FaceCount());
+    const uint32_t kStart = kFirst < FaceCount() ? faceOffsets[kFirst] : (uint32_t)cornerVertices.size();
+    aPartRanges.emplace_back(kStart, kLast > kFirst ? FaceEnd(kLast - 1) : kStart);
+  }
+  aRanges = aPartRanges;
+  std::sort(aRanges.begin(), aRanges.end());
+  for (size_t ix = 1; ix < aRanges.size(); ix++) {
+    if (aRanges[ix].first < aRanges[ix - 1].second) {
+      return false;
+    }
+  }
+  if (parts.empty()) {
+    aRanges.emplace_back(0, (uint32_t)cornerVertices.size());
+  }
+  return true;
+}
+
+// Replaces the faces with the triangles of aIndices, numbered by
+// NumberCorners. Every triangle becomes a face so the parts keep addressing
+// their own, found at aPartRanges.
+void
+Geometry::State::SetTriangles(const std::vector<WeldKey>& aKeys, const std::vector<uint32_t>& aIndices, const IndexRanges& aPartRanges) {
+  facesChanged = true;
+  cornerVertices.resize(aIndices.size());
+  cornerNormals.resize(aIndices.size());
+  cornerUVs.resize(aIndices.size());
+  for (size_t corner = 0; corner < aIndices.size(); corner++) {
+    const WeldKey& kKey = aKeys[aIndices[corner]];
+    cornerVertices[corner] = kKey.vertex;
+    cornerNormals[corner] = kKey.normal;
+    cornerUVs[corner] = kKey.uv;
+  }
+  faceOffsets.resize(aIndices.size() / 3);
+  faceGroups.clear();
+  for (size_t ix = 0; ix < faceOffsets.size(); ix++) {
+    faceOffsets[ix] = (uint32_t)(ix * 3);
+  }
+  for (size_t ix = 0; (ix < parts.size()) && (ix < aPartRanges.size()); ix++) {
+    parts[ix].firstFace = (int32_t)(aPartRanges[ix].first / 3);
+    parts[ix].faceCount = (int32_t)((aPartRanges[ix].second - aPartRanges[ix].first) / 3);
+  }
+  UpdateFaceMemory();
+}
+
+// Welds every member into one vertex stream and uploads it. Called with the
+// lock held by the first member to be initialized.
+bool
+Geometry::SharedVertices::Build(const RenderBuffer& aLayout, const GLExtensionsPtr& aExtensions) {
+  std::vector<uint8_t> vertices;
+  std::unique_ptr<uint8_t[]> scratch;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  if (vertexArray) {
+    std::unordered_map<WeldKey, GLuint, WeldKeyHash> welded;
+    releaseSource = !members.empty();
+    for (Geometry::State* member: members) {
+      member->sharedIndices.clear();
+      member->Weld(aLayout, welded, vertices, member->sharedIndices);
+      releaseSource = releaseSource && member->releaseSource;
+    }
+    vertexCount = (GLuint)(vertices.size() / (size_t)aLayout.VertexSize());
+    if (releaseSource && (retainedVertices.size == 0)) {
+      Retain(dataCache, vertices, retainedVertices);
+    }
+    data = vertices.data();
+    size = vertices.size();
+  } else {
+    data = Restore(dataCache, retainedVertices, scratch);
+    size = retainedVertices.size;
+  }
+  if (!data) {
+    VRB_ERROR("Unable to restore shared Geometry vertices");
+    return false;
+  }
+  if (!vertexObject) {
+    VRB_GL_CHECK(glGenBuffers(1, &vertexObject));
+    vertexStorage = BufferStorage::Unallocated;
+  }
+  const GLsizeiptr kVertexBytes = size;
+  UploadStaticBuffer(aExtensions, GL_ARRAY_BUFFER, vertexObject, vertexStorage, kVertexBytes, data);
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  VRB_GL_STATS_ADD(BufferUploadBytes, kVertexBytes);
+  vertexMemory.Set((size_t)kVertexBytes);
+  pending = members.size();
+  built = true;
+  VRB_DEBUG("Shared vertex buffer of %u vertices for %d geometries", vertexCount, (int32_t)members.size());
+  return true;
+}
+
+void
+Geometry::SharedVertices::Remove(Geometry::State* aMember) {
+  auto it = std::find(members.begin(), members.end(), aMember);
+  if (it != members.end()) {
+    members.erase(it);
+  }
+}
+
+void
+Geometry::State::ExtendBounds(Bounds& aBounds) const {
+  if (!vertexArray) {
+    return;
+  }
+  const GLuint kVertexCount = (GLuint)vertexArray->GetVertexCount();
+  const Vector4* padded = vertexArray->GetPaddedVertices();
+  if (padded) {
+    const float kMax = std::numeric_limits<float>::max();
+    Vector min(kMax, kMax, kMax);
+    Vector max(-kMax, -kMax, -kMax);
+    vrb::ExtendBounds(padded, kVertexCount, cornerVertices.data(), cornerVertices.size(), 1, min, max);
+    if (min.x() <= max.x()) {
+      aBounds.Extend(Bounds(min, max));
+    }
+    return;
+  }
+  for (GLuint index: cornerVertices) {
+    if ((index > 0) && (index <= kVertexCount)) {
+      aBounds.Extend(vertexArray->GetVertex(index - 1));
+    }
+  }
+}
+
+void
+Geometry::State::EncodeVertex(const RenderBuffer& aLayout, const WeldKey& aKey, const bool aUV, const bool aColor,
+                              const bool aSkin, uint8_t* aVertex) const {
+  EncodeAttribute(aVertex + aLayout.PositionOffset(), vertexArray->GetVertex(aKey.vertex).Data(),
+                  aLayout.PositionLength(), aLayout.PositionType());
+  EncodeAttribute(aVertex + aLayout.NormalOffset(), vertexArray->GetNormal(aKey.normal).Data(),
+                  aLayout.NormalLength(), aLayout.NormalType());
+  if (aUV) {
+    EncodeAttribute(aVertex + aLayout.UVOffset(), vertexArray->GetUV(aKey.uv).Data(),
+                    aLayout.UVLength(), aLayout.UVType());
+  }
+  if (aColor) {
+    EncodeAttribute(aVertex + aLayout.ColorOffset(), vertexArray->GetColor(aKey.vertex).Data(),
+                    aLayout.ColorLength(), aLayout.ColorType());
+  }
+  if (aSkin) {
+    EncodeJoints(aVertex + aLayout.JointOffset(), vertexArray->GetJoints(aKey.vertex),
+                 aLayout.JointLength(), aLayout.JointType());
+    EncodeAttribute(aVertex + aLayout.WeightOffset(), vertexArray->GetWeights(aKey.vertex),
+                    aLayout.WeightLength(), aLayout.WeightType());
+  }
+}
+
+// Appends the triangles of every face to aIndices. Corners that reference the
+// same vertex, normal and uv (color follows the vertex) are welded into a
+// single entry of aVertices, which is encoded using aLayout. aKeys, when set,
+// receives the key of each new entry.
+void
+Geometry::State::Weld(const RenderBuffer& aLayout,
+                      std::unordered_map<WeldKey, GLuint, WeldKeyHash>& aWelded,
+                      std::vector<uint8_t>& aVertices,
+                      std::vector<GLuint>& aIndices,
+                      std::vector<WeldKey>* aKeys) {
+  ResolveNormals();
+  const bool kHasTextureCoords = vertexArray->GetUVCount() > 0;
+  const bool kHasColor = vertexArray->GetColorCount() > 0;
+  const bool kHasSkin = aLayout.JointLength() > 0;
+  const size_t kVertexSize = (size_t)aLayout.VertexSize();
+  const uint32_t kFirstIndex = (uint32_t)aIndices.size();
+  GLuint count = (GLuint)(aVertices.size() / kVertexSize);
+  aVertices.reserve(aVertices.size() + (kVertexSize * vertexCount));
+  aIndices.reserve(aIndices.size() + cornerVertices.size());
+  aWelded.reserve(aWelded.size() + vertexCount);
+
+  for (size_t corner = 0; corner < cornerVertices.size(); corner++) {
+    const GLuint vertexIndex = cornerVertices[corner] - 1;
+    const GLuint normalIndex = cornerNormals[corner] - 1;
+    const GLuint uvIndex = (kHasTextureCoords && (cornerUVs[corner] > 0)) ? cornerUVs[corner] - 1 : 0;
+    const WeldKey kKey{vertexIndex, normalIndex, uvIndex};
+    auto result = aWelded.emplace(kKey, count);
+    if (!result.second) {
+      aIndices.push_back(result.first->second);
+      continue;
+    }
+    aVertices.resize(aVertices.size() + kVertexSize);
+    EncodeVertex(aLayout, kKey, kHasTextureCoords, kHasColor, kHasSkin, aVertices.data() + (kVertexSize * count));
+    if (aKeys) {
+      aKeys->push_back(kKey);
+    }
+    aIndices.push_back(count);
+    count++;
+  }
+
+  // Corners map one to one to indices so parts are located by face offset.
+  if (!parts.empty()) {
+    for (Part& part: parts) {
+      const size_t kFirst = std::min((size_t)part.firstFace, FaceCount());
+      const size_t kLast = std::min((size_t)part.firstFace + (size_t)part.faceCount, FaceCount());
+      const uint32_t kStart = kFirst < FaceCount() ? faceOffsets[kFirst] : (uint32_t)cornerVertices.size();
+      const uint32_t kEnd = kLast > kFirst ? FaceEnd(kLast - 1) : kStart;
+      part.indexStart = kFirstIndex + kStart;
+      part.indexLength = kEnd - kStart;
+    }
+    UpdatePartRanges();
+  }
+}
+
+// Replaces the triangles of aIndices by strips, built separately for each
+// part so that parts stay contiguous, and moves the parts along. Returns
+// false, leaving everything as is, when the strips are not shorter.
+bool
+Geometry::State::Stripify(std::vector<GLuint>& aIndices) {
+  std::vector<uint32_t> boundaries = {0, (uint32_t)aIndices.size()};
+  for (const Part& part: parts) {
+    boundaries.push_back(part.indexStart);
+    boundaries.push_back(part.indexStart + part.indexLength);
+  }
+  std::sort(boundaries.begin(), boundaries.end());
+  boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+  GLuint vertexCount = 0;
+  for (const GLuint index: aIndices) {
+    vertexCount = std::max(vertexCount, index + 1);
+  }
+  std::vector<uint32_t> strips;
+  strips.reserve(aIndices.size());
+  std::vector<uint32_t> moved = {0};
+  for (size_t ix = 1; ix < boundaries.size(); ix++) {
+    StripifyTriangles(aIndices.data() + boundaries[ix - 1], boundaries[ix] - boundaries[ix - 1], vertexCount,
+                      0xFFFFFFFF, strips);
+    moved.push_back((uint32_t)strips.size());
+  }
+  if (strips.size() >= aIndices.size()) {
+    return false;
+  }
+  auto move = [&](const uint32_t aIndex) -> uint32_t {
+    return moved[std::lower_bound(boundaries.begin(), boundaries.end(), aIndex) - boundaries.begin()];
+  };
+  for (Part& part: parts) {
+    const uint32_t kStart = move(part.indexStart);
+    part.indexLength = move(part.indexStart + part.indexLength) - kStart;
+    part.indexStart = kStart;
+  }
+  if (!parts.empty()) {
+    UpdatePartRanges();
+  }
+  aIndices.swap(strips);
+  return true;
+}
+
+// Drops the faces and VertexArray once they live in GL buffers and in the
+// retained copies. The bounds are kept for culling.
+void
+Geometry::State::ReleaseSource() {
+  sourceBounds = Bounds::Empty();
+  ExtendBounds(sourceBounds);
+  std::vector<GLuint>().swap(cornerVertices);
+  std::vector<GLuint>().swap(cornerUVs);
+  std::vector<GLuint>().swap(cornerNormals);
+  std::vector<int32_t>().swap(faceGroups);
+  std::vector<uint32_t>().swap(faceOffsets);
+  std::vector<GLuint>().swap(sharedIndices);
+  vertexArray = nullptr;
+  sourceReleased = true;
+  // Retained copies that could not be cached stay in memory.
+  faceMemory.Set((retainedVertices.data ? retainedVertices.size : 0) +
+                 (retainedIndices.data ? retainedIndices.size : 0));
+}
+
+// Uploads the retained copies of the buffers after the GL context was lost.
+bool
+Geometry::State::RestoreBuffers() {
+  GLuint vertexObjectId = renderBuffer->GetVertexObject();
+  GLuint indexObjectId = renderBuffer->GetIndexObject();
+  std::unique_ptr<uint8_t[]> scratch;
+  if (shared) {
+    MutexAutoLock lock(shared->lock);
+    if (!shared->built && !shared->Build(*renderBuffer, glExtensions)) {
+      return false;
+    }
+    vertexObjectId = shared->vertexObject;
+  } else {
+    const uint8_t* vertices = Restore(dataCache, retainedVertices, scratch);
+    if (!vertices) {
+      VRB_ERROR("Unable to restore Geometry vertices");
+      return false;
+    }
+    if (UploadStaticBuffer(glExtensions, GL_ARRAY_BUFFER, vertexObjectId, vertexStorage,
+                           (GLsizeiptr)retainedVertices.size, vertices)) {
+      InvalidateVertexArray();
+    }
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    VRB_GL_STATS_ADD(BufferUploadBytes, retainedVertices.size);
+    vertexMemory.Set(retainedVertices.size);
+  }
+  const uint8_t* indices = Restore(dataCache, retainedIndices, scratch);
+  if (!indices) {
+    VRB_ERROR("Unable to restore Geometry indices");
+    return false;
+  }
+  if (UploadStaticBuffer(glExtensions, GL_ELEMENT_ARRAY_BUFFER, indexObjectId, indexStorage,
+                         (GLsizeiptr)retainedIndices.size, indices)) {
+    InvalidateVertexArray();
+  }
+  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  VRB_GL_STATS_ADD(BufferUploadBytes, retainedIndices.size);
+  indexMemory.Set(retainedIndices.size);
+  renderBuffer->SetIndexType(retainedIndexType);
+  renderBuffer->SetVertexObject(vertexObjectId, (GLsizei)retainedVertexCount);
+  renderBuffer->SetIndexObject(indexObjectId, retainedIndexCount);
+  return true;
+}
+
+// Replaces the drawn ranges with the runs of enabled parts. Every part being
+// enabled draws the whole buffer in one call.
+void
+Geometry::State::UpdatePartRanges() {
+  ranges.clear();
+  partsHidden = false;
+  if (parts.empty()) {
+    return;
+  }
+  std::vector<const Part*> enabled;
+  for (const Part& part: parts) {
+    if (part.enabled) {
+      enabled.push_back(&part);
+    }
+  }
+  if (enabled.size() == parts.size()) {
+    return;
+  }
+  if (enabled.empty()) {
+    partsHidden = true;
+    return;
+  }
+  std::sort(enabled.begin(), enabled.end(), [](const Part* aLeft, const Part* aRight) {
+    return aLeft->indexStart < aRight->indexStart;
+  });
+  for (const Part* part: enabled) {
+    if (part->indexLength == 0) {
+      continue;
+    }
+    if (!ranges.empty() && ((ranges[ranges.size() - 2] + ranges.back()) == part->indexStart)) {
+      ranges.back() += part->indexLength;
+    } else {
+      ranges.push_back(part->indexStart);
+      ranges.push_back(part->indexLength);
+    }
+  }
+  partsHidden = ranges.empty();
+}
+
+// aUVs and aNormals may be null. Consecutive corners are aStride ints apart.
+// The polygon is triangulated as a fan from its first corner.
+void
+Geometry::State::AddFace(const int* aVertices, const int* aUVs, const int* aNormals, const size_t aCount, const size_t aStride) {
+  if (!faceGroups.empty() || (smoothingGroup != kNoSmoothingGroup)) {
+    faceGroups.resize(faceOffsets.size(), kNoSmoothingGroup);
+    faceGroups.push_back(smoothingGroup);
+  }
+  faceOffsets.push_back((uint32_t)cornerVertices.size());
+  facesChanged = true;
+  if (aCount < 3) {
+    VRB_ERROR("Face with only %d vertices", (int)aCount);
+    return;
+  }
+  vertexCount += aCount;
+  // Missing normals are left at zero for GenerateNormals.
+  const bool kHasNormals = aNormals && (aNormals[0] != 0);
+  normalsPending = normalsPending || !kHasNormals;
+  auto appendCorner = [&](const size_t aCorner) {
+    const size_t kOffset = aCorner * aStride;
+    cornerVertices.push_back((GLuint)aVertices[kOffset]);
+    cornerUVs.push_back(aUVs ? (GLuint)aUVs[kOffset] : 0);
+    cornerNormals.push_back(kHasNormals ? (GLuint)aNormals[kOffset] : 0);
+  };
+  for (size_t ix = 1; (ix + 1) < aCount; ix++) {
+    appendCorner(0);
+    appendCorner(ix);
+    appendCorner(ix + 1);
+  }
+}
+
+void
+Geometry::State::ResolveNormals() {
+  if (normalsPending && vertexArray) {
+    GenerateNormals({this}, NormalWeighting::Face, nullptr);
+  }
+}
+
+// Faces are walked as polygons, corner k of a face being the first corner
+// of its fan for k = 0, and the second and third corners of triangles 0 and
+// k - 2 otherwise. Each polygon corner contributes the weighted face normal
+// to its vertex. With smoothing groups the corners of a vertex are split by
+// group, each run getting one normal. Normals are numbered in vertex order
+// so the result does not depend on how the work was split.
+void
+Geometry::State::GenerateNormals(const std::vector<State*>& aMembers, const NormalWeighting aWeighting,
+                                 const JobSystemPtr& aJobs) {
+  VRB_TRACE_ZONE("Geometry::GenerateNormals");
+  // The clock is read for the VRB_DEBUG timer at the end only.
+  const double kStartTime = (VRB_LOG_LEVEL <= VRB_LOG_LEVEL_DEBUG) ? GetMonotonicSeconds() : 0.0;
+  VertexArrayPtr array = aMembers.front()->vertexArray;
+  const uint32_t kVertexCount = (uint32_t)array->GetVertexCount();
+  const uint32_t kInvalid = std::numeric_limits<uint32_t>::max();
+  struct PendingFace {
+    // Triangulated corners of the face.
+    const GLuint* vertices;
+    GLuint* normals;
+    uint32_t triangleCorners;
+    // Index of the first polygon corner across all faces.
+    uint32_t firstEntry;
+    // Faces without smoothing each get a group of their own.
+    int64_t group;
+    uint32_t CornerCount() const { return (triangleCorners / 3) + 2; }
+  };
+  std::vector<PendingFace> faces;
+  size_t faceCount = 0;
+  for (State* member: aMembers) {
+    faceCount += member->FaceCount();
+  }
+  faces.reserve(faceCount);
+  uint32_t entryCount = 0;
+  int64_t flatGroup = 0;
+  bool singleGroup = true;
+  for (State* member: aMembers) {
+    for (size_t face = 0; face < member->FaceCount(); face++) {
+      const uint32_t kStart = member->faceOffsets[face];
+      const uint32_t kEnd = member->FaceEnd(face);
+      if ((kEnd <= kStart) || (member->cornerNormals[kStart] != 0)) {
+        continue;
+      }
+      const int32_t kGroup = face < member->faceGroups.size() ? member->faceGroups[face] : kNoSmoothingGroup;
+      faces.push_back({member->cornerVertices.data() + kStart, member->cornerNormals.data() + kStart, kEnd - kStart,
+                       entryCount, kGroup > 0 ? kGroup : (kGroup == 0 ? --flatGroup : 0)});
+      singleGroup = singleGroup && (faces.back().group == faces.front().group);
+      entryCount += faces.back().CornerCount();
+    }
+    member->normalsPending = false;
+  }
+  const bool kSingleGroup = singleGroup;
+  auto polygonVertex = [kVertexCount, kInvalid](const PendingFace& aFace, const uint32_t aCorner) -> uint32_t {
+    const GLuint kVertex = aFace.vertices[aCorner < 2 ? aCorner : (((aCorner - 2) * 3) + 2)];
+    return ((kVertex > 0) && (kVertex <= kVertexCount)) ? kVertex - 1 : kInvalid;
+  };
+
+  // The weighted normal of each face and, with angle weighting, the weight
+  // of each polygon corner.
+  std::vector<Vector> faceNormals(faces.size());
+  std::vector<float> entryWeights(aWeighting == NormalWeighting::Angle ? entryCount : 0);
+  // Vertices are packed Vectors, see VertexArray::GetVertexData.
+  const Vector* positions = reinterpret_cast<const Vector*>(array->GetVertexData());
+  const Vector kOrigin(0.0f, 0.0f, 0.0f);
+  RunChunks(aJobs, faces.size(), [&](const size_t aBegin, const size_t aEnd) {
+    std::vector<const Vector*> points;
+    for (size_t ix = aBegin; ix < aEnd; ix++) {
+      const PendingFace& kFace = faces[ix];
+      const uint32_t kCount = kFace.CornerCount();
+      points.resize(kCount);
+      for (uint32_t corner = 0; corner < kCount; corner++) {
+        const uint32_t kVertex = polygonVertex(kFace, corner);
+        points[corner] = kVertex != kInvalid ? positions + kVertex : &kOrigin;
+      }
+      Vector areaNormal(0.0f, 0.0f, 0.0f);
+      for (uint32_t corner = 2; corner < kCount; corner++) {
+        areaNormal += (*points[corner - 1] - *points[0]).Cross(*points[corner] - *points[0]);
+      }
+      const float kDoubleArea = areaNormal.Magnitude();
+      const Vector kNormal = kDoubleArea > FLT_EPSILON ? areaNormal / kDoubleArea : kOrigin;
+      faceNormals[ix] = aWeighting == NormalWeighting::Area ? areaNormal * 0.5f : kNormal;
+      if (aWeighting != NormalWeighting::Angle) {
+        continue;
+      }
+      for (uint32_t corner = 0; corner < kCount; corner++) {
+        const Vector& kPoint = *points[corner];
+        const Vector kPrevious = (*points[corner > 0 ? corner - 1 : kCount - 1] - kPoint).Normalize();
+        const Vector kNext = (*points[(corner + 1) < kCount ? corner + 1 : 0] - kPoint).Normalize();
+        entryWeights[kFace.firstEntry + corner] = acosf(Clamp(kPrevious.Dot(kNext), -1.0f, 1.0f));
+      }
+    }
+  });
+  auto contribution = [&](const size_t aFace, const uint32_t aCorner) -> Vector {
+    return entryWeights.empty() ? faceNormals[aFace] : faceNormals[aFace] * entryWeights[faces[aFace].firstEntry + aCorner];
+  };
+
+  // Normal indices are one based.
+  const uint32_t kFirstNormal = (uint32_t)array->GetNormalCount() + 1;
+  std::vector<float> normals;
+  // Normal of each vertex with a single group, of each polygon corner
+  // otherwise.
+  std::vector<uint32_t> vertexIndices;
+  std::vector<uint32_t> entryIndices;
+  if (kSingleGroup) {
+    // Every vertex gets one normal, summed in place.
+    std::vector<Vector> sums(kVertexCount, kOrigin);
+    vertexIndices.resize(kVertexCount, 0);
+    for (size_t ix = 0; ix < faces.size(); ix++) {
+      const uint32_t kCount = faces[ix].CornerCount();
+      for (uint32_t corner = 0; corner < kCount; corner++) {
+        const uint32_t kVertex = polygonVertex(faces[ix], corner);
+        if (kVertex != kInvalid) {
+          sums[kVertex] += contribution(ix, corner);
+          vertexIndices[kVertex] = 1;
+        }
+      }
+    }
+    uint32_t normalCount = 0;
+    for (uint32_t& index: vertexIndices) {
+      index = index ? kFirstNormal + normalCount++ : 0;
+    }
+    normals.resize((size_t)normalCount * 3);
+    RunChunks(aJobs, kVertexCount, [&](const size_t aBegin, const size_t aEnd) {
+      for (size_t vertex = aBegin; vertex < aEnd; vertex++) {
+        if (vertexIndices[vertex]) {
+          memcpy(normals.data() + ((size_t)(vertexIndices[vertex] - kFirstNormal) * 3), sums[vertex].Normalize().Data(),
+                 sizeof(float) * 3);
+        }
+      }
+    });
+  } else {
+    // Polygon corners sorted by vertex, then by group.
+    std::vector<uint32_t> entryFaces(entryCount);
+    std::vector<uint32_t> rowOffsets(kVertexCount + 1, 0);
+    for (size_t ix = 0; ix < faces.size(); ix++) {
+      const uint32_t kCount = faces[ix].CornerCount();
+      for (uint32_t corner = 0; corner < kCount; corner++) {
+        entryFaces[faces[ix].firstEntry + corner] = (uint32_t)ix;
+        const uint32_t kVertex = polygonVertex(faces[ix], corner);
+        if (kVertex != kInvalid) {
+          rowOffsets[kVertex + 1]++;
+        }
+      }
+    }
+    for (uint32_t ix = 0; ix < kVertexCount; ix++) {
+      rowOffsets[ix + 1] += rowOffsets[ix];
+    }
+    std::vector<uint32_t> rows(rowOffsets[kVertexCount]);
+    {
+      std::vector<uint32_t> cursor(rowOffsets.begin(), rowOffsets.end() - 1);
+      for (const PendingFace& kFace: faces) {
+        const uint32_t kCount = kFace.CornerCount();
+        for (uint32_t corner = 0; corner < kCount; corner++) {
+          const uint32_t kVertex = polygonVertex(kFace, corner);
+          if (kVertex != kInvalid) {
+            rows[cursor[kVertex]++] = kFace.firstEntry + corner;
+          }
+        }
+      }
+    }
+    auto entryGroup = [&](const uint32_t aEntry) -> int64_t {
+      return faces[entryFaces[aEntry]].group;
+    };
+    std::vector<uint32_t> runOffsets(kVertexCount + 1, 0);
+    RunChunks(aJobs, kVertexCount, [&](const size_t aBegin, const size_t aEnd) {
+      for (size_t vertex = aBegin; vertex < aEnd; vertex++) {
+        uint32_t* first = rows.data() + rowOffsets[vertex];
+        uint32_t* last = rows.data() + rowOffsets[vertex + 1];
+        std::sort(first, last, [&entryGroup](const uint32_t aLeft, const uint32_t aRight) {
+          return entryGroup(aLeft) != entryGroup(aRight) ? entryGroup(aLeft) < entryGroup(aRight) : aLeft < aRight;
+        });
+        uint32_t runs = 0;
+        for (uint32_t* entry = first; entry != last; entry++) {
+          if ((entry == first) || (entryGroup(*entry) != entryGroup(*(entry - 1)))) {
+            runs++;
+          }
+        }
+        runOffsets[vertex + 1] = runs;
+      }
+    });
+    for (uint32_t ix = 0; ix < kVertexCount; ix++) {
+      runOffsets[ix + 1] += runOffsets[ix];
+    }
+    normals.resize((size_t)runOffsets[kVertexCount] * 3);
+    entryIndices.resize(entryCount, 0);
+    RunChunks(aJobs, kVertexCount, [&](const size_t aBegin, const size_t aEnd) {
+      for (size_t vertex = aBegin; vertex < aEnd; vertex++) {
+        uint32_t run = runOffsets[vertex];
+        const uint32_t kRowEnd = rowOffsets[vertex + 1];
+        for (uint32_t entry = rowOffsets[vertex]; entry < kRowEnd; run++) {
+          const int64_t kGroup = entryGroup(rows[entry]);
+          Vector sum = kOrigin;
+          for (; (entry < kRowEnd) && (entryGroup(rows[entry]) == kGroup); entry++) {
+            const uint32_t kFace = entryFaces[rows[entry]];
+            sum += contribution(kFace, rows[entry] - faces[kFace].firstEntry);
+            entryIndices[rows[entry]] = kFirstNormal + run;
+          }
+          memcpy(normals.data() + ((size_t)run * 3), sum.Normalize().Data(), sizeof(float) * 3);
+        }
+      }
+    });
+  }
+
+  RunChunks(aJobs, faces.size(), [&](const size_t aBegin, const size_t aEnd) {
+    for (size_t ix = aBegin; ix < aEnd; ix++) {
+      const PendingFace& kFace = faces[ix];
+      for (uint32_t corner = 0; corner < kFace.triangleCorners; corner++) {
+        if (kSingleGroup) {
+          const GLuint kVertex = kFace.vertices[corner];
+          kFace.normals[corner] = ((kVertex > 0) && (kVertex <= kVertexCount)) ? vertexIndices[kVertex - 1] : 0;
+        } else {
+          const uint32_t kTriangle = corner / 3;
+          const uint32_t kPolygonCorner = (corner % 3) == 0 ? 0 : kTriangle + (corner % 3);
+          kFace.normals[corner] = entryIndices[kFace.firstEntry + kPolygonCorner];
+        }
+      }
+    }
+  });
+  array->AppendNormals(normals.data(), normals.size() / 3, 3);
+  VRB_DEBUG("TIMER Geometry normals for %d faces of %d geometries: %f sec",
+            (int32_t)faces.size(), (int32_t)aMembers.size(), GetMonotonicSeconds() - kStartTime);
+}
+
+void
+Geometry::State::ReserveFaces(const size_t aFaceCount, const size_t aTriangleCount) {
+  faceOffsets.reserve(faceOffsets.size() + aFaceCount);
+  cornerVertices.reserve(cornerVertices.size() + (aTriangleCount * 3));
+  cornerUVs.reserve(cornerUVs.size() + (aTriangleCount * 3));
+  cornerNormals.reserve(cornerNormals.size() + (aTriangleCount * 3));
+}
+
+void
+Geometry::State::UpdateFaceMemory() {
+  faceMemory.Set(((cornerVertices.capacity() + cornerUVs.capacity() + cornerNormals.capacity()) * sizeof(GLuint)) +
+                 (faceOffsets.capacity() * sizeof(uint32_t)) + (faceGroups.capacity() * sizeof(int32_t)));
+}
+
+// Encodes again the uploaded vertices that use VertexArray entries changed
+// since the last upload and uploads the span they cover. A span over half
+// of the buffer respecifies the whole store so the driver may orphan it
+// instead of waiting on draws still reading it. Returns true when vertices
+// changed.
+bool
+Geometry::State::UpdateDirtyVertices() {
+  int first[3] = {0, 0, 0};
+  int end[3] = {0, 0, 0};
+  // Colors and skins follow the vertex index.
+  bool dirty[3] = {false, false, false};
+  dirty[0] = vertexArray->GetDirtyRange(VertexArray::Attribute::Vertex, first[0], end[0]);
+  for (VertexArray::Attribute attribute: {VertexArray::Attribute::Color, VertexArray::Attribute::Skin}) {
+    int attributeFirst = 0;
+    int attributeEnd = 0;
+    if (vertexArray->GetDirtyRange(attribute, attributeFirst, attributeEnd)) {
+      first[0] = dirty[0] ? std::min(first[0], attributeFirst) : attributeFirst;
+      end[0] = dirty[0] ? std::max(end[0], attributeEnd) : attributeEnd;
+      dirty[0] = true;
+    }
+  }
+  dirty[1] = vertexArray->GetDirtyRange(VertexArray::Attribute::Normal, first[1], end[1]);
+  dirty[2] = (renderBuffer->UVLength() > 0) && vertexArray->GetDirtyRange(VertexArray::Attribute::UV, first[2], end[2]);
+  vertexArray->ClearDirty();
+  const RenderBuffer& kLayout = *renderBuffer;
+  const size_t kVertexSize = (size_t)kLayout.VertexSize();
+  if (dynamicVertices.size() != dynamicKeys.size() * kVertexSize) {
+    return false;
+  }
+  auto isDirty = [&](const size_t aAttribute, const GLuint aIndex) {
+    return dirty[aAttribute] && (aIndex >= (GLuint)first[aAttribute]) && (aIndex < (GLuint)end[aAttribute]);
+  };
+  size_t low = dynamicKeys.size();
+  size_t high = 0;
+  for (size_t ix = 0; ix < dynamicKeys.size(); ix++) {
+    const WeldKey& kKey = dynamicKeys[ix];
+    if (isDirty(0, kKey.vertex) || isDirty(1, kKey.normal) || isDirty(2, kKey.uv)) {
+      EncodeVertex(kLayout, kKey, kLayout.UVLength() > 0, kLayout.ColorLength() > 0, kLayout.JointLength() > 0,
+                   dynamicVertices.data() + (ix * kVertexSize));
+      low = std::min(low, ix);
+      high = ix + 1;
+    }
+  }
+  if (low >= high) {
+    return false;
+  }
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, renderBuffer->GetVertexObject()));
+  if (((high - low) * 2) > dynamicKeys.size()) {
+    VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)dynamicVertices.size(), dynamicVertices.data(), GL_DYNAMIC_DRAW));
+    VRB_GL_STATS_ADD(BufferUploadBytes, dynamicVertices.size());
+  } else {
+    const size_t kOffset = low * kVertexSize;
+    const size_t kBytes = (high - low) * kVertexSize;
+    VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)kOffset, (GLsizeiptr)kBytes, dynamicVertices.data() + kOffset));
+    VRB_GL_STATS_ADD(BufferUploadBytes, kBytes);
+  }
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  triangleIndexDirty = true;
+  return true;
+}
+
 GeometryPtr
 Geometry::Create(CreationContextPtr& aContext) {
-  return std::make_shared<ConcreteClass<Geometry, Geometry::State> >(aContext);
+  return std::allocate_shared<ConcreteClass<Geometry, Geometry::State> >(PoolAllocator<Geometry>(), aContext);
+}
+
+// Node interface
+void
+Geometry::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  if (m.partsHidden) {
+    return;
+  }
+  if (!m.initializedGL) {
+    if (aVisitor.IsVisible(GetBounds())) {
+      m.initializePriority = true;
+    }
+    return;
+  }
+  GeometryDrawable::Cull(aVisitor, aDrawables);
+}
+
+bool
+Geometry::Intersect(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit) {
+  if (m.sourceReleased) {
+    // The triangles are gone, so is the need for their index.
+    m.triangleIndex.Clear();
+    return false;
+  }
+  if (m.partsHidden || !m.vertexArray) {
+    return false;
+  }
+  float distance = 0.0f;
+  if (!GetBounds().IntersectsRay(aOrigin, aDirection, distance) || (distance > aHit.distance)) {
+    return false;
+  }
+  if (m.triangleIndexDirty) {
+    m.BuildTriangleIndex();
+  }
+  int32_t triangle = -1;
+  float u = 0.0f;
+  float v = 0.0f;
+  m.triangleIndex.RayQuery(aOrigin, aDirection, aHit.distance, [&](const uint32_t aTriangle, const float, float& aMaxDistance) {
+    // Moller-Trumbore, both sides of the triangle are hit.
+    Vector a, b, c;
+    if (!m.GetTriangle(aTriangle, a, b, c)) {
+      return;
+    }
+    const Vector kEdge1 = b - a;
+    const Vector kEdge2 = c - a;
+    const Vector kP = aDirection.Cross(kEdge2);
+    const float kDeterminant = kEdge1.Dot(kP);
+    if (fabsf(kDeterminant) <= std::numeric_limits<float>::min()) {
+      return;
+    }
+    const float kInverse = 1.0f / kDeterminant;
+    const Vector kT = aOrigin - a;
+    const float kU = kT.Dot(kP) * kInverse;
+    // Rays through shared edges and corners hit one of their triangles.
+    const float kEpsilon = 1.0e-4f;
+    if ((kU < -kEpsilon) || (kU > (1.0f + kEpsilon))) {
+      return;
+    }
+    const Vector kQ = kT.Cross(kEdge1);
+    const float kV = aDirection.Dot(kQ) * kInverse;
+    if ((kV < -kEpsilon) || ((kU + kV) > (1.0f + kEpsilon))) {
+      return;
+    }
+    const float kDistance = kEdge2.Dot(kQ) * kInverse;
+    if ((kDistance < 0.0f) || (kDistance >= aMaxDistance)) {
+      return;
+    }
+    if (!m.ranges.empty() && !m.IsFaceDrawn(m.FaceOfTriangle(aTriangle))) {
+      return;
+    }
+    aMaxDistance = kDistance;
+    triangle = (int32_t)aTriangle;
+    u = kU;
+    v = kV;
+  });
+  if (triangle < 0) {
+    return false;
+  }
+  aHit.node = nullptr;
+  aHit.triangle = triangle;
+  aHit.face = (int32_t)m.FaceOfTriangle((size_t)triangle);
+  aHit.u = u;
+  aHit.v = v;
+  return true;
 }
 
 // Geometry interface
@@ -66,179 +1268,510 @@ Geometry::GetVertexArray() const {
 void
 Geometry::SetVertexArray(const VertexArrayPtr& aVertexArray) {
   m.vertexArray = aVertexArray;
+  InvalidateBounds();
+}
+
+void
+Geometry::SetVertexFormat(const uint32_t aFormat) {
+  m.vertexFormat = aFormat;
+}
+
+uint32_t
+Geometry::GetVertexFormat() const {
+  return m.vertexFormat;
 }
 
 void
 Geometry::UpdateBuffers() {
+  VRB_TRACE_ZONE("Geometry::UpdateBuffers");
+  LoadReportTimer timer(LoadReport::Phase::GeometryUpload);
   GLuint vertexObjectId = m.renderBuffer->GetVertexObject();
   GLuint indexObjectId = m.renderBuffer->GetIndexObject();
-  if (vertexObjectId == 0 || indexObjectId == 0) {
+  if ((!m.shared && (vertexObjectId == 0)) || indexObjectId == 0) {
     VRB_WARN("Geometry GL objects not created");
     return;
   }
+  if (m.sourceReleased) {
+    m.RestoreBuffers();
+    return;
+  }
+  // The VertexArray may have been modified since the bounds were last computed.
+  InvalidateBounds();
 
-  const bool kHasTextureCoords = m.vertexArray->GetUVCount() > 0;
-  const bool kHasColor = m.vertexArray->GetColorCount() > 0;
-  const GLsizei kPositionSize = m.renderBuffer->PositionSize();
-  const GLsizei kNormalSize = m.renderBuffer->NormalSize();
-  const GLsizei kUVSize = m.renderBuffer->UVSize();
-  const GLsizei kColorSize = m.renderBuffer->ColorSize();
+  // Only read by the VRB_DEBUG timer below.
+  const double kStartTime = (VRB_LOG_LEVEL <= VRB_LOG_LEVEL_DEBUG) ? GetMonotonicSeconds() : 0.0;
+  const RenderBuffer& kLayout = *m.renderBuffer;
 
-  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vertexObjectId));
+  // Build the interleaved vertex stream on the CPU so that it may be uploaded
+  // with a single call instead of one call per attribute per corner.
+  std::vector<uint8_t> vertices;
+  std::vector<GLuint> indices;
+  GLuint count = 0;
+  if (m.shared) {
+    MutexAutoLock lock(m.shared->lock);
+    if (!m.shared->built && !m.shared->Build(kLayout, m.glExtensions)) {
+      return;
+    }
+    indices.swap(m.sharedIndices);
+    vertexObjectId = m.shared->vertexObject;
+    count = m.shared->vertexCount;
+  } else {
+    std::unordered_map<WeldKey, GLuint, WeldKeyHash> welded;
+    m.dynamicKeys.clear();
+    m.Weld(kLayout, welded, vertices, indices, m.dynamic ? &m.dynamicKeys : nullptr);
+    count = (GLuint)(vertices.size() / (size_t)kLayout.VertexSize());
+  }
 
-  std::vector<GLushort> indices;
-  GLushort count = 0;
-  GLintptr offset = 0;
+  const bool kStrips = m.strips && m.glExtensions &&
+      m.glExtensions->IsExtensionSupported(GLExtensions::Ext::ARB_ES3_compatibility) &&
+      m.Stripify(indices);
+  m.renderBuffer->SetPrimitiveType(kStrips ? GL_TRIANGLE_STRIP : GL_TRIANGLES);
 
-  for (auto& face: m.faces) {
-    if (face.vertices.empty()) {
-      break;
+  // Use the narrowest index type able to address every unique vertex. The
+  // largest value of the type is the restart index of strips.
+  const GLuint kRestartReserve = kStrips ? 1 : 0;
+  const bool kSupportsIndexUInt = m.glExtensions &&
+      m.glExtensions->IsExtensionSupported(GLExtensions::Ext::OES_element_index_uint);
+  std::vector<uint8_t> packedIndices;
+  GLenum indexType = GL_UNSIGNED_SHORT;
+  if (count <= ((GLuint)std::numeric_limits<GLubyte>::max() + 1 - kRestartReserve)) {
+    indexType = GL_UNSIGNED_BYTE;
+    PackIndices<GLubyte>(indices, packedIndices);
+  } else if ((count <= ((GLuint)std::numeric_limits<GLushort>::max() + 1 - kRestartReserve)) || !kSupportsIndexUInt) {
+    if (count > ((GLuint)std::numeric_limits<GLushort>::max() + 1 - kRestartReserve)) {
+      VRB_ERROR("Unique vertex count %u requires 32-bit indices which are not supported", count);
     }
-    if (face.vertices.size() < 3) {
-      std::string message;
-      for (auto index: face.vertices) { message += " "; message += std::to_string(index); }
-      VRB_ERROR("Face with only %d vertices:%s", (int32_t)face.vertices.size(), message.c_str());
-      continue;
+    PackIndices<GLushort>(indices, packedIndices);
+  } else {
+    indexType = GL_UNSIGNED_INT;
+    PackIndices<GLuint>(indices, packedIndices);
+  }
+
+  const GLsizeiptr kVertexBytes = vertices.size();
+  const GLsizeiptr kIndexBytes = packedIndices.size();
+  bool replaced = false;
+  if (m.dynamic) {
+    // Respecifying the store lets the driver orphan the one still in use.
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vertexObjectId));
+    VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, kVertexBytes, vertices.data(), GL_DYNAMIC_DRAW));
+    m.vertexStorage = BufferStorage::Mutable;
+  } else if (!m.shared) {
+    replaced = UploadStaticBuffer(m.glExtensions, GL_ARRAY_BUFFER, vertexObjectId, m.vertexStorage,
+                                  kVertexBytes, vertices.data());
+  }
+  if (UploadStaticBuffer(m.glExtensions, GL_ELEMENT_ARRAY_BUFFER, indexObjectId, m.indexStorage,
+                         kIndexBytes, packedIndices.data())) {
+    replaced = true;
+  }
+  if (replaced) {
+    m.InvalidateVertexArray();
+  }
+  VRB_GL_STATS_ADD(BufferUploadBytes, kVertexBytes + kIndexBytes);
+  LoadReportCollectorPtr report = LoadReportCollector::GetCurrent();
+  if (report) {
+    report->AddValue(LoadReport::Counter::VertexBytes, m.shared ? 0 : (uint64_t)kVertexBytes);
+    report->AddValue(LoadReport::Counter::IndexBytes, (uint64_t)kIndexBytes);
+  }
+  m.vertexMemory.Set((size_t)kVertexBytes);
+  m.indexMemory.Set((size_t)kIndexBytes);
+  m.renderBuffer->SetIndexType(indexType);
+  m.renderBuffer->SetVertexObject(vertexObjectId, (GLsizei)count);
+  m.renderBuffer->SetIndexObject(indexObjectId, (GLsizei)indices.size());
+
+  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  VRB_DEBUG("TIMER Geometry upload of %d unique vertices from %d corners (%d vertex bytes, %d index bytes): %f sec",
+            (int32_t)count, (int32_t)indices.size(), (int32_t)kVertexBytes, (int32_t)kIndexBytes, GetMonotonicSeconds() - kStartTime);
+
+  m.facesChanged = false;
+  if (m.dynamic) {
+    m.vertexArray->ClearDirty();
+    m.dynamicVertices.swap(vertices);
+    return;
+  }
+  bool release = m.releaseSource;
+  if (m.shared) {
+    MutexAutoLock lock(m.shared->lock);
+    if (m.shared->pending > 0) {
+      m.shared->pending--;
     }
-    const auto vertexIndex = (GLushort)(face.vertices[0] - 1);
-    const auto normalIndex = (GLushort)(face.normals[0] - 1);
-    const auto uvIndex = (GLushort)(kHasTextureCoords ? face.uvs[0] - 1 : -1);
-    const Vector& firstVertex = m.vertexArray->GetVertex(vertexIndex);
-    const Vector& firstNormal = m.vertexArray->GetNormal(normalIndex);
-    const Vector& firstUV = m.vertexArray->GetUV(uvIndex);
-    const Color& firstColor = m.vertexArray->GetColor(vertexIndex);
-    for (int ix = 1; ix <= face.vertices.size() - 2; ix++) {
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kPositionSize, firstVertex.Data()));
-      offset += kPositionSize;
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kNormalSize, firstNormal.Data()));
-      offset += kNormalSize;
-      if (kHasTextureCoords) {
-        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kUVSize, firstUV.Data()));
-        offset += kUVSize;
-      }
-      if (kHasColor) {
-        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kColorSize, firstColor.Data()));
-        offset += kColorSize;
-      }
-      indices.push_back(count);
-      count++;
-
-      const Vector v1 = m.vertexArray->GetVertex(face.vertices[ix] - 1);
-      const Vector n1 = m.vertexArray->GetNormal(face.normals[ix] - 1);
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kPositionSize, v1.Data()));
-      offset += kPositionSize;
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kNormalSize, n1.Data()));
-      offset += kNormalSize;
-      if (kHasTextureCoords) {
-        const Vector uv1 = m.vertexArray->GetUV(face.uvs[ix] - 1);
-        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kUVSize, uv1.Data()));
-        offset += kUVSize;
-      }
-      if (kHasColor) {
-        const Color& color1 = m.vertexArray->GetColor(face.vertices[ix] - 1);
-        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kColorSize, color1.Data()));
-        offset += kColorSize;
-      }
-      indices.push_back(count);
-      count++;
-
-      const Vector v2 = m.vertexArray->GetVertex(face.vertices[ix + 1] - 1);
-      const Vector n2 = m.vertexArray->GetNormal(face.normals[ix + 1] - 1);
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kPositionSize, v2.Data()));
-      offset += kPositionSize;
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kNormalSize, n2.Data()));
-      offset += kNormalSize;
-      if (kHasTextureCoords) {
-        const Vector uv2 = m.vertexArray->GetUV(face.uvs[ix + 1] - 1);
-        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kUVSize, uv2.Data()));
-        offset += kUVSize;
-      }
-      if (kHasColor) {
-        const Color& color2 = m.vertexArray->GetColor(face.vertices[ix + 1] - 1);
-        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kColorSize, color2.Data()));
-        offset += kColorSize;
-      }
-      indices.push_back(count);
-      count++;
+    // Members all release their source or none do, since restoring the shared
+    // vertex buffer needs either the VertexArray or the retained copy.
+    release = m.shared->releaseSource;
+    if ((m.shared->pending == 0) && release) {
+      m.shared->vertexArray = nullptr;
+    }
+  }
+  if (release) {
+    if (!m.shared) {
+      Retain(m.dataCache, vertices, m.retainedVertices);
     }
+    Retain(m.dataCache, packedIndices, m.retainedIndices);
+    m.retainedIndexType = indexType;
+    m.retainedIndexCount = (GLsizei)indices.size();
+    m.retainedVertexCount = count;
+    m.ReleaseSource();
   }
+}
 
-  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexObjectId));
-  VRB_GL_CHECK(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLushort) * indices.size(), indices.data()));
 
+void
+Geometry::SetTriangleStrips(const bool aStrips) {
+  m.strips = aStrips;
+}
 
-  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+void
+Geometry::SetDynamic(const bool aDynamic) {
+  if (aDynamic == m.dynamic) {
+    return;
+  }
+  if (aDynamic && m.shared) {
+    VRB_ERROR("Geometry '%s' shares its vertex buffer and can not be dynamic", GetName().c_str());
+    return;
+  }
+  m.dynamic = aDynamic;
+  if (!aDynamic) {
+    m.Unlink();
+    std::vector<WeldKey>().swap(m.dynamicKeys);
+    std::vector<uint8_t>().swap(m.dynamicVertices);
+    return;
+  }
+  // Only dynamic Geometry is visited on every update.
+  CreationContextPtr context = m.context.lock();
+  if (context) {
+    context->AddUpdatable(this);
+  }
 }
 
+bool
+Geometry::IsDynamic() const {
+  return m.dynamic;
+}
+
+void
+Geometry::SetSmoothingGroup(const int32_t aGroup) {
+  m.smoothingGroup = aGroup;
+}
 
 void
 Geometry::AddFace(
     const std::vector<int>& aVertices,
     const std::vector<int>& aUVs,
     const std::vector<int>& aNormals) {
+  m.AddFace(aVertices.data(), aUVs.empty() ? nullptr : aUVs.data(), aNormals.empty() ? nullptr : aNormals.data(), aVertices.size(), 1);
+  m.UpdateFaceMemory();
+  InvalidateBounds();
+}
 
-  Face face;
-  m.vertexCount += aVertices.size();
-  m.triangleCount += aVertices.size() - 2;
-  CopyIndices(face.vertices, aVertices);
-  if (face.vertices.size() < 3) {
-    std::string indices;
-    for (auto ix: face.vertices) {
-      indices += " ";
-      indices += std::to_string(ix);
-    }
-    indices += " from:";
-    for (auto ix: aVertices) {
-      indices += " ";
-      indices += std::to_string(ix);
-    }
-    VRB_ERROR("Face with only %d vertices:%s", (int)face.vertices.size(), indices.c_str());
-  }
-  if (!aUVs.empty()) {
-    CopyIndices(face.uvs, aUVs);
-  }
-
-  if (!aNormals.empty() && (aNormals[0] != 0)) {
-    CopyIndices(face.normals, aNormals);
-  } else if (m.vertexArray) {
-    m.vertexArray->SetNormalCount(m.vertexArray->GetVertexCount());
-    const Vector point = m.vertexArray->GetVertex(aVertices[0] - 1);
-    const Vector normal = ((m.vertexArray->GetVertex(aVertices[1] - 1) - point).Cross(m.vertexArray->GetVertex(aVertices[2] - 1) - point)).Normalize();
-    m.vertexArray->AppendNormal(normal);
-    for (GLuint index: face.vertices) {
-      if (index <= 0) {
-        VRB_ERROR("Vertices index is less than zero.");
-      }
-      if (normal.Magnitude() > FLT_EPSILON) {
-        m.vertexArray->AddNormal(index - 1, normal);
-      }
-      face.normals.push_back(index);
-    }
+void
+Geometry::AddFaces(const int* aIndices, const uint32_t* aCornerCounts, const size_t aFaceCount) {
+  size_t triangles = 0;
+  for (size_t ix = 0; ix < aFaceCount; ix++) {
+    triangles += aCornerCounts[ix] > 2 ? aCornerCounts[ix] - 2 : 0;
+  }
+  m.ReserveFaces(aFaceCount, triangles);
+  const int* indices = aIndices;
+  for (size_t ix = 0; ix < aFaceCount; ix++) {
+    m.AddFace(indices, indices + 1, indices + 2, aCornerCounts[ix], 3);
+    indices += aCornerCounts[ix] * 3;
   }
+  m.UpdateFaceMemory();
+  InvalidateBounds();
+}
 
-  m.faces.push_back(std::move(face));
+void
+Geometry::AppendFaces(const Geometry& aSource) {
+  const State& source = aSource.m;
+  const uint32_t kBase = (uint32_t)m.cornerVertices.size();
+  m.ReserveFaces(source.FaceCount(), source.cornerVertices.size() / 3);
+  const size_t kBaseFace = m.FaceCount();
+  for (uint32_t offset: source.faceOffsets) {
+    m.faceOffsets.push_back(kBase + offset);
+  }
+  if (!m.faceGroups.empty() || !source.faceGroups.empty()) {
+    m.faceGroups.resize(kBaseFace, kNoSmoothingGroup);
+    m.faceGroups.insert(m.faceGroups.end(), source.faceGroups.begin(), source.faceGroups.end());
+    m.faceGroups.resize(m.FaceCount(), kNoSmoothingGroup);
+  }
+  m.normalsPending = m.normalsPending || source.normalsPending;
+  m.cornerVertices.insert(m.cornerVertices.end(), source.cornerVertices.begin(), source.cornerVertices.end());
+  m.cornerUVs.insert(m.cornerUVs.end(), source.cornerUVs.begin(), source.cornerUVs.end());
+  m.cornerNormals.insert(m.cornerNormals.end(), source.cornerNormals.begin(), source.cornerNormals.end());
+  m.facesChanged = true;
+  m.vertexCount += source.vertexCount;
+  m.UpdateFaceMemory();
+  InvalidateBounds();
 }
 
 int32_t
 Geometry::GetFaceCount() const {
-  return m.faces.size();
+  return (int32_t)m.FaceCount();
 }
 
-const Geometry::Face&
+Geometry::Face
 Geometry::GetFace(int32_t aIndex) const {
-  return m.faces[aIndex];
+  const uint32_t kStart = m.faceOffsets[aIndex];
+  Face result;
+  result.vertices = m.cornerVertices.data() + kStart;
+  result.uvs = m.cornerUVs.data() + kStart;
+  result.normals = m.cornerNormals.data() + kStart;
+  result.cornerCount = m.FaceEnd(aIndex) - kStart;
+  return result;
+}
+
+int32_t
+Geometry::AddPart(const std::string& aName, const int32_t aFirstFace, const int32_t aFaceCount) {
+  State::Part part;
+  part.name = aName;
+  part.firstFace = std::max(aFirstFace, 0);
+  part.faceCount = std::max(aFaceCount, 0);
+  m.parts.push_back(std::move(part));
+  return (int32_t)m.parts.size() - 1;
+}
+
+int32_t
+Geometry::GetPartCount() const {
+  return (int32_t)m.parts.size();
+}
+
+const std::string&
+Geometry::GetPartName(const int32_t aIndex) const {
+  return m.parts.at(aIndex).name;
+}
+
+int32_t
+Geometry::FindPart(const std::string& aName) const {
+  for (size_t ix = 0; ix < m.parts.size(); ix++) {
+    if (m.parts[ix].name == aName) {
+      return (int32_t)ix;
+    }
+  }
+  return -1;
+}
+
+void
+Geometry::SetPartEnabled(const int32_t aIndex, const bool aEnabled) {
+  if ((aIndex < 0) || (aIndex >= (int32_t)m.parts.size())) {
+    VRB_WARN("Invalid Geometry part index: %d", aIndex);
+    return;
+  }
+  if (m.parts[aIndex].enabled == aEnabled) {
+    return;
+  }
+  m.parts[aIndex].enabled = aEnabled;
+  m.UpdatePartRanges();
+}
+
+void
+Geometry::OptimizeMesh() {
+  VRB_TRACE_ZONE("Geometry::OptimizeMesh");
+  if (!m.vertexArray || m.cornerVertices.empty() || m.initializedGL) {
+    return;
+  }
+  // The triangles replacing the faces no longer know their smoothing group.
+  m.ResolveNormals();
+  const double kStartTime = GetMonotonicSeconds();
+  std::vector<WeldKey> keys;
+  std::vector<uint32_t> indices;
+  std::vector<float> positions;
+  m.NumberCorners(keys, indices, positions);
+  // Parts are optimized separately so that they remain contiguous.
+  State::IndexRanges partRanges;
+  State::IndexRanges ranges;
+  if (!m.GetPartIndexRanges(partRanges, ranges)) {
+    VRB_WARN("Unable to optimize Geometry '%s' with overlapping parts", GetName().c_str());
+    return;
+  }
+
+  const float kBefore = ComputeACMR(indices.data(), indices.size(), keys.size());
+  for (const std::pair<uint32_t, uint32_t>& range: ranges) {
+    uint32_t* start = indices.data() + range.first;
+    const size_t kCount = range.second - range.first;
+    std::vector<uint32_t> clusters;
+    OptimizeVertexCache(start, kCount, keys.size(), &clusters);
+    OptimizeOverdraw(start, kCount, positions.data(), clusters);
+  }
+  const float kAfter = ComputeACMR(indices.data(), indices.size(), keys.size());
+
+  m.SetTriangles(keys, indices, partRanges);
+  VRB_LOG("Optimized Geometry '%s' with %d triangles, ACMR %.3f -> %.3f: %f sec",
+          GetName().c_str(), (int32_t)(indices.size() / 3), kBefore, kAfter, GetMonotonicSeconds() - kStartTime);
+}
+
+GeometryPtr
+Geometry::CreateSimplified(CreationContextPtr& aContext, const float aRatio, const float aMaxError) const {
+  VRB_TRACE_ZONE("Geometry::CreateSimplified");
+  if (!m.vertexArray || m.cornerVertices.empty()) {
+    return nullptr;
+  }
+  const double kStartTime = GetMonotonicSeconds();
+  std::vector<WeldKey> keys;
+  std::vector<uint32_t> indices;
+  std::vector<float> positions;
+  m.NumberCorners(keys, indices, positions);
+  State::IndexRanges partRanges;
+  State::IndexRanges ranges;
+  if (!m.GetPartIndexRanges(partRanges, ranges)) {
+    VRB_WARN("Unable to simplify Geometry '%s' with overlapping parts", GetName().c_str());
+    return nullptr;
+  }
+  // Faces outside of any part are simplified on their own as well.
+  std::vector<uint32_t> boundaries{0, (uint32_t)indices.size()};
+  for (const std::pair<uint32_t, uint32_t>& range: ranges) {
+    boundaries.push_back(range.first);
+    boundaries.push_back(range.second);
+  }
+  std::sort(boundaries.begin(), boundaries.end());
+  boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+  const float kRatio = std::max(0.0f, std::min(aRatio, 1.0f));
+  std::vector<uint32_t> simplified;
+  std::vector<uint32_t> result;
+  std::unordered_map<uint32_t, uint32_t> moved{{0, 0}};
+  simplified.reserve(indices.size());
+  for (size_t ix = 1; ix < boundaries.size(); ix++) {
+    const size_t kCount = boundaries[ix] - boundaries[ix - 1];
+    const size_t kTarget = ((size_t)((float)kCount * kRatio) / 3) * 3;
+    SimplifyMesh(indices.data() + boundaries[ix - 1], kCount, positions.data(), keys.size(), kTarget, aMaxError, result);
+    simplified.insert(simplified.end(), result.begin(), result.end());
+    moved[boundaries[ix]] = (uint32_t)simplified.size();
+  }
+  for (std::pair<uint32_t, uint32_t>& range: partRanges) {
+    range.first = moved[range.first];
+    range.second = moved[range.second];
+  }
+
+  GeometryPtr geometry = Geometry::Create(aContext);
+  geometry->SetName(GetName());
+  geometry->SetVertexArray(m.vertexArray);
+  geometry->SetRenderState(m.renderState);
+  geometry->m.vertexFormat = m.vertexFormat;
+  geometry->m.vertexCount = (GLsizei)simplified.size();
+  geometry->m.parts = m.parts;
+  geometry->m.releaseSource = m.releaseSource;
+  geometry->m.SetTriangles(keys, simplified, partRanges);
+  VRB_LOG("Simplified Geometry '%s' from %d to %d triangles: %f sec", GetName().c_str(),
+          (int32_t)(indices.size() / 3), (int32_t)(simplified.size() / 3), GetMonotonicSeconds() - kStartTime);
+  return geometry;
+}
+
+void
+Geometry::SetReleaseSourceData(const bool aRelease) {
+  m.releaseSource = aRelease;
+}
+
+bool
+Geometry::IsPartEnabled(const int32_t aIndex) const {
+  if ((aIndex < 0) || (aIndex >= (int32_t)m.parts.size())) {
+    return false;
+  }
+  return m.parts[aIndex].enabled;
+}
+
+void
+Geometry::SetBufferData(const std::shared_ptr<const void>& aOwner,
+                        const uint8_t* aVertices, const size_t aVertexBytes, const GLsizei aVertexCount,
+                        const uint8_t* aIndices, const size_t aIndexBytes, const GLenum aIndexType,
+                        const GLsizei aIndexCount, const Bounds& aBounds) {
+  if (m.shared) {
+    VRB_ERROR("Geometry '%s' shares its vertex buffer and can not take buffer data", GetName().c_str());
+    return;
+  }
+  Forget(m.dataCache, m.retainedVertices);
+  Forget(m.dataCache, m.retainedIndices);
+  m.retainedVertices.owner = aOwner;
+  m.retainedVertices.view = aVertices;
+  m.retainedVertices.size = aVertexBytes;
+  m.retainedIndices.owner = aOwner;
+  m.retainedIndices.view = aIndices;
+  m.retainedIndices.size = aIndexBytes;
+  m.retainedVertexCount = (GLuint)aVertexCount;
+  m.retainedIndexType = aIndexType;
+  m.retainedIndexCount = aIndexCount;
+  m.ReleaseSource();
+  m.sourceBounds = aBounds;
+  InvalidateBounds();
+}
+
+void
+Geometry::GenerateNormals(const std::vector<GeometryPtr>& aGeometries, const NormalWeighting aWeighting,
+                          const JobSystemPtr& aJobs) {
+  // Members grouped by VertexArray, in the order first seen.
+  std::vector<std::vector<State*>> arrays;
+  for (const GeometryPtr& geometry: aGeometries) {
+    State& state = geometry->m;
+    if (!state.normalsPending || !state.vertexArray) {
+      continue;
+    }
+    auto found = std::find_if(arrays.begin(), arrays.end(), [&state](const std::vector<State*>& aMembers) {
+      return aMembers.front()->vertexArray == state.vertexArray;
+    });
+    if (found == arrays.end()) {
+      arrays.emplace_back();
+      found = arrays.end() - 1;
+    }
+    found->push_back(&state);
+  }
+  for (const std::vector<State*>& members: arrays) {
+    State::GenerateNormals(members, aWeighting, aJobs);
+  }
+}
+
+void
+Geometry::ShareVertexBuffer(const std::vector<GeometryPtr>& aGeometries) {
+  std::shared_ptr<SharedVertices> shared = std::make_shared<SharedVertices>();
+  for (const GeometryPtr& geometry: aGeometries) {
+    State& state = geometry->m;
+    if (state.faceOffsets.empty() || state.shared || state.initializedGL || state.dynamic) {
+      continue;
+    }
+    if (!shared->vertexArray) {
+      shared->vertexArray = state.vertexArray;
+      shared->dataCache = state.dataCache;
+      shared->glDeletions = state.glDeletions;
+    } else if (shared->vertexArray != state.vertexArray) {
+      VRB_WARN("Geometry '%s' does not use the shared VertexArray", geometry->GetName().c_str());
+      continue;
+    }
+    state.shared = shared;
+    shared->members.push_back(&state);
+  }
 }
 
 Geometry::Geometry(State& aState, CreationContextPtr& aContext) :
     GeometryDrawable(aState, aContext),
     ResourceGL(aState, aContext),
+    Updatable(aState),
     m(aState)
 {
+  m.context = aContext;
   m.renderBuffer = RenderBuffer::Create(aContext);
+  m.glExtensions = aContext->GetGLExtensions();
+  m.dataCache = aContext->GetDataCache();
+  m.glDeletions = aContext->GetGLDeletionQueue();
 }
 
-Geometry::~Geometry() {}
+Geometry::~Geometry() {
+  m.ReleaseBuffers();
+  if (m.shared) {
+    MutexAutoLock lock(m.shared->lock);
+    m.shared->Remove(&m);
+  }
+  Forget(m.dataCache, m.retainedVertices);
+  Forget(m.dataCache, m.retainedIndices);
+}
+
+// Node interface
+void
+Geometry::ComputeBounds(Bounds& aBounds) const {
+  // Faces or vertices changed.
+  m.triangleIndexDirty = true;
+  if (m.sourceReleased) {
+    aBounds.Extend(m.sourceBounds);
+    return;
+  }
+  m.ExtendBounds(aBounds);
+}
 
 // ResourceGL interface
 bool
@@ -248,44 +1781,131 @@ Geometry::SupportOffRenderThreadInitialization() {
 
 void
 Geometry::InitializeGL() {
+  if (m.sourceReleased) {
+    // The RenderBuffer still holds the vertex layout.
+    GLuint vertexObjectId = 0;
+    GLuint indexObjectId = 0;
+    if (!m.shared) {
+      VRB_GL_CHECK(glGenBuffers(1, &vertexObjectId));
+    }
+    VRB_GL_CHECK(glGenBuffers(1, &indexObjectId));
+    m.renderBuffer->SetVertexObject(vertexObjectId, 0);
+    m.renderBuffer->SetIndexObject(indexObjectId, 0);
+    m.vertexStorage = BufferStorage::Unallocated;
+    m.indexStorage = BufferStorage::Unallocated;
+    m.RestoreBuffers();
+    return;
+  }
   if (!m.vertexArray) {
     VRB_ERROR("Unable to initialize Geometry Node. No VertexArray set");
+    return;
   }
 
   size_t definedOffset = 0;
-  m.renderBuffer->DefinePosition(definedOffset);
+  if (m.vertexFormat & VertexFormatHalfPosition) {
+    m.renderBuffer->DefinePosition(definedOffset, 3, GL_HALF_FLOAT, false);
+  } else {
+    m.renderBuffer->DefinePosition(definedOffset);
+  }
   definedOffset = m.renderBuffer->PositionOffset() + m.renderBuffer->PositionSize();
-  m.renderBuffer->DefineNormal(definedOffset);
+  if (m.vertexFormat & VertexFormatPackedNormal) {
+    m.renderBuffer->DefineNormal(definedOffset, 4, GL_INT_2_10_10_10_REV, true);
+  } else {
+    m.renderBuffer->DefineNormal(definedOffset);
+  }
   definedOffset = m.renderBuffer->NormalOffset() + m.renderBuffer->NormalSize();
-  if (m.vertexArray->GetUVCount() > 0) {
-    m.renderBuffer->DefineUV(definedOffset, m.vertexArray->GetUVLength());
+  const int kUVCount = m.vertexArray->GetUVCount();
+  if (kUVCount > 0) {
+    const int kUVLength = m.vertexArray->GetUVLength();
+    bool normalizeUV = (m.vertexFormat & VertexFormatNormalizedUV) != 0;
+    // Normalized UVs can only represent coordinates in the [0, 1] range.
+    for (int ix = 0; normalizeUV && (ix < kUVCount); ix++) {
+      const Vector& uv = m.vertexArray->GetUV(ix);
+      for (int jx = 0; jx < kUVLength; jx++) {
+        if ((uv.Data()[jx] < 0.0f) || (uv.Data()[jx] > 1.0f)) {
+          VRB_DEBUG("UV coordinates out of range, using float UVs");
+          normalizeUV = false;
+          break;
+        }
+      }
+    }
+    if (normalizeUV) {
+      m.renderBuffer->DefineUV(definedOffset, kUVLength, GL_UNSIGNED_SHORT, true);
+    } else {
+      m.renderBuffer->DefineUV(definedOffset, kUVLength);
+    }
     definedOffset = m.renderBuffer->UVOffset() + m.renderBuffer->UVSize();
   }
   if (m.vertexArray->GetColorCount() > 0) {
-    m.renderBuffer->DefineColor(definedOffset);
+    if (m.vertexFormat & VertexFormatByteColor) {
+      m.renderBuffer->DefineColor(definedOffset, 4, GL_UNSIGNED_BYTE, true);
+    } else {
+      m.renderBuffer->DefineColor(definedOffset);
+    }
+    definedOffset = m.renderBuffer->ColorOffset() + m.renderBuffer->ColorSize();
+  }
+  if (m.vertexArray->GetSkinCount() > 0) {
+    m.renderBuffer->DefineJoint(definedOffset);
+    definedOffset = m.renderBuffer->JointOffset() + m.renderBuffer->JointSize();
+    if (m.vertexFormat & VertexFormatByteWeight) {
+      m.renderBuffer->DefineWeight(definedOffset, 4, GL_UNSIGNED_BYTE, true);
+    } else {
+      m.renderBuffer->DefineWeight(definedOffset);
+    }
   }
   GLuint vertexObjectId = 0;
   GLuint indexObjectId = 0;
-  VRB_GL_CHECK(glGenBuffers(1, &vertexObjectId));
-  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vertexObjectId));
-  GLsizei kTriangleSize = m.renderBuffer->VertexSize() * 3;
-
-  VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, kTriangleSize * m.triangleCount, nullptr, GL_STATIC_DRAW));
-  VRB_LOG("Allocate: %d for GL_ARRAY_BUFFER: %d", kTriangleSize * m.triangleCount, vertexObjectId);
-
+  // Shared vertices are uploaded into a buffer owned by SharedVertices.
+  if (!m.shared) {
+    VRB_GL_CHECK(glGenBuffers(1, &vertexObjectId));
+  }
   VRB_GL_CHECK(glGenBuffers(1, &indexObjectId));
-  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexObjectId));
-  VRB_GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * m.triangleCount * 3, nullptr, GL_STATIC_DRAW));
-  VRB_LOG("Allocate: %d for GL_ELEMENT_ARRAY_BUFFER: %d", (int32_t)sizeof(GLushort) * m.triangleCount * 3, indexObjectId);
-  m.renderBuffer->SetVertexObject(vertexObjectId, m.vertexCount);
-  m.renderBuffer->SetIndexObject(indexObjectId, m.triangleCount * 3);
+  m.renderBuffer->SetVertexObject(vertexObjectId, 0);
+  m.renderBuffer->SetIndexObject(indexObjectId, 0);
+  m.vertexStorage = BufferStorage::Unallocated;
+  m.indexStorage = BufferStorage::Unallocated;
 
+  // Buffer storage is allocated by UpdateBuffers once the number of unique
+  // vertices is known.
   UpdateBuffers();
 }
 
 void
-Geometry::ShutdownGL() {
+Geometry::UpdateResource(RenderContext& aContext) {
+  if (!m.dynamic || !m.initializedGL || m.sourceReleased || !m.vertexArray) {
+    return;
+  }
+  if (m.facesChanged) {
+    UpdateBuffers();
+    return;
+  }
+  if (m.vertexArray->IsDirty() && m.UpdateDirtyVertices()) {
+    InvalidateBounds();
+  }
+}
 
+void
+Geometry::ShutdownGL() {
+  // Vertex array objects are not shared between contexts and are
+  // recreated on the next draw.
+  m.vertexArrayObject = 0;
+  m.InvalidateVertexArray();
+  // The buffers are deleted with the other names released by the shutdown,
+  // InitializeGL() creates new ones.
+  m.ReleaseBuffers();
+  m.renderBuffer->SetVertexObject(0, m.renderBuffer->VertexCount());
+  m.renderBuffer->SetIndexObject(0, m.renderBuffer->IndexCount());
+  m.vertexMemory.Set(0);
+  m.indexMemory.Set(0);
+  if (m.shared) {
+    MutexAutoLock lock(m.shared->lock);
+    m.shared->built = false;
+    if (m.glDeletions) {
+      m.glDeletions->DeleteBuffer(m.shared->vertexObject);
+    }
+    m.shared->vertexObject = 0;
+    m.shared->vertexMemory.Set(0);
+  }
 }
 
 }
@@ -7,24 +7,266 @@
 
 #include "vrb/private/GeometryDrawableState.h"
 
+#include "vrb/Bounds.h"
 #include "vrb/Camera.h"
 #include "vrb/Color.h"
+#include "vrb/CreationContext.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/CullVisitor.h"
 #include "vrb/DrawableList.h"
 #include "vrb/GLError.h"
+#include "vrb/GLExtensions.h"
+#include "vrb/InstanceCuller.h"
 #include "vrb/Logger.h"
 #include "vrb/Matrix.h"
+#include "vrb/NodeProfiler.h"
+#include "vrb/Program.h"
+#include "vrb/ProgramFactory.h"
 #include "vrb/RenderBuffer.h"
 #include "vrb/RenderState.h"
+#include "vrb/StreamBuffer.h"
 #include "vrb/Texture.h"
 #include "vrb/VertexArray.h"
 #include "vrb/Vector.h"
 
+#include <algorithm>
 #include <vector>
 
+namespace {
+
+// Strip indices end each strip with the largest value of their type, which
+// must only restart primitives while they are drawn.
+class PrimitiveRestartScope {
+public:
+  explicit PrimitiveRestartScope(const vrb::RenderBuffer& aBuffer)
+      : mEnabled(aBuffer.PrimitiveType() == GL_TRIANGLE_STRIP) {
+    if (mEnabled) {
+      VRB_GL_CHECK(glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX));
+    }
+  }
+  ~PrimitiveRestartScope() {
+    if (mEnabled) {
+      VRB_GL_CHECK(glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX));
+    }
+  }
+private:
+  const bool mEnabled;
+};
+
+} // namespace
+
 namespace vrb {
 
+bool
+GeometryDrawable::State::UseInstancing() const {
+  if (!renderState) {
+    return false;
+  }
+  ProgramPtr program = renderState->GetProgram();
+  return program && program->SupportsFeatures(FeatureInstancing);
+}
+
+void
+GeometryDrawable::State::BindVertexArray() {
+  VertexArrayKey key;
+  key.vertexObject = renderBuffer->GetVertexObject();
+  key.indexObject = renderBuffer->GetIndexObject();
+  key.position = renderState->AttributePosition();
+  key.normal = renderState->AttributeNormal();
+  key.uv = UseTexture() ? renderState->AttributeUV() : -1;
+  key.color = UseColor() ? renderState->AttributeColor() : -1;
+  key.instanceModel = renderState->AttributeInstanceModel();
+  // Joint attributes are only bound when the RenderBuffer defines them.
+  if (renderBuffer->JointLength() > 0) {
+    key.joint = renderState->AttributeJoint();
+    key.weight = renderState->AttributeWeight();
+  }
+
+  VRB_GL_STATS_ADD(StateChanges, 1);
+  if (vertexArrayObject && (key == vertexArrayKey)) {
+    VRB_GL_CHECK(glBindVertexArray(vertexArrayObject));
+    return;
+  }
+
+  // The vertex array object is rebuilt from scratch so that attributes
+  // enabled by a previous layout do not remain enabled.
+  if (vertexArrayObject) {
+    VRB_GL_CHECK(glDeleteVertexArrays(1, &vertexArrayObject));
+  }
+  vertexArrayKey = key;
+  VRB_GL_CHECK(glGenVertexArrays(1, &vertexArrayObject));
+  VRB_GL_CHECK(glBindVertexArray(vertexArrayObject));
+  renderBuffer->Bind();
+
+  const GLsizei kSize = renderBuffer->VertexSize();
+  const RenderBuffer& rb = *renderBuffer;
+  VRB_GL_CHECK(glVertexAttribPointer((GLuint)key.position, rb.PositionLength(), rb.PositionType(), rb.PositionNormalized(), kSize, (const GLvoid*)rb.PositionOffset()));
+  VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)key.position));
+  VRB_GL_CHECK(glVertexAttribPointer((GLuint)key.normal, rb.NormalLength(), rb.NormalType(), rb.NormalNormalized(), kSize, (const GLvoid*)rb.NormalOffset()));
+  VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)key.normal));
+  if (key.uv >= 0) {
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)key.uv, rb.UVLength(), rb.UVType(), rb.UVNormalized(), kSize, (const GLvoid*)rb.UVOffset()));
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)key.uv));
+  }
+  if (key.color >= 0) {
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)key.color, rb.ColorLength(), rb.ColorType(), rb.ColorNormalized(), kSize, (const GLvoid*)rb.ColorOffset()));
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)key.color));
+  }
+  if (key.joint >= 0) {
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)key.joint, rb.JointLength(), rb.JointType(), rb.JointNormalized(), kSize, (const GLvoid*)rb.JointOffset()));
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)key.joint));
+  }
+  if (key.weight >= 0) {
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)key.weight, rb.WeightLength(), rb.WeightType(), rb.WeightNormalized(), kSize, (const GLvoid*)rb.WeightOffset()));
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)key.weight));
+  }
+  if (key.instanceModel >= 0) {
+    for (GLuint column = 0; column < 4; column++) {
+      const GLuint kLocation = (GLuint)key.instanceModel + column;
+      VRB_GL_CHECK(glEnableVertexAttribArray(kLocation));
+      VRB_GL_CHECK(glVertexAttribDivisor(kLocation, 1));
+    }
+  }
+  // Only the element array binding is recorded in the vertex array object.
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+// Points the instance model matrix of the bound vertex array object at
+// aOffset in aBuffer. A mat4 attribute occupies four consecutive locations,
+// one per column.
+void
+GeometryDrawable::State::PointInstanceAttributes(const GLuint aBuffer, const size_t aOffset) {
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, aBuffer));
+  const GLsizei kMatrixSize = sizeof(float) * 16;
+  for (GLuint column = 0; column < 4; column++) {
+    const GLuint kLocation = (GLuint)vertexArrayKey.instanceModel + column;
+    VRB_GL_CHECK(glVertexAttribPointer(kLocation, 4, GL_FLOAT, GL_FALSE, kMatrixSize, (const GLvoid*)(aOffset + (sizeof(float) * 4 * column))));
+  }
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+void
+GeometryDrawable::State::DrawElements(const GLsizei aInstanceCount) {
+  PrimitiveRestartScope restart(*renderBuffer);
+  if (ranges.empty()) {
+    DrawRange(rangeStart, rangeLength, aInstanceCount);
+    return;
+  }
+  if ((aInstanceCount <= 1) && (ranges.size() > 2)) {
+    drawCounts.clear();
+    drawOffsets.clear();
+    AppendRanges(drawCounts, drawOffsets);
+    MultiDraw();
+    return;
+  }
+  for (size_t ix = 0; (ix + 1) < ranges.size(); ix += 2) {
+    // A zero length would draw the whole buffer.
+    if (ranges[ix + 1] > 0) {
+      DrawRange(ranges[ix], ranges[ix + 1], aInstanceCount);
+    }
+  }
+}
+
+void
+GeometryDrawable::State::DrawRange(const uint32_t aStart, const uint32_t aLength, const GLsizei aInstanceCount) {
+  const GLenum kMode = renderBuffer->PrimitiveType();
+  const GLenum kIndexType = renderBuffer->IndexType();
+  GLsizei count = 0;
+  size_t offset = 0;
+  if (!GetRange(aStart, aLength, count, offset)) {
+    return;
+  }
+  const uint64_t kTriangles = (uint64_t)renderBuffer->TriangleCount(count) * std::max(aInstanceCount, 1);
+  VRB_GL_STATS_ADD(DrawCalls, 1);
+  VRB_GL_STATS_ADD(Triangles, kTriangles);
+  NodeProfiler::AddDraws(1, kTriangles);
+  if (aInstanceCount > 1) {
+    VRB_GL_CHECK(glDrawElementsInstanced(kMode, count, kIndexType, (void*)offset, aInstanceCount));
+  } else {
+    VRB_GL_CHECK(glDrawElements(kMode, count, kIndexType, (void*)offset));
+  }
+}
+
+bool
+GeometryDrawable::State::GetRange(const uint32_t aStart, const uint32_t aLength, GLsizei& aCount, size_t& aOffset) const {
+  const int32_t maxLength = renderBuffer->IndexCount();
+  aCount = maxLength;
+  aOffset = 0;
+  if (aLength != 0) {
+    if (((uint64_t)aStart + aLength) > (uint64_t)std::max(maxLength, 0)) {
+      VRB_WARN("Invalid geometry range (%u-%u). Max geometry length %d", aStart, aStart + aLength, maxLength);
+      return false;
+    }
+    aCount = aLength;
+    aOffset = aStart * renderBuffer->IndexSize();
+  }
+  return true;
+}
+
+void
+GeometryDrawable::State::AppendRanges(std::vector<GLsizei>& aCounts, std::vector<const void*>& aOffsets) const {
+  GLsizei count = 0;
+  size_t offset = 0;
+  if (ranges.empty()) {
+    if (GetRange(rangeStart, rangeLength, count, offset)) {
+      aCounts.push_back(count);
+      aOffsets.push_back((const void*)offset);
+    }
+    return;
+  }
+  for (size_t ix = 0; (ix + 1) < ranges.size(); ix += 2) {
+    // A zero length would draw the whole buffer.
+    if ((ranges[ix + 1] > 0) && GetRange(ranges[ix], ranges[ix + 1], count, offset)) {
+      aCounts.push_back(count);
+      aOffsets.push_back((const void*)offset);
+    }
+  }
+}
+
+void
+GeometryDrawable::State::MultiDraw() {
+  if (drawCounts.empty()) {
+    return;
+  }
+  const GLenum kMode = renderBuffer->PrimitiveType();
+  const GLenum kIndexType = renderBuffer->IndexType();
+  uint64_t triangles = 0;
+  for (const GLsizei kCount: drawCounts) {
+    triangles += renderBuffer->TriangleCount(kCount);
+  }
+  VRB_GL_STATS_ADD(Triangles, triangles);
+  PFNGLMULTIDRAWELEMENTSEXTPROC multiDraw = glExtensions ? glExtensions->GetFunctions().glMultiDrawElementsEXT : nullptr;
+  if (multiDraw && (drawCounts.size() > 1)) {
+    VRB_GL_STATS_ADD(DrawCalls, 1);
+    NodeProfiler::AddDraws(1, triangles);
+    VRB_GL_CHECK(multiDraw(kMode, drawCounts.data(), kIndexType, drawOffsets.data(), (GLsizei)drawCounts.size()));
+    return;
+  }
+  VRB_GL_STATS_ADD(DrawCalls, drawCounts.size());
+  NodeProfiler::AddDraws(drawCounts.size(), triangles);
+  for (size_t ix = 0; ix < drawCounts.size(); ix++) {
+    VRB_GL_CHECK(glDrawElements(kMode, drawCounts[ix], kIndexType, drawOffsets[ix]));
+  }
+}
+
+void
+GeometryDrawable::State::DrawCulledInstances(const Camera& aCamera, const Matrix& aModelTransform) {
+  // The compute shader runs before the RenderState binds its program.
+  if (!instanceCuller->Cull(aCamera, aModelTransform, renderBuffer->IndexCount())) {
+    return;
+  }
+  if (renderState->Enable(aCamera, aModelTransform, instanceCuller->GetBounds().Transform(aModelTransform))) {
+    BindVertexArray();
+    if (vertexArrayKey.instanceModel >= 0) {
+      PointInstanceAttributes(instanceCuller->GetInstanceBuffer(), 0);
+    }
+    PrimitiveRestartScope restart(*renderBuffer);
+    instanceCuller->Draw(*renderBuffer);
+    VRB_GL_CHECK(glBindVertexArray(0));
+    renderState->Disable();
+  }
+}
+
 GeometryDrawablePtr
 GeometryDrawable::Create(CreationContextPtr& aContext) {
   return std::make_shared<ConcreteClass<GeometryDrawable, GeometryDrawable::State> >(aContext);
@@ -33,7 +275,10 @@ GeometryDrawable::Create(CreationContextPtr& aContext) {
 // Node interface
 void
 GeometryDrawable::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
-  aDrawables.AddDrawable(std::move(CreateDrawablePtr()), aVisitor.GetTransform());
+  if (!aVisitor.IsVisible(GetBounds())) {
+    return;
+  }
+  aDrawables.AddDrawable(*this, aVisitor.GetTransform());
 }
 
 // Drawable interface
@@ -45,50 +290,105 @@ GeometryDrawable::GetRenderState() {
 void
 GeometryDrawable::SetRenderState(const RenderStatePtr& aRenderState) {
   m.renderState = aRenderState;
+  m.InvalidateVertexArray();
 }
 
 void
 GeometryDrawable::Draw(const Camera& aCamera, const Matrix& aModelTransform) {
-  if (m.renderState->Enable(aCamera.GetPerspective(), aCamera.GetView(), aModelTransform)) {
-    const bool kUseTexture = m.UseTexture();
-    const bool kUseColor = m.UseColor();
-    const GLsizei kSize = m.renderBuffer->VertexSize();
-    m.renderBuffer->Bind();
-
-    VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.renderState->AttributePosition(), m.renderBuffer->PositionLength(), GL_FLOAT, GL_FALSE, kSize, (const GLvoid*)m.renderBuffer->PositionOffset()));
-    VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.renderState->AttributeNormal(), m.renderBuffer->NormalLength(), GL_FLOAT, GL_FALSE, kSize, (const GLvoid*)m.renderBuffer->NormalOffset()));
-    if (kUseTexture) {
-      VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.renderState->AttributeUV(), m.renderBuffer->UVLength(), GL_FLOAT, GL_FALSE, kSize, (const GLvoid*)m.renderBuffer->UVOffset()));
-    }
-    if (kUseColor) {
-      VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.renderState->AttributeColor(), m.renderBuffer->ColorLength(), GL_FLOAT, GL_FALSE, kSize, (const GLvoid*)m.renderBuffer->ColorOffset()));
-    }
+  if (m.instanceCuller && m.UseInstancing()) {
+    m.DrawCulledInstances(aCamera, aModelTransform);
+    return;
+  }
+  if (m.UseInstancing()) {
+    DrawInstanced(aCamera, &aModelTransform, 1);
+    return;
+  }
+  if (m.renderState->Enable(aCamera, aModelTransform, GetBounds().Transform(aModelTransform))) {
+    m.BindVertexArray();
+    m.DrawElements(1);
+    VRB_GL_CHECK(glBindVertexArray(0));
+    m.renderState->Disable();
+  }
+}
 
-    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.renderState->AttributePosition()));
-    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.renderState->AttributeNormal()));
-    if (kUseTexture) {
-      VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.renderState->AttributeUV()));
-    }
-    if (kUseColor) {
-      VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.renderState->AttributeColor()));
-    }
-    const int32_t maxLength = m.renderBuffer->IndexCount();
-    if (m.rangeLength == 0) {
-      VRB_GL_CHECK(glDrawElements(GL_TRIANGLES, maxLength, GL_UNSIGNED_SHORT, 0));
-    } else if ((m.rangeStart + m.rangeLength) <= maxLength) {
-      VRB_GL_CHECK(glDrawElements(GL_TRIANGLES, m.rangeLength, GL_UNSIGNED_SHORT, (void*)(m.rangeStart * sizeof(GLushort))));
-    } else {
-      VRB_WARN("Invalid geometry range (%u-%u). Max geometry length %d", m.rangeStart, m.rangeLength + m.rangeLength, maxLength);
-    }
-    VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)m.renderState->AttributePosition()));
-    VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)m.renderState->AttributeNormal()));
-    if (kUseTexture) {
-      VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)m.renderState->AttributeUV()));
+const void*
+GeometryDrawable::GetInstancingKey() {
+  // Drawables sharing a RenderBuffer may only be batched when they draw all of it.
+  if ((m.rangeLength != 0) || !m.ranges.empty() || !m.UseInstancing() || m.instanceCuller) {
+    return nullptr;
+  }
+  return m.renderBuffer.get();
+}
+
+void
+GeometryDrawable::DrawInstanced(const Camera& aCamera, const Matrix* aModelTransforms, const int32_t aCount) {
+  if (aCount <= 0) {
+    return;
+  }
+  if (!m.UseInstancing()) {
+    for (int32_t ix = 0; ix < aCount; ix++) {
+      Draw(aCamera, aModelTransforms[ix]);
     }
-    if (kUseColor) {
-      VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)m.renderState->AttributeColor()));
+    return;
+  }
+  // Every instance is given the lights reaching any of them.
+  Bounds bounds;
+  for (int32_t ix = 0; ix < aCount; ix++) {
+    bounds.Extend(GetBounds().Transform(aModelTransforms[ix]));
+  }
+  if (m.renderState->Enable(aCamera, aModelTransforms[0], bounds)) {
+    m.BindVertexArray();
+    if (m.vertexArrayKey.instanceModel >= 0) {
+      // The matrices are copied into this frame of the StreamBuffer, falling
+      // back to respecifying a buffer of this drawable when it is full.
+      const size_t kBytes = sizeof(float) * 16 * (size_t)aCount;
+      const GLintptr kOffset = m.streamBuffer ? m.streamBuffer->Write(aModelTransforms[0].Data(), kBytes) : -1;
+      if (kOffset >= 0) {
+        m.PointInstanceAttributes(m.streamBuffer->GetHandle(), (size_t)kOffset);
+      } else {
+        if (!m.instanceBuffer) {
+          VRB_GL_CHECK(glGenBuffers(1, &m.instanceBuffer));
+        }
+        VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.instanceBuffer));
+        VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)kBytes, aModelTransforms[0].Data(), GL_STREAM_DRAW));
+        VRB_GL_STATS_ADD(BufferUploadBytes, kBytes);
+        m.PointInstanceAttributes(m.instanceBuffer, 0);
+      }
     }
-    m.renderBuffer->Unbind();
+    m.DrawElements(aCount);
+    VRB_GL_CHECK(glBindVertexArray(0));
+    m.renderState->Disable();
+  }
+}
+
+const void*
+GeometryDrawable::GetBatchKey() {
+  // Drawables drawing all of a RenderBuffer are batched by instancing instead.
+  if (((m.rangeLength == 0) && m.ranges.empty()) || m.UseInstancing() || m.instanceCuller) {
+    return nullptr;
+  }
+  return m.renderBuffer.get();
+}
+
+void
+GeometryDrawable::DrawBatch(const Camera& aCamera, const Matrix& aModelTransform, Drawable* const* aBatch, const int32_t aCount) {
+  if (aCount <= 0) {
+    return;
+  }
+  Bounds bounds;
+  m.drawCounts.clear();
+  m.drawOffsets.clear();
+  for (int32_t ix = 0; ix < aCount; ix++) {
+    // Only a GeometryDrawable returns its RenderBuffer as batch key.
+    const GeometryDrawable* drawable = static_cast<const GeometryDrawable*>(aBatch[ix]);
+    bounds.Extend(drawable->GetBounds());
+    drawable->m.AppendRanges(m.drawCounts, m.drawOffsets);
+  }
+  if (m.renderState->Enable(aCamera, aModelTransform, bounds.Transform(aModelTransform))) {
+    m.BindVertexArray();
+    PrimitiveRestartScope restart(*m.renderBuffer);
+    m.MultiDraw();
+    VRB_GL_CHECK(glBindVertexArray(0));
     m.renderState->Disable();
   }
 }
@@ -102,12 +402,30 @@ GeometryDrawable::GetRenderBuffer() {
 void
 GeometryDrawable::SetRenderBuffer(RenderBufferPtr& aRenderBuffer) {
   m.renderBuffer = aRenderBuffer;
+  m.InvalidateVertexArray();
 }
 
 void
 GeometryDrawable::SetRenderRange(uint32_t aStartIndex, uint32_t aLength) {
   m.rangeStart = aStartIndex;
   m.rangeLength = aLength;
+  m.ranges.clear();
+}
+
+void
+GeometryDrawable::AddRenderRange(uint32_t aStartIndex, uint32_t aLength) {
+  m.ranges.push_back(aStartIndex);
+  m.ranges.push_back(aLength);
+}
+
+void
+GeometryDrawable::ClearRenderRanges() {
+  m.ranges.clear();
+}
+
+void
+GeometryDrawable::SetInstanceCuller(const InstanceCullerPtr& aCuller) {
+  m.instanceCuller = aCuller;
 }
 
 GeometryDrawable::GeometryDrawable(State& aState, CreationContextPtr& aContext) :
@@ -116,6 +434,9 @@ GeometryDrawable::GeometryDrawable(State& aState, CreationContextPtr& aContext)
     m(aState)
 {
   m.renderBuffer = RenderBuffer::Create(aContext);
+  m.streamBuffer = aContext->GetStreamBuffer();
+  m.glDeletions = aContext->GetGLDeletionQueue();
+  m.glExtensions = aContext->GetGLExtensions();
 }
 
 } // vrb
@@ -6,15 +6,33 @@
 #include "vrb/Group.h"
 #include "vrb/private/GroupState.h"
 #include "vrb/private/DrawableState.h"
+#include "vrb/private/PoolAllocator.h"
 
+#include "vrb/BoundingVolumeHierarchy.h"
+#include "vrb/Bounds.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/CullVisitor.h"
 #include "vrb/DrawableList.h"
 #include "vrb/Light.h"
 #include "vrb/Logger.h"
 #include "vrb/Matrix.h"
+#include "vrb/NodeProfiler.h"
+#include "vrb/RayHit.h"
+#include "vrb/SceneSnapshot.h"
+#include "vrb/TraceProfiler.h"
 
 #include <algorithm>
+#include <limits>
 #include <memory>
+#include <string.h>
+#include <unordered_set>
+
+namespace {
+
+// Smaller groups are faster to cull with a linear scan.
+const size_t kMinSpatialIndexChildren = 16;
+
+}
 
 namespace vrb {
 
@@ -66,14 +84,41 @@ Group::State::createLambdaDrawable(CreationContextPtr& aContext, const RenderLam
   return nullptr;
 }
 
-bool
-Group::State::Contains(const Node& aNode) {
-  for (NodePtr& node: children) {
-    if (node.get() == &aNode) {
-      return true;
+int32_t
+Group::State::FindChild(const Node& aNode) {
+  auto it = childSlots.find(&aNode);
+  if (it == childSlots.end()) {
+    return -1;
+  }
+  const int32_t kCount = (int32_t)children.size();
+  const int32_t kSlot = std::min((int32_t)it->second, kCount - 1);
+  for (int32_t offset = 0; ((kSlot - offset) >= 0) || ((kSlot + offset) < kCount); offset++) {
+    const int32_t kBefore = kSlot - offset;
+    if ((kBefore >= 0) && (children[kBefore].get() == &aNode)) {
+      it->second = (uint32_t)kBefore;
+      return kBefore;
+    }
+    const int32_t kAfter = kSlot + offset;
+    if ((kAfter < kCount) && (children[kAfter].get() == &aNode)) {
+      it->second = (uint32_t)kAfter;
+      return kAfter;
     }
   }
-  return false;
+  VRB_ERROR("Group child missing from its slot index");
+  return -1;
+}
+
+void
+Group::State::AppendChild(NodePtr&& aNode) {
+  childSlots[aNode.get()] = (uint32_t)children.size();
+  children.push_back(std::move(aNode));
+}
+
+void
+Group::State::UpdateChildSlots() {
+  for (uint32_t ix = 0; ix < (uint32_t)children.size(); ix++) {
+    childSlots[children[ix].get()] = ix;
+  }
 }
 
 bool
@@ -86,37 +131,203 @@ Group::State::Contains(const Light& aLight) {
   return false;
 }
 
+// Brings the hierarchy up to date with the bounds of the children. Returns
+// false when the children should be scanned linearly instead.
+bool
+Group::State::UseSpatialIndex() {
+  if (!spatialIndexEnabled || (children.size() < kMinSpatialIndexChildren)) {
+    return false;
+  }
+  if (!spatialRebuild && !spatialRefit) {
+    return true;
+  }
+  if (!spatialRebuild) {
+    childBounds.clear();
+    for (uint32_t child: indexedChildren) {
+      const Bounds& kBounds = children[child]->GetBounds();
+      if (kBounds.IsEmpty() || kBounds.IsInfinite()) {
+        spatialRebuild = true;
+        break;
+      }
+      childBounds.push_back(kBounds);
+    }
+    spatialRebuild = spatialRebuild || !spatialIndex.Refit(childBounds);
+  }
+  if (spatialRebuild) {
+    indexedChildren.clear();
+    unboundedChildren.clear();
+    childBounds.clear();
+    for (uint32_t ix = 0; ix < (uint32_t)children.size(); ix++) {
+      const Bounds& kBounds = children[ix]->GetBounds();
+      if (kBounds.IsEmpty() || kBounds.IsInfinite()) {
+        unboundedChildren.push_back(ix);
+      } else {
+        indexedChildren.push_back(ix);
+        childBounds.push_back(kBounds);
+      }
+    }
+    spatialIndex.Build(childBounds);
+  }
+  spatialRebuild = false;
+  spatialRefit = false;
+  return true;
+}
+
 GroupPtr
 Group::Create(CreationContextPtr& aContext) {
-  GroupPtr group = std::make_shared<ConcreteClass<Group, Group::State> >(aContext);
+  GroupPtr group = std::allocate_shared<ConcreteClass<Group, Group::State> >(PoolAllocator<Group>(), aContext);
   group->m.self = group;
   return group;
 }
 
 void
 Group::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  VRB_TRACE_ZONE("Group::Cull");
+  if (!aVisitor.IsVisible(GetBounds())) {
+    return;
+  }
+  if (m.occlusionCulling && aVisitor.IsOccluded(*this, GetBounds())) {
+    return;
+  }
+  CullChildren(aVisitor, aDrawables);
+}
+
+void
+Group::Flatten(SceneSnapshot& aSnapshot) {
+  FlattenGroup(aSnapshot, nullptr);
+}
+
+bool
+Group::Intersect(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit) {
+  float distance = 0.0f;
+  if (!GetBounds().IntersectsRay(aOrigin, aDirection, distance) || (distance > aHit.distance)) {
+    return false;
+  }
+  return IntersectChildren(aOrigin, aDirection, aHit);
+}
+
+void
+Group::CullChildren(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  NodeProfiler::CullScope profile(*this);
+  if (!m.recordVisitor) {
+    CullContents(aVisitor, aDrawables);
+    return;
+  }
+  const Matrix& kTransform = aVisitor.GetTransform();
+  if ((m.recording < 0) || (GetRevision() != m.recordedRevision) ||
+      (memcmp(kTransform.Data(), m.recordedTransform.Data(), sizeof(float) * 16) != 0) ||
+      !m.recordings[m.recording]->HasRecordedLights(aDrawables)) {
+    VRB_TRACE_ZONE("Group::Record");
+    m.recording = m.recording == 0 ? 1 : 0;
+    DrawableList& recording = *m.recordings[m.recording];
+    recording.BeginRecording(aDrawables);
+    // Every child is recorded, whatever the view, so only the bounds of
+    // the Group are tested while the recording is reused.
+    m.recordVisitor->Inherit(aVisitor);
+    m.recordVisitor->ClearFrustum();
+    m.recordVisitor->ClearCamera();
+    m.recordVisitor->SetOcclusionCuller(nullptr);
+    CullContents(*m.recordVisitor, recording);
+    m.recordVisitor->Reset();
+    // Read after recording, culling the children may update their state.
+    m.recordedRevision = GetRevision();
+    m.recordedTransform = kTransform;
+  }
+  aDrawables.AddRecording(*m.recordings[m.recording]);
+}
+
+void
+Group::CullContents(CullVisitor& aVisitor, DrawableList& aDrawables) {
   for (LightPtr& light: m.lights) {
     aDrawables.PushLight(*light);
   }
+  if (m.depthPrePass) {
+    aDrawables.PushDepthPrePass();
+  }
   // Lambdas are added post first and pre last because the DrawablesList is FILO.
   if (m.postRenderLambda) {
-    aDrawables.AddDrawable(m.postRenderLambda, Matrix());
+    aDrawables.AddDrawable(*m.postRenderLambda, Matrix());
   }
-  for (NodePtr& node: m.children) {
-    if (m.IsEnabled(*node)) {
-      node->Cull(aVisitor, aDrawables);
+  if (m.UseSpatialIndex()) {
+    std::vector<uint32_t>& visible = m.visibleChildren;
+    visible.clear();
+    m.spatialIndex.Query([&aVisitor](const Bounds& aBounds) { return aVisitor.IsVisible(aBounds); }, visible);
+    for (uint32_t& item: visible) {
+      item = m.indexedChildren[item];
     }
+    visible.insert(visible.end(), m.unboundedChildren.begin(), m.unboundedChildren.end());
+    // Children are culled in the order they were added, as without the index.
+    std::sort(visible.begin(), visible.end());
+    for (const uint32_t kChild: visible) {
+      if (m.IsEnabled(kChild)) {
+        m.children[kChild]->Cull(aVisitor, aDrawables);
+      }
+    }
+  } else {
+    m.ForEachEnabled([this, &aVisitor, &aDrawables](const uint32_t aChild) {
+      m.children[aChild]->Cull(aVisitor, aDrawables);
+    });
   }
   if (m.preRenderLambda) {
-    aDrawables.AddDrawable(m.preRenderLambda, Matrix());
+    aDrawables.AddDrawable(*m.preRenderLambda, Matrix());
+  }
+  if (m.depthPrePass) {
+    aDrawables.PopDepthPrePass();
   }
   aDrawables.PopLights(m.lights.size());
 }
 
+void
+Group::FlattenGroup(SceneSnapshot& aSnapshot, const Matrix* aTransform) {
+  // The hierarchy and occlusion queries are only used by Cull.
+  if (m.spatialIndexEnabled || m.occlusionCulling || m.recordVisitor || m.depthPrePass) {
+    Node::Flatten(aSnapshot);
+    return;
+  }
+  aSnapshot.BeginGroup(*this, aTransform, m.lights, m.preRenderLambda.get(), m.postRenderLambda.get());
+  m.ForEachEnabled([this, &aSnapshot](const uint32_t aChild) {
+    m.children[aChild]->Flatten(aSnapshot);
+  });
+  aSnapshot.EndGroup();
+}
+
+bool
+Group::IntersectChildren(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit) {
+  bool result = false;
+  auto intersect = [&](const uint32_t aSlot) {
+    const NodePtr& kChild = m.children[aSlot];
+    if (kChild->Intersect(aOrigin, aDirection, aHit)) {
+      // Geometry leaves the node to the Group holding it.
+      if (!aHit.node) {
+        aHit.node = kChild;
+      }
+      result = true;
+    }
+  };
+  if (m.UseSpatialIndex()) {
+    // aHit.distance shrinks as hits are found, which prunes farther boxes.
+    m.spatialIndex.RayQuery(aOrigin, aDirection, aHit.distance, [&](const uint32_t aItem, const float, float&) {
+      const uint32_t kChild = m.indexedChildren[aItem];
+      if (m.IsEnabled(kChild)) {
+        intersect(kChild);
+      }
+    });
+    for (const uint32_t kChild: m.unboundedChildren) {
+      if (m.IsEnabled(kChild)) {
+        intersect(kChild);
+      }
+    }
+  } else {
+    m.ForEachEnabled(intersect);
+  }
+  return result;
+}
+
 void
 Group::AddLight(LightPtr aLight) {
   if (!m.Contains(*aLight)) {
     m.lights.push_back(std::move(aLight));
+    InvalidateLayout();
   }
 }
 
@@ -125,6 +336,7 @@ Group::RemoveLight(const Light& aLight) {
   for (auto it = m.lights.begin(); it != m.lights.end(); it++) {
     if (it->get() == &aLight) {
       m.lights.erase(it);
+      InvalidateLayout();
       return;
     }
   }
@@ -133,27 +345,106 @@ Group::RemoveLight(const Light& aLight) {
 void
 Group::AddNode(NodePtr aNode) {
   if (!m.Contains(*aNode)) {
-    AddToParents(m.self, *aNode);
-    m.children.push_back(std::move(aNode));
+    AddToParents(*this, *aNode);
+    m.AppendChild(std::move(aNode));
+    m.spatialRebuild = true;
+    InvalidateLayout();
+    InvalidateBounds();
+  }
+}
+
+void
+Group::AddNodes(const std::vector<NodePtr>& aNodes) {
+  m.children.reserve(m.children.size() + aNodes.size());
+  bool added = false;
+  for (const NodePtr& node: aNodes) {
+    if (node && !m.Contains(*node)) {
+      AddToParents(*this, *node);
+      m.AppendChild(NodePtr(node));
+      added = true;
+    }
+  }
+  if (added) {
+    m.spatialRebuild = true;
+    InvalidateLayout();
+    InvalidateBounds();
   }
 }
 
 void
 Group::RemoveNode(Node& aNode) {
-  for (auto childIt = m.children.begin(); childIt != m.children.end(); childIt++) {
-    if (childIt->get() == &aNode) {
-      m.children.erase(childIt);
-      RemoveFromParents(*this, aNode);
-      return;
+  const int32_t kSlot = m.FindChild(aNode);
+  if (kSlot < 0) {
+    return;
+  }
+  // Keeps the child alive until it is detached from this Group.
+  NodePtr child = std::move(m.children[kSlot]);
+  m.children.erase(m.children.begin() + kSlot);
+  m.childSlots.erase(&aNode);
+  m.toggledOff.Erase((uint32_t)kSlot);
+  m.filtered.Erase((uint32_t)kSlot);
+  m.spatialRebuild = true;
+  m.Detach(aNode);
+  RemoveFromParents(*this, aNode);
+  InvalidateLayout();
+  InvalidateBounds();
+}
+
+void
+Group::RemoveNodes(const std::vector<NodePtr>& aNodes) {
+  std::unordered_set<const Node*> removed;
+  for (const NodePtr& node: aNodes) {
+    if (node && m.Contains(*node)) {
+      removed.insert(node.get());
     }
   }
+  if (removed.empty()) {
+    return;
+  }
+  // A single pass keeps the order of the remaining children.
+  std::vector<NodePtr> detached;
+  detached.reserve(removed.size());
+  size_t kept = 0;
+  for (size_t ix = 0; ix < m.children.size(); ix++) {
+    if (removed.count(m.children[ix].get()) > 0) {
+      detached.push_back(std::move(m.children[ix]));
+    } else {
+      if (kept != ix) {
+        m.childSlots[m.children[ix].get()] = (uint32_t)kept;
+        m.children[kept] = std::move(m.children[ix]);
+        m.toggledOff.Set((uint32_t)kept, m.toggledOff.Test((uint32_t)ix));
+        m.filtered.Set((uint32_t)kept, m.filtered.Test((uint32_t)ix));
+      }
+      kept++;
+    }
+  }
+  m.children.resize(kept);
+  m.toggledOff.Truncate((uint32_t)kept);
+  m.filtered.Truncate((uint32_t)kept);
+  m.spatialRebuild = true;
+  // Every slot goes first, Detach may look up the remaining children.
+  for (NodePtr& node: detached) {
+    m.childSlots.erase(node.get());
+  }
+  for (NodePtr& node: detached) {
+    m.Detach(*node);
+    RemoveFromParents(*this, *node);
+  }
+  InvalidateLayout();
+  InvalidateBounds();
 }
 
 void
 Group::InsertNode(NodePtr aNode, uint32_t aIndex) {
   if (!m.Contains(*aNode)) {
-    AddToParents(m.self, *aNode);
+    AddToParents(*this, *aNode);
+    m.childSlots[aNode.get()] = aIndex;
     m.children.insert(m.children.begin() + aIndex, std::move(aNode));
+    m.toggledOff.Insert(aIndex);
+    m.filtered.Insert(aIndex);
+    m.spatialRebuild = true;
+    InvalidateLayout();
+    InvalidateBounds();
   }
 }
 
@@ -169,25 +460,136 @@ Group::GetNodeCount() const {
 
 void
 Group::SortNodes(const std::function<bool(const vrb::NodePtr&, const vrb::NodePtr&)>& aFunction) {
+  // The bits follow their children to the sorted slots.
+  std::vector<const Node*> toggledOff;
+  std::vector<const Node*> filtered;
+  if (m.toggledOff.Any() || m.filtered.Any()) {
+    for (uint32_t ix = 0; ix < (uint32_t)m.children.size(); ix++) {
+      if (m.toggledOff.Test(ix)) {
+        toggledOff.push_back(m.children[ix].get());
+      }
+      if (m.filtered.Test(ix)) {
+        filtered.push_back(m.children[ix].get());
+      }
+    }
+    m.toggledOff.Clear();
+    m.filtered.Clear();
+  }
   std::sort(m.children.begin(), m.children.end(), aFunction);
+  m.UpdateChildSlots();
+  for (const Node* node: toggledOff) {
+    m.toggledOff.Set(m.childSlots[node], true);
+  }
+  for (const Node* node: filtered) {
+    m.filtered.Set(m.childSlots[node], true);
+  }
+  m.spatialRebuild = true;
+  InvalidateLayout();
 }
 
 void
 Group::TakeChildren(GroupPtr& aSource) {
   for (NodePtr& child: aSource->m.children) {
-    m.children.push_back(child);
+    // Re-parent so bounds changes in the children invalidate this Group.
+    RemoveFromParents(*aSource, *child);
+    if (!m.Contains(*child)) {
+      AddToParents(*this, *child);
+      m.AppendChild(std::move(child));
+    }
   }
+  m.spatialRebuild = true;
   aSource->m.Clear();
+  aSource->InvalidateLayout();
+  aSource->InvalidateBounds();
+  InvalidateLayout();
+  InvalidateBounds();
 }
 
 void
 Group::SetPreRenderLambda(CreationContextPtr& aContext, const RenderLambda& aLambda) {
   m.preRenderLambda = m.createLambdaDrawable(aContext, aLambda);
+  InvalidateLayout();
 }
 
 void
 Group::SetPostRenderLambda(CreationContextPtr& aContext, const RenderLambda& aLambda) {
   m.postRenderLambda = m.createLambdaDrawable(aContext, aLambda);
+  InvalidateLayout();
+}
+
+void
+Group::SetSpatialIndex(const bool aEnabled) {
+  m.spatialIndexEnabled = aEnabled;
+  m.spatialRebuild = true;
+  InvalidateLayout();
+  if (!aEnabled) {
+    m.spatialIndex.Clear();
+  }
+}
+
+void
+Group::SetStatic(CreationContextPtr& aContext, const bool aStatic) {
+  if (aStatic == (m.recordVisitor != nullptr)) {
+    return;
+  }
+  if (aStatic) {
+    m.recordVisitor = CullVisitor::Create(aContext);
+    m.recordings[0] = DrawableList::Create(aContext);
+    m.recordings[1] = DrawableList::Create(aContext);
+  } else {
+    m.recordVisitor = nullptr;
+    m.recordings[0] = nullptr;
+    m.recordings[1] = nullptr;
+  }
+  m.recording = -1;
+  InvalidateLayout();
+}
+
+void
+Group::SetOcclusionCulling(const bool aEnabled) {
+  m.occlusionCulling = aEnabled;
+  InvalidateLayout();
+}
+
+void
+Group::SetDepthPrePass(const bool aEnabled) {
+  if (aEnabled == m.depthPrePass) {
+    return;
+  }
+  m.depthPrePass = aEnabled;
+  // Static Groups holding the subtree record it again.
+  InvalidateLayout();
+}
+
+NodePtr
+Group::PickChild(const Vector& aOrigin, const Vector& aDirection, float* aDistance) {
+  NodePtr result;
+  float nearest = std::numeric_limits<float>::infinity();
+  // Flags the hierarchy for a refit if children moved.
+  GetBounds();
+  if (m.UseSpatialIndex()) {
+    const int32_t kItem = m.spatialIndex.Raycast(aOrigin, aDirection, [this](const uint32_t aItem) {
+      return m.IsEnabled(m.indexedChildren[aItem]);
+    }, nearest);
+    if (kItem >= 0) {
+      result = m.children[m.indexedChildren[kItem]];
+    }
+    // Unbounded children can not be hit.
+  } else {
+    m.ForEachEnabled([this, &aOrigin, &aDirection, &nearest, &result](const uint32_t aChild) {
+      const NodePtr& kChild = m.children[aChild];
+      float distance = 0.0f;
+      const Bounds& kBounds = kChild->GetBounds();
+      if (!kBounds.IsInfinite() && kBounds.IntersectsRay(aOrigin, aDirection, distance) && (distance < nearest)) {
+        nearest = distance;
+        result = kChild;
+      }
+    });
+  }
+  if (result && aDistance) {
+    *aDistance = nearest;
+  }
+  return result;
 }
 
 bool
@@ -201,6 +603,22 @@ Group::Traverse(const GroupPtr& aParent, const Node::TraverseFunction& aTraverse
   return false;
 }
 
+void
+Group::ComputeBounds(Bounds& aBounds) const {
+  // Bounds of the Group are invalidated whenever a child moves.
+  m.spatialRefit = true;
+  for (const NodePtr& child: m.children) {
+    aBounds.Extend(child->GetBounds());
+  }
+}
+
+void
+Group::InvalidateWorldTransform() {
+  for (NodePtr& child: m.children) {
+    child->InvalidateWorldTransform();
+  }
+}
+
 Group::Group(State& aState, CreationContextPtr& aContext) : Node(aState, aContext), m(aState) {}
 Group::~Group() {
   for (NodePtr& child: m.children) {
@@ -0,0 +1,410 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/Impostor.h"
+#include "vrb/private/GroupState.h"
+#include "vrb/private/ResourceGLState.h"
+#include "vrb/private/UpdatableState.h"
+
+#include "vrb/Bounds.h"
+#include "vrb/CameraSimple.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/CullVisitor.h"
+#include "vrb/DrawableList.h"
+#include "vrb/FBO.h"
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/GLError.h"
+#include "vrb/Geometry.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/MemoryCounter.h"
+#include "vrb/OffscreenRenderScope.h"
+#include "vrb/OffscreenTexture.h"
+#include "vrb/ProgramFactory.h"
+#include "vrb/RenderContext.h"
+#include "vrb/RenderState.h"
+#include "vrb/Texture.h"
+#include "vrb/TraceProfiler.h"
+#include "vrb/VertexArray.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const int32_t kMaxAtlasSize = 4096;
+// Captures are taken from this many bounding radii away, close enough to
+// orthographic that the billboard matches the children at any distance.
+const float kCaptureDistance = 10.0f;
+
+}
+
+namespace vrb {
+
+namespace {
+
+// Scaled basis whose Z axis is aDirection, with X kept horizontal, placed at
+// aPosition. Used for the capture cameras and the billboard.
+Matrix
+FacingTransform(const Vector& aPosition, const Vector& aDirection, const float aScale) {
+  const Vector kUp = std::fabs(aDirection.y()) > 0.99f ? Vector(0.0f, 0.0f, -1.0f) : Vector(0.0f, 1.0f, 0.0f);
+  const Vector kX = kUp.Cross(aDirection).Normalize() * aScale;
+  const Vector kY = aDirection.Cross(kX);
+  const Vector kZ = aDirection * aScale;
+  return Matrix(
+      kX.x(), kX.y(), kX.z(), 0.0f,
+      kY.x(), kY.y(), kY.z(), 0.0f,
+      kZ.x(), kZ.y(), kZ.z(), 0.0f,
+      aPosition.x(), aPosition.y(), aPosition.z(), 1.0f);
+}
+
+} // namespace
+
+struct Impostor::State : public Group::State, public ResourceGL::State, public Updatable::State {
+  enum class Cell : uint8_t { Empty, Captured, Stale };
+  RenderContextWeak context;
+  GLDeletionQueuePtr glDeletions;
+  float threshold;
+  int32_t directions;
+  int32_t elevations;
+  int32_t cellSize;
+  int32_t budget;
+  std::vector<Cell> cells;
+  // Cells the last Cull looked for, captured by the next update.
+  std::vector<uint8_t> wanted;
+  bool anyWanted;
+  int32_t capturedCount;
+  uint32_t capturedRevision;
+  bool showing;
+  GLuint texture;
+  MemoryTracker textureMemory;
+  FBOPtr fbo;
+  OffscreenTexturePtr atlas;
+  GeometryPtr quad;
+  RenderStatePtr quadState;
+  CameraSimplePtr camera;
+  CullVisitorPtr visitor;
+  DrawableListPtr drawables;
+
+  State()
+      : threshold(0.1f)
+      , directions(8)
+      , elevations(3)
+      , cellSize(128)
+      , budget(2)
+      , anyWanted(false)
+      , capturedCount(0)
+      , capturedRevision(0)
+      , showing(false)
+      , texture(0)
+      , textureMemory(MemoryType::FramebufferAttachment)
+  {}
+
+  int32_t CellCount() const {
+    return directions * elevations;
+  }
+
+  void ResetCells() {
+    cells.assign((size_t)CellCount(), Cell::Empty);
+    wanted.assign((size_t)CellCount(), 0);
+    anyWanted = false;
+    capturedCount = 0;
+  }
+
+  // Columns around the vertical axis start at +Z, rows from below.
+  int32_t FindCell(const Vector& aDirection, const float aLength) const {
+    const float kFullTurn = 2.0f * PI_FLOAT;
+    float azimuth = std::atan2(aDirection.x(), aDirection.z());
+    if (azimuth < 0.0f) {
+      azimuth += kFullTurn;
+    }
+    const int32_t kColumn = (int32_t)std::lround(azimuth * directions / kFullTurn) % directions;
+    const float kElevation = std::asin(std::max(-1.0f, std::min(1.0f, aDirection.y() / aLength)));
+    const int32_t kRow = std::min(elevations - 1, (int32_t)((kElevation / PI_FLOAT + 0.5f) * elevations));
+    return std::max(kRow, 0) * directions + kColumn;
+  }
+
+  Vector CellDirection(const int32_t aCell) const {
+    const float kAzimuth = (aCell % directions) * 2.0f * PI_FLOAT / directions;
+    const float kElevation = (((aCell / directions) + 0.5f) / elevations - 0.5f) * PI_FLOAT;
+    return Vector(
+        std::sin(kAzimuth) * std::cos(kElevation),
+        std::sin(kElevation),
+        std::cos(kAzimuth) * std::cos(kElevation));
+  }
+
+  Matrix CellUVTransform(const int32_t aCell) const {
+    const float kWidth = 1.0f / directions;
+    const float kHeight = 1.0f / elevations;
+    return Matrix::FromTranslationScale(
+        Vector((aCell % directions) * kWidth, (aCell / directions) * kHeight, 0.0f),
+        Vector(kWidth, kHeight, 1.0f));
+  }
+
+  void Allocate() {
+    RenderContextPtr render = context.lock();
+    if (!render) {
+      return;
+    }
+    const GLsizei kWidth = directions * cellSize;
+    const GLsizei kHeight = elevations * cellSize;
+    VRB_GL_CHECK(glGenTextures(1, &texture));
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
+    VRB_GL_CHECK(glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, kWidth, kHeight));
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+    textureMemory.Set((size_t)kWidth * kHeight * 4);
+    atlas->SetTextureHandle(texture);
+    atlas->SetTextureParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    atlas->SetTextureParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    fbo = FBO::Create(render);
+    fbo->SetTextureHandle(texture, kWidth, kHeight);
+    if (!fbo->IsValid()) {
+      VRB_ERROR("Impostor failed to create a %dx%d atlas", kWidth, kHeight);
+      Release();
+      return;
+    }
+    ResetCells();
+  }
+
+  void Release() {
+    fbo = nullptr;
+    glDeletions->DeleteTexture(texture);
+    texture = 0;
+    textureMemory.Set(0);
+    if (atlas) {
+      atlas->SetTextureHandle(0);
+    }
+    ResetCells();
+  }
+
+  // Culls the children as seen from aCell and draws them into its viewport.
+  void Capture(Impostor& aImpostor, const int32_t aCell, const Vector& aCenter, const float aRadius) {
+    const float kDistance = aRadius * kCaptureDistance;
+    const float kFieldOfView = 2.0f * std::asin(1.0f / kCaptureDistance) * ToDegrees;
+    const Vector kDirection = CellDirection(aCell);
+    camera->SetViewport(cellSize, cellSize);
+    camera->SetFieldOfView(kFieldOfView, kFieldOfView);
+    camera->SetClipRange((kDistance - aRadius) * 0.99f, (kDistance + aRadius) * 1.01f);
+    camera->SetTransform(FacingTransform(aCenter + (kDirection * kDistance), kDirection, 1.0f));
+    visitor->Reset();
+    visitor->SetFrustum(camera->GetFrustum());
+    visitor->SetCamera(*camera);
+    drawables->Reset();
+    aImpostor.CullChildren(*visitor, *drawables);
+
+    const GLint kX = (aCell % directions) * cellSize;
+    const GLint kY = (aCell / directions) * cellSize;
+    VRB_GL_CHECK(glViewport(kX, kY, cellSize, cellSize));
+    VRB_GL_CHECK(glScissor(kX, kY, cellSize, cellSize));
+    VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    drawables->Draw(*camera);
+    drawables->Reset();
+    if (cells[aCell] == Cell::Empty) {
+      capturedCount++;
+    }
+    cells[aCell] = Cell::Captured;
+  }
+};
+
+ImpostorPtr
+Impostor::Create(RenderContextPtr& aContext) {
+  ImpostorPtr result = std::make_shared<ConcreteClass<Impostor, Impostor::State> >(aContext);
+  result->m.self = result;
+  return result;
+}
+
+// Node interface
+void
+Impostor::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  VRB_TRACE_ZONE("Impostor::Cull");
+  const Bounds& kBounds = GetBounds();
+  if (!aVisitor.IsVisible(kBounds)) {
+    return;
+  }
+  m.showing = false;
+  Vector eye;
+  if (m.texture && !kBounds.IsEmpty() && !kBounds.IsInfinite() && aVisitor.GetEye(eye) &&
+      (aVisitor.GetScreenCoverage(kBounds) < m.threshold)) {
+    const Matrix& kTransform = aVisitor.GetTransform();
+    const Matrix kInverse = kTransform.IsAffine() ? kTransform.AfineInverse() : kTransform.Inverse();
+    const Vector kCenter = kBounds.Center();
+    const Vector kDirection = kInverse.MultiplyPosition(eye) - kCenter;
+    const float kLength = kDirection.Magnitude();
+    if (kLength > 0.0f) {
+      const int32_t kCell = m.FindCell(kDirection, kLength);
+      m.wanted[kCell] = 1;
+      m.anyWanted = true;
+      if (m.cells[kCell] != State::Cell::Empty) {
+        // The capture frustum is slightly wider than the bounding sphere.
+        const float kRadius = kBounds.Extents().Magnitude();
+        const float kHalfSize = kRadius / std::sqrt(1.0f - 1.0f / (kCaptureDistance * kCaptureDistance));
+        m.quadState->SetUVTransform(m.CellUVTransform(kCell));
+        aVisitor.PushAffineTransform(FacingTransform(kCenter, kDirection / kLength, kHalfSize));
+        m.quad->Cull(aVisitor, aDrawables);
+        aVisitor.PopTransform();
+        m.showing = true;
+        return;
+      }
+    }
+  }
+  CullChildren(aVisitor, aDrawables);
+}
+
+void
+Impostor::Flatten(SceneSnapshot& aSnapshot) {
+  // The billboard or the children are picked on every Cull.
+  Node::Flatten(aSnapshot);
+}
+
+// Impostor interface
+void
+Impostor::SetCoverageThreshold(const float aCoverage) {
+  m.threshold = aCoverage;
+}
+
+float
+Impostor::GetCoverageThreshold() const {
+  return m.threshold;
+}
+
+void
+Impostor::SetAtlasLayout(const int32_t aDirections, const int32_t aElevations, const int32_t aCellSize) {
+  if ((aDirections < 1) || (aElevations < 1) || (aCellSize < 1)) {
+    VRB_ERROR("Impostor::SetAtlasLayout invalid layout: %d, %d, %d", aDirections, aElevations, aCellSize);
+    return;
+  }
+  const int32_t kMaxCellSize = kMaxAtlasSize / std::max(aDirections, aElevations);
+  if (kMaxCellSize < 1) {
+    VRB_ERROR("Impostor::SetAtlasLayout too many cells: %d, %d", aDirections, aElevations);
+    return;
+  }
+  m.directions = aDirections;
+  m.elevations = aElevations;
+  m.cellSize = std::min(aCellSize, kMaxCellSize);
+  if (m.texture) {
+    m.Release();
+    m.Allocate();
+  } else {
+    m.ResetCells();
+  }
+}
+
+void
+Impostor::SetCaptureBudget(const int32_t aCells) {
+  m.budget = std::max(aCells, 1);
+}
+
+void
+Impostor::Invalidate() {
+  for (State::Cell& cell: m.cells) {
+    if (cell == State::Cell::Captured) {
+      cell = State::Cell::Stale;
+    }
+  }
+}
+
+int32_t
+Impostor::GetCapturedCount() const {
+  return m.capturedCount;
+}
+
+bool
+Impostor::IsShowingImpostor() const {
+  return m.showing;
+}
+
+Impostor::Impostor(State& aState, RenderContextPtr& aContext)
+    : Group(aState, aContext->GetRenderThreadCreationContext())
+    , ResourceGL(aState, aContext->GetRenderThreadCreationContext())
+    , Updatable(aState, aContext->GetRenderThreadCreationContext())
+    , m(aState) {
+  CreationContextPtr& create = aContext->GetRenderThreadCreationContext();
+  m.context = aContext;
+  m.glDeletions = aContext->GetGLDeletionQueue();
+  m.ResetCells();
+  m.atlas = OffscreenTexture::Create(create);
+  m.atlas->SetName("Impostor atlas");
+  m.camera = CameraSimple::Create(create);
+  m.visitor = CullVisitor::Create(create);
+  m.drawables = DrawableList::Create(create);
+
+  VertexArrayPtr array = VertexArray::Create(create);
+  const float kCorners[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+  for (const auto& corner: kCorners) {
+    array->AppendVertex(Vector(corner[0], corner[1], 0.0f));
+    array->AppendUV(Vector((corner[0] + 1.0f) * 0.5f, (corner[1] + 1.0f) * 0.5f, 0.0f));
+  }
+  array->AppendNormal(Vector(0.0f, 0.0f, 1.0f));
+  ProgramPtr program = aContext->GetProgramFactory()->CreateProgram(create, FeatureTexture | FeatureUVTransform);
+  m.quadState = RenderState::Create(create);
+  m.quadState->SetProgram(program);
+  m.quadState->SetTexture(m.atlas);
+  m.quadState->SetLightsEnabled(false);
+  // Cells are cleared to transparent around the captured children.
+  m.quadState->SetTransparent(true);
+  m.quad = Geometry::Create(create);
+  m.quad->SetVertexArray(array);
+  m.quad->SetRenderState(m.quadState);
+  m.quad->AddFace({1, 2, 3, 4}, {1, 2, 3, 4}, {1, 1, 1, 1});
+}
+
+Impostor::~Impostor() {
+  m.Release();
+}
+
+// ResourceGL interface
+void
+Impostor::InitializeGL() {
+  m.Allocate();
+}
+
+void
+Impostor::ShutdownGL() {
+  m.Release();
+}
+
+// Updatable interface
+void
+Impostor::UpdateResource(RenderContext& aContext) {
+  if (GetRevision() != m.capturedRevision) {
+    Invalidate();
+    m.capturedRevision = GetRevision();
+  }
+  if (!m.texture || !m.anyWanted) {
+    return;
+  }
+  VRB_TRACE_ZONE("Impostor::Capture");
+  // Cells never captured come first, the stale ones keep being shown.
+  std::vector<int32_t> picked;
+  for (const State::Cell kPass: {State::Cell::Empty, State::Cell::Stale}) {
+    for (int32_t ix = 0; (ix < m.CellCount()) && ((int32_t)picked.size() < m.budget); ix++) {
+      if (m.wanted[ix] && (m.cells[ix] == kPass)) {
+        picked.push_back(ix);
+      }
+    }
+  }
+  std::fill(m.wanted.begin(), m.wanted.end(), 0);
+  m.anyWanted = false;
+  const Bounds& kBounds = GetBounds();
+  if (picked.empty() || kBounds.IsEmpty() || kBounds.IsInfinite()) {
+    return;
+  }
+
+  const Vector kCenter = kBounds.Center();
+  const float kRadius = kBounds.Extents().Magnitude();
+  {
+    OffscreenRenderScope scope(aContext, *m.fbo);
+    // Each capture is limited to its cell of the atlas.
+    VRB_GL_CHECK(glEnable(GL_SCISSOR_TEST));
+    for (const int32_t kCell: picked) {
+      m.Capture(*this, kCell, kCenter, kRadius);
+    }
+  }
+  // Culling the children may update their state, see Group::CullChildren().
+  m.capturedRevision = GetRevision();
+}
+
+} // namespace vrb
@@ -0,0 +1,333 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/InstanceCuller.h"
+#include "vrb/private/ResourceGLState.h"
+
+#include "vrb/Bounds.h"
+#include "vrb/Camera.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/Frustum.h"
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/GLError.h"
+#include "vrb/GLExtensions.h"
+#include "vrb/GLStats.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/NodeProfiler.h"
+#include "vrb/RenderBuffer.h"
+#include "vrb/RenderState.h"
+#include "vrb/ShaderUtil.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+const GLuint kGroupSize = 64;
+
+const char* sComputeShader = R"SHADER(
+#version 310 es
+layout(local_size_x = 64) in;
+struct Instance {
+  mat4 model;
+  // Bounding sphere relative to the drawable.
+  vec4 sphere;
+};
+layout(std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+layout(std430, binding = 1) writeonly buffer Visible { mat4 visible[]; };
+layout(std430, binding = 2) buffer Command {
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  uint baseVertex;
+  uint reserved;
+};
+uniform mat4 u_model;
+uniform vec4 u_planes[6];
+uniform float u_scale;
+uniform uint u_instanceCount;
+void main() {
+  uint index = gl_GlobalInvocationID.x;
+  if (index >= u_instanceCount) {
+    return;
+  }
+  vec4 sphere = instances[index].sphere;
+  vec3 center = (u_model * vec4(sphere.xyz, 1.0)).xyz;
+  float radius = sphere.w * u_scale;
+  for (int ix = 0; ix < 6; ix++) {
+    if (dot(u_planes[ix].xyz, center) + u_planes[ix].w < -radius) {
+      return;
+    }
+  }
+  visible[atomicAdd(instanceCount, 1u)] = u_model * instances[index].model;
+}
+)SHADER";
+
+// Floats per instance in the storage buffer, a mat4 and a vec4.
+const size_t kInstanceFloats = 20;
+const size_t kMatrixBytes = sizeof(float) * 16;
+
+// Matches DrawElementsIndirectCommand.
+struct DrawCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLuint baseVertex;
+  GLuint reserved;
+};
+
+}
+
+namespace vrb {
+
+struct InstanceCuller::State : public ResourceGL::State {
+  GLExtensionsPtr glExtensions;
+  GLDeletionQueuePtr glDeletions;
+  std::vector<Matrix> transforms;
+  // Bounds of each instance relative to the drawable.
+  std::vector<Bounds> instanceBounds;
+  Bounds bounds;
+  bool uploaded = false;
+  bool gpu = false;
+  GLuint program = 0;
+  GLint uModel = -1;
+  GLint uPlanes = -1;
+  GLint uScale = -1;
+  GLint uInstanceCount = -1;
+  // Instances read by the compute shader.
+  GLuint instanceBuffer = 0;
+  // Transforms of the visible instances.
+  GLuint visibleBuffer = 0;
+  GLuint commandBuffer = 0;
+  GLsizei indexCount = 0;
+  GLsizei visibleCount = 0;
+  std::vector<Matrix> visible;
+
+  void Upload();
+  void CullOnGPU(const Camera& aCamera, const Matrix& aModel);
+  void CullOnCPU(const Camera& aCamera, const Matrix& aModel);
+};
+
+void
+InstanceCuller::State::Upload() {
+  uploaded = true;
+  if (!gpu || transforms.empty()) {
+    return;
+  }
+  std::vector<float> data(transforms.size() * kInstanceFloats);
+  for (size_t ix = 0; ix < transforms.size(); ix++) {
+    float* instance = &data[ix * kInstanceFloats];
+    memcpy(instance, transforms[ix].Data(), kMatrixBytes);
+    const Vector center = instanceBounds[ix].Center();
+    instance[16] = center.x();
+    instance[17] = center.y();
+    instance[18] = center.z();
+    instance[19] = instanceBounds[ix].Extents().Magnitude();
+  }
+  if (!instanceBuffer) {
+    VRB_GL_CHECK(glGenBuffers(1, &instanceBuffer));
+  }
+  VRB_GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer));
+  VRB_GL_CHECK(glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(data.size() * sizeof(float)), data.data(), GL_STATIC_DRAW));
+  VRB_GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer));
+  VRB_GL_CHECK(glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(transforms.size() * kMatrixBytes), nullptr, GL_DYNAMIC_COPY));
+  VRB_GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+  VRB_GL_STATS_ADD(BufferUploadBytes, data.size() * sizeof(float));
+}
+
+void
+InstanceCuller::State::CullOnGPU(const Camera& aCamera, const Matrix& aModel) {
+  const Frustum& kFrustum = aCamera.GetFrustum();
+  float planes[6 * 4];
+  for (int32_t ix = 0; ix < 6; ix++) {
+    Vector normal;
+    kFrustum.GetPlane(ix, normal, planes[ix * 4 + 3]);
+    planes[ix * 4] = normal.x();
+    planes[ix * 4 + 1] = normal.y();
+    planes[ix * 4 + 2] = normal.z();
+  }
+  // Spheres grow with the largest axis scale of the drawable.
+  const float kScale = std::max(std::max(aModel.MultiplyDirection(Vector(1.0f, 0.0f, 0.0f)).Magnitude(),
+                                         aModel.MultiplyDirection(Vector(0.0f, 1.0f, 0.0f)).Magnitude()),
+                                aModel.MultiplyDirection(Vector(0.0f, 0.0f, 1.0f)).Magnitude());
+  const DrawCommand kCommand = {(GLuint)indexCount, 0, 0, 0, 0};
+  VRB_GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer));
+  VRB_GL_CHECK(glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(kCommand), &kCommand, GL_DYNAMIC_COPY));
+  VRB_GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+  const GLExtensions::Functions& gl = glExtensions->GetFunctions();
+  VRB_GL_CHECK(glUseProgram(program));
+  VRB_GL_CHECK(glUniformMatrix4fv(uModel, 1, GL_FALSE, aModel.Data()));
+  VRB_GL_CHECK(glUniform4fv(uPlanes, 6, planes));
+  VRB_GL_CHECK(glUniform1f(uScale, kScale));
+  VRB_GL_CHECK(glUniform1ui(uInstanceCount, (GLuint)transforms.size()));
+  VRB_GL_CHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer));
+  VRB_GL_CHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleBuffer));
+  VRB_GL_CHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer));
+  VRB_GL_CHECK(gl.glDispatchCompute(((GLuint)transforms.size() + kGroupSize - 1) / kGroupSize, 1, 1));
+  VRB_GL_CHECK(gl.glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT));
+  VRB_GL_CHECK(glUseProgram(0));
+  // The render states have to bind their program again.
+  RenderState::InvalidateBindings();
+}
+
+void
+InstanceCuller::State::CullOnCPU(const Camera& aCamera, const Matrix& aModel) {
+  const Frustum& kFrustum = aCamera.GetFrustum();
+  visible.clear();
+  for (size_t ix = 0; ix < transforms.size(); ix++) {
+    if (kFrustum.Intersects(instanceBounds[ix].Transform(aModel))) {
+      visible.push_back(aModel.PostMultiply(transforms[ix]));
+    }
+  }
+  visibleCount = (GLsizei)visible.size();
+  if (visibleCount == 0) {
+    return;
+  }
+  const size_t kBytes = visible.size() * kMatrixBytes;
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, visibleBuffer));
+  VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)kBytes, visible[0].Data(), GL_STREAM_DRAW));
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  VRB_GL_STATS_ADD(BufferUploadBytes, kBytes);
+}
+
+InstanceCullerPtr
+InstanceCuller::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<InstanceCuller, InstanceCuller::State> >(aContext);
+}
+
+void
+InstanceCuller::SetInstances(const std::vector<Matrix>& aTransforms, const Bounds& aBounds) {
+  m.transforms = aTransforms;
+  m.instanceBounds.clear();
+  m.instanceBounds.reserve(aTransforms.size());
+  m.bounds = Bounds::Empty();
+  for (const Matrix& transform: aTransforms) {
+    m.instanceBounds.push_back(aBounds.Transform(transform));
+    m.bounds.Extend(m.instanceBounds.back());
+  }
+  m.uploaded = false;
+}
+
+int32_t
+InstanceCuller::GetInstanceCount() const {
+  return (int32_t)m.transforms.size();
+}
+
+const Bounds&
+InstanceCuller::GetBounds() const {
+  return m.bounds;
+}
+
+bool
+InstanceCuller::IsGPUCulling() const {
+  return m.gpu;
+}
+
+bool
+InstanceCuller::Cull(const Camera& aCamera, const Matrix& aModel, const GLsizei aIndexCount) {
+  m.indexCount = aIndexCount;
+  m.visibleCount = 0;
+  if (m.transforms.empty() || !m.visibleBuffer) {
+    return false;
+  }
+  if (!m.uploaded) {
+    m.Upload();
+  }
+  if (m.gpu) {
+    m.CullOnGPU(aCamera, aModel);
+    return true;
+  }
+  m.CullOnCPU(aCamera, aModel);
+  return m.visibleCount > 0;
+}
+
+GLuint
+InstanceCuller::GetInstanceBuffer() const {
+  return m.visibleBuffer;
+}
+
+void
+InstanceCuller::Draw(const RenderBuffer& aBuffer) {
+  const GLenum kMode = aBuffer.PrimitiveType();
+  const GLenum kIndexType = aBuffer.IndexType();
+  if (m.gpu) {
+    // The visible count stays on the GPU.
+    VRB_GL_STATS_ADD(DrawCalls, 1);
+    NodeProfiler::AddDraws(1, 0);
+    VRB_GL_CHECK(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m.commandBuffer));
+    VRB_GL_CHECK(m.glExtensions->GetFunctions().glDrawElementsIndirect(kMode, kIndexType, nullptr));
+    VRB_GL_CHECK(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+    return;
+  }
+  if (m.visibleCount > 0) {
+    VRB_GL_STATS_ADD(DrawCalls, 1);
+    const uint64_t kTriangles = (uint64_t)aBuffer.TriangleCount(m.indexCount) * m.visibleCount;
+    VRB_GL_STATS_ADD(Triangles, kTriangles);
+    NodeProfiler::AddDraws(1, kTriangles);
+    VRB_GL_CHECK(glDrawElementsInstanced(kMode, m.indexCount, kIndexType, nullptr, m.visibleCount));
+  }
+}
+
+InstanceCuller::InstanceCuller(State& aState, CreationContextPtr& aContext)
+    : ResourceGL(aState, aContext)
+    , m(aState) {
+  m.glExtensions = aContext->GetGLExtensions();
+  m.glDeletions = aContext->GetGLDeletionQueue();
+}
+
+InstanceCuller::~InstanceCuller() {
+  if (m.glDeletions) {
+    m.glDeletions->DeleteProgram(m.program);
+    m.glDeletions->DeleteBuffer(m.instanceBuffer);
+    m.glDeletions->DeleteBuffer(m.visibleBuffer);
+    m.glDeletions->DeleteBuffer(m.commandBuffer);
+  }
+}
+
+// ResourceGL interface
+void
+InstanceCuller::InitializeGL() {
+  VRB_GL_CHECK(glGenBuffers(1, &m.visibleBuffer));
+  m.uploaded = false;
+  m.gpu = false;
+  if (!m.glExtensions || !m.glExtensions->IsExtensionSupported(GLExtensions::Ext::ARB_ES3_1_compatibility)) {
+    return;
+  }
+  GLuint shader = LoadShader(GL_COMPUTE_SHADER, sComputeShader);
+  if (shader) {
+    m.program = CreateComputeProgram(shader);
+    // Released with the program.
+    VRB_GL_CHECK(glDeleteShader(shader));
+  }
+  if (!m.program) {
+    VRB_ERROR("Failed to create instance culling program, instances are culled on the CPU");
+    return;
+  }
+  m.uModel = GetUniformLocation(m.program, "u_model");
+  m.uPlanes = GetUniformLocation(m.program, "u_planes");
+  m.uScale = GetUniformLocation(m.program, "u_scale");
+  m.uInstanceCount = GetUniformLocation(m.program, "u_instanceCount");
+  VRB_GL_CHECK(glGenBuffers(1, &m.commandBuffer));
+  m.gpu = true;
+}
+
+void
+InstanceCuller::ShutdownGL() {
+  if (m.program) {
+    VRB_GL_CHECK(glDeleteProgram(m.program));
+  }
+  GLuint buffers[] = {m.instanceBuffer, m.visibleBuffer, m.commandBuffer};
+  VRB_GL_CHECK(glDeleteBuffers(3, buffers));
+  m.program = 0;
+  m.instanceBuffer = m.visibleBuffer = m.commandBuffer = 0;
+  m.gpu = false;
+  m.uploaded = false;
+}
+
+} // namespace vrb
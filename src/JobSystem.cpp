@@ -0,0 +1,372 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/JobSystem.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/ConditionVariable.h"
+#include "vrb/Logger.h"
+#include "vrb/Mutex.h"
+#include "vrb/TraceProfiler.h"
+#if defined(ANDROID)
+#include "vrb/ThreadUtils.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <pthread.h>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/resource.h>
+#endif
+
+namespace vrb {
+
+struct JobSystem::Job {
+  Task task;
+  JobHandle parent;
+  // The job itself and each child that has not finished.
+  std::atomic<int32_t> unfinished;
+  std::atomic<bool> finished;
+  Job() : unfinished(1), finished(false) {}
+};
+
+struct JobSystem::State {
+  struct Queue {
+    Mutex lock;
+    std::deque<JobHandle> jobs;
+  };
+  struct Worker {
+    State* system;
+    int32_t index;
+    pthread_t thread;
+  };
+  // Set on worker threads so jobs they create go to their own queue.
+  static thread_local State* sCurrent;
+  static thread_local int32_t sWorker;
+
+  int32_t workerCount;
+  ThreadHook hook;
+  Mutex startLock;
+  std::atomic<bool> started;
+  std::vector<Worker> workers;
+  // One queue per worker and a last one shared by every other thread.
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::atomic<int32_t> queued;
+  // Threads blocked on lock, waiting for a job to be queued or to finish.
+  std::atomic<int32_t> sleeping;
+  ConditionVariable lock;
+  bool done;
+
+  State()
+      : workerCount(std::max(0, (int32_t)std::thread::hardware_concurrency() - 1))
+      , started(false)
+      , queued(0)
+      , sleeping(0)
+      , done(false)
+  {}
+  static void* Run(void* aData);
+  void Start();
+  void Stop();
+  int32_t CurrentWorker() const { return sCurrent == this ? sWorker : -1; }
+  JobHandle Take(const int32_t aWorker);
+  bool RunNext(const int32_t aWorker);
+  void Finish(const JobHandle& aJob);
+  void Notify();
+};
+
+thread_local JobSystem::State* JobSystem::State::sCurrent = nullptr;
+thread_local int32_t JobSystem::State::sWorker = -1;
+
+void*
+JobSystem::State::Run(void* aData) {
+  Worker& worker = *static_cast<Worker*>(aData);
+  State& self = *worker.system;
+  sCurrent = &self;
+  sWorker = worker.index;
+#if defined(ANDROID)
+  SetThreadName("VRB Worker");
+#endif
+  if (self.hook) {
+    self.hook(worker.index);
+  }
+  while (true) {
+    if (self.RunNext(worker.index)) {
+      continue;
+    }
+    MutexAutoLock guard(self.lock);
+    self.sleeping++;
+    while (!self.done && (self.queued.load() == 0)) {
+      self.lock.Wait();
+    }
+    self.sleeping--;
+    if (self.done && (self.queued.load() == 0)) {
+      break;
+    }
+  }
+  sCurrent = nullptr;
+  return nullptr;
+}
+
+void
+JobSystem::State::Start() {
+  if (started.load()) {
+    return;
+  }
+  MutexAutoLock guard(startLock);
+  if (started.load()) {
+    return;
+  }
+  queues.clear();
+  for (int32_t ix = 0; ix <= workerCount; ix++) {
+    queues.emplace_back(new Queue);
+  }
+  done = false;
+  // Resized once, the threads keep pointers to their Worker.
+  workers.resize((size_t)workerCount);
+  int32_t created = 0;
+  for (Worker& worker: workers) {
+    worker.system = this;
+    worker.index = created;
+    if (pthread_create(&worker.thread, nullptr, &State::Run, &worker) != 0) {
+      VRB_ERROR("JobSystem failed to start worker thread %d", (int)created);
+      break;
+    }
+    created++;
+  }
+  // Queues of workers that failed to start are still drained by stealing.
+  workers.resize((size_t)created);
+  started.store(true);
+}
+
+void
+JobSystem::State::Stop() {
+  MutexAutoLock guard(startLock);
+  if (!started.load()) {
+    return;
+  }
+  {
+    MutexAutoLock sleepGuard(lock);
+    done = true;
+    lock.Broadcast();
+  }
+  for (Worker& worker: workers) {
+    if (pthread_join(worker.thread, nullptr) != 0) {
+      VRB_ERROR("JobSystem failed to join worker thread %d", (int)worker.index);
+    }
+  }
+  workers.clear();
+  // Without workers the remaining jobs run here.
+  while (RunNext(-1)) {}
+  started.store(false);
+}
+
+JobSystem::JobHandle
+JobSystem::State::Take(const int32_t aWorker) {
+  const int32_t kCount = (int32_t)queues.size();
+  if (kCount == 0) {
+    return nullptr;
+  }
+  if (aWorker >= 0) {
+    Queue& own = *queues[aWorker];
+    MutexAutoLock guard(own.lock);
+    if (!own.jobs.empty()) {
+      JobHandle job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      queued--;
+      return job;
+    }
+  }
+  // Steal the oldest job, starting with the shared queue.
+  const int32_t kWorkerQueues = kCount - 1;
+  for (int32_t offset = 0; offset < kCount; offset++) {
+    const int32_t kIndex = offset == 0 ? kWorkerQueues : (aWorker + offset + kWorkerQueues) % kWorkerQueues;
+    if (kIndex == aWorker) {
+      continue;
+    }
+    Queue& queue = *queues[kIndex];
+    MutexAutoLock guard(queue.lock);
+    if (!queue.jobs.empty()) {
+      JobHandle job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+      queued--;
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+bool
+JobSystem::State::RunNext(const int32_t aWorker) {
+  JobHandle job = Take(aWorker);
+  if (!job) {
+    return false;
+  }
+  if (job->task) {
+    job->task();
+    // Releases whatever the task captured before the job is reported finished.
+    job->task = nullptr;
+  }
+  Finish(job);
+  return true;
+}
+
+void
+JobSystem::State::Finish(const JobHandle& aJob) {
+  if (aJob->unfinished.fetch_sub(1) != 1) {
+    return;
+  }
+  JobHandle parent = std::move(aJob->parent);
+  aJob->finished.store(true);
+  Notify();
+  if (parent) {
+    Finish(parent);
+  }
+}
+
+void
+JobSystem::State::Notify() {
+  // Sleepers count themselves before checking for work, under lock, so
+  // skipping the lock when nobody sleeps does not lose a wake up.
+  if (sleeping.load() > 0) {
+    MutexAutoLock guard(lock);
+    lock.Broadcast();
+  }
+}
+
+JobSystemPtr
+JobSystem::Create() {
+  return std::make_shared<ConcreteClass<JobSystem, JobSystem::State> >();
+}
+
+void
+JobSystem::SetWorkerCount(const int32_t aCount) {
+  if (m.started.load()) {
+    VRB_WARN("JobSystem worker count must be set before the first job is run");
+    return;
+  }
+  m.workerCount = aCount > 0 ? aCount : std::max(0, (int32_t)std::thread::hardware_concurrency() - 1);
+}
+
+int32_t
+JobSystem::GetWorkerCount() const {
+  return m.workerCount;
+}
+
+void
+JobSystem::SetThreadHook(const ThreadHook& aHook) {
+  if (m.started.load()) {
+    VRB_WARN("JobSystem thread hook must be set before the first job is run");
+    return;
+  }
+  m.hook = aHook;
+}
+
+JobSystem::JobHandle
+JobSystem::Create(Task&& aTask, const JobHandle& aParent) {
+  JobHandle job = std::make_shared<Job>();
+  job->task = std::move(aTask);
+  if (aParent) {
+    if (aParent->finished.load()) {
+      VRB_ERROR("JobSystem job created with a parent that already finished");
+    } else {
+      aParent->unfinished++;
+      job->parent = aParent;
+    }
+  }
+  return job;
+}
+
+void
+JobSystem::Run(const JobHandle& aJob) {
+  if (!aJob) {
+    return;
+  }
+  m.Start();
+  const int32_t kWorker = m.CurrentWorker();
+  State::Queue& queue = kWorker >= 0 ? *m.queues[kWorker] : *m.queues.back();
+  {
+    MutexAutoLock guard(queue.lock);
+    queue.jobs.push_back(aJob);
+  }
+  m.queued++;
+  m.Notify();
+}
+
+JobSystem::JobHandle
+JobSystem::Schedule(Task&& aTask, const JobHandle& aParent) {
+  JobHandle job = Create(std::move(aTask), aParent);
+  Run(job);
+  return job;
+}
+
+void
+JobSystem::Wait(const JobHandle& aJob) {
+  if (!aJob) {
+    return;
+  }
+  VRB_TRACE_ZONE("JobSystem::Wait");
+  m.Start();
+  const int32_t kWorker = m.CurrentWorker();
+  while (!aJob->finished.load()) {
+    if (m.RunNext(kWorker)) {
+      continue;
+    }
+    MutexAutoLock guard(m.lock);
+    m.sleeping++;
+    while (!aJob->finished.load() && (m.queued.load() == 0)) {
+      m.lock.Wait();
+    }
+    m.sleeping--;
+  }
+}
+
+bool
+JobSystem::IsFinished(const JobHandle& aJob) const {
+  return !aJob || aJob->finished.load();
+}
+
+void
+JobSystem::Shutdown() {
+  m.Stop();
+}
+
+bool
+JobSystem::SetThreadAffinity(const uint64_t aCPUMask) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu = 0; (cpu < 64) && (cpu < CPU_SETSIZE); cpu++) {
+    if (aCPUMask & (1ull << cpu)) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  // Zero is the calling thread.
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+bool
+JobSystem::SetThreadNiceness(const int32_t aNiceness) {
+#if defined(__linux__)
+  // Linux applies the niceness of PRIO_PROCESS 0 to the calling thread only.
+  return setpriority(PRIO_PROCESS, 0, aNiceness) == 0;
+#else
+  return false;
+#endif
+}
+
+JobSystem::JobSystem(State& aState) : m(aState) {}
+
+JobSystem::~JobSystem() {
+  m.Stop();
+}
+
+} // namespace vrb
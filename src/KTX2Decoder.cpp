@@ -0,0 +1,283 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/KTX2Decoder.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/FileReader.h"
+#include "vrb/GLExtensions.h"
+#include "vrb/JobSystem.h"
+#include "vrb/Logger.h"
+#include "vrb/Mutex.h"
+#include "vrb/TextureFormat.h"
+#include "vrb/private/LittleEndian.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const uint8_t kIdentifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+// Header fields after the identifier followed by the level index.
+const size_t kHeaderSize = 80;
+const size_t kLevelIndexEntrySize = 24;
+
+const uint32_t kSupercompressionNone = 0;
+const uint32_t kSupercompressionBasisLZ = 1;
+const uint8_t kColorModelUASTC = 166;
+
+const uint32_t VK_FORMAT_R8G8B8A8_UNORM = 37;
+const uint32_t VK_FORMAT_R8G8B8A8_SRGB = 43;
+const uint32_t VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK = 147;
+const uint32_t VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK = 152;
+const uint32_t VK_FORMAT_ASTC_4x4_UNORM_BLOCK = 157;
+const uint32_t VK_FORMAT_ASTC_12x12_SRGB_BLOCK = 184;
+
+bool
+InRange(const uint64_t aOffset, const uint64_t aLength, const size_t aSize) {
+  return (aOffset <= aSize) && (aLength <= aSize - aOffset);
+}
+
+// GL format of the levels that are uploaded as stored, zero when unknown.
+GLenum
+GLFormat(const uint32_t aVkFormat) {
+  if ((aVkFormat == VK_FORMAT_R8G8B8A8_UNORM) || (aVkFormat == VK_FORMAT_R8G8B8A8_SRGB)) {
+    return GL_RGBA;
+  }
+  // The ETC2 RGB, RGB A1 and RGBA formats follow the same order in both APIs.
+  if ((aVkFormat >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK) && (aVkFormat <= VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK)) {
+    return GL_COMPRESSED_RGB8_ETC2 + (aVkFormat - VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK);
+  }
+  // Vulkan interleaves the UNORM and SRGB block sizes, GL has two ranges.
+  if ((aVkFormat >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK) && (aVkFormat <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK)) {
+    const uint32_t kIndex = aVkFormat - VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+    return ((kIndex & 1) ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR : GL_COMPRESSED_RGBA_ASTC_4x4_KHR) + (kIndex >> 1);
+  }
+  return 0;
+}
+
+bool
+Parse(const uint8_t* aData, const size_t aSize, vrb::KTX2Decoder::Image& aImage, std::string& aError) {
+  if (!vrb::KTX2Decoder::IsKTX2((const char*)aData, aSize) || (aSize < kHeaderSize)) {
+    aError = "Not a KTX2 file";
+    return false;
+  }
+  aImage.vkFormat = vrb::ReadLittleEndian32(aData + 12);
+  aImage.width = vrb::ReadLittleEndian32(aData + 20);
+  aImage.height = vrb::ReadLittleEndian32(aData + 24);
+  const uint32_t kDepth = vrb::ReadLittleEndian32(aData + 28);
+  const uint32_t kLayerCount = vrb::ReadLittleEndian32(aData + 32);
+  aImage.faceCount = vrb::ReadLittleEndian32(aData + 36);
+  // Zero asks the loader to generate the mip chain, only the base is stored.
+  const uint32_t kLevelCount = std::max(vrb::ReadLittleEndian32(aData + 40), 1u);
+  aImage.supercompression = vrb::ReadLittleEndian32(aData + 44);
+  if ((aImage.width == 0) || (aImage.height == 0) || (kDepth > 1) || (kLayerCount > 1)) {
+    aError = "Only 2D and cube map KTX2 textures are supported";
+    return false;
+  }
+  if ((aImage.faceCount != 1) && (aImage.faceCount != 6)) {
+    aError = "Invalid KTX2 face count";
+    return false;
+  }
+  if ((aImage.width > (uint32_t)std::numeric_limits<int>::max()) ||
+      (aImage.height > (uint32_t)std::numeric_limits<int>::max())) {
+    aError = "KTX2 texture is too large";
+    return false;
+  }
+  if (kLevelCount > vrb::GetMipLevelCount(aImage.width, aImage.height)) {
+    aError = "Invalid KTX2 level count";
+    return false;
+  }
+  const uint32_t kDFDOffset = vrb::ReadLittleEndian32(aData + 48);
+  aImage.dfdLength = vrb::ReadLittleEndian32(aData + 52);
+  const uint64_t kSGDOffset = vrb::ReadLittleEndian64(aData + 64);
+  aImage.sgdLength = vrb::ReadLittleEndian64(aData + 72);
+  if (!InRange(kDFDOffset, aImage.dfdLength, aSize) || !InRange(kSGDOffset, aImage.sgdLength, aSize) ||
+      !InRange(kHeaderSize, (uint64_t)kLevelCount * kLevelIndexEntrySize, aSize)) {
+    aError = "Truncated KTX2 file";
+    return false;
+  }
+  aImage.dfd = aImage.dfdLength ? aData + kDFDOffset : nullptr;
+  aImage.sgd = aImage.sgdLength ? aData + kSGDOffset : nullptr;
+  aImage.levels.clear();
+  for (uint32_t ix = 0; ix < kLevelCount; ix++) {
+    const uint8_t* entry = aData + kHeaderSize + (ix * kLevelIndexEntrySize);
+    const uint64_t kOffset = vrb::ReadLittleEndian64(entry);
+    vrb::KTX2Decoder::Level level;
+    level.length = vrb::ReadLittleEndian64(entry + 8);
+    level.uncompressedLength = vrb::ReadLittleEndian64(entry + 16);
+    if (!InRange(kOffset, level.length, aSize)) {
+      aError = "Truncated KTX2 level";
+      return false;
+    }
+    level.data = aData + kOffset;
+    aImage.levels.push_back(level);
+  }
+  return true;
+}
+
+} // namespace
+
+namespace vrb {
+
+struct KTX2Decoder::State {
+  JobSystemPtr jobs;
+  std::atomic<int> target;
+  Mutex lock;
+  TextureTranscoderPtr transcoder;
+  State() : target((int)Target::RGBA8) {}
+
+  TextureTranscoderPtr getTranscoder() {
+    MutexAutoLock autoLock(lock);
+    return transcoder;
+  }
+
+  // Copies each face of each level out of the file data.
+  bool copyLevels(const Image& aImage, std::vector<ImageLevel>& aLevels, std::string& aError) {
+    const GLenum kFormat = GLFormat(aImage.vkFormat);
+    if (kFormat == 0) {
+      aError = "Unsupported KTX2 vkFormat " + std::to_string(aImage.vkFormat);
+      return false;
+    }
+    if (aImage.supercompression != kSupercompressionNone) {
+      aError = "Unsupported KTX2 supercompression scheme " + std::to_string(aImage.supercompression);
+      return false;
+    }
+    for (uint32_t face = 0; face < aImage.faceCount; face++) {
+      for (uint32_t ix = 0; ix < aImage.levels.size(); ix++) {
+        const Level& source = aImage.levels[ix];
+        const uint64_t kFaceLength = source.length / aImage.faceCount;
+        ImageLevel level;
+        level.target = aImage.faceCount == 6 ? (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) : (GLenum)GL_TEXTURE_2D;
+        level.level = (int)ix;
+        level.width = (int)std::max(aImage.width >> ix, 1u);
+        level.height = (int)std::max(aImage.height >> ix, 1u);
+        level.format = kFormat;
+        level.length = kFaceLength;
+        level.data = std::make_unique<uint8_t[]>((size_t)kFaceLength);
+        memcpy(level.data.get(), source.data + (face * kFaceLength), (size_t)kFaceLength);
+        aLevels.push_back(std::move(level));
+      }
+    }
+    return true;
+  }
+
+  bool transcodeLevels(const Image& aImage, std::vector<ImageLevel>& aLevels, std::string& aError) {
+    TextureTranscoderPtr kTranscoder = getTranscoder();
+    if (!kTranscoder) {
+      aError = "No TextureTranscoder for Basis Universal KTX2 file";
+      return false;
+    }
+    const Target kTarget = (Target)target.load();
+    const size_t kFirst = aLevels.size();
+    const uint32_t kLevelCount = (uint32_t)aImage.levels.size();
+    aLevels.resize(kFirst + (aImage.faceCount * kLevelCount));
+    std::atomic<bool> failed(false);
+    JobSystem::JobHandle pass = jobs ? jobs->Create(nullptr) : nullptr;
+    for (uint32_t face = 0; face < aImage.faceCount; face++) {
+      for (uint32_t ix = 0; ix < kLevelCount; ix++) {
+        ImageLevel* result = &aLevels[kFirst + (face * kLevelCount) + ix];
+        result->target = aImage.faceCount == 6 ? (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) : (GLenum)GL_TEXTURE_2D;
+        result->level = (int)ix;
+        JobSystem::Task task = [&aImage, &kTranscoder, &failed, kTarget, face, ix, result]() {
+          if (!kTranscoder->Transcode(aImage, ix, face, kTarget, *result) || !result->data) {
+            failed = true;
+          }
+        };
+        if (pass) {
+          jobs->Schedule(std::move(task), pass);
+        } else {
+          task();
+        }
+      }
+    }
+    if (pass) {
+      jobs->Run(pass);
+      jobs->Wait(pass);
+    }
+    if (failed) {
+      aLevels.resize(kFirst);
+      aError = "Failed to transcode Basis Universal KTX2 file";
+      return false;
+    }
+    return true;
+  }
+};
+
+bool
+KTX2Decoder::Image::IsBasis() const {
+  if (vkFormat != 0) {
+    return false;
+  }
+  if (supercompression == kSupercompressionBasisLZ) {
+    return true;
+  }
+  // UASTC, optionally Zstandard compressed, is identified by the color
+  // model of the basic data format descriptor block.
+  return dfd && (dfdLength > 12) && (dfd[12] == kColorModelUASTC);
+}
+
+KTX2DecoderPtr
+KTX2Decoder::Create() {
+  return std::make_shared<ConcreteClass<KTX2Decoder, KTX2Decoder::State> >();
+}
+
+bool
+KTX2Decoder::IsKTX2(const char* aData, const size_t aSize) {
+  return aData && (aSize >= sizeof(kIdentifier)) && (memcmp(aData, kIdentifier, sizeof(kIdentifier)) == 0);
+}
+
+KTX2Decoder::Target
+KTX2Decoder::SelectTarget(const GLExtensions& aExtensions) {
+  if (aExtensions.IsExtensionSupported(GLExtensions::Ext::KHR_texture_compression_astc_ldr) ||
+      aExtensions.IsCompressedFormatSupported(GL_COMPRESSED_RGBA_ASTC_4x4_KHR)) {
+    return Target::ASTC_4x4;
+  }
+  if (aExtensions.IsExtensionSupported(GLExtensions::Ext::ARB_ES3_compatibility) ||
+      aExtensions.IsCompressedFormatSupported(GL_COMPRESSED_RGBA8_ETC2_EAC)) {
+    return Target::ETC2;
+  }
+  return Target::RGBA8;
+}
+
+void
+KTX2Decoder::SetJobSystem(const JobSystemPtr& aJobSystem) {
+  m.jobs = aJobSystem;
+}
+
+void
+KTX2Decoder::SetTarget(const Target aTarget) {
+  m.target = (int)aTarget;
+}
+
+KTX2Decoder::Target
+KTX2Decoder::GetTarget() const {
+  return (Target)m.target.load();
+}
+
+void
+KTX2Decoder::SetTranscoder(const TextureTranscoderPtr& aTranscoder) {
+  MutexAutoLock lock(m.lock);
+  m.transcoder = aTranscoder;
+}
+
+bool
+KTX2Decoder::Decode(const char* aData, const size_t aSize, std::vector<ImageLevel>& aLevels, std::string& aError) {
+  Image image;
+  if (!Parse((const uint8_t*)aData, aSize, image, aError)) {
+    return false;
+  }
+  if (image.IsBasis()) {
+    return m.transcodeLevels(image, aLevels, aError);
+  }
+  return m.copyLevels(image, aLevels, aError);
+}
+
+KTX2Decoder::KTX2Decoder(State& aState) : m(aState) {}
+KTX2Decoder::~KTX2Decoder() {}
+
+} // namespace vrb
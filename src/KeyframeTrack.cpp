@@ -0,0 +1,148 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/KeyframeTrack.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/Quaternion.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace vrb {
+
+struct KeyframeTrack::State {
+  Target target = Target::Translation;
+  // Floats per key, four for rotations and three otherwise.
+  uint32_t stride = 3;
+  std::vector<float> times;
+  std::vector<float> values;
+
+  bool CanAdd(const float aTime, const uint32_t aStride) const;
+  uint32_t Find(const float aTime, const uint32_t aCursor) const;
+  Matrix ToMatrix(const float* aValue) const;
+};
+
+bool
+KeyframeTrack::State::CanAdd(const float aTime, const uint32_t aStride) const {
+  if (aStride != stride) {
+    VRB_ERROR("KeyframeTrack key does not match the track target");
+    return false;
+  }
+  if (!times.empty() && (aTime < times.back())) {
+    VRB_ERROR("KeyframeTrack keys must be added in time order");
+    return false;
+  }
+  return true;
+}
+
+uint32_t
+KeyframeTrack::State::Find(const float aTime, const uint32_t aCursor) const {
+  // Key at or before aTime, with aTime clamped by the caller.
+  const uint32_t kLast = (uint32_t)times.size() - 1;
+  if (aCursor < kLast) {
+    if ((times[aCursor] <= aTime) && (aTime < times[aCursor + 1])) {
+      return aCursor;
+    }
+    // Playback moved on to the next key.
+    const uint32_t kNext = aCursor + 1;
+    if ((times[kNext] <= aTime) && ((kNext == kLast) || (aTime < times[kNext + 1]))) {
+      return kNext;
+    }
+  }
+  const auto kFound = std::upper_bound(times.begin(), times.end(), aTime);
+  return kFound == times.begin() ? 0 : (uint32_t)(kFound - times.begin()) - 1;
+}
+
+Matrix
+KeyframeTrack::State::ToMatrix(const float* aValue) const {
+  if (target == Target::Rotation) {
+    return Matrix::Rotation(Quaternion(aValue));
+  }
+  const Vector kValue(aValue[0], aValue[1], aValue[2]);
+  if (target == Target::Scale) {
+    return Matrix::Scaling(kValue);
+  }
+  return Matrix::Translation(kValue);
+}
+
+KeyframeTrackPtr
+KeyframeTrack::Create(const Target aTarget) {
+  KeyframeTrackPtr result = std::make_shared<ConcreteClass<KeyframeTrack, KeyframeTrack::State> >();
+  result->m.target = aTarget;
+  result->m.stride = aTarget == Target::Rotation ? 4 : 3;
+  return result;
+}
+
+KeyframeTrack::Target
+KeyframeTrack::GetTarget() const {
+  return m.target;
+}
+
+void
+KeyframeTrack::AddKey(const float aTime, const Vector& aValue) {
+  if (!m.CanAdd(aTime, 3)) {
+    return;
+  }
+  m.times.push_back(aTime);
+  m.values.insert(m.values.end(), {aValue.x(), aValue.y(), aValue.z()});
+}
+
+void
+KeyframeTrack::AddKey(const float aTime, const Quaternion& aValue) {
+  if (!m.CanAdd(aTime, 4)) {
+    return;
+  }
+  const Quaternion kValue = aValue.Normalize();
+  m.times.push_back(aTime);
+  m.values.insert(m.values.end(), kValue.Data(), kValue.Data() + 4);
+}
+
+int32_t
+KeyframeTrack::GetKeyCount() const {
+  return (int32_t)m.times.size();
+}
+
+float
+KeyframeTrack::GetDuration() const {
+  return m.times.empty() ? 0.0f : m.times.back();
+}
+
+Matrix
+KeyframeTrack::Sample(const float aTime, uint32_t& aCursor) const {
+  if (m.times.empty()) {
+    return Matrix::Identity();
+  }
+  const uint32_t kLast = (uint32_t)m.times.size() - 1;
+  if (aTime <= m.times.front()) {
+    aCursor = 0;
+    return m.ToMatrix(&m.values[0]);
+  }
+  if (aTime >= m.times.back()) {
+    aCursor = kLast;
+    return m.ToMatrix(&m.values[kLast * m.stride]);
+  }
+  aCursor = m.Find(aTime, aCursor);
+  const float* kFrom = &m.values[aCursor * m.stride];
+  const float* kTo = kFrom + m.stride;
+  const float kSpan = m.times[aCursor + 1] - m.times[aCursor];
+  const float kAmount = kSpan > 0.0f ? (aTime - m.times[aCursor]) / kSpan : 0.0f;
+  if (m.target == Target::Rotation) {
+    return Matrix::Rotation(Quaternion::Slerp(Quaternion(kFrom), Quaternion(kTo), kAmount));
+  }
+  float value[3];
+  for (int ix = 0; ix < 3; ix++) {
+    value[ix] = kFrom[ix] + ((kTo[ix] - kFrom[ix]) * kAmount);
+  }
+  return m.ToMatrix(value);
+}
+
+KeyframeTrack::KeyframeTrack(State& aState) : m(aState) {}
+KeyframeTrack::~KeyframeTrack() {}
+
+} // namespace vrb
@@ -0,0 +1,101 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/LateLatch.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/BasicShaders.h"
+#include "vrb/Camera.h"
+#include "vrb/GLError.h"
+#include "vrb/Matrix.h"
+#include "vrb/RenderContext.h"
+#include "vrb/StreamBuffer.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+// std140 layout of vrb_Camera, arrays of mat4 are tightly packed.
+struct CameraBlock {
+  float viewProjection[VRB_MAX_VIEWS][16];
+  float view[VRB_MAX_VIEWS][16];
+};
+
+void
+FillBlock(const vrb::Camera& aCamera, CameraBlock& aBlock) {
+  const int kViewCount = std::max(aCamera.GetViewCount(), 1);
+  for (int ix = 0; ix < VRB_MAX_VIEWS; ix++) {
+    const int kView = std::min(ix, kViewCount - 1);
+    memcpy(aBlock.viewProjection[ix], aCamera.GetViewProjectionAt(kView).Data(), sizeof(aBlock.viewProjection[ix]));
+    memcpy(aBlock.view[ix], aCamera.GetViewAt(kView).Data(), sizeof(aBlock.view[ix]));
+  }
+}
+
+} // namespace
+
+namespace vrb {
+
+struct LateLatch::State {
+  RenderContextWeak context;
+  StreamBufferPtr streamBuffer;
+  GLint alignment;
+  GLintptr offset;
+  double timestamp;
+  State() : alignment(0), offset(-1), timestamp(-1.0) {}
+};
+
+LateLatchPtr
+LateLatch::Create(RenderContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<LateLatch, LateLatch::State> >(aContext);
+}
+
+bool
+LateLatch::Bind(const Camera& aCamera) {
+  RenderContextPtr context = m.context.lock();
+  if (!context || !m.streamBuffer) {
+    return false;
+  }
+  if (m.alignment <= 0) {
+    VRB_GL_CHECK(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m.alignment));
+    m.alignment = std::max(m.alignment, (GLint)16);
+  }
+  CameraBlock block;
+  FillBlock(aCamera, block);
+  m.offset = m.streamBuffer->Write(&block, sizeof(block), (size_t)m.alignment);
+  if (m.offset < 0) {
+    return false;
+  }
+  m.timestamp = context->GetTimestamp();
+  VRB_GL_CHECK(glBindBufferRange(GL_UNIFORM_BUFFER, VRB_CAMERA_BLOCK_BINDING, m.streamBuffer->GetHandle(), m.offset,
+                                 sizeof(block)));
+  return true;
+}
+
+bool
+LateLatch::Latch(const Camera& aCamera) {
+  RenderContextPtr context = m.context.lock();
+  if (!context || !m.streamBuffer || (m.offset < 0)) {
+    return false;
+  }
+  // The offset of an earlier frame may point into the current one once the
+  // ring wraps around.
+  if (context->GetTimestamp() != m.timestamp) {
+    m.offset = -1;
+    return false;
+  }
+  CameraBlock block;
+  FillBlock(aCamera, block);
+  return m.streamBuffer->Overwrite(m.offset, &block, sizeof(block));
+}
+
+LateLatch::LateLatch(State& aState, RenderContextPtr& aContext) : m(aState) {
+  m.context = aContext;
+  m.streamBuffer = aContext->GetStreamBuffer();
+}
+
+LateLatch::~LateLatch() {}
+
+} // namespace vrb
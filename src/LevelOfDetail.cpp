@@ -0,0 +1,116 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/LevelOfDetail.h"
+#include "vrb/private/ToggleState.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/CullVisitor.h"
+#include "vrb/TraceProfiler.h"
+
+#include <vector>
+
+namespace vrb {
+
+struct LevelOfDetail::State : public Toggle::State {
+  struct Level {
+    const Node* node;
+    float minCoverage;
+  };
+  std::vector<Level> levels;
+  int32_t current;
+
+  State() : current(-1) {}
+  int32_t Find(const Node& aNode) const {
+    for (size_t ix = 0; ix < levels.size(); ix++) {
+      if (levels[ix].node == &aNode) {
+        return (int32_t)ix;
+      }
+    }
+    return -1;
+  }
+  // Leaves every level but the current one out through the filtered bits.
+  void FilterLevels() {
+    filtered.Clear();
+    for (size_t ix = 0; ix < levels.size(); ix++) {
+      const int32_t kSlot = (int32_t)ix == current ? -1 : FindChild(*levels[ix].node);
+      if (kSlot >= 0) {
+        filtered.Set((uint32_t)kSlot, true);
+      }
+    }
+  }
+  void Detach(const Node& aNode) override {
+    const int32_t kLevel = Find(aNode);
+    if (kLevel >= 0) {
+      levels.erase(levels.begin() + kLevel);
+      current = -1;
+      FilterLevels();
+    }
+    Toggle::State::Detach(aNode);
+  }
+  void Clear() override { levels.clear(); current = -1; Toggle::State::Clear(); }
+};
+
+LevelOfDetailPtr
+LevelOfDetail::Create(CreationContextPtr& aContext) {
+  LevelOfDetailPtr lod = std::make_shared<ConcreteClass<LevelOfDetail, LevelOfDetail::State> >(aContext);
+  lod->m.self = lod;
+  return lod;
+}
+
+// Node interface
+void
+LevelOfDetail::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  VRB_TRACE_ZONE("LevelOfDetail::Cull");
+  const Bounds& kBounds = GetBounds();
+  if (!aVisitor.IsVisible(kBounds)) {
+    return;
+  }
+  const float kCoverage = aVisitor.GetScreenCoverage(kBounds);
+  int32_t level = -1;
+  for (size_t ix = 0; ix < m.levels.size(); ix++) {
+    if (kCoverage >= m.levels[ix].minCoverage) {
+      level = (int32_t)ix;
+      break;
+    }
+  }
+  if (level != m.current) {
+    m.current = level;
+    m.FilterLevels();
+  }
+  CullChildren(aVisitor, aDrawables);
+}
+
+void
+LevelOfDetail::Flatten(SceneSnapshot& aSnapshot) {
+  // The level is picked on every Cull from the screen coverage.
+  Node::Flatten(aSnapshot);
+}
+
+// LevelOfDetail interface
+void
+LevelOfDetail::AddLevel(NodePtr aNode, const float aMinCoverage) {
+  if (!aNode || (m.Find(*aNode) >= 0)) {
+    return;
+  }
+  m.levels.push_back(State::Level{aNode.get(), aMinCoverage});
+  AddNode(std::move(aNode));
+  m.FilterLevels();
+}
+
+int32_t
+LevelOfDetail::GetLevelCount() const {
+  return (int32_t)m.levels.size();
+}
+
+int32_t
+LevelOfDetail::GetCurrentLevel() const {
+  return m.current;
+}
+
+LevelOfDetail::LevelOfDetail(State& aState, CreationContextPtr& aContext) : Toggle(aState, aContext), m(aState) {}
+LevelOfDetail::~LevelOfDetail() {}
+
+} // namespace vrb
@@ -36,6 +36,16 @@ Light::GetSpecularColor() const {
   return m.specular;
 }
 
+const Vector&
+Light::GetPosition() const {
+  return m.position;
+}
+
+float
+Light::GetRange() const {
+  return m.range;
+}
+
 void
 Light::SetDirection(const Vector& aDirection) {
   if (aDirection.Magnitude() > 0.0f) {
@@ -58,6 +68,16 @@ Light::SetSpecularColor(const Color& aColor) {
   m.specular = aColor;
 }
 
+void
+Light::SetPosition(const Vector& aPosition) {
+  m.position = aPosition;
+}
+
+void
+Light::SetRange(const float aRange) {
+  m.range = aRange > 0.0f ? aRange : 0.0f;
+}
+
 Light::Light(State& aState, CreationContextPtr& aContext) : m(aState) {}
 Light::~Light() {}
 
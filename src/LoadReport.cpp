@@ -0,0 +1,187 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/LoadReport.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/private/Clock.h"
+
+#include "vrb/Geometry.h"
+#include "vrb/Group.h"
+#include "vrb/Mutex.h"
+#include "vrb/VertexArray.h"
+
+#include <atomic>
+#include <cstdio>
+#include <unordered_set>
+
+namespace {
+
+const char* kPhaseNames[] = {"read", "parse", "mesh", "geometry upload", "texture decode", "texture upload", "shaders"};
+static_assert(sizeof(kPhaseNames) / sizeof(kPhaseNames[0]) == (size_t)vrb::LoadReport::Phase::Count, "Phase names do not match LoadReport::Phase");
+
+thread_local vrb::LoadReportCollectorPtr sCurrent;
+thread_local vrb::LoadReportTimer* sTimer = nullptr;
+
+void
+CountGeometry(const vrb::NodePtr& aNode, std::unordered_set<vrb::VertexArray*>& aVertices, vrb::LoadReportCollector& aCollector) {
+  vrb::GroupPtr group = std::dynamic_pointer_cast<vrb::Group>(aNode);
+  if (group) {
+    for (int32_t ix = 0; ix < group->GetNodeCount(); ix++) {
+      CountGeometry(group->GetNode((uint32_t)ix), aVertices, aCollector);
+    }
+    return;
+  }
+  vrb::GeometryPtr geometry = std::dynamic_pointer_cast<vrb::Geometry>(aNode);
+  if (!geometry) {
+    return;
+  }
+  uint64_t triangles = 0;
+  for (int32_t ix = 0; ix < geometry->GetFaceCount(); ix++) {
+    const uint32_t kCorners = geometry->GetFace(ix).cornerCount;
+    triangles += kCorners > 2 ? kCorners - 2 : 0;
+  }
+  aCollector.AddValue(vrb::LoadReport::Counter::Triangles, triangles);
+  aCollector.AddValue(vrb::LoadReport::Counter::Draws, 1);
+  vrb::VertexArrayPtr vertices = geometry->GetVertexArray();
+  if (vertices && aVertices.insert(vertices.get()).second) {
+    aCollector.AddValue(vrb::LoadReport::Counter::Vertices, (uint64_t)vertices->GetVertexCount());
+  }
+}
+
+}
+
+namespace vrb {
+
+std::string
+LoadReport::ToString() const {
+  std::string result("Load report for '" + name + "': ");
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "%.1f ms total", total * 1000.0);
+  result += buffer;
+  for (int ix = 0; ix < (int)Phase::Count; ix++) {
+    if (times[ix] > 0.0) {
+      snprintf(buffer, sizeof(buffer), ", %s %.1f ms", kPhaseNames[ix], times[ix] * 1000.0);
+      result += buffer;
+    }
+  }
+  snprintf(buffer, sizeof(buffer), ", %llu vertices, %llu triangles, %llu draws",
+           (unsigned long long)Get(Counter::Vertices), (unsigned long long)Get(Counter::Triangles),
+           (unsigned long long)Get(Counter::Draws));
+  result += buffer;
+  snprintf(buffer, sizeof(buffer), ", %llu KB vertices, %llu KB indices, %llu KB textures",
+           (unsigned long long)(Get(Counter::VertexBytes) / 1024), (unsigned long long)(Get(Counter::IndexBytes) / 1024),
+           (unsigned long long)(Get(Counter::TextureBytes) / 1024));
+  result += buffer;
+  return result;
+}
+
+struct LoadReportCollector::State {
+  Mutex nameLock;
+  std::string name;
+  // Nanoseconds per phase.
+  std::atomic<uint64_t> times[(int)LoadReport::Phase::Count];
+  std::atomic<uint64_t> values[(int)LoadReport::Counter::Count];
+  State() {
+    for (std::atomic<uint64_t>& time: times) {
+      time = 0;
+    }
+    for (std::atomic<uint64_t>& value: values) {
+      value = 0;
+    }
+  }
+};
+
+LoadReportCollectorPtr
+LoadReportCollector::Create() {
+  return std::make_shared<ConcreteClass<LoadReportCollector, LoadReportCollector::State> >();
+}
+
+LoadReportCollectorPtr
+LoadReportCollector::GetCurrent() {
+  return sCurrent;
+}
+
+void
+LoadReportCollector::SetName(const std::string& aName) {
+  MutexAutoLock lock(m.nameLock);
+  m.name = aName;
+}
+
+void
+LoadReportCollector::AddTime(const LoadReport::Phase aPhase, const double aSeconds) {
+  if (aSeconds > 0.0) {
+    m.times[(int)aPhase].fetch_add((uint64_t)(aSeconds * 1.0e9), std::memory_order_relaxed);
+  }
+}
+
+void
+LoadReportCollector::AddValue(const LoadReport::Counter aCounter, const uint64_t aAmount) {
+  m.values[(int)aCounter].fetch_add(aAmount, std::memory_order_relaxed);
+}
+
+void
+LoadReportCollector::CountNodes(const GroupPtr& aRoot) {
+  std::unordered_set<VertexArray*> vertices;
+  CountGeometry(aRoot, vertices, *this);
+}
+
+LoadReport
+LoadReportCollector::GetReport(const double aTotal) const {
+  LoadReport result;
+  {
+    MutexAutoLock lock(m.nameLock);
+    result.name = m.name;
+  }
+  result.total = aTotal;
+  for (int ix = 0; ix < (int)LoadReport::Phase::Count; ix++) {
+    result.times[ix] = (double)m.times[ix].load(std::memory_order_relaxed) / 1.0e9;
+  }
+  for (int ix = 0; ix < (int)LoadReport::Counter::Count; ix++) {
+    result.values[ix] = m.values[ix].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+LoadReportCollector::LoadReportCollector(State& aState) : m(aState) {}
+LoadReportCollector::~LoadReportCollector() {}
+
+LoadReportScope::LoadReportScope(const LoadReportCollectorPtr& aCollector) : mPrevious(std::move(sCurrent)) {
+  sCurrent = aCollector;
+}
+
+LoadReportScope::~LoadReportScope() {
+  sCurrent = std::move(mPrevious);
+}
+
+LoadReportTimer::LoadReportTimer(const LoadReport::Phase aPhase)
+    : mCollector(sCurrent.get())
+    , mParent(nullptr)
+    , mPhase(aPhase)
+    , mStart(0.0)
+    , mElapsed(0.0) {
+  if (!mCollector) {
+    return;
+  }
+  mStart = GetMonotonicSeconds();
+  mParent = sTimer;
+  if (mParent) {
+    mParent->mElapsed += mStart - mParent->mStart;
+  }
+  sTimer = this;
+}
+
+LoadReportTimer::~LoadReportTimer() {
+  if (!mCollector) {
+    return;
+  }
+  const double kNow = GetMonotonicSeconds();
+  mCollector->AddTime(mPhase, mElapsed + (kNow - mStart));
+  sTimer = mParent;
+  if (mParent) {
+    mParent->mStart = kNow;
+  }
+}
+
+} // namespace vrb
@@ -0,0 +1,228 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/Logger.h"
+#include "vrb/ConditionVariable.h"
+
+#include <atomic>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(ANDROID)
+#  include <android/log.h>
+#endif
+
+namespace {
+
+const int kMessageSize = 512;
+// Must be a power of two.
+const uint32_t kQueueSize = 1024;
+
+// Bounded multiple producer queue. Each slot carries a sequence number that
+// tells producers and the writer thread whose turn it is, so neither side
+// takes a lock to pass messages. The writer sleeps on sWake once the queue
+// is empty, so only a push into an empty queue has to wake it.
+struct Message {
+  std::atomic<uint32_t> sequence;
+  int level;
+  char text[kMessageSize];
+};
+
+Message sQueue[kQueueSize];
+std::atomic<uint32_t> sWritePosition(0);
+std::atomic<uint32_t> sReadPosition(0);
+std::atomic<uint32_t> sDropped(0);
+std::atomic<bool> sAsync(false);
+std::atomic<bool> sRunning(false);
+pthread_t sWriter;
+vrb::ConditionVariable sWake;
+// Broadcast after messages were written, for LoggerFlush().
+vrb::ConditionVariable sWritten;
+
+void
+Write(const int aLevel, const char* aText) {
+#if defined(ANDROID)
+  int priority = ANDROID_LOG_INFO;
+  switch (aLevel) {
+    case VRB_LOG_LEVEL_DEBUG: priority = ANDROID_LOG_DEBUG; break;
+    case VRB_LOG_LEVEL_WARN: priority = ANDROID_LOG_WARN; break;
+    case VRB_LOG_LEVEL_ERROR: priority = ANDROID_LOG_ERROR; break;
+    default: break;
+  }
+  __android_log_write(priority, "VRB", aText);
+#else
+  const char* prefix = "VRB: ";
+  switch (aLevel) {
+    case VRB_LOG_LEVEL_DEBUG: prefix = "VRB DEBUG: "; break;
+    case VRB_LOG_LEVEL_WARN: prefix = "VRB WARNING: "; break;
+    case VRB_LOG_LEVEL_ERROR: prefix = "VRB ERROR: "; break;
+    default: break;
+  }
+  fprintf(stderr, "%s%s\n", prefix, aText);
+#endif
+}
+
+void
+InitializeQueue() {
+  for (uint32_t ix = 0; ix < kQueueSize; ix++) {
+    sQueue[ix].sequence.store(ix, std::memory_order_relaxed);
+  }
+  sWritePosition.store(0, std::memory_order_relaxed);
+  sReadPosition.store(0, std::memory_order_release);
+}
+
+void
+Enqueue(const int aLevel, const char* aFormat, va_list aArgs) {
+  uint32_t position = sWritePosition.load(std::memory_order_relaxed);
+  Message* message = nullptr;
+  while (true) {
+    message = &sQueue[position & (kQueueSize - 1)];
+    const uint32_t kSequence = message->sequence.load(std::memory_order_acquire);
+    const int32_t kDiff = (int32_t)(kSequence - position);
+    if (kDiff == 0) {
+      if (sWritePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (kDiff < 0) {
+      sDropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = sWritePosition.load(std::memory_order_relaxed);
+    }
+  }
+  message->level = aLevel;
+  vsnprintf(message->text, kMessageSize, aFormat, aArgs);
+  // Sequentially consistent with the read position stored by Drain(), so
+  // either the writer sees this message or this sees the empty queue.
+  message->sequence.store(position + 1, std::memory_order_seq_cst);
+  if (sReadPosition.load(std::memory_order_seq_cst) == position) {
+    vrb::MutexAutoLock lock(sWake);
+    sWake.Signal();
+  }
+}
+
+bool
+IsMessageReady() {
+  const uint32_t kPosition = sReadPosition.load(std::memory_order_relaxed);
+  return sQueue[kPosition & (kQueueSize - 1)].sequence.load(std::memory_order_seq_cst) == kPosition + 1;
+}
+
+// Writes every message that is ready. Only called by one thread at a time.
+bool
+Drain() {
+  bool wrote = false;
+  uint32_t position = sReadPosition.load(std::memory_order_relaxed);
+  while (true) {
+    Message& message = sQueue[position & (kQueueSize - 1)];
+    if (message.sequence.load(std::memory_order_acquire) != position + 1) {
+      break;
+    }
+    Write(message.level, message.text);
+    message.sequence.store(position + kQueueSize, std::memory_order_release);
+    position++;
+    sReadPosition.store(position, std::memory_order_seq_cst);
+    wrote = true;
+  }
+  const uint32_t kDropped = sDropped.exchange(0, std::memory_order_relaxed);
+  if (kDropped > 0) {
+    char text[64];
+    snprintf(text, sizeof(text), "Logger queue full, dropped %u messages", kDropped);
+    Write(VRB_LOG_LEVEL_WARN, text);
+  }
+  if (wrote) {
+    vrb::MutexAutoLock lock(sWritten);
+    sWritten.Broadcast();
+  }
+  return wrote;
+}
+
+void*
+RunWriter(void*) {
+  while (true) {
+    Drain();
+    vrb::MutexAutoLock lock(sWake);
+    if (!sRunning.load(std::memory_order_acquire)) {
+      break;
+    }
+    if (!IsMessageReady()) {
+      sWake.Wait();
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+namespace vrb {
+
+void
+LogMessage(const int aLevel, const char* aFormat, ...) {
+  va_list args;
+  va_start(args, aFormat);
+  if (sAsync.load(std::memory_order_acquire)) {
+    Enqueue(aLevel, aFormat, args);
+  } else {
+    char text[kMessageSize];
+    vsnprintf(text, kMessageSize, aFormat, args);
+    Write(aLevel, text);
+  }
+  va_end(args);
+}
+
+void
+LoggerStartAsync() {
+  if (sRunning.load(std::memory_order_acquire)) {
+    return;
+  }
+  InitializeQueue();
+  sRunning.store(true, std::memory_order_release);
+  if (pthread_create(&sWriter, nullptr, &RunWriter, nullptr) != 0) {
+    sRunning.store(false, std::memory_order_release);
+    VRB_ERROR("Failed to start logger thread");
+    return;
+  }
+  sAsync.store(true, std::memory_order_release);
+}
+
+void
+LoggerStopAsync() {
+  if (!sRunning.load(std::memory_order_acquire)) {
+    return;
+  }
+  sAsync.store(false, std::memory_order_release);
+  {
+    MutexAutoLock lock(sWake);
+    sRunning.store(false, std::memory_order_release);
+    sWake.Signal();
+  }
+  pthread_join(sWriter, nullptr);
+  // Producers that saw the queue as still in use may have pushed after the
+  // last drain of the writer.
+  Drain();
+  MutexAutoLock lock(sWritten);
+  sWritten.Broadcast();
+}
+
+void
+LoggerFlush() {
+  if (!sAsync.load(std::memory_order_acquire)) {
+    return;
+  }
+  const uint32_t kTarget = sWritePosition.load(std::memory_order_acquire);
+  MutexAutoLock lock(sWritten);
+  while (sRunning.load(std::memory_order_acquire) &&
+         ((int32_t)(sReadPosition.load(std::memory_order_acquire) - kTarget) < 0)) {
+    sWritten.Wait();
+  }
+}
+
+bool
+LoggerIsAsync() {
+  return sAsync.load(std::memory_order_acquire);
+}
+
+} // namespace vrb
@@ -0,0 +1,151 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/MaterialRegistry.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Color.h"
+#include "vrb/Matrix.h"
+#include "vrb/Mutex.h"
+#include "vrb/RenderState.h"
+
+#include <atomic>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+struct Parameters {
+  const void* program;
+  const void* texture;
+  vrb::Color ambient;
+  vrb::Color diffuse;
+  vrb::Color specular;
+  float specularExponent;
+  vrb::Color tint;
+  float uvTransform[16];
+  float textureLayer;
+  bool transparent;
+  bool lightsEnabled;
+
+  explicit Parameters(const vrb::RenderState& aState)
+      : program(aState.GetProgram().get())
+      , texture(aState.GetTexture().get())
+      , specularExponent(0.0f)
+      , tint(aState.GetTintColor())
+      , textureLayer(aState.GetTextureLayer())
+      , transparent(aState.IsTransparent())
+      , lightsEnabled(aState.GetLightsEnabled()) {
+    aState.GetMaterial(ambient, diffuse, specular, specularExponent);
+    memcpy(uvTransform, aState.GetUVTransform().Data(), sizeof(uvTransform));
+  }
+
+  bool operator==(const Parameters& aOther) const {
+    return (program == aOther.program) && (texture == aOther.texture) &&
+           (ambient == aOther.ambient) && (diffuse == aOther.diffuse) && (specular == aOther.specular) &&
+           (specularExponent == aOther.specularExponent) && (tint == aOther.tint) &&
+           (memcmp(uvTransform, aOther.uvTransform, sizeof(uvTransform)) == 0) &&
+           (textureLayer == aOther.textureLayer) && (transparent == aOther.transparent) &&
+           (lightsEnabled == aOther.lightsEnabled);
+  }
+
+  // FNV-1a, as LightBlock::Hash.
+  uint64_t Hash() const {
+    uint64_t result = 0xcbf29ce484222325ull;
+    auto add = [&result](const void* aData, const size_t aSize) {
+      const uint8_t* bytes = (const uint8_t*)aData;
+      for (size_t ix = 0; ix < aSize; ix++) {
+        result ^= bytes[ix];
+        result *= 0x100000001b3ull;
+      }
+    };
+    add(&program, sizeof(program));
+    add(&texture, sizeof(texture));
+    add(ambient.Data(), 4 * sizeof(float));
+    add(diffuse.Data(), 4 * sizeof(float));
+    add(specular.Data(), 4 * sizeof(float));
+    add(&specularExponent, sizeof(specularExponent));
+    add(tint.Data(), 4 * sizeof(float));
+    add(uvTransform, sizeof(uvTransform));
+    add(&textureLayer, sizeof(textureLayer));
+    add(&transparent, sizeof(transparent));
+    add(&lightsEnabled, sizeof(lightsEnabled));
+    return result;
+  }
+};
+
+}
+
+namespace vrb {
+
+struct MaterialRegistry::State {
+  mutable Mutex lock;
+  std::unordered_multimap<uint64_t, RenderStateWeak> states;
+  std::atomic<bool> enabled;
+  State() : enabled(false) {}
+};
+
+MaterialRegistryPtr
+MaterialRegistry::Create() {
+  return std::make_shared<ConcreteClass<MaterialRegistry, MaterialRegistry::State> >();
+}
+
+RenderStatePtr
+MaterialRegistry::Share(const RenderStatePtr& aState) {
+  if (!aState || !m.enabled || aState->GetSkeleton()) {
+    return aState;
+  }
+  const Parameters kParameters(*aState);
+  const uint64_t kHash = kParameters.Hash();
+  MutexAutoLock lock(m.lock);
+  auto range = m.states.equal_range(kHash);
+  auto it = range.first;
+  while (it != range.second) {
+    RenderStatePtr state = it->second.lock();
+    if (!state) {
+      it = m.states.erase(it);
+      continue;
+    }
+    if ((state == aState) || (Parameters(*state) == kParameters)) {
+      return state;
+    }
+    ++it;
+  }
+  m.states.emplace(kHash, aState);
+  return aState;
+}
+
+void
+MaterialRegistry::SetEnabled(const bool aEnabled) {
+  m.enabled = aEnabled;
+}
+
+bool
+MaterialRegistry::IsEnabled() const {
+  return m.enabled;
+}
+
+size_t
+MaterialRegistry::GetCount() const {
+  MutexAutoLock lock(m.lock);
+  size_t result = 0;
+  for (const auto& item: m.states) {
+    if (!item.second.expired()) {
+      result++;
+    }
+  }
+  return result;
+}
+
+void
+MaterialRegistry::Clear() {
+  MutexAutoLock lock(m.lock);
+  m.states.clear();
+}
+
+MaterialRegistry::MaterialRegistry(State& aState) : m(aState) {}
+MaterialRegistry::~MaterialRegistry() {}
+
+} // namespace vrb
@@ -0,0 +1,90 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/MemoryCounter.h"
+
+#include "vrb/Logger.h"
+#include "vrb/TextureFormat.h"
+
+#include <atomic>
+
+namespace {
+
+std::atomic<int64_t> sUsage[(int)vrb::MemoryType::Count];
+
+const char* const kNames[] = {
+  "VertexBuffer",
+  "IndexBuffer",
+  "TextureRGBA",
+  "TextureRG",
+  "TextureCompressed",
+  "FramebufferAttachment",
+  "VertexArray",
+  "GeometryFaces",
+  "ImageData"
+};
+
+static_assert(sizeof(kNames) / sizeof(kNames[0]) == (size_t)vrb::MemoryType::Count, "Missing memory type name");
+
+int64_t
+SumUsage(const vrb::MemoryType aFirst, const vrb::MemoryType aLast) {
+  int64_t result = 0;
+  for (int ix = (int)aFirst; ix <= (int)aLast; ix++) {
+    result += sUsage[ix].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+} // namespace
+
+namespace vrb {
+
+void
+AddMemoryUsage(const MemoryType aType, const int64_t aBytes) {
+  sUsage[(int)aType].fetch_add(aBytes, std::memory_order_relaxed);
+}
+
+int64_t
+GetMemoryUsage(const MemoryType aType) {
+  return sUsage[(int)aType].load(std::memory_order_relaxed);
+}
+
+int64_t
+GetGPUMemoryUsage() {
+  return SumUsage(MemoryType::VertexBuffer, MemoryType::FramebufferAttachment);
+}
+
+int64_t
+GetCPUMemoryUsage() {
+  return SumUsage(MemoryType::VertexArray, MemoryType::ImageData);
+}
+
+const char*
+GetMemoryTypeName(const MemoryType aType) {
+  return aType < MemoryType::Count ? kNames[(int)aType] : "Unknown";
+}
+
+MemoryType
+GetTextureMemoryType(const GLenum aFormat) {
+  switch (aFormat) {
+    case GL_RGBA:
+    case GL_RGBA8:
+      return MemoryType::TextureRGBA;
+    case GL_RG8:
+      return MemoryType::TextureRG;
+    default:
+      return IsCompressedTextureFormat(aFormat) ? MemoryType::TextureCompressed : MemoryType::TextureRGBA;
+  }
+}
+
+void
+LogMemoryUsage() {
+  for (int ix = 0; ix < (int)MemoryType::Count; ix++) {
+    VRB_LOG("Memory %s: %lld bytes", kNames[ix], (long long)sUsage[ix].load(std::memory_order_relaxed));
+  }
+  VRB_LOG("Memory total GPU: %lld CPU: %lld bytes", (long long)GetGPUMemoryUsage(), (long long)GetCPUMemoryUsage());
+}
+
+} // namespace vrb
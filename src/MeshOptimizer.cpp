@@ -0,0 +1,582 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/MeshOptimizer.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <math.h>
+#include <unordered_map>
+
+namespace {
+
+// Scoring constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+const size_t kMaxCacheSize = 32;
+const float kCacheDecayPower = 1.5f;
+const float kLastTriangleScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+
+float
+VertexScore(const int32_t aCachePosition, const uint32_t aRemaining) {
+  if (aRemaining == 0) {
+    // Vertices without triangles left do not draw triangles to them.
+    return -1.0f;
+  }
+  float score = 0.0f;
+  if (aCachePosition >= 0) {
+    if (aCachePosition < 3) {
+      // The vertices of the last triangle are scored lower on purpose so the
+      // strip does not double back on itself.
+      score = kLastTriangleScore;
+    } else {
+      const float kScaler = 1.0f / (float)(kMaxCacheSize - 3);
+      score = powf(1.0f - ((float)(aCachePosition - 3) * kScaler), kCacheDecayPower);
+    }
+  }
+  return score + (kValenceBoostScale * powf((float)aRemaining, -kValenceBoostPower));
+}
+
+vrb::Vector
+Position(const float* aPositions, const uint32_t aIndex) {
+  const float* position = aPositions + (aIndex * 3);
+  return vrb::Vector(position[0], position[1], position[2]);
+}
+
+struct Cluster {
+  uint32_t start;
+  uint32_t end;
+  float sortKey;
+};
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes.
+struct Quadric {
+  double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+  double b2 = 0.0, bc = 0.0, bd = 0.0;
+  double c2 = 0.0, cd = 0.0;
+  double d2 = 0.0;
+  double weight = 0.0;
+
+  void AddPlane(const double a, const double b, const double c, const double d, const double aWeight) {
+    a2 += a * a * aWeight; ab += a * b * aWeight; ac += a * c * aWeight; ad += a * d * aWeight;
+    b2 += b * b * aWeight; bc += b * c * aWeight; bd += b * d * aWeight;
+    c2 += c * c * aWeight; cd += c * d * aWeight;
+    d2 += d * d * aWeight;
+    weight += aWeight;
+  }
+  void Add(const Quadric& aOther) {
+    a2 += aOther.a2; ab += aOther.ab; ac += aOther.ac; ad += aOther.ad;
+    b2 += aOther.b2; bc += aOther.bc; bd += aOther.bd;
+    c2 += aOther.c2; cd += aOther.cd;
+    d2 += aOther.d2;
+    weight += aOther.weight;
+  }
+  // Mean squared distance to the planes, weighted by their area.
+  double Error(const float* aPoint) const {
+    if (weight <= 0.0) {
+      return 0.0;
+    }
+    const double x = aPoint[0], y = aPoint[1], z = aPoint[2];
+    const double kError = (a2 * x * x) + (2.0 * ab * x * y) + (2.0 * ac * x * z) + (2.0 * ad * x) +
+           (b2 * y * y) + (2.0 * bc * y * z) + (2.0 * bd * y) +
+           (c2 * z * z) + (2.0 * cd * z) + d2;
+    return std::max(kError, 0.0) / weight;
+  }
+};
+
+struct Collapse {
+  double cost;
+  uint32_t from;
+  uint32_t to;
+};
+
+uint64_t
+EdgeKey(const uint32_t aFirst, const uint32_t aSecond) {
+  return aFirst < aSecond ? (((uint64_t)aFirst << 32) | aSecond) : (((uint64_t)aSecond << 32) | aFirst);
+}
+
+// Rejects the collapse if a triangle around aFrom, moved to aTo, would flip
+// or become degenerate.
+bool
+CollapseKeepsOrientation(const uint32_t* aIndices, const float* aPositions, const uint32_t* aTriangles,
+                         const uint32_t aCount, const uint32_t aFrom, const uint32_t aTo) {
+  for (uint32_t ix = 0; ix < aCount; ix++) {
+    const uint32_t* triangle = aIndices + (aTriangles[ix] * 3);
+    if ((triangle[0] == aTo) || (triangle[1] == aTo) || (triangle[2] == aTo)) {
+      // Removed by the collapse.
+      continue;
+    }
+    vrb::Vector before[3];
+    vrb::Vector after[3];
+    for (size_t corner = 0; corner < 3; corner++) {
+      before[corner] = Position(aPositions, triangle[corner]);
+      after[corner] = triangle[corner] == aFrom ? Position(aPositions, aTo) : before[corner];
+    }
+    const vrb::Vector kBefore = (before[1] - before[0]).Cross(before[2] - before[0]);
+    const vrb::Vector kAfter = (after[1] - after[0]).Cross(after[2] - after[0]);
+    if (kBefore.Dot(kAfter) <= 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+namespace vrb {
+
+float
+ComputeACMR(const uint32_t* aIndices, const size_t aIndexCount, const size_t aVertexCount, const size_t aCacheSize) {
+  const size_t kTriangleCount = aIndexCount / 3;
+  if (kTriangleCount == 0) {
+    return 0.0f;
+  }
+  // A vertex is still cached while fewer than aCacheSize misses happened since it was loaded.
+  std::vector<size_t> loadedAt(aVertexCount, 0);
+  size_t time = aCacheSize + 1;
+  size_t misses = 0;
+  for (size_t ix = 0; ix < aIndexCount; ix++) {
+    const uint32_t kIndex = aIndices[ix];
+    if ((time - loadedAt[kIndex]) > aCacheSize) {
+      loadedAt[kIndex] = time;
+      time++;
+      misses++;
+    }
+  }
+  return (float)misses / (float)kTriangleCount;
+}
+
+void
+OptimizeVertexCache(uint32_t* aIndices, const size_t aIndexCount, const size_t aVertexCount, std::vector<uint32_t>* aClusters) {
+  const size_t kTriangleCount = aIndexCount / 3;
+  if (kTriangleCount < 2) {
+    if (aClusters && kTriangleCount) {
+      aClusters->push_back(0);
+    }
+    return;
+  }
+
+  // Triangles adjacent to each vertex in compressed rows. The first
+  // remaining[v] entries of a row are the triangles not emitted yet.
+  std::vector<uint32_t> remaining(aVertexCount, 0);
+  for (size_t ix = 0; ix < (kTriangleCount * 3); ix++) {
+    remaining[aIndices[ix]]++;
+  }
+  std::vector<uint32_t> offsets(aVertexCount + 1, 0);
+  for (size_t ix = 0; ix < aVertexCount; ix++) {
+    offsets[ix + 1] = offsets[ix] + remaining[ix];
+  }
+  std::vector<uint32_t> adjacency(offsets[aVertexCount]);
+  {
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t ix = 0; ix < (kTriangleCount * 3); ix++) {
+      adjacency[cursor[aIndices[ix]]++] = (uint32_t)(ix / 3);
+    }
+  }
+
+  std::vector<int32_t> cachePosition(aVertexCount, -1);
+  std::vector<float> vertexScore(aVertexCount);
+  for (size_t ix = 0; ix < aVertexCount; ix++) {
+    vertexScore[ix] = VertexScore(-1, remaining[ix]);
+  }
+  std::vector<uint8_t> emitted(kTriangleCount, 0);
+  std::vector<uint32_t> output;
+  output.reserve(kTriangleCount * 3);
+
+  uint32_t cache[kMaxCacheSize + 3];
+  size_t cacheSize = 0;
+  size_t scanCursor = 0;
+  int64_t best = -1;
+  while (output.size() < (kTriangleCount * 3)) {
+    if (best < 0) {
+      // Nothing left around the cache, continue with the next triangle in
+      // input order which keeps the restart linear.
+      while (emitted[scanCursor]) {
+        scanCursor++;
+      }
+      best = (int64_t)scanCursor;
+      if (aClusters) {
+        aClusters->push_back((uint32_t)output.size());
+      }
+    }
+    const uint32_t kTriangle = (uint32_t)best;
+    const uint32_t* corners = aIndices + (kTriangle * 3);
+    emitted[kTriangle] = 1;
+    uint32_t newCache[kMaxCacheSize + 3];
+    size_t newCacheSize = 0;
+    for (size_t corner = 0; corner < 3; corner++) {
+      const uint32_t kVertex = corners[corner];
+      output.push_back(kVertex);
+      // Remove the triangle from the remaining triangles of the vertex.
+      uint32_t* row = adjacency.data() + offsets[kVertex];
+      for (uint32_t jx = 0; jx < remaining[kVertex]; jx++) {
+        if (row[jx] == kTriangle) {
+          std::swap(row[jx], row[remaining[kVertex] - 1]);
+          remaining[kVertex]--;
+          break;
+        }
+      }
+      if (std::find(newCache, newCache + newCacheSize, kVertex) == (newCache + newCacheSize)) {
+        newCache[newCacheSize++] = kVertex;
+      }
+    }
+    for (size_t ix = 0; ix < cacheSize; ix++) {
+      if (std::find(newCache, newCache + 3, cache[ix]) == (newCache + 3)) {
+        newCache[newCacheSize++] = cache[ix];
+      }
+    }
+    for (size_t ix = 0; ix < newCacheSize; ix++) {
+      const uint32_t kVertex = newCache[ix];
+      cachePosition[kVertex] = ix < kMaxCacheSize ? (int32_t)ix : -1;
+      vertexScore[kVertex] = VertexScore(cachePosition[kVertex], remaining[kVertex]);
+    }
+    // Only triangles around the cache change score, the best of them is next.
+    best = -1;
+    float bestScore = -1.0f;
+    for (size_t ix = 0; ix < newCacheSize; ix++) {
+      const uint32_t kVertex = newCache[ix];
+      const uint32_t* row = adjacency.data() + offsets[kVertex];
+      for (uint32_t jx = 0; jx < remaining[kVertex]; jx++) {
+        const uint32_t* triangle = aIndices + (row[jx] * 3);
+        const float kScore = vertexScore[triangle[0]] + vertexScore[triangle[1]] + vertexScore[triangle[2]];
+        if (kScore > bestScore) {
+          bestScore = kScore;
+          best = row[jx];
+        }
+      }
+    }
+    cacheSize = std::min(newCacheSize, kMaxCacheSize);
+    std::copy(newCache, newCache + cacheSize, cache);
+  }
+  std::copy(output.begin(), output.end(), aIndices);
+}
+
+void
+OptimizeOverdraw(uint32_t* aIndices, const size_t aIndexCount, const float* aPositions,
+                 const std::vector<uint32_t>& aClusters, const size_t aMaxClusterTriangles) {
+  const uint32_t kIndexCount = (uint32_t)((aIndexCount / 3) * 3);
+  const uint32_t kMaxClusterIndices = (uint32_t)(std::max(aMaxClusterTriangles, (size_t)1) * 3);
+  std::vector<Cluster> clusters;
+  for (size_t ix = 0; ix < aClusters.size(); ix++) {
+    const uint32_t kEnd = (ix + 1) < aClusters.size() ? aClusters[ix + 1] : kIndexCount;
+    for (uint32_t start = aClusters[ix]; start < kEnd; start += kMaxClusterIndices) {
+      clusters.push_back(Cluster{start, std::min(start + kMaxClusterIndices, kEnd), 0.0f});
+    }
+  }
+  if (clusters.size() < 2) {
+    return;
+  }
+
+  Vector center;
+  for (uint32_t ix = 0; ix < kIndexCount; ix++) {
+    center += Position(aPositions, aIndices[ix]);
+  }
+  center = center / (float)kIndexCount;
+
+  // Clusters whose area weighted normal points away from the center are
+  // likely to be in front of the rest of the mesh from any view point.
+  for (Cluster& cluster: clusters) {
+    Vector normal;
+    Vector centroid;
+    float area = 0.0f;
+    for (uint32_t ix = cluster.start; ix < cluster.end; ix += 3) {
+      const Vector kA = Position(aPositions, aIndices[ix]);
+      const Vector kB = Position(aPositions, aIndices[ix + 1]);
+      const Vector kC = Position(aPositions, aIndices[ix + 2]);
+      const Vector kCross = (kB - kA).Cross(kC - kA);
+      const float kArea = kCross.Magnitude();
+      normal += kCross;
+      centroid += (kA + kB + kC) * (kArea / 3.0f);
+      area += kArea;
+    }
+    if (area <= 0.0f) {
+      continue;
+    }
+    centroid = centroid / area;
+    const float kLength = normal.Magnitude();
+    if (kLength > 0.0f) {
+      cluster.sortKey = (centroid - center).Dot(normal / kLength);
+    }
+  }
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& aLeft, const Cluster& aRight) {
+    return aLeft.sortKey > aRight.sortKey;
+  });
+
+  std::vector<uint32_t> sorted;
+  sorted.reserve(kIndexCount);
+  for (const Cluster& cluster: clusters) {
+    sorted.insert(sorted.end(), aIndices + cluster.start, aIndices + cluster.end);
+  }
+  std::copy(sorted.begin(), sorted.end(), aIndices);
+}
+
+size_t
+SimplifyMesh(const uint32_t* aIndices, const size_t aIndexCount, const float* aPositions,
+             const size_t aVertexCount, const size_t aTargetIndexCount, const float aMaxError,
+             std::vector<uint32_t>& aResult) {
+  aResult.assign(aIndices, aIndices + ((aIndexCount / 3) * 3));
+  if ((aResult.size() <= aTargetIndexCount) || (aVertexCount == 0)) {
+    return aResult.size();
+  }
+
+  Vector minimum(aPositions[0], aPositions[1], aPositions[2]);
+  Vector maximum(minimum);
+  for (size_t ix = 1; ix < aVertexCount; ix++) {
+    const Vector kPosition = Position(aPositions, (uint32_t)ix);
+    minimum.ContractInPlace(kPosition);
+    maximum.ExpandInPlace(kPosition);
+  }
+  const double kMaxDistance = (double)aMaxError * (double)(maximum - minimum).Magnitude();
+  const double kMaxCost = kMaxDistance * kMaxDistance;
+
+  // Edges not shared by exactly two triangles are open, or seams where the
+  // corners of the two sides differ. Their vertices never move.
+  std::vector<uint8_t> locked(aVertexCount, 0);
+  {
+    std::unordered_map<uint64_t, uint32_t> edges;
+    edges.reserve(aResult.size());
+    for (size_t ix = 0; ix < aResult.size(); ix += 3) {
+      for (size_t corner = 0; corner < 3; corner++) {
+        edges[EdgeKey(aResult[ix + corner], aResult[ix + ((corner + 1) % 3)])]++;
+      }
+    }
+    for (const auto& edge: edges) {
+      if (edge.second != 2) {
+        locked[edge.first >> 32] = 1;
+        locked[edge.first & 0xffffffff] = 1;
+      }
+    }
+  }
+
+  std::vector<Quadric> quadrics(aVertexCount);
+  for (size_t ix = 0; ix < aResult.size(); ix += 3) {
+    const Vector kA = Position(aPositions, aResult[ix]);
+    const Vector kB = Position(aPositions, aResult[ix + 1]);
+    const Vector kC = Position(aPositions, aResult[ix + 2]);
+    const Vector kCross = (kB - kA).Cross(kC - kA);
+    const float kArea = kCross.Magnitude();
+    if (kArea <= 0.0f) {
+      continue;
+    }
+    const Vector kNormal = kCross / kArea;
+    const double kD = -(double)kNormal.Dot(kA);
+    for (size_t corner = 0; corner < 3; corner++) {
+      quadrics[aResult[ix + corner]].AddPlane(kNormal.x(), kNormal.y(), kNormal.z(), kD, kArea);
+    }
+  }
+
+  // Greedy passes over independent collapses: every vertex around an
+  // accepted collapse is left for the next pass so costs stay valid.
+  std::vector<uint32_t> remap(aVertexCount);
+  std::vector<uint8_t> touched(aVertexCount);
+  std::vector<uint32_t> offsets(aVertexCount + 1);
+  std::vector<uint32_t> adjacency;
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> neighbours;
+  std::vector<uint32_t> counted;
+  while (aResult.size() > aTargetIndexCount) {
+    const size_t kTriangleCount = aResult.size() / 3;
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (uint32_t index: aResult) {
+      offsets[index + 1]++;
+    }
+    for (size_t ix = 0; ix < aVertexCount; ix++) {
+      offsets[ix + 1] += offsets[ix];
+    }
+    adjacency.resize(aResult.size());
+    {
+      std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+      for (size_t ix = 0; ix < aResult.size(); ix++) {
+        adjacency[cursor[aResult[ix]]++] = (uint32_t)(ix / 3);
+      }
+    }
+
+    collapses.clear();
+    for (size_t ix = 0; ix < aResult.size(); ix += 3) {
+      for (size_t corner = 0; corner < 3; corner++) {
+        const uint32_t kFrom = aResult[ix + corner];
+        const uint32_t kTo = aResult[ix + ((corner + 1) % 3)];
+        for (int direction = 0; direction < 2; direction++) {
+          const uint32_t kSource = direction ? kTo : kFrom;
+          const uint32_t kTarget = direction ? kFrom : kTo;
+          if (locked[kSource]) {
+            continue;
+          }
+          Quadric quadric = quadrics[kSource];
+          quadric.Add(quadrics[kTarget]);
+          collapses.push_back(Collapse{quadric.Error(aPositions + (kTarget * 3)), kSource, kTarget});
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& aLeft, const Collapse& aRight) {
+      return aLeft.cost < aRight.cost;
+    });
+
+    for (size_t ix = 0; ix < aVertexCount; ix++) {
+      remap[ix] = (uint32_t)ix;
+    }
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t removed = 0;
+    const size_t kRemovable = kTriangleCount - (aTargetIndexCount / 3);
+    for (const Collapse& collapse: collapses) {
+      if ((collapse.cost > kMaxCost) || (removed >= kRemovable)) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+      const uint32_t* fromTriangles = adjacency.data() + offsets[collapse.from];
+      const uint32_t kFromCount = offsets[collapse.from + 1] - offsets[collapse.from];
+      const uint32_t* toTriangles = adjacency.data() + offsets[collapse.to];
+      const uint32_t kToCount = offsets[collapse.to + 1] - offsets[collapse.to];
+      // Two vertices of an interior edge share exactly the two vertices
+      // opposite to it, more would leave the mesh non manifold.
+      neighbours.clear();
+      for (uint32_t jx = 0; jx < kFromCount; jx++) {
+        const uint32_t* triangle = aResult.data() + (fromTriangles[jx] * 3);
+        neighbours.insert(neighbours.end(), triangle, triangle + 3);
+      }
+      std::sort(neighbours.begin(), neighbours.end());
+      neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+      size_t shared = 0;
+      size_t sharedTriangles = 0;
+      counted.clear();
+      for (uint32_t jx = 0; jx < kToCount; jx++) {
+        const uint32_t* triangle = aResult.data() + (toTriangles[jx] * 3);
+        bool hasFrom = false;
+        for (size_t corner = 0; corner < 3; corner++) {
+          const uint32_t kVertex = triangle[corner];
+          hasFrom = hasFrom || (kVertex == collapse.from);
+          if ((kVertex != collapse.from) && (kVertex != collapse.to) &&
+              std::binary_search(neighbours.begin(), neighbours.end(), kVertex) &&
+              (std::find(counted.begin(), counted.end(), kVertex) == counted.end())) {
+            counted.push_back(kVertex);
+            shared++;
+          }
+        }
+        sharedTriangles += hasFrom ? 1 : 0;
+      }
+      if ((shared > 2) || (sharedTriangles == 0)) {
+        continue;
+      }
+      if (!CollapseKeepsOrientation(aResult.data(), aPositions, fromTriangles, kFromCount, collapse.from, collapse.to)) {
+        continue;
+      }
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to].Add(quadrics[collapse.from]);
+      for (uint32_t vertex: neighbours) {
+        touched[vertex] = 1;
+      }
+      removed += sharedTriangles;
+    }
+    if (removed == 0) {
+      break;
+    }
+
+    size_t count = 0;
+    for (size_t ix = 0; ix < aResult.size(); ix += 3) {
+      const uint32_t kA = remap[aResult[ix]];
+      const uint32_t kB = remap[aResult[ix + 1]];
+      const uint32_t kC = remap[aResult[ix + 2]];
+      if ((kA != kB) && (kB != kC) && (kC != kA)) {
+        aResult[count++] = kA;
+        aResult[count++] = kB;
+        aResult[count++] = kC;
+      }
+    }
+    aResult.resize(count);
+  }
+  return aResult.size();
+}
+
+void
+StripifyTriangles(const uint32_t* aIndices, const size_t aIndexCount, const size_t aVertexCount,
+                  const uint32_t aRestartIndex, std::vector<uint32_t>& aResult) {
+  const size_t kTriangleCount = aIndexCount / 3;
+  // Triangles adjacent to each vertex in compressed rows.
+  std::vector<uint32_t> offsets(aVertexCount + 1, 0);
+  for (size_t ix = 0; ix < (kTriangleCount * 3); ix++) {
+    offsets[aIndices[ix] + 1]++;
+  }
+  for (size_t ix = 0; ix < aVertexCount; ix++) {
+    offsets[ix + 1] += offsets[ix];
+  }
+  std::vector<uint32_t> adjacency(offsets[aVertexCount]);
+  {
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t ix = 0; ix < (kTriangleCount * 3); ix++) {
+      adjacency[cursor[aIndices[ix]]++] = (uint32_t)(ix / 3);
+    }
+  }
+  std::vector<uint8_t> emitted(kTriangleCount, 0);
+  for (size_t ix = 0; ix < kTriangleCount; ix++) {
+    const uint32_t* triangle = aIndices + (ix * 3);
+    if ((triangle[0] == triangle[1]) || (triangle[1] == triangle[2]) || (triangle[2] == triangle[0])) {
+      emitted[ix] = 1;
+    }
+  }
+  // Returns a triangle left with the directed edge aFrom to aTo, of which
+  // aThird receives the other vertex, or -1 if there is none.
+  auto findNext = [&](const uint32_t aFrom, const uint32_t aTo, uint32_t& aThird) -> int64_t {
+    for (uint32_t entry = offsets[aFrom]; entry < offsets[aFrom + 1]; entry++) {
+      const uint32_t kTriangle = adjacency[entry];
+      if (emitted[kTriangle]) {
+        continue;
+      }
+      const uint32_t* triangle = aIndices + (kTriangle * 3);
+      for (int corner = 0; corner < 3; corner++) {
+        if ((triangle[corner] == aFrom) && (triangle[(corner + 1) % 3] == aTo)) {
+          aThird = triangle[(corner + 2) % 3];
+          return kTriangle;
+        }
+      }
+    }
+    return -1;
+  };
+
+  // Triangle i of a strip is (i, i + 1, i + 2) when i is even and
+  // (i + 1, i, i + 2) when it is odd, so the next triangle must have the
+  // last edge in the direction matching its parity.
+  size_t scanCursor = 0;
+  while (true) {
+    while ((scanCursor < kTriangleCount) && emitted[scanCursor]) {
+      scanCursor++;
+    }
+    if (scanCursor == kTriangleCount) {
+      break;
+    }
+    const uint32_t* triangle = aIndices + (scanCursor * 3);
+    emitted[scanCursor] = 1;
+    // Starts with the rotation whose last edge has a neighbour.
+    int rotation = 0;
+    uint32_t third = 0;
+    for (int ix = 0; ix < 3; ix++) {
+      if (findNext(triangle[(ix + 2) % 3], triangle[(ix + 1) % 3], third) >= 0) {
+        rotation = ix;
+        break;
+      }
+    }
+    uint32_t previous = triangle[(rotation + 1) % 3];
+    uint32_t last = triangle[(rotation + 2) % 3];
+    aResult.push_back(triangle[rotation]);
+    aResult.push_back(previous);
+    aResult.push_back(last);
+    bool odd = true;
+    while (true) {
+      const int64_t kNext = odd ? findNext(last, previous, third) : findNext(previous, last, third);
+      if (kNext < 0) {
+        break;
+      }
+      emitted[kNext] = 1;
+      aResult.push_back(third);
+      previous = last;
+      last = third;
+      odd = !odd;
+    }
+    aResult.push_back(aRestartIndex);
+  }
+}
+
+} // namespace vrb
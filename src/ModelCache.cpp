@@ -0,0 +1,87 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/ModelCache.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Group.h"
+#include "vrb/Mutex.h"
+#include "vrb/Node.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace vrb {
+
+struct ModelCache::State {
+  struct Entry {
+    std::string name;
+    // Held in a list rather than a Group so the cache is not one of their
+    // parents.
+    std::vector<NodePtr> nodes;
+  };
+  Mutex lock;
+  std::unordered_map<std::string, Entry> models;
+  State() {}
+};
+
+ModelCachePtr
+ModelCache::Create() {
+  return std::make_shared<ConcreteClass<ModelCache, ModelCache::State> >();
+}
+
+GroupPtr
+ModelCache::Instantiate(CreationContextPtr& aContext, const std::string& aPath) {
+  std::vector<NodePtr> nodes;
+  std::string name;
+  {
+    MutexAutoLock lock(m.lock);
+    auto found = m.models.find(aPath);
+    if (found == m.models.end()) {
+      return nullptr;
+    }
+    nodes = found->second.nodes;
+    name = found->second.name;
+  }
+  GroupPtr result = Group::Create(aContext);
+  result->SetName(name);
+  result->AddNodes(nodes);
+  return result;
+}
+
+void
+ModelCache::Add(const std::string& aPath, const GroupPtr& aModel) {
+  // A failed load is not cached so that it is tried again.
+  if (!aModel || (aModel->GetNodeCount() == 0)) {
+    return;
+  }
+  State::Entry entry;
+  entry.name = aModel->GetName();
+  const int32_t kCount = aModel->GetNodeCount();
+  entry.nodes.reserve((size_t)kCount);
+  for (int32_t ix = 0; ix < kCount; ix++) {
+    entry.nodes.push_back(aModel->GetNode((uint32_t)ix));
+  }
+  MutexAutoLock lock(m.lock);
+  m.models.emplace(aPath, std::move(entry));
+}
+
+void
+ModelCache::Remove(const std::string& aPath) {
+  MutexAutoLock lock(m.lock);
+  m.models.erase(aPath);
+}
+
+void
+ModelCache::Clear() {
+  MutexAutoLock lock(m.lock);
+  m.models.clear();
+}
+
+ModelCache::ModelCache(State& aState) : m(aState) {}
+
+ModelCache::~ModelCache() {}
+
+} // namespace vrb
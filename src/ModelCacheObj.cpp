@@ -0,0 +1,483 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/ModelCacheObj.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+#include "vrb/MappedFile.h"
+#include "vrb/ParserObj.h"
+#include "vrb/Vector.h"
+#include "vrb/private/CacheFile.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+const uint32_t kMagic = 0x4d425256; // "VRBM"
+const uint32_t kVersion = 1;
+
+enum class Op : uint8_t {
+  StartModel,
+  FinishModel,
+  LoadMaterialLibrary,
+  SetGroupNames,
+  SetObjectName,
+  SetMaterialName,
+  AddVertex,
+  AddNormal,
+  AddUV,
+  AddFace,
+  SetSmoothingGroup,
+  StartMaterialFile,
+  FinishMaterialFile,
+  CreateMaterial,
+  SetAmbientColor,
+  SetDiffuseColor,
+  SetSpecularColor,
+  SetSpecularExponent,
+  SetIlluniationModel,
+  SetAmbientTexture,
+  SetDiffuseTexture,
+  SetSpecularTexture
+};
+
+struct SourceKey {
+  uint64_t size;
+  int64_t modified;
+};
+
+bool
+GetSourceKey(const std::string& aFileName, SourceKey& aKey) {
+  struct stat info = {};
+  if (stat(aFileName.c_str(), &info) != 0) {
+    return false;
+  }
+  aKey.size = (uint64_t)info.st_size;
+  aKey.modified = (int64_t)info.st_mtime;
+  return true;
+}
+
+// The shared entry format with the values of model records.
+class Writer : public vrb::CacheFileWriter {
+public:
+  void PutOp(const Op aOp) { PutU8((uint8_t)aOp); }
+  void PutVector(const vrb::Vector& aValue) { Put(aValue.Data(), sizeof(float) * 3); }
+};
+
+class Reader : public vrb::CacheFileReader {
+public:
+  Reader(const char* aData, const size_t aSize) : vrb::CacheFileReader(aData, aSize) {}
+  vrb::Vector GetVector() {
+    float values[3];
+    Get(values, sizeof(values));
+    return vrb::Vector(values[0], values[1], values[2]);
+  }
+  void GetInts(std::vector<int>& aValues, const uint32_t aCount) {
+    aValues.resize(aCount);
+    if (aCount > 0) {
+      Get(aValues.data(), sizeof(int32_t) * aCount);
+    }
+  }
+};
+
+// Walks a cache entry, calling aObserver when it is not null. Returns false
+// if the entry is truncated or contains an unknown record.
+bool
+Replay(Reader& aReader, vrb::ParserObserverObj* aObserver) {
+  std::vector<int> vertices;
+  std::vector<int> uvs;
+  std::vector<int> normals;
+  std::vector<std::string> names;
+  while (aReader.IsValid() && !aReader.AtEnd()) {
+    uint8_t value = 0;
+    aReader.Get(&value, sizeof(value));
+    switch ((Op)value) {
+      case Op::StartModel: {
+        const std::string name = aReader.GetString();
+        if (aObserver) { aObserver->StartModel(name); }
+        break;
+      }
+      case Op::FinishModel:
+        if (aObserver) { aObserver->FinishModel(); }
+        break;
+      case Op::LoadMaterialLibrary: {
+        const std::string name = aReader.GetString();
+        if (aObserver) { aObserver->LoadMaterialLibrary(name); }
+        break;
+      }
+      case Op::SetGroupNames: {
+        const uint32_t count = aReader.GetU32();
+        names.clear();
+        for (uint32_t ix = 0; (ix < count) && aReader.IsValid(); ix++) {
+          names.push_back(aReader.GetString());
+        }
+        if (aObserver) { aObserver->SetGroupNames(names); }
+        break;
+      }
+      case Op::SetObjectName: {
+        const std::string name = aReader.GetString();
+        if (aObserver) { aObserver->SetObjectName(name); }
+        break;
+      }
+      case Op::SetMaterialName: {
+        const std::string name = aReader.GetString();
+        if (aObserver) { aObserver->SetMaterialName(name); }
+        break;
+      }
+      case Op::AddVertex: {
+        const vrb::Vector point = aReader.GetVector();
+        const float w = aReader.GetFloat();
+        if (aObserver) { aObserver->AddVertex(point, w); }
+        break;
+      }
+      case Op::AddNormal: {
+        const vrb::Vector normal = aReader.GetVector();
+        if (aObserver) { aObserver->AddNormal(normal); }
+        break;
+      }
+      case Op::AddUV: {
+        const vrb::Vector uv = aReader.GetVector();
+        if (aObserver) { aObserver->AddUV(uv.x(), uv.y(), uv.z()); }
+        break;
+      }
+      case Op::AddFace: {
+        const uint32_t count = aReader.GetU32();
+        aReader.GetInts(vertices, count);
+        aReader.GetInts(uvs, count);
+        aReader.GetInts(normals, count);
+        if (aObserver) { aObserver->AddFace(vertices, uvs, normals); }
+        break;
+      }
+      case Op::SetSmoothingGroup: {
+        const int32_t group = aReader.GetI32();
+        if (aObserver) { aObserver->SetSmoothingGroup(group); }
+        break;
+      }
+      case Op::StartMaterialFile: {
+        const std::string name = aReader.GetString();
+        if (aObserver) { aObserver->StartMaterialFile(name); }
+        break;
+      }
+      case Op::FinishMaterialFile:
+        if (aObserver) { aObserver->FinishMaterialFile(); }
+        break;
+      case Op::CreateMaterial: {
+        const std::string name = aReader.GetString();
+        if (aObserver) { aObserver->CreateMaterial(name); }
+        break;
+      }
+      case Op::SetAmbientColor: {
+        const vrb::Vector color = aReader.GetVector();
+        if (aObserver) { aObserver->SetAmbientColor(color); }
+        break;
+      }
+      case Op::SetDiffuseColor: {
+        const vrb::Vector color = aReader.GetVector();
+        if (aObserver) { aObserver->SetDiffuseColor(color); }
+        break;
+      }
+      case Op::SetSpecularColor: {
+        const vrb::Vector color = aReader.GetVector();
+        if (aObserver) { aObserver->SetSpecularColor(color); }
+        break;
+      }
+      case Op::SetSpecularExponent: {
+        const float exponent = aReader.GetFloat();
+        if (aObserver) { aObserver->SetSpecularExponent(exponent); }
+        break;
+      }
+      case Op::SetIlluniationModel: {
+        const int32_t model = aReader.GetI32();
+        if (aObserver) { aObserver->SetIlluniationModel(model); }
+        break;
+      }
+      case Op::SetAmbientTexture: {
+        const std::string name = aReader.GetString();
+        if (aObserver) { aObserver->SetAmbientTexture(name); }
+        break;
+      }
+      case Op::SetDiffuseTexture: {
+        const std::string name = aReader.GetString();
+        if (aObserver) { aObserver->SetDiffuseTexture(name); }
+        break;
+      }
+      case Op::SetSpecularTexture: {
+        const std::string name = aReader.GetString();
+        if (aObserver) { aObserver->SetSpecularTexture(name); }
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return aReader.IsValid();
+}
+
+class ModelRecorder;
+typedef std::shared_ptr<ModelRecorder> ModelRecorderPtr;
+
+// Forwards every call to the target observer while recording it.
+class ModelRecorder : public vrb::ParserObserverObj {
+public:
+  static ModelRecorderPtr Create(const std::string& aCacheFile, const std::string& aSource,
+                                 const SourceKey& aKey, const vrb::ParserObserverObjPtr& aTarget);
+  // Geometry Interface
+  void StartModel(const std::string& aFile) override {
+    mRecord.PutOp(Op::StartModel); mRecord.PutString(aFile);
+    mTarget->StartModel(aFile);
+  }
+  void FinishModel() override {
+    mRecord.PutOp(Op::FinishModel);
+    mTarget->FinishModel();
+    Write();
+  }
+  void LoadMaterialLibrary(const std::string& aFile) override {
+    mRecord.PutOp(Op::LoadMaterialLibrary); mRecord.PutString(aFile);
+    mTarget->LoadMaterialLibrary(aFile);
+  }
+  void SetGroupNames(const std::vector<std::string>& aNames) override {
+    mRecord.PutOp(Op::SetGroupNames);
+    mRecord.PutU32((uint32_t)aNames.size());
+    for (const std::string& name: aNames) { mRecord.PutString(name); }
+    mTarget->SetGroupNames(aNames);
+  }
+  void SetObjectName(const std::string& aName) override {
+    mRecord.PutOp(Op::SetObjectName); mRecord.PutString(aName);
+    mTarget->SetObjectName(aName);
+  }
+  void SetMaterialName(const std::string& aName) override {
+    mRecord.PutOp(Op::SetMaterialName); mRecord.PutString(aName);
+    mTarget->SetMaterialName(aName);
+  }
+  void AddVertex(const vrb::Vector& aPoint, const float aW) override {
+    mRecord.PutOp(Op::AddVertex); mRecord.PutVector(aPoint); mRecord.PutFloat(aW);
+    mTarget->AddVertex(aPoint, aW);
+  }
+  void AddNormal(const vrb::Vector& aNormal) override {
+    mRecord.PutOp(Op::AddNormal); mRecord.PutVector(aNormal);
+    mTarget->AddNormal(aNormal);
+  }
+  void AddUV(const float aU, const float aV, const float aW) override {
+    mRecord.PutOp(Op::AddUV); mRecord.PutVector(vrb::Vector(aU, aV, aW));
+    mTarget->AddUV(aU, aV, aW);
+  }
+  void AddFace(const std::vector<int>& aVerticies, const std::vector<int>& aUVs, const std::vector<int>& aNormals) override {
+    const uint32_t count = (uint32_t)aVerticies.size();
+    mRecord.PutOp(Op::AddFace);
+    mRecord.PutU32(count);
+    PutInts(aVerticies, count);
+    PutInts(aUVs, count);
+    PutInts(aNormals, count);
+    mTarget->AddFace(aVerticies, aUVs, aNormals);
+  }
+  void SetSmoothingGroup(const int aGroup) override {
+    mRecord.PutOp(Op::SetSmoothingGroup); mRecord.PutI32(aGroup);
+    mTarget->SetSmoothingGroup(aGroup);
+  }
+  void AddVertices(const float* aPoints, const size_t aCount) override {
+    for (size_t ix = 0; ix < aCount; ix++) {
+      mRecord.PutOp(Op::AddVertex); mRecord.Put(aPoints + (ix * 4), sizeof(float) * 4);
+    }
+    mTarget->AddVertices(aPoints, aCount);
+  }
+  void AddNormals(const float* aNormals, const size_t aCount) override {
+    for (size_t ix = 0; ix < aCount; ix++) {
+      mRecord.PutOp(Op::AddNormal); mRecord.Put(aNormals + (ix * 3), sizeof(float) * 3);
+    }
+    mTarget->AddNormals(aNormals, aCount);
+  }
+  void AddUVs(const float* aUVs, const size_t aCount) override {
+    for (size_t ix = 0; ix < aCount; ix++) {
+      mRecord.PutOp(Op::AddUV); mRecord.Put(aUVs + (ix * 3), sizeof(float) * 3);
+    }
+    mTarget->AddUVs(aUVs, aCount);
+  }
+  void AddFaces(const int* aIndices, const uint32_t* aCornerCounts, const size_t aFaceCount) override {
+    const int* indices = aIndices;
+    for (size_t ix = 0; ix < aFaceCount; ix++) {
+      const uint32_t count = aCornerCounts[ix];
+      mRecord.PutOp(Op::AddFace);
+      mRecord.PutU32(count);
+      for (uint32_t element = 0; element < 3; element++) {
+        for (uint32_t corner = 0; corner < count; corner++) {
+          mRecord.PutI32(indices[(corner * 3) + element]);
+        }
+      }
+      indices += count * 3;
+    }
+    mTarget->AddFaces(aIndices, aCornerCounts, aFaceCount);
+  }
+  // Material Interface
+  void StartMaterialFile(const std::string& aFileName) override {
+    mRecord.PutOp(Op::StartMaterialFile); mRecord.PutString(aFileName);
+    mTarget->StartMaterialFile(aFileName);
+  }
+  void FinishMaterialFile() override {
+    mRecord.PutOp(Op::FinishMaterialFile);
+    mTarget->FinishMaterialFile();
+    // Material files read asynchronously may finish after the model.
+    if (mFinished) { Write(); }
+  }
+  void CreateMaterial(const std::string& aName) override {
+    mRecord.PutOp(Op::CreateMaterial); mRecord.PutString(aName);
+    mTarget->CreateMaterial(aName);
+  }
+  void SetAmbientColor(const vrb::Vector& aColor) override {
+    mRecord.PutOp(Op::SetAmbientColor); mRecord.PutVector(aColor);
+    mTarget->SetAmbientColor(aColor);
+  }
+  void SetDiffuseColor(const vrb::Vector& aColor) override {
+    mRecord.PutOp(Op::SetDiffuseColor); mRecord.PutVector(aColor);
+    mTarget->SetDiffuseColor(aColor);
+  }
+  void SetSpecularColor(const vrb::Vector& aColor) override {
+    mRecord.PutOp(Op::SetSpecularColor); mRecord.PutVector(aColor);
+    mTarget->SetSpecularColor(aColor);
+  }
+  void SetSpecularExponent(const float aValue) override {
+    mRecord.PutOp(Op::SetSpecularExponent); mRecord.PutFloat(aValue);
+    mTarget->SetSpecularExponent(aValue);
+  }
+  void SetIlluniationModel(const int aValue) override {
+    mRecord.PutOp(Op::SetIlluniationModel); mRecord.PutI32(aValue);
+    mTarget->SetIlluniationModel(aValue);
+  }
+  void SetAmbientTexture(const std::string& aFileName) override {
+    mRecord.PutOp(Op::SetAmbientTexture); mRecord.PutString(aFileName);
+    mTarget->SetAmbientTexture(aFileName);
+  }
+  void SetDiffuseTexture(const std::string& aFileName) override {
+    mRecord.PutOp(Op::SetDiffuseTexture); mRecord.PutString(aFileName);
+    mTarget->SetDiffuseTexture(aFileName);
+  }
+  void SetSpecularTexture(const std::string& aFileName) override {
+    mRecord.PutOp(Op::SetSpecularTexture); mRecord.PutString(aFileName);
+    mTarget->SetSpecularTexture(aFileName);
+  }
+
+  ModelRecorder() : mKey{0, 0}, mFinished(false) {}
+  ~ModelRecorder() {}
+protected:
+  void PutInts(const std::vector<int>& aValues, const uint32_t aCount) {
+    for (uint32_t ix = 0; ix < aCount; ix++) {
+      mRecord.PutI32(ix < aValues.size() ? aValues[ix] : 0);
+    }
+  }
+  void Write();
+
+  std::string mCacheFile;
+  std::string mSource;
+  SourceKey mKey;
+  vrb::ParserObserverObjPtr mTarget;
+  Writer mRecord;
+  bool mFinished;
+private:
+  VRB_NO_DEFAULTS(ModelRecorder)
+};
+
+ModelRecorderPtr
+ModelRecorder::Create(const std::string& aCacheFile, const std::string& aSource,
+                      const SourceKey& aKey, const vrb::ParserObserverObjPtr& aTarget) {
+  ModelRecorderPtr result = std::make_shared<ModelRecorder>();
+  result->mCacheFile = aCacheFile;
+  result->mSource = aSource;
+  result->mKey = aKey;
+  result->mTarget = aTarget;
+  return result;
+}
+
+void
+ModelRecorder::Write() {
+  mFinished = true;
+  Writer header;
+  header.PutU32(kMagic);
+  header.PutU32(kVersion);
+  header.Put(&mKey.size, sizeof(mKey.size));
+  header.Put(&mKey.modified, sizeof(mKey.modified));
+  header.PutString(mSource);
+  vrb::CacheFileOutput output(mCacheFile, "model cache");
+  if (!output.IsOpen()) {
+    return;
+  }
+  output.Write(header);
+  output.Write(mRecord);
+  if (!output.Commit()) {
+    return;
+  }
+  VRB_DEBUG("Wrote model cache '%s' for '%s'", mCacheFile.c_str(), mSource.c_str());
+}
+
+} // namespace
+
+namespace vrb {
+
+struct ModelCacheObj::State {
+  std::string directory;
+  State() {}
+  std::string GetCacheFile(const std::string& aFileName) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.vrbm", (unsigned long long)CacheFileHash(aFileName));
+    return directory + "/" + name;
+  }
+};
+
+ModelCacheObjPtr
+ModelCacheObj::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<ModelCacheObj, ModelCacheObj::State> >(aContext);
+}
+
+void
+ModelCacheObj::SetCacheDirectory(const std::string& aDirectory) {
+  m.directory = aDirectory;
+}
+
+bool
+ModelCacheObj::LoadModel(const std::string& aFileName, ParserObserverObj& aObserver) {
+  SourceKey key;
+  if (m.directory.empty() || !GetSourceKey(aFileName, key)) {
+    return false;
+  }
+  MappedFile mapping(m.GetCacheFile(aFileName));
+  if (!mapping.IsValid()) {
+    return false;
+  }
+  Reader reader(mapping.Data(), mapping.Size());
+  SourceKey cached = {0, 0};
+  const uint32_t magic = reader.GetU32();
+  const uint32_t version = reader.GetU32();
+  reader.Get(&cached.size, sizeof(cached.size));
+  reader.Get(&cached.modified, sizeof(cached.modified));
+  const std::string source = reader.GetString();
+  if (!reader.IsValid() || (magic != kMagic) || (version != kVersion) || (source != aFileName) ||
+      (cached.size != key.size) || (cached.modified != key.modified)) {
+    return false;
+  }
+  // Validate the whole entry before making any observer calls.
+  Reader validate = reader;
+  if (!Replay(validate, nullptr)) {
+    VRB_WARN("Corrupt model cache for: '%s'", aFileName.c_str());
+    return false;
+  }
+  VRB_LOG("Loading cached model: '%s'", aFileName.c_str());
+  return Replay(reader, &aObserver);
+}
+
+ParserObserverObjPtr
+ModelCacheObj::CreateRecorder(const std::string& aFileName, const ParserObserverObjPtr& aObserver) {
+  SourceKey key;
+  if (m.directory.empty() || !GetSourceKey(aFileName, key)) {
+    return aObserver;
+  }
+  return ModelRecorder::Create(m.GetCacheFile(aFileName), aFileName, key, aObserver);
+}
+
+ModelCacheObj::ModelCacheObj(State& aState, CreationContextPtr& aContext) : m(aState) {}
+ModelCacheObj::~ModelCacheObj() {}
+
+} // namespace vrb
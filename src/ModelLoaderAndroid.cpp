@@ -9,17 +9,28 @@
 #include "vrb/Group.h"
 #include "vrb/ClassLoaderAndroid.h"
 #include "vrb/ConditionVariable.h"
-#include "vrb/ContextSynchronizer.h"
 #include "vrb/CreationContext.h"
 #include "vrb/FileReaderAndroid.h"
+#include "vrb/GLError.h"
 #include "vrb/Logger.h"
+#include "vrb/ModelCache.h"
+#include "vrb/NodeFactoryGLTF.h"
 #include "vrb/NodeFactoryObj.h"
 #include "vrb/ParserObj.h"
 #include "vrb/SharedEGLContext.h"
 #include "vrb/RenderContext.h"
 #include "vrb/ThreadUtils.h"
+#include "vrb/gl.h"
 
+#include "vrb/private/Clock.h"
+#include "vrb/private/LoadQueue.h"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
 #include <pthread.h>
+#include <thread>
+#include <time.h>
 #include <vector>
 
 namespace vrb {
@@ -46,109 +57,150 @@ protected:
 
 static LoadFinishedCallback sNoop = [](GroupPtr&){};
 
-struct LoadInfo {
-  GroupPtr target;
-  LoadTask task;
-  LoadFinishedCallback callback;
-  LoadInfo(GroupPtr& aGroup, LoadTask& aTask, LoadFinishedCallback& aCallback)
-      : target(aGroup)
-      , task(aTask)
-      , callback(aCallback)
-  {}
-  LoadInfo(const LoadInfo& aInfo)
-      : target(aInfo.target)
-      , task(aInfo.task)
-      , callback(aInfo.callback)
-  {}
-  LoadInfo& operator=(const LoadInfo& aInfo) {
-    target = aInfo.target;
-    task = aInfo.task;
-    callback = aInfo.callback;
-    return *this;
-  }
-private:
-  LoadInfo() = delete;
-};
-
-class ModelLoaderAndroidSynchronizerObserver;
-typedef std::shared_ptr<ModelLoaderAndroidSynchronizerObserver> ModelLoaderAndroidSynchronizerObserverPtr;
-
-class ModelLoaderAndroidSynchronizerObserver : public ContextSynchronizerObserver {
-public:
-  static ModelLoaderAndroidSynchronizerObserverPtr Create() {
-    return std::make_shared<ModelLoaderAndroidSynchronizerObserver>();
-  }
-  void Set(GroupPtr& aSource, GroupPtr& aTarget, LoadFinishedCallback& aCallback) {
-    mSource = aSource;
-    mTarget = aTarget;
-    mCallback = aCallback;
-  }
-
-  void AddFinishedCallbacks(std::vector<LoadFinishedCallback>& aCallbacks) {
-    finishCallbacks.swap(aCallbacks);
-  }
-
-  void ContextsSynchronized(RenderContextPtr& aRenderContext) override {
-    if (mTarget && mSource) {
-      mTarget->TakeChildren(mSource);
-    }
-    mCallback(mTarget);
-    mTarget = mSource = nullptr;
-    mCallback = sNoop;
-    GroupPtr nullGroup;
-    for (LoadFinishedCallback& cb : finishCallbacks) {
-      if (cb) {
-        cb(nullGroup);
-      }
-    }
-    finishCallbacks.clear();
-  }
-  ModelLoaderAndroidSynchronizerObserver() {}
-protected:
-  GroupPtr mSource;
-  GroupPtr mTarget;
-  LoadFinishedCallback mCallback;
-  std::vector<LoadFinishedCallback> finishCallbacks;
-private:
-  VRB_NO_DEFAULTS(ModelLoaderAndroidSynchronizerObserver)
-};
+// Leave a core for the render thread when picking the default worker count.
+static const int kMaxDefaultWorkers = 4;
 
 struct ModelLoaderAndroid::State {
+  // Runs the CPU stage of load tasks: parsing, image decode and node creation.
+  struct Worker {
+    State* owner;
+    pthread_t thread;
+    CreationContextPtr context;
+    std::vector<LoadFinishedCallback> finishCallbacks;
+    bool uploadPending;
+    // Report of the task being uploaded, made current on the upload thread.
+    LoadReportCollectorPtr report;
+    // Signaled once the upload is done on the GPU, the render thread waits
+    // on it before using the nodes.
+    GLsync fence;
+    int index;
+    Worker() : owner(nullptr), thread(), uploadPending(false), fence(nullptr), index(0) {}
+  };
+  // Runs the GL stage, the uploads of finished tasks, with a shared EGL
+  // context of its own.
+  struct Uploader {
+    State* owner;
+    pthread_t thread;
+    SharedEGLContextPtr eglContext;
+    Uploader() : owner(nullptr), thread() {}
+  };
   bool running;
   JavaVM* jvm;
   JNIEnv* renderThreadEnv;
-  JNIEnv* env;
   jobject activity;
   jobject assets;
   RenderContextWeak render;
-  CreationContextPtr context;
-  SharedEGLContextPtr eglContext;
-  pthread_t child;
+  // Created on the render thread by InitializeGL(), one per uploader.
+  std::vector<SharedEGLContextPtr> eglContexts;
+  int workerCount;
+  int uploaderCount;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::unique_ptr<Uploader>> uploaders;
+  // Guards loadList, uploadList, done, quitting, stoppedWorkers,
+  // stoppedUploaders and activeLimit. It is
+  // waited on with different conditions so it is always broadcast.
   ConditionVariable loadLock;
   bool done;
   bool quitting;
-  std::vector<LoadInfo> loadList;
-  std::vector<LoadFinishedCallback> finishCallbacks;
+  int stoppedWorkers;
+  int stoppedUploaders;
+  // See SetActiveWorkerLimit().
+  int activeLimit;
+  LoadQueue loadList;
+  std::deque<Worker*> uploadList;
+  ModelCachePtr modelCache;
+  LoadReportCallback reportCallback;
+  bool logReports;
   State()
       : running(false)
       , jvm(nullptr)
       , renderThreadEnv(nullptr)
-      , env(nullptr)
       , activity(nullptr)
       , assets(nullptr)
+      , workerCount(0)
+      , uploaderCount(0)
       , done(false)
       , quitting(false)
+      , stoppedWorkers(0)
+      , stoppedUploaders(0)
+      , activeLimit(0)
+      , logReports(false)
   {}
+  int GetWorkerCount() const {
+    if (workerCount > 0) {
+      return workerCount;
+    }
+    const int kCores = (int)std::thread::hardware_concurrency();
+    return std::max(1, std::min(kCores - 1, kMaxDefaultWorkers));
+  }
+
+  int GetUploaderCount() const {
+    const int kWorkers = GetWorkerCount();
+    return uploaderCount > 0 ? std::min(uploaderCount, kWorkers) : kWorkers;
+  }
+
   void StartThread() {
     if (running) {
       return;
     }
-    if (!renderThreadEnv || !eglContext) {
+    if (!renderThreadEnv || eglContexts.empty()) {
+      return;
+    }
+    RenderContextPtr context = render.lock();
+    if (!context) {
       return;
     }
+    const int kCount = GetWorkerCount();
+    for (int ix = 0; ix < kCount; ix++) {
+      std::unique_ptr<Worker> worker(new Worker);
+      worker->owner = this;
+      worker->index = ix;
+      // CreationContexts may only be created on the render thread.
+      worker->context = CreationContext::Create(context);
+      if (!worker->context) {
+        break;
+      }
+      workers.push_back(std::move(worker));
+    }
+    for (SharedEGLContextPtr& eglContext: eglContexts) {
+      std::unique_ptr<Uploader> uploader(new Uploader);
+      uploader->owner = this;
+      uploader->eglContext = eglContext;
+      uploaders.push_back(std::move(uploader));
+    }
+    // Held until the lists only hold started threads, which read them once
+    // they have the lock.
+    MutexAutoLock lock(loadLock);
     done = false;
-    pthread_create(&child, nullptr, &ModelLoaderAndroid::Run, this);
+    quitting = false;
+    stoppedWorkers = 0;
+    stoppedUploaders = 0;
     running = true;
+    size_t started = 0;
+    for (; started < uploaders.size(); started++) {
+      Uploader& uploader = *uploaders[started];
+      if (pthread_create(&(uploader.thread), nullptr, &ModelLoaderAndroid::Run, &uploader) != 0) {
+        VRB_ERROR("ModelLoaderAndroid failed to start upload thread %d", (int)started);
+        break;
+      }
+    }
+    uploaders.resize(started);
+    if (uploaders.empty()) {
+      // Workers would wait for their uploads forever.
+      workers.clear();
+      running = false;
+      return;
+    }
+    started = 0;
+    for (; started < workers.size(); started++) {
+      Worker& worker = *workers[started];
+      if (pthread_create(&(worker.thread), nullptr, &ModelLoaderAndroid::RunWorker, &worker) != 0) {
+        VRB_ERROR("ModelLoaderAndroid failed to start load thread %d", (int)started);
+        break;
+      }
+    }
+    // Without workers the uploaders quit right away, StopThread() joins them.
+    workers.resize(started);
   }
 
   void StopThread() {
@@ -159,31 +211,72 @@ struct ModelLoaderAndroid::State {
     if (context) {
       context->Update();
     }
-    VRB_LOG("Waiting for ModelLoaderAndroid load thread to stop.");
+    VRB_LOG("Waiting for ModelLoaderAndroid load threads to stop.");
     {
       MutexAutoLock lock(loadLock);
       done = true;
-      loadLock.Signal();
+      loadList.Clear();
+      loadLock.Broadcast();
     }
-    bool gotQuit = false;
-    while (!gotQuit) {
-      if (context) {
-        context->Update();
-      }
+    {
+      // Uploads run on the uploaders, so no thread waits for the render
+      // thread and this may block.
       MutexAutoLock lock(loadLock);
-      gotQuit = quitting;
+      while (!quitting) {
+        loadLock.Wait();
+      }
+    }
+    bool joined = true;
+    for (std::unique_ptr<Uploader>& uploader: uploaders) {
+      joined = (pthread_join(uploader->thread, nullptr) == 0) && joined;
     }
-    if (pthread_join(child, nullptr) == 0) {
-      VRB_LOG("ModelLoaderAndroid load thread stopped");
+    for (std::unique_ptr<Worker>& worker: workers) {
+      joined = (pthread_join(worker->thread, nullptr) == 0) && joined;
+    }
+    if (joined) {
+      VRB_LOG("ModelLoaderAndroid load threads stopped");
     } else {
-      VRB_ERROR("ModelLoaderAndroid load thread failed to stop");
+      VRB_ERROR("ModelLoaderAndroid load threads failed to stop");
     }
+    workers.clear();
+    uploaders.clear();
     running = false;
+    if (context) {
+      // Adopts what the last tasks handed off.
+      context->Update();
+    }
+  }
+
+  Worker* GetCurrentWorker() const {
+    if (!running) {
+      return nullptr;
+    }
+    const pthread_t self = pthread_self();
+    for (const std::unique_ptr<Worker>& worker: workers) {
+      if (pthread_equal(worker->thread, self) > 0) {
+        return worker.get();
+      }
+    }
+    return nullptr;
+  }
+
+  bool
+  IsParked(const Worker& aWorker) const {
+    return (activeLimit > 0) && (aWorker.index >= activeLimit);
   }
 
   bool
   IsOnLoaderThread() const {
-    return running && (pthread_equal(child, pthread_self()) > 0);
+    if (!running) {
+      return false;
+    }
+    const pthread_t self = pthread_self();
+    for (const std::unique_ptr<Uploader>& uploader: uploaders) {
+      if (pthread_equal(uploader->thread, self) > 0) {
+        return true;
+      }
+    }
+    return GetCurrentWorker() != nullptr;
   }
 };
 
@@ -226,15 +319,41 @@ ModelLoaderAndroid::ShutdownJava() {
 
 void
 ModelLoaderAndroid::InitializeGL() {
-  m.eglContext = SharedEGLContext::Create();
-  m.eglContext->Initialize();
+  m.StopThread();
+  m.eglContexts.clear();
+  const int kCount = m.GetUploaderCount();
+  for (int ix = 0; ix < kCount; ix++) {
+    SharedEGLContextPtr eglContext = SharedEGLContext::Create();
+    // Uploaders left without a context hand their resources to the render
+    // thread, so only the first one is kept when none can be created.
+    if (!eglContext->Initialize() && (ix > 0)) {
+      VRB_WARN("ModelLoaderAndroid: only %d of %d shared EGL contexts created", ix, kCount);
+      break;
+    }
+    m.eglContexts.push_back(eglContext);
+  }
   m.StartThread();
 }
 
 void
 ModelLoaderAndroid::ShutdownGL() {
   m.StopThread();
-  m.eglContext = nullptr;
+  m.eglContexts.clear();
+}
+
+void
+ModelLoaderAndroid::SetModelCache(const ModelCachePtr& aCache) {
+  m.modelCache = aCache;
+}
+
+void
+ModelLoaderAndroid::SetLoadReportCallback(const LoadReportCallback& aCallback) {
+  m.reportCallback = aCallback;
+}
+
+void
+ModelLoaderAndroid::SetLoadReportLogging(const bool aEnabled) {
+  m.logReports = aEnabled;
 }
 
 void
@@ -249,20 +368,43 @@ ModelLoaderAndroid::LoadModel(vrb::LoadTask aLoadTask, GroupPtr aTargetNode) {
 
 void
 ModelLoaderAndroid::LoadModel(const std::string& aModelName, GroupPtr aTargetNode, LoadFinishedCallback& aCallback) {
-  LoadTask task = [aModelName](CreationContextPtr& aContext) -> GroupPtr {
+  LoadModel(aModelName, std::move(aTargetNode), aCallback, nullptr);
+}
+
+void
+ModelLoaderAndroid::LoadModel(const std::string& aModelName, GroupPtr aTargetNode, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken) {
+  ModelCachePtr cache = m.modelCache;
+  LoadTask task = [aModelName, cache](CreationContextPtr& aContext) -> GroupPtr {
     LoadTimer timer;
     timer.Start();
-    NodeFactoryObjPtr factory = NodeFactoryObj::Create(aContext);
-    ParserObjPtr parser = ParserObj::Create(aContext);
-    parser->SetFileReader(aContext->GetFileReader());
-    parser->SetObserver(factory);
+    LoadReportCollectorPtr report = LoadReportCollector::GetCurrent();
+    if (report) {
+      report->SetName(aModelName);
+    }
     GroupPtr group = Group::Create(aContext);
-    factory->SetModelRoot(group);
-    parser->LoadModel(aModelName);
+    if (NodeFactoryGLTF::IsGLTFFile(aModelName)) {
+      NodeFactoryGLTFPtr factory = NodeFactoryGLTF::Create(aContext);
+      factory->SetModelRoot(group);
+      factory->LoadModel(aModelName);
+    } else {
+      GroupPtr instance = cache ? cache->Instantiate(aContext, aModelName) : nullptr;
+      if (instance) {
+        return instance;
+      }
+      NodeFactoryObjPtr factory = NodeFactoryObj::Create(aContext);
+      ParserObjPtr parser = ParserObj::Create(aContext);
+      parser->SetFileReader(aContext->GetFileReader());
+      parser->SetObserver(factory);
+      factory->SetModelRoot(group);
+      parser->LoadModel(aModelName);
+      if (cache) {
+        cache->Add(aModelName, group);
+      }
+    }
     VRB_LOG("TIMER Load time for %s: %f sec", aModelName.c_str(), timer.Sample());
     return group;
   };
-  RunLoadTask(std::move(aTargetNode), task, aCallback);
+  RunLoadTask(std::move(aTargetNode), task, aCallback, aToken);
 }
 
 void
@@ -272,94 +414,199 @@ ModelLoaderAndroid::RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask) {
 
 void
 ModelLoaderAndroid::RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback) {
+  RunLoadTask(std::move(aTargetNode), aTask, aCallback, nullptr);
+}
+
+void
+ModelLoaderAndroid::RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken) {
   MutexAutoLock lock(m.loadLock);
-  m.loadList.emplace_back(LoadInfo(aTargetNode, aTask,  aCallback));
-  m.loadLock.Signal();
+  m.loadList.Push(LoadInfo(aTargetNode, aTask, aCallback, aToken));
+  m.loadLock.Broadcast();
 }
 
 /* static */ void*
 ModelLoaderAndroid::Run(void* data) {
-  ModelLoaderAndroid::State& m = *(ModelLoaderAndroid::State*)data;
-  m.context->BindToThread();
+  ModelLoaderAndroid::State::Uploader& uploader = *(ModelLoaderAndroid::State::Uploader*)data;
+  ModelLoaderAndroid::State& m = *uploader.owner;
+  JNIEnv* env = nullptr;
   bool attached = false;
-  if (m.jvm->AttachCurrentThread(&(m.env), nullptr) == 0) {
-    SetThreadName("VRB Loader");
+  if (m.jvm->AttachCurrentThread(&env, nullptr) == 0) {
+    SetThreadName("VRB Loader GL");
     attached = true;
-    const bool offRenderThreadContextCurrent = m.eglContext->MakeCurrent();
-    if (!offRenderThreadContextCurrent) {
-      VRB_ERROR("Failed to make shared context current. VRB Nodes will be initialized on render thread");
+  }
+  const bool offRenderThreadContextCurrent = uploader.eglContext->MakeCurrent();
+  if (!offRenderThreadContextCurrent) {
+    VRB_ERROR("Failed to make shared context current. VRB Nodes will be initialized on render thread");
+  }
+  {
+    LoadTimer timer;
+
+    // Uploads of the workers are spread over the uploaders, each with its
+    // own shared EGL context current, so they run in parallel. The threads
+    // keep running until every worker has quit so no worker waits forever.
+    bool quit = false;
+    while (!quit) {
+      State::Worker* worker = nullptr;
+      {
+        MutexAutoLock lock(m.loadLock);
+        while (m.uploadList.empty() && (m.stoppedWorkers < (int)m.workers.size())) {
+          m.loadLock.Wait();
+        }
+        if (m.uploadList.empty()) {
+          quit = true;
+          continue;
+        }
+        worker = m.uploadList.front();
+        m.uploadList.pop_front();
+      }
+      // The worker is blocked until the upload is marked finished so its
+      // resource lists are not touched by any other thread.
+      if (offRenderThreadContextCurrent) {
+        LoadReportScope scope(worker->report);
+        timer.Start();
+        worker->context->UpdateResourceGL();
+        // Flushed so the fence is signaled without another call on this
+        // context.
+        VRB_GL_CHECK(worker->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        VRB_GL_CHECK(glFlush());
+        // RenderContext::Update() only checks the render thread context.
+        GLErrorCheckWork("a loader upload");
+        VRB_DEBUG("TIMER Update GL resources: %f sec", timer.Sample());
+      }
+      MutexAutoLock lock(m.loadLock);
+      worker->uploadPending = false;
+      m.loadLock.Broadcast();
     }
+  }
+  if (attached) {
+    m.jvm->DetachCurrentThread();
+  }
+  {
+    MutexAutoLock lock(m.loadLock);
+    m.stoppedUploaders++;
+    m.quitting = m.stoppedUploaders == (int)m.uploaders.size();
+    m.loadLock.Broadcast();
+  }
+  VRB_LOG("ModelLoaderAndroid load thread stopping");
+  return nullptr;
+}
+
+/* static */ void*
+ModelLoaderAndroid::RunWorker(void* data) {
+  ModelLoaderAndroid::State::Worker& worker = *(ModelLoaderAndroid::State::Worker*)data;
+  ModelLoaderAndroid::State& m = *worker.owner;
+  worker.context->BindToThread();
+  JNIEnv* env = nullptr;
+  bool attached = false;
+  if (m.jvm->AttachCurrentThread(&env, nullptr) == 0) {
+    SetThreadName("VRB Loader");
+    attached = true;
     ClassLoaderAndroidPtr classLoader = ClassLoaderAndroid::Create();
-    classLoader->Init(m.env, m.activity);
+    classLoader->Init(env, m.activity);
     FileReaderAndroidPtr reader = FileReaderAndroid::Create();
-    reader->Init(m.env, m.assets, classLoader);
-    m.context->SetFileReader(reader);
-    ModelLoaderAndroidSynchronizerObserverPtr finalizer = ModelLoaderAndroidSynchronizerObserver::Create();
-    ContextSynchronizerObserverPtr obs = finalizer;
-    m.context->RegisterContextSynchronizerObserver(obs);
+    reader->Init(env, m.assets, classLoader);
+    worker.context->SetFileReader(reader);
 
     LoadTimer timer;
     LoadTimer total;
-    float accumulativeTime = 0.0f;
 
-    bool done = false;
-    while (!done) {
-      std::vector<LoadInfo> list;
+    while (true) {
+      std::unique_ptr<LoadInfo> info;
       {
         MutexAutoLock lock(m.loadLock);
-        list.swap(m.loadList);
-        done = m.done;
-        while (list.empty() && !done) {
+        // Priorities are read when the task is taken so they may change while queued.
+        while (!m.done && (m.IsParked(worker) || !m.loadList.Pop(info))) {
           m.loadLock.Wait();
-          list.swap(m.loadList);
-          done = m.done;
+        }
+        if (m.done) {
+          break;
         }
       }
 
-      if (!done) {
-        for (LoadInfo& info: list) {
-          total.Start();
-          timer.Start();
-          GroupPtr group = info.task(m.context);
-          VRB_DEBUG("TIMER Off-render-thread asset task: %f sec", timer.Sample());
-          finalizer->Set(group, info.target, info.callback);
-          if (offRenderThreadContextCurrent) {
-            timer.Start();
-            m.context->UpdateResourceGL();
-            VRB_DEBUG("TIMER Update GL resources: %f sec", timer.Sample());
-          }
-          finalizer->AddFinishedCallbacks(m.finishCallbacks);
-          timer.Start();
-          m.context->Synchronize();
-          const float thisLoad = total.Sample();
-          accumulativeTime += thisLoad;
-          VRB_DEBUG("TIMER Total asset processing time: %f sec", thisLoad);
-          VRB_LOG("TIMER Accumulative time loading assets: %f sec", accumulativeTime);
+      total.Start();
+      timer.Start();
+      const double kStartTime = GetMonotonicSeconds();
+      LoadReportCollectorPtr report = (m.reportCallback || m.logReports) ? LoadReportCollector::Create() : nullptr;
+      GroupPtr group;
+      {
+        LoadReportScope scope(report);
+        group = info->task(worker.context);
+      }
+      VRB_DEBUG("TIMER Off-render-thread asset task: %f sec", timer.Sample());
+      if (info->IsCancelled()) {
+        // Releasing the nodes removes their resources from the context lists
+        // so nothing is uploaded.
+        VRB_DEBUG("Dropping cancelled load task");
+        continue;
+      }
+      {
+        MutexAutoLock lock(m.loadLock);
+        worker.uploadPending = true;
+        worker.report = report;
+        m.uploadList.push_back(&worker);
+        m.loadLock.Broadcast();
+        while (worker.uploadPending) {
+          m.loadLock.Wait();
         }
+        worker.report = nullptr;
       }
+      LoadFinishedCallback reportCallback = FinishLoadReport(report, group, GetMonotonicSeconds() - kStartTime, m.reportCallback, m.logReports);
+      ContextsSynchronizedLambda finalizer = CreateLoadFinalizer(group, *info, worker.finishCallbacks, reportCallback);
+      GLsync fence = worker.fence;
+      worker.fence = nullptr;
+      // Returns without waiting for the render thread so the next task can start.
+      worker.context->Synchronize([fence, finalizer](RenderContextPtr& aContext) {
+        if (fence) {
+          // Waits on the GPU, the render thread is not blocked.
+          VRB_GL_CHECK(glWaitSync(fence, 0, GL_TIMEOUT_IGNORED));
+          VRB_GL_CHECK(glDeleteSync(fence));
+        }
+        finalizer(aContext);
+      });
+      VRB_DEBUG("TIMER Total asset processing time: %f sec", total.Sample());
     }
 
-    m.env = nullptr;
-
-    m.context->ReleaseContextSynchronizerObserver(obs);
+    worker.context->SetFileReader(nullptr);
   }
   if (attached) {
     m.jvm->DetachCurrentThread();
   }
   {
     MutexAutoLock lock(m.loadLock);
-    m.quitting = true;
+    m.stoppedWorkers++;
+    m.loadLock.Broadcast();
   }
-  VRB_LOG("ModelLoaderAndroid load thread stopping");
   return nullptr;
 }
 
 void
 ModelLoaderAndroid::AddFinishedCallback(LoadFinishedCallback& aCallback) {
-  if (!m.IsOnLoaderThread()) {
-    VRB_ERROR("ModelLoaderAndroid::AddFinisedhCallback must be called on the loading thread");
+  State::Worker* worker = m.GetCurrentWorker();
+  if (!worker) {
+    VRB_ERROR("ModelLoaderAndroid::AddFinisedhCallback must be called on a load task thread");
+    return;
+  }
+  worker->finishCallbacks.emplace_back(aCallback);
+}
+
+void
+ModelLoaderAndroid::SetWorkerCount(const int aCount) {
+  m.workerCount = aCount;
+}
+
+void
+ModelLoaderAndroid::SetUploadThreadCount(const int aCount) {
+  m.uploaderCount = aCount;
+}
+
+void
+ModelLoaderAndroid::SetActiveWorkerLimit(const int aLimit) {
+  MutexAutoLock lock(m.loadLock);
+  if (aLimit != m.activeLimit) {
+    m.activeLimit = aLimit;
+    VRB_LOG("ModelLoaderAndroid active workers limited to %d", aLimit);
+    m.loadLock.Broadcast();
   }
-  m.finishCallbacks.emplace_back(aCallback);
 }
 
 bool
@@ -370,7 +617,6 @@ ModelLoaderAndroid::IsOnLoaderThread() const {
 
 ModelLoaderAndroid::ModelLoaderAndroid(State& aState, RenderContextPtr& aContext)
     : m(aState) {
-  m.context = CreationContext::Create(aContext);
   m.render = aContext;
 }
 
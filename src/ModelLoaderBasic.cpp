@@ -0,0 +1,351 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/ModelLoaderBasic.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/ConditionVariable.h"
+#include "vrb/CreationContext.h"
+#include "vrb/FileReaderBasic.h"
+#include "vrb/Group.h"
+#include "vrb/Logger.h"
+#include "vrb/ModelCache.h"
+#include "vrb/NodeFactoryGLTF.h"
+#include "vrb/NodeFactoryObj.h"
+#include "vrb/ParserObj.h"
+#include "vrb/RenderContext.h"
+
+#include "vrb/private/Clock.h"
+#include "vrb/private/LoadQueue.h"
+
+#include <algorithm>
+#include <memory>
+#include <pthread.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+vrb::LoadFinishedCallback sNoop = [](vrb::GroupPtr&){};
+
+} // namespace
+
+namespace vrb {
+
+struct ModelLoaderBasic::State {
+  struct Worker {
+    State* owner;
+    pthread_t thread;
+    int index;
+    std::vector<LoadFinishedCallback> finishCallbacks;
+    Worker() : owner(nullptr), thread(), index(0) {}
+  };
+  RenderContextWeak render;
+  // Shared by every worker, each one hands off only the resources it created.
+  CreationContextPtr context;
+  int workerCount;
+  // Workers are only added and removed on the render thread while no worker is running.
+  std::vector<std::unique_ptr<Worker>> workers;
+  ConditionVariable loadLock;
+  // Guarded by loadLock, see SetActiveWorkerLimit().
+  int activeLimit;
+  bool running;
+  bool done;
+  int stopped;
+  LoadQueue loadList;
+  ModelCachePtr modelCache;
+  LoadReportCallback reportCallback;
+  bool logReports;
+  State()
+      : workerCount(0)
+      , activeLimit(0)
+      , running(false)
+      , done(false)
+      , stopped(0)
+      , logReports(false)
+  {}
+
+  bool IsParked(const Worker& aWorker) const {
+    return (activeLimit > 0) && (aWorker.index >= activeLimit);
+  }
+
+  Worker* GetCurrentWorker() const {
+    if (!running) {
+      return nullptr;
+    }
+    const pthread_t self = pthread_self();
+    for (const std::unique_ptr<Worker>& worker: workers) {
+      if (pthread_equal(worker->thread, self) != 0) {
+        return worker.get();
+      }
+    }
+    return nullptr;
+  }
+
+  void StartThreads() {
+    if (running) {
+      return;
+    }
+    RenderContextPtr context = render.lock();
+    if (!context) {
+      return;
+    }
+    int count = workerCount;
+    if (count <= 0) {
+      count = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    // CreationContexts may only be created on the render thread.
+    this->context = CreationContext::Create(context);
+    if (!this->context) {
+      return;
+    }
+    this->context->SetFileReader(FileReaderBasic::Create());
+    done = false;
+    stopped = 0;
+    for (int ix = 0; ix < count; ix++) {
+      std::unique_ptr<Worker> worker(new Worker);
+      worker->owner = this;
+      worker->index = ix;
+      workers.push_back(std::move(worker));
+    }
+    // Mark running before the threads start so IsOnLoaderThread works from the first task.
+    running = true;
+    {
+      // Held until the list only holds started workers, which read it once
+      // they have the lock.
+      MutexAutoLock lock(loadLock);
+      size_t started = 0;
+      for (; started < workers.size(); started++) {
+        Worker& worker = *workers[started];
+        if (pthread_create(&(worker.thread), nullptr, &ModelLoaderBasic::Run, &worker) != 0) {
+          VRB_ERROR("ModelLoaderBasic failed to start load thread %d", (int)started);
+          break;
+        }
+      }
+      workers.resize(started);
+    }
+    if (workers.empty()) {
+      this->context = nullptr;
+      running = false;
+      return;
+    }
+    VRB_LOG("ModelLoaderBasic started %d load threads", (int)workers.size());
+  }
+
+  void StopThreads() {
+    if (!running) {
+      return;
+    }
+    VRB_LOG("Waiting for ModelLoaderBasic load threads to stop.");
+    {
+      MutexAutoLock lock(loadLock);
+      done = true;
+      loadList.Clear();
+      loadLock.Broadcast();
+      // Tasks hand their nodes off without waiting for the render thread, so
+      // this may block.
+      while (stopped < (int)workers.size()) {
+        loadLock.Wait();
+      }
+    }
+    for (std::unique_ptr<Worker>& worker: workers) {
+      if (pthread_join(worker->thread, nullptr) != 0) {
+        VRB_ERROR("ModelLoaderBasic load thread failed to stop");
+      }
+    }
+    workers.clear();
+    this->context = nullptr;
+    running = false;
+    RenderContextPtr context = render.lock();
+    if (context) {
+      // Adopts the batches handed off by the last tasks.
+      context->Update();
+    }
+    VRB_LOG("ModelLoaderBasic load threads stopped");
+  }
+};
+
+ModelLoaderBasicPtr
+ModelLoaderBasic::Create(RenderContextPtr& aContext, const int aWorkerCount) {
+  ModelLoaderBasicPtr result = std::make_shared<ConcreteClass<ModelLoaderBasic, ModelLoaderBasic::State> >(aContext);
+  result->m.workerCount = aWorkerCount;
+  return result;
+}
+
+void
+ModelLoaderBasic::Start() {
+  m.StartThreads();
+}
+
+void
+ModelLoaderBasic::Stop() {
+  m.StopThreads();
+}
+
+void
+ModelLoaderBasic::SetModelCache(const ModelCachePtr& aCache) {
+  m.modelCache = aCache;
+}
+
+void
+ModelLoaderBasic::SetLoadReportCallback(const LoadReportCallback& aCallback) {
+  m.reportCallback = aCallback;
+}
+
+void
+ModelLoaderBasic::SetLoadReportLogging(const bool aEnabled) {
+  m.logReports = aEnabled;
+}
+
+void
+ModelLoaderBasic::LoadModel(const std::string& aModelName, GroupPtr aTargetNode) {
+  LoadModel(aModelName, std::move(aTargetNode), sNoop);
+}
+
+void
+ModelLoaderBasic::LoadModel(const std::string& aModelName, GroupPtr aTargetNode, LoadFinishedCallback& aCallback) {
+  LoadModel(aModelName, std::move(aTargetNode), aCallback, nullptr);
+}
+
+void
+ModelLoaderBasic::LoadModel(const std::string& aModelName, GroupPtr aTargetNode, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken) {
+  ModelCachePtr cache = m.modelCache;
+  LoadTask task = [aModelName, cache](CreationContextPtr& aContext) -> GroupPtr {
+    const double kStartTime = GetMonotonicSeconds();
+    LoadReportCollectorPtr report = LoadReportCollector::GetCurrent();
+    if (report) {
+      report->SetName(aModelName);
+    }
+    GroupPtr group = Group::Create(aContext);
+    if (NodeFactoryGLTF::IsGLTFFile(aModelName)) {
+      NodeFactoryGLTFPtr factory = NodeFactoryGLTF::Create(aContext);
+      factory->SetModelRoot(group);
+      factory->LoadModel(aModelName);
+    } else {
+      GroupPtr instance = cache ? cache->Instantiate(aContext, aModelName) : nullptr;
+      if (instance) {
+        return instance;
+      }
+      NodeFactoryObjPtr factory = NodeFactoryObj::Create(aContext);
+      ParserObjPtr parser = ParserObj::Create(aContext);
+      parser->SetFileReader(aContext->GetFileReader());
+      parser->SetObserver(factory);
+      factory->SetModelRoot(group);
+      parser->LoadModel(aModelName);
+      if (cache) {
+        cache->Add(aModelName, group);
+      }
+    }
+    VRB_LOG("TIMER Load time for %s: %f sec", aModelName.c_str(), GetMonotonicSeconds() - kStartTime);
+    return group;
+  };
+  RunLoadTask(std::move(aTargetNode), task, aCallback, aToken);
+}
+
+void
+ModelLoaderBasic::RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask) {
+  RunLoadTask(std::move(aTargetNode), aTask, sNoop);
+}
+
+void
+ModelLoaderBasic::RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback) {
+  RunLoadTask(std::move(aTargetNode), aTask, aCallback, nullptr);
+}
+
+void
+ModelLoaderBasic::RunLoadTask(GroupPtr aTargetNode, LoadTask& aTask, LoadFinishedCallback& aCallback, const LoadTokenPtr& aToken) {
+  MutexAutoLock lock(m.loadLock);
+  m.loadList.Push(LoadInfo(aTargetNode, aTask, aCallback, aToken));
+  if (m.activeLimit > 0) {
+    // A parked worker could take the signal and go back to waiting.
+    m.loadLock.Broadcast();
+  } else {
+    m.loadLock.Signal();
+  }
+}
+
+/* static */ void*
+ModelLoaderBasic::Run(void* data) {
+  ModelLoaderBasic::State::Worker& worker = *(ModelLoaderBasic::State::Worker*)data;
+  ModelLoaderBasic::State& m = *worker.owner;
+  CreationContextPtr context = m.context;
+
+  while (true) {
+    std::unique_ptr<LoadInfo> info;
+    {
+      MutexAutoLock lock(m.loadLock);
+      // Priorities are read when the task is taken so they may change while queued.
+      while (!m.done && (m.IsParked(worker) || !m.loadList.Pop(info))) {
+        m.loadLock.Wait();
+      }
+      if (m.done) {
+        break;
+      }
+    }
+
+    const double kStartTime = GetMonotonicSeconds();
+    // GL resources are initialized on the render thread after the report
+    // is delivered, so it has no upload times.
+    LoadReportCollectorPtr report = (m.reportCallback || m.logReports) ? LoadReportCollector::Create() : nullptr;
+    GroupPtr group;
+    {
+      LoadReportScope scope(report);
+      group = info->task(context);
+    }
+    const double kElapsed = GetMonotonicSeconds() - kStartTime;
+    VRB_DEBUG("TIMER Off-render-thread asset task: %f sec", kElapsed);
+    if (info->IsCancelled()) {
+      // Releasing the nodes removes their resources from the context lists.
+      VRB_DEBUG("Dropping cancelled load task");
+      continue;
+    }
+    LoadFinishedCallback reportCallback = FinishLoadReport(report, group, kElapsed, m.reportCallback, m.logReports);
+    // Returns without waiting for the render thread so the next task can start.
+    context->Synchronize(CreateLoadFinalizer(group, *info, worker.finishCallbacks, reportCallback));
+  }
+
+  {
+    MutexAutoLock lock(m.loadLock);
+    m.stopped++;
+    m.loadLock.Broadcast();
+  }
+  return nullptr;
+}
+
+void
+ModelLoaderBasic::AddFinishedCallback(LoadFinishedCallback& aCallback) {
+  State::Worker* worker = m.GetCurrentWorker();
+  if (!worker) {
+    VRB_ERROR("ModelLoaderBasic::AddFinishedCallback must be called on a loading thread");
+    return;
+  }
+  worker->finishCallbacks.emplace_back(aCallback);
+}
+
+bool
+ModelLoaderBasic::IsOnLoaderThread() const {
+  return m.GetCurrentWorker() != nullptr;
+}
+
+void
+ModelLoaderBasic::SetActiveWorkerLimit(const int aLimit) {
+  MutexAutoLock lock(m.loadLock);
+  if (aLimit != m.activeLimit) {
+    m.activeLimit = aLimit;
+    VRB_LOG("ModelLoaderBasic active workers limited to %d", aLimit);
+    m.loadLock.Broadcast();
+  }
+}
+
+ModelLoaderBasic::ModelLoaderBasic(State& aState, RenderContextPtr& aContext)
+    : m(aState) {
+  m.render = aContext;
+}
+
+ModelLoaderBasic::~ModelLoaderBasic() {
+  m.StopThreads();
+}
+
+} // namespace vrb
@@ -5,7 +5,9 @@
 
 #include "vrb/Node.h"
 #include "vrb/private/NodeState.h"
+#include "vrb/private/GroupState.h"
 #include "vrb/Logger.h"
+#include "vrb/SceneSnapshot.h"
 
 namespace vrb {
 
@@ -15,56 +17,91 @@ Node::GetName() const { return m.name; }
 void
 Node::SetName(const std::string& aName) { m.name = aName; }
 
+const Bounds&
+Node::GetBounds() const {
+  if (m.boundsDirty) {
+    m.bounds = Bounds::Empty();
+    ComputeBounds(m.bounds);
+    m.boundsDirty = false;
+  }
+  return m.bounds;
+}
+
+void
+Node::InvalidateBounds() {
+  IncrementRevision(false);
+  MarkBoundsDirty();
+}
+
+void
+Node::Flatten(SceneSnapshot& aSnapshot) {
+  aSnapshot.AddNode(*this);
+}
+
+uint32_t
+Node::GetRevision() const {
+  return m.revision;
+}
+
+uint32_t
+Node::GetLayoutRevision() const {
+  return m.layoutRevision;
+}
+
 void
 Node::GetParents(std::vector<GroupPtr>& aParents) const {
-  for (GroupWeak& weak: m.parents) {
-    if (GroupPtr parent = weak.lock()) {
+  m.ForEachParent([&aParents](Group& aParent) {
+    if (GroupPtr parent = aParent.m.self.lock()) {
       aParents.push_back(std::move(parent));
-    } else {
-      VRB_WARN("Deleted weak parent found in parent list in Node::GetParents Node: %s", m.name.c_str());
     }
-  }
+  });
+}
+
+int32_t
+Node::GetParentCount() const {
+  return m.ParentCount();
+}
+
+Group*
+Node::GetParent(const int32_t aIndex) const {
+  return m.Parent(aIndex);
 }
 
 void
 Node::RemoveFromParents() {
-  for (GroupWeak& weak: m.parents) {
-    if (GroupPtr parent = weak.lock()) {
-      parent->RemoveNode(*this);
-    } else {
-      VRB_WARN("Deleted weak parent found in parent list in Node::RemoveFromParents Node: %s", m.name.c_str());
+  // Each RemoveNode drops the first link.
+  while (Group* parent = m.parent) {
+    parent->RemoveNode(*this);
+    if (m.parent == parent) {
+      VRB_WARN("Node::RemoveFromParents failed to remove all parents for Node: %s", m.name.c_str());
+      return;
     }
   }
-  if (m.parents.size() != 0) {
-    VRB_WARN("Node::RemoveFromParents failed to remove all parents for Node: %s", m.name.c_str());
-  }
 }
 
 Node::Node(State& aState, CreationContextPtr& aContext) : m(aState) {}
 Node::~Node() {
-  if (m.parents.size() != 0) {
+  if (m.ParentCount() != 0) {
     const char* name = (m.name.size() ? m.name.c_str() : "<unnamed>");
     VRB_WARN("Node: %s destructor called with parent count != 0", name);
   }
 }
 
 void
-Node::AddToParents(GroupWeak& aParent, Node& aChild) {
-  aChild.m.parents.push_back(aParent);
+Node::AddToParents(Group& aParent, Node& aChild) {
+  aChild.m.AddParent(aParent);
+  aChild.InvalidateWorldTransform();
+}
+
+void
+Node::InvalidateLayout() {
+  IncrementRevision(true);
 }
 
 void
 Node::RemoveFromParents(Group& aParent, Node& aChild) {
-  for (auto it = aChild.m.parents.begin(); it != aChild.m.parents.end();) {
-    Group* node = it->lock().get();
-    if (node == &aParent) {
-      it = aChild.m.parents.erase(it);
-      return;
-    } else if (node == nullptr) {
-      it = aChild.m.parents.erase(it);
-    } else {
-      it++;
-    }
+  if (aChild.m.RemoveParent(aParent)) {
+    aChild.InvalidateWorldTransform();
   }
 }
 
@@ -81,4 +118,40 @@ Node::Traverse(const GroupPtr& aParent, const TraverseFunction& aTraverseFunctio
   return false;
 }
 
+bool
+Node::Intersect(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit) {
+  return false;
+}
+
+void
+Node::ComputeBounds(Bounds& aBounds) const {
+  aBounds = Bounds::Infinite();
+}
+
+void
+Node::InvalidateWorldTransform() {}
+
+void
+Node::MarkBoundsDirty() {
+  if (m.boundsDirty) {
+    return;
+  }
+  m.boundsDirty = true;
+  m.ForEachParent([](Group& aParent) {
+    aParent.MarkBoundsDirty();
+  });
+}
+
+void
+Node::IncrementRevision(const bool aLayout) {
+  // Unlike the bounds, revisions are never reset, so every ancestor is updated.
+  m.revision++;
+  if (aLayout) {
+    m.layoutRevision++;
+  }
+  m.ForEachParent([aLayout](Group& aParent) {
+    aParent.IncrementRevision(aLayout);
+  });
+}
+
 }
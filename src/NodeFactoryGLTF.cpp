@@ -0,0 +1,1294 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/NodeFactoryGLTF.h"
+
+#include "vrb/Bounds.h"
+#include "vrb/Color.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/FileReader.h"
+#include "vrb/Geometry.h"
+#include "vrb/Group.h"
+#include "vrb/KTX2Decoder.h"
+#include "vrb/LoadReport.h"
+#include "vrb/Logger.h"
+#include "vrb/MappedFile.h"
+#include "vrb/Matrix.h"
+#include "vrb/Program.h"
+#include "vrb/ProgramFactory.h"
+#include "vrb/Quaternion.h"
+#include "vrb/RenderBuffer.h"
+#include "vrb/RenderState.h"
+#include "vrb/TextureFormat.h"
+#include "vrb/TextureGL.h"
+#include "vrb/Transform.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace {
+
+const uint32_t kGLBMagic = 0x46546C67; // "glTF"
+const uint32_t kGLBVersion = 2;
+const uint32_t kGLBChunkJSON = 0x4E4F534A;
+const uint32_t kGLBChunkBIN = 0x004E4942;
+const size_t kGLBHeaderSize = 12;
+const size_t kGLBChunkHeaderSize = 8;
+const int32_t kModeTriangles = 4;
+// Deeper JSON is rejected rather than risking the stack.
+const int32_t kMaxJSONDepth = 128;
+
+uint32_t
+ReadLE32(const uint8_t* aData) {
+  return (uint32_t)aData[0] | ((uint32_t)aData[1] << 8) | ((uint32_t)aData[2] << 16) | ((uint32_t)aData[3] << 24);
+}
+
+bool
+EndsWith(const std::string& aString, const char* aSuffix) {
+  const size_t kLength = strlen(aSuffix);
+  if (aString.size() < kLength) {
+    return false;
+  }
+  for (size_t ix = 0; ix < kLength; ix++) {
+    if (tolower(aString[aString.size() - kLength + ix]) != aSuffix[ix]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The subset of JSON used by glTF. Numbers are kept as doubles.
+struct JSONValue {
+  enum class Type { Null, Boolean, Number, String, Array, Object };
+  Type type;
+  bool boolean;
+  double number;
+  std::string string;
+  std::vector<JSONValue> items;
+  std::vector<std::pair<std::string, JSONValue>> members;
+
+  JSONValue() : type(Type::Null), boolean(false), number(0.0) {}
+  static const JSONValue& Null() {
+    static const JSONValue sNull;
+    return sNull;
+  }
+  bool IsNull() const { return type == Type::Null; }
+  bool IsNumber() const { return type == Type::Number; }
+  size_t Size() const { return type == Type::Array ? items.size() : 0; }
+  const JSONValue& operator[](const char* aKey) const {
+    for (const auto& member: members) {
+      if (member.first == aKey) {
+        return member.second;
+      }
+    }
+    return Null();
+  }
+  const JSONValue& operator[](const size_t aIndex) const {
+    return aIndex < Size() ? items[aIndex] : Null();
+  }
+  // Keeps literal indices from converting to a null key.
+  const JSONValue& operator[](const int aIndex) const {
+    return aIndex >= 0 ? (*this)[(size_t)aIndex] : Null();
+  }
+  double AsNumber(const double aDefault) const { return type == Type::Number ? number : aDefault; }
+  int32_t AsInt(const int32_t aDefault) const { return type == Type::Number ? (int32_t)number : aDefault; }
+  bool AsBool(const bool aDefault) const { return type == Type::Boolean ? boolean : aDefault; }
+  const std::string& AsString() const {
+    static const std::string sEmpty;
+    return type == Type::String ? string : sEmpty;
+  }
+};
+
+class JSONParser {
+public:
+  JSONParser(const char* aData, const size_t aSize) : mCurrent(aData), mEnd(aData + aSize) {}
+  bool Parse(JSONValue& aResult, std::string& aError) {
+    // Skip a UTF-8 byte order mark.
+    if ((mEnd - mCurrent >= 3) && (memcmp(mCurrent, "\xEF\xBB\xBF", 3) == 0)) {
+      mCurrent += 3;
+    }
+    if (!ParseValue(aResult, 0)) {
+      aError = mError;
+      return false;
+    }
+    SkipWhitespace();
+    if (mCurrent != mEnd) {
+      aError = "Unexpected data after the JSON value";
+      return false;
+    }
+    return true;
+  }
+private:
+  bool Fail(const char* aError) {
+    if (mError.empty()) {
+      mError = aError;
+    }
+    return false;
+  }
+  void SkipWhitespace() {
+    while ((mCurrent < mEnd) && ((*mCurrent == ' ') || (*mCurrent == '\t') || (*mCurrent == '\n') || (*mCurrent == '\r'))) {
+      mCurrent++;
+    }
+  }
+  bool Match(const char* aLiteral) {
+    const size_t kLength = strlen(aLiteral);
+    if (((size_t)(mEnd - mCurrent) < kLength) || (memcmp(mCurrent, aLiteral, kLength) != 0)) {
+      return false;
+    }
+    mCurrent += kLength;
+    return true;
+  }
+  bool ParseValue(JSONValue& aValue, const int32_t aDepth) {
+    if (aDepth > kMaxJSONDepth) {
+      return Fail("JSON nested too deeply");
+    }
+    SkipWhitespace();
+    if (mCurrent >= mEnd) {
+      return Fail("Unexpected end of JSON");
+    }
+    const char kFirst = *mCurrent;
+    if (kFirst == '{') {
+      return ParseObject(aValue, aDepth);
+    } else if (kFirst == '[') {
+      return ParseArray(aValue, aDepth);
+    } else if (kFirst == '"') {
+      aValue.type = JSONValue::Type::String;
+      return ParseString(aValue.string);
+    } else if (Match("true")) {
+      aValue.type = JSONValue::Type::Boolean;
+      aValue.boolean = true;
+      return true;
+    } else if (Match("false")) {
+      aValue.type = JSONValue::Type::Boolean;
+      aValue.boolean = false;
+      return true;
+    } else if (Match("null")) {
+      aValue.type = JSONValue::Type::Null;
+      return true;
+    }
+    return ParseNumber(aValue);
+  }
+  bool ParseObject(JSONValue& aValue, const int32_t aDepth) {
+    aValue.type = JSONValue::Type::Object;
+    mCurrent++;
+    SkipWhitespace();
+    if ((mCurrent < mEnd) && (*mCurrent == '}')) {
+      mCurrent++;
+      return true;
+    }
+    while (true) {
+      SkipWhitespace();
+      if ((mCurrent >= mEnd) || (*mCurrent != '"')) {
+        return Fail("Expected a JSON object key");
+      }
+      aValue.members.emplace_back();
+      if (!ParseString(aValue.members.back().first)) {
+        return false;
+      }
+      SkipWhitespace();
+      if ((mCurrent >= mEnd) || (*mCurrent != ':')) {
+        return Fail("Expected ':' in JSON object");
+      }
+      mCurrent++;
+      if (!ParseValue(aValue.members.back().second, aDepth + 1)) {
+        return false;
+      }
+      SkipWhitespace();
+      if ((mCurrent < mEnd) && (*mCurrent == ',')) {
+        mCurrent++;
+        continue;
+      }
+      if ((mCurrent < mEnd) && (*mCurrent == '}')) {
+        mCurrent++;
+        return true;
+      }
+      return Fail("Expected ',' or '}' in JSON object");
+    }
+  }
+  bool ParseArray(JSONValue& aValue, const int32_t aDepth) {
+    aValue.type = JSONValue::Type::Array;
+    mCurrent++;
+    SkipWhitespace();
+    if ((mCurrent < mEnd) && (*mCurrent == ']')) {
+      mCurrent++;
+      return true;
+    }
+    while (true) {
+      aValue.items.emplace_back();
+      if (!ParseValue(aValue.items.back(), aDepth + 1)) {
+        return false;
+      }
+      SkipWhitespace();
+      if ((mCurrent < mEnd) && (*mCurrent == ',')) {
+        mCurrent++;
+        continue;
+      }
+      if ((mCurrent < mEnd) && (*mCurrent == ']')) {
+        mCurrent++;
+        return true;
+      }
+      return Fail("Expected ',' or ']' in JSON array");
+    }
+  }
+  bool ParseHex(uint32_t& aResult) {
+    if (mEnd - mCurrent < 4) {
+      return false;
+    }
+    aResult = 0;
+    for (int ix = 0; ix < 4; ix++) {
+      const char kDigit = *mCurrent++;
+      aResult <<= 4;
+      if ((kDigit >= '0') && (kDigit <= '9')) {
+        aResult |= (uint32_t)(kDigit - '0');
+      } else if ((kDigit >= 'a') && (kDigit <= 'f')) {
+        aResult |= (uint32_t)(kDigit - 'a' + 10);
+      } else if ((kDigit >= 'A') && (kDigit <= 'F')) {
+        aResult |= (uint32_t)(kDigit - 'A' + 10);
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+  static void AppendUTF8(const uint32_t aCode, std::string& aResult) {
+    if (aCode < 0x80) {
+      aResult += (char)aCode;
+    } else if (aCode < 0x800) {
+      aResult += (char)(0xC0 | (aCode >> 6));
+      aResult += (char)(0x80 | (aCode & 0x3F));
+    } else if (aCode < 0x10000) {
+      aResult += (char)(0xE0 | (aCode >> 12));
+      aResult += (char)(0x80 | ((aCode >> 6) & 0x3F));
+      aResult += (char)(0x80 | (aCode & 0x3F));
+    } else {
+      aResult += (char)(0xF0 | (aCode >> 18));
+      aResult += (char)(0x80 | ((aCode >> 12) & 0x3F));
+      aResult += (char)(0x80 | ((aCode >> 6) & 0x3F));
+      aResult += (char)(0x80 | (aCode & 0x3F));
+    }
+  }
+  bool ParseString(std::string& aResult) {
+    mCurrent++;
+    while (mCurrent < mEnd) {
+      const char kChar = *mCurrent++;
+      if (kChar == '"') {
+        return true;
+      }
+      if (kChar != '\\') {
+        aResult += kChar;
+        continue;
+      }
+      if (mCurrent >= mEnd) {
+        break;
+      }
+      const char kEscape = *mCurrent++;
+      switch (kEscape) {
+        case '"': aResult += '"'; break;
+        case '\\': aResult += '\\'; break;
+        case '/': aResult += '/'; break;
+        case 'b': aResult += '\b'; break;
+        case 'f': aResult += '\f'; break;
+        case 'n': aResult += '\n'; break;
+        case 'r': aResult += '\r'; break;
+        case 't': aResult += '\t'; break;
+        case 'u': {
+          uint32_t code = 0;
+          if (!ParseHex(code)) {
+            return Fail("Invalid JSON unicode escape");
+          }
+          // Characters outside of the BMP are escaped as surrogate pairs.
+          uint32_t low = 0;
+          if ((code >= 0xD800) && (code < 0xDC00) && Match("\\u") && ParseHex(low) &&
+              (low >= 0xDC00) && (low < 0xE000)) {
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          }
+          AppendUTF8(code, aResult);
+          break;
+        }
+        default:
+          return Fail("Invalid JSON escape");
+      }
+    }
+    return Fail("Unterminated JSON string");
+  }
+  bool ParseNumber(JSONValue& aValue) {
+    // strtod needs a terminated string.
+    char buffer[64];
+    size_t length = 0;
+    while ((mCurrent < mEnd) && (length < sizeof(buffer) - 1) &&
+           (((*mCurrent >= '0') && (*mCurrent <= '9')) || (*mCurrent == '-') || (*mCurrent == '+') ||
+            (*mCurrent == '.') || (*mCurrent == 'e') || (*mCurrent == 'E'))) {
+      buffer[length++] = *mCurrent++;
+    }
+    buffer[length] = '\0';
+    char* end = nullptr;
+    aValue.number = strtod(buffer, &end);
+    if ((length == 0) || (end != buffer + length)) {
+      return Fail("Invalid JSON value");
+    }
+    aValue.type = JSONValue::Type::Number;
+    return true;
+  }
+
+  const char* mCurrent;
+  const char* mEnd;
+  std::string mError;
+};
+
+// Bytes of a file, or of a part of one, kept valid by owner.
+struct Blob {
+  std::shared_ptr<const void> owner;
+  const uint8_t* data;
+  size_t size;
+  Blob() : data(nullptr), size(0) {}
+};
+
+// Collects a file that the FileReader can not map.
+struct BlobHandler : public vrb::FileHandler {
+  std::shared_ptr<std::vector<uint8_t>> bytes;
+  std::string error;
+  bool finished;
+
+  void BindFileHandle(const std::string& aFileName, const int aFileHandle) override {}
+  void LoadFailed(const int aFileHandle, const std::string& aReason) override {
+    error = aReason;
+  }
+  void ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) override {
+    bytes->insert(bytes->end(), (const uint8_t*)aBuffer, (const uint8_t*)aBuffer + aSize);
+  }
+  void FinishRawFile(const int aFileHandle) override {
+    finished = true;
+  }
+  void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength,
+                        const int aWidth, const int aHeight, const GLenum aFormat) override {}
+  BlobHandler() : bytes(std::make_shared<std::vector<uint8_t>>()), finished(false) {}
+  ~BlobHandler() {}
+private:
+  VRB_NO_DEFAULTS(BlobHandler)
+};
+
+bool
+DecodeBase64(const char* aData, const size_t aSize, std::vector<uint8_t>& aResult) {
+  uint32_t bits = 0;
+  int32_t count = 0;
+  aResult.reserve((aSize / 4) * 3);
+  for (size_t ix = 0; ix < aSize; ix++) {
+    const char kChar = aData[ix];
+    uint32_t value = 0;
+    if ((kChar >= 'A') && (kChar <= 'Z')) {
+      value = (uint32_t)(kChar - 'A');
+    } else if ((kChar >= 'a') && (kChar <= 'z')) {
+      value = (uint32_t)(kChar - 'a' + 26);
+    } else if ((kChar >= '0') && (kChar <= '9')) {
+      value = (uint32_t)(kChar - '0' + 52);
+    } else if (kChar == '+') {
+      value = 62;
+    } else if (kChar == '/') {
+      value = 63;
+    } else if (kChar == '=') {
+      break;
+    } else {
+      return false;
+    }
+    bits = (bits << 6) | value;
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      aResult.push_back((uint8_t)((bits >> count) & 0xFF));
+    }
+  }
+  return true;
+}
+
+// Replaces the %XX escapes of a relative URI.
+std::string
+DecodeURI(const std::string& aURI) {
+  std::string result;
+  for (size_t ix = 0; ix < aURI.size(); ix++) {
+    if ((aURI[ix] == '%') && (ix + 2 < aURI.size()) && isxdigit(aURI[ix + 1]) && isxdigit(aURI[ix + 2])) {
+      result += (char)strtol(aURI.substr(ix + 1, 2).c_str(), nullptr, 16);
+      ix += 2;
+    } else {
+      result += aURI[ix];
+    }
+  }
+  return result;
+}
+
+bool
+IsDataURI(const std::string& aURI) {
+  return aURI.compare(0, 5, "data:") == 0;
+}
+
+GLsizei
+ComponentSize(const GLenum aType) {
+  switch (aType) {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+      return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+      return 2;
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+GLsizei
+ComponentCount(const std::string& aType) {
+  if (aType == "SCALAR") {
+    return 1;
+  } else if (aType == "VEC2") {
+    return 2;
+  } else if (aType == "VEC3") {
+    return 3;
+  } else if (aType == "VEC4" || aType == "MAT2") {
+    return 4;
+  } else if (aType == "MAT3") {
+    return 9;
+  } else if (aType == "MAT4") {
+    return 16;
+  }
+  return 0;
+}
+
+struct BufferView {
+  int32_t buffer;
+  size_t byteOffset;
+  size_t byteLength;
+  size_t byteStride;
+  BufferView() : buffer(-1), byteOffset(0), byteLength(0), byteStride(0) {}
+};
+
+struct Accessor {
+  int32_t bufferView;
+  size_t byteOffset;
+  GLenum componentType;
+  GLsizei componentCount;
+  bool normalized;
+  bool sparse;
+  size_t count;
+  bool hasBounds;
+  vrb::Vector min;
+  vrb::Vector max;
+  Accessor()
+      : bufferView(-1), byteOffset(0), componentType(0), componentCount(0)
+      , normalized(false), sparse(false), count(0), hasBounds(false)
+  {}
+  GLsizei ElementSize() const { return ComponentSize(componentType) * componentCount; }
+};
+
+// A vertex attribute of a primitive, resolved to its bytes.
+struct Attribute {
+  const Accessor* accessor;
+  const uint8_t* data;
+  size_t stride;
+  Attribute() : accessor(nullptr), data(nullptr), stride(0) {}
+  bool IsSet() const { return data != nullptr; }
+};
+
+// Keeps the sources of a primitive and the data built for it alive.
+struct PrimitiveData {
+  std::shared_ptr<const void> vertexSource;
+  std::shared_ptr<const void> indexSource;
+  std::vector<uint8_t> vertices;
+  std::vector<uint8_t> indices;
+};
+
+GLuint
+ReadIndex(const uint8_t* aIndices, const GLenum aType, const size_t aIndex) {
+  if (aType == GL_UNSIGNED_BYTE) {
+    return aIndices[aIndex];
+  } else if (aType == GL_UNSIGNED_SHORT) {
+    GLushort result;
+    memcpy(&result, aIndices + aIndex * sizeof(GLushort), sizeof(result));
+    return result;
+  }
+  GLuint result;
+  memcpy(&result, aIndices + aIndex * sizeof(GLuint), sizeof(result));
+  return result;
+}
+
+}
+
+namespace vrb {
+
+struct NodeFactoryGLTF::State {
+  CreationContextWeak context;
+  GroupPtr root;
+  std::string fileName;
+  // Prefix of the URIs of the buffers and images.
+  std::string directory;
+  JSONValue json;
+  Blob binaryChunk;
+  std::vector<Blob> buffers;
+  std::vector<BufferView> views;
+  std::vector<Accessor> accessors;
+  std::vector<TexturePtr> textures;
+  std::vector<bool> texturesLoaded;
+  std::map<std::pair<int32_t, bool>, RenderStatePtr> renderStates;
+  std::vector<NodePtr> meshes;
+  std::vector<NodePtr> nodes;
+
+  void Reset() {
+    json = JSONValue();
+    binaryChunk = Blob();
+    buffers.clear();
+    views.clear();
+    accessors.clear();
+    textures.clear();
+    texturesLoaded.clear();
+    renderStates.clear();
+    meshes.clear();
+    nodes.clear();
+  }
+  bool ReadFile(const std::string& aFileName, Blob& aBlob);
+  bool ReadURI(const std::string& aURI, Blob& aBlob);
+  bool ParseContainer(const Blob& aFile, const char*& aJSON, size_t& aJSONSize);
+  bool LoadBuffers();
+  void ParseViews();
+  void ParseAccessors();
+  bool GetAttribute(const int32_t aAccessor, Attribute& aAttribute) const;
+  bool GetImage(const int32_t aImage, Blob& aBlob, std::string& aURI);
+  TexturePtr GetTexture(const int32_t aTexture);
+  RenderStatePtr GetRenderState(const int32_t aMaterial, const bool aVertexColor);
+  GeometryPtr CreatePrimitive(const JSONValue& aPrimitive, const std::string& aName);
+  NodePtr GetMesh(const int32_t aMesh);
+  NodePtr GetNode(const int32_t aNode, const size_t aDepth);
+};
+
+bool
+NodeFactoryGLTF::State::ReadFile(const std::string& aFileName, Blob& aBlob) {
+  CreationContextPtr creation = context.lock();
+  FileReaderPtr reader = creation ? creation->GetFileReader() : nullptr;
+  if (!reader) {
+    VRB_ERROR("NodeFactoryGLTF unable to load file: '%s'. FileReader not set", aFileName.c_str());
+    return false;
+  }
+  MappedFilePtr mapping = reader->MapFile(aFileName);
+  if (mapping) {
+    aBlob.data = (const uint8_t*)mapping->Data();
+    aBlob.size = mapping->Size();
+    aBlob.owner = std::move(mapping);
+    return true;
+  }
+  // Reads are synchronous, the handler is done when ReadRawFile returns.
+  std::shared_ptr<BlobHandler> handler = std::make_shared<BlobHandler>();
+  reader->ReadRawFile(aFileName, handler);
+  if (!handler->finished) {
+    VRB_ERROR("Failed to read '%s': %s", aFileName.c_str(), handler->error.c_str());
+    return false;
+  }
+  aBlob.data = handler->bytes->data();
+  aBlob.size = handler->bytes->size();
+  aBlob.owner = handler->bytes;
+  return true;
+}
+
+bool
+NodeFactoryGLTF::State::ReadURI(const std::string& aURI, Blob& aBlob) {
+  if (!IsDataURI(aURI)) {
+    return ReadFile(directory + DecodeURI(aURI), aBlob);
+  }
+  const size_t kStart = aURI.find(";base64,");
+  if (kStart == std::string::npos) {
+    VRB_ERROR("Only base64 data URIs are supported in '%s'", fileName.c_str());
+    return false;
+  }
+  const size_t kDataStart = kStart + strlen(";base64,");
+  std::shared_ptr<std::vector<uint8_t>> bytes = std::make_shared<std::vector<uint8_t>>();
+  if (!DecodeBase64(aURI.data() + kDataStart, aURI.size() - kDataStart, *bytes)) {
+    VRB_ERROR("Invalid base64 data URI in '%s'", fileName.c_str());
+    return false;
+  }
+  aBlob.data = bytes->data();
+  aBlob.size = bytes->size();
+  aBlob.owner = std::move(bytes);
+  return true;
+}
+
+// Finds the JSON, and the binary chunk of .glb files.
+bool
+NodeFactoryGLTF::State::ParseContainer(const Blob& aFile, const char*& aJSON, size_t& aJSONSize) {
+  if ((aFile.size < kGLBHeaderSize) || (ReadLE32(aFile.data) != kGLBMagic)) {
+    aJSON = (const char*)aFile.data;
+    aJSONSize = aFile.size;
+    return true;
+  }
+  if (ReadLE32(aFile.data + 4) != kGLBVersion) {
+    VRB_ERROR("Unsupported GLB version %u in '%s'", ReadLE32(aFile.data + 4), fileName.c_str());
+    return false;
+  }
+  const size_t kLength = std::min((size_t)ReadLE32(aFile.data + 8), aFile.size);
+  aJSON = nullptr;
+  size_t offset = kGLBHeaderSize;
+  while (offset + kGLBChunkHeaderSize <= kLength) {
+    const size_t kChunkLength = ReadLE32(aFile.data + offset);
+    const uint32_t kChunkType = ReadLE32(aFile.data + offset + 4);
+    offset += kGLBChunkHeaderSize;
+    if (kChunkLength > kLength - offset) {
+      VRB_ERROR("Truncated GLB chunk in '%s'", fileName.c_str());
+      return false;
+    }
+    if ((kChunkType == kGLBChunkJSON) && !aJSON) {
+      aJSON = (const char*)(aFile.data + offset);
+      aJSONSize = kChunkLength;
+    } else if ((kChunkType == kGLBChunkBIN) && !binaryChunk.data) {
+      binaryChunk.owner = aFile.owner;
+      binaryChunk.data = aFile.data + offset;
+      binaryChunk.size = kChunkLength;
+    }
+    // Chunks are padded to four bytes.
+    offset += (kChunkLength + 3) & ~(size_t)3;
+  }
+  if (!aJSON) {
+    VRB_ERROR("GLB file '%s' has no JSON chunk", fileName.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool
+NodeFactoryGLTF::State::LoadBuffers() {
+  const JSONValue& kBuffers = json["buffers"];
+  buffers.resize(kBuffers.Size());
+  for (size_t ix = 0; ix < kBuffers.Size(); ix++) {
+    const JSONValue& kBuffer = kBuffers[ix];
+    const std::string& kURI = kBuffer["uri"].AsString();
+    Blob blob;
+    if (kURI.empty() && (ix == 0) && binaryChunk.data) {
+      blob = binaryChunk;
+    } else if (kURI.empty() || !ReadURI(kURI, blob)) {
+      VRB_ERROR("Unable to load buffer %d of '%s'", (int32_t)ix, fileName.c_str());
+      return false;
+    }
+    const double kLength = kBuffer["byteLength"].AsNumber(0.0);
+    if ((kLength < 0.0) || (kLength > (double)blob.size)) {
+      VRB_ERROR("Buffer %d of '%s' is shorter than its byteLength", (int32_t)ix, fileName.c_str());
+      return false;
+    }
+    blob.size = (size_t)kLength;
+    buffers[ix] = std::move(blob);
+  }
+  return true;
+}
+
+void
+NodeFactoryGLTF::State::ParseViews() {
+  const JSONValue& kViews = json["bufferViews"];
+  views.resize(kViews.Size());
+  for (size_t ix = 0; ix < kViews.Size(); ix++) {
+    const JSONValue& kView = kViews[ix];
+    BufferView& view = views[ix];
+    view.buffer = kView["buffer"].AsInt(-1);
+    view.byteOffset = (size_t)std::max(kView["byteOffset"].AsNumber(0.0), 0.0);
+    view.byteLength = (size_t)std::max(kView["byteLength"].AsNumber(0.0), 0.0);
+    view.byteStride = (size_t)std::max(kView["byteStride"].AsNumber(0.0), 0.0);
+    if ((view.buffer < 0) || (view.buffer >= (int32_t)buffers.size()) ||
+        (view.byteOffset > buffers[view.buffer].size) ||
+        (view.byteLength > buffers[view.buffer].size - view.byteOffset)) {
+      VRB_ERROR("Buffer view %d of '%s' is outside of its buffer", (int32_t)ix, fileName.c_str());
+      view = BufferView();
+    }
+  }
+}
+
+void
+NodeFactoryGLTF::State::ParseAccessors() {
+  const JSONValue& kAccessors = json["accessors"];
+  accessors.resize(kAccessors.Size());
+  for (size_t ix = 0; ix < kAccessors.Size(); ix++) {
+    const JSONValue& kAccessor = kAccessors[ix];
+    Accessor& accessor = accessors[ix];
+    accessor.bufferView = kAccessor["bufferView"].AsInt(-1);
+    accessor.byteOffset = (size_t)std::max(kAccessor["byteOffset"].AsNumber(0.0), 0.0);
+    accessor.componentType = (GLenum)kAccessor["componentType"].AsInt(0);
+    accessor.componentCount = ComponentCount(kAccessor["type"].AsString());
+    accessor.normalized = kAccessor["normalized"].AsBool(false);
+    accessor.sparse = !kAccessor["sparse"].IsNull();
+    accessor.count = (size_t)std::max(kAccessor["count"].AsNumber(0.0), 0.0);
+    const JSONValue& kMin = kAccessor["min"];
+    const JSONValue& kMax = kAccessor["max"];
+    if ((accessor.componentCount == 3) && (kMin.Size() == 3) && (kMax.Size() == 3)) {
+      accessor.hasBounds = true;
+      accessor.min = Vector((float)kMin[0].AsNumber(0.0), (float)kMin[1].AsNumber(0.0), (float)kMin[2].AsNumber(0.0));
+      accessor.max = Vector((float)kMax[0].AsNumber(0.0), (float)kMax[1].AsNumber(0.0), (float)kMax[2].AsNumber(0.0));
+    }
+  }
+}
+
+// Resolves aAccessor to its bytes, checking that every element lies inside
+// of its buffer view.
+bool
+NodeFactoryGLTF::State::GetAttribute(const int32_t aAccessor, Attribute& aAttribute) const {
+  if ((aAccessor < 0) || (aAccessor >= (int32_t)accessors.size())) {
+    return false;
+  }
+  const Accessor& kAccessor = accessors[aAccessor];
+  if (kAccessor.sparse) {
+    VRB_WARN("Sparse accessor %d of '%s' is not supported", aAccessor, fileName.c_str());
+    return false;
+  }
+  if ((kAccessor.bufferView < 0) || (kAccessor.bufferView >= (int32_t)views.size()) ||
+      (kAccessor.ElementSize() == 0) || (kAccessor.count == 0)) {
+    return false;
+  }
+  const BufferView& kView = views[kAccessor.bufferView];
+  if (kView.buffer < 0) {
+    return false;
+  }
+  const size_t kStride = kView.byteStride > 0 ? kView.byteStride : (size_t)kAccessor.ElementSize();
+  const size_t kExtent = ((kAccessor.count - 1) * kStride) + (size_t)kAccessor.ElementSize();
+  if ((kAccessor.byteOffset > kView.byteLength) || (kExtent > kView.byteLength - kAccessor.byteOffset)) {
+    VRB_ERROR("Accessor %d of '%s' is outside of its buffer view", aAccessor, fileName.c_str());
+    return false;
+  }
+  aAttribute.accessor = &kAccessor;
+  aAttribute.data = buffers[kView.buffer].data + kView.byteOffset + kAccessor.byteOffset;
+  aAttribute.stride = kStride;
+  return true;
+}
+
+// Images are either files of their own, returned in aURI, or bytes of a
+// buffer view or data URI.
+bool
+NodeFactoryGLTF::State::GetImage(const int32_t aImage, Blob& aBlob, std::string& aURI) {
+  const JSONValue& kImage = json["images"][(size_t)std::max(aImage, 0)];
+  if ((aImage < 0) || kImage.IsNull()) {
+    return false;
+  }
+  const std::string& kURI = kImage["uri"].AsString();
+  if (!kURI.empty()) {
+    if (!IsDataURI(kURI)) {
+      aURI = directory + DecodeURI(kURI);
+      return true;
+    }
+    return ReadURI(kURI, aBlob);
+  }
+  const int32_t kView = kImage["bufferView"].AsInt(-1);
+  if ((kView < 0) || (kView >= (int32_t)views.size()) || (views[kView].buffer < 0)) {
+    return false;
+  }
+  const Blob& kBuffer = buffers[views[kView].buffer];
+  aBlob.owner = kBuffer.owner;
+  aBlob.data = kBuffer.data + views[kView].byteOffset;
+  aBlob.size = views[kView].byteLength;
+  return true;
+}
+
+TexturePtr
+NodeFactoryGLTF::State::GetTexture(const int32_t aTexture) {
+  if ((aTexture < 0) || (aTexture >= (int32_t)json["textures"].Size())) {
+    return nullptr;
+  }
+  if (texturesLoaded[aTexture]) {
+    return textures[aTexture];
+  }
+  texturesLoaded[aTexture] = true;
+  CreationContextPtr creation = context.lock();
+  if (!creation) {
+    return nullptr;
+  }
+  const JSONValue& kTexture = json["textures"][(size_t)aTexture];
+  const int32_t kSource = kTexture["extensions"]["KHR_texture_basisu"]["source"].AsInt(kTexture["source"].AsInt(-1));
+  Blob blob;
+  std::string uri;
+  if (!GetImage(kSource, blob, uri)) {
+    VRB_WARN("Texture %d of '%s' has no usable image", aTexture, fileName.c_str());
+    return nullptr;
+  }
+  if (!uri.empty()) {
+    // Shared with every other user of the file through the TextureCache.
+    textures[aTexture] = creation->LoadTexture(uri);
+    return textures[aTexture];
+  }
+
+  std::vector<ImageLevel> levels;
+  std::string error("Unsupported embedded image format, PNG and JPEG images must be separate files");
+  bool decoded = false;
+  if (KTX2Decoder::IsKTX2((const char*)blob.data, blob.size)) {
+    KTX2DecoderPtr decoder = creation->GetKTX2Decoder();
+    decoded = decoder && decoder->Decode((const char*)blob.data, blob.size, levels, error);
+  } else if (IsASTCFile((const char*)blob.data, blob.size)) {
+    decoded = ReadASTCFile((const char*)blob.data, blob.size, levels, error);
+  } else if ((blob.size > 12) && (memcmp(blob.data, "\xABKTX 11\xBB", 8) == 0)) {
+    decoded = ReadKTXFile((const char*)blob.data, blob.size, levels, error);
+  }
+  if (!decoded) {
+    VRB_WARN("Unable to decode image %d of '%s': %s", kSource, fileName.c_str(), error.c_str());
+    return nullptr;
+  }
+
+  TextureGLPtr texture = TextureGL::Create(creation);
+  texture->SetName(fileName + "#image" + std::to_string(kSource));
+  const JSONValue& kSampler = json["samplers"][(size_t)std::max(kTexture["sampler"].AsInt(-1), 0)];
+  if (kTexture["sampler"].IsNumber() && !kSampler.IsNull()) {
+    texture->SetTextureParameter(GL_TEXTURE_WRAP_S, kSampler["wrapS"].AsInt(GL_REPEAT));
+    texture->SetTextureParameter(GL_TEXTURE_WRAP_T, kSampler["wrapT"].AsInt(GL_REPEAT));
+    if (kSampler["magFilter"].IsNumber()) {
+      texture->SetTextureParameter(GL_TEXTURE_MAG_FILTER, kSampler["magFilter"].AsInt(GL_LINEAR));
+    }
+    // A mipmap filter on a single level would leave the texture incomplete.
+    const GLint kMinFilter = kSampler["minFilter"].AsInt(0);
+    const bool kMipmapFilter = (kMinFilter != GL_NEAREST) && (kMinFilter != GL_LINEAR);
+    if ((kMinFilter != 0) && (!kMipmapFilter || (levels.size() > 1))) {
+      texture->SetTextureParameter(GL_TEXTURE_MIN_FILTER, kMinFilter);
+    }
+  }
+  texture->SetImageLevels(levels);
+  textures[aTexture] = texture;
+  return texture;
+}
+
+RenderStatePtr
+NodeFactoryGLTF::State::GetRenderState(const int32_t aMaterial, const bool aVertexColor) {
+  const std::pair<int32_t, bool> kKey(aMaterial, aVertexColor);
+  auto it = renderStates.find(kKey);
+  if (it != renderStates.end()) {
+    return it->second;
+  }
+  CreationContextPtr creation = context.lock();
+  if (!creation) {
+    return nullptr;
+  }
+  const JSONValue& kMaterial = json["materials"][(size_t)std::max(aMaterial, 0)];
+  const bool kHasMaterial = (aMaterial >= 0) && !kMaterial.IsNull();
+  const JSONValue& kPBR = kHasMaterial ? kMaterial["pbrMetallicRoughness"] : JSONValue::Null();
+  TexturePtr texture = GetTexture(kPBR["baseColorTexture"]["index"].AsInt(-1));
+  uint32_t features = texture ? FeatureTexture : 0;
+  if (aVertexColor) {
+    features |= FeatureVertexColor;
+  }
+  ProgramPtr program = creation->GetProgramFactory()->CreateProgram(creation, features);
+  RenderStatePtr state = RenderState::Create(creation);
+  state->SetProgram(program);
+  if (texture) {
+    state->SetTexture(texture);
+  }
+  if (kHasMaterial) {
+    const JSONValue& kFactor = kPBR["baseColorFactor"];
+    const Color kBase((float)kFactor[0].AsNumber(1.0), (float)kFactor[1].AsNumber(1.0),
+                      (float)kFactor[2].AsNumber(1.0), (float)kFactor[3].AsNumber(1.0));
+    // Keeps the ambient to diffuse ratio of the default material.
+    state->SetAmbient(Color(kBase.Red() * 0.5f, kBase.Green() * 0.5f, kBase.Blue() * 0.5f, kBase.Alpha()));
+    state->SetDiffuse(kBase);
+    state->SetTransparent(kMaterial["alphaMode"].AsString() == "BLEND");
+    if (!kMaterial["extensions"]["KHR_materials_unlit"].IsNull()) {
+      state->SetLightsEnabled(false);
+    }
+  }
+  renderStates[kKey] = state;
+  return state;
+}
+
+GeometryPtr
+NodeFactoryGLTF::State::CreatePrimitive(const JSONValue& aPrimitive, const std::string& aName) {
+  CreationContextPtr creation = context.lock();
+  if (!creation) {
+    return nullptr;
+  }
+  if (aPrimitive["mode"].AsInt(kModeTriangles) != kModeTriangles) {
+    VRB_WARN("Primitive of '%s' in '%s' is not made of triangles", aName.c_str(), fileName.c_str());
+    return nullptr;
+  }
+  const JSONValue& kAttributes = aPrimitive["attributes"];
+  Attribute position;
+  Attribute normal;
+  Attribute uv;
+  Attribute color;
+  if (!GetAttribute(kAttributes["POSITION"].AsInt(-1), position) ||
+      (position.accessor->componentType != GL_FLOAT) || (position.accessor->componentCount != 3)) {
+    VRB_WARN("Primitive of '%s' in '%s' has no usable positions", aName.c_str(), fileName.c_str());
+    return nullptr;
+  }
+  const size_t kVertexCount = position.accessor->count;
+  // Attributes the shaders can not take are dropped.
+  if (GetAttribute(kAttributes["NORMAL"].AsInt(-1), normal) &&
+      ((normal.accessor->componentType != GL_FLOAT) || (normal.accessor->componentCount != 3) ||
+       (normal.accessor->count != kVertexCount))) {
+    normal = Attribute();
+  }
+  if (GetAttribute(kAttributes["TEXCOORD_0"].AsInt(-1), uv) &&
+      ((uv.accessor->componentCount != 2) || (uv.accessor->count != kVertexCount) ||
+       ((uv.accessor->componentType != GL_FLOAT) && !uv.accessor->normalized))) {
+    uv = Attribute();
+  }
+  if (GetAttribute(kAttributes["COLOR_0"].AsInt(-1), color) &&
+      ((color.accessor->componentCount < 3) || (color.accessor->componentCount > 4) ||
+       (color.accessor->count != kVertexCount) ||
+       ((color.accessor->componentType != GL_FLOAT) && !color.accessor->normalized))) {
+    color = Attribute();
+  }
+
+  std::shared_ptr<PrimitiveData> data = std::make_shared<PrimitiveData>();
+  // Index buffer views have no stride, so the indices are used as they are.
+  const uint8_t* indices = nullptr;
+  size_t indexCount = kVertexCount;
+  GLenum indexType = GL_UNSIGNED_INT;
+  Attribute indexAttribute;
+  const int32_t kIndices = aPrimitive["indices"].AsInt(-1);
+  if (kIndices >= 0) {
+    if (!GetAttribute(kIndices, indexAttribute) || (indexAttribute.accessor->componentCount != 1) ||
+        (indexAttribute.stride != (size_t)indexAttribute.accessor->ElementSize()) ||
+        ((indexAttribute.accessor->componentType != GL_UNSIGNED_BYTE) &&
+         (indexAttribute.accessor->componentType != GL_UNSIGNED_SHORT) &&
+         (indexAttribute.accessor->componentType != GL_UNSIGNED_INT))) {
+      VRB_WARN("Primitive of '%s' in '%s' has invalid indices", aName.c_str(), fileName.c_str());
+      return nullptr;
+    }
+    indices = indexAttribute.data;
+    indexCount = indexAttribute.accessor->count;
+    indexType = indexAttribute.accessor->componentType;
+    data->indexSource = buffers[views[indexAttribute.accessor->bufferView].buffer].owner;
+  } else {
+    data->indices.resize(kVertexCount * sizeof(GLuint));
+    for (size_t ix = 0; ix < kVertexCount; ix++) {
+      const GLuint kIndex = (GLuint)ix;
+      memcpy(data->indices.data() + (ix * sizeof(GLuint)), &kIndex, sizeof(kIndex));
+    }
+    indices = data->indices.data();
+  }
+  for (size_t ix = 0; ix < indexCount; ix++) {
+    if (ReadIndex(indices, indexType, ix) >= kVertexCount) {
+      VRB_WARN("Primitive of '%s' in '%s' indexes past its vertices", aName.c_str(), fileName.c_str());
+      return nullptr;
+    }
+  }
+
+  GeometryPtr geometry = Geometry::Create(creation);
+  geometry->SetName(aName);
+  RenderBufferPtr& layout = geometry->GetRenderBuffer();
+  Attribute* attributes[] = {&position, &normal, &uv, &color};
+
+  // Attributes interleaved in one buffer view are drawn from it when every
+  // attribute the shaders need is there.
+  bool interleaved = normal.IsSet();
+  size_t start = position.accessor->byteOffset;
+  for (Attribute* attribute: attributes) {
+    if (attribute->IsSet()) {
+      interleaved = interleaved && (attribute->accessor->bufferView == position.accessor->bufferView);
+      start = std::min(start, attribute->accessor->byteOffset);
+    }
+  }
+  const size_t kStride = views[position.accessor->bufferView].byteStride;
+  interleaved = interleaved && (kStride > 0) && ((kStride % 4) == 0);
+  size_t vertexExtent = 0;
+  for (Attribute* attribute: attributes) {
+    if (interleaved && attribute->IsSet()) {
+      const size_t kEnd = attribute->accessor->byteOffset - start + (size_t)attribute->accessor->ElementSize();
+      interleaved = kEnd <= kStride;
+      vertexExtent = std::max(vertexExtent, kEnd);
+    }
+  }
+  const uint8_t* vertices = nullptr;
+  size_t vertexBytes = 0;
+  if (interleaved) {
+    const Accessor& kPosition = *position.accessor;
+    layout->SetVertexStride((GLsizei)kStride);
+    layout->DefinePosition(kPosition.byteOffset - start);
+    layout->DefineNormal(normal.accessor->byteOffset - start);
+    if (uv.IsSet()) {
+      layout->DefineUV(uv.accessor->byteOffset - start, 2, uv.accessor->componentType, uv.accessor->normalized);
+    }
+    if (color.IsSet()) {
+      layout->DefineColor(color.accessor->byteOffset - start, color.accessor->componentCount,
+                          color.accessor->componentType, color.accessor->normalized);
+    }
+    vertices = position.data - (kPosition.byteOffset - start);
+    vertexBytes = ((kVertexCount - 1) * kStride) + vertexExtent;
+    data->vertexSource = buffers[views[kPosition.bufferView].buffer].owner;
+  } else {
+    // Interleaved once, each attribute copied as it is stored.
+    layout->DefinePosition(0);
+    layout->DefineNormal(layout->PositionOffset() + layout->PositionSize());
+    size_t offset = layout->NormalOffset() + layout->NormalSize();
+    if (uv.IsSet()) {
+      layout->DefineUV(offset, 2, uv.accessor->componentType, uv.accessor->normalized);
+      offset = layout->UVOffset() + layout->UVSize();
+    }
+    if (color.IsSet()) {
+      layout->DefineColor(offset, color.accessor->componentCount, color.accessor->componentType, color.accessor->normalized);
+    }
+    const size_t kVertexSize = (size_t)layout->VertexSize();
+    const size_t kOffsets[] = {layout->PositionOffset(), layout->NormalOffset(), layout->UVOffset(), layout->ColorOffset()};
+    data->vertices.resize(kVertexSize * kVertexCount);
+    uint8_t* target = data->vertices.data();
+    for (size_t ix = 0; ix < 4; ix++) {
+      const Attribute& kAttribute = *attributes[ix];
+      if (!kAttribute.IsSet()) {
+        continue;
+      }
+      const size_t kSize = (size_t)kAttribute.accessor->ElementSize();
+      for (size_t vertex = 0; vertex < kVertexCount; vertex++) {
+        memcpy(target + (vertex * kVertexSize) + kOffsets[ix], kAttribute.data + (vertex * kAttribute.stride), kSize);
+      }
+    }
+    if (!normal.IsSet()) {
+      // Smooth normals weighted by triangle area.
+      std::vector<Vector> normals(kVertexCount, Vector(0.0f, 0.0f, 0.0f));
+      auto positionAt = [&](const GLuint aIndex) {
+        float value[3];
+        memcpy(value, target + ((size_t)aIndex * kVertexSize), sizeof(value));
+        return Vector(value[0], value[1], value[2]);
+      };
+      for (size_t ix = 0; (ix + 2) < indexCount; ix += 3) {
+        const GLuint kA = ReadIndex(indices, indexType, ix);
+        const GLuint kB = ReadIndex(indices, indexType, ix + 1);
+        const GLuint kC = ReadIndex(indices, indexType, ix + 2);
+        const Vector kA0 = positionAt(kA);
+        const Vector kFace = (positionAt(kB) - kA0).Cross(positionAt(kC) - kA0);
+        normals[kA] += kFace;
+        normals[kB] += kFace;
+        normals[kC] += kFace;
+      }
+      for (size_t vertex = 0; vertex < kVertexCount; vertex++) {
+        const Vector kNormal = normals[vertex].Magnitude() > 0.0f ? normals[vertex].Normalize() : Vector(0.0f, 0.0f, 1.0f);
+        memcpy(target + (vertex * kVertexSize) + kOffsets[1], kNormal.Data(), sizeof(float) * 3);
+      }
+    }
+    vertices = data->vertices.data();
+    vertexBytes = data->vertices.size();
+  }
+
+  Bounds bounds;
+  if (position.accessor->hasBounds) {
+    bounds = Bounds(position.accessor->min, position.accessor->max);
+  } else {
+    for (size_t vertex = 0; vertex < kVertexCount; vertex++) {
+      float value[3];
+      memcpy(value, position.data + (vertex * position.stride), sizeof(value));
+      bounds.Extend(Vector(value[0], value[1], value[2]));
+    }
+  }
+  geometry->SetRenderState(GetRenderState(aPrimitive["material"].AsInt(-1), color.IsSet()));
+  geometry->SetBufferData(data, vertices, vertexBytes, (GLsizei)kVertexCount,
+                          indices, indexCount * (size_t)ComponentSize(indexType), indexType,
+                          (GLsizei)indexCount, bounds);
+  return geometry;
+}
+
+NodePtr
+NodeFactoryGLTF::State::GetMesh(const int32_t aMesh) {
+  if ((aMesh < 0) || (aMesh >= (int32_t)meshes.size())) {
+    return nullptr;
+  }
+  if (meshes[aMesh]) {
+    return meshes[aMesh];
+  }
+  CreationContextPtr creation = context.lock();
+  if (!creation) {
+    return nullptr;
+  }
+  const JSONValue& kMesh = json["meshes"][(size_t)aMesh];
+  std::string name = kMesh["name"].AsString();
+  if (name.empty()) {
+    name = "mesh" + std::to_string(aMesh);
+  }
+  const JSONValue& kPrimitives = kMesh["primitives"];
+  std::vector<GeometryPtr> geometries;
+  for (size_t ix = 0; ix < kPrimitives.Size(); ix++) {
+    GeometryPtr geometry = CreatePrimitive(kPrimitives[ix], kPrimitives.Size() > 1 ? name + "#" + std::to_string(ix) : name);
+    if (geometry) {
+      geometries.push_back(geometry);
+    }
+  }
+  if (geometries.size() == 1) {
+    meshes[aMesh] = geometries.front();
+  } else if (!geometries.empty()) {
+    GroupPtr group = Group::Create(creation);
+    group->SetName(name);
+    for (GeometryPtr& geometry: geometries) {
+      group->AddNode(geometry);
+    }
+    meshes[aMesh] = group;
+  }
+  return meshes[aMesh];
+}
+
+NodePtr
+NodeFactoryGLTF::State::GetNode(const int32_t aNode, const size_t aDepth) {
+  // Deeper than the node count means the hierarchy has a cycle.
+  if ((aNode < 0) || (aNode >= (int32_t)nodes.size()) || (aDepth > nodes.size())) {
+    return nullptr;
+  }
+  if (nodes[aNode]) {
+    return nodes[aNode];
+  }
+  CreationContextPtr creation = context.lock();
+  if (!creation) {
+    return nullptr;
+  }
+  const JSONValue& kNode = json["nodes"][(size_t)aNode];
+  const JSONValue& kMatrix = kNode["matrix"];
+  const JSONValue& kTranslation = kNode["translation"];
+  const JSONValue& kRotation = kNode["rotation"];
+  const JSONValue& kScale = kNode["scale"];
+  const JSONValue& kChildren = kNode["children"];
+  NodePtr mesh = GetMesh(kNode["mesh"].AsInt(-1));
+  const bool kTransformed = (kMatrix.Size() == 16) || (kTranslation.Size() == 3) ||
+                            (kRotation.Size() == 4) || (kScale.Size() == 3);
+  if (!kTransformed && (kChildren.Size() == 0)) {
+    // A mesh may be used by several nodes, so it keeps the mesh name.
+    nodes[aNode] = mesh;
+    return mesh;
+  }
+  GroupPtr group;
+  if (kTransformed) {
+    Matrix transform = Matrix::Identity();
+    if (kMatrix.Size() == 16) {
+      float values[16];
+      for (size_t ix = 0; ix < 16; ix++) {
+        values[ix] = (float)kMatrix[ix].AsNumber(0.0);
+      }
+      transform = Matrix::FromColumnMajor(values);
+    } else {
+      const Vector kT((float)kTranslation[0].AsNumber(0.0), (float)kTranslation[1].AsNumber(0.0), (float)kTranslation[2].AsNumber(0.0));
+      const Quaternion kR((float)kRotation[0].AsNumber(0.0), (float)kRotation[1].AsNumber(0.0),
+                          (float)kRotation[2].AsNumber(0.0), (float)kRotation[3].AsNumber(1.0));
+      const Vector kS((float)kScale[0].AsNumber(1.0), (float)kScale[1].AsNumber(1.0), (float)kScale[2].AsNumber(1.0));
+      transform = Matrix::FromTRS(kT, kR, kS);
+    }
+    TransformPtr node = Transform::Create(creation);
+    node->SetTransform(transform);
+    group = node;
+  } else {
+    group = Group::Create(creation);
+  }
+  group->SetName(kNode["name"].AsString());
+  // Set before the children so a cycle ends at this node.
+  nodes[aNode] = group;
+  if (mesh) {
+    group->AddNode(mesh);
+  }
+  for (size_t ix = 0; ix < kChildren.Size(); ix++) {
+    NodePtr child = GetNode(kChildren[ix].AsInt(-1), aDepth + 1);
+    if (child && (child != group)) {
+      group->AddNode(child);
+    }
+  }
+  return group;
+}
+
+NodeFactoryGLTFPtr
+NodeFactoryGLTF::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<NodeFactoryGLTF, NodeFactoryGLTF::State> >(aContext);
+}
+
+bool
+NodeFactoryGLTF::IsGLTFFile(const std::string& aFileName) {
+  return EndsWith(aFileName, ".gltf") || EndsWith(aFileName, ".glb");
+}
+
+void
+NodeFactoryGLTF::SetModelRoot(GroupPtr aGroup) {
+  m.root = std::move(aGroup);
+}
+
+GroupPtr&
+NodeFactoryGLTF::GetModelRoot() {
+  return m.root;
+}
+
+bool
+NodeFactoryGLTF::LoadModel(const std::string& aFileName) {
+  LoadReportTimer timer(LoadReport::Phase::Parse);
+  CreationContextPtr creation = m.context.lock();
+  if (!creation) {
+    VRB_ERROR("Failed to lock creation context in NodeFactoryGLTF::LoadModel");
+    return false;
+  }
+  VRB_LOG("Loading file: '%s'", aFileName.c_str());
+  m.Reset();
+  m.fileName = aFileName;
+  const size_t kSlash = aFileName.find_last_of('/');
+  m.directory = kSlash == std::string::npos ? std::string() : aFileName.substr(0, kSlash + 1);
+  Blob file;
+  const char* text = nullptr;
+  size_t textSize = 0;
+  if (!m.ReadFile(aFileName, file) || !m.ParseContainer(file, text, textSize)) {
+    return false;
+  }
+  std::string error;
+  if (!JSONParser(text, textSize).Parse(m.json, error)) {
+    VRB_ERROR("Failed to parse '%s': %s", aFileName.c_str(), error.c_str());
+    m.Reset();
+    return false;
+  }
+  if (m.json["asset"]["version"].AsString().compare(0, 2, "2.") != 0) {
+    VRB_ERROR("'%s' is not a glTF 2.0 file", aFileName.c_str());
+    m.Reset();
+    return false;
+  }
+  const JSONValue& kRequired = m.json["extensionsRequired"];
+  for (size_t ix = 0; ix < kRequired.Size(); ix++) {
+    const std::string& kExtension = kRequired[ix].AsString();
+    if ((kExtension != "KHR_texture_basisu") && (kExtension != "KHR_materials_unlit")) {
+      VRB_ERROR("'%s' requires the unsupported extension %s", aFileName.c_str(), kExtension.c_str());
+      m.Reset();
+      return false;
+    }
+  }
+  if (!m.LoadBuffers()) {
+    m.Reset();
+    return false;
+  }
+  m.ParseViews();
+  m.ParseAccessors();
+  m.textures.resize(m.json["textures"].Size());
+  m.texturesLoaded.resize(m.textures.size(), false);
+  m.meshes.resize(m.json["meshes"].Size());
+  m.nodes.resize(m.json["nodes"].Size());
+
+  if (!m.root) {
+    m.root = Group::Create(creation);
+  }
+  m.root->SetName(aFileName);
+  const JSONValue& kScene = m.json["scenes"][(size_t)std::max(m.json["scene"].AsInt(0), 0)];
+  if (!kScene.IsNull()) {
+    const JSONValue& kRoots = kScene["nodes"];
+    for (size_t ix = 0; ix < kRoots.Size(); ix++) {
+      NodePtr node = m.GetNode(kRoots[ix].AsInt(-1), 0);
+      if (node) {
+        m.root->AddNode(node);
+      }
+    }
+  } else {
+    // Without a scene every node that is not a child is a root.
+    std::vector<bool> isChild(m.nodes.size(), false);
+    for (size_t ix = 0; ix < m.nodes.size(); ix++) {
+      const JSONValue& kChildren = m.json["nodes"][ix]["children"];
+      for (size_t child = 0; child < kChildren.Size(); child++) {
+        const int32_t kChild = kChildren[child].AsInt(-1);
+        if ((kChild >= 0) && (kChild < (int32_t)isChild.size())) {
+          isChild[kChild] = true;
+        }
+      }
+    }
+    for (size_t ix = 0; ix < m.nodes.size(); ix++) {
+      NodePtr node = isChild[ix] ? nullptr : m.GetNode((int32_t)ix, 0);
+      if (node) {
+        m.root->AddNode(node);
+      }
+    }
+  }
+  // The geometries keep the buffers they draw from.
+  m.Reset();
+  return true;
+}
+
+NodeFactoryGLTF::NodeFactoryGLTF(State& aState, CreationContextPtr& aContext) : m(aState) {
+  m.context = aContext;
+}
+NodeFactoryGLTF::~NodeFactoryGLTF() { m.Reset(); }
+
+} // namespace vrb
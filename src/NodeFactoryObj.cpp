@@ -5,20 +5,27 @@
 
 #include "vrb/NodeFactoryObj.h"
 
+#include "vrb/AssetID.h"
 #include "vrb/Color.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/CreationContext.h"
 #include "vrb/Geometry.h"
 #include "vrb/Group.h"
+#include "vrb/JobSystem.h"
+#include "vrb/LevelOfDetail.h"
+#include "vrb/LoadReport.h"
+#include "vrb/MaterialRegistry.h"
 #include "vrb/Mutex.h"
 #include "vrb/Program.h"
 #include "vrb/ProgramFactory.h"
 #include "vrb/RenderState.h"
 #include "vrb/Texture.h"
+#include "vrb/TextureAtlas.h"
 #include "vrb/TextureGL.h"
 #include "vrb/Vector.h"
 #include "vrb/VertexArray.h"
 
+#include <algorithm>
 #include <unordered_map>
 
 namespace {
@@ -28,20 +35,55 @@ struct Material {
   vrb::Color diffuse;
   vrb::Color specular;
   float specularExponent;
-  std::string ambientTextureName;
-  std::string diffuseTextureName;
-  std::string specularTextureName;
+  vrb::AssetID ambientTexture;
+  vrb::AssetID diffuseTexture;
+  vrb::AssetID specularTexture;
   vrb::RenderStatePtr state;
-
-  Material () : specularExponent(0.0f) {}
+  // The diffuse texture is assigned by FinishModel, see SetTextureAtlas.
+  bool atlasPending;
+
+  Material ()
+      : specularExponent(0.0f)
+      , ambientTexture(vrb::kInvalidAssetID)
+      , diffuseTexture(vrb::kInvalidAssetID)
+      , specularTexture(vrb::kInvalidAssetID)
+      , atlasPending(false) {}
 };
 
+// Largest surface deviation of a generated level of detail, relative to the
+// size of the model.
+const float kLevelOfDetailMaxError = 0.02f;
+// Screen coverage below which the second level is drawn, halved per level.
+const float kLevelOfDetailCoverage = 0.25f;
+// UVs this far outside [0, 1] still map into an atlas region.
+const float kAtlasUVTolerance = 0.001f;
+
+bool
+UVsInUnitRange(const vrb::Geometry& aGeometry, const vrb::VertexArray& aVertices) {
+  const float kMin = -kAtlasUVTolerance;
+  const float kMax = 1.0f + kAtlasUVTolerance;
+  for (int32_t ix = 0; ix < aGeometry.GetFaceCount(); ix++) {
+    const vrb::Geometry::Face face = aGeometry.GetFace(ix);
+    for (uint32_t corner = 0; corner < face.cornerCount; corner++) {
+      if (face.uvs[corner] == 0) {
+        continue;
+      }
+      const vrb::Vector& uv = aVertices.GetUV((int)face.uvs[corner] - 1);
+      if ((uv.x() < kMin) || (uv.x() > kMax) || (uv.y() < kMin) || (uv.y() > kMax)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 }
 
 namespace vrb {
 
 struct NodeFactoryObj::State {
-  std::unordered_map<std::string, Material> materials;
+  // Keyed by the interned material name.
+  std::unordered_map<AssetID, Material> materials;
   CreationContextWeak context;
   int groupId;
   GroupPtr root;
@@ -49,12 +91,38 @@ struct NodeFactoryObj::State {
   GeometryPtr currentGeometry;
   Material* currentMaterial;
   RenderStatePtr defaultRenderState;
+  bool mergeGeometry;
+  bool optimizeMeshes;
+  bool triangleStrips;
+  Geometry::NormalWeighting normalWeighting;
+  // Applied to the geometries created once a smoothing group is set.
+  bool hasSmoothingGroup;
+  int32_t smoothingGroup;
+  bool shareVertices;
+  bool releaseSource;
+  int32_t levelCount;
+  TextureAtlasPtr atlas;
+  std::vector<GeometryPtr> geometries;
+  // Parent of the texture reads started by the material library, waited on
+  // once the model is finished.
+  JobSystemPtr jobs;
+  JobSystem::JobHandle prefetch;
 
   State()
       : groupId(0)
-      , currentMaterial(nullptr) {}
+      , currentMaterial(nullptr)
+      , mergeGeometry(false)
+      , optimizeMeshes(false)
+      , triangleStrips(false)
+      , normalWeighting(Geometry::NormalWeighting::Face)
+      , hasSmoothingGroup(false)
+      , smoothingGroup(0)
+      , shareVertices(true)
+      , releaseSource(false)
+      , levelCount(1) {}
 
   void Reset() {
+    FinishPrefetch();
     if (vertices) {
       VRB_LOG("vertices: %d normals: %d uv: %d", vertices->GetVertexCount(), vertices->GetNormalCount(), vertices->GetUVCount());
     }
@@ -62,10 +130,46 @@ struct NodeFactoryObj::State {
     vertices = nullptr;
     currentGeometry = nullptr;
     currentMaterial = nullptr;
+    hasSmoothingGroup = false;
+    geometries.clear();
   }
+  void PrefetchTexture(const AssetID aTexture);
+  void FinishPrefetch();
   void CreateRenderState(Material& aMaterial);
+  void ShareRenderState(Material& aMaterial);
+  void AssignAtlasTextures();
+  void MergeGeometries();
+  void GenerateLevelsOfDetail();
 };
 
+void
+NodeFactoryObj::State::PrefetchTexture(const AssetID aTexture) {
+  CreationContextPtr creation = context.lock();
+  if (!creation || (aTexture == kInvalidAssetID)) {
+    return;
+  }
+  if (!prefetch) {
+    jobs = creation->GetJobSystem();
+    if (!jobs) {
+      return;
+    }
+    prefetch = jobs->Create(nullptr);
+  }
+  // The texture is cached so CreateRenderState finds it once used.
+  creation->PrefetchTexture(aTexture, prefetch);
+}
+
+void
+NodeFactoryObj::State::FinishPrefetch() {
+  if (!prefetch) {
+    return;
+  }
+  jobs->Run(prefetch);
+  jobs->Wait(prefetch);
+  prefetch = nullptr;
+  jobs = nullptr;
+}
+
 void
 NodeFactoryObj::State::CreateRenderState(Material& aMaterial) {
   if (aMaterial.state) {
@@ -75,10 +179,13 @@ NodeFactoryObj::State::CreateRenderState(Material& aMaterial) {
   CreationContextPtr creation = context.lock();
   if (creation) {
     TexturePtr texture;
-    if (!aMaterial.diffuseTextureName.empty()) {
-      texture = creation->LoadTexture(aMaterial.diffuseTextureName);
+    if ((aMaterial.diffuseTexture != kInvalidAssetID) && atlas) {
+      // Whether the texture fits an atlas depends on UVs not parsed yet.
+      aMaterial.atlasPending = true;
+    } else if (aMaterial.diffuseTexture != kInvalidAssetID) {
+      texture = creation->LoadTexture(aMaterial.diffuseTexture);
     }
-    uint32_t features = texture ? FeatureTexture : 0;
+    uint32_t features = (texture || aMaterial.atlasPending) ? FeatureTexture : 0;
     ProgramPtr program = creation->GetProgramFactory()->CreateProgram(creation, features);
     aMaterial.state = RenderState::Create(creation);
     aMaterial.state->SetProgram(program);
@@ -87,6 +194,143 @@ NodeFactoryObj::State::CreateRenderState(Material& aMaterial) {
     }
   }
   aMaterial.state->SetMaterial(aMaterial.ambient, aMaterial.diffuse, aMaterial.specular, aMaterial.specularExponent);
+  if (!aMaterial.atlasPending) {
+    ShareRenderState(aMaterial);
+  }
+}
+
+void
+NodeFactoryObj::State::ShareRenderState(Material& aMaterial) {
+  CreationContextPtr creation = context.lock();
+  MaterialRegistryPtr registry = creation ? creation->GetMaterialRegistry() : nullptr;
+  if (!registry) {
+    return;
+  }
+  RenderStatePtr shared = registry->Share(aMaterial.state);
+  if (shared == aMaterial.state) {
+    return;
+  }
+  for (GeometryPtr& geometry: geometries) {
+    if (geometry->GetRenderState() == aMaterial.state) {
+      geometry->SetRenderState(shared);
+    }
+  }
+  aMaterial.state = shared;
+}
+
+void
+NodeFactoryObj::State::AssignAtlasTextures() {
+  CreationContextPtr creation = context.lock();
+  if (!creation) {
+    return;
+  }
+  for (auto& item: materials) {
+    Material& material = item.second;
+    if (!material.atlasPending) {
+      continue;
+    }
+    material.atlasPending = false;
+    // Repeating textures can not be packed.
+    bool packable = atlas && vertices;
+    for (GeometryPtr& geometry: geometries) {
+      if (packable && (geometry->GetRenderState() == material.state)) {
+        packable = UVsInUnitRange(*geometry, *vertices);
+      }
+    }
+    if (packable) {
+      ProgramPtr program = creation->GetProgramFactory()->CreateProgram(creation, FeatureTexture | FeatureUVTransform);
+      material.state->SetProgram(program);
+      // Not shared, the atlas sets its texture and UV transform later.
+      atlas->AddTexture(GetAssetName(material.diffuseTexture), material.state);
+    } else {
+      material.state->SetTexture(creation->LoadTexture(material.diffuseTexture));
+      ShareRenderState(material);
+    }
+  }
+}
+
+void
+NodeFactoryObj::State::MergeGeometries() {
+  CreationContextPtr creation = context.lock();
+  if (!creation || !root) {
+    return;
+  }
+  // Group by RenderState, keeping the order in which materials were first used.
+  std::vector<std::vector<GeometryPtr>> batches;
+  std::unordered_map<RenderState*, size_t> batchIndex;
+  for (GeometryPtr& geometry: geometries) {
+    if (geometry->GetFaceCount() == 0) {
+      continue;
+    }
+    RenderState* key = geometry->GetRenderState().get();
+    auto it = batchIndex.find(key);
+    if (it == batchIndex.end()) {
+      batchIndex[key] = batches.size();
+      batches.emplace_back();
+      batches.back().push_back(geometry);
+    } else {
+      batches[it->second].push_back(geometry);
+    }
+  }
+
+  std::vector<GeometryPtr> result;
+  std::vector<NodePtr> pieces;
+  for (std::vector<GeometryPtr>& batch: batches) {
+    if (batch.size() < 2) {
+      result.push_back(batch.front());
+      continue;
+    }
+    GeometryPtr merged = Geometry::Create(creation);
+    merged->SetName(batch.front()->GetName());
+    merged->SetVertexArray(vertices);
+    merged->SetRenderState(batch.front()->GetRenderState());
+    for (GeometryPtr& piece: batch) {
+      merged->AddPart(piece->GetName(), merged->GetFaceCount(), piece->GetFaceCount());
+      merged->AppendFaces(*piece);
+      pieces.push_back(piece);
+    }
+    root->AddNode(merged);
+    result.push_back(merged);
+  }
+  root->RemoveNodes(pieces);
+  geometries.swap(result);
+}
+
+void
+NodeFactoryObj::State::GenerateLevelsOfDetail() {
+  CreationContextPtr creation = context.lock();
+  if (!creation || !root) {
+    return;
+  }
+  std::vector<GeometryPtr> simplified;
+  for (GeometryPtr& geometry: geometries) {
+    std::vector<GeometryPtr> levels{geometry};
+    float ratio = 1.0f;
+    for (int32_t level = 1; level < levelCount; level++) {
+      ratio *= 0.5f;
+      GeometryPtr next = geometry->CreateSimplified(creation, ratio, kLevelOfDetailMaxError);
+      if (!next) {
+        break;
+      }
+      levels.push_back(next);
+    }
+    if (levels.size() < 2) {
+      continue;
+    }
+    LevelOfDetailPtr lod = LevelOfDetail::Create(creation);
+    lod->SetName(geometry->GetName());
+    float coverage = kLevelOfDetailCoverage;
+    for (size_t ix = 0; ix < levels.size(); ix++) {
+      // The least detailed level is drawn however small the model gets.
+      lod->AddLevel(levels[ix], (ix + 1) < levels.size() ? coverage : 0.0f);
+      coverage *= 0.5f;
+    }
+    simplified.insert(simplified.end(), levels.begin() + 1, levels.end());
+    root->RemoveNode(*geometry);
+    root->AddNode(lod);
+  }
+  // Simplified levels are optimized and share the vertex buffer as well.
+  geometries.insert(geometries.end(), simplified.begin(), simplified.end());
 }
 
 NodeFactoryObjPtr
@@ -112,9 +356,30 @@ NodeFactoryObj::StartModel(const std::string& aFileName) {
 
 void
 NodeFactoryObj::FinishModel() {
+  LoadReportTimer timer(LoadReport::Phase::MeshBuild);
   if (m.vertices && m.vertices->GetUVCount() > 0) {
     m.vertices->SetUVLength(2);
   }
+  // Before merging so that normals average across the source geometries.
+  CreationContextPtr creation = m.context.lock();
+  Geometry::GenerateNormals(m.geometries, m.normalWeighting, creation ? creation->GetJobSystem() : nullptr);
+  m.AssignAtlasTextures();
+  if (m.mergeGeometry) {
+    m.MergeGeometries();
+  }
+  if (m.levelCount > 1) {
+    m.GenerateLevelsOfDetail();
+  }
+  for (GeometryPtr& geometry: m.geometries) {
+    if (m.optimizeMeshes) {
+      geometry->OptimizeMesh();
+    }
+    geometry->SetTriangleStrips(m.triangleStrips);
+    geometry->SetReleaseSourceData(m.releaseSource);
+  }
+  if (m.shareVertices && (m.geometries.size() > 1)) {
+    Geometry::ShareVertexBuffer(m.geometries);
+  }
   m.Reset();
 }
 
@@ -133,11 +398,19 @@ NodeFactoryObj::SetGroupNames(const std::vector<std::string>& aNames) {
   m.currentGeometry = Geometry::Create(creation);
   m.currentGeometry->SetName(aNames.front());
   m.root->AddNode(m.currentGeometry);
+  m.geometries.push_back(m.currentGeometry);
   m.currentGeometry->SetVertexArray(m.vertices);
+  if (m.hasSmoothingGroup) {
+    m.currentGeometry->SetSmoothingGroup(m.smoothingGroup);
+  }
   if (!m.defaultRenderState) {
     m.defaultRenderState = RenderState::Create(creation);
     ProgramPtr program = creation->GetProgramFactory()->CreateProgram(creation, 0);
     m.defaultRenderState->SetProgram(program);
+    MaterialRegistryPtr registry = creation->GetMaterialRegistry();
+    if (registry) {
+      m.defaultRenderState = registry->Share(m.defaultRenderState);
+    }
   }
   m.currentGeometry->SetRenderState(m.defaultRenderState);
 }
@@ -151,7 +424,7 @@ NodeFactoryObj::SetObjectName(const std::string& aName) {
 
 void
 NodeFactoryObj::SetMaterialName(const std::string& aName) {
-  auto it = m.materials.find(aName);
+  auto it = m.materials.find(InternAsset(aName));
   if (it == m.materials.end()) {
     VRB_WARN("Failed to find material: '%s'", aName.c_str());
     return;
@@ -187,6 +460,11 @@ NodeFactoryObj::AddUV(const float aU, const float aV, const float aW) {
 
 void
 NodeFactoryObj::SetSmoothingGroup(const int aGroup) {
+  m.hasSmoothingGroup = true;
+  m.smoothingGroup = aGroup;
+  if (m.currentGeometry) {
+    m.currentGeometry->SetSmoothingGroup(aGroup);
+  }
 }
 
 void
@@ -202,6 +480,31 @@ NodeFactoryObj::AddFace(
   m.currentGeometry->AddFace(aVerticies, aUVs, aNormals);
 }
 
+void
+NodeFactoryObj::AddVertices(const float* aPoints, const size_t aCount) {
+  m.vertices->AppendVertices(aPoints, aCount, 4);
+}
+
+void
+NodeFactoryObj::AddNormals(const float* aNormals, const size_t aCount) {
+  m.vertices->AppendNormals(aNormals, aCount, 3);
+}
+
+void
+NodeFactoryObj::AddUVs(const float* aUVs, const size_t aCount) {
+  m.vertices->AppendUVs(aUVs, aCount, 3);
+}
+
+void
+NodeFactoryObj::AddFaces(const int* aIndices, const uint32_t* aCornerCounts, const size_t aFaceCount) {
+  if (!m.currentGeometry) {
+    std::vector<std::string> names;
+    names.emplace_back("");
+    SetGroupNames(names);
+  }
+  m.currentGeometry->AddFaces(aIndices, aCornerCounts, aFaceCount);
+}
+
 void
 NodeFactoryObj::StartMaterialFile(const std::string& aFileName) {
   //VRB_LOG("StartMaterialFile: '%s'", aFileName.c_str());
@@ -215,7 +518,7 @@ NodeFactoryObj::FinishMaterialFile() {
 void
 NodeFactoryObj::CreateMaterial(const std::string& aName ) {
   //VRB_LOG("CreateMaterial: '%s'", aName.c_str());
-  m.currentMaterial = &m.materials[aName];
+  m.currentMaterial = &m.materials[InternAsset(aName)];
 }
 
 void
@@ -262,7 +565,7 @@ void
 NodeFactoryObj::SetAmbientTexture(const std::string& aFileName) {
   //VRB_LOG("SetAmbientTexture: '%s'", aFileName.c_str());
   if (m.currentMaterial) {
-    m.currentMaterial->ambientTextureName = aFileName;
+    m.currentMaterial->ambientTexture = InternAsset(aFileName);
   }
 }
 
@@ -270,7 +573,12 @@ void
 NodeFactoryObj::SetDiffuseTexture(const std::string& aFileName) {
   //VRB_LOG("SetDiffuseTexture: '%s'", aFileName.c_str());
   if (m.currentMaterial) {
-    m.currentMaterial->diffuseTextureName = aFileName;
+    m.currentMaterial->diffuseTexture = InternAsset(aFileName);
+    // Decoded while the mesh is parsed, textures packed into an atlas are
+    // loaded by the atlas instead.
+    if (!m.atlas) {
+      m.PrefetchTexture(m.currentMaterial->diffuseTexture);
+    }
   }
 }
 
@@ -278,7 +586,7 @@ void
 NodeFactoryObj::SetSpecularTexture(const std::string& aFileName) {
   //VRB_LOG("SetSpecularTexture: '%s'", aFileName.c_str());
   if (m.currentMaterial) {
-    m.currentMaterial->specularTextureName = aFileName;
+    m.currentMaterial->specularTexture = InternAsset(aFileName);
   }
 }
 
@@ -293,6 +601,46 @@ NodeFactoryObj::GetModelRoot() {
   return m.root;
 }
 
+void
+NodeFactoryObj::SetMergeGeometry(const bool aMerge) {
+  m.mergeGeometry = aMerge;
+}
+
+void
+NodeFactoryObj::SetOptimizeMeshes(const bool aOptimize) {
+  m.optimizeMeshes = aOptimize;
+}
+
+void
+NodeFactoryObj::SetNormalWeighting(const Geometry::NormalWeighting aWeighting) {
+  m.normalWeighting = aWeighting;
+}
+
+void
+NodeFactoryObj::SetTriangleStrips(const bool aStrips) {
+  m.triangleStrips = aStrips;
+}
+
+void
+NodeFactoryObj::SetShareVertices(const bool aShare) {
+  m.shareVertices = aShare;
+}
+
+void
+NodeFactoryObj::SetReleaseSourceData(const bool aRelease) {
+  m.releaseSource = aRelease;
+}
+
+void
+NodeFactoryObj::SetLevelsOfDetail(const int32_t aLevelCount) {
+  m.levelCount = std::max(aLevelCount, 1);
+}
+
+void
+NodeFactoryObj::SetTextureAtlas(const TextureAtlasPtr& aAtlas) {
+  m.atlas = aAtlas;
+}
+
 NodeFactoryObj::NodeFactoryObj(State& aState, CreationContextPtr& aContext) : m(aState) {
   m.context = aContext;
 }
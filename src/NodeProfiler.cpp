@@ -0,0 +1,359 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/NodeProfiler.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Drawable.h"
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/GLExtensions.h"
+#include "vrb/Group.h"
+#include "vrb/Logger.h"
+#include "vrb/Mutex.h"
+#include "vrb/Node.h"
+#include "vrb/RenderContext.h"
+#include "vrb/TraceProfiler.h"
+#include "vrb/gl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <unordered_map>
+
+namespace {
+
+const double kNanosecondsToSeconds = 1.0e-9;
+
+// Unnamed nodes are attributed to their nearest named parent.
+const std::string&
+GetProfileName(const vrb::Node* aNode) {
+  static const std::string kUnnamed("(unnamed)");
+  const vrb::Node* node = aNode;
+  while (node) {
+    if (!node->GetName().empty()) {
+      return node->GetName();
+    }
+    node = node->GetParentCount() > 0 ? node->GetParent(0) : nullptr;
+  }
+  return kUnnamed;
+}
+
+} // namespace
+
+namespace vrb {
+
+struct NodeProfiler::State {
+  // Timestamps around one draw, resolved once the GPU has passed them.
+  struct Query {
+    GLuint begin;
+    GLuint end;
+    Entry* entry;
+  };
+  typedef std::vector<Query> Frame;
+  RenderContextWeak context;
+  GLExtensionsPtr extensions;
+  GLDeletionQueuePtr glDeletions;
+  // Cull scopes report from the culling threads.
+  mutable Mutex lock;
+  // Values are not moved by inserts, so queries point at them.
+  std::unordered_map<std::string, Entry> entries;
+  bool capturing;
+  int framesLeft;
+  int frames;
+  Frame current;
+  std::deque<Frame> pending;
+  std::vector<GLuint> freeQueries;
+
+  State() : capturing(false), framesLeft(0), frames(0) {}
+
+  Entry& FindEntry(const std::string& aName) {
+    Entry& result = entries[aName];
+    if (result.name.empty()) {
+      result.name = aName;
+    }
+    return result;
+  }
+
+  bool IsTimerSupported() const {
+    return extensions && extensions->IsExtensionSupported(GLExtensions::Ext::EXT_disjoint_timer_query);
+  }
+
+  GLuint GetQuery() {
+    if (freeQueries.empty()) {
+      GLuint query = 0;
+      extensions->GetFunctions().glGenQueriesEXT(1, &query);
+      return query;
+    }
+    const GLuint result = freeQueries.back();
+    freeQueries.pop_back();
+    return result;
+  }
+
+  int32_t BeginQuery() {
+    if (!capturing || !IsTimerSupported()) {
+      return -1;
+    }
+    Query query = {GetQuery(), GetQuery(), nullptr};
+    extensions->GetFunctions().glQueryCounterEXT(query.begin, GL_TIMESTAMP_EXT);
+    current.push_back(query);
+    return (int32_t)current.size() - 1;
+  }
+
+  void EndQuery(const int32_t aQuery, Entry& aEntry) {
+    if ((aQuery < 0) || (aQuery >= (int32_t)current.size())) {
+      return;
+    }
+    Query& query = current[aQuery];
+    extensions->GetFunctions().glQueryCounterEXT(query.end, GL_TIMESTAMP_EXT);
+    query.entry = &aEntry;
+  }
+
+  void ReleaseFrame(const Frame& aFrame) {
+    for (const Query& query: aFrame) {
+      freeQueries.push_back(query.begin);
+      freeQueries.push_back(query.end);
+    }
+  }
+
+  // Adds the GPU times of the pending frames whose results are available,
+  // oldest first, or of every pending frame when aWait is true.
+  void CollectGPUTimes(const bool aWait) {
+    if (pending.empty() || !IsTimerSupported()) {
+      return;
+    }
+    const GLExtensions::Functions& gl = extensions->GetFunctions();
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) {
+      // Timestamps issued across a disjoint event are meaningless.
+      for (const Frame& frame: pending) {
+        ReleaseFrame(frame);
+      }
+      pending.clear();
+      return;
+    }
+    while (!pending.empty()) {
+      const Frame& frame = pending.front();
+      if (!frame.empty() && !aWait) {
+        // Timestamps complete in order, so the last one covers the frame.
+        GLint available = 0;
+        gl.glGetQueryObjectivEXT(frame.back().end, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available) {
+          return;
+        }
+      }
+      MutexAutoLock guard(lock);
+      for (const Query& query: frame) {
+        if (!query.entry) {
+          continue;
+        }
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        gl.glGetQueryObjectui64vEXT(query.begin, GL_QUERY_RESULT_EXT, &begin);
+        gl.glGetQueryObjectui64vEXT(query.end, GL_QUERY_RESULT_EXT, &end);
+        if (end > begin) {
+          query.entry->gpuTime += (double)(end - begin) * kNanosecondsToSeconds;
+        }
+      }
+      ReleaseFrame(frame);
+      pending.pop_front();
+    }
+  }
+};
+
+namespace {
+
+// The capturing profiler.
+std::atomic<NodeProfiler*> sActive(nullptr);
+thread_local NodeProfiler::DrawScope* sDrawScope = nullptr;
+
+} // namespace
+
+NodeProfilerPtr
+NodeProfiler::Create(RenderContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<NodeProfiler, NodeProfiler::State> >(aContext);
+}
+
+void
+NodeProfiler::StartCapture(const int aFrames) {
+  StopCapture();
+  NodeProfiler* expected = nullptr;
+  if (!sActive.compare_exchange_strong(expected, this)) {
+    VRB_WARN("NodeProfiler: another profiler is capturing");
+    return;
+  }
+  RenderContextPtr context = m.context.lock();
+  m.extensions = context ? context->GetGLExtensions() : nullptr;
+  {
+    MutexAutoLock guard(m.lock);
+    m.entries.clear();
+  }
+  m.frames = 0;
+  m.framesLeft = std::max(aFrames, 1);
+  m.capturing = true;
+}
+
+void
+NodeProfiler::StopCapture() {
+  if (!m.capturing) {
+    return;
+  }
+  NodeProfiler* expected = this;
+  sActive.compare_exchange_strong(expected, nullptr);
+  m.capturing = false;
+  m.pending.push_back(std::move(m.current));
+  m.current.clear();
+  m.CollectGPUTimes(true);
+}
+
+bool
+NodeProfiler::IsCapturing() const {
+  return m.capturing;
+}
+
+void
+NodeProfiler::EndFrame() {
+  if (!m.capturing) {
+    return;
+  }
+  m.frames++;
+  m.pending.push_back(std::move(m.current));
+  m.current.clear();
+  m.CollectGPUTimes(false);
+  m.framesLeft--;
+  if (m.framesLeft <= 0) {
+    StopCapture();
+  }
+}
+
+int
+NodeProfiler::GetFrameCount() const {
+  return m.frames;
+}
+
+std::vector<NodeProfiler::Entry>
+NodeProfiler::GetTopEntries(const Sort aSort, const size_t aCount) const {
+  std::vector<Entry> result;
+  {
+    MutexAutoLock guard(m.lock);
+    result.reserve(m.entries.size());
+    for (const auto& item: m.entries) {
+      result.push_back(item.second);
+    }
+  }
+  auto cost = [aSort](const Entry& aEntry) -> double {
+    switch (aSort) {
+      case Sort::CullTime: return aEntry.cullTime;
+      case Sort::GPUTime: return aEntry.gpuTime;
+      case Sort::DrawCalls: return (double)aEntry.drawCalls;
+      case Sort::Triangles: return (double)aEntry.triangles;
+    }
+    return 0.0;
+  };
+  std::sort(result.begin(), result.end(), [&cost](const Entry& aLeft, const Entry& aRight) {
+    const double kLeft = cost(aLeft);
+    const double kRight = cost(aRight);
+    return kLeft != kRight ? kLeft > kRight : aLeft.name < aRight.name;
+  });
+  if (result.size() > aCount) {
+    result.resize(aCount);
+  }
+  return result;
+}
+
+std::string
+NodeProfiler::GetReport(const Sort aSort, const size_t aCount) const {
+  const std::vector<Entry> kEntries = GetTopEntries(aSort, aCount);
+  const double kFrames = std::max(m.frames, 1);
+  char line[256];
+  snprintf(line, sizeof(line), "Per frame averages over %d frames:\n%10s %8s %8s %10s %10s  %s\n", m.frames,
+           "cull ms", "culls", "draws", "triangles", "gpu ms", "node");
+  std::string result(line);
+  for (const Entry& entry: kEntries) {
+    snprintf(line, sizeof(line), "%10.3f %8.1f %8.1f %10.0f %10.3f  %s\n",
+             entry.cullTime * 1000.0 / kFrames, (double)entry.culls / kFrames, (double)entry.drawCalls / kFrames,
+             (double)entry.triangles / kFrames, entry.gpuTime * 1000.0 / kFrames, entry.name.c_str());
+    result += line;
+  }
+  return result;
+}
+
+NodeProfiler::CullScope::CullScope(const Node& aNode) : mNode(nullptr), mStart(0) {
+  if (sActive.load(std::memory_order_relaxed) && !aNode.GetName().empty()) {
+    mNode = &aNode;
+    mStart = TraceGetTime();
+  }
+}
+
+NodeProfiler::CullScope::~CullScope() {
+  if (!mNode) {
+    return;
+  }
+  const uint64_t kEnd = TraceGetTime();
+  NodeProfiler* profiler = sActive.load(std::memory_order_acquire);
+  if (!profiler) {
+    return;
+  }
+  MutexAutoLock guard(profiler->m.lock);
+  Entry& entry = profiler->m.FindEntry(mNode->GetName());
+  entry.cullTime += (double)(kEnd - mStart) * kNanosecondsToSeconds;
+  entry.culls++;
+}
+
+NodeProfiler::DrawScope::DrawScope(Drawable& aDrawable)
+    : mDrawable(nullptr)
+    , mDrawCalls(0)
+    , mTriangles(0)
+    , mQuery(-1) {
+  NodeProfiler* profiler = sActive.load(std::memory_order_relaxed);
+  if (!profiler) {
+    return;
+  }
+  mDrawable = &aDrawable;
+  mQuery = profiler->m.BeginQuery();
+  sDrawScope = this;
+}
+
+NodeProfiler::DrawScope::~DrawScope() {
+  if (!mDrawable) {
+    return;
+  }
+  sDrawScope = nullptr;
+  NodeProfiler* profiler = sActive.load(std::memory_order_acquire);
+  if (!profiler) {
+    return;
+  }
+  State& state = profiler->m;
+  Entry* entry = nullptr;
+  {
+    MutexAutoLock guard(state.lock);
+    entry = &state.FindEntry(GetProfileName(dynamic_cast<const Node*>(mDrawable)));
+    entry->drawCalls += mDrawCalls;
+    entry->triangles += mTriangles;
+  }
+  state.EndQuery(mQuery, *entry);
+}
+
+void
+NodeProfiler::AddDraws(const uint64_t aDrawCalls, const uint64_t aTriangles) {
+  if (sDrawScope) {
+    sDrawScope->AddDraws(aDrawCalls, aTriangles);
+  }
+}
+
+NodeProfiler::NodeProfiler(State& aState, RenderContextPtr& aContext) : m(aState) {
+  m.context = aContext;
+  m.glDeletions = aContext->GetGLDeletionQueue();
+}
+
+NodeProfiler::~NodeProfiler() {
+  StopCapture();
+  for (const GLuint query: m.freeQueries) {
+    m.glDeletions->DeleteQuery(query);
+  }
+}
+
+} // namespace vrb
@@ -1,91 +1,172 @@
 #include "vrb/ObjectCounter.h"
 
 #include "vrb/Logger.h"
-#include "vrb/Mutex.h"
-#include <string>
-#include <unordered_map>
+#include <atomic>
+#include <map>
 
-namespace vrb {
+namespace {
+
+// Counts are kept in fixed size, lock-free hash tables. Each thread is assigned
+// one of several shards so that loader threads and the render thread do not
+// contend on the same cache lines. Objects may be destroyed on a different
+// thread than they were created on, so a single shard may hold a negative
+// count; the shards are only merged when a report is requested.
+const int kShardCount = 8;
+const int kSlotCount = 512;
+
+struct Slot {
+  std::atomic<std::size_t> handle;
+  std::atomic<const char*> name;
+  std::atomic<int32_t> count;
+};
+
+struct Shard {
+  Slot slots[kSlotCount];
+};
+
+Shard sShards[kShardCount];
+std::atomic<bool> sEnabled(false);
+std::atomic<bool> sFullWarned(false);
+std::atomic<int> sNextShard(0);
+
+std::size_t
+ToKey(const std::size_t aHandle) {
+  // Zero marks an empty slot.
+  return aHandle ? aHandle : 1;
+}
+
+Shard&
+GetShard() {
+  thread_local int tShard = sNextShard.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+  return sShards[tShard];
+}
+
+Slot*
+FindSlot(Shard& aShard, const std::size_t aHandle) {
+  const std::size_t kKey = ToKey(aHandle);
+  for (int probe = 0; probe < kSlotCount; probe++) {
+    Slot& slot = aShard.slots[(kKey + probe) % kSlotCount];
+    std::size_t current = slot.handle.load(std::memory_order_acquire);
+    if (current == kKey) {
+      return &slot;
+    }
+    if ((current == 0) &&
+        (slot.handle.compare_exchange_strong(current, kKey, std::memory_order_acq_rel) || (current == kKey))) {
+      return &slot;
+    }
+  }
+  if (!sFullWarned.exchange(true, std::memory_order_relaxed)) {
+    VRB_WARN("Object counter table is full, some types will not be counted");
+  }
+  return nullptr;
+}
 
-struct ObjectCounterInfo {
+struct Tally {
   int32_t count = 0;
-  std::string name;
-  ObjectCounterInfo(const int32_t aCount, const std::string& aName) :
-    count(aCount),
-    name(aName) {}
-  ObjectCounterInfo(const ObjectCounterInfo& aInfo) = default;
-  ObjectCounterInfo& operator=(const ObjectCounterInfo& aInfo) = default;
+  const char* name = nullptr;
 };
 
-static Mutex* sLock;
-static std::unordered_map<std::size_t, ObjectCounterInfo> sMap;
+// Merges every shard. Slots claimed by a removal carry no name, so the name is
+// taken from whichever shard has one.
+std::map<std::size_t, Tally>
+Merge() {
+  std::map<std::size_t, Tally> result;
+  for (Shard& shard: sShards) {
+    for (Slot& slot: shard.slots) {
+      const std::size_t kKey = slot.handle.load(std::memory_order_acquire);
+      if (kKey == 0) {
+        continue;
+      }
+      Tally& tally = result[kKey];
+      tally.count += slot.count.load(std::memory_order_relaxed);
+      const char* name = slot.name.load(std::memory_order_acquire);
+      if (name && !tally.name) {
+        tally.name = name;
+      }
+    }
+  }
+  return result;
+}
 
 void
-InitializeObjectCounter() {
-  if (!sLock) {
-    sLock = new Mutex();
+Reset() {
+  for (Shard& shard: sShards) {
+    for (Slot& slot: shard.slots) {
+      slot.count.store(0, std::memory_order_relaxed);
+      slot.name.store(nullptr, std::memory_order_relaxed);
+      slot.handle.store(0, std::memory_order_release);
+    }
   }
 }
 
+} // namespace
+
+namespace vrb {
+
+void
+InitializeObjectCounter() {
+  sEnabled.store(true, std::memory_order_release);
+}
+
 void
 LogObjectCount() {
-  if (!sLock) {
+  if (!sEnabled.load(std::memory_order_acquire)) {
     return;
   }
-  MutexAutoLock lock(*sLock);
-  for (const auto& info: sMap) {
-    VRB_LOG("Type: %s count: %d", info.second.name.c_str(), info.second.count);
+  for (const auto& info: Merge()) {
+    VRB_LOG("Type: %s count: %d", info.second.name ? info.second.name : "unknown", info.second.count);
   }
 }
 
 void
 ShutdownObjectCounter() {
-  if (!sLock) {
+  if (!sEnabled.exchange(false, std::memory_order_acq_rel)) {
     return;
   }
 
-  if (sMap.size() == 0) {
+  const std::map<std::size_t, Tally> kTallies = Merge();
+  if (kTallies.size() == 0) {
     return;
   }
 
-  delete sLock; sLock = nullptr;
-
   int leakCount = 0;
-  for (const auto& info: sMap) {
+  for (const auto& info: kTallies) {
     if (info.second.count > 0) {
        leakCount++;
-       VRB_ERROR("Leak detected: %s count: %d", info.second.name.c_str(), info.second.count);
+       VRB_ERROR("Leak detected: %s count: %d", info.second.name ? info.second.name : "unknown", info.second.count);
     }
   }
   if (leakCount == 0) {
     VRB_DEBUG("No leaks detected");
   }
-  sMap.clear();
+  Reset();
 }
 
 void
 AddObject(std::size_t aHandle, const char* aName) {
-  if (!sLock) {
+  if (!sEnabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  Slot* slot = FindSlot(GetShard(), aHandle);
+  if (!slot) {
     return;
   }
-  MutexAutoLock lock(*sLock);
-  auto search = sMap.find(aHandle);
-  if (search != sMap.end()) {
-    search->second.count++;
-  } else {
-    sMap.emplace(aHandle, ObjectCounterInfo(1, aName));
+  if (!slot->name.load(std::memory_order_relaxed)) {
+    slot->name.store(aName, std::memory_order_release);
   }
+  slot->count.fetch_add(1, std::memory_order_relaxed);
 }
 
 void
 RemoveObject(std::size_t aHandle) {
-  if (!sLock) {
+  if (!sEnabled.load(std::memory_order_relaxed)) {
     return;
   }
-  MutexAutoLock lock(*sLock);
-  auto search = sMap.find(aHandle);
-  if (search != sMap.end()) {
-    search->second.count--;
+  // The object may have been created on another thread, in which case the
+  // slot in this thread's shard has no name until the shards are merged.
+  Slot* slot = FindSlot(GetShard(), aHandle);
+  if (slot) {
+    slot->count.fetch_sub(1, std::memory_order_relaxed);
   }
 }
 
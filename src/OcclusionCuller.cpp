@@ -0,0 +1,303 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/OcclusionCuller.h"
+#include "vrb/private/ResourceGLState.h"
+
+#include "vrb/Bounds.h"
+#include "vrb/Camera.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/GLError.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/Mutex.h"
+#include "vrb/ShaderUtil.h"
+#include "vrb/TraceProfiler.h"
+#include "vrb/Vector.h"
+#include "vrb/gl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const char* sVertexShader = R"SHADER(
+#version 100
+uniform mat4 u_matrix;
+attribute vec3 a_position;
+void main() {
+  gl_Position = u_matrix * vec4(a_position, 1.0);
+}
+)SHADER";
+
+const char* sFragmentShader = R"SHADER(
+#version 100
+precision lowp float;
+void main() {
+  gl_FragColor = vec4(1.0);
+}
+)SHADER";
+
+#if defined(ANDROID)
+const GLenum kQueryTarget = GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+#else
+const GLenum kQueryTarget = GL_ANY_SAMPLES_PASSED;
+#endif
+
+// Entries of nodes that were not tested for this many frames are dropped.
+const uint32_t kMaxIdleFrames = 60;
+// Boxes are grown so that flat bounds still cover samples when seen edge on.
+const float kMinExtent = 0.01f;
+
+const GLfloat kCubeVertices[] = {
+  -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f, 1.0f, -1.0f,   -1.0f, 1.0f, -1.0f,
+  -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,   1.0f, 1.0f,  1.0f,   -1.0f, 1.0f,  1.0f
+};
+
+const GLushort kCubeIndices[] = {
+  0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,
+  3, 6, 2, 3, 7, 6,  0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5
+};
+
+bool
+SameVector(const vrb::Vector& aLeft, const vrb::Vector& aRight) {
+  return (aLeft.x() == aRight.x()) && (aLeft.y() == aRight.y()) && (aLeft.z() == aRight.z());
+}
+
+bool
+SameBounds(const vrb::Bounds& aLeft, const vrb::Bounds& aRight) {
+  return SameVector(aLeft.Min(), aRight.Min()) && SameVector(aLeft.Max(), aRight.Max());
+}
+
+}
+
+namespace vrb {
+
+struct OcclusionCuller::State : public ResourceGL::State {
+  struct Entry {
+    Bounds bounds;
+    GLuint query = 0;
+    // A query is in flight, no other is issued until it is read.
+    bool pending = false;
+    // Tested by the current cull and waiting for Draw.
+    bool queued = false;
+    int32_t hiddenResults = 0;
+    uint32_t lastFrame = 0;
+  };
+  // IsOccluded may be called by several cull threads at once.
+  Mutex lock;
+  std::unordered_map<const Node*, Entry> entries;
+  std::vector<const Node*> queue;
+  uint32_t frame = 1;
+  int32_t hysteresis = 2;
+  int32_t occludedCount = 0;
+  int32_t lastOccludedCount = 0;
+  GLuint program = 0;
+  GLuint vertexShader = 0;
+  GLuint fragmentShader = 0;
+  GLuint vertexArray = 0;
+  GLuint vertexBuffer = 0;
+  GLuint indexBuffer = 0;
+  GLint uMatrix = -1;
+  GLint aPosition = -1;
+
+  void ReadResults();
+};
+
+void
+OcclusionCuller::State::ReadResults() {
+  for (auto it = entries.begin(); it != entries.end();) {
+    Entry& entry = it->second;
+    if (entry.pending) {
+      GLuint available = 0;
+      VRB_GL_CHECK(glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT_AVAILABLE, &available));
+      if (available) {
+        GLuint passed = 1;
+        VRB_GL_CHECK(glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT, &passed));
+        entry.hiddenResults = passed ? 0 : std::min(entry.hiddenResults + 1, hysteresis);
+        entry.pending = false;
+      }
+    }
+    if (!entry.pending && ((frame - entry.lastFrame) > kMaxIdleFrames)) {
+      if (entry.query) {
+        VRB_GL_CHECK(glDeleteQueries(1, &entry.query));
+      }
+      it = entries.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+OcclusionCullerPtr
+OcclusionCuller::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<OcclusionCuller, OcclusionCuller::State> >(aContext);
+}
+
+bool
+OcclusionCuller::IsOccluded(const Node& aNode, const Bounds& aWorldBounds) {
+  MutexAutoLock lock(m.lock);
+  State::Entry& entry = m.entries[&aNode];
+  if (entry.lastFrame != m.frame) {
+    entry.lastFrame = m.frame;
+    if (!SameBounds(entry.bounds, aWorldBounds)) {
+      // Results for other bounds say nothing about these.
+      entry.bounds = aWorldBounds;
+      entry.hiddenResults = 0;
+    }
+    if (!entry.queued) {
+      entry.queued = true;
+      m.queue.push_back(&aNode);
+    }
+  }
+  if (entry.hiddenResults >= m.hysteresis) {
+    m.occludedCount++;
+    return true;
+  }
+  return false;
+}
+
+void
+OcclusionCuller::Draw(const Camera& aCamera) {
+  VRB_TRACE_ZONE("OcclusionCuller::Draw");
+  m.lastOccludedCount = m.occludedCount;
+  m.occludedCount = 0;
+  if (!m.program) {
+    for (const Node* node: m.queue) {
+      m.entries[node].queued = false;
+    }
+    m.queue.clear();
+    m.frame++;
+    return;
+  }
+  m.ReadResults();
+
+  const Matrix& kViewProjection = aCamera.GetViewProjection();
+  const Vector kEye = aCamera.GetTransform().GetTranslation();
+  // Boxes crossing the near plane are clipped and may report hidden.
+  const Matrix& kPerspective = aCamera.GetPerspective();
+  const float kNear = std::max(kPerspective.At(3, 2) / (kPerspective.At(2, 2) - 1.0f), 0.0f);
+
+  VRB_GL_CHECK(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+  VRB_GL_CHECK(glDepthMask(GL_FALSE));
+  VRB_GL_CHECK(glUseProgram(m.program));
+  VRB_GL_CHECK(glBindVertexArray(m.vertexArray));
+  for (const Node* node: m.queue) {
+    State::Entry& entry = m.entries[node];
+    entry.queued = false;
+    if (entry.pending) {
+      continue;
+    }
+    const Vector kCenter = entry.bounds.Center();
+    Vector extents = entry.bounds.Extents();
+    const float kLargest = std::max(extents.x(), std::max(extents.y(), extents.z()));
+    const float kMin = std::max(kLargest * kMinExtent, std::numeric_limits<float>::epsilon());
+    extents.Set(std::max(extents.x(), kMin), std::max(extents.y(), kMin), std::max(extents.z(), kMin));
+    const Vector kOffset = kEye - kCenter;
+    if ((fabsf(kOffset.x()) <= (extents.x() + kNear)) && (fabsf(kOffset.y()) <= (extents.y() + kNear)) &&
+        (fabsf(kOffset.z()) <= (extents.z() + kNear))) {
+      entry.hiddenResults = 0;
+      continue;
+    }
+    if (!entry.query) {
+      VRB_GL_CHECK(glGenQueries(1, &entry.query));
+    }
+    const Matrix kBox = kViewProjection.AffinePostMultiply(Matrix::FromTranslationScale(kCenter, extents));
+    VRB_GL_CHECK(glUniformMatrix4fv(m.uMatrix, 1, GL_FALSE, kBox.Data()));
+    VRB_GL_CHECK(glBeginQuery(kQueryTarget, entry.query));
+    VRB_GL_CHECK(glDrawElements(GL_TRIANGLES, sizeof(kCubeIndices) / sizeof(kCubeIndices[0]), GL_UNSIGNED_SHORT, nullptr));
+    VRB_GL_CHECK(glEndQuery(kQueryTarget));
+    entry.pending = true;
+  }
+  VRB_GL_CHECK(glBindVertexArray(0));
+  VRB_GL_CHECK(glUseProgram(0));
+  VRB_GL_CHECK(glDepthMask(GL_TRUE));
+  VRB_GL_CHECK(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+  m.queue.clear();
+  m.frame++;
+}
+
+void
+OcclusionCuller::SetHysteresis(const int32_t aFrames) {
+  m.hysteresis = std::max(aFrames, 1);
+}
+
+int32_t
+OcclusionCuller::GetOccludedCount() const {
+  return m.lastOccludedCount;
+}
+
+OcclusionCuller::OcclusionCuller(State& aState, CreationContextPtr& aContext) : ResourceGL(aState, aContext), m(aState) {}
+OcclusionCuller::~OcclusionCuller() {}
+
+// ResourceGL interface
+void
+OcclusionCuller::InitializeGL() {
+  m.vertexShader = LoadShader(GL_VERTEX_SHADER, sVertexShader);
+  m.fragmentShader = LoadShader(GL_FRAGMENT_SHADER, sFragmentShader);
+  if (m.vertexShader && m.fragmentShader) {
+    m.program = CreateProgram(m.vertexShader, m.fragmentShader);
+  }
+  if (!m.program) {
+    VRB_ERROR("Failed to create occlusion query program, occlusion culling is disabled");
+    return;
+  }
+  m.uMatrix = GetUniformLocation(m.program, "u_matrix");
+  m.aPosition = GetAttributeLocation(m.program, "a_position");
+
+  VRB_GL_CHECK(glGenVertexArrays(1, &m.vertexArray));
+  VRB_GL_CHECK(glBindVertexArray(m.vertexArray));
+  VRB_GL_CHECK(glGenBuffers(1, &m.vertexBuffer));
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.vertexBuffer));
+  VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(kCubeVertices), kCubeVertices, GL_STATIC_DRAW));
+  VRB_GL_CHECK(glGenBuffers(1, &m.indexBuffer));
+  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.indexBuffer));
+  VRB_GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(kCubeIndices), kCubeIndices, GL_STATIC_DRAW));
+  if (m.aPosition >= 0) {
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.aPosition, 3, GL_FLOAT, GL_FALSE, 0, nullptr));
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.aPosition));
+  }
+  VRB_GL_CHECK(glBindVertexArray(0));
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+void
+OcclusionCuller::ShutdownGL() {
+  for (auto& item: m.entries) {
+    State::Entry& entry = item.second;
+    if (entry.query) {
+      VRB_GL_CHECK(glDeleteQueries(1, &entry.query));
+    }
+    // Queries are lost with the context, so are their results.
+    entry.query = 0;
+    entry.pending = false;
+    entry.hiddenResults = 0;
+  }
+  if (m.vertexArray) {
+    VRB_GL_CHECK(glDeleteVertexArrays(1, &m.vertexArray));
+  }
+  if (m.vertexBuffer) {
+    VRB_GL_CHECK(glDeleteBuffers(1, &m.vertexBuffer));
+  }
+  if (m.indexBuffer) {
+    VRB_GL_CHECK(glDeleteBuffers(1, &m.indexBuffer));
+  }
+  if (m.program) {
+    VRB_GL_CHECK(glDeleteProgram(m.program));
+  }
+  if (m.vertexShader) {
+    VRB_GL_CHECK(glDeleteShader(m.vertexShader));
+  }
+  if (m.fragmentShader) {
+    VRB_GL_CHECK(glDeleteShader(m.fragmentShader));
+  }
+  m.vertexArray = m.vertexBuffer = m.indexBuffer = 0;
+  m.program = m.vertexShader = m.fragmentShader = 0;
+}
+
+} // namespace vrb
@@ -0,0 +1,30 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/OffscreenRenderScope.h"
+
+#include "vrb/FBO.h"
+#include "vrb/GLError.h"
+#include "vrb/RenderContext.h"
+
+namespace vrb {
+
+OffscreenRenderScope::OffscreenRenderScope(RenderContext& aContext, FBO& aFBO)
+    : mContext(aContext)
+    , mFBO(aFBO) {
+  mContext.SaveOffscreenGLState();
+  mFBO.Bind();
+  VRB_GL_CHECK(glDisable(GL_SCISSOR_TEST));
+  VRB_GL_CHECK(glEnable(GL_DEPTH_TEST));
+  VRB_GL_CHECK(glDepthMask(GL_TRUE));
+  VRB_GL_CHECK(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+OffscreenRenderScope::~OffscreenRenderScope() {
+  mFBO.Unbind();
+  mContext.RestoreOffscreenGLState();
+}
+
+} // namespace vrb
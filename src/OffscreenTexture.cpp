@@ -0,0 +1,28 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/OffscreenTexture.h"
+#include "vrb/private/TextureState.h"
+
+#include "vrb/ConcreteClass.h"
+
+namespace vrb {
+
+struct OffscreenTexture::State : public Texture::State {};
+
+OffscreenTexturePtr
+OffscreenTexture::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<OffscreenTexture, OffscreenTexture::State> >(aContext);
+}
+
+void
+OffscreenTexture::SetTextureHandle(const GLuint aHandle) {
+  m.texture = aHandle;
+}
+
+OffscreenTexture::OffscreenTexture(State& aState, CreationContextPtr& aContext) : Texture(aState, aContext), m(aState) {}
+OffscreenTexture::~OffscreenTexture() {}
+
+} // namespace vrb
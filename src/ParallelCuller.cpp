@@ -0,0 +1,101 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/ParallelCuller.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/CullVisitor.h"
+#include "vrb/DrawableList.h"
+#include "vrb/JobSystem.h"
+#include "vrb/Logger.h"
+#include "vrb/TraceProfiler.h"
+
+#include <memory>
+#include <vector>
+
+namespace vrb {
+
+struct ParallelCuller::State {
+  // Slots are reused by the following passes so steady state frames do not
+  // allocate visitors or segments. Only the thread calling Queue touches
+  // them, jobs only use their own slot.
+  struct Slot {
+    CullVisitorPtr visitor;
+    DrawableListPtr segment;
+    Job job;
+  };
+  CreationContextWeak context;
+  JobSystemPtr jobs;
+  // Parent of the jobs queued since the last Wait.
+  JobSystem::JobHandle pass;
+  std::vector<std::unique_ptr<Slot>> slots;
+  size_t used = 0;
+};
+
+ParallelCullerPtr
+ParallelCuller::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<ParallelCuller, ParallelCuller::State> >(aContext);
+}
+
+int32_t
+ParallelCuller::GetWorkerCount() const {
+  return m.jobs ? m.jobs->GetWorkerCount() : 0;
+}
+
+void
+ParallelCuller::Queue(const CullVisitor& aVisitor, DrawableList& aDrawables, Job&& aJob) {
+  if (m.used == m.slots.size()) {
+    CreationContextPtr context = m.context.lock();
+    if (!context) {
+      VRB_ERROR("ParallelCuller used after its CreationContext was destroyed");
+      return;
+    }
+    std::unique_ptr<State::Slot> slot(new State::Slot);
+    slot->visitor = CullVisitor::Create(context);
+    slot->segment = DrawableList::Create(context);
+    m.slots.push_back(std::move(slot));
+  }
+  State::Slot* slot = m.slots[m.used].get();
+  m.used++;
+  slot->visitor->Inherit(aVisitor);
+  aDrawables.AddSegment(*slot->segment);
+  slot->job = std::move(aJob);
+  if (!m.jobs) {
+    slot->job(*slot->visitor, *slot->segment);
+    slot->job = nullptr;
+    return;
+  }
+  if (!m.pass) {
+    m.pass = m.jobs->Create(nullptr);
+  }
+  m.jobs->Schedule([slot]() {
+    VRB_TRACE_ZONE("ParallelCuller::Job");
+    slot->job(*slot->visitor, *slot->segment);
+    slot->job = nullptr;
+  }, m.pass);
+}
+
+void
+ParallelCuller::Wait() {
+  VRB_TRACE_ZONE("ParallelCuller::Wait");
+  if (m.pass) {
+    m.jobs->Run(m.pass);
+    m.jobs->Wait(m.pass);
+    m.pass = nullptr;
+  }
+  m.used = 0;
+}
+
+ParallelCuller::ParallelCuller(State& aState, CreationContextPtr& aContext) : m(aState) {
+  m.context = aContext;
+  m.jobs = aContext->GetJobSystem();
+}
+
+ParallelCuller::~ParallelCuller() {
+  Wait();
+}
+
+} // namespace vrb
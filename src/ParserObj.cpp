@@ -4,14 +4,22 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "vrb/ParserObj.h"
+#include "vrb/private/Clock.h"
 
 #include "vrb/ConcreteClass.h"
 #include "vrb/CreationContext.h"
+#include "vrb/LoadReport.h"
+#include "vrb/TraceProfiler.h"
 #include "vrb/Vector.h"
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <thread>
+#include <algorithm>
 
 namespace {
 
@@ -20,108 +28,194 @@ const char cRF = char(13);
 const char cSpace = ' ';
 const char cTab = '\t';
 
-static int
-LocalStoi(const std::string& aValue) {
-  int result = 0;
-  try {
-    result = std::stoi(aValue);
-  } catch (std::invalid_argument& e) {
-  } catch (std::out_of_range& e) {
+// A view into a line buffer. Tokens are never copied unless a std::string is
+// needed by the ParserObserverObj interface.
+struct Token {
+  const char* begin;
+  size_t length;
+  Token() : begin(nullptr), length(0) {}
+  Token(const char* aBegin, const size_t aLength) : begin(aBegin), length(aLength) {}
+  bool Empty() const { return length == 0; }
+  bool Equals(const char* aValue) const {
+    const size_t kLength = strlen(aValue);
+    return (kLength == length) && (memcmp(begin, aValue, length) == 0);
   }
-  return result;
+  std::string ToString() const { return std::string(begin, length); }
+};
+
+const double kPowersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+  1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+bool
+IsDigit(const char aValue) {
+  return (aValue >= '0') && (aValue <= '9');
 }
-static float
-LocalStof(const std::string& aValue) {
-  float result = 0;
-  try {
-    result = std::stof(aValue);
-  } catch (std::invalid_argument& e) {
-  } catch (std::out_of_range& e) {
+
+// Invalid or out of range values parse as zero, matching the old std::stoi behavior.
+static int
+LocalStoi(const Token& aValue) {
+  const char* place = aValue.begin;
+  const char* end = aValue.begin + aValue.length;
+  bool negative = false;
+  if ((place < end) && ((*place == '-') || (*place == '+'))) {
+    negative = *place == '-';
+    place++;
   }
-  return result;
+  if ((place == end) || !IsDigit(*place)) {
+    return 0;
+  }
+  int64_t result = 0;
+  while ((place < end) && IsDigit(*place)) {
+    result = (result * 10) + (*place - '0');
+    if (result > INT32_MAX) {
+      return 0;
+    }
+    place++;
+  }
+  return (int)(negative ? -result : result);
 }
 
-static std::string
-Trim(const std::string& aStr) {
-  size_t start = aStr.find_first_not_of(" ");
-  size_t end = aStr.find_last_not_of(" ") + 1;
-  return aStr.substr(start, end - start);
+static float
+ParseFloatSlow(const Token& aValue) {
+  char buffer[64];
+  const size_t kLength = aValue.length < (sizeof(buffer) - 1) ? aValue.length : (sizeof(buffer) - 1);
+  memcpy(buffer, aValue.begin, kLength);
+  buffer[kLength] = '\0';
+  return strtof(buffer, nullptr);
 }
 
-static std::string
-TokenizeWhiteSpace(const std::string& aBuffer, std::vector<std::string>& aTokens) {
-  const size_t bufferLength = aBuffer.length();
-  const char* buffer = aBuffer.c_str();
-  std::string result;
-  int charCount = 0;
-  size_t begin = 0;
-  size_t place = 0;
-  bool first = true;
-
-  while (place < bufferLength) {
-    const char value = buffer[place];
-    if ((value == cSpace) || (value == cTab)) {
-      if (charCount > 0) {
-        if (first) {
-          result = aBuffer.substr(begin, place - begin);
-          first = false;
-        } else {
-          aTokens.push_back(aBuffer.substr(begin, place - begin));
-        }
-        charCount = 0;
-      }
+// Handles the [+-]digits[.digits][(e|E)[+-]digits] values found in OBJ and MTL
+// files without allocating. Anything else is handed to strtof.
+static float
+LocalStof(const Token& aValue) {
+  const char* place = aValue.begin;
+  const char* end = aValue.begin + aValue.length;
+  bool negative = false;
+  if ((place < end) && ((*place == '-') || (*place == '+'))) {
+    negative = *place == '-';
+    place++;
+  }
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool hasDigits = false;
+  while ((place < end) && IsDigit(*place)) {
+    if (digits < 19) {
+      mantissa = (mantissa * 10) + (*place - '0');
+      if (mantissa > 0) { digits++; }
     } else {
-      if (charCount == 0) {
-        begin = place;
+      exponent++;
+    }
+    hasDigits = true;
+    place++;
+  }
+  if ((place < end) && (*place == '.')) {
+    place++;
+    while ((place < end) && IsDigit(*place)) {
+      if (digits < 19) {
+        mantissa = (mantissa * 10) + (*place - '0');
+        if (mantissa > 0) { digits++; }
+        exponent--;
       }
-      charCount++;
+      hasDigits = true;
+      place++;
     }
+  }
+  if (!hasDigits) {
+    return ParseFloatSlow(aValue);
+  }
+  if ((place < end) && ((*place == 'e') || (*place == 'E'))) {
     place++;
+    bool negativeExponent = false;
+    if ((place < end) && ((*place == '-') || (*place == '+'))) {
+      negativeExponent = *place == '-';
+      place++;
+    }
+    if ((place == end) || !IsDigit(*place)) {
+      return ParseFloatSlow(aValue);
+    }
+    int value = 0;
+    while ((place < end) && IsDigit(*place)) {
+      if (value < 10000) { value = (value * 10) + (*place - '0'); }
+      place++;
+    }
+    exponent += negativeExponent ? -value : value;
   }
-
-  if (charCount > 0) {
-    if (first) { result = aBuffer.substr(begin); }
-    else { aTokens.push_back(aBuffer.substr(begin)); }
+  if ((place != end) || (exponent > 22) || (exponent < -22)) {
+    return ParseFloatSlow(aValue);
   }
-  return result;
+  double result = (double)mantissa;
+  result = exponent < 0 ? result / kPowersOfTen[-exponent] : result * kPowersOfTen[exponent];
+  return (float)(negative ? -result : result);
 }
 
-static std::string
-TokenizeBuffer(std::string& aBuffer, std::vector<std::string>& aTokens) {
-  // VRB_LOG("line: %s", aBuffer.c_str());
-  size_t end = aBuffer.find("#");
-  if (end != std::string::npos) { aBuffer.erase(end); }
-  return TokenizeWhiteSpace(aBuffer, aTokens);
+// Splits a line on spaces and tabs, ignoring everything after a '#'. The first
+// token is returned and the rest are stored in aTokens.
+static Token
+TokenizeBuffer(const char* aBuffer, const size_t aLength, std::vector<Token>& aTokens) {
+  aTokens.clear();
+  Token result;
+  bool first = true;
+  size_t place = 0;
+  while (place < aLength) {
+    const char value = aBuffer[place];
+    if (value == '#') {
+      break;
+    }
+    if ((value == cSpace) || (value == cTab)) {
+      place++;
+      continue;
+    }
+    const size_t begin = place;
+    while ((place < aLength) && (aBuffer[place] != cSpace) && (aBuffer[place] != cTab) && (aBuffer[place] != '#')) {
+      place++;
+    }
+    if (first) {
+      result = Token(aBuffer + begin, place - begin);
+      first = false;
+    } else {
+      aTokens.push_back(Token(aBuffer + begin, place - begin));
+    }
+  }
+  return result;
 }
 
+// Splits aToken on aDelimiter into at most aMaxCount tokens and returns how many were found.
 static size_t
-TokenizeDelimiter(const std::string& aStr, const char aDelimiter, std::vector<std::string>& aTokens) {
-  const char* buffer = aStr.c_str();
+TokenizeDelimiter(const Token& aToken, const char aDelimiter, Token* aTokens, const size_t aMaxCount) {
+  size_t count = 0;
   size_t start = 0;
-  size_t place = 0;
-  while (buffer[place] != '\0') {
-    if (buffer[place] == aDelimiter) {
-      aTokens.push_back(aStr.substr(start, place - start));
+  for (size_t place = 0; (place < aToken.length) && (count < aMaxCount); place++) {
+    if (aToken.begin[place] == aDelimiter) {
+      aTokens[count++] = Token(aToken.begin + start, place - start);
       start = place + 1;
     }
-    place++;
   }
-  aTokens.push_back(aStr.substr(start));
-  return aTokens.size();
+  if (count < aMaxCount) {
+    aTokens[count++] = Token(aToken.begin + start, aToken.length - start);
+  }
+  return count;
+}
+
+static std::string
+LastTokenOrDefault(const std::vector<Token>& aTokens, const char* aDefault) {
+  return aTokens.size() > 0 ? aTokens.back().ToString() : std::string(aDefault);
 }
 
 class LineParser {
 public:
-  virtual void Parse(const std::vector<std::string>& aTokens, vrb::ParserObserverObj& aObserver) = 0;
+  virtual void Parse(const std::vector<Token>& aTokens, vrb::ParserObserverObj& aObserver) = 0;
 };
 
 class VectorParser : public LineParser {
 public:
-  void Parse(const std::vector<std::string>& aTokens, vrb::ParserObserverObj& aObserver) override;
+  void Parse(const std::vector<Token>& aTokens, vrb::ParserObserverObj& aObserver) override;
 protected:
   VectorParser(const float aDefaultValue) : mDefaultValue(aDefaultValue) {}
   virtual void SetVector(const vrb::Vector& aVector, const float aW, vrb::ParserObserverObj& aObserver) = 0;
-  float GetValue(const std::vector<std::string>& aTokens, const int place);
+  float GetValue(const std::vector<Token>& aTokens, const int place);
   float mDefaultValue;
 
 private:
@@ -132,7 +226,7 @@ private:
 
 class ColorParser : public VectorParser {
 public:
-  void Parse(const std::vector<std::string>& aTokens, vrb::ParserObserverObj& aObserver) override;
+  void Parse(const std::vector<Token>& aTokens, vrb::ParserObserverObj& aObserver) override;
 
 protected:
   ColorParser(const float aDefaultValue) : VectorParser(aDefaultValue) {}
@@ -199,21 +293,26 @@ class FaceParser : public LineParser {
 public:
   FaceParser() {}
   ~FaceParser() {}
-  void Parse(const std::vector<std::string>& aTokens, vrb::ParserObserverObj& aObserver) override;
+  void Parse(const std::vector<Token>& aTokens, vrb::ParserObserverObj& aObserver) override;
+private:
+  // Reused between faces to avoid allocating per line.
+  std::vector<int> mVertices;
+  std::vector<int> mUVs;
+  std::vector<int> mNormals;
 };
 
 void
-VectorParser::Parse(const std::vector<std::string>& aTokens, vrb::ParserObserverObj& aObserver) {
+VectorParser::Parse(const std::vector<Token>& aTokens, vrb::ParserObserverObj& aObserver) {
   SetVector(vrb::Vector(GetValue(aTokens, 0), GetValue(aTokens, 1), GetValue(aTokens, 2)), GetValue(aTokens, 3), aObserver);
 }
 
 void
-ColorParser::Parse(const std::vector<std::string>& aTokens, vrb::ParserObserverObj& aObserver) {
+ColorParser::Parse(const std::vector<Token>& aTokens, vrb::ParserObserverObj& aObserver) {
   SetVector(vrb::Vector(GetValue(aTokens, -3), GetValue(aTokens, -2), GetValue(aTokens, -1)), 1.0f, aObserver);
 }
 
 float
-VectorParser::GetValue(const std::vector<std::string>& aTokens, const int place) {
+VectorParser::GetValue(const std::vector<Token>& aTokens, const int place) {
   if (place >= 0) {
     return aTokens.size() > place ? LocalStof(aTokens[place]) : mDefaultValue;
   } else {
@@ -224,43 +323,178 @@ VectorParser::GetValue(const std::vector<std::string>& aTokens, const int place)
 }
 
 void
-FaceParser::Parse(const std::vector<std::string>& aTokens, vrb::ParserObserverObj& aObserver) {
+FaceParser::Parse(const std::vector<Token>& aTokens, vrb::ParserObserverObj& aObserver) {
   const size_t tokensSize = aTokens.size();
-  std::vector<int> vertices;
-  vertices.reserve(4);
-  std::vector<int> uvs;
-  uvs.reserve(4);
-  std::vector<int> normals;
-  normals.reserve(4);
+  mVertices.clear();
+  mUVs.clear();
+  mNormals.clear();
   for (size_t ix = 0; ix < tokensSize; ix++) {
-    std::vector<std::string> vertexTokens;
-    vertexTokens.reserve(3);
-    size_t vertexSize = TokenizeDelimiter(aTokens[ix], '/', vertexTokens);
+    Token vertexTokens[3];
+    const size_t vertexSize = TokenizeDelimiter(aTokens[ix], '/', vertexTokens, 3);
     int index[3] = { 0, 0, 0 };
     for (size_t jy = 0; jy < vertexSize; jy++) {
-      if ((jy < 3) && !vertexTokens[jy].empty()) { index[jy] = LocalStoi(vertexTokens[jy]); }
+      if (!vertexTokens[jy].Empty()) { index[jy] = LocalStoi(vertexTokens[jy]); }
     }
-    vertices.push_back(index[0]);
-    uvs.push_back(index[1]);
-    normals.push_back(index[2]);
+    mVertices.push_back(index[0]);
+    mUVs.push_back(index[1]);
+    mNormals.push_back(index[2]);
   }
-  aObserver.AddFace(vertices, uvs, normals);
+  aObserver.AddFace(mVertices, mUVs, mNormals);
 }
 
+// Geometry records of a range of lines parsed on a worker thread. Lines that
+// are not v, vn, vt or f records are kept as-is and parsed when the range is
+// replayed so every observer call is still made in file order.
+struct ParsedRange {
+  enum class Kind : uint8_t { Vertex, Normal, UV, Face, Other };
+  struct Record {
+    Kind kind;
+    uint32_t offset;
+    uint32_t count;
+    const char* line;
+    size_t length;
+  };
+  std::vector<Record> records;
+  std::vector<float> floats;
+  std::vector<int> ints;
+  std::vector<uint32_t> corners;
+  std::vector<Token> tokens;
+
+  void Clear() {
+    records.clear();
+    floats.clear();
+    ints.clear();
+    corners.clear();
+  }
+
+  void AddVector(const Kind aKind, const size_t aSize, const float aDefaultValue) {
+    records.push_back(Record{aKind, (uint32_t)floats.size(), (uint32_t)aSize, nullptr, 0});
+    for (size_t ix = 0; ix < aSize; ix++) {
+      floats.push_back(tokens.size() > ix ? LocalStof(tokens[ix]) : aDefaultValue);
+    }
+    if (aKind == Kind::UV) {
+      floats[floats.size() - 2] = 1.0f - floats[floats.size() - 2];
+    }
+  }
+
+  void AddFace() {
+    records.push_back(Record{Kind::Face, (uint32_t)ints.size(), (uint32_t)tokens.size(), nullptr, 0});
+    corners.push_back((uint32_t)tokens.size());
+    for (const Token& token: tokens) {
+      Token vertexTokens[3];
+      const size_t vertexSize = TokenizeDelimiter(token, '/', vertexTokens, 3);
+      int index[3] = { 0, 0, 0 };
+      for (size_t jy = 0; jy < vertexSize; jy++) {
+        if (!vertexTokens[jy].Empty()) { index[jy] = LocalStoi(vertexTokens[jy]); }
+      }
+      ints.push_back(index[0]);
+      ints.push_back(index[1]);
+      ints.push_back(index[2]);
+    }
+  }
+
+  void ParseLine(const char* aLine, const size_t aLength) {
+    const Token type = TokenizeBuffer(aLine, aLength, tokens);
+    if (type.Empty()) {
+      return;
+    } else if (type.Equals("v")) {
+      AddVector(Kind::Vertex, 4, 0.0f);
+    } else if (type.Equals("vn")) {
+      AddVector(Kind::Normal, 3, 0.0f);
+    } else if (type.Equals("vt")) {
+      AddVector(Kind::UV, 3, 1.0f);
+    } else if (type.Equals("f")) {
+      AddFace();
+    } else {
+      records.push_back(Record{Kind::Other, 0, 0, aLine, aLength});
+    }
+  }
+
+  void Parse(const char* aBuffer, const size_t aSize) {
+    size_t start = 0;
+    for (size_t place = 0; place < aSize; place++) {
+      if ((aBuffer[place] == cLF) || (aBuffer[place] == cRF)) {
+        if (place > start) {
+          ParseLine(aBuffer + start, place - start);
+        }
+        start = place + 1;
+      }
+    }
+    if (start < aSize) {
+      ParseLine(aBuffer + start, aSize - start);
+    }
+  }
+};
+
+// Chunks of at least this size are split across worker threads.
+const size_t kParallelParseThreshold = 1024 * 1024;
+const size_t kMinimumRangeSize = 256 * 1024;
+const size_t kMaxParseThreads = 8;
+
 } // namespace
 
 namespace vrb {
 
+void
+ParserObserverObj::AddVertices(const float* aPoints, const size_t aCount) {
+  for (size_t ix = 0; ix < aCount; ix++) {
+    const float* point = aPoints + (ix * 4);
+    AddVertex(Vector(point[0], point[1], point[2]), point[3]);
+  }
+}
+
+void
+ParserObserverObj::AddNormals(const float* aNormals, const size_t aCount) {
+  for (size_t ix = 0; ix < aCount; ix++) {
+    const float* normal = aNormals + (ix * 3);
+    AddNormal(Vector(normal[0], normal[1], normal[2]));
+  }
+}
+
+void
+ParserObserverObj::AddUVs(const float* aUVs, const size_t aCount) {
+  for (size_t ix = 0; ix < aCount; ix++) {
+    const float* uv = aUVs + (ix * 3);
+    AddUV(uv[0], uv[1], uv[2]);
+  }
+}
+
+void
+ParserObserverObj::AddFaces(const int* aIndices, const uint32_t* aCornerCounts, const size_t aFaceCount) {
+  std::vector<int> vertices;
+  std::vector<int> uvs;
+  std::vector<int> normals;
+  const int* indices = aIndices;
+  for (size_t ix = 0; ix < aFaceCount; ix++) {
+    vertices.clear();
+    uvs.clear();
+    normals.clear();
+    for (uint32_t corner = 0; corner < aCornerCounts[ix]; corner++) {
+      vertices.push_back(indices[0]);
+      uvs.push_back(indices[1]);
+      normals.push_back(indices[2]);
+      indices += 3;
+    }
+    AddFace(vertices, uvs, normals);
+  }
+}
+
 struct ParserObj::State {
   std::weak_ptr<ParserObj> self;
   FileReaderPtr fileReader;
   std::weak_ptr<ParserObserverObj> weakObserver;
   std::string objFileName;
   std::string mtlFileName;
+  // Material libraries already read for the current model.
+  std::vector<std::string> mtlFileNames;
   int objFileHandle;
   int mtlFileHandle;
   std::string objLineBuffer;
   std::string mtlLineBuffer;
+  std::vector<Token> tokens;
+  std::vector<ParsedRange> parsedRanges;
+  double objStartTime;
+  size_t objBytes;
   VertexParser vertexParser;
   NormalParser normalParser;
   UVParser uvParser;
@@ -272,15 +506,20 @@ struct ParserObj::State {
   State()
       : objFileHandle(0)
       , mtlFileHandle(0)
+      , objStartTime(0.0)
+      , objBytes(0)
     {
 }
 
   std::string GetAbsolutePath(const std::string& aRelativePath) const;
   std::string* GetBuffer(const int aFileHandle);
-  void Parse(const int aFileHandle, FileHandler& aFileHandler);
+  void Parse(const int aFileHandle, const char* aLine, const size_t aLength);
   void Finish(const int aFileHandle);
-  void ParseObj(FileHandler& aFileHandler);
-  void ParseMtl();
+  void ParseObj(const char* aLine, const size_t aLength);
+  void PrefetchMaterialLibraries(const char* aBuffer, const size_t aSize);
+  void ParseMtl(const char* aLine, const size_t aLength);
+  void ParseObjRanges(const char* aBuffer, const size_t aSize);
+  void Replay(const ParsedRange& aRange, ParserObserverObj& aObserver);
 };
 
 std::string
@@ -300,9 +539,9 @@ ParserObj::State::GetBuffer(const int aFileHandle) {
 }
 
 void
-ParserObj::State::Parse(const int aFileHandle, FileHandler& aFileHandler) {
-  if (aFileHandle == objFileHandle) { ParseObj(aFileHandler); }
-  else if (aFileHandle == mtlFileHandle) { ParseMtl(); }
+ParserObj::State::Parse(const int aFileHandle, const char* aLine, const size_t aLength) {
+  if (aFileHandle == objFileHandle) { ParseObj(aLine, aLength); }
+  else if (aFileHandle == mtlFileHandle) { ParseMtl(aLine, aLength); }
   else {
 
   }
@@ -312,6 +551,12 @@ void
 ParserObj::State::Finish(const int aFileHandle) {
   ParserObserverObjPtr observer = weakObserver.lock();
   if (aFileHandle == objFileHandle) {
+#if VRB_LOG_LEVEL <= VRB_LOG_LEVEL_DEBUG
+    const double kElapsed = GetMonotonicSeconds() - objStartTime;
+    const double kMegabytes = (double)objBytes / (1024.0 * 1024.0);
+    VRB_DEBUG("TIMER Parsed '%s' %.2f MB in %.3f s (%.1f MB/s)", objFileName.c_str(), kMegabytes, kElapsed,
+              kElapsed > 0.0 ? kMegabytes / kElapsed : 0.0);
+#endif
     if (observer) { observer->FinishModel(); }
     objFileHandle = 0;
   } else if (aFileHandle == mtlFileHandle) {
@@ -322,89 +567,203 @@ ParserObj::State::Finish(const int aFileHandle) {
 }
 
 void
-ParserObj::State::ParseObj(FileHandler& aFileHandler) {
+ParserObj::State::ParseObj(const char* aLine, const size_t aLength) {
   ParserObserverObjPtr observer = weakObserver.lock();
-  if (!objLineBuffer.empty() && observer) {
-    std::vector<std::string> tokens;
-    const std::string type = TokenizeBuffer(objLineBuffer, tokens);
+  if ((aLength > 0) && observer) {
+    const Token type = TokenizeBuffer(aLine, aLength, tokens);
     LineParser *currentParser = nullptr;
-    if (type == "#") {
-      // Found line comment;
-    } else if (type == "v") {
+    if (type.Empty()) {
+      // Found blank line or line comment;
+    } else if (type.Equals("v")) {
       currentParser = &vertexParser;
-    } else if (type == "vn") {
+    } else if (type.Equals("vn")) {
       currentParser = &normalParser;
-    } else if (type == "vt") {
+    } else if (type.Equals("vt")) {
       currentParser = &uvParser;
-    } else if (type == "f") {
+    } else if (type.Equals("f")) {
       currentParser = &faceParser;
-    } else if (type == "g") {
-      observer->SetGroupNames(tokens);
-    } else if (type == "o") {
-      observer->SetObjectName(tokens.size() > 0 ? tokens[0] : "");
-    } else if (type == "mtllib") {
-
-      mtlFileName = tokens.size() > 0 ? GetAbsolutePath(tokens[0]) : "";
-      if (fileReader) {
-        fileReader->ReadRawFile(mtlFileName, self.lock());
+    } else if (type.Equals("g")) {
+      std::vector<std::string> names;
+      for (const Token& token: tokens) {
+        names.push_back(token.ToString());
+      }
+      observer->SetGroupNames(names);
+    } else if (type.Equals("o")) {
+      observer->SetObjectName(tokens.size() > 0 ? tokens[0].ToString() : "");
+    } else if (type.Equals("mtllib")) {
+      const std::string kFileName = tokens.size() > 0 ? GetAbsolutePath(tokens[0].ToString()) : "";
+      if (std::find(mtlFileNames.begin(), mtlFileNames.end(), kFileName) == mtlFileNames.end()) {
+        mtlFileNames.push_back(kFileName);
+        mtlFileName = kFileName;
+        if (fileReader) {
+          fileReader->ReadRawFile(mtlFileName, self.lock());
+        }
+        observer->LoadMaterialLibrary(mtlFileName);
+      }
+    } else if (type.Equals("usemtl")) {
+      observer->SetMaterialName(tokens.size() > 0 ? tokens[0].ToString() : "");
+    } else if (type.Equals("s")) {
+      int group = 0;
+      if ((tokens.size() > 0) && !tokens[0].Equals("off")) {
+        group = LocalStoi(tokens[0]);
       }
-      observer->LoadMaterialLibrary(mtlFileName);
-    } else if (type == "usemtl") {
-      observer->SetMaterialName(tokens.size() > 0 ? tokens[0] : "");
-    } else if (type == "s") {
-      std::string value = tokens.size() > 0 ? tokens[0] : "0";
-      if (value == "off") { value = "0"; }
-      int group = LocalStoi(value);
       observer->SetSmoothingGroup(group);
     } else {
-      std::cout << "Unknown type: " << type << std::endl;
+      std::cout << "Unknown type: " << type.ToString() << std::endl;
     }
 
     if (currentParser) {
       currentParser->Parse(tokens, *observer.get());
     }
   }
-  objLineBuffer.clear();
+}
+
+// Reads the material libraries named anywhere in the first chunk of the OBJ
+// before any of it is parsed, so their textures are read and decoded while
+// the mesh is parsed instead of after the mtllib line is reached.
+void
+ParserObj::State::PrefetchMaterialLibraries(const char* aBuffer, const size_t aSize) {
+  const char* kEnd = aBuffer + aSize;
+  const char* line = aBuffer;
+  while (line < kEnd) {
+    const char* next = static_cast<const char*>(memchr(line, cLF, (size_t)(kEnd - line)));
+    const char* lineEnd = next ? next : kEnd;
+    const char* start = line;
+    line = lineEnd + 1;
+    if ((lineEnd > start) && (lineEnd[-1] == cRF)) {
+      lineEnd--;
+    }
+    while ((start < lineEnd) && ((*start == ' ') || (*start == '\t'))) {
+      start++;
+    }
+    // A partial line at the end of the chunk is left to the parse.
+    if (next && ((lineEnd - start) > 7) && (memcmp(start, "mtllib", 6) == 0) && ((start[6] == ' ') || (start[6] == '\t'))) {
+      ParseObj(start, (size_t)(lineEnd - start));
+    }
+  }
 }
 
 void
-ParserObj::State::ParseMtl() {
+ParserObj::State::ParseMtl(const char* aLine, const size_t aLength) {
   ParserObserverObjPtr observer = weakObserver.lock();
-  if (!mtlLineBuffer.empty() && observer) {
-    std::vector<std::string> tokens;
-    const std::string type = TokenizeBuffer(mtlLineBuffer, tokens);
+  if ((aLength > 0) && observer) {
+    const Token type = TokenizeBuffer(aLine, aLength, tokens);
     LineParser *currentParser = nullptr;
 
-    if (type == "#") {
-      // Found line comment
-    } else if (type == "newmtl") {
-      observer->CreateMaterial(tokens.size() > 0 ? tokens[0] : "");
-    } else if (type == "Ka") {
+    if (type.Empty()) {
+      // Found blank line or line comment
+    } else if (type.Equals("newmtl")) {
+      observer->CreateMaterial(tokens.size() > 0 ? tokens[0].ToString() : "");
+    } else if (type.Equals("Ka")) {
       currentParser = &ambientParser;
-    } else if (type == "Ks") {
+    } else if (type.Equals("Ks")) {
       currentParser = &specularParser;
-    } else if (type == "Kd") {
+    } else if (type.Equals("Kd")) {
       currentParser = &diffuseParser;
-    } else if (type == "Ns") {
-      observer->SetSpecularExponent(LocalStof(tokens.size() > 0 ? tokens[tokens.size() - 1] : "1.0"));
-    } else if (type == "map_Ka") {
-      observer->SetAmbientTexture(tokens.size() > 0 ? GetAbsolutePath(tokens[tokens.size() - 1]) : "");
-    } else if (type == "map_Kd") {
-      observer->SetDiffuseTexture(tokens.size() > 0 ? GetAbsolutePath(tokens[tokens.size() - 1]) : "");
-    } else if (type == "map_Ks") {
-      observer->SetSpecularTexture(tokens.size() > 0 ? GetAbsolutePath(tokens[tokens.size() - 1]) : "");
-    } else if (type == "illum") {
-      observer->SetIlluniationModel(LocalStoi(tokens.size() > 0 ? tokens[tokens.size() - 1] : "1"));
+    } else if (type.Equals("Ns")) {
+      observer->SetSpecularExponent(tokens.size() > 0 ? LocalStof(tokens.back()) : 1.0f);
+    } else if (type.Equals("map_Ka")) {
+      observer->SetAmbientTexture(tokens.size() > 0 ? GetAbsolutePath(LastTokenOrDefault(tokens, "")) : "");
+    } else if (type.Equals("map_Kd")) {
+      observer->SetDiffuseTexture(tokens.size() > 0 ? GetAbsolutePath(LastTokenOrDefault(tokens, "")) : "");
+    } else if (type.Equals("map_Ks")) {
+      observer->SetSpecularTexture(tokens.size() > 0 ? GetAbsolutePath(LastTokenOrDefault(tokens, "")) : "");
+    } else if (type.Equals("illum")) {
+      observer->SetIlluniationModel(tokens.size() > 0 ? LocalStoi(tokens.back()) : 1);
     }else {
       // Unhandled tag
-      VRB_WARN("In file: '%s' Unhandled mtl option: '%s'", mtlFileName.c_str(), mtlLineBuffer.c_str());
+      VRB_WARN("In file: '%s' Unhandled mtl option: '%s'", mtlFileName.c_str(), std::string(aLine, aLength).c_str());
     }
 
     if (currentParser) {
       currentParser->Parse(tokens, *observer.get());
     }
   }
-  mtlLineBuffer.clear();
+}
+
+void
+ParserObj::State::ParseObjRanges(const char* aBuffer, const size_t aSize) {
+  const size_t kHardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t kThreads = aSize < kParallelParseThreshold ? 1 :
+      std::min(std::min(kHardwareThreads, kMaxParseThreads), std::max((size_t)1, aSize / kMinimumRangeSize));
+  if (parsedRanges.size() < kThreads) {
+    parsedRanges.resize(kThreads);
+  }
+  // Split at line boundaries so that no line is shared between two ranges.
+  std::vector<size_t> bounds(kThreads + 1, aSize);
+  bounds[0] = 0;
+  for (size_t ix = 1; ix < kThreads; ix++) {
+    size_t place = std::max(bounds[ix - 1], (aSize / kThreads) * ix);
+    while ((place < aSize) && (aBuffer[place] != cLF) && (aBuffer[place] != cRF)) {
+      place++;
+    }
+    bounds[ix] = place;
+  }
+  std::vector<std::thread> workers;
+  workers.reserve(kThreads - 1);
+  for (size_t ix = 1; ix < kThreads; ix++) {
+    ParsedRange* range = &parsedRanges[ix];
+    const char* begin = aBuffer + bounds[ix];
+    const size_t size = bounds[ix + 1] - bounds[ix];
+    workers.emplace_back([range, begin, size]() {
+      range->Clear();
+      range->Parse(begin, size);
+    });
+  }
+  parsedRanges[0].Clear();
+  parsedRanges[0].Parse(aBuffer, bounds[1]);
+  for (std::thread& worker: workers) {
+    worker.join();
+  }
+
+  ParserObserverObjPtr observer = weakObserver.lock();
+  if (!observer) {
+    return;
+  }
+  for (size_t ix = 0; ix < kThreads; ix++) {
+    Replay(parsedRanges[ix], *observer);
+  }
+}
+
+void
+ParserObj::State::Replay(const ParsedRange& aRange, ParserObserverObj& aObserver) {
+  const size_t kRecordCount = aRange.records.size();
+  size_t face = 0;
+  size_t ix = 0;
+  while (ix < kRecordCount) {
+    const ParsedRange::Record& record = aRange.records[ix];
+    if (record.kind == ParsedRange::Kind::Other) {
+      ParseObj(record.line, record.length);
+      ix++;
+      continue;
+    }
+    // Consecutive records of the same kind are stored contiguously so each
+    // run is delivered with a single bulk call.
+    size_t end = ix + 1;
+    while ((end < kRecordCount) && (aRange.records[end].kind == record.kind)) {
+      end++;
+    }
+    const size_t kCount = end - ix;
+    const float* values = aRange.floats.data() + record.offset;
+    switch (record.kind) {
+      case ParsedRange::Kind::Vertex:
+        aObserver.AddVertices(values, kCount);
+        break;
+      case ParsedRange::Kind::Normal:
+        aObserver.AddNormals(values, kCount);
+        break;
+      case ParsedRange::Kind::UV:
+        aObserver.AddUVs(values, kCount);
+        break;
+      case ParsedRange::Kind::Face:
+        aObserver.AddFaces(aRange.ints.data() + record.offset, aRange.corners.data() + face, kCount);
+        face += kCount;
+        break;
+      case ParsedRange::Kind::Other:
+        break;
+    }
+    ix = end;
+  }
 }
 
 ParserObjPtr
@@ -425,6 +784,9 @@ ParserObj::BindFileHandle(const std::string& aFileName, const int aFileHandle) {
     m.objFileHandle = aFileHandle;
     m.objFileName = aFileName;
     m.objLineBuffer.clear();
+    m.mtlFileNames.clear();
+    m.objStartTime = GetMonotonicSeconds();
+    m.objBytes = 0;
     if (observer) { observer->StartModel(aFileName); }
   }
 }
@@ -437,21 +799,55 @@ ParserObj::LoadFailed(const int aFileHandle, const std::string& aReason) {
 
 void
 ParserObj::ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) {
+  VRB_TRACE_ZONE("ParserObj::ProcessRawFileChunk");
+  LoadReportTimer timer(LoadReport::Phase::Parse);
   std::string* lineBuffer = m.GetBuffer(aFileHandle);
 
   if (!lineBuffer) {
     VRB_ERROR("Failed to find line buffer of file handle: %d", aFileHandle);
     return;
   }
+  if (aFileHandle == m.objFileHandle) {
+    if (m.objBytes == 0) {
+      m.PrefetchMaterialLibraries(aBuffer, aSize);
+    }
+    m.objBytes += aSize;
+  }
   size_t place = 0;
   size_t start = 0;
 
+  if (aFileHandle == m.objFileHandle) {
+    // Finish the line carried over from the previous chunk, parse every
+    // complete line into ranges, in parallel for large chunks, and carry over
+    // the trailing partial line.
+    while ((place < aSize) && (aBuffer[place] != cLF) && (aBuffer[place] != cRF)) {
+      place++;
+    }
+    size_t last = aSize;
+    while ((last > place) && (aBuffer[last - 1] != cLF) && (aBuffer[last - 1] != cRF)) {
+      last--;
+    }
+    if (place < last) {
+      lineBuffer->append(aBuffer, place);
+      m.Parse(aFileHandle, lineBuffer->data(), lineBuffer->size());
+      lineBuffer->clear();
+      m.ParseObjRanges(aBuffer + place + 1, last - place - 1);
+      lineBuffer->append(aBuffer + last, aSize - last);
+      return;
+    }
+    place = 0;
+  }
+
   while(place < aSize) {
     if ((aBuffer[place] == cLF) || (aBuffer[place] == cRF)) {
-      if ((place - start) > 0) {
+      if (lineBuffer->empty()) {
+        // The whole line is in this chunk so parse it in place.
+        m.Parse(aFileHandle, &(aBuffer[start]), place - start);
+      } else {
         lineBuffer->append(&(aBuffer[start]), place - start);
+        m.Parse(aFileHandle, lineBuffer->data(), lineBuffer->size());
+        lineBuffer->clear();
       }
-      m.Parse(aFileHandle, *this);
       start = place + 1;
     }
     place++;
@@ -464,7 +860,13 @@ ParserObj::ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const
 
 void
 ParserObj::FinishRawFile(const int aFileHandle) {
-  m.Parse(aFileHandle, *this);
+  VRB_TRACE_ZONE("ParserObj::FinishRawFile");
+  LoadReportTimer timer(LoadReport::Phase::Parse);
+  std::string* lineBuffer = m.GetBuffer(aFileHandle);
+  if (lineBuffer) {
+    m.Parse(aFileHandle, lineBuffer->data(), lineBuffer->size());
+    lineBuffer->clear();
+  }
   m.Finish(aFileHandle);
 
 }
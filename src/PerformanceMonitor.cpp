@@ -4,15 +4,25 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "vrb/PerformanceMonitor.h"
+#include "vrb/private/Clock.h"
+#include "vrb/private/FrameHistory.h"
 #include "vrb/private/UpdatableState.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/GLExtensions.h"
 #include "vrb/Logger.h"
 #include "vrb/RenderContext.h"
 
+#include "vrb/gl.h"
+
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <forward_list>
 #include <limits>
+#include <unordered_map>
+#include <vector>
 
 namespace {
 const double kInvalidTimestamp = -1.0;
@@ -24,6 +34,17 @@ const double kMinAverageFrameRate = 60.0;
 const double kFrameEpsilon = 2.0;
 const double kSampleTimeDelta = 1.0;
 const double kMaxSampleTimeDelta = 3.0;
+const double kDroppedFrameFactor = 1.5;
+// Frames in flight before GPU results are read. Older frames still without
+// results are dropped rather than waited on.
+const size_t kGPUFrameCount = 4;
+const size_t kNoQuery = std::numeric_limits<size_t>::max();
+const double kNanosecondsToSeconds = 1.0e-9;
+
+struct Times {
+  double cpu = 0.0;
+  double gpu = 0.0;
+};
 }
 
 namespace vrb {
@@ -33,7 +54,10 @@ struct PerformanceMonitor::State : public Updatable::State {
   bool slow = false;
   double averageFrameRate = kMinAverageFrameRate;
   double timeStamp = kInvalidTimestamp;
-  double frameCount = 0.0;
+  double lastFrame = kInvalidTimestamp;
+  FrameHistory history;
+  // Scratch storage for percentiles.
+  mutable std::vector<float> sorted;
   double resumePause = kInvalidTimestamp;
   double performanceDelta = kDefaultPerformanceDelta;
   double startOfPoorPerformanceTime = kInvalidTimestamp;
@@ -41,16 +65,141 @@ struct PerformanceMonitor::State : public Updatable::State {
   int32_t samplePlace = 0;
   std::forward_list<PerformanceMonitorObserverPtr> observers;
 
+  struct Pass {
+    std::string name;
+    size_t begin = kNoQuery;
+    size_t end = kNoQuery;
+    double cpuStart = 0.0;
+    double cpuTime = 0.0;
+  };
+  struct GPUFrame {
+    // Timestamp queries, reused every time the frame slot comes around.
+    std::vector<GLuint> queries;
+    size_t used = 0;
+    size_t end = kNoQuery;
+    double cpuTime = 0.0;
+    bool pending = false;
+    std::vector<Pass> passes;
+  };
+  GLExtensionsPtr extensions;
+  GLDeletionQueuePtr glDeletions;
+  bool gpuTimingEnabled = false;
+  bool frameStarted = false;
+  double cpuFrameStart = 0.0;
+  std::array<GPUFrame, kGPUFrameCount> gpuFrames;
+  size_t gpuFrame = 0;
+  bool hasFrameTimes = false;
+  Times frameTimes;
+  std::unordered_map<std::string, Times> passTimes;
+
   State() {
     Clear();
   }
 
+  ~State() {
+    ReleaseQueries();
+  }
+
+  bool IsTimerSupported() const {
+    return extensions && extensions->IsExtensionSupported(GLExtensions::Ext::EXT_disjoint_timer_query);
+  }
+
+  void ReleaseQueries() {
+    for (GPUFrame& frame: gpuFrames) {
+      for (const GLuint query: frame.queries) {
+        glDeletions->DeleteQuery(query);
+      }
+      frame.queries.clear();
+      frame.used = 0;
+      frame.pending = false;
+      frame.passes.clear();
+    }
+    frameStarted = false;
+  }
+
+  size_t IssueTimestamp() {
+    const GLExtensions::Functions& gl = extensions->GetFunctions();
+    GPUFrame& frame = gpuFrames[gpuFrame];
+    if (frame.used == frame.queries.size()) {
+      GLuint query = 0;
+      gl.glGenQueriesEXT(1, &query);
+      frame.queries.push_back(query);
+    }
+    gl.glQueryCounterEXT(frame.queries[frame.used], GL_TIMESTAMP_EXT);
+    return frame.used++;
+  }
+
+  double GetElapsed(const GPUFrame& aFrame, const size_t aBegin, const size_t aEnd) const {
+    const GLExtensions::Functions& gl = extensions->GetFunctions();
+    GLuint64 begin = 0;
+    GLuint64 end = 0;
+    gl.glGetQueryObjectui64vEXT(aFrame.queries[aBegin], GL_QUERY_RESULT_EXT, &begin);
+    gl.glGetQueryObjectui64vEXT(aFrame.queries[aEnd], GL_QUERY_RESULT_EXT, &end);
+    return end > begin ? (double)(end - begin) * kNanosecondsToSeconds : 0.0;
+  }
+
+  // Reads every pending frame whose results are available, oldest first.
+  void CollectGPUTimes() {
+    const GLExtensions::Functions& gl = extensions->GetFunctions();
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    for (size_t ix = 1; ix <= kGPUFrameCount; ix++) {
+      GPUFrame& frame = gpuFrames[(gpuFrame + ix) % kGPUFrameCount];
+      if (!frame.pending) {
+        continue;
+      }
+      if (disjoint) {
+        // Timestamps issued across a disjoint event are meaningless.
+        frame.pending = false;
+        continue;
+      }
+      // Timestamps complete in order, so the last one covers the frame.
+      GLint available = 0;
+      gl.glGetQueryObjectivEXT(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+      if (!available) {
+        break;
+      }
+      frame.pending = false;
+      frameTimes.cpu = frame.cpuTime;
+      frameTimes.gpu = GetElapsed(frame, 0, frame.end);
+      hasFrameTimes = true;
+      for (const Pass& pass: frame.passes) {
+        if (pass.end != kNoQuery) {
+          Times& times = passTimes[pass.name];
+          times.cpu = pass.cpuTime;
+          times.gpu = GetElapsed(frame, pass.begin, pass.end);
+        }
+      }
+    }
+  }
+
+  void StartGPUFrame() {
+    if (!gpuTimingEnabled || !IsTimerSupported()) {
+      frameStarted = false;
+      return;
+    }
+    CollectGPUTimes();
+    gpuFrame = (gpuFrame + 1) % kGPUFrameCount;
+    GPUFrame& frame = gpuFrames[gpuFrame];
+    if (frame.pending) {
+      VRB_DEBUG("Dropping GPU frame times, results were not available in time");
+    }
+    frame.used = 0;
+    frame.end = kNoQuery;
+    frame.pending = false;
+    frame.passes.clear();
+    IssueTimestamp();
+    cpuFrameStart = GetMonotonicSeconds();
+    frameStarted = true;
+  }
+
   void Clear() {
     for (double& value: samples) {
       value = -1.0;
     }
     timeStamp = kInvalidTimestamp;
-    frameCount = 0.0;
+    lastFrame = kInvalidTimestamp;
+    history.Clear();
     resumePause = kInvalidTimestamp;
   }
 
@@ -122,6 +271,29 @@ PerformanceMonitor::GetAverageFrameRate() const {
   return m.averageFrameRate;
 }
 
+bool
+PerformanceMonitor::GetFrameStats(const double aSeconds, FrameStats& aStats) const {
+  const FrameHistory::Window window = m.history.GetWindow(aSeconds);
+  if ((aSeconds <= 0.0) || (window.frames == 0)) {
+    return false;
+  }
+  m.history.Copy(window.frames, m.sorted);
+  std::sort(m.sorted.begin(), m.sorted.end());
+  const size_t kCount = m.sorted.size();
+  const double kDroppedDelta = kDroppedFrameFactor / m.averageFrameRate;
+  aStats.frames = kCount;
+  aStats.dropped = (size_t)(m.sorted.end() - std::upper_bound(m.sorted.begin(), m.sorted.end(), (float)kDroppedDelta));
+  auto percentile = [&](const double aPercent) -> double {
+    const size_t kIndex = (size_t)std::ceil(aPercent * kCount);
+    return m.sorted[std::min(kCount, std::max(kIndex, (size_t)1)) - 1];
+  };
+  aStats.p50 = percentile(0.50);
+  aStats.p95 = percentile(0.95);
+  aStats.p99 = percentile(0.99);
+  aStats.max = m.sorted.back();
+  return true;
+}
+
 double
 PerformanceMonitor::GetPerfomranceDelta() const {
   return m.performanceDelta;
@@ -167,12 +339,92 @@ PerformanceMonitor::RemovePerformanceMonitorObserver(const vrb::PerformanceMonit
   });
 }
 
+void
+PerformanceMonitor::SetGPUTimingEnabled(const bool aEnabled) {
+  if (m.gpuTimingEnabled && !aEnabled) {
+    m.ReleaseQueries();
+  }
+  m.gpuTimingEnabled = aEnabled;
+}
+
+bool
+PerformanceMonitor::IsGPUTimingEnabled() const {
+  return m.gpuTimingEnabled;
+}
+
+void
+PerformanceMonitor::EndFrame() {
+  if (!m.frameStarted) {
+    return;
+  }
+  State::GPUFrame& frame = m.gpuFrames[m.gpuFrame];
+  frame.end = m.IssueTimestamp();
+  frame.cpuTime = GetMonotonicSeconds() - m.cpuFrameStart;
+  frame.pending = true;
+  m.frameStarted = false;
+}
+
+void
+PerformanceMonitor::BeginPass(const std::string& aName) {
+  if (!m.frameStarted) {
+    return;
+  }
+  State::Pass pass;
+  pass.name = aName;
+  pass.begin = m.IssueTimestamp();
+  pass.cpuStart = GetMonotonicSeconds();
+  m.gpuFrames[m.gpuFrame].passes.push_back(pass);
+}
+
+void
+PerformanceMonitor::EndPass(const std::string& aName) {
+  if (!m.frameStarted) {
+    return;
+  }
+  std::vector<State::Pass>& passes = m.gpuFrames[m.gpuFrame].passes;
+  for (auto pass = passes.rbegin(); pass != passes.rend(); pass++) {
+    if ((pass->end == kNoQuery) && (pass->name == aName)) {
+      pass->end = m.IssueTimestamp();
+      pass->cpuTime = GetMonotonicSeconds() - pass->cpuStart;
+      return;
+    }
+  }
+  VRB_WARN("PerformanceMonitor::EndPass called without BeginPass: %s", aName.c_str());
+}
+
+bool
+PerformanceMonitor::GetFrameTimes(double& aCPUTime, double& aGPUTime) const {
+  if (!m.hasFrameTimes) {
+    return false;
+  }
+  aCPUTime = m.frameTimes.cpu;
+  aGPUTime = m.frameTimes.gpu;
+  return true;
+}
+
+bool
+PerformanceMonitor::GetPassTimes(const std::string& aName, double& aCPUTime, double& aGPUTime) const {
+  auto iter = m.passTimes.find(aName);
+  if (iter == m.passTimes.end()) {
+    return false;
+  }
+  aCPUTime = iter->second.cpu;
+  aGPUTime = iter->second.gpu;
+  return true;
+}
+
 PerformanceMonitor::PerformanceMonitor(State& aState, CreationContextPtr& aContext)
     : Updatable(aState, aContext)
-    , m(aState) {}
+    , m(aState) {
+  m.glDeletions = aContext->GetGLDeletionQueue();
+}
 
 void
 PerformanceMonitor::UpdateResource(RenderContext& aContext) {
+  if (!m.extensions) {
+    m.extensions = aContext.GetGLExtensions();
+  }
+  m.StartGPUFrame();
   if (m.paused) {
     return;
   }
@@ -183,25 +435,31 @@ PerformanceMonitor::UpdateResource(RenderContext& aContext) {
   } else if (m.resumePause > ctime) {
     return;
   }
+  if (m.lastFrame > 0.0) {
+    const double frameDelta = ctime - m.lastFrame;
+    if (frameDelta <= kMaxSampleTimeDelta) {
+      m.history.Push(frameDelta);
+    }
+  }
+  m.lastFrame = ctime;
   if (m.timeStamp <= 0.0) {
     m.timeStamp = ctime;
-    m.frameCount++;
     return;
   }
   const double delta = ctime - m.timeStamp;
   if (delta > kMaxSampleTimeDelta) {
     VRB_DEBUG("Discarding sample, frame delta was too large: %f sec", delta);
-    m.frameCount = 1.0;
     m.timeStamp = ctime;
   } else if (delta >= kSampleTimeDelta) {
-    m.samples[m.samplePlace] = m.frameCount / delta;
+    const FrameHistory::Window window = m.history.GetWindow(delta);
+    m.samples[m.samplePlace] = window.total > 0.0 ? (double)window.frames / window.total : 0.0;
     VRB_DEBUG("Average Frame Rate: %.0fHz", std::round(m.samples[m.samplePlace]));
+    if (m.hasFrameTimes) {
+      VRB_DEBUG("Frame time CPU: %.2fms GPU: %.2fms", m.frameTimes.cpu * 1000.0, m.frameTimes.gpu * 1000.0);
+    }
     m.samplePlace = (m.samplePlace + 1) % kSampleCount;
-    m.frameCount = 1.0;
     m.timeStamp = ctime;
     m.Validate();
-  } else {
-    m.frameCount++;
   }
 }
 
@@ -0,0 +1,65 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/private/PoolAllocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+const size_t kChunkSize = 16 * 1024;
+const size_t kMinChunkSlots = 16;
+
+}
+
+namespace vrb {
+
+MemoryPool::MemoryPool(const size_t aSize, const size_t aAlignment)
+    : mSlotSize(0)
+    , mAlignment(std::max(aAlignment, sizeof(void*)))
+    , mChunkSlots(0)
+    , mFree(nullptr) {
+  const size_t kSize = std::max(aSize, sizeof(Slot));
+  mSlotSize = ((kSize + mAlignment - 1) / mAlignment) * mAlignment;
+  mChunkSlots = std::max(kChunkSize / mSlotSize, kMinChunkSlots);
+}
+
+void*
+MemoryPool::Allocate() {
+  MutexAutoLock lock(mLock);
+  if (!mFree) {
+    void* chunk = nullptr;
+    if (posix_memalign(&chunk, mAlignment, mSlotSize * mChunkSlots) != 0) {
+      throw std::bad_alloc();
+    }
+    mChunks.push_back(chunk);
+    // Thread the new slots in address order so consecutive allocations
+    // are adjacent.
+    char* base = static_cast<char*>(chunk);
+    for (size_t index = mChunkSlots; index > 0; index--) {
+      Slot* slot = reinterpret_cast<Slot*>(base + ((index - 1) * mSlotSize));
+      slot->next = mFree;
+      mFree = slot;
+    }
+  }
+  Slot* result = mFree;
+  mFree = result->next;
+  return result;
+}
+
+void
+MemoryPool::Release(void* aSlot) {
+  if (!aSlot) {
+    return;
+  }
+  MutexAutoLock lock(mLock);
+  Slot* slot = static_cast<Slot*>(aSlot);
+  slot->next = mFree;
+  mFree = slot;
+}
+
+} // namespace vrb
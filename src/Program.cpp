@@ -9,14 +9,88 @@
 #include "vrb/Program.h"
 
 #include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+#include "vrb/ProgramFactory.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+// Uniforms with locations beyond this value are always uploaded.
+const GLint kMaxShadowedLocation = 256;
+
+struct UniformShadow {
+  bool valid = false;
+  GLfloat values[16];
+};
+
+}
 
 namespace vrb {
 
 struct Program::State {
   GLuint program = 0;
   uint32_t features = 0;
+  int lightCount = -1;
+  std::function<ProgramPtr(const int)> variantFactory;
+  ProgramPtr lightVariants[VRB_MAX_LIGHTS + 1];
+  bool pending = false;
+  std::function<bool(const GLuint)> linked;
+  bool locationsValid = false;
+  Locations locations;
+  std::vector<UniformShadow> uniforms;
+
+  // Returns true if the values differ from the last values set at aLocation.
+  bool Update(const GLint aLocation, const GLfloat* aValues, const size_t aCount) {
+    if ((aLocation < 0) || (aLocation >= kMaxShadowedLocation)) {
+      return aLocation >= 0;
+    }
+    if (aLocation >= (GLint)uniforms.size()) {
+      uniforms.resize((size_t)aLocation + 1);
+    }
+    UniformShadow& shadow = uniforms[aLocation];
+    const size_t kSize = sizeof(GLfloat) * aCount;
+    if (shadow.valid && (memcmp(shadow.values, aValues, kSize) == 0)) {
+      return false;
+    }
+    memcpy(shadow.values, aValues, kSize);
+    shadow.valid = true;
+    return true;
+  }
 };
 
+Program::Locations::Locations()
+    : model(-1)
+    , joints(-1)
+    , uvTransform(-1)
+    , lightCount(-1)
+    , materialAmbient(-1)
+    , materialDiffuse(-1)
+    , materialSpecular(-1)
+    , materialSpecularExponent(-1)
+    , texture0(-1)
+    , textureLayer(-1)
+    , tintColor(-1)
+    , position(-1)
+    , normal(-1)
+    , uv(-1)
+    , color(-1)
+    , instanceModel(-1)
+    , jointIndices(-1)
+    , jointWeights(-1)
+{
+  for (int ix = 0; ix < VRB_MAX_VIEWS; ix++) {
+    viewProjection[ix] = view[ix] = -1;
+    modelViewProjection[ix] = modelView[ix] = -1;
+  }
+  for (Light& light: lights) {
+    light.direction = light.position = light.ambient = light.diffuse = light.specular = -1;
+  }
+}
+
 ProgramPtr
 Program::Create() {
   return std::make_shared<ConcreteClass<Program, Program::State> >();
@@ -24,11 +98,32 @@ Program::Create() {
 
 bool
 Program::Enable() {
-  if (!m.program) {
+  if (!IsReady()) {
     return false;
   }
 
   VRB_GL_CHECK(glUseProgram(m.program));
+  VRB_GL_STATS_ADD(ProgramSwitches, 1);
+  return true;
+}
+
+bool
+Program::IsReady() {
+  if (!m.program) {
+    return false;
+  }
+  if (m.pending) {
+    if (!IsProgramComplete(m.program)) {
+      return false;
+    }
+    m.pending = false;
+    std::function<bool(const GLuint)> linked;
+    linked.swap(m.linked);
+    if (linked && !linked(m.program)) {
+      m.program = 0;
+      return false;
+    }
+  }
   return true;
 }
 
@@ -37,14 +132,62 @@ Program::SetFeatures(const uint32_t aFeatures) {
   m.features = aFeatures;
 }
 
+uint32_t
+Program::GetFeatures() const {
+  return m.features;
+}
+
 bool
 Program::SupportsFeatures(const uint32_t aFeatures) {
   return (m.features & aFeatures) == aFeatures;
 }
 
+void
+Program::SetLightCount(const int aLightCount) {
+  m.lightCount = aLightCount;
+}
+
+int
+Program::GetLightCount() const {
+  return m.lightCount;
+}
+
+ProgramPtr
+Program::GetLightCountVariant(const int aLightCount) {
+  if ((aLightCount < 0) || (aLightCount > VRB_MAX_LIGHTS) || !m.variantFactory) {
+    return nullptr;
+  }
+  ProgramPtr& variant = m.lightVariants[aLightCount];
+  if (!variant) {
+    variant = m.variantFactory(aLightCount);
+    if (!variant) {
+      // The factory only fails once its context is gone.
+      m.variantFactory = nullptr;
+      return nullptr;
+    }
+  }
+  return variant->IsReady() ? variant : nullptr;
+}
+
+void
+Program::SetLightCountVariantFactory(const std::function<ProgramPtr(const int)>& aFactory) {
+  m.variantFactory = aFactory;
+}
+
 void
 Program::SetProgram(GLuint aProgram) {
   m.program = aProgram;
+  m.pending = false;
+  m.linked = nullptr;
+  m.locationsValid = false;
+  m.uniforms.clear();
+}
+
+void
+Program::SetPendingProgram(GLuint aProgram, const std::function<bool(const GLuint)>& aLinked) {
+  SetProgram(aProgram);
+  m.pending = aProgram != 0;
+  m.linked = aLinked;
 }
 
 GLuint
@@ -70,6 +213,152 @@ Program::GetUniformLocation(const char* aName) {
   return vrb::GetUniformLocation(m.program, aName);
 }
 
+const Program::Locations&
+Program::GetLocations() {
+  if (m.locationsValid || !m.program) {
+    return m.locations;
+  }
+  Locations& result = m.locations;
+  result = Locations();
+  const bool kTexturing = (m.features & (FeatureTexture | FeatureCubeTexture | FeatureSurfaceTexture | FeatureTextureArray)) != 0;
+  char name[64];
+  if (SupportsFeatures(FeatureLateLatch)) {
+    // The camera comes from the uniform block, the binding is program state
+    // and is set again after each link.
+    GLuint block = GL_INVALID_INDEX;
+    VRB_GL_CHECK(block = glGetUniformBlockIndex(m.program, "vrb_Camera"));
+    if (block == GL_INVALID_INDEX) {
+      VRB_ERROR("Failed to glGetUniformBlockIndex for 'vrb_Camera'");
+    } else {
+      VRB_GL_CHECK(glUniformBlockBinding(m.program, block, VRB_CAMERA_BLOCK_BINDING));
+    }
+  } else if (SupportsFeatures(FeatureMultiview)) {
+    for (int ix = 0; ix < VRB_MAX_VIEWS; ix++) {
+      snprintf(name, sizeof(name), "u_viewProjection[%d]", ix);
+      result.viewProjection[ix] = GetUniformLocation(name);
+      snprintf(name, sizeof(name), "u_view[%d]", ix);
+      result.view[ix] = GetUniformLocation(name);
+      snprintf(name, sizeof(name), "u_modelViewProjection[%d]", ix);
+      result.modelViewProjection[ix] = GetUniformLocation(name);
+      snprintf(name, sizeof(name), "u_modelView[%d]", ix);
+      result.modelView[ix] = GetUniformLocation(name);
+    }
+  } else {
+    result.viewProjection[0] = GetUniformLocation("u_viewProjection");
+    result.view[0] = GetUniformLocation("u_view");
+    result.modelViewProjection[0] = GetUniformLocation("u_modelViewProjection");
+    result.modelView[0] = GetUniformLocation("u_modelView");
+  }
+  if (SupportsFeatures(FeatureInstancing)) {
+    result.instanceModel = GetAttributeLocation("a_instanceModel");
+  } else {
+    result.model = GetUniformLocation("u_model");
+  }
+  if (SupportsFeatures(FeatureSkinning)) {
+    result.joints = GetUniformLocation("u_joints[0]");
+    result.jointIndices = GetAttributeLocation("a_jointIndices");
+    result.jointWeights = GetAttributeLocation("a_jointWeights");
+  }
+  if (SupportsFeatures(FeatureDepthOnly)) {
+    // Nothing but the position reaches the shaders.
+    result.position = GetAttributeLocation("a_position");
+    m.locationsValid = true;
+    return result;
+  }
+  if (m.lightCount < 0) {
+    result.lightCount = GetUniformLocation("u_lightCount");
+  }
+  if (SupportsFeatures(FeatureUVTransform)) {
+    result.uvTransform = GetUniformLocation("u_uv_transform");
+  }
+  // Lights past the count of a specialized program are not in the shader.
+  const int kLightCount = m.lightCount < 0 ? VRB_MAX_LIGHTS : std::min(m.lightCount, VRB_MAX_LIGHTS);
+  for (int ix = 0; ix < kLightCount; ix++) {
+    snprintf(name, sizeof(name), "u_lights[%d].direction", ix);
+    result.lights[ix].direction = GetUniformLocation(name);
+    snprintf(name, sizeof(name), "u_lights[%d].position", ix);
+    result.lights[ix].position = GetUniformLocation(name);
+    snprintf(name, sizeof(name), "u_lights[%d].ambient", ix);
+    result.lights[ix].ambient = GetUniformLocation(name);
+    snprintf(name, sizeof(name), "u_lights[%d].diffuse", ix);
+    result.lights[ix].diffuse = GetUniformLocation(name);
+    snprintf(name, sizeof(name), "u_lights[%d].specular", ix);
+    result.lights[ix].specular = GetUniformLocation(name);
+  }
+  if (SupportsFeatures(FeatureMaterialBlock)) {
+    GLuint block = GL_INVALID_INDEX;
+    VRB_GL_CHECK(block = glGetUniformBlockIndex(m.program, "vrb_Material"));
+    if (block == GL_INVALID_INDEX) {
+      VRB_ERROR("Failed to glGetUniformBlockIndex for 'vrb_Material'");
+    } else {
+      VRB_GL_CHECK(glUniformBlockBinding(m.program, block, VRB_MATERIAL_BLOCK_BINDING));
+    }
+  } else {
+    result.materialAmbient = GetUniformLocation("u_material.ambient");
+    result.materialDiffuse = GetUniformLocation("u_material.diffuse");
+    result.materialSpecular = GetUniformLocation("u_material.specular");
+    result.materialSpecularExponent = GetUniformLocation("u_material.specularExponent");
+    result.tintColor = GetUniformLocation("u_tintColor");
+  }
+  if (kTexturing) {
+    result.texture0 = GetUniformLocation("u_texture0");
+    result.uv = GetAttributeLocation("a_uv");
+  }
+  if (SupportsFeatures(FeatureTextureArray)) {
+    result.textureLayer = GetUniformLocation("u_textureLayer");
+  }
+  result.position = GetAttributeLocation("a_position");
+  result.normal = GetAttributeLocation("a_normal");
+  if (SupportsFeatures(FeatureVertexColor)) {
+    result.color = GetAttributeLocation("a_color");
+  }
+  m.locationsValid = true;
+  return result;
+}
+
+void
+Program::SetUniform1i(const GLint aLocation, const GLint aValue) {
+  GLfloat value = 0.0f;
+  memcpy(&value, &aValue, sizeof(value));
+  if (m.Update(aLocation, &value, 1)) {
+    VRB_GL_CHECK(glUniform1i(aLocation, aValue));
+  }
+}
+
+void
+Program::SetUniform1f(const GLint aLocation, const GLfloat aValue) {
+  if (m.Update(aLocation, &aValue, 1)) {
+    VRB_GL_CHECK(glUniform1f(aLocation, aValue));
+  }
+}
+
+void
+Program::SetUniform3fv(const GLint aLocation, const GLfloat* aValues) {
+  if (m.Update(aLocation, aValues, 3)) {
+    VRB_GL_CHECK(glUniform3fv(aLocation, 1, aValues));
+  }
+}
+
+void
+Program::SetUniform4fv(const GLint aLocation, const GLfloat* aValues) {
+  if (m.Update(aLocation, aValues, 4)) {
+    VRB_GL_CHECK(glUniform4fv(aLocation, 1, aValues));
+  }
+}
+
+void
+Program::SetUniformMatrix4fv(const GLint aLocation, const GLfloat* aValues) {
+  if (m.Update(aLocation, aValues, 16)) {
+    VRB_GL_CHECK(glUniformMatrix4fv(aLocation, 1, GL_FALSE, aValues));
+  }
+}
+
+void
+Program::SetUniformMatrix4fv(const GLint aLocation, const GLsizei aCount, const GLfloat* aValues) {
+  if ((aLocation >= 0) && (aCount > 0)) {
+    VRB_GL_CHECK(glUniformMatrix4fv(aLocation, aCount, GL_FALSE, aValues));
+  }
+}
 
 Program::Program(State& aState) : m(aState) {}
 
@@ -10,16 +10,153 @@
 #include "vrb/ConcreteClass.h"
 #include "vrb/CreationContext.h"
 #include "vrb/LoaderThread.h"
+#include "vrb/Logger.h"
 #include <vrb/Mutex.h>
 #include "vrb/ResourceGL.h"
+#include "vrb/private/AssetTable.h"
+#include "vrb/private/CacheFile.h"
 #include "vrb/private/ResourceGLState.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include <vrb/Program.h>
 #include <vrb/GLError.h>
 #include <vrb/ShaderUtil.h>
 
+namespace {
+
+const uint32_t kBinaryMagic = 0x50425256; // "VRBP"
+const uint32_t kBinaryVersion = 1;
+
+std::string
+GetGLString(const GLenum aName) {
+  const GLubyte* value = glGetString(aName);
+  return value ? std::string((const char*)value) : std::string();
+}
+
+// Program binaries are only valid for the driver that produced them.
+std::string
+GetDriverString() {
+  return GetGLString(GL_VENDOR) + "|" + GetGLString(GL_RENDERER) + "|" + GetGLString(GL_VERSION);
+}
+
+// File layout: magic, version, feature mask, driver string length and
+// bytes, binary format, binary length and bytes.
+GLuint
+LoadProgramBinary(const std::string& aFile, const uint32_t aFeatureMask, const std::string& aDriver) {
+  std::ifstream input(aFile, std::ios::binary);
+  if (!input) {
+    return 0;
+  }
+  std::vector<char> buffer((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  vrb::CacheFileReader reader(buffer.data(), buffer.size());
+  const uint32_t magic = reader.GetU32();
+  const uint32_t version = reader.GetU32();
+  const uint32_t featureMask = reader.GetU32();
+  const std::string driver = reader.GetString();
+  const uint32_t format = reader.GetU32();
+  const uint32_t length = reader.GetU32();
+  const char* binary = reader.Skip(length);
+  if (!binary || (magic != kBinaryMagic) || (version != kBinaryVersion) ||
+      (featureMask != aFeatureMask) || (driver != aDriver)) {
+    return 0;
+  }
+  GLuint program = VRB_GL_CHECK(glCreateProgram());
+  VRB_GL_CHECK(glProgramBinary(program, (GLenum)format, binary, (GLsizei)length));
+  GLint linked = 0;
+  VRB_GL_CHECK(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+  if (!linked) {
+    // Expected after a driver update, the caller compiles from source.
+    VRB_DEBUG("Rejected cached program binary: %s", aFile.c_str());
+    VRB_GL_CHECK(glDeleteProgram(program));
+    return 0;
+  }
+  return program;
+}
+
+void
+SaveProgramBinary(const std::string& aFile, const GLuint aProgram, const uint32_t aFeatureMask, const std::string& aDriver) {
+  GLint length = 0;
+  VRB_GL_CHECK(glGetProgramiv(aProgram, GL_PROGRAM_BINARY_LENGTH, &length));
+  if (length <= 0) {
+    return;
+  }
+  std::vector<char> binary((size_t)length);
+  GLenum format = 0;
+  GLsizei written = 0;
+  VRB_GL_CHECK(glGetProgramBinary(aProgram, length, &written, &format, binary.data()));
+  if (written <= 0) {
+    return;
+  }
+  vrb::CacheFileWriter header;
+  header.PutU32(kBinaryMagic);
+  header.PutU32(kBinaryVersion);
+  header.PutU32(aFeatureMask);
+  header.PutString(aDriver);
+  header.PutU32((uint32_t)format);
+  header.PutU32((uint32_t)written);
+  vrb::CacheFileOutput output(aFile, "program binary");
+  if (!output.IsOpen()) {
+    return;
+  }
+  output.Write(header);
+  output.Write(binary.data(), (size_t)written);
+  output.Commit();
+}
+
+// Inserts aDefines after the #version and #extension directives, which
+// must come first. With aESSL3 the source is also moved to GLSL ES 3.00 and
+// expected to use the GLSL ES 1.00 names mapped by the multiview defines.
+std::string
+AddPreamble(const char* aSource, const std::string& aDefines, const bool aESSL3) {
+  std::string result(aSource);
+  size_t position = 0;
+  const size_t kVersion = result.find("#version");
+  if (kVersion != std::string::npos) {
+    const size_t kEnd = result.find('\n', kVersion);
+    if (kEnd == std::string::npos) {
+      result += "\n";
+      position = result.length();
+    } else {
+      position = kEnd + 1;
+    }
+    if (aESSL3) {
+      result.replace(kVersion, position - kVersion, "#version 300 es\n");
+      position = kVersion + strlen("#version 300 es\n");
+    }
+  } else if (aESSL3) {
+    result.insert(0, "#version 300 es\n");
+    position = strlen("#version 300 es\n");
+  }
+  while (true) {
+    const size_t kStart = result.find_first_not_of(" \t\r\n", position);
+    if ((kStart == std::string::npos) || (result.compare(kStart, strlen("#extension"), "#extension") != 0)) {
+      break;
+    }
+    const size_t kEnd = result.find('\n', kStart);
+    position = kEnd == std::string::npos ? result.length() : kEnd + 1;
+  }
+  if (aESSL3) {
+    const std::string kExternal("GL_OES_EGL_image_external :");
+    const size_t kFound = result.find(kExternal);
+    if ((kFound != std::string::npos) && (kFound < position)) {
+      result.replace(kFound, kExternal.length(), "GL_OES_EGL_image_external_essl3 :");
+      position += strlen("_essl3");
+    }
+  }
+  result.insert(position, aDefines);
+  return result;
+}
+
+} // namespace
+
 namespace vrb {
 
 class ProgramBuilder;
@@ -27,11 +164,14 @@ typedef std::shared_ptr<ProgramBuilder> ProgramBuilderPtr;
 
 class ProgramBuilder : public ResourceGL {
 public:
-  static ProgramBuilderPtr Create(LoaderThreadWeak aLoader);
+  static ProgramBuilderPtr Create(LoaderThreadWeak aLoader, const std::string& aCachePath, const bool aParallelCompile);
 
   ProgramPtr GetProgram();
-  void SetFeatures(const uint32_t aFeatureMask, const std::string& aCustomFragShader);
+  void SetFeatures(const uint32_t aFeatureMask, const std::string& aCustomFragShader, const int aLightCount);
+  void SetParallelCompileEnabled(const bool aEnabled);
   void Finalize();
+  // True once the program is usable or failed to compile.
+  bool IsDone();
 
   // ResourceGL Interface
   bool SupportOffRenderThreadInitialization() override;
@@ -48,40 +188,89 @@ private:
 
 struct ProgramBuilder::State : public ResourceGL::State {
   LoaderThreadWeak loaderHandle;
+  std::string cachePath;
+  bool parallelCompile;
+  // Set while the driver is still compiling programHandle.
+  bool pending;
+  bool finalized;
+  std::string cacheFile;
+  std::string driver;
   ProgramPtr program;
   uint32_t featureMask;
   std::string customFragmentShader;
+  int lightCount;
   GLuint vertexShader;
   GLuint fragmentShader;
   GLuint programHandle;
 
-  State() : program(Program::Create()), featureMask(0), vertexShader(0), fragmentShader(0), programHandle(0) {}
-  bool IsTexturingEnabled() { return (featureMask & (FeatureTexture | FeatureCubeTexture | FeatureSurfaceTexture)) != 0; }
-  bool IsCubeMapTextureEnabled() { return (featureMask & FeatureCubeTexture) != 0; }
-  bool IsSurfaceTextureEnabled() { return (featureMask & FeatureSurfaceTexture) != 0;}
-  std::string GetFragmentShader(const std::string& aSource) {
-    const std::string kPrecisionMacro("VRB_FRAGMENT_PRECISION");
-    std::string result = aSource;
-    const size_t kUVStart = result.find(kPrecisionMacro);
-    if (kUVStart != std::string::npos) {
-      const char * precision;
-      if ((featureMask & FeatureHighPrecision) != 0) {
-        precision = "highp";
-      } else if ((featureMask & FeatureLowPrecision) != 0) {
-        precision = "lowp";
-      } else {
-        precision = "mediump";
-      }
-      result.replace(kUVStart, kPrecisionMacro.length(), precision);
+  State() : parallelCompile(false), pending(false), finalized(false), program(Program::Create()), featureMask(0), lightCount(-1), vertexShader(0), fragmentShader(0), programHandle(0) {}
+  bool IsTexturingEnabled() const { return (featureMask & (FeatureTexture | FeatureCubeTexture | FeatureSurfaceTexture | FeatureTextureArray)) != 0; }
+  bool IsCubeMapTextureEnabled() const { return (featureMask & FeatureCubeTexture) != 0; }
+  bool IsTextureArrayEnabled() const { return (featureMask & FeatureTextureArray) != 0; }
+  bool IsESSL3() const { return (featureMask & (FeatureMultiview | FeatureTextureArray | FeatureLateLatch | FeatureMaterialBlock)) != 0; }
+  bool IsSurfaceTextureEnabled() const { return (featureMask & FeatureSurfaceTexture) != 0;}
+  // The variant is selected by a #define preamble generated from the mask.
+  std::string GetVertexDefines() const {
+    std::string result;
+    if ((featureMask & FeatureMultiview) != 0) {
+      result += "#extension GL_OVR_multiview2 : require\n";
+      result += "layout(num_views = " + std::to_string(VRB_MAX_VIEWS) + ") in;\n";
+    }
+    if (IsESSL3()) {
+      result += "#define attribute in\n";
+      result += "#define varying out\n";
+    }
+    result += std::string("#define VRB_MULTIVIEW ") + ((featureMask & FeatureMultiview) != 0 ? "1" : "0") + "\n";
+    result += std::string("#define VRB_USE_TEXTURE ") + (IsTexturingEnabled() ? "1" : "0") + "\n";
+    result += std::string("#define VRB_UV_TYPE ") + ((IsCubeMapTextureEnabled() || IsTextureArrayEnabled()) ? "vec3" : "vec2") + "\n";
+    result += std::string("#define VRB_TEXTURE_ARRAY ") + (IsTextureArrayEnabled() ? "1" : "0") + "\n";
+    result += std::string("#define VRB_UV_TRANSFORM ") + ((featureMask & FeatureUVTransform) != 0 ? "1" : "0") + "\n";
+    result += std::string("#define VRB_VERTEX_COLOR ") + ((featureMask & FeatureVertexColor) != 0 ? "1" : "0") + "\n";
+    result += std::string("#define VRB_INSTANCED ") + ((featureMask & FeatureInstancing) != 0 ? "1" : "0") + "\n";
+    result += std::string("#define VRB_SKINNED ") + ((featureMask & FeatureSkinning) != 0 ? "1" : "0") + "\n";
+    result += std::string("#define VRB_SPECULAR ") + ((featureMask & FeatureNoSpecular) != 0 ? "0" : "1") + "\n";
+    result += std::string("#define VRB_LATE_LATCH ") + ((featureMask & FeatureLateLatch) != 0 ? "1" : "0") + "\n";
+    result += std::string("#define VRB_MATERIAL_BLOCK ") + ((featureMask & FeatureMaterialBlock) != 0 ? "1" : "0") + "\n";
+    result += std::string("#define VRB_DEPTH_ONLY ") + ((featureMask & FeatureDepthOnly) != 0 ? "1" : "0") + "\n";
+    result += "#define VRB_MAX_JOINTS " + std::to_string(VRB_MAX_JOINTS) + "\n";
+    result += "#define VRB_MAX_LIGHTS " + std::to_string(VRB_MAX_LIGHTS) + "\n";
+    // A known light count replaces the light loop with one call per light.
+    result += "#define VRB_LIGHT_COUNT " + std::to_string(lightCount) + "\n";
+    result += "#define VRB_APPLY_LIGHTS";
+    for (int ix = 0; ix < lightCount; ix++) {
+      result += " v_color += calculate_light(" + std::to_string(ix) + ");";
+    }
+    result += "\n";
+    return result;
+  }
+  std::string GetFragmentDefines() const {
+    const char* precision;
+    if ((featureMask & FeatureHighPrecision) != 0) {
+      precision = "highp";
+    } else if ((featureMask & FeatureLowPrecision) != 0) {
+      precision = "lowp";
+    } else {
+      precision = "mediump";
+    }
+    std::string result;
+    if (IsESSL3()) {
+      result += "#define varying in\n";
+      result += "#define texture2D texture\n";
+      result += "#define textureCube texture\n";
+      result += "out mediump vec4 vrb_FragColor;\n";
+      result += "#define gl_FragColor vrb_FragColor\n";
     }
+    result += std::string("#define VRB_FRAGMENT_PRECISION ") + precision + "\n";
     return result;
   }
 };
 
 ProgramBuilderPtr
-ProgramBuilder::Create(LoaderThreadWeak aLoader) {
+ProgramBuilder::Create(LoaderThreadWeak aLoader, const std::string& aCachePath, const bool aParallelCompile) {
   ProgramBuilderPtr result = std::make_shared<ConcreteClass<ProgramBuilder, ProgramBuilder::State> >();
   result->m.loaderHandle = aLoader;
+  result->m.cachePath = aCachePath;
+  result->m.parallelCompile = aParallelCompile;
   return result;
 }
 
@@ -92,10 +281,17 @@ ProgramBuilder::GetProgram() {
 }
 
 void
-ProgramBuilder::SetFeatures(const uint32_t aFeatureMask, const std::string& aCustomFragShader) {
+ProgramBuilder::SetFeatures(const uint32_t aFeatureMask, const std::string& aCustomFragShader, const int aLightCount) {
   m.featureMask = aFeatureMask;
   m.customFragmentShader = aCustomFragShader;
+  m.lightCount = aLightCount;
   m.program->SetFeatures(aFeatureMask);
+  m.program->SetLightCount(aLightCount);
+}
+
+void
+ProgramBuilder::SetParallelCompileEnabled(const bool aEnabled) {
+  m.parallelCompile = aEnabled;
 }
 
 
@@ -104,7 +300,36 @@ ProgramBuilder::Finalize() {
   if (!m.program) {
     return;
   }
-  m.program->SetProgram(m.programHandle);
+  m.finalized = true;
+  if (!m.pending) {
+    m.program->SetProgram(m.programHandle);
+    return;
+  }
+  m.pending = false;
+  const GLuint kVertexShader = m.vertexShader;
+  const GLuint kFragmentShader = m.fragmentShader;
+  const uint32_t kFeatureMask = m.featureMask;
+  const std::string cacheFile = m.cacheFile;
+  const std::string driver = m.driver;
+  // Runs on the render thread from Program::Enable() once the driver is done.
+  m.program->SetPendingProgram(m.programHandle, [=](const GLuint aProgram) {
+    if (!CheckProgramLinked(aProgram, kVertexShader, kFragmentShader)) {
+      return false;
+    }
+    if (!cacheFile.empty()) {
+      SaveProgramBinary(cacheFile, aProgram, kFeatureMask, driver);
+    }
+    return true;
+  });
+}
+
+bool
+ProgramBuilder::IsDone() {
+  if (!m.finalized) {
+    return false;
+  }
+  // Polling also completes a program compiled in parallel.
+  return m.program->IsReady() || (m.program->GetProgram() == 0);
 }
 
 bool
@@ -112,59 +337,60 @@ ProgramBuilder::SupportOffRenderThreadInitialization() { return true; }
 
 void
 ProgramBuilder::InitializeGL() {
-  std::string vertexShaderSource = GetVertexShaderSource();
-  const std::string kTextureUVMacro("VRB_TEXTURE_UV_TYPE");
-  const size_t kUVStart = vertexShaderSource.find(kTextureUVMacro);
-  if (kUVStart != std::string::npos) {
-    vertexShaderSource.replace(kUVStart, kTextureUVMacro.length(), m.IsCubeMapTextureEnabled() ? "vec3" : "vec2");
-  }
-
-  const std::string kUVTransformMacro("VRB_UV_TRANSFORM_ENABLED");
-  const size_t kUVTransformStart = vertexShaderSource.find(kUVTransformMacro);
-  if (kUVTransformStart != std::string::npos) {
-    vertexShaderSource.replace(kUVTransformStart, kUVTransformMacro.length(), (m.featureMask & FeatureUVTransform) != 0 ? "1" : "0");
-  }
-
-  const std::string kVertexColorMacro("VRB_VERTEX_COLOR_ENABLED");
-  const size_t kVertexColorStart = vertexShaderSource.find(kVertexColorMacro);
-  if (kVertexColorStart != std::string::npos) {
-    vertexShaderSource.replace(kVertexColorStart, kVertexColorMacro.length(), (m.featureMask & FeatureVertexColor) != 0 ? "1" : "0");
-  }
-
-  const std::string kTextureMacro("VRB_TEXTURE_STATE");
-  const size_t kStart = vertexShaderSource.find(kTextureMacro);
-  if (m.IsTexturingEnabled()) {
-    if(kStart != std::string::npos) {
-      vertexShaderSource.replace(kStart, kTextureMacro.length(), "1");
-    }
-    m.vertexShader = LoadShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
-    std::string frag = m.GetFragmentShader(GetFragmentTextureShaderSource());
+  const bool kESSL3 = m.IsESSL3();
+  const std::string vertexShaderSource = AddPreamble(GetVertexShaderSource(), m.GetVertexDefines(), kESSL3);
+  const char* fragmentSource = GetFragmentShaderSource();
+  if ((m.featureMask & FeatureDepthOnly) != 0) {
+    fragmentSource = GetFragmentDepthOnlyShaderSource();
+  } else if (!m.customFragmentShader.empty()) {
+    fragmentSource = m.customFragmentShader.c_str();
+  } else if (m.IsTexturingEnabled()) {
+    fragmentSource = GetFragmentTextureShaderSource();
     if (m.IsCubeMapTextureEnabled()) {
-      frag = m.GetFragmentShader(GetFragmentCubeMapTextureShaderSource());
+      fragmentSource = GetFragmentCubeMapTextureShaderSource();
+    } else if (m.IsTextureArrayEnabled()) {
+      fragmentSource = GetFragmentTextureArrayShaderSource();
     }
 #if defined(ANDROID)
     // SurfaceTexture requires usage of fragment shader extension.
     if (m.IsSurfaceTextureEnabled()) {
-      frag = m.GetFragmentShader(GetFragmentSurfaceTextureShaderSource());
+      fragmentSource = GetFragmentSurfaceTextureShaderSource();
     }
 #endif // defined(ANDROID)
-    if (!m.customFragmentShader.empty()) {
-      frag = m.GetFragmentShader(m.customFragmentShader);
+  }
+  const std::string frag = AddPreamble(fragmentSource, m.GetFragmentDefines(), kESSL3);
+
+  // The final sources are part of the key so shader changes invalidate it.
+  std::string& cacheFile = m.cacheFile;
+  std::string& driver = m.driver;
+  if (!m.cachePath.empty()) {
+    driver = GetDriverString();
+    const uint64_t kKey = CacheFileHash(driver, CacheFileHash(frag,
+        CacheFileHash(vertexShaderSource, CacheFileHash(std::to_string(m.featureMask)))));
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)kKey);
+    cacheFile = m.cachePath + "/vrb_program_" + name + ".bin";
+    m.programHandle = LoadProgramBinary(cacheFile, m.featureMask, driver);
+  }
+
+  if (!m.programHandle && m.parallelCompile) {
+    // Only submit the work, the link status is checked once the driver
+    // reports completion so other programs can be submitted meanwhile.
+    m.vertexShader = CompileShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
+    m.fragmentShader = CompileShader(GL_FRAGMENT_SHADER, frag.c_str());
+    if (m.fragmentShader && m.vertexShader) {
+      m.programHandle = LinkProgram(m.vertexShader, m.fragmentShader, !cacheFile.empty());
+      m.pending = true;
     }
+  } else if (!m.programHandle) {
+    m.vertexShader = LoadShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
     m.fragmentShader = LoadShader(GL_FRAGMENT_SHADER, frag.c_str());
-  } else {
-    if(kStart != std::string::npos) {
-      vertexShaderSource.replace(kStart, kTextureMacro.length(), "0");
+    if (m.fragmentShader && m.vertexShader) {
+      m.programHandle = CreateProgram(m.vertexShader, m.fragmentShader, !cacheFile.empty());
     }
-    m.vertexShader = LoadShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
-    std::string frag = m.GetFragmentShader(GetFragmentShaderSource());
-    if (!m.customFragmentShader.empty()) {
-      frag = m.GetFragmentShader(m.customFragmentShader);
+    if (m.programHandle && !cacheFile.empty()) {
+      SaveProgramBinary(cacheFile, m.programHandle, m.featureMask, driver);
     }
-    m.fragmentShader = LoadShader(GL_FRAGMENT_SHADER, frag.c_str());
-  }
-  if (m.fragmentShader && m.vertexShader) {
-    m.programHandle = CreateProgram(m.vertexShader, m.fragmentShader);
   }
 
   LoaderThreadPtr loader = m.loaderHandle.lock();
@@ -178,6 +404,8 @@ ProgramBuilder::ShutdownGL() {
   if (m.programHandle) {
     VRB_GL_CHECK(glDeleteProgram(m.programHandle));
     m.programHandle = 0;
+    m.pending = false;
+    m.finalized = false;
     m.program->SetProgram(0);
   }
 
@@ -190,61 +418,284 @@ ProgramBuilder::ShutdownGL() {
     VRB_GL_CHECK(glDeleteShader(m.fragmentShader));
     m.fragmentShader = 0;
   }
+  // Nothing draws without its program, so it is recreated first when the
+  // context is restored with a budget, from the program binary if cached.
+  m.initializePriority = true;
 }
 
 ProgramBuilder::ProgramBuilder(State& aState) : ResourceGL(aState), m(aState) {}
 
+namespace {
+
+const uint32_t kKnownFeatures = (FeatureDepthOnly << 1) - 1;
+
+// Values keyed by feature mask, created the first time a mask is used. The
+// open addressed tables are never rehashed, a full table links one twice as
+// large, so Find() only does atomic loads and may run concurrently with
+// FindOrCreate(), which callers must serialize.
+template <typename T>
+class FeatureTable {
+public:
+  FeatureTable() : mFirst(new Table(kFirstBits)) {}
+  ~FeatureTable() {
+    Table* table = mFirst;
+    while (table) {
+      Table* next = table->next.load();
+      delete table;
+      table = next;
+    }
+  }
+
+  T* Find(const uint32_t aMask) const {
+    for (const Table* table = mFirst; table; table = table->next.load(std::memory_order_acquire)) {
+      T* value = table->Find(aMask);
+      if (value) {
+        return value;
+      }
+    }
+    return nullptr;
+  }
+
+  T* FindOrCreate(const uint32_t aMask) {
+    T* result = Find(aMask);
+    if (result) {
+      return result;
+    }
+    Table* table = mFirst;
+    while (!table->Insert(aMask, result)) {
+      Table* next = table->next.load();
+      if (!next) {
+        next = new Table(table->bits + 1);
+        table->next.store(next, std::memory_order_release);
+      }
+      table = next;
+    }
+    return result;
+  }
+
+  template <typename Callback>
+  void ForEach(const Callback& aCallback) const {
+    for (const Table* table = mFirst; table; table = table->next.load(std::memory_order_acquire)) {
+      for (size_t ix = 0; ix < table->Capacity(); ix++) {
+        T* value = table->values[ix].load(std::memory_order_acquire);
+        if (value) {
+          aCallback(*value);
+        }
+      }
+    }
+  }
+
+private:
+  // Most apps use a few dozen variants.
+  static const uint32_t kFirstBits = 6;
+
+  struct Table {
+    const uint32_t bits;
+    size_t count;
+    std::unique_ptr<uint32_t[]> keys;
+    std::unique_ptr<std::atomic<T*>[]> values;
+    std::atomic<Table*> next;
+
+    explicit Table(const uint32_t aBits)
+        : bits(aBits)
+        , count(0)
+        , keys(new uint32_t[size_t(1) << aBits])
+        , values(new std::atomic<T*>[size_t(1) << aBits])
+        , next(nullptr) {
+      for (size_t ix = 0; ix < Capacity(); ix++) {
+        values[ix].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+    ~Table() {
+      for (size_t ix = 0; ix < Capacity(); ix++) {
+        delete values[ix].load();
+      }
+    }
+    size_t Capacity() const {
+      return size_t(1) << bits;
+    }
+    size_t Slot(const uint32_t aMask) const {
+      // Fibonacci hashing spreads the low feature bits over the table.
+      return (size_t)((aMask * 2654435769u) >> (32 - bits));
+    }
+    // The key is written before the value is published.
+    T* Find(const uint32_t aMask) const {
+      for (size_t probe = 0, ix = Slot(aMask); probe < Capacity(); probe++, ix = (ix + 1) & (Capacity() - 1)) {
+        T* value = values[ix].load(std::memory_order_acquire);
+        if (!value) {
+          return nullptr;
+        }
+        if (keys[ix] == aMask) {
+          return value;
+        }
+      }
+      return nullptr;
+    }
+    // Fails once the table is half full, to keep probes short.
+    bool Insert(const uint32_t aMask, T*& aResult) {
+      if ((count + 1) * 2 > Capacity()) {
+        return false;
+      }
+      size_t ix = Slot(aMask);
+      while (values[ix].load(std::memory_order_relaxed)) {
+        ix = (ix + 1) & (Capacity() - 1);
+      }
+      aResult = new T;
+      keys[ix] = aMask;
+      values[ix].store(aResult, std::memory_order_release);
+      count++;
+      return true;
+    }
+    VRB_NO_DEFAULTS(Table)
+  };
+
+  Table* mFirst;
+  VRB_NO_DEFAULTS(FeatureTable)
+};
+
+} // namespace
+
 struct ProgramFactory::State {
+  // Builders are read without the lock and only created while holding it.
+  struct Variant {
+    ProgramBuilderPtr builder;
+    // Programs with a custom fragment shader, indexed by the AssetID of its
+    // source. Allocated with the first one.
+    std::atomic<AssetTable<ProgramBuilder>*> custom;
+    // The same programs specialized for each light count from zero to
+    // VRB_MAX_LIGHTS. Allocated with the first one.
+    std::atomic<Variant*> lightCounts;
+    Variant() : custom(nullptr), lightCounts(nullptr) {}
+    ~Variant() {
+      delete custom.load();
+      delete[] lightCounts.load();
+    }
+    ProgramBuilderPtr Find(const AssetID aCustomFragShader) const {
+      if (aCustomFragShader == kInvalidAssetID) {
+        return std::atomic_load(&builder);
+      }
+      AssetTable<ProgramBuilder>* table = custom.load(std::memory_order_acquire);
+      return table ? table->Find(aCustomFragShader) : nullptr;
+    }
+    template <typename T>
+    void ForEach(const T& aCallback) const {
+      ProgramBuilderPtr generic = std::atomic_load(&builder);
+      if (generic) {
+        aCallback(generic);
+      }
+      AssetTable<ProgramBuilder>* table = custom.load();
+      if (table) {
+        table->ForEach([&aCallback](const AssetID, const ProgramBuilderPtr& aBuilder) {
+          aCallback(aBuilder);
+        });
+      }
+      const Variant* counts = lightCounts.load();
+      for (int ix = 0; counts && (ix <= VRB_MAX_LIGHTS); ix++) {
+        counts[ix].ForEach(aCallback);
+      }
+    }
+  };
   Mutex lock;
-  std::unordered_map<std::string, ProgramBuilderPtr> programs;
+  FeatureTable<Variant> variants;
   LoaderThreadWeak loader;
+  std::string cachePath;
+  bool parallelCompile;
+  std::atomic<bool> multiviewEnabled;
+  std::atomic<bool> multiviewSupported;
+  std::atomic<bool> lateLatchEnabled;
+  std::atomic<bool> materialBlockEnabled;
+  std::vector<ProgramBuilderPtr> precompiled;
+  State()
+      : parallelCompile(false)
+      , multiviewEnabled(false)
+      , multiviewSupported(false)
+      , lateLatchEnabled(false)
+      , materialBlockEnabled(false)
+  {}
+  ProgramBuilderPtr GetBuilder(CreationContextPtr& aContext, const uint32_t aFeatureMask, const AssetID aCustomFragShader,
+                               const int aLightCount);
 };
 
-ProgramFactoryPtr
-ProgramFactory::Create() {
-  ProgramFactoryPtr result = std::make_shared<ConcreteClass<ProgramFactory, ProgramFactory::State> >();
-  return result;
-}
-
-void
-ProgramFactory::SetLoaderThread(LoaderThreadPtr aLoader) {
-  m.loader = aLoader;
-}
-
-ProgramPtr
-ProgramFactory::CreateProgram(CreationContextPtr& aContext, uint32_t aFeatureMask) {
-  static const std::string empty;
-  return CreateProgram(aContext, aFeatureMask, empty);
-}
-
-ProgramPtr
-ProgramFactory::CreateProgram(CreationContextPtr& aContext, const uint32_t aFeatureMask,
-                              const std::string& aCustomFragShader) {
-  const std::string key = std::to_string(aFeatureMask) + aCustomFragShader;
-  ProgramBuilderPtr builder;
+ProgramBuilderPtr
+ProgramFactory::State::GetBuilder(CreationContextPtr& aContext, const uint32_t aFeatureMask,
+                                  const AssetID aCustomFragShader, const int aLightCount) {
+  uint32_t featureMask = aFeatureMask;
+  if (featureMask & ~kKnownFeatures) {
+    VRB_ERROR("Unknown program features: 0x%x", featureMask);
+    return nullptr;
+  }
+  if (aLightCount > VRB_MAX_LIGHTS) {
+    VRB_ERROR("Programs support at most %d lights, not %d", VRB_MAX_LIGHTS, aLightCount);
+    return nullptr;
+  }
+  if (multiviewEnabled && multiviewSupported) {
+    featureMask |= FeatureMultiview;
+  }
+  if (lateLatchEnabled) {
+    featureMask |= FeatureLateLatch;
+  }
+  if (materialBlockEnabled && ((featureMask & FeatureDepthOnly) == 0)) {
+    featureMask |= FeatureMaterialBlock;
+  }
+  Variant* target = variants.Find(featureMask);
+  if (!target) {
+    MutexAutoLock guard(lock);
+    target = variants.FindOrCreate(featureMask);
+  }
+  if (aLightCount >= 0) {
+    Variant* counts = target->lightCounts.load(std::memory_order_acquire);
+    if (!counts) {
+      MutexAutoLock guard(lock);
+      counts = target->lightCounts.load();
+      if (!counts) {
+        counts = new Variant[VRB_MAX_LIGHTS + 1];
+        target->lightCounts.store(counts, std::memory_order_release);
+      }
+    }
+    target = &counts[aLightCount];
+  }
+  Variant& variant = *target;
+  ProgramBuilderPtr builder = variant.Find(aCustomFragShader);
+  if (builder) {
+    return builder;
+  }
   bool created = false;
   {
-    MutexAutoLock lock(m.lock);
-
-    auto found = m.programs.find(key);
-    if (found == m.programs.end()) {
-      builder = ProgramBuilder::Create(m.loader);
-      builder->SetFeatures(aFeatureMask, aCustomFragShader);
-      m.programs[key] = builder;
+    MutexAutoLock guard(lock);
+    builder = variant.Find(aCustomFragShader);
+    if (!builder) {
+      builder = ProgramBuilder::Create(loader, cachePath, parallelCompile);
+      builder->SetFeatures(featureMask, GetAssetName(aCustomFragShader), aLightCount);
+      if (aLightCount < 0) {
+        // Set before the program is published, RenderState::Enable asks for
+        // the variants matching the lights of each draw.
+        CreationContextWeak context = aContext;
+        builder->GetProgram()->SetLightCountVariantFactory([context, featureMask, aCustomFragShader](const int aCount) -> ProgramPtr {
+          CreationContextPtr creation = context.lock();
+          ProgramFactoryPtr factory = creation ? creation->GetProgramFactory() : nullptr;
+          return factory ? factory->CreateProgram(creation, featureMask, aCustomFragShader, aCount) : nullptr;
+        });
+      }
+      if (aCustomFragShader == kInvalidAssetID) {
+        std::atomic_store(&variant.builder, builder);
+      } else {
+        if (!variant.custom.load()) {
+          variant.custom.store(new AssetTable<ProgramBuilder>, std::memory_order_release);
+        }
+        variant.custom.load()->Set(aCustomFragShader, builder);
+      }
       created = true;
-    } else {
-      builder = found->second;
     }
   }
 
   if (created) {
-    LoaderThreadPtr loader = m.loader.lock();
-    if (loader) {
+    LoaderThreadPtr loaderThread = loader.lock();
+    if (loaderThread) {
       LoadFinishedCallback finished = [builder](GroupPtr&) {
         builder->Finalize();
       };
-      if (loader->IsOnLoaderThread()) {
-        loader->AddFinishedCallback(finished);
+      if (loaderThread->IsOnLoaderThread()) {
+        loaderThread->AddFinishedCallback(finished);
         aContext->AddResourceGL(builder.get());
       } else {
 
@@ -253,14 +704,122 @@ ProgramFactory::CreateProgram(CreationContextPtr& aContext, const uint32_t aFeat
           return nullptr;
         };
 
-        loader->RunLoadTask(nullptr, task, finished);
+        loaderThread->RunLoadTask(nullptr, task, finished);
       }
     } else {
       aContext->AddResourceGL(builder.get());
     }
   }
 
-  return builder->GetProgram();
+  return builder;
+}
+
+ProgramFactoryPtr
+ProgramFactory::Create() {
+  ProgramFactoryPtr result = std::make_shared<ConcreteClass<ProgramFactory, ProgramFactory::State> >();
+  return result;
+}
+
+void
+ProgramFactory::SetLoaderThread(LoaderThreadPtr aLoader) {
+  m.loader = aLoader;
+}
+
+void
+ProgramFactory::SetCachePath(const std::string& aPath) {
+  MutexAutoLock lock(m.lock);
+  m.cachePath = aPath;
+}
+
+void
+ProgramFactory::SetMultiviewEnabled(const bool aEnabled) {
+  MutexAutoLock lock(m.lock);
+  m.multiviewEnabled = aEnabled;
+}
+
+void
+ProgramFactory::SetMultiviewSupported(const bool aSupported) {
+  MutexAutoLock lock(m.lock);
+  m.multiviewSupported = aSupported;
+}
+
+void
+ProgramFactory::SetLateLatchEnabled(const bool aEnabled) {
+  MutexAutoLock lock(m.lock);
+  m.lateLatchEnabled = aEnabled;
+}
+
+void
+ProgramFactory::SetMaterialBlockEnabled(const bool aEnabled) {
+  MutexAutoLock lock(m.lock);
+  m.materialBlockEnabled = aEnabled;
+}
+
+void
+ProgramFactory::SetParallelCompileEnabled(const bool aEnabled) {
+  MutexAutoLock lock(m.lock);
+  m.parallelCompile = aEnabled;
+  m.variants.ForEach([aEnabled](const State::Variant& aVariant) {
+    aVariant.ForEach([aEnabled](const ProgramBuilderPtr& aBuilder) {
+      aBuilder->SetParallelCompileEnabled(aEnabled);
+    });
+  });
+}
+
+ProgramPtr
+ProgramFactory::CreateProgram(CreationContextPtr& aContext, uint32_t aFeatureMask) {
+  return CreateProgram(aContext, aFeatureMask, kInvalidAssetID);
+}
+
+ProgramPtr
+ProgramFactory::CreateProgram(CreationContextPtr& aContext, const uint32_t aFeatureMask,
+                              const std::string& aCustomFragShader) {
+  return CreateProgram(aContext, aFeatureMask, InternAsset(aCustomFragShader));
+}
+
+ProgramPtr
+ProgramFactory::CreateProgram(CreationContextPtr& aContext, const uint32_t aFeatureMask,
+                              const AssetID aCustomFragShader) {
+  ProgramBuilderPtr builder = m.GetBuilder(aContext, aFeatureMask, aCustomFragShader, -1);
+  return builder ? builder->GetProgram() : nullptr;
+}
+
+ProgramPtr
+ProgramFactory::CreateProgram(CreationContextPtr& aContext, const uint32_t aFeatureMask,
+                              const AssetID aCustomFragShader, const int aLightCount) {
+  ProgramBuilderPtr builder = m.GetBuilder(aContext, aFeatureMask, aCustomFragShader, aLightCount < 0 ? -1 : aLightCount);
+  return builder ? builder->GetProgram() : nullptr;
+}
+
+void
+ProgramFactory::Precompile(CreationContextPtr& aContext, const uint32_t aFeatureMask) {
+  Precompile(aContext, aFeatureMask, std::string());
+}
+
+void
+ProgramFactory::Precompile(CreationContextPtr& aContext, const uint32_t aFeatureMask,
+                           const std::string& aCustomFragShader) {
+  ProgramBuilderPtr builder = m.GetBuilder(aContext, aFeatureMask, InternAsset(aCustomFragShader), -1);
+  if (!builder) {
+    return;
+  }
+  MutexAutoLock lock(m.lock);
+  if (std::find(m.precompiled.begin(), m.precompiled.end(), builder) == m.precompiled.end()) {
+    m.precompiled.push_back(builder);
+  }
+}
+
+int
+ProgramFactory::GetPrecompileProgress(int& aTotal) {
+  MutexAutoLock lock(m.lock);
+  aTotal = (int)m.precompiled.size();
+  int result = 0;
+  for (ProgramBuilderPtr& builder: m.precompiled) {
+    if (builder->IsDone()) {
+      result++;
+    }
+  }
+  return result;
 }
 
 ProgramFactory::ProgramFactory(State& aState) : m(aState) {}
@@ -60,4 +60,27 @@ Quaternion::SetFromEulerAngles(float aX, float aY, float aZ) {
   m.mZ = sy * cr * cp - cy * sr * sp;
 }
 
+Quaternion
+Quaternion::Slerp(const Quaternion& aFrom, const Quaternion& aTo, const float aAmount) {
+  float cosAngle = aFrom.m.mX * aTo.m.mX + aFrom.m.mY * aTo.m.mY + aFrom.m.mZ * aTo.m.mZ + aFrom.m.mW * aTo.m.mW;
+  // q and -q are the same rotation, go the short way around.
+  const float kSign = cosAngle < 0.0f ? -1.0f : 1.0f;
+  cosAngle *= kSign;
+  float fromWeight = 1.0f - aAmount;
+  float toWeight = aAmount;
+  // Nearly parallel quaternions fall back to linear interpolation.
+  if (cosAngle < 0.9995f) {
+    const float kAngle = acosf(cosAngle);
+    const float kInverseSin = 1.0f / sinf(kAngle);
+    fromWeight = sinf(fromWeight * kAngle) * kInverseSin;
+    toWeight = sinf(toWeight * kAngle) * kInverseSin;
+  }
+  toWeight *= kSign;
+  return Quaternion(
+      (aFrom.m.mX * fromWeight) + (aTo.m.mX * toWeight),
+      (aFrom.m.mY * fromWeight) + (aTo.m.mY * toWeight),
+      (aFrom.m.mZ * fromWeight) + (aTo.m.mZ * toWeight),
+      (aFrom.m.mW * fromWeight) + (aTo.m.mW * toWeight)).Normalize();
+}
+
 }
@@ -16,39 +16,96 @@
 
 namespace vrb {
 
+namespace {
+
+GLsizei
+AttributeSize(const GLsizei aLength, const GLenum aType) {
+  GLsizei result = 0;
+  switch (aType) {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+      result = aLength;
+      break;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+    case GL_HALF_FLOAT:
+      result = aLength * 2;
+      break;
+    case GL_INT_2_10_10_10_REV:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+      result = aLength > 0 ? 4 : 0;
+      break;
+    default:
+      result = aLength * (GLsizei)sizeof(float);
+      break;
+  }
+  // Keep every attribute four byte aligned within the vertex.
+  return (result + 3) & ~3;
+}
+
+}
+
 struct RenderBuffer::State {
   GLsizei vertexCount = 0;
+  GLsizei vertexStride = 0;
   GLsizei indexCount = 0;
   GLuint vertexObjectId = 0;
   GLuint indexObjectId = 0;
+  GLenum indexType = GL_UNSIGNED_SHORT;
+  GLenum primitiveType = GL_TRIANGLES;
   size_t positionOffset = 0;
   GLsizei positionLength = 0;
+  GLenum positionType = GL_FLOAT;
+  bool positionNormalized = false;
   size_t normalOffset = 0;
   GLsizei normalLength = 0;
+  GLenum normalType = GL_FLOAT;
+  bool normalNormalized = false;
   size_t uvOffset = 0;
   GLsizei uvLength = 0;
+  GLenum uvType = GL_FLOAT;
+  bool uvNormalized = false;
   size_t colorOffset = 0;
   GLsizei colorLength = 0;
+  GLenum colorType = GL_FLOAT;
+  bool colorNormalized = false;
+  size_t jointOffset = 0;
+  GLsizei jointLength = 0;
+  GLenum jointType = GL_UNSIGNED_BYTE;
+  bool jointNormalized = false;
+  size_t weightOffset = 0;
+  GLsizei weightLength = 0;
+  GLenum weightType = GL_FLOAT;
+  bool weightNormalized = false;
 
   State() = default;
   ~State() = default;
   GLsizei PositionSize() const {
-    return positionLength * sizeof(float);
+    return AttributeSize(positionLength, positionType);
   }
 
   GLsizei NormalSize() const {
-    return normalLength * sizeof(float);
+    return AttributeSize(normalLength, normalType);
   }
 
   GLsizei UVSize() const {
-    return uvLength * sizeof(float);
+    return AttributeSize(uvLength, uvType);
   }
   GLsizei ColorSize() const {
-    return colorLength* sizeof(float);
+    return AttributeSize(colorLength, colorType);
+  }
+  GLsizei JointSize() const {
+    return AttributeSize(jointLength, jointType);
+  }
+  GLsizei WeightSize() const {
+    return AttributeSize(weightLength, weightType);
   }
 
   GLsizei VertexSize() const {
-    return PositionSize() + NormalSize() + ColorSize() + UVSize();
+    if (vertexStride > 0) {
+      return vertexStride;
+    }
+    return PositionSize() + NormalSize() + ColorSize() + UVSize() + JointSize() + WeightSize();
   }
 };
 
@@ -89,14 +146,60 @@ RenderBuffer::VertexSize() const {
   return m.VertexSize();
 }
 
+void
+RenderBuffer::SetVertexStride(const GLsizei aStride) {
+  m.vertexStride = aStride;
+}
+
 GLsizei
 RenderBuffer::IndexCount() const {
   return m.indexCount;
 }
+
+void
+RenderBuffer::SetIndexType(const GLenum aType) {
+  m.indexType = aType;
+}
+
+GLenum
+RenderBuffer::IndexType() const {
+  return m.indexType;
+}
+
+GLsizei
+RenderBuffer::IndexSize() const {
+  if (m.indexType == GL_UNSIGNED_BYTE) {
+    return sizeof(GLubyte);
+  } else if (m.indexType == GL_UNSIGNED_INT) {
+    return sizeof(GLuint);
+  }
+  return sizeof(GLushort);
+}
+
+void
+RenderBuffer::SetPrimitiveType(const GLenum aType) {
+  m.primitiveType = aType;
+}
+
+GLenum
+RenderBuffer::PrimitiveType() const {
+  return m.primitiveType;
+}
+
+GLsizei
+RenderBuffer::TriangleCount(const GLsizei aIndexCount) const {
+  if (m.primitiveType == GL_TRIANGLE_STRIP) {
+    return aIndexCount > 2 ? aIndexCount - 2 : 0;
+  }
+  return aIndexCount / 3;
+}
+
 void
-RenderBuffer::DefinePosition(const size_t aOffset, const GLsizei aLength) {
+RenderBuffer::DefinePosition(const size_t aOffset, const GLsizei aLength, const GLenum aType, const bool aNormalized) {
   m.positionOffset = aOffset;
   m.positionLength = aLength;
+  m.positionType = aType;
+  m.positionNormalized = aNormalized;
 }
 
 size_t
@@ -114,10 +217,22 @@ RenderBuffer::PositionSize() const {
   return m.PositionSize();
 }
 
+GLenum
+RenderBuffer::PositionType() const {
+  return m.positionType;
+}
+
+GLboolean
+RenderBuffer::PositionNormalized() const {
+  return m.positionNormalized ? GL_TRUE : GL_FALSE;
+}
+
 void
-RenderBuffer::DefineNormal(const size_t aOffset, const GLsizei aLength) {
+RenderBuffer::DefineNormal(const size_t aOffset, const GLsizei aLength, const GLenum aType, const bool aNormalized) {
   m.normalOffset = aOffset;
   m.normalLength = aLength;
+  m.normalType = aType;
+  m.normalNormalized = aNormalized;
 }
 
 size_t
@@ -135,10 +250,22 @@ RenderBuffer::NormalSize() const {
   return m.NormalSize();
 }
 
+GLenum
+RenderBuffer::NormalType() const {
+  return m.normalType;
+}
+
+GLboolean
+RenderBuffer::NormalNormalized() const {
+  return m.normalNormalized ? GL_TRUE : GL_FALSE;
+}
+
 void
-RenderBuffer::DefineUV(const size_t aOffset, const GLsizei aLength) {
+RenderBuffer::DefineUV(const size_t aOffset, const GLsizei aLength, const GLenum aType, const bool aNormalized) {
   m.uvOffset = aOffset;
   m.uvLength = aLength;
+  m.uvType = aType;
+  m.uvNormalized = aNormalized;
 }
 
 size_t
@@ -156,10 +283,22 @@ RenderBuffer::UVSize() const {
   return m.UVSize();
 }
 
+GLenum
+RenderBuffer::UVType() const {
+  return m.uvType;
+}
+
+GLboolean
+RenderBuffer::UVNormalized() const {
+  return m.uvNormalized ? GL_TRUE : GL_FALSE;
+}
+
 void
-RenderBuffer::DefineColor(const size_t aOffset, const GLsizei aLength) {
+RenderBuffer::DefineColor(const size_t aOffset, const GLsizei aLength, const GLenum aType, const bool aNormalized) {
   m.colorOffset = aOffset;
   m.colorLength = aLength;
+  m.colorType = aType;
+  m.colorNormalized = aNormalized;
 }
 
 size_t
@@ -177,6 +316,82 @@ RenderBuffer::ColorSize() const {
   return m.ColorSize();
 }
 
+GLenum
+RenderBuffer::ColorType() const {
+  return m.colorType;
+}
+
+GLboolean
+RenderBuffer::ColorNormalized() const {
+  return m.colorNormalized ? GL_TRUE : GL_FALSE;
+}
+
+void
+RenderBuffer::DefineJoint(const size_t aOffset, const GLsizei aLength, const GLenum aType, const bool aNormalized) {
+  m.jointOffset = aOffset;
+  m.jointLength = aLength;
+  m.jointType = aType;
+  m.jointNormalized = aNormalized;
+}
+
+size_t
+RenderBuffer::JointOffset() const {
+  return m.jointOffset;
+}
+
+GLsizei
+RenderBuffer::JointLength() const {
+  return m.jointLength;
+}
+
+GLsizei
+RenderBuffer::JointSize() const {
+  return m.JointSize();
+}
+
+GLenum
+RenderBuffer::JointType() const {
+  return m.jointType;
+}
+
+GLboolean
+RenderBuffer::JointNormalized() const {
+  return m.jointNormalized ? GL_TRUE : GL_FALSE;
+}
+
+void
+RenderBuffer::DefineWeight(const size_t aOffset, const GLsizei aLength, const GLenum aType, const bool aNormalized) {
+  m.weightOffset = aOffset;
+  m.weightLength = aLength;
+  m.weightType = aType;
+  m.weightNormalized = aNormalized;
+}
+
+size_t
+RenderBuffer::WeightOffset() const {
+  return m.weightOffset;
+}
+
+GLsizei
+RenderBuffer::WeightLength() const {
+  return m.weightLength;
+}
+
+GLsizei
+RenderBuffer::WeightSize() const {
+  return m.WeightSize();
+}
+
+GLenum
+RenderBuffer::WeightType() const {
+  return m.weightType;
+}
+
+GLboolean
+RenderBuffer::WeightNormalized() const {
+  return m.weightNormalized ? GL_TRUE : GL_FALSE;
+}
+
 void
 RenderBuffer::Bind() {
   VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.vertexObjectId));
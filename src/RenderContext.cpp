@@ -5,6 +5,7 @@
 
 #include "vrb/RenderContext.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/private/Clock.h"
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/private/UpdatableState.h"
 
@@ -17,25 +18,55 @@
 #  include "vrb/FileReaderBasic.h"
 #endif // defined(ANDROID)
 #include "vrb/DataCache.h"
+#include "vrb/FBOPool.h"
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/GLError.h"
 #include "vrb/GLExtensions.h"
+#include "vrb/GLStats.h"
+#include "vrb/Group.h"
+#include "vrb/JobSystem.h"
+#include "vrb/KTX2Decoder.h"
 #include "vrb/Logger.h"
+#include "vrb/MaterialRegistry.h"
+#include "vrb/MemoryCounter.h"
+#include "vrb/ModelCache.h"
+#include "vrb/Node.h"
 #include "vrb/ProgramFactory.h"
 #include "vrb/ResourceGL.h"
+#include "vrb/SamplerCache.h"
+#include "vrb/StreamBuffer.h"
 #if defined(ANDROID)
 #  include "vrb/SurfaceTextureFactory.h"
 #endif // defined(ANDROID)
 #include "vrb/TextureCache.h"
+#include "vrb/TextureDiskCache.h"
 #include "vrb/ThreadIdentity.h"
+#include "vrb/TraceProfiler.h"
+#include "vrb/TransformAnimator.h"
 #include "vrb/Updatable.h"
 #if defined(ANDROID)
 #  include <EGL/egl.h>
 #endif // defined(ANDROID)
+#include <algorithm>
+#include <iterator>
 #include <pthread.h>
-#include <time.h>
+#include <stdio.h>
+#include <string>
 #include <vector>
 
 namespace {
 const double kNanosecondsToSeconds = 1.0e9;
+const double kDefaultDisposalBudget = 0.001;
+
+const char* kStartupPhaseNames[] = {
+  "Startup::Create",
+  "Startup::InitializeGL",
+  "Startup::FirstUpdate",
+  "Startup::FirstFrame"
+};
+const int kStartupPhaseCount = (int)vrb::RenderContext::StartupPhase::Count;
+static_assert(sizeof(kStartupPhaseNames) / sizeof(kStartupPhaseNames[0]) == kStartupPhaseCount,
+              "A startup phase is missing a name");
 }
 
 namespace vrb {
@@ -43,10 +74,19 @@ namespace vrb {
 struct RenderContext::State {
   ThreadIdentityPtr threadSelf;
   TextureCachePtr textureCache;
+  TextureDiskCachePtr textureDiskCache;
   ProgramFactoryPtr programFactory;
   DataCachePtr dataCache;
+  JobSystemPtr jobSystem;
+  KTX2DecoderPtr ktx2Decoder;
+  TransformAnimatorPtr transformAnimator;
   CreationContextPtr creationContext;
   GLExtensionsPtr glExtensions;
+  FBOPoolPtr fboPool;
+  StreamBufferPtr streamBuffer;
+  GLDeletionQueuePtr glDeletions;
+  MaterialRegistryPtr materials;
+  SamplerCachePtr samplers;
 #if defined(ANDROID)
   EGLContext eglContext;
   FileReaderAndroidPtr fileReader;
@@ -59,30 +99,135 @@ struct RenderContext::State {
   ResourceGLList uninitializedResources;
   ResourceGLList resources;
   std::vector<ContextSynchronizerPtr> synchronizers;
+  // Nodes waiting to be torn down by Update(), see Dispose().
+  std::vector<NodePtr> disposed;
+  std::vector<std::weak_ptr<ModelCache>> modelCaches;
+  double disposalBudget;
   double timestamp;
   double frameDelta;
+  double resourceBudget;
+  bool recovering;
+  double recoveryStart;
+  double recoveryTime;
+  // Trace times in nanoseconds, zero until the phase is reached.
+  uint64_t startupBegin;
+  uint64_t startup[kStartupPhaseCount];
+  int updatesSinceGL;
+  GLStats glStats;
+  // GL state of the application when the first offscreen render of an
+  // Update() started, see OffscreenRenderScope.
+  struct OffscreenGLState {
+    bool saved;
+    GLint framebuffer;
+    GLint viewport[4];
+    GLint scissorTest;
+    GLint depthTest;
+    GLint depthMask;
+    GLfloat clearColor[4];
+  } offscreen;
   State();
+  void MarkStartup(const StartupPhase aPhase);
+  void DisposeWithBudget();
 };
 
 RenderContext::State::State()
     : threadSelf(ThreadIdentity::Create())
+    , textureCache(TextureCache::Create())
+    , textureDiskCache(TextureDiskCache::Create())
+    , programFactory(ProgramFactory::Create())
+    , dataCache(DataCache::Create())
+    , jobSystem(JobSystem::Create())
+    , ktx2Decoder(KTX2Decoder::Create())
+    , transformAnimator(TransformAnimator::Create())
+    , glDeletions(GLDeletionQueue::Create())
+    , materials(MaterialRegistry::Create())
 #if defined(ANDROID)
     , eglContext(EGL_NO_CONTEXT)
 #endif // defined(ANDROID)
-    , dataCache(DataCache::Create())
-    , textureCache(TextureCache::Create())
-    , programFactory(ProgramFactory::Create())
+    , disposalBudget(kDefaultDisposalBudget)
     , timestamp(0.0)
     , frameDelta(0.0)
+    , resourceBudget(0.0)
+    , recovering(false)
+    , recoveryStart(0.0)
+    , recoveryTime(0.0)
+    , startupBegin(0)
+    , startup()
+    , updatesSinceGL(-1)
+    , offscreen()
 {}
 
+void
+RenderContext::State::MarkStartup(const StartupPhase aPhase) {
+  const int kIndex = (int)aPhase;
+  if (startup[kIndex] != 0) {
+    return;
+  }
+  startup[kIndex] = TraceGetTime();
+  const uint64_t kStart = kIndex > 0 ? startup[kIndex - 1] : startupBegin;
+  // Each zone covers the time since the previous phase.
+  TraceAddEvent(kStartupPhaseNames[kIndex], kStart, startup[kIndex]);
+  if (aPhase != StartupPhase::FirstFrame) {
+    return;
+  }
+  std::string timeline;
+  for (int ix = 0; ix < kStartupPhaseCount; ix++) {
+    char entry[64] = {};
+    snprintf(entry, sizeof(entry), " %s %.1f ms", kStartupPhaseNames[ix],
+             (double)(startup[ix] - startupBegin) / 1.0e6);
+    timeline += entry;
+  }
+  VRB_LOG("Startup timeline:%s", timeline.c_str());
+}
+
+void
+RenderContext::State::DisposeWithBudget() {
+  if (disposed.empty()) {
+    return;
+  }
+  const double kDeadline = disposalBudget > 0.0 ? GetMonotonicSeconds() + disposalBudget : 0.0;
+  bool first = true;
+  while (!disposed.empty()) {
+    if (!first && (kDeadline > 0.0) && (GetMonotonicSeconds() >= kDeadline)) {
+      return;
+    }
+    first = false;
+    NodePtr node = std::move(disposed.back());
+    disposed.pop_back();
+    // Nodes with other owners are only released.
+    if (node.use_count() > 1) {
+      continue;
+    }
+    // The children of a Group are queued instead of destroyed with it, so
+    // a large subtree is torn down over several frames.
+    GroupPtr group = std::dynamic_pointer_cast<Group>(node);
+    const int32_t kCount = group ? group->GetNodeCount() : 0;
+    if (kCount == 0) {
+      continue;
+    }
+    std::vector<NodePtr> children;
+    children.reserve((size_t)kCount);
+    for (int32_t ix = 0; ix < kCount; ix++) {
+      children.push_back(group->GetNode((uint32_t)ix));
+    }
+    group->RemoveNodes(children);
+    disposed.insert(disposed.end(), std::make_move_iterator(children.begin()),
+                    std::make_move_iterator(children.end()));
+  }
+}
+
 RenderContextPtr
 RenderContext::Create() {
+  const uint64_t kBegin = TraceGetTime();
   RenderContextPtr result = std::make_shared<ConcreteClass<RenderContext, RenderContext::State> >();
+  result->m.startupBegin = kBegin;
+  result->m.glExtensions = GLExtensions::Create(result);
+  result->m.fboPool = FBOPool::Create(result);
+  result->m.streamBuffer = StreamBuffer::Create(result);
+  result->m.samplers = SamplerCache::Create(result);
   result->m.creationContext = CreationContext::Create(result);
   result->m.creationContext->BindToThread();
   result->m.textureCache->Init(result->m.creationContext);
-  result->m.glExtensions = GLExtensions::Create(result);
 #if defined(ANDROID)
   result->m.surfaceTextureFactory = SurfaceTextureFactory::Create(result->m.creationContext);
   result->m.fileReader = FileReaderAndroid::Create();
@@ -90,7 +235,10 @@ RenderContext::Create() {
 #else
   result->m.fileReader = FileReaderBasic::Create();
 #endif // defined(ANDROID)
+  result->m.ktx2Decoder->SetJobSystem(result->m.jobSystem);
+  result->m.fileReader->SetKTX2Decoder(result->m.ktx2Decoder);
   result->m.creationContext->SetFileReader(result->m.fileReader);
+  result->m.MarkStartup(StartupPhase::Created);
   return result;
 }
 
@@ -99,7 +247,7 @@ void
 RenderContext::InitializeJava(JNIEnv* aEnv, jobject& aActivity, jobject& aAssetManager) {
   if (m.classLoader) { m.classLoader->Init(aEnv, aActivity); }
   if (m.fileReader) { m.fileReader->Init(aEnv, aAssetManager, m.classLoader); }
-  if (m.surfaceTextureFactory) { m.surfaceTextureFactory->InitializeJava(aEnv); }
+  if (m.surfaceTextureFactory) { m.surfaceTextureFactory->InitializeJava(aEnv, m.classLoader); }
 }
 
 void
@@ -128,26 +276,64 @@ RenderContext::InitializeGL() {
   }
   m.eglContext = current;
 #endif // defined(ANDROID)
-  m.resources.InitializeGL();
   m.glExtensions->Initialize();
+  m.programFactory->SetParallelCompileEnabled(
+      m.glExtensions->IsExtensionSupported(GLExtensions::Ext::KHR_parallel_shader_compile));
+  m.programFactory->SetMultiviewSupported(
+      m.glExtensions->IsExtensionSupported(GLExtensions::Ext::OVR_multiview2));
+  m.ktx2Decoder->SetTarget(KTX2Decoder::SelectTarget(*m.glExtensions));
+  if (m.glExtensions->IsExtensionSupported(GLExtensions::Ext::KHR_debug)) {
+    GLErrorEnableDebugOutput(m.glExtensions->GetFunctions().glDebugMessageCallbackKHR);
+  }
+  m.streamBuffer->InitializeGL();
+  m.samplers->InitializeGL();
+  if (m.updatesSinceGL < 0) {
+    m.updatesSinceGL = 0;
+  }
+  if ((m.resourceBudget <= 0.0) || !m.resources.IsDirty()) {
+    m.resources.InitializeGL();
+    m.MarkStartup(StartupPhase::GLInitialized);
+    return true;
+  }
+  // The resources of the lost context go back to the uninitialized list,
+  // ahead of those created since, and Update() recreates them with the
+  // budget. Programs flag themselves as priority in ShutdownGL() and
+  // visible Geometry does when culled.
+  m.recovering = true;
+  m.recoveryStart = GetMonotonicSeconds();
+  if (m.uninitializedResources.IsDirty()) {
+    m.resources.AppendAndAdoptList(m.uninitializedResources);
+  }
+  m.uninitializedResources.AppendAndAdoptList(m.resources);
+  m.MarkStartup(StartupPhase::GLInitialized);
   return true;
 }
 
 void
 RenderContext::ShutdownGL() {
+  m.fboPool->Clear();
+  m.streamBuffer->ShutdownGL();
+  m.samplers->ShutdownGL();
   m.resources.ShutdownGL();
+  m.glDeletions->ShutdownGL();
 }
 
 void
 RenderContext::Update() {
-  timespec spec = {};
-  if (clock_gettime(CLOCK_MONOTONIC, &spec) == 0) {
-    double nextTimestamp = (double)spec.tv_sec + (spec.tv_nsec / kNanosecondsToSeconds);
+  const double nextTimestamp = GetMonotonicSeconds();
+  if (nextTimestamp != 0.0) {
     if (m.timestamp != 0.0) {
       m.frameDelta = nextTimestamp - m.timestamp;
     }
     m.timestamp = nextTimestamp;
   }
+  // Everything counted since the previous Update belongs to the previous frame.
+  GLStatsEndFrame(m.glStats);
+  GLErrorCheckFrame();
+  m.streamBuffer->NextFrame();
+  // The application may have changed it since the previous Update().
+  m.offscreen.saved = false;
+  m.glDeletions->Update();
   m.creationContext->Synchronize();
   for(auto iter = m.synchronizers.begin(); iter != m.synchronizers.end();) {
     bool active = true;
@@ -158,10 +344,115 @@ RenderContext::Update() {
       iter++;
     }
   }
-  if (m.uninitializedResources.Update()) {
-    m.resources.AppendAndAdoptList(m.uninitializedResources);
+  if (m.uninitializedResources.IsDirty()) {
+    // Resources over budget stay in the list for the next frame.
+    m.uninitializedResources.Update(m.resources, m.resourceBudget);
+  }
+  if (m.recovering && !m.uninitializedResources.IsDirty()) {
+    m.recovering = false;
+    m.recoveryTime = GetMonotonicSeconds() - m.recoveryStart;
+    VRB_LOG("GL context recovered in %.1f ms", m.recoveryTime * 1000.0);
   }
   m.updatables.UpdateResource(*this);
+  m.transformAnimator->Update(m.timestamp);
+  m.textureCache->Update();
+  m.samplers->Update();
+  m.DisposeWithBudget();
+  if ((m.updatesSinceGL >= 0) && (m.updatesSinceGL < 2)) {
+    m.updatesSinceGL++;
+    m.MarkStartup(m.updatesSinceGL == 1 ? StartupPhase::FirstUpdate : StartupPhase::FirstFrame);
+  }
+}
+
+void
+RenderContext::Dispose(NodePtr aNode) {
+  if (!aNode) {
+    return;
+  }
+  aNode->RemoveFromParents();
+  m.disposed.push_back(std::move(aNode));
+}
+
+/* static */ RenderContext::MemoryPressure
+RenderContext::GetMemoryPressure(const int aTrimLevel) {
+  // TRIM_MEMORY_RUNNING_MODERATE is 5, RUNNING_LOW 10, RUNNING_CRITICAL 15,
+  // UI_HIDDEN 20, BACKGROUND 40, MODERATE 60 and COMPLETE 80.
+  if ((aTrimLevel >= 60) || (aTrimLevel == 15)) {
+    return MemoryPressure::Critical;
+  } else if ((aTrimLevel >= 40) || (aTrimLevel == 10)) {
+    return MemoryPressure::Low;
+  }
+  return MemoryPressure::Moderate;
+}
+
+size_t
+RenderContext::TrimMemory(const MemoryPressure aPressure) {
+  const int64_t kBefore = GetCPUMemoryUsage() + GetGPUMemoryUsage();
+  m.textureCache->ReleaseImageData();
+  if (aPressure >= MemoryPressure::Low) {
+    m.textureCache->EvictUnused();
+    m.fboPool->Trim();
+    const double kBudget = m.disposalBudget;
+    m.disposalBudget = 0.0;
+    m.DisposeWithBudget();
+    m.disposalBudget = kBudget;
+  }
+  if (aPressure >= MemoryPressure::Critical) {
+    for (std::weak_ptr<ModelCache>& weak: m.modelCaches) {
+      ModelCachePtr cache = weak.lock();
+      if (cache) {
+        cache->Clear();
+      }
+    }
+    m.modelCaches.erase(std::remove_if(m.modelCaches.begin(), m.modelCaches.end(), [](const std::weak_ptr<ModelCache>& aCache) {
+      return aCache.expired();
+    }), m.modelCaches.end());
+  }
+  const int64_t kFreed = kBefore - (GetCPUMemoryUsage() + GetGPUMemoryUsage());
+  const size_t kResult = kFreed > 0 ? (size_t)kFreed : 0;
+  VRB_LOG("RenderContext::TrimMemory(%d) freed %.1f MB", (int)aPressure, (double)kResult / (1024.0 * 1024.0));
+  return kResult;
+}
+
+void
+RenderContext::AddModelCache(const ModelCachePtr& aCache) {
+  if (aCache) {
+    m.modelCaches.push_back(aCache);
+  }
+}
+
+void
+RenderContext::SetDisposalBudget(const double aSeconds) {
+  m.disposalBudget = aSeconds;
+}
+
+void
+RenderContext::SetResourceInitializationBudget(const double aSeconds) {
+  m.resourceBudget = aSeconds;
+}
+
+double
+RenderContext::GetResourceInitializationBudget() const {
+  return m.resourceBudget;
+}
+
+bool
+RenderContext::IsRecoveringContext() const {
+  return m.recovering;
+}
+
+double
+RenderContext::GetContextRecoveryTime() const {
+  return m.recoveryTime;
+}
+
+double
+RenderContext::GetStartupTime(const StartupPhase aPhase) const {
+  const int kIndex = (int)aPhase;
+  if ((kIndex < 0) || (kIndex >= kStartupPhaseCount) || (m.startup[kIndex] == 0)) {
+    return -1.0;
+  }
+  return (double)(m.startup[kIndex] - m.startupBegin) / kNanosecondsToSeconds;
 }
 
 double
@@ -174,6 +465,11 @@ RenderContext::GetFrameDelta() {
   return m.frameDelta;
 }
 
+const GLStats&
+RenderContext::GetGLStats() const {
+  return m.glStats;
+}
+
 ThreadIdentityPtr&
 RenderContext::GetRenderThreadIdentity() {
   return m.threadSelf;
@@ -184,11 +480,31 @@ RenderContext::GetDataCache() {
   return m.dataCache;
 }
 
+JobSystemPtr&
+RenderContext::GetJobSystem() {
+  return m.jobSystem;
+}
+
+KTX2DecoderPtr&
+RenderContext::GetKTX2Decoder() {
+  return m.ktx2Decoder;
+}
+
+TransformAnimatorPtr&
+RenderContext::GetTransformAnimator() {
+  return m.transformAnimator;
+}
+
 TextureCachePtr&
 RenderContext::GetTextureCache() {
   return m.textureCache;
 }
 
+TextureDiskCachePtr&
+RenderContext::GetTextureDiskCache() {
+  return m.textureDiskCache;
+}
+
 ProgramFactoryPtr&
 RenderContext::GetProgramFactory() {
   return m.programFactory;
@@ -205,6 +521,31 @@ RenderContext::GetGLExtensions() const {
   return m.glExtensions;
 }
 
+FBOPoolPtr&
+RenderContext::GetFBOPool() {
+  return m.fboPool;
+}
+
+StreamBufferPtr&
+RenderContext::GetStreamBuffer() {
+  return m.streamBuffer;
+}
+
+GLDeletionQueuePtr&
+RenderContext::GetGLDeletionQueue() {
+  return m.glDeletions;
+}
+
+MaterialRegistryPtr&
+RenderContext::GetMaterialRegistry() {
+  return m.materials;
+}
+
+SamplerCachePtr&
+RenderContext::GetSamplerCache() {
+  return m.samplers;
+}
+
 #if defined(ANDROID)
 SurfaceTextureFactoryPtr
 RenderContext::GetSurfaceTextureFactory() {
@@ -234,6 +575,43 @@ RenderContext::RegisterContextSynchronizer(ContextSynchronizerPtr& aSynchronizer
   m.synchronizers.push_back(aSynchronizer);
 }
 
+void
+RenderContext::SaveOffscreenGLState() {
+  State::OffscreenGLState& saved = m.offscreen;
+  if (saved.saved) {
+    return;
+  }
+  VRB_GL_CHECK(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &saved.framebuffer));
+  VRB_GL_CHECK(glGetIntegerv(GL_VIEWPORT, saved.viewport));
+  VRB_GL_CHECK(glGetIntegerv(GL_SCISSOR_TEST, &saved.scissorTest));
+  VRB_GL_CHECK(glGetIntegerv(GL_DEPTH_TEST, &saved.depthTest));
+  VRB_GL_CHECK(glGetIntegerv(GL_DEPTH_WRITEMASK, &saved.depthMask));
+  VRB_GL_CHECK(glGetFloatv(GL_COLOR_CLEAR_VALUE, saved.clearColor));
+  saved.saved = true;
+}
+
+void
+RenderContext::RestoreOffscreenGLState() {
+  const State::OffscreenGLState& saved = m.offscreen;
+  if (!saved.saved) {
+    return;
+  }
+  VRB_GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)saved.framebuffer));
+  VRB_GL_CHECK(glViewport(saved.viewport[0], saved.viewport[1], saved.viewport[2], saved.viewport[3]));
+  if (saved.scissorTest) {
+    VRB_GL_CHECK(glEnable(GL_SCISSOR_TEST));
+  } else {
+    VRB_GL_CHECK(glDisable(GL_SCISSOR_TEST));
+  }
+  if (saved.depthTest) {
+    VRB_GL_CHECK(glEnable(GL_DEPTH_TEST));
+  } else {
+    VRB_GL_CHECK(glDisable(GL_DEPTH_TEST));
+  }
+  VRB_GL_CHECK(glDepthMask(saved.depthMask ? GL_TRUE : GL_FALSE));
+  VRB_GL_CHECK(glClearColor(saved.clearColor[0], saved.clearColor[1], saved.clearColor[2], saved.clearColor[3]));
+}
+
 RenderContext::RenderContext(State& aState) : m(aState) {}
 RenderContext::~RenderContext() {}
 
@@ -0,0 +1,278 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/RenderLayer.h"
+#include "vrb/private/GroupState.h"
+#include "vrb/private/ResourceGLState.h"
+#include "vrb/private/UpdatableState.h"
+
+#include "vrb/Bounds.h"
+#include "vrb/CameraSimple.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/CullVisitor.h"
+#include "vrb/DrawableList.h"
+#include "vrb/FBO.h"
+#include "vrb/FBOPool.h"
+#include "vrb/GLError.h"
+#include "vrb/Geometry.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/OffscreenRenderScope.h"
+#include "vrb/OffscreenTexture.h"
+#include "vrb/ProgramFactory.h"
+#include "vrb/RenderContext.h"
+#include "vrb/RenderState.h"
+#include "vrb/Texture.h"
+#include "vrb/TraceProfiler.h"
+#include "vrb/VertexArray.h"
+
+#include <cmath>
+
+namespace {
+
+// Renders are taken from this many bounding radii away, close enough to
+// orthographic that the quad matches the children at any angle.
+const float kRenderDistance = 10.0f;
+
+}
+
+namespace vrb {
+
+struct RenderLayer::State : public Group::State, public ResourceGL::State, public Updatable::State {
+  RenderContextWeak context;
+  int32_t width;
+  int32_t height;
+  bool dirty;
+  // Set by Cull, cleared by the next update.
+  bool seen;
+  bool rendered;
+  bool showing;
+  uint32_t renderedRevision;
+  uint32_t renderCount;
+  // Placement of the quad for the bounds of the last render.
+  Matrix quadTransform;
+  FBOPtr fbo;
+  OffscreenTexturePtr texture;
+  GeometryPtr quad;
+  CameraSimplePtr camera;
+  CullVisitorPtr visitor;
+  DrawableListPtr drawables;
+
+  State()
+      : width(512)
+      , height(512)
+      , dirty(true)
+      , seen(false)
+      , rendered(false)
+      , showing(false)
+      , renderedRevision(0)
+      , renderCount(0)
+      , quadTransform(Matrix::Identity())
+  {}
+
+  void Acquire() {
+    RenderContextPtr render = context.lock();
+    if (!render) {
+      return;
+    }
+    // Every render clears the whole target.
+    FBO::Attributes attributes;
+    attributes.invalidateOnBind = true;
+    fbo = render->GetFBOPool()->Acquire(width, height, attributes);
+    if (!fbo) {
+      VRB_ERROR("RenderLayer failed to acquire a %dx%d render target", width, height);
+      return;
+    }
+    texture->SetTextureHandle(fbo->GetTextureHandle());
+    dirty = true;
+  }
+
+  void Release() {
+    if (fbo) {
+      RenderContextPtr render = context.lock();
+      if (render) {
+        render->GetFBOPool()->Release(fbo);
+      }
+      fbo = nullptr;
+    }
+    if (texture) {
+      texture->SetTextureHandle(0);
+    }
+    rendered = false;
+  }
+
+  // Culls the children as seen from +Z and draws them into the whole target,
+  // with the front face of aBounds filling it.
+  void Render(RenderLayer& aLayer, const Bounds& aBounds) {
+    const Vector kCenter = aBounds.Center();
+    const Vector kExtents = aBounds.Extents();
+    const float kDistance = kExtents.Magnitude() * kRenderDistance;
+    const float kFront = kDistance - kExtents.z();
+    camera->SetViewport(width, height);
+    camera->SetFieldOfView(2.0f * std::atan(kExtents.x() / kFront) * ToDegrees,
+                           2.0f * std::atan(kExtents.y() / kFront) * ToDegrees);
+    camera->SetClipRange(kFront * 0.99f, (kDistance + kExtents.z()) * 1.01f);
+    camera->SetTransform(Matrix::Translation(kCenter + Vector(0.0f, 0.0f, kDistance)));
+    visitor->Reset();
+    visitor->SetFrustum(camera->GetFrustum());
+    visitor->SetCamera(*camera);
+    drawables->Reset();
+    aLayer.CullChildren(*visitor, *drawables);
+
+    VRB_GL_CHECK(glViewport(0, 0, width, height));
+    VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    drawables->Draw(*camera);
+    drawables->Reset();
+    quadTransform = Matrix::FromTranslationScale(
+        Vector(kCenter.x(), kCenter.y(), kCenter.z() + kExtents.z()),
+        Vector(kExtents.x(), kExtents.y(), 1.0f));
+    rendered = true;
+    renderCount++;
+  }
+};
+
+RenderLayerPtr
+RenderLayer::Create(RenderContextPtr& aContext) {
+  RenderLayerPtr result = std::make_shared<ConcreteClass<RenderLayer, RenderLayer::State> >(aContext);
+  result->m.self = result;
+  return result;
+}
+
+// Node interface
+void
+RenderLayer::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  VRB_TRACE_ZONE("RenderLayer::Cull");
+  if (!aVisitor.IsVisible(GetBounds())) {
+    return;
+  }
+  m.seen = true;
+  m.showing = m.rendered;
+  if (!m.rendered) {
+    CullChildren(aVisitor, aDrawables);
+    return;
+  }
+  aVisitor.PushAffineTransform(m.quadTransform);
+  m.quad->Cull(aVisitor, aDrawables);
+  aVisitor.PopTransform();
+}
+
+void
+RenderLayer::Flatten(SceneSnapshot& aSnapshot) {
+  // The quad or the children are picked on every Cull.
+  Node::Flatten(aSnapshot);
+}
+
+// RenderLayer interface
+void
+RenderLayer::SetResolution(const int32_t aWidth, const int32_t aHeight) {
+  if ((aWidth < 1) || (aHeight < 1)) {
+    VRB_ERROR("RenderLayer::SetResolution invalid size: %dx%d", aWidth, aHeight);
+    return;
+  }
+  if ((aWidth == m.width) && (aHeight == m.height)) {
+    return;
+  }
+  m.width = aWidth;
+  m.height = aHeight;
+  if (m.fbo) {
+    m.Release();
+    m.Acquire();
+  }
+}
+
+void
+RenderLayer::Invalidate() {
+  m.dirty = true;
+}
+
+uint32_t
+RenderLayer::GetRenderCount() const {
+  return m.renderCount;
+}
+
+bool
+RenderLayer::IsShowingLayer() const {
+  return m.showing;
+}
+
+RenderLayer::RenderLayer(State& aState, RenderContextPtr& aContext)
+    : Group(aState, aContext->GetRenderThreadCreationContext())
+    , ResourceGL(aState, aContext->GetRenderThreadCreationContext())
+    , Updatable(aState, aContext->GetRenderThreadCreationContext())
+    , m(aState) {
+  CreationContextPtr& create = aContext->GetRenderThreadCreationContext();
+  m.context = aContext;
+  m.texture = OffscreenTexture::Create(create);
+  m.texture->SetName("RenderLayer texture");
+  m.camera = CameraSimple::Create(create);
+  m.visitor = CullVisitor::Create(create);
+  m.drawables = DrawableList::Create(create);
+
+  VertexArrayPtr array = VertexArray::Create(create);
+  const float kCorners[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+  for (const auto& corner: kCorners) {
+    array->AppendVertex(Vector(corner[0], corner[1], 0.0f));
+    array->AppendUV(Vector((corner[0] + 1.0f) * 0.5f, (corner[1] + 1.0f) * 0.5f, 0.0f));
+  }
+  array->AppendNormal(Vector(0.0f, 0.0f, 1.0f));
+  ProgramPtr program = aContext->GetProgramFactory()->CreateProgram(create, FeatureTexture);
+  RenderStatePtr state = RenderState::Create(create);
+  state->SetProgram(program);
+  state->SetTexture(m.texture);
+  state->SetLightsEnabled(false);
+  // The target is cleared to transparent around the children.
+  state->SetTransparent(true);
+  m.quad = Geometry::Create(create);
+  m.quad->SetVertexArray(array);
+  m.quad->SetRenderState(state);
+  m.quad->AddFace({1, 2, 3, 4}, {1, 2, 3, 4}, {1, 1, 1, 1});
+}
+
+RenderLayer::~RenderLayer() {
+  m.Release();
+}
+
+// ResourceGL interface
+void
+RenderLayer::InitializeGL() {
+  m.Acquire();
+}
+
+void
+RenderLayer::ShutdownGL() {
+  m.Release();
+}
+
+// Updatable interface
+void
+RenderLayer::UpdateResource(RenderContext& aContext) {
+  if (GetRevision() != m.renderedRevision) {
+    m.dirty = true;
+    m.renderedRevision = GetRevision();
+  }
+  const bool kSeen = m.seen;
+  m.seen = false;
+  if (!m.fbo || !m.dirty || !kSeen) {
+    return;
+  }
+  m.dirty = false;
+  const Bounds& kBounds = GetBounds();
+  const Vector kExtents = kBounds.Extents();
+  if (kBounds.IsEmpty() || kBounds.IsInfinite() || (kExtents.x() <= 0.0f) || (kExtents.y() <= 0.0f)) {
+    // Nothing a quad could stand for, the children are drawn instead.
+    m.rendered = false;
+    return;
+  }
+  VRB_TRACE_ZONE("RenderLayer::Render");
+
+  {
+    OffscreenRenderScope scope(aContext, *m.fbo);
+    m.Render(*this, kBounds);
+  }
+  // Culling the children may update their state, see Group::CullChildren().
+  m.renderedRevision = GetRevision();
+}
+
+} // namespace vrb
@@ -5,71 +5,129 @@
 
 #include "vrb/RenderState.h"
 #include "vrb/private/ResourceGLState.h"
+#include "vrb/private/PoolAllocator.h"
 
 #include "vrb/BasicShaders.h"
+#include "vrb/Bounds.h"
+#include "vrb/Camera.h"
 #include "vrb/Color.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
 #include "vrb/Logger.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLError.h"
+#include "vrb/LightBlock.h"
 #include "vrb/Matrix.h"
 #include "vrb/Program.h"
+#include "vrb/SamplerCache.h"
 #include "vrb/ShaderUtil.h"
+#include "vrb/Skeleton.h"
 #include "vrb/Texture.h"
 #include "vrb/Vector.h"
 
 #include "vrb/gl.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <vrb/ProgramFactory.h>
 
+namespace {
+
+// GL bindings made by RenderState::Enable. Drawing only happens on the render
+// thread, so this tracks the bindings of the context current on that thread.
+struct BoundState {
+  GLuint program = 0;
+  const vrb::Texture* texture = nullptr;
+  GLuint textureHandle = 0;
+  // Bound to texture unit 0 with the texture, see SamplerCache.
+  GLuint sampler = 0;
+  // Lights of the block last uploaded to the bound program.
+  bool lightsValid = false;
+  const vrb::LightBlock* lights = nullptr;
+  uint64_t lightsHash = 0;
+  int lightCount = 0;
+  uint32_t lightIndices[VRB_MAX_LIGHTS] = {};
+  // Buffer bound to VRB_MATERIAL_BLOCK_BINDING.
+  GLuint materialBuffer = 0;
+};
+
+// std140 layout of the vrb_Material block.
+struct MaterialBlock {
+  float ambient[4];
+  float diffuse[4];
+  float specular[4];
+  float specularExponent;
+  float padding[3];
+  float tintColor[4];
+};
+static_assert(sizeof(MaterialBlock) == 80, "MaterialBlock must match the std140 layout of vrb_Material");
+
+thread_local BoundState sBound;
+thread_local bool sDepthOnly = false;
+std::atomic<int> sQualityTier(0);
+
+// Fallbacks must draw the same vertex layout as the program they replace.
+const uint32_t kLayoutFeatures = vrb::FeatureInstancing | vrb::FeatureSkinning;
+// Features of the program kept by its FeatureDepthOnly variant.
+const uint32_t kDepthOnlyFeatures = kLayoutFeatures | vrb::FeatureMultiview | vrb::FeatureLateLatch;
+
+// Fills aIndices with the lights of aBlock reaching aBounds, at most
+// VRB_MAX_LIGHTS of them, and returns their count. Directional lights come
+// first and point lights follow by distance relative to their range. Lights
+// with the same score keep the order of the block.
+int
+SelectLights(const vrb::LightBlock& aBlock, const vrb::Bounds& aBounds, uint32_t* aIndices) {
+  float scores[VRB_MAX_LIGHTS];
+  int count = 0;
+  for (uint32_t ix = 0; ix < (uint32_t)aBlock.lights.size(); ix++) {
+    const vrb::LightBlock::Entry& kLight = aBlock.lights[ix];
+    float score = 0.0f;
+    if (kLight.range > 0.0f) {
+      const float kRangeSquared = kLight.range * kLight.range;
+      const float kDistanceSquared = aBounds.DistanceSquared(kLight.position);
+      if (kDistanceSquared >= kRangeSquared) {
+        continue;
+      }
+      score = kDistanceSquared / kRangeSquared;
+    }
+    if ((count == VRB_MAX_LIGHTS) && (score >= scores[count - 1])) {
+      continue;
+    }
+    int slot = count < VRB_MAX_LIGHTS ? count++ : count - 1;
+    while ((slot > 0) && (scores[slot - 1] > score)) {
+      scores[slot] = scores[slot - 1];
+      aIndices[slot] = aIndices[slot - 1];
+      slot--;
+    }
+    scores[slot] = score;
+    aIndices[slot] = ix;
+  }
+  return count;
+}
+
+}
+
 namespace vrb {
 
 struct RenderState::State : public ResourceGL::State {
-  struct Light {
-    const Vector direction;
-    const Color ambient;
-    const Color diffuse;
-    const Color specular;
-
-    Light(const Vector& aDirection, const Color& aAmbient, const Color& aDiffuse, const Color& aSpecular)
-        : direction(aDirection)
-        , ambient(aAmbient)
-        , diffuse(aDiffuse)
-        , specular(aSpecular)
-    {}
-  };
-  struct ULight {
-    GLint direction;
-    GLint ambient;
-    GLint diffuse;
-    GLint specular;
-    ULight()
-        : direction(0)
-        , ambient(0)
-        , diffuse(0)
-        , specular(0)
-    {}
-  };
-
+  CreationContextWeak context;
+  GLDeletionQueuePtr glDeletions;
+  SamplerCachePtr samplers;
   ProgramPtr program;
+  // Cheaper programs for the lower quality tiers, see SetQualityFallbacks().
+  std::vector<uint32_t> fallbackMasks;
+  std::vector<ProgramPtr> fallbacks;
+  // The program drawn with: program, or its fallback for the quality tier,
+  // or the variant of either for the light count.
+  ProgramPtr activeProgram;
+  // FeatureDepthOnly variant of the program, created by the first depth only
+  // draw.
+  ProgramPtr depthProgram;
   bool updateProgram;
-  GLint uPerspective;
-  GLint uView;
-  GLint uModel;
-  GLint uUVTransform;
-  GLint uLightCount;
-  ULight uLights[VRB_MAX_LIGHTS];
-  GLint uMatterialAmbient;
-  GLint uMatterialDiffuse;
-  GLint uMatterialSpecular;
-  GLint uMatterialSpecularExponent;
-  GLint uTexture0;
-  GLint uTintColor;
-  GLint aPosition;
-  GLint aNormal;
-  GLint aUV;
-  GLint aColor;
-  std::vector<Light> lights;
+  Program::Locations locations;
+  LightBlockPtr lights;
   Color ambient;
   Color diffuse;
   Color specular;
@@ -77,129 +135,180 @@ struct RenderState::State : public ResourceGL::State {
   TexturePtr texture;
   Color tintColor;
   uint32_t lightId;
+  bool transparent;
   bool lightsEnabled;
   bool uvTransformEnabled;
   vrb::Matrix uvTransform;
+  float textureLayer;
+  SkeletonPtr skeleton;
   std::string customFragmentShader;
+  // Created by the first draw with a FeatureMaterialBlock program.
+  GLuint materialBuffer;
+  bool materialDirty;
 
   State()
       : program(0)
       , updateProgram(true)
-      , uPerspective(-1)
-      , uView(-1)
-      , uModel(-1)
-      , uUVTransform(-1)
-      , uLightCount(-1)
-      , uMatterialAmbient(-1)
-      , uMatterialDiffuse(-1)
-      , uMatterialSpecular(-1)
-      , uMatterialSpecularExponent(-1)
-      , uTexture0(-1)
-      , uTintColor(-1)
-      , aPosition(-1)
-      , aNormal(-1)
-      , aUV(-1)
-      , aColor(-1)
       , specularExponent(0.0f)
       , ambient(0.5f, 0.5f, 0.5f, 1.0f) // default to gray
       , diffuse(1.0f, 1.0f, 1.0f, 1.0f) // default to white
       , tintColor(1.0f, 1.0f, 1.0f, 1.0f)
       , lightId(0)
+      , transparent(false)
       , lightsEnabled(true)
       , uvTransformEnabled(false)
       , uvTransform(Matrix::Identity())
+      , textureLayer(0.0f)
+      , materialBuffer(0)
+      , materialDirty(true)
   {}
 
   void InitializeProgram();
+  void BindMaterialBlock();
+  void CreateFallbacks();
+  const ProgramPtr& GetTierProgram() const;
+  bool Enable(const Matrix** aViewProjections, const Matrix** aViews, const Matrix& aModel, const Bounds& aBounds);
+  // Returns false until the variant is ready.
+  bool EnableDepthOnly(const Matrix** aViewProjections, const Matrix& aModel);
 };
 
 void
 RenderState::State::InitializeProgram() {
-  if (!program || program->GetProgram() == 0) {
+  if (!activeProgram || activeProgram->GetProgram() == 0) {
+    return;
+  }
+  uvTransformEnabled = activeProgram->SupportsFeatures(FeatureUVTransform);
+  locations = activeProgram->GetLocations();
+  updateProgram = false;
+}
+
+void
+RenderState::State::CreateFallbacks() {
+  fallbacks.clear();
+  CreationContextPtr creation = context.lock();
+  if (!program || fallbackMasks.empty() || !creation) {
     return;
   }
-  const bool kEnableTexturing = texture != nullptr;
-  uvTransformEnabled = program->SupportsFeatures(FeatureUVTransform);
+  ProgramFactoryPtr factory = creation->GetProgramFactory();
+  const uint32_t kLayout = program->GetFeatures() & kLayoutFeatures;
+  for (const uint32_t mask: fallbackMasks) {
+    fallbacks.push_back(factory->CreateProgram(creation, (mask & ~kLayoutFeatures) | kLayout));
+  }
+}
 
-  uPerspective = program->GetUniformLocation("u_perspective");
-  uView = program->GetUniformLocation("u_view");
-  uModel = program->GetUniformLocation("u_model");
-  uLightCount = program->GetUniformLocation("u_lightCount");
-  if (uvTransformEnabled) {
-    uUVTransform = program->GetUniformLocation("u_uv_transform");
-  }
-  const std::string structNameOpen("u_lights[");
-  const std::string structNameClose("].");
-  const std::string directionName("direction");
-  const std::string ambientName("ambient");
-  const std::string diffuseName("diffuse");
-  const std::string specularName("specular");
-  for (int ix = 0; ix < VRB_MAX_LIGHTS; ix++) {
-    const std::string structName = structNameOpen + std::to_string(ix) + structNameClose;
-    const std::string direction = structName + directionName;
-    const std::string ambient = structName + ambientName;
-    const std::string diffuse = structName + diffuseName;
-    const std::string specular = structName + specularName;
-    uLights[ix].direction = program->GetUniformLocation(direction);
-    uLights[ix].ambient = program->GetUniformLocation(ambient);
-    uLights[ix].diffuse = program->GetUniformLocation(diffuse);
-    uLights[ix].specular = program->GetUniformLocation(specular);
-  }
-  const std::string materialName("u_material.");
-  const std::string specularExponentName("specularExponent");
-  const std::string ambient = materialName + ambientName;
-  const std::string diffuse = materialName + diffuseName;
-  const std::string specular = materialName + specularName;
-  const std::string specularExponent = materialName + specularExponentName;
-  uMatterialAmbient = program->GetUniformLocation(ambient);
-  uMatterialDiffuse = program->GetUniformLocation(diffuse);
-  uMatterialSpecular = program->GetUniformLocation(specular);
-  uMatterialSpecularExponent = program->GetUniformLocation(specularExponent);
-  if (kEnableTexturing) {
-    const std::string texture0("u_texture0");
-    uTexture0 = program->GetUniformLocation(texture0);
-  }
-  uTintColor = program->GetUniformLocation("u_tintColor");
-  aPosition = program->GetAttributeLocation("a_position");
-  aNormal = program->GetAttributeLocation("a_normal");
-  if (kEnableTexturing) {
-    aUV = program->GetAttributeLocation("a_uv");
-  }
-  if (program->SupportsFeatures(FeatureVertexColor)) {
-    aColor = program->GetAttributeLocation("a_color");
+void
+RenderState::State::BindMaterialBlock() {
+  if (!materialBuffer) {
+    VRB_GL_CHECK(glGenBuffers(1, &materialBuffer));
+    VRB_GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer));
+    VRB_GL_CHECK(glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialBlock), nullptr, GL_DYNAMIC_DRAW));
+    materialDirty = true;
   }
-  updateProgram = false;
+  if (materialDirty) {
+    MaterialBlock block = {};
+    memcpy(block.ambient, ambient.Data(), sizeof(block.ambient));
+    memcpy(block.diffuse, diffuse.Data(), sizeof(block.diffuse));
+    memcpy(block.specular, specular.Data(), sizeof(block.specular));
+    block.specularExponent = specularExponent;
+    memcpy(block.tintColor, tintColor.Data(), sizeof(block.tintColor));
+    VRB_GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer));
+    VRB_GL_CHECK(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block));
+    materialDirty = false;
+  }
+  if (sBound.materialBuffer != materialBuffer) {
+    VRB_GL_CHECK(glBindBufferRange(GL_UNIFORM_BUFFER, VRB_MATERIAL_BLOCK_BINDING, materialBuffer, 0, sizeof(MaterialBlock)));
+    VRB_GL_STATS_ADD(StateChanges, 1);
+    sBound.materialBuffer = materialBuffer;
+  }
+}
+
+const ProgramPtr&
+RenderState::State::GetTierProgram() const {
+  const int kTier = sQualityTier.load(std::memory_order_relaxed);
+  if ((kTier <= 0) || fallbacks.empty()) {
+    return program;
+  }
+  const ProgramPtr& kFallback = fallbacks[std::min((size_t)kTier, fallbacks.size()) - 1];
+  return (kFallback && kFallback->IsReady()) ? kFallback : program;
 }
 
 RenderStatePtr
 RenderState::Create(CreationContextPtr& aContext) {
-  return std::make_shared<ConcreteClass<RenderState, RenderState::State>>(aContext);
+  return std::allocate_shared<ConcreteClass<RenderState, RenderState::State> >(PoolAllocator<RenderState>(), aContext);
 }
 
 void
 RenderState::SetProgram(ProgramPtr& aProgram) {
   m.program = aProgram;
+  m.depthProgram = nullptr;
   m.updateProgram = true;
+  m.CreateFallbacks();
+}
+
+ProgramPtr
+RenderState::GetProgram() const {
+  return m.program;
+}
+
+void
+RenderState::SetQualityFallbacks(const std::vector<uint32_t>& aFeatureMasks) {
+  m.fallbackMasks = aFeatureMasks;
+  m.CreateFallbacks();
+}
+
+void
+RenderState::SetQualityTier(const int aTier) {
+  sQualityTier.store(std::max(aTier, 0), std::memory_order_relaxed);
+}
+
+int
+RenderState::GetQualityTier() {
+  return sQualityTier.load(std::memory_order_relaxed);
+}
+
+void
+RenderState::SetDepthOnly(const bool aDepthOnly) {
+  sDepthOnly = aDepthOnly;
+}
+
+bool
+RenderState::IsDepthOnly() {
+  return sDepthOnly;
 }
 
 GLint
 RenderState::AttributePosition() const {
-  return m.aPosition;
+  return m.locations.position;
 }
 
 GLint
 RenderState::AttributeNormal() const {
-  return m.aNormal;
+  return m.locations.normal;
 }
 
 GLint
 RenderState::AttributeUV() const {
-  return m.aUV;
+  return m.locations.uv;
 }
 
 GLint
 RenderState::AttributeColor() const {
-  return m.aColor;
+  return m.locations.color;
+}
+
+GLint
+RenderState::AttributeInstanceModel() const {
+  return m.locations.instanceModel;
+}
+
+GLint
+RenderState::AttributeJoint() const {
+  return m.locations.jointIndices;
+}
+
+GLint
+RenderState::AttributeWeight() const {
+  return m.locations.jointWeights;
 }
 
 uint32_t
@@ -210,12 +319,28 @@ RenderState::GetLightId() const {
 void
 RenderState::ResetLights(const uint32_t aId) {
   m.lightId = aId;
-  m.lights.clear();
+  m.lights = nullptr;
 }
 
 void
 RenderState::AddLight(const Vector& aDirection, const Color& aAmbient, const Color& aDiffuse, const Color& aSpecular) {
-  m.lights.push_back(State::Light(aDirection, aAmbient, aDiffuse, aSpecular));
+  // Blocks may be shared so a new one is created.
+  std::shared_ptr<LightBlock> block = m.lights ? std::make_shared<LightBlock>(*m.lights) : std::make_shared<LightBlock>();
+  LightBlock::Entry entry = {aDirection, aAmbient, aDiffuse, aSpecular, Vector(), 0.0f};
+  block->hash = LightBlock::Hash(entry, m.lights ? block->hash : LightBlock::EmptyHash());
+  block->lights.push_back(entry);
+  m.lights = block;
+}
+
+void
+RenderState::SetLights(const uint32_t aId, const LightBlockPtr& aLights) {
+  m.lightId = aId;
+  m.lights = aLights;
+}
+
+const LightBlockPtr&
+RenderState::GetLights() const {
+  return m.lights;
 }
 
 void
@@ -224,17 +349,20 @@ RenderState::SetMaterial(const Color& aAmbient, const Color& aDiffuse, const Col
   m.diffuse = aDiffuse;
   m.specular = aSpecular;
   m.specularExponent = aSpecularExponent;
+  m.materialDirty = true;
 }
 
 
 void
 RenderState::SetAmbient(const Color& aColor) {
   m.ambient = aColor;
+  m.materialDirty = true;
 }
 
 void
 RenderState::SetDiffuse(const Color& aColor) {
   m.diffuse = aColor;
+  m.materialDirty = true;
 }
 
 void
@@ -250,7 +378,8 @@ RenderState::UVLength() const {
   if (!m.texture) {
     return 0;
   }
-  return m.texture->GetTarget() == GL_TEXTURE_CUBE_MAP ? 3 : 2;
+  const GLenum kTarget = m.texture->GetTarget();
+  return (kTarget == GL_TEXTURE_CUBE_MAP) || (kTarget == GL_TEXTURE_2D_ARRAY) ? 3 : 2;
 }
 
 TexturePtr
@@ -276,54 +405,213 @@ RenderState::GetTintColor() const {
 void
 RenderState::SetTintColor(const Color& aColor) {
   m.tintColor = aColor;
+  m.materialDirty = true;
+}
+
+bool
+RenderState::IsTransparent() const {
+  return m.transparent || m.tintColor.HasAlpha() || m.diffuse.HasAlpha();
+}
+
+void
+RenderState::SetTransparent(const bool aTransparent) {
+  m.transparent = aTransparent;
 }
 
 bool
 RenderState::Enable(const Matrix& aPerspective, const Matrix& aView, const Matrix& aModel) {
-  if (!m.program) { return false; }
-  if (!m.program->Enable()) { return false; }
-  if (m.updateProgram) {
-    m.InitializeProgram();
+  const Matrix kViewProjection = aPerspective.PostMultiply(aView);
+  const Matrix* viewProjections[VRB_MAX_VIEWS];
+  const Matrix* views[VRB_MAX_VIEWS];
+  for (int ix = 0; ix < VRB_MAX_VIEWS; ix++) {
+    viewProjections[ix] = &kViewProjection;
+    views[ix] = &aView;
   }
+  return m.Enable(viewProjections, views, aModel, Bounds::Infinite());
+}
 
-  int lightCount = 0;
-  if (m.lightsEnabled) {
-    for (State::Light& light: m.lights) {
-      VRB_GL_CHECK(glUniform3f(m.uLights[lightCount].direction, light.direction.x(), light.direction.y(), light.direction.z()));
-      VRB_GL_CHECK(glUniform4fv(m.uLights[lightCount].ambient, 1, light.ambient.Data()));
-      VRB_GL_CHECK(glUniform4fv(m.uLights[lightCount].diffuse, 1, light.diffuse.Data()));
-      VRB_GL_CHECK(glUniform4fv(m.uLights[lightCount].specular, 1, light.specular.Data()));
-      lightCount++;
+bool
+RenderState::Enable(const Camera& aCamera, const Matrix& aModel) {
+  return Enable(aCamera, aModel, Bounds::Infinite());
+}
+
+bool
+RenderState::Enable(const Camera& aCamera, const Matrix& aModel, const Bounds& aBounds) {
+  const Matrix* viewProjections[VRB_MAX_VIEWS];
+  const Matrix* views[VRB_MAX_VIEWS];
+  const int kCount = aCamera.GetViewCount();
+  for (int ix = 0; ix < VRB_MAX_VIEWS; ix++) {
+    // A single view camera draws the same view into every layer.
+    const int kView = ix < kCount ? ix : 0;
+    viewProjections[ix] = &aCamera.GetViewProjectionAt(kView);
+    views[ix] = &aCamera.GetViewAt(kView);
+  }
+  return m.Enable(viewProjections, views, aModel, aBounds);
+}
+
+bool
+RenderState::State::EnableDepthOnly(const Matrix** aViewProjections, const Matrix& aModel) {
+  if (!depthProgram) {
+    CreationContextPtr creation = context.lock();
+    if (!creation) {
+      return false;
+    }
+    depthProgram = creation->GetProgramFactory()->CreateProgram(creation, (program->GetFeatures() & kDepthOnlyFeatures) | FeatureDepthOnly);
+  }
+  if (!depthProgram || !depthProgram->IsReady()) {
+    return false;
+  }
+  const GLuint kProgram = depthProgram->GetProgram();
+  if (sBound.program != kProgram) {
+    if (!depthProgram->Enable()) { return false; }
+    sBound.program = kProgram;
+    sBound.lightsValid = false;
+  }
+  Program& target = *depthProgram;
+  const Program::Locations& kLocations = target.GetLocations();
+  for (int ix = 0; ix < VRB_MAX_VIEWS; ix++) {
+    target.SetUniformMatrix4fv(kLocations.viewProjection[ix], aViewProjections[ix]->Data());
+    if (kLocations.modelViewProjection[ix] >= 0) {
+      target.SetUniformMatrix4fv(kLocations.modelViewProjection[ix], aViewProjections[ix]->PostMultiply(aModel).Data());
     }
   }
-  VRB_GL_CHECK(glUniform1i(m.uLightCount, lightCount));
+  if (kLocations.instanceModel < 0) {
+    target.SetUniformMatrix4fv(kLocations.model, aModel.Data());
+  }
+  if (skeleton && (kLocations.joints >= 0) && (skeleton->GetJointCount() > 0)) {
+    const int32_t kJointCount = std::min(skeleton->GetJointCount(), VRB_MAX_JOINTS);
+    target.SetUniformMatrix4fv(kLocations.joints, kJointCount, skeleton->GetPalette()->Data());
+  }
+  return true;
+}
 
-  VRB_GL_CHECK(glUniform4fv(m.uMatterialAmbient, 1, m.ambient.Data()));
-  VRB_GL_CHECK(glUniform4fv(m.uMatterialDiffuse, 1, m.diffuse.Data()));
-  VRB_GL_CHECK(glUniform4fv(m.uMatterialSpecular, 1, m.specular.Data()));
-  VRB_GL_CHECK(glUniform1f(m.uMatterialSpecularExponent, m.specularExponent));
+bool
+RenderState::State::Enable(const Matrix** aViewProjections, const Matrix** aViews, const Matrix& aModel, const Bounds& aBounds) {
+  if (!program || (program->GetProgram() == 0)) { return false; }
+  // The attribute locations the drawables bind come from the active program,
+  // which the variant shares, so it must have been set up first.
+  if (sDepthOnly && activeProgram && !updateProgram && EnableDepthOnly(aViewProjections, aModel)) {
+    return true;
+  }
+  const LightBlock* kLights = lightsEnabled ? lights.get() : nullptr;
+  const uint64_t kLightsHash = kLights ? kLights->hash : 0;
+  uint32_t lightIndices[VRB_MAX_LIGHTS];
+  const int kLightCount = kLights ? SelectLights(*kLights, aBounds, lightIndices) : 0;
+  // The variant without a light loop is drawn with once it is compiled.
+  const ProgramPtr& kTierProgram = GetTierProgram();
+  ProgramPtr variant = kTierProgram->GetLightCountVariant(kLightCount);
+  if (!variant) {
+    variant = kTierProgram;
+  }
+  if (variant != activeProgram) {
+    activeProgram = variant;
+    updateProgram = true;
+  }
+  const GLuint kProgram = activeProgram->GetProgram();
+  if (sBound.program != kProgram) {
+    if (!activeProgram->Enable()) { return false; }
+    sBound.program = kProgram;
+    sBound.lightsValid = false;
+  }
+  if (updateProgram) {
+    InitializeProgram();
+  }
 
-  if (m.texture) {
-    VRB_GL_CHECK(glActiveTexture(GL_TEXTURE0));
-    m.texture->Bind();
-    VRB_GL_CHECK(glUniform1i(m.uTexture0, 0));
+  Program& target = *activeProgram;
+  const Program::Locations& kLocations = locations;
+  // Draws given the same lights of a block skip the light uniforms entirely.
+  if (!sBound.lightsValid || (sBound.lights != kLights) || (sBound.lightsHash != kLightsHash) ||
+      (sBound.lightCount != kLightCount) || !std::equal(lightIndices, lightIndices + kLightCount, sBound.lightIndices)) {
+    for (int ix = 0; ix < kLightCount; ix++) {
+      const LightBlock::Entry& kLight = kLights->lights[lightIndices[ix]];
+      const float kPosition[] = {kLight.position.x(), kLight.position.y(), kLight.position.z(), kLight.range};
+      target.SetUniform3fv(kLocations.lights[ix].direction, kLight.direction.Data());
+      target.SetUniform4fv(kLocations.lights[ix].position, kPosition);
+      target.SetUniform4fv(kLocations.lights[ix].ambient, kLight.ambient.Data());
+      target.SetUniform4fv(kLocations.lights[ix].diffuse, kLight.diffuse.Data());
+      target.SetUniform4fv(kLocations.lights[ix].specular, kLight.specular.Data());
+      sBound.lightIndices[ix] = lightIndices[ix];
+    }
+    target.SetUniform1i(kLocations.lightCount, kLightCount);
+    VRB_GL_STATS_ADD(StateChanges, 1);
+    sBound.lightsValid = true;
+    sBound.lights = kLights;
+    sBound.lightsHash = kLightsHash;
+    sBound.lightCount = kLightCount;
   }
-  VRB_GL_CHECK(glUniform4f(m.uTintColor, m.tintColor.Red(), m.tintColor.Green(), m.tintColor.Blue(), m.tintColor.Alpha()));
-  VRB_GL_CHECK(glUniformMatrix4fv(m.uPerspective, 1, GL_FALSE, aPerspective.Data()));
-  VRB_GL_CHECK(glUniformMatrix4fv(m.uView, 1, GL_FALSE, aView.Data()));
-  VRB_GL_CHECK(glUniformMatrix4fv(m.uModel, 1, GL_FALSE, aModel.Data()));
-  if (m.uvTransformEnabled) {
-    VRB_GL_CHECK(glUniformMatrix4fv(m.uUVTransform, 1, GL_FALSE, m.uvTransform.Data()));
+
+  // Render states sharing a material, see MaterialRegistry, also share the
+  // block binding.
+  if (activeProgram->SupportsFeatures(FeatureMaterialBlock)) {
+    BindMaterialBlock();
+  } else {
+    target.SetUniform4fv(kLocations.materialAmbient, ambient.Data());
+    target.SetUniform4fv(kLocations.materialDiffuse, diffuse.Data());
+    target.SetUniform4fv(kLocations.materialSpecular, specular.Data());
+    target.SetUniform1f(kLocations.materialSpecularExponent, specularExponent);
+    target.SetUniform4fv(kLocations.tintColor, tintColor.Data());
+  }
+
+  if (texture) {
+    if ((sBound.texture != texture.get()) || (sBound.textureHandle != texture->GetHandle())) {
+      VRB_GL_CHECK(glActiveTexture(GL_TEXTURE0));
+      texture->Bind();
+      VRB_GL_STATS_ADD(StateChanges, 1);
+      sBound.texture = texture.get();
+      sBound.textureHandle = texture->GetHandle();
+      const GLuint kSampler = samplers ? samplers->GetSampler(*texture) : 0;
+      if (sBound.sampler != kSampler) {
+        VRB_GL_CHECK(glBindSampler(0, kSampler));
+        sBound.sampler = kSampler;
+      }
+    }
+    target.SetUniform1i(kLocations.texture0, 0);
+  }
+  // The camera matrices are the same for every draw in a pass so they are
+  // only uploaded the first time each program is used.
+  for (int ix = 0; ix < VRB_MAX_VIEWS; ix++) {
+    target.SetUniformMatrix4fv(kLocations.viewProjection[ix], aViewProjections[ix]->Data());
+    target.SetUniformMatrix4fv(kLocations.view[ix], aViews[ix]->Data());
+    if (kLocations.modelViewProjection[ix] >= 0) {
+      target.SetUniformMatrix4fv(kLocations.modelViewProjection[ix], aViewProjections[ix]->PostMultiply(aModel).Data());
+    }
+    if (kLocations.modelView[ix] >= 0) {
+      target.SetUniformMatrix4fv(kLocations.modelView[ix], aViews[ix]->PostMultiply(aModel).Data());
+    }
+  }
+  if (kLocations.instanceModel < 0) {
+    target.SetUniformMatrix4fv(kLocations.model, aModel.Data());
+  }
+  if (uvTransformEnabled) {
+    target.SetUniformMatrix4fv(kLocations.uvTransform, uvTransform.Data());
+  }
+  if (kLocations.textureLayer >= 0) {
+    target.SetUniform1f(kLocations.textureLayer, textureLayer);
+  }
+  if (skeleton && (kLocations.joints >= 0) && (skeleton->GetJointCount() > 0)) {
+    const int32_t kJointCount = std::min(skeleton->GetJointCount(), VRB_MAX_JOINTS);
+    target.SetUniformMatrix4fv(kLocations.joints, kJointCount, skeleton->GetPalette()->Data());
   }
   return true;
 }
 
 void
 RenderState::Disable() {
-  if (m.texture) {
-    glActiveTexture(GL_TEXTURE0);
-    m.texture->Unbind();
+  // The texture is left bound so the next draw using it may skip the bind.
+}
+
+void
+RenderState::InvalidateBindings() {
+  // Other code binding textures to unit 0 must not sample with it.
+  if (sBound.sampler) {
+    VRB_GL_CHECK(glBindSampler(0, 0));
   }
+  sBound = BoundState();
+}
+
+bool
+RenderState::GetLightsEnabled() const {
+  return m.lightsEnabled;
 }
 
 void
@@ -331,12 +619,47 @@ RenderState::SetLightsEnabled(bool aEnabled) {
   m.lightsEnabled = aEnabled;
 }
 
+const vrb::Matrix&
+RenderState::GetUVTransform() const {
+  return m.uvTransform;
+}
+
 void
 RenderState::SetUVTransform(const vrb::Matrix& aMatrix) {
   m.uvTransform = aMatrix;
 }
 
-RenderState::RenderState(State& aState, CreationContextPtr& aContext) : ResourceGL(aState, aContext), m(aState) {}
+float
+RenderState::GetTextureLayer() const {
+  return m.textureLayer;
+}
+
+void
+RenderState::SetTextureLayer(const float aLayer) {
+  m.textureLayer = aLayer;
+}
+
+void
+RenderState::SetSkeleton(const SkeletonPtr& aSkeleton) {
+  m.skeleton = aSkeleton;
+}
+
+const SkeletonPtr&
+RenderState::GetSkeleton() const {
+  return m.skeleton;
+}
+
+RenderState::RenderState(State& aState, CreationContextPtr& aContext) : ResourceGL(aState, aContext), m(aState) {
+  m.context = aContext;
+  m.glDeletions = aContext->GetGLDeletionQueue();
+  m.samplers = aContext->GetSamplerCache();
+}
+
+RenderState::~RenderState() {
+  // The last reference may be dropped on any thread. Every CreationContext
+  // shares the deletion queue of its RenderContext.
+  m.glDeletions->DeleteBuffer(m.materialBuffer);
+}
 
 void
 RenderState::InitializeGL() {
@@ -345,6 +668,10 @@ RenderState::InitializeGL() {
 void
 RenderState::ShutdownGL() {
   m.updateProgram = true;
+  if (m.materialBuffer) {
+    VRB_GL_CHECK(glDeleteBuffers(1, &m.materialBuffer));
+    m.materialBuffer = 0;
+  }
 }
 
 } // namespace vrb
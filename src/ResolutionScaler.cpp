@@ -0,0 +1,384 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/ResolutionScaler.h"
+#include "vrb/private/UpdatableState.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/FBOPool.h"
+#include "vrb/Logger.h"
+#include "vrb/RenderContext.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace {
+
+// The PerformanceMonitor averages five one second samples, so a step needs
+// this long before the monitor reflects it.
+const double kLowerInterval = 6.0;
+const double kRaiseInterval = 10.0;
+// Raising again is delayed up to this long when raising caused poor performance.
+const double kMaxRaiseInterval = 80.0;
+// The delay goes back to kRaiseInterval once performance stayed good at the
+// highest level for this long.
+const double kRaiseBackoffReset = 120.0;
+const float kDefaultScales[] = {1.0f, 0.85f, 0.7f, 0.5f};
+
+}
+
+namespace vrb {
+
+namespace {
+
+// PerformanceMonitorObserver may not be a base of an Updatable, so the
+// scaler forwards the signals through this object.
+class ScalerObserver : public PerformanceMonitorObserver {
+public:
+  std::function<void(const bool)> callback;
+  void PoorPerformanceDetected(const double& aTargetFrameRate, const double& aAverageFrameRate) override {
+    if (callback) { callback(true); }
+  }
+  void PerformanceRestored(const double& aTargetFrameRate, const double& aAverageFrameRate) override {
+    if (callback) { callback(false); }
+  }
+  ScalerObserver() = default;
+  ~ScalerObserver() = default;
+};
+
+} // namespace
+
+struct ResolutionScaler::State : public Updatable::State {
+  struct Target {
+    FBOPtr fbo;
+    int32_t width;
+    int32_t height;
+    Target() : width(0), height(0) {}
+  };
+  RenderContextWeak context;
+  std::weak_ptr<PerformanceMonitor> monitor;
+  std::shared_ptr<ScalerObserver> observer;
+  std::vector<float> scales;
+  std::vector<Target> targets;
+  int32_t fullWidth;
+  int32_t fullHeight;
+  FBO::Attributes attributes;
+  int32_t minFoveation;
+  int32_t maxFoveation;
+  float focalPoints[2][2];
+  // Step along the foveation levels followed by the scales.
+  size_t level;
+  // Lowest level raised back to, see SetStepFloor().
+  size_t stepFloor;
+  bool poor;
+  double lastStep;
+  double lastRaise;
+  double raiseInterval;
+
+  State()
+      : scales(std::begin(kDefaultScales), std::end(kDefaultScales))
+      , fullWidth(0)
+      , fullHeight(0)
+      , minFoveation(0)
+      , maxFoveation(0)
+      , focalPoints()
+      , level(0)
+      , stepFloor(0)
+      , poor(false)
+      , lastStep(-1.0)
+      , lastRaise(-1.0)
+      , raiseInterval(kRaiseInterval)
+  {}
+
+  // Returns the targets to the FBOPool of the context.
+  void Release() {
+    RenderContextPtr render = context.lock();
+    for (Target& target: targets) {
+      // Other users of the pool expect an unfoveated target.
+      target.fbo->SetFoveationLevel(0);
+      if (render) {
+        render->GetFBOPool()->Release(target.fbo);
+      }
+    }
+    targets.clear();
+  }
+
+  void Allocate() {
+    Release();
+    RenderContextPtr render = context.lock();
+    if (!render) {
+      return;
+    }
+    FBOPoolPtr& pool = render->GetFBOPool();
+    if ((fullWidth > 0) && (fullHeight > 0)) {
+      for (const float scale: scales) {
+        Target target;
+        target.width = std::max(1, (int32_t)std::lround(fullWidth * scale));
+        target.height = std::max(1, (int32_t)std::lround(fullHeight * scale));
+        target.fbo = pool->Acquire(target.width, target.height, attributes);
+        if (!target.fbo) {
+          VRB_ERROR("ResolutionScaler failed to acquire a %dx%d render target", target.width, target.height);
+          Release();
+          break;
+        }
+        for (int32_t eye = 0; eye < 2; eye++) {
+          target.fbo->SetFocalPoint(eye, focalPoints[eye][0], focalPoints[eye][1]);
+        }
+        targets.push_back(target);
+      }
+    }
+    // Released targets of a size that is no longer used are not kept around.
+    pool->Trim();
+    if (targets.empty()) {
+      return;
+    }
+    level = std::min(level, StepCount() - 1);
+    ApplyFoveation();
+  }
+
+  // Foveation steps are skipped when the render targets are not foveated.
+  size_t FoveationSteps() const {
+    const bool kFoveated = !targets.empty() && targets[0].fbo->IsFoveated();
+    return kFoveated ? (size_t)(maxFoveation - minFoveation) : 0;
+  }
+
+  size_t StepCount() const {
+    return FoveationSteps() + scales.size();
+  }
+
+  size_t Floor() const {
+    return std::min(stepFloor, StepCount() - 1);
+  }
+
+  size_t ScaleIndex() const {
+    const size_t kFoveationSteps = FoveationSteps();
+    return level > kFoveationSteps ? level - kFoveationSteps : 0;
+  }
+
+  int32_t FoveationLevel() const {
+    if (FoveationSteps() == 0) {
+      return 0;
+    }
+    return minFoveation + (int32_t)std::min(level, FoveationSteps());
+  }
+
+  void ApplyFoveation() {
+    const int32_t kLevel = FoveationLevel();
+    for (Target& target: targets) {
+      target.fbo->SetFoveationLevel(kLevel);
+    }
+  }
+
+  const Target* GetTarget() const {
+    const size_t kIndex = ScaleIndex();
+    return kIndex < targets.size() ? &targets[kIndex] : nullptr;
+  }
+
+  double GetTimestamp() const {
+    RenderContextPtr render = context.lock();
+    return render ? render->GetTimestamp() : 0.0;
+  }
+
+  void PoorPerformanceDetected() {
+    const double kNow = GetTimestamp();
+    if ((lastRaise >= 0.0) && ((kNow - lastRaise) < raiseInterval)) {
+      // The last raise was too much, wait longer before trying it again.
+      raiseInterval = std::min(raiseInterval * 2.0, kMaxRaiseInterval);
+    }
+    poor = true;
+    if (level + 1 < StepCount()) {
+      Step(level + 1, kNow);
+    }
+  }
+
+  void PerformanceRestored() {
+    poor = false;
+    lastStep = GetTimestamp();
+  }
+
+  void RemoveObserver() {
+    PerformanceMonitorPtr current = monitor.lock();
+    if (current && observer) {
+      current->RemovePerformanceMonitorObserver(*observer);
+    }
+    if (observer) {
+      observer->callback = nullptr;
+    }
+    observer = nullptr;
+    monitor.reset();
+  }
+
+  void Step(const size_t aLevel, const double aTimestamp) {
+    level = aLevel;
+    lastStep = aTimestamp;
+    ApplyFoveation();
+    VRB_LOG("ResolutionScaler scale set to %.2f, foveation %d", scales[ScaleIndex()], FoveationLevel());
+  }
+};
+
+ResolutionScalerPtr
+ResolutionScaler::Create(RenderContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<ResolutionScaler, ResolutionScaler::State> >(aContext);
+}
+
+void
+ResolutionScaler::SetPerformanceMonitor(const PerformanceMonitorPtr& aMonitor) {
+  m.RemoveObserver();
+  if (!aMonitor) {
+    return;
+  }
+  ResolutionScaler* self = this;
+  m.observer = std::make_shared<ScalerObserver>();
+  m.observer->callback = [self](const bool aPoor) {
+    if (aPoor) {
+      self->m.PoorPerformanceDetected();
+    } else {
+      self->m.PerformanceRestored();
+    }
+    self->Wake();
+  };
+  m.monitor = aMonitor;
+  aMonitor->AddPerformanceMonitorObserver(m.observer);
+}
+
+void
+ResolutionScaler::SetScales(const std::vector<float>& aScales) {
+  std::vector<float> scales;
+  for (const float scale: aScales) {
+    if ((scale > 0.0f) && (scale <= 1.0f)) {
+      scales.push_back(scale);
+    }
+  }
+  if (scales.empty()) {
+    VRB_ERROR("ResolutionScaler requires at least one scale in (0, 1]");
+    return;
+  }
+  std::sort(scales.begin(), scales.end(), [](const float aLeft, const float aRight) { return aLeft > aRight; });
+  m.scales = scales;
+  m.level = std::min(m.level, m.StepCount() - 1);
+  if (!m.targets.empty()) {
+    m.Allocate();
+  }
+  Wake();
+}
+
+void
+ResolutionScaler::SetFoveationLevels(const int32_t aMin, const int32_t aMax) {
+  m.minFoveation = std::max(0, std::min(aMin, FBO::kMaxFoveationLevel));
+  m.maxFoveation = std::max(m.minFoveation, std::min(aMax, FBO::kMaxFoveationLevel));
+  m.level = std::min(m.level, m.StepCount() - 1);
+  m.ApplyFoveation();
+  Wake();
+}
+
+void
+ResolutionScaler::SetStepFloor(const int32_t aStep) {
+  m.stepFloor = (size_t)std::max(aStep, 0);
+  if (m.level < m.Floor()) {
+    // Lowered right away, raised again one step at a time once the floor drops.
+    m.Step(m.Floor(), m.GetTimestamp());
+  }
+  Wake();
+}
+
+int32_t
+ResolutionScaler::GetStep() const {
+  return (int32_t)m.level;
+}
+
+int32_t
+ResolutionScaler::GetFoveationLevel() const {
+  return m.FoveationLevel();
+}
+
+void
+ResolutionScaler::SetFocalPoint(const int32_t aEye, const float aX, const float aY) {
+  if ((aEye < 0) || (aEye >= 2)) {
+    VRB_ERROR("ResolutionScaler::SetFocalPoint invalid eye: %d", aEye);
+    return;
+  }
+  m.focalPoints[aEye][0] = aX;
+  m.focalPoints[aEye][1] = aY;
+  for (State::Target& target: m.targets) {
+    target.fbo->SetFocalPoint(aEye, aX, aY);
+  }
+}
+
+void
+ResolutionScaler::SetSize(const int32_t aWidth, const int32_t aHeight, const FBO::Attributes& aAttributes) {
+  m.fullWidth = aWidth;
+  m.fullHeight = aHeight;
+  m.attributes = aAttributes;
+  m.Allocate();
+}
+
+float
+ResolutionScaler::GetScale() const {
+  return m.scales[m.ScaleIndex()];
+}
+
+void
+ResolutionScaler::GetSize(int32_t& aWidth, int32_t& aHeight) const {
+  const State::Target* target = m.GetTarget();
+  aWidth = target ? target->width : 0;
+  aHeight = target ? target->height : 0;
+}
+
+FBOPtr
+ResolutionScaler::GetFBO() const {
+  const State::Target* target = m.GetTarget();
+  return target ? target->fbo : nullptr;
+}
+
+GLuint
+ResolutionScaler::GetTextureHandle() const {
+  const State::Target* target = m.GetTarget();
+  return target ? target->fbo->GetTextureHandle() : 0;
+}
+
+void
+ResolutionScaler::UpdateResource(RenderContext& aContext) {
+  const double kNow = aContext.GetTimestamp();
+  if (m.lastStep < 0.0) {
+    // Nothing to do until the monitor signals, which wakes the scaler.
+    Sleep(aContext);
+    return;
+  }
+  if (m.poor) {
+    // Still no restored signal, keep lowering.
+    if (((kNow - m.lastStep) >= kLowerInterval) && (m.level + 1 < m.StepCount())) {
+      m.Step(m.level + 1, kNow);
+    }
+  } else if ((m.level > m.Floor()) && ((kNow - m.lastStep) >= m.raiseInterval)) {
+    m.Step(m.level - 1, kNow);
+    m.lastRaise = kNow;
+  } else if (!m.poor && (m.level <= m.Floor()) && ((kNow - m.lastStep) >= kRaiseBackoffReset)) {
+    m.raiseInterval = kRaiseInterval;
+  }
+  const bool kBackedOff = m.raiseInterval > kRaiseInterval;
+  if (m.poor && (m.level + 1 < m.StepCount())) {
+    SleepUntil(aContext, m.lastStep + kLowerInterval);
+  } else if (!m.poor && (m.level > m.Floor())) {
+    SleepUntil(aContext, m.lastStep + m.raiseInterval);
+  } else if (!m.poor && kBackedOff) {
+    SleepUntil(aContext, m.lastStep + kRaiseBackoffReset);
+  } else {
+    Sleep(aContext);
+  }
+}
+
+ResolutionScaler::ResolutionScaler(State& aState, RenderContextPtr& aContext)
+    : Updatable(aState, aContext->GetRenderThreadCreationContext())
+    , m(aState) {
+  m.context = aContext;
+}
+
+ResolutionScaler::~ResolutionScaler() {
+  m.RemoveObserver();
+  m.Release();
+}
+
+} // namespace vrb
@@ -5,31 +5,51 @@
 
 #include "vrb/RunnableQueue.h"
 
+#include "vrb/ClassLoaderAndroid.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/JNIException.h"
 #include "vrb/Logger.h"
-#include "vrb/Mutex.h"
 
+#include <algorithm>
+#include <atomic>
 #include <jni.h>
 #include <vector>
 
 namespace {
 
+const jsize kMinBatchCapacity = 16;
+
+struct RunnableNode {
+  RunnableNode* next;
+  jobject runnable;
+  std::function<void()> task;
+  RunnableNode() : next(nullptr), runnable(nullptr) {}
+};
+
 } // namespace
 
 namespace vrb {
 
 struct RunnableQueue::State {
-  Mutex lock;
   JavaVM* vm;
   JNIEnv* threadEnv;
   jmethodID runMethod;
-  std::vector<jobject> list[2];
-  uint32_t count;
+  jclass batchClass;
+  jmethodID batchRunMethod;
+  jobjectArray batch;
+  jsize batchCapacity;
+  // Producers push onto this stack, the consumer takes all of it at once.
+  std::atomic<RunnableNode*> head;
+  std::vector<RunnableNode*> pending;
   State()
       : vm(nullptr)
       , threadEnv(nullptr)
       , runMethod(nullptr)
-      , count(0)
+      , batchClass(nullptr)
+      , batchRunMethod(nullptr)
+      , batch(nullptr)
+      , batchCapacity(0)
+      , head(nullptr)
   {}
   ~State() {
     Shutdown();
@@ -47,29 +67,121 @@ struct RunnableQueue::State {
     aEnv->DeleteLocalRef(localRunnableClass);
     threadEnv = aEnv;
   }
-  uint32_t AddPlace() {
-    return ~count & 0x01;
+  void InitializeBatch(JNIEnv* aEnv, const ClassLoaderAndroidPtr& aClassLoader) {
+    jclass localBatchClass = aClassLoader->FindClass("org/mozilla/vrb/RunnableBatch");
+    if (!localBatchClass) {
+      VRB_WARN("Failed finding class: org/mozilla/vrb/RunnableBatch, runnables are not batched");
+      return;
+    }
+    batchClass = (jclass)aEnv->NewGlobalRef(localBatchClass);
+    aEnv->DeleteLocalRef(localBatchClass);
+    batchRunMethod = aEnv->GetStaticMethodID(batchClass, "run", "([Ljava/lang/Runnable;I)V");
+    if (!batchRunMethod) {
+      VRB_ERROR("Failed finding RunnableBatch.run()");
+      aEnv->ExceptionClear();
+      aEnv->DeleteGlobalRef(batchClass);
+      batchClass = nullptr;
+    }
+  }
+  void Push(RunnableNode* aNode) {
+    RunnableNode* top = head.load(std::memory_order_relaxed);
+    do {
+      aNode->next = top;
+    } while (!head.compare_exchange_weak(top, aNode, std::memory_order_release, std::memory_order_relaxed));
   }
-  uint32_t ProcessPlace() {
-    return count & 0x01;
+  // Moves every queued node into pending, oldest first.
+  void TakeAll() {
+    RunnableNode* node = head.exchange(nullptr, std::memory_order_acquire);
+    const size_t kStart = pending.size();
+    for (; node; node = node->next) {
+      pending.push_back(node);
+    }
+    std::reverse(pending.begin() + kStart, pending.end());
+  }
+  bool ReserveBatch(const jsize aCount) {
+    if (aCount <= batchCapacity) {
+      return true;
+    }
+    if (batch) {
+      threadEnv->DeleteGlobalRef(batch);
+      batch = nullptr;
+      batchCapacity = 0;
+    }
+    jsize capacity = kMinBatchCapacity;
+    while (capacity < aCount) {
+      capacity *= 2;
+    }
+    jclass localRunnableClass = threadEnv->FindClass("java/lang/Runnable");
+    jobjectArray localBatch = localRunnableClass ? threadEnv->NewObjectArray(capacity, localRunnableClass, nullptr) : nullptr;
+    if (localRunnableClass) {
+      threadEnv->DeleteLocalRef(localRunnableClass);
+    }
+    if (!localBatch) {
+      threadEnv->ExceptionClear();
+      return false;
+    }
+    batch = (jobjectArray)threadEnv->NewGlobalRef(localBatch);
+    threadEnv->DeleteLocalRef(localBatch);
+    batchCapacity = capacity;
+    return true;
+  }
+  // Runs the Java runnables of pending[aStart, aEnd) in one call to Java if
+  // batching is available, otherwise one call each.
+  void RunJava(const size_t aStart, const size_t aEnd) {
+    const jsize kCount = (jsize)(aEnd - aStart);
+    if (batchClass && (kCount > 1) && ReserveBatch(kCount)) {
+      for (jsize ix = 0; ix < kCount; ix++) {
+        threadEnv->SetObjectArrayElement(batch, ix, pending[aStart + ix]->runnable);
+      }
+      threadEnv->CallStaticVoidMethod(batchClass, batchRunMethod, batch, kCount);
+      VRB_CHECK_JNI_EXCEPTION(threadEnv);
+      // The batch array outlives the call, do not let it keep the runnables
+      // reachable once their global references are deleted.
+      for (jsize ix = 0; ix < kCount; ix++) {
+        threadEnv->SetObjectArrayElement(batch, ix, nullptr);
+      }
+    } else {
+      for (size_t ix = aStart; ix < aEnd; ix++) {
+        threadEnv->CallVoidMethod(pending[ix]->runnable, runMethod);
+        VRB_CHECK_JNI_EXCEPTION(threadEnv);
+      }
+    }
+    for (size_t ix = aStart; ix < aEnd; ix++) {
+      threadEnv->DeleteGlobalRef(pending[ix]->runnable);
+      pending[ix]->runnable = nullptr;
+    }
   }
   void Shutdown() {
-    if (!vm) { return; }
+    TakeAll();
     JNIEnv* env = nullptr;
-    if (!vm->AttachCurrentThread(&env, nullptr)) { return; }
-    for (int ix = 0; ix < 2; ix++) {
-      for (jobject& runnable: list[ix]) {
-        env->DeleteGlobalRef(runnable);
-        runnable = nullptr;
+    if (vm && (vm->AttachCurrentThread(&env, nullptr) != 0)) {
+      env = nullptr;
+    }
+    for (RunnableNode* node: pending) {
+      if (node->runnable && env) {
+        env->DeleteGlobalRef(node->runnable);
       }
-      list[ix].clear();
+      delete node;
     }
+    pending.clear();
+    if (env) {
+      if (batch) {
+        env->DeleteGlobalRef(batch);
+      }
+      if (batchClass) {
+        env->DeleteGlobalRef(batchClass);
+      }
+    }
+    batch = nullptr;
+    batchCapacity = 0;
+    batchClass = nullptr;
+    batchRunMethod = nullptr;
     threadEnv = nullptr;
   }
 };
 
 RunnableQueuePtr
-RunnableQueue::Create(JavaVM* aVM) {
+RunnableQueue::Create(JavaVM* aVM, const ClassLoaderAndroidPtr& aClassLoader) {
   RunnableQueuePtr result = std::make_shared<ConcreteClass<RunnableQueue, RunnableQueue::State> >();
   result->m.vm = aVM;
   JNIEnv* env = nullptr;
@@ -78,6 +190,9 @@ RunnableQueue::Create(JavaVM* aVM) {
     return nullptr;
   }
   result->m.Initialize(env);
+  if (aClassLoader) {
+    result->m.InitializeBatch(env, aClassLoader);
+  }
   return result;
 }
 
@@ -102,9 +217,19 @@ RunnableQueue::Clear() {
 
 void
 RunnableQueue::AddRunnable(JNIEnv* aEnv, jobject aRunnable) {
-  jobject runnable = aEnv->NewGlobalRef(aRunnable);
-  MutexAutoLock lock(m.lock);
-  m.list[m.AddPlace()].push_back(runnable);
+  RunnableNode* node = new RunnableNode;
+  node->runnable = aEnv->NewGlobalRef(aRunnable);
+  m.Push(node);
+}
+
+void
+RunnableQueue::AddTask(std::function<void()>&& aTask) {
+  if (!aTask) {
+    return;
+  }
+  RunnableNode* node = new RunnableNode;
+  node->task = std::move(aTask);
+  m.Push(node);
 }
 
 void
@@ -122,18 +247,27 @@ RunnableQueue::ProcessRunnables() {
     VRB_ERROR("Unable to process Runnables, runMethod is a nullptr in %s", __FILE__);
     return;
   }
-  {
-    MutexAutoLock lock(m.lock);
-    // Switch lists
-    m.count++;
+  // Work added while running is left for the next call.
+  m.TakeAll();
+  size_t javaStart = 0;
+  for (size_t ix = 0; ix < m.pending.size(); ix++) {
+    RunnableNode* node = m.pending[ix];
+    if (node->runnable) {
+      continue;
+    }
+    if (javaStart < ix) {
+      m.RunJava(javaStart, ix);
+    }
+    node->task();
+    javaStart = ix + 1;
+  }
+  if (javaStart < m.pending.size()) {
+    m.RunJava(javaStart, m.pending.size());
   }
-  const uint32_t place = m.ProcessPlace();
-  for (jobject& runnable: m.list[place]) {
-    m.threadEnv->CallVoidMethod(runnable, m.runMethod);
-    m.threadEnv->DeleteGlobalRef(runnable);
-    runnable = nullptr;
+  for (RunnableNode* node: m.pending) {
+    delete node;
   }
-  m.list[place].clear();
+  m.pending.clear();
 }
 
 RunnableQueue::RunnableQueue(State& aState) : m(aState) {}
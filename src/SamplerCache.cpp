@@ -0,0 +1,201 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/SamplerCache.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/GLError.h"
+#include "vrb/GLExtensions.h"
+#include "vrb/Logger.h"
+#include "vrb/RenderContext.h"
+#include "vrb/RenderState.h"
+#include "vrb/Texture.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+struct SamplerKey {
+  GLint minFilter;
+  GLint magFilter;
+  GLint wrapS;
+  GLint wrapT;
+  GLint wrapR;
+  bool operator==(const SamplerKey& aOther) const {
+    return (minFilter == aOther.minFilter) && (magFilter == aOther.magFilter) && (wrapS == aOther.wrapS) &&
+           (wrapT == aOther.wrapT) && (wrapR == aOther.wrapR);
+  }
+};
+
+struct SamplerKeyHash {
+  size_t operator()(const SamplerKey& aKey) const {
+    size_t result = 0;
+    const GLint kValues[] = {aKey.minFilter, aKey.magFilter, aKey.wrapS, aKey.wrapT, aKey.wrapR};
+    for (const GLint value: kValues) {
+      result = (result * 31) ^ std::hash<GLint>()(value);
+    }
+    return result;
+  }
+};
+
+bool
+IsMipmapped(const GLint aMinFilter) {
+  return (aMinFilter != GL_NEAREST) && (aMinFilter != GL_LINEAR);
+}
+
+} // namespace
+
+namespace vrb {
+
+struct SamplerCache::State {
+  GLExtensionsPtr glExtensions;
+  std::unordered_map<SamplerKey, GLuint, SamplerKeyHash> samplers;
+  bool supported;
+  float driverMaxAnisotropy;
+  float maxAnisotropy;
+  std::vector<float> tierAnisotropy;
+  // Anisotropy of the mipmapped samplers.
+  float appliedAnisotropy;
+
+  State()
+      : supported(false)
+      , driverMaxAnisotropy(1.0f)
+      , maxAnisotropy(1.0f)
+      , appliedAnisotropy(1.0f)
+  {}
+
+  float GetAnisotropy() const {
+    float result = maxAnisotropy;
+    if (!tierAnisotropy.empty()) {
+      const size_t kTier = (size_t)RenderState::GetQualityTier();
+      result = tierAnisotropy[std::min(kTier, tierAnisotropy.size() - 1)];
+    }
+    return std::max(1.0f, std::min(result, driverMaxAnisotropy));
+  }
+
+  void ApplyAnisotropy(const GLuint aSampler) {
+    VRB_GL_CHECK(glSamplerParameterf(aSampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, appliedAnisotropy));
+  }
+
+  void UpdateAnisotropy() {
+    const float kAnisotropy = GetAnisotropy();
+    if (kAnisotropy == appliedAnisotropy) {
+      return;
+    }
+    appliedAnisotropy = kAnisotropy;
+    for (const auto& entry: samplers) {
+      if (IsMipmapped(entry.first.minFilter)) {
+        ApplyAnisotropy(entry.second);
+      }
+    }
+  }
+
+  void Destroy() {
+    for (const auto& entry: samplers) {
+      VRB_GL_CHECK(glDeleteSamplers(1, &entry.second));
+    }
+    samplers.clear();
+  }
+};
+
+SamplerCachePtr
+SamplerCache::Create(RenderContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<SamplerCache, SamplerCache::State> >(aContext);
+}
+
+bool
+SamplerCache::IsSupported() const {
+  return m.supported;
+}
+
+GLuint
+SamplerCache::GetSampler(const Texture& aTexture) {
+  if (!m.supported) {
+    return 0;
+  }
+  const GLenum kTarget = aTexture.GetTarget();
+  if ((kTarget != GL_TEXTURE_2D) && (kTarget != GL_TEXTURE_CUBE_MAP) && (kTarget != GL_TEXTURE_2D_ARRAY)) {
+    return 0;
+  }
+  const SamplerKey kKey = {
+      aTexture.GetTextureParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR),
+      aTexture.GetTextureParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR),
+      aTexture.GetTextureParameter(GL_TEXTURE_WRAP_S, GL_REPEAT),
+      aTexture.GetTextureParameter(GL_TEXTURE_WRAP_T, GL_REPEAT),
+      aTexture.GetTextureParameter(GL_TEXTURE_WRAP_R, GL_REPEAT)};
+  auto found = m.samplers.find(kKey);
+  if (found != m.samplers.end()) {
+    return found->second;
+  }
+  GLuint sampler = 0;
+  VRB_GL_CHECK(glGenSamplers(1, &sampler));
+  VRB_GL_CHECK(glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, kKey.minFilter));
+  VRB_GL_CHECK(glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, kKey.magFilter));
+  VRB_GL_CHECK(glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, kKey.wrapS));
+  VRB_GL_CHECK(glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, kKey.wrapT));
+  VRB_GL_CHECK(glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, kKey.wrapR));
+  if (IsMipmapped(kKey.minFilter) && (m.appliedAnisotropy > 1.0f)) {
+    m.ApplyAnisotropy(sampler);
+  }
+  m.samplers[kKey] = sampler;
+  return sampler;
+}
+
+void
+SamplerCache::SetMaxAnisotropy(const float aAnisotropy) {
+  m.maxAnisotropy = aAnisotropy;
+  m.UpdateAnisotropy();
+}
+
+float
+SamplerCache::GetMaxAnisotropy() const {
+  return m.appliedAnisotropy;
+}
+
+void
+SamplerCache::SetTierAnisotropy(const std::vector<float>& aAnisotropy) {
+  m.tierAnisotropy = aAnisotropy;
+  m.UpdateAnisotropy();
+}
+
+size_t
+SamplerCache::GetCount() const {
+  return m.samplers.size();
+}
+
+void
+SamplerCache::InitializeGL() {
+  m.Destroy();
+  m.supported = m.glExtensions && m.glExtensions->IsExtensionSupported(GLExtensions::Ext::ARB_sampler_objects);
+  m.driverMaxAnisotropy = 1.0f;
+  if (m.supported && m.glExtensions->IsExtensionSupported(GLExtensions::Ext::EXT_texture_filter_anisotropic)) {
+    GLfloat driverMax = 1.0f;
+    VRB_GL_CHECK(glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &driverMax));
+    m.driverMaxAnisotropy = std::max(driverMax, 1.0f);
+  }
+  // Samplers created from now on get the anisotropy of the new context.
+  m.appliedAnisotropy = m.GetAnisotropy();
+}
+
+void
+SamplerCache::ShutdownGL() {
+  m.Destroy();
+}
+
+void
+SamplerCache::Update() {
+  if (!m.tierAnisotropy.empty()) {
+    m.UpdateAnisotropy();
+  }
+}
+
+SamplerCache::SamplerCache(State& aState, RenderContextPtr& aContext) : m(aState) {
+  m.glExtensions = aContext->GetGLExtensions();
+}
+
+SamplerCache::~SamplerCache() {}
+
+} // namespace vrb
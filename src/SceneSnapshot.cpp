@@ -0,0 +1,338 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/SceneSnapshot.h"
+
+#include "vrb/Bounds.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/CullVisitor.h"
+#include "vrb/DrawableList.h"
+#include "vrb/Group.h"
+#include "vrb/Light.h"
+#include "vrb/Matrix.h"
+#include "vrb/ParallelCuller.h"
+#include "vrb/TraceProfiler.h"
+
+#include <algorithm>
+
+namespace {
+
+// Subtrees smaller than this are not worth a job of their own.
+const uint32_t kMinJobSize = 64;
+// Jobs per thread, so threads that finish early can take more work.
+const uint32_t kJobsPerThread = 4;
+
+}
+
+namespace vrb {
+
+struct SceneSnapshot::State {
+  struct Entry {
+    Node* node;
+    const Matrix* transform;
+    Drawable* preRender;
+    Drawable* postRender;
+    // Parent entry, or -1 for the root.
+    int32_t parent;
+    // One past the last entry of the subtree. Leaves are their own subtree.
+    uint32_t end;
+    uint32_t firstLight;
+    uint32_t lightCount;
+    uint32_t revision;
+    // When set, the entries from this one to jobEnd are siblings culled by
+    // a ParallelCuller job, which uses jobStacks[job].
+    uint32_t jobEnd;
+    uint32_t job;
+    bool leaf;
+    // Set when the world transform was changed by the last Refresh.
+    bool moved;
+    // Transform applied to the children, or to the node itself for leaves.
+    Matrix world;
+    // Bounds of a Group in world space.
+    Bounds bounds;
+  };
+  GroupPtr root;
+  std::vector<Entry> entries;
+  std::vector<const Light*> lights;
+  // Groups entered and not yet left, while building and while culling.
+  std::vector<uint32_t> open;
+  uint32_t layoutRevision = 0;
+  bool built = false;
+  ParallelCullerPtr culler;
+  // Worker count the jobs were partitioned for, -1 when not partitioned.
+  int32_t partitionWorkers = -1;
+  // Open groups of each job, kept between frames.
+  std::vector<std::vector<uint32_t>> jobStacks;
+
+  Entry& Append(Node& aNode, const bool aLeaf);
+  void Build(SceneSnapshot& aSnapshot);
+  void Refresh(const bool aAll);
+  void Partition();
+  void PartitionGroup(const uint32_t aGroup, const uint32_t aJobSize);
+  void AddJob(const uint32_t aBegin, const uint32_t aEnd);
+  void CullRange(const uint32_t aBegin, const uint32_t aEnd, CullVisitor& aVisitor, DrawableList& aDrawables,
+                 std::vector<uint32_t>& aOpen, const bool aQueueJobs);
+  void Leave(const Entry& aEntry, DrawableList& aDrawables) const;
+};
+
+SceneSnapshot::State::Entry&
+SceneSnapshot::State::Append(Node& aNode, const bool aLeaf) {
+  entries.emplace_back();
+  Entry& entry = entries.back();
+  entry.node = &aNode;
+  entry.transform = nullptr;
+  entry.preRender = nullptr;
+  entry.postRender = nullptr;
+  entry.parent = open.empty() ? -1 : (int32_t)open.back();
+  entry.end = (uint32_t)entries.size();
+  entry.firstLight = (uint32_t)lights.size();
+  entry.lightCount = 0;
+  entry.revision = aNode.GetRevision();
+  entry.jobEnd = 0;
+  entry.job = 0;
+  entry.leaf = aLeaf;
+  entry.moved = false;
+  return entry;
+}
+
+void
+SceneSnapshot::State::Build(SceneSnapshot& aSnapshot) {
+  VRB_TRACE_ZONE("SceneSnapshot::Build");
+  entries.clear();
+  lights.clear();
+  open.clear();
+  built = false;
+  if (!root) {
+    return;
+  }
+  layoutRevision = root->GetLayoutRevision();
+  root->Flatten(aSnapshot);
+  built = true;
+  partitionWorkers = -1;
+  Refresh(true);
+}
+
+void
+SceneSnapshot::State::Refresh(const bool aAll) {
+  const Matrix kIdentity = Matrix::Identity();
+  uint32_t ix = 0;
+  while (ix < entries.size()) {
+    Entry& entry = entries[ix];
+    const Entry* parent = entry.parent >= 0 ? &entries[entry.parent] : nullptr;
+    const uint32_t kRevision = entry.node->GetRevision();
+    const bool kParentMoved = parent && parent->moved;
+    if (!aAll && (kRevision == entry.revision) && !kParentMoved) {
+      // Nothing changed in the subtree, or above it.
+      entry.moved = false;
+      ix = entry.end;
+      continue;
+    }
+    const Matrix& kParentWorld = parent ? parent->world : kIdentity;
+    entry.revision = kRevision;
+    entry.moved = false;
+    if (aAll || kParentMoved || entry.transform) {
+      const Matrix kWorld = !entry.transform ? kParentWorld :
+                            (entry.transform->IsAffine() ? kParentWorld.AffinePostMultiply(*entry.transform) : kParentWorld.PostMultiply(*entry.transform));
+      entry.moved = aAll || !std::equal(kWorld.Data(), kWorld.Data() + 16, entry.world.Data());
+      entry.world = kWorld;
+    }
+    if (!entry.leaf) {
+      // Bounds of a node are in the space of its parent.
+      entry.bounds = entry.node->GetBounds().Transform(kParentWorld);
+    }
+    ix++;
+  }
+}
+
+void
+SceneSnapshot::State::Partition() {
+  VRB_TRACE_ZONE("SceneSnapshot::Partition");
+  for (Entry& entry: entries) {
+    entry.jobEnd = 0;
+  }
+  jobStacks.clear();
+  partitionWorkers = culler ? culler->GetWorkerCount() : 0;
+  if ((partitionWorkers <= 0) || entries.empty() || entries.front().leaf) {
+    return;
+  }
+  const uint32_t kThreads = (uint32_t)partitionWorkers + 1;
+  const uint32_t kJobSize = std::max(kMinJobSize, (uint32_t)entries.size() / (kThreads * kJobsPerThread));
+  if (entries.size() >= (kJobSize * 2)) {
+    PartitionGroup(0, kJobSize);
+  }
+}
+
+void
+SceneSnapshot::State::PartitionGroup(const uint32_t aGroup, const uint32_t aJobSize) {
+  // Large children are split further, runs of small siblings become one job.
+  // Runs too small to pay for a job are left to the calling thread.
+  uint32_t batch = aGroup + 1;
+  auto flush = [&](const uint32_t aEnd) {
+    if ((aEnd - batch) >= (aJobSize / 4)) {
+      AddJob(batch, aEnd);
+    }
+  };
+  uint32_t child = aGroup + 1;
+  const uint32_t kEnd = entries[aGroup].end;
+  while (child < kEnd) {
+    const Entry& entry = entries[child];
+    if (!entry.leaf && ((entry.end - child) > aJobSize)) {
+      flush(child);
+      PartitionGroup(child, aJobSize);
+      batch = entry.end;
+    } else if ((entry.end - batch) >= aJobSize) {
+      AddJob(batch, entry.end);
+      batch = entry.end;
+    }
+    child = entry.end;
+  }
+  flush(kEnd);
+}
+
+void
+SceneSnapshot::State::AddJob(const uint32_t aBegin, const uint32_t aEnd) {
+  entries[aBegin].jobEnd = aEnd;
+  entries[aBegin].job = (uint32_t)jobStacks.size();
+  jobStacks.emplace_back();
+}
+
+void
+SceneSnapshot::State::CullRange(const uint32_t aBegin, const uint32_t aEnd, CullVisitor& aVisitor, DrawableList& aDrawables,
+                                std::vector<uint32_t>& aOpen, const bool aQueueJobs) {
+  aOpen.clear();
+  uint32_t ix = aBegin;
+  while (ix < aEnd) {
+    while (!aOpen.empty() && (entries[aOpen.back()].end <= ix)) {
+      Leave(entries[aOpen.back()], aDrawables);
+      aOpen.pop_back();
+    }
+    const Entry& entry = entries[ix];
+    if (aQueueJobs && entry.jobEnd) {
+      const uint32_t kBegin = ix;
+      std::vector<uint32_t>* stack = &jobStacks[entry.job];
+      culler->Queue(aVisitor, aDrawables, [this, kBegin, stack](CullVisitor& aJobVisitor, DrawableList& aSegment) {
+        CullRange(kBegin, entries[kBegin].jobEnd, aJobVisitor, aSegment, *stack, false);
+      });
+      ix = entry.jobEnd;
+      continue;
+    }
+    if (entry.leaf) {
+      aVisitor.PushTransform(entry.world);
+      entry.node->Cull(aVisitor, aDrawables);
+      aVisitor.PopTransform();
+      ix++;
+      continue;
+    }
+    if (!aVisitor.IsVisible(entry.bounds)) {
+      ix = entry.end;
+      continue;
+    }
+    for (uint32_t light = 0; light < entry.lightCount; light++) {
+      aDrawables.PushLight(*lights[entry.firstLight + light]);
+    }
+    // Lambdas are added post first and pre last because the DrawablesList is FILO.
+    if (entry.postRender) {
+      aDrawables.AddDrawable(*entry.postRender, Matrix());
+    }
+    aOpen.push_back(ix);
+    ix++;
+  }
+  while (!aOpen.empty()) {
+    Leave(entries[aOpen.back()], aDrawables);
+    aOpen.pop_back();
+  }
+}
+
+void
+SceneSnapshot::State::Leave(const Entry& aEntry, DrawableList& aDrawables) const {
+  if (aEntry.preRender) {
+    aDrawables.AddDrawable(*aEntry.preRender, Matrix());
+  }
+  aDrawables.PopLights(aEntry.lightCount);
+}
+
+SceneSnapshotPtr
+SceneSnapshot::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<SceneSnapshot, SceneSnapshot::State> >(aContext);
+}
+
+void
+SceneSnapshot::SetRoot(const GroupPtr& aRoot) {
+  m.root = aRoot;
+  m.built = false;
+  m.entries.clear();
+  m.lights.clear();
+}
+
+void
+SceneSnapshot::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  VRB_TRACE_ZONE("SceneSnapshot::Cull");
+  if (!m.root) {
+    return;
+  }
+  if (!m.built || (m.root->GetLayoutRevision() != m.layoutRevision)) {
+    m.Build(*this);
+  } else if (m.root->GetRevision() != m.entries.front().revision) {
+    m.Refresh(false);
+  }
+
+  if (!m.culler || (m.culler->GetWorkerCount() <= 0)) {
+    m.CullRange(0, (uint32_t)m.entries.size(), aVisitor, aDrawables, m.open, false);
+    return;
+  }
+  if (m.partitionWorkers != m.culler->GetWorkerCount()) {
+    m.Partition();
+  }
+  m.CullRange(0, (uint32_t)m.entries.size(), aVisitor, aDrawables, m.open, true);
+  m.culler->Wait();
+}
+
+void
+SceneSnapshot::SetParallelCuller(const ParallelCullerPtr& aCuller) {
+  // Partitions only depend on the worker count, so cullers may be swapped
+  // between passes without splitting the graph again.
+  if (!aCuller || !m.culler || (aCuller->GetWorkerCount() != m.culler->GetWorkerCount())) {
+    m.partitionWorkers = -1;
+  }
+  m.culler = aCuller;
+}
+
+int32_t
+SceneSnapshot::GetEntryCount() const {
+  return (int32_t)m.entries.size();
+}
+
+void
+SceneSnapshot::AddNode(Node& aNode) {
+  m.Append(aNode, true);
+}
+
+void
+SceneSnapshot::BeginGroup(Node& aNode, const Matrix* aTransform, const std::vector<LightPtr>& aLights,
+                          Drawable* aPreRender, Drawable* aPostRender) {
+  State::Entry& entry = m.Append(aNode, false);
+  entry.transform = aTransform;
+  entry.preRender = aPreRender;
+  entry.postRender = aPostRender;
+  entry.lightCount = (uint32_t)aLights.size();
+  for (const LightPtr& light: aLights) {
+    m.lights.push_back(light.get());
+  }
+  m.open.push_back((uint32_t)m.entries.size() - 1);
+}
+
+void
+SceneSnapshot::EndGroup() {
+  if (m.open.empty()) {
+    return;
+  }
+  m.entries[m.open.back()].end = (uint32_t)m.entries.size();
+  m.open.pop_back();
+}
+
+SceneSnapshot::SceneSnapshot(State& aState, CreationContextPtr& aContext) : m(aState) {}
+SceneSnapshot::~SceneSnapshot() {}
+
+} // namespace vrb
@@ -0,0 +1,197 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/ShaderQualityScaler.h"
+#include "vrb/private/UpdatableState.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+#include "vrb/PerformanceMonitor.h"
+#include "vrb/RenderContext.h"
+#include "vrb/RenderState.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// Same pacing as the ResolutionScaler, the PerformanceMonitor needs about
+// six seconds to reflect a step.
+const double kLowerInterval = 6.0;
+const double kRaiseInterval = 10.0;
+
+}
+
+namespace vrb {
+
+namespace {
+
+// PerformanceMonitorObserver may not be a base of an Updatable, so the
+// scaler forwards the signals through this object.
+class QualityObserver : public PerformanceMonitorObserver {
+public:
+  std::function<void(const bool)> callback;
+  void PoorPerformanceDetected(const double& aTargetFrameRate, const double& aAverageFrameRate) override {
+    if (callback) { callback(true); }
+  }
+  void PerformanceRestored(const double& aTargetFrameRate, const double& aAverageFrameRate) override {
+    if (callback) { callback(false); }
+  }
+  QualityObserver() = default;
+  ~QualityObserver() = default;
+};
+
+} // namespace
+
+struct ShaderQualityScaler::State : public Updatable::State {
+  RenderContextWeak context;
+  std::weak_ptr<PerformanceMonitor> monitor;
+  std::shared_ptr<QualityObserver> observer;
+  int maxTier;
+  // Tier not raised above, see SetMinTier().
+  int minTier;
+  int tier;
+  bool poor;
+  double lastStep;
+
+  State()
+      : maxTier(1)
+      , minTier(0)
+      , tier(0)
+      , poor(false)
+      , lastStep(-1.0)
+  {}
+
+  int Floor() const {
+    return std::min(minTier, maxTier);
+  }
+
+  double GetTimestamp() const {
+    RenderContextPtr render = context.lock();
+    return render ? render->GetTimestamp() : 0.0;
+  }
+
+  void Step(const int aTier, const double aTimestamp) {
+    tier = aTier;
+    lastStep = aTimestamp;
+    RenderState::SetQualityTier(tier);
+    VRB_LOG("ShaderQualityScaler tier set to %d", tier);
+  }
+
+  void PoorPerformanceDetected() {
+    poor = true;
+    const double kNow = GetTimestamp();
+    if (tier < maxTier) {
+      Step(tier + 1, kNow);
+    } else {
+      lastStep = kNow;
+    }
+  }
+
+  void PerformanceRestored() {
+    poor = false;
+    lastStep = GetTimestamp();
+  }
+
+  void RemoveObserver() {
+    PerformanceMonitorPtr current = monitor.lock();
+    if (current && observer) {
+      current->RemovePerformanceMonitorObserver(*observer);
+    }
+    if (observer) {
+      observer->callback = nullptr;
+    }
+    observer = nullptr;
+    monitor.reset();
+  }
+};
+
+ShaderQualityScalerPtr
+ShaderQualityScaler::Create(RenderContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<ShaderQualityScaler, ShaderQualityScaler::State> >(aContext);
+}
+
+void
+ShaderQualityScaler::SetPerformanceMonitor(const PerformanceMonitorPtr& aMonitor) {
+  m.RemoveObserver();
+  if (!aMonitor) {
+    return;
+  }
+  ShaderQualityScaler* self = this;
+  m.observer = std::make_shared<QualityObserver>();
+  m.observer->callback = [self](const bool aPoor) {
+    if (aPoor) {
+      self->m.PoorPerformanceDetected();
+    } else {
+      self->m.PerformanceRestored();
+    }
+    self->Wake();
+  };
+  m.monitor = aMonitor;
+  aMonitor->AddPerformanceMonitorObserver(m.observer);
+}
+
+void
+ShaderQualityScaler::SetMaxTier(const int aTier) {
+  m.maxTier = std::max(aTier, 0);
+  if (m.tier > m.maxTier) {
+    m.Step(m.maxTier, m.GetTimestamp());
+  }
+  Wake();
+}
+
+void
+ShaderQualityScaler::SetMinTier(const int aTier) {
+  m.minTier = std::max(aTier, 0);
+  if (m.tier < m.Floor()) {
+    m.Step(m.Floor(), m.GetTimestamp());
+  }
+  Wake();
+}
+
+int
+ShaderQualityScaler::GetTier() const {
+  return m.tier;
+}
+
+void
+ShaderQualityScaler::UpdateResource(RenderContext& aContext) {
+  if (m.lastStep < 0.0) {
+    // Woken by the monitor signals.
+    Sleep(aContext);
+    return;
+  }
+  const double kNow = aContext.GetTimestamp();
+  if (m.poor) {
+    // Still no restored signal, keep lowering.
+    if (((kNow - m.lastStep) >= kLowerInterval) && (m.tier < m.maxTier)) {
+      m.Step(m.tier + 1, kNow);
+    }
+  } else if ((m.tier > m.Floor()) && ((kNow - m.lastStep) >= kRaiseInterval)) {
+    m.Step(m.tier - 1, kNow);
+  }
+  if (m.poor && (m.tier < m.maxTier)) {
+    SleepUntil(aContext, m.lastStep + kLowerInterval);
+  } else if (!m.poor && (m.tier > m.Floor())) {
+    SleepUntil(aContext, m.lastStep + kRaiseInterval);
+  } else {
+    Sleep(aContext);
+  }
+}
+
+ShaderQualityScaler::ShaderQualityScaler(State& aState, RenderContextPtr& aContext)
+    : Updatable(aState, aContext->GetRenderThreadCreationContext())
+    , m(aState) {
+  m.context = aContext;
+}
+
+ShaderQualityScaler::~ShaderQualityScaler() {
+  m.RemoveObserver();
+  if (m.tier > 0) {
+    RenderState::SetQualityTier(0);
+  }
+}
+
+} // namespace vrb
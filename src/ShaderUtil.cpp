@@ -4,11 +4,33 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "vrb/ShaderUtil.h"
+#include "vrb/BasicShaders.h"
 #include "vrb/GLError.h"
+#include "vrb/LoadReport.h"
 #include "vrb/Logger.h"
 
 #include <memory>
 
+namespace {
+
+bool
+CheckShaderCompiled(GLuint aShader) {
+  GLint compiled = 0;
+  VRB_GL_CHECK(glGetShaderiv(aShader, GL_COMPILE_STATUS, &compiled));
+  if (!compiled) {
+    GLint length = 0;
+    glGetShaderiv(aShader, GL_INFO_LOG_LENGTH, &length);
+    if (length > 1) {
+      std::unique_ptr<char[]> log = std::make_unique<char[]>(length);
+      VRB_GL_CHECK(glGetShaderInfoLog(aShader, length, nullptr, log.get()));
+      VRB_ERROR("Failed to compile shader:\n%s", log.get());
+    }
+  }
+  return compiled != 0;
+}
+
+} // namespace
+
 namespace vrb {
 
 GLint
@@ -41,51 +63,109 @@ GetUniformLocation(GLuint aProgram, const std::string& aName) {
 
 GLuint
 LoadShader(GLenum aType, const char* aSrc) {
+  GLuint shader = CompileShader(aType, aSrc);
+  if (shader && !CheckShaderCompiled(shader)) {
+    VRB_ERROR("From source:\n%s", aSrc);
+  }
+  return shader;
+}
+
+GLuint
+CreateProgram(GLuint aVertexShader, GLuint aFragmentShader) {
+  return CreateProgram(aVertexShader, aFragmentShader, false);
+}
+
+GLuint
+CreateProgram(GLuint aVertexShader, GLuint aFragmentShader, const bool aRetrievable) {
+  GLuint program = LinkProgram(aVertexShader, aFragmentShader, aRetrievable);
+  if (!CheckProgramLinked(program, 0, 0)) {
+    VRB_GL_CHECK(glDeleteProgram(program));
+    program = 0;
+  }
+  return program;
+}
+
+GLuint
+CreateComputeProgram(GLuint aComputeShader) {
+  LoadReportTimer timer(LoadReport::Phase::ShaderCompile);
+  GLuint program = VRB_GL_CHECK(glCreateProgram());
+  VRB_GL_CHECK(glAttachShader(program, aComputeShader));
+  VRB_GL_CHECK(glLinkProgram(program));
+  if (!CheckProgramLinked(program, aComputeShader, 0)) {
+    VRB_GL_CHECK(glDeleteProgram(program));
+    program = 0;
+  }
+  return program;
+}
+
+GLuint
+CompileShader(GLenum aType, const char* aSrc) {
+  LoadReportTimer timer(LoadReport::Phase::ShaderCompile);
   GLuint shader = VRB_GL_CHECK(glCreateShader(aType));
 
   if (shader == 0) {
     VRB_ERROR("FAILED to create shader of type: %s", (aType == GL_VERTEX_SHADER ? "vertex shader" : "fragment shader"));
+    return 0;
   }
 
   VRB_GL_CHECK(glShaderSource(shader, 1, &aSrc, nullptr));
   VRB_GL_CHECK(glCompileShader(shader));
-  GLint compiled = 0;
-  VRB_GL_CHECK(glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled));
-
-  if (!compiled) {
-    GLint length = 0;
-    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
-    if (length > 1) {
-      std::unique_ptr<char[]> log = std::make_unique<char[]>(length);
-      VRB_GL_CHECK(glGetShaderInfoLog(shader, length, nullptr, log.get()));
-      VRB_ERROR("Failed to compile shader:\n%s", log.get());
-      VRB_ERROR("From source:\n%s", aSrc);
-    }
-  }
-
   return shader;
 }
 
 GLuint
-CreateProgram(GLuint aVertexShader, GLuint aFragmentShader) {
+LinkProgram(GLuint aVertexShader, GLuint aFragmentShader, const bool aRetrievable) {
+  LoadReportTimer timer(LoadReport::Phase::ShaderCompile);
   GLuint program = VRB_GL_CHECK(glCreateProgram());
+  if (aRetrievable) {
+    VRB_GL_CHECK(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+  }
   VRB_GL_CHECK(glAttachShader(program, aVertexShader));
   VRB_GL_CHECK(glAttachShader(program, aFragmentShader));
+  // Names missing from the shaders are ignored.
+  VRB_GL_CHECK(glBindAttribLocation(program, VRB_ATTRIBUTE_POSITION, "a_position"));
+  VRB_GL_CHECK(glBindAttribLocation(program, VRB_ATTRIBUTE_NORMAL, "a_normal"));
+  VRB_GL_CHECK(glBindAttribLocation(program, VRB_ATTRIBUTE_UV, "a_uv"));
+  VRB_GL_CHECK(glBindAttribLocation(program, VRB_ATTRIBUTE_COLOR, "a_color"));
+  VRB_GL_CHECK(glBindAttribLocation(program, VRB_ATTRIBUTE_JOINT_INDICES, "a_jointIndices"));
+  VRB_GL_CHECK(glBindAttribLocation(program, VRB_ATTRIBUTE_JOINT_WEIGHTS, "a_jointWeights"));
+  VRB_GL_CHECK(glBindAttribLocation(program, VRB_ATTRIBUTE_INSTANCE_MODEL, "a_instanceModel"));
   VRB_GL_CHECK(glLinkProgram(program));
+  return program;
+}
+
+bool
+IsProgramComplete(GLuint aProgram) {
+  GLint complete = 0;
+  VRB_GL_CHECK(glGetProgramiv(aProgram, GL_COMPLETION_STATUS_KHR, &complete));
+  return complete != 0;
+}
+
+bool
+CheckProgramLinked(GLuint aProgram, GLuint aVertexShader, GLuint aFragmentShader) {
+  if (!aProgram) {
+    return false;
+  }
   GLint linked = 0;
-  VRB_GL_CHECK(glGetProgramiv(program, GL_LINK_STATUS, &linked));
-  if (!linked) {
-    GLint length = 0;
-    VRB_GL_CHECK(glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length));
-    if (length > 1) {
-      std::unique_ptr<char[]> log = std::make_unique<char[]>(length);
-      VRB_GL_CHECK(glGetProgramInfoLog(program, length, nullptr, log.get()));
-      VRB_ERROR("Failed to link program:\n%s", log.get());
-    }
-    VRB_GL_CHECK(glDeleteProgram(program));
-    program = 0;
+  VRB_GL_CHECK(glGetProgramiv(aProgram, GL_LINK_STATUS, &linked));
+  if (linked) {
+    return true;
   }
-  return program;
+  // A deferred compile has not reported its errors yet.
+  if (aVertexShader) {
+    CheckShaderCompiled(aVertexShader);
+  }
+  if (aFragmentShader) {
+    CheckShaderCompiled(aFragmentShader);
+  }
+  GLint length = 0;
+  VRB_GL_CHECK(glGetProgramiv(aProgram, GL_INFO_LOG_LENGTH, &length));
+  if (length > 1) {
+    std::unique_ptr<char[]> log = std::make_unique<char[]>(length);
+    VRB_GL_CHECK(glGetProgramInfoLog(aProgram, length, nullptr, log.get()));
+    VRB_ERROR("Failed to link program:\n%s", log.get());
+  }
+  return false;
 }
 
 } // namespace vrb
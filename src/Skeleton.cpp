@@ -0,0 +1,88 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/Skeleton.h"
+#include "vrb/private/SkeletonState.h"
+
+#include "vrb/BasicShaders.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/RenderContext.h"
+#include "vrb/Transform.h"
+#include "vrb/TransformAnimator.h"
+
+namespace vrb {
+
+void
+Skeleton::State::UpdatePalette() {
+  // Parents come first so their pose is always computed before their children.
+  for (size_t ix = 0; ix < joints.size(); ix++) {
+    const Joint& joint = joints[ix];
+    const Matrix& local = joint.transform->GetTransform();
+    poses[ix] = joint.parent < 0 ? local : poses[joint.parent].PostMultiply(local);
+    palette[ix] = poses[ix].PostMultiply(joint.inverseBind);
+  }
+}
+
+SkeletonPtr
+Skeleton::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<Skeleton, Skeleton::State> >(aContext);
+}
+
+int32_t
+Skeleton::AddJoint(const TransformPtr& aTransform, const Matrix& aInverseBind, const int32_t aParent) {
+  const int32_t kIndex = (int32_t)m.joints.size();
+  if (!aTransform || (aParent >= kIndex)) {
+    VRB_ERROR("Invalid Skeleton joint, parent %d must be added before joint %d", aParent, kIndex);
+    return -1;
+  }
+  if (kIndex >= VRB_MAX_JOINTS) {
+    VRB_WARN("Skeleton joint %d exceeds the %d joints uploaded to the shader", kIndex, VRB_MAX_JOINTS);
+  }
+  m.joints.push_back({aTransform, aParent < 0 ? -1 : aParent, aInverseBind});
+  m.poses.resize(m.joints.size());
+  m.palette.resize(m.joints.size());
+  m.UpdatePalette();
+  return kIndex;
+}
+
+int32_t
+Skeleton::GetJointCount() const {
+  return (int32_t)m.joints.size();
+}
+
+TransformPtr
+Skeleton::GetJoint(const int32_t aIndex) const {
+  if ((aIndex < 0) || (aIndex >= (int32_t)m.joints.size())) {
+    return nullptr;
+  }
+  return m.joints[aIndex].transform;
+}
+
+const Matrix*
+Skeleton::GetPalette() const {
+  return m.palette.empty() ? nullptr : m.palette.data();
+}
+
+Skeleton::Skeleton(State& aState, CreationContextPtr& aContext) : Updatable(aState, aContext), m(aState) {}
+
+Skeleton::~Skeleton() {
+  TransformAnimatorPtr animator = m.animator.lock();
+  if (animator) {
+    animator->RemoveSkeleton(*this);
+  }
+}
+
+void
+Skeleton::UpdateResource(RenderContext& aContext) {
+  // Like AnimatedTransform, the skeleton moves to the TransformAnimator on its
+  // first update so every palette is rebuilt in the same pass.
+  TransformAnimatorPtr& animator = aContext.GetTransformAnimator();
+  animator->AddSkeleton(*this);
+  m.Unlink();
+}
+
+} // namespace vrb
@@ -0,0 +1,217 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/StreamBuffer.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/GLError.h"
+#include "vrb/GLExtensions.h"
+#include "vrb/Logger.h"
+#include "vrb/MemoryCounter.h"
+#include "vrb/RenderContext.h"
+
+#include <string.h>
+
+namespace {
+
+const size_t kFrameCount = 3;
+const size_t kDefaultFrameSize = 1024 * 1024;
+// A frame the GPU has not finished after this long is overwritten anyway.
+const GLuint64 kFenceTimeout = 100000000; // 100 ms
+
+} // namespace
+
+namespace vrb {
+
+struct StreamBuffer::State {
+  GLExtensionsPtr glExtensions;
+  size_t frameSize;
+  GLuint buffer;
+  uint8_t* mapped;
+  size_t frame;
+  size_t used;
+  GLsync fences[kFrameCount];
+  MemoryTracker memory;
+
+  State()
+      : frameSize(kDefaultFrameSize)
+      , buffer(0)
+      , mapped(nullptr)
+      , frame(0)
+      , used(0)
+      , fences()
+      , memory(MemoryType::VertexBuffer)
+  {}
+  bool CreatePersistent(const GLsizeiptr aSize);
+  void Destroy();
+};
+
+bool
+StreamBuffer::State::CreatePersistent(const GLsizeiptr aSize) {
+  if (!glExtensions || !glExtensions->IsExtensionSupported(GLExtensions::Ext::EXT_buffer_storage)) {
+    return false;
+  }
+  const GLbitfield kFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+  VRB_GL_CHECK(glExtensions->GetFunctions().glBufferStorageEXT(GL_ARRAY_BUFFER, aSize, nullptr, kFlags));
+  VRB_GL_CHECK(mapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, aSize, kFlags));
+  if (!mapped) {
+    // Immutable storage can not be respecified, so the name is replaced.
+    VRB_WARN("Failed to map the stream buffer persistently, mapping each write");
+    VRB_GL_CHECK(glDeleteBuffers(1, &buffer));
+    VRB_GL_CHECK(glGenBuffers(1, &buffer));
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+    return false;
+  }
+  return true;
+}
+
+void
+StreamBuffer::State::Destroy() {
+  for (GLsync& fence: fences) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+  if (buffer) {
+    if (mapped) {
+      VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+      VRB_GL_CHECK(glUnmapBuffer(GL_ARRAY_BUFFER));
+      VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    }
+    VRB_GL_CHECK(glDeleteBuffers(1, &buffer));
+    buffer = 0;
+  }
+  mapped = nullptr;
+  frame = 0;
+  used = 0;
+  memory.Set(0);
+}
+
+StreamBufferPtr
+StreamBuffer::Create(RenderContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<StreamBuffer, StreamBuffer::State> >(aContext);
+}
+
+void
+StreamBuffer::SetFrameSize(const size_t aSize) {
+  m.frameSize = aSize;
+}
+
+size_t
+StreamBuffer::GetFrameSize() const {
+  return m.frameSize;
+}
+
+GLintptr
+StreamBuffer::Write(const void* aData, const size_t aSize, const size_t aAlignment) {
+  if (!m.buffer || (aSize == 0)) {
+    return -1;
+  }
+  const size_t kAlignment = aAlignment > 0 ? aAlignment : 1;
+  const size_t kStart = ((m.used + kAlignment - 1) / kAlignment) * kAlignment;
+  if ((kStart > m.frameSize) || (aSize > m.frameSize - kStart)) {
+    return -1;
+  }
+  const size_t kOffset = (m.frame * m.frameSize) + kStart;
+  if (m.mapped) {
+    memcpy(m.mapped + kOffset, aData, aSize);
+  } else {
+    // The fence of this region has been waited on, nothing reads the range.
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.buffer));
+    uint8_t* target = nullptr;
+    VRB_GL_CHECK(target = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)kOffset, (GLsizeiptr)aSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    if (!target) {
+      VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+      return -1;
+    }
+    memcpy(target, aData, aSize);
+    VRB_GL_CHECK(glUnmapBuffer(GL_ARRAY_BUFFER));
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  }
+  VRB_GL_STATS_ADD(BufferUploadBytes, aSize);
+  m.used = kStart + aSize;
+  return (GLintptr)kOffset;
+}
+
+bool
+StreamBuffer::Overwrite(const GLintptr aOffset, const void* aData, const size_t aSize) {
+  if (!m.mapped || (aOffset < 0)) {
+    return false;
+  }
+  const size_t kStart = m.frame * m.frameSize;
+  const size_t kOffset = (size_t)aOffset;
+  if ((kOffset < kStart) || (kOffset - kStart > m.used) || (aSize > m.used - (kOffset - kStart))) {
+    return false;
+  }
+  // Coherent, the GPU sees the copy in the commands it has not executed yet.
+  memcpy(m.mapped + kOffset, aData, aSize);
+  VRB_GL_STATS_ADD(BufferUploadBytes, aSize);
+  return true;
+}
+
+GLuint
+StreamBuffer::GetHandle() const {
+  return m.buffer;
+}
+
+bool
+StreamBuffer::IsPersistent() const {
+  return m.mapped != nullptr;
+}
+
+void
+StreamBuffer::InitializeGL() {
+  m.Destroy();
+  if (m.frameSize == 0) {
+    return;
+  }
+  const GLsizeiptr kSize = (GLsizeiptr)(m.frameSize * kFrameCount);
+  VRB_GL_CHECK(glGenBuffers(1, &m.buffer));
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.buffer));
+  if (!m.CreatePersistent(kSize)) {
+    VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, kSize, nullptr, GL_STREAM_DRAW));
+  }
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  m.memory.Set((size_t)kSize);
+}
+
+void
+StreamBuffer::ShutdownGL() {
+  m.Destroy();
+}
+
+void
+StreamBuffer::NextFrame() {
+  if (!m.buffer) {
+    return;
+  }
+  if (m.used > 0) {
+    VRB_GL_CHECK(m.fences[m.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+  }
+  m.frame = (m.frame + 1) % kFrameCount;
+  m.used = 0;
+  GLsync& fence = m.fences[m.frame];
+  if (!fence) {
+    return;
+  }
+  const GLenum kStatus = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeout);
+  if (kStatus == GL_TIMEOUT_EXPIRED) {
+    VRB_WARN("Stream buffer frame still in use after %d ms", (int)(kFenceTimeout / 1000000));
+  } else if (kStatus == GL_WAIT_FAILED) {
+    VRB_ERROR("Failed to wait for stream buffer fence");
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+StreamBuffer::StreamBuffer(State& aState, RenderContextPtr& aContext) : m(aState) {
+  m.glExtensions = aContext->GetGLExtensions();
+}
+
+StreamBuffer::~StreamBuffer() {}
+
+} // namespace vrb
@@ -6,14 +6,20 @@
 #include "vrb/SurfaceTextureFactory.h"
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/private/UpdatableState.h"
+#include "vrb/ClassLoaderAndroid.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/GLError.h"
 #include "vrb/JNIException.h"
 #include "vrb/Logger.h"
 
+#include <atomic>
 #include <forward_list>
 #include <memory>
 
+#define JNI_METHOD(return_type, method_name) \
+  JNIEXPORT return_type JNICALL              \
+    Java_org_mozilla_vrb_SurfaceTextureListener_##method_name
+
 namespace {
 
 struct SurfaceTextureRecord {
@@ -22,20 +28,33 @@ struct SurfaceTextureRecord {
   jobject surface;
   GLuint texture;
   bool attached;
-
-  SurfaceTextureRecord() : surface(nullptr), texture(0) {}
+  // org.mozilla.vrb.SurfaceTextureListener setting frameAvailable from the
+  // thread delivering onFrameAvailable. Without it the surface is updated
+  // every frame.
+  jobject listener;
+  std::unique_ptr<std::atomic<bool>> frameAvailable;
+  // SurfaceTexture.getTimestamp of the last updated frame, in nanoseconds.
+  int64_t timestamp;
+
+  SurfaceTextureRecord() : surface(nullptr), texture(0), attached(false), listener(nullptr), timestamp(0) {}
   SurfaceTextureRecord(const std::string& aName, const vrb::SurfaceTextureObserverPtr& aObserver)
       : name(aName)
       , observer(aObserver)
       , surface(nullptr)
       , texture(0)
       , attached(false)
+      , listener(nullptr)
+      , timestamp(0)
   {}
   SurfaceTextureRecord(SurfaceTextureRecord&& aRecord)
       : name(aRecord.name)
       , observer(std::move(aRecord.observer))
       , surface(aRecord.surface)
       , texture(aRecord.texture)
+      , attached(aRecord.attached)
+      , listener(aRecord.listener)
+      , frameAvailable(std::move(aRecord.frameAvailable))
+      , timestamp(aRecord.timestamp)
   {}
 
   SurfaceTextureRecord& operator=(SurfaceTextureRecord&& aRecord) {
@@ -43,17 +62,30 @@ struct SurfaceTextureRecord {
     observer = std::move(aRecord.observer);
     surface = aRecord.surface;
     texture = aRecord.texture;
+    attached = aRecord.attached;
+    listener = aRecord.listener;
+    frameAvailable = std::move(aRecord.frameAvailable);
+    timestamp = aRecord.timestamp;
     return *this;
   }
 
-  void Release(JNIEnv* aEnv);
+  void Release(JNIEnv* aEnv, jmethodID aReleaseListener);
 };
 
 void
-SurfaceTextureRecord::Release(JNIEnv* aEnv) {
+SurfaceTextureRecord::Release(JNIEnv* aEnv, jmethodID aReleaseListener) {
   if (observer) {
     observer->SurfaceTextureDestroyed(name);
   }
+  if (aEnv && listener) {
+    // Waits for a callback in progress, frameAvailable may be freed after.
+    if (aReleaseListener) {
+      aEnv->CallVoidMethod(listener, aReleaseListener);
+      VRB_CHECK_JNI_EXCEPTION(aEnv);
+    }
+    aEnv->DeleteGlobalRef(listener);
+    listener = nullptr;
+  }
   if (aEnv && surface) {
     aEnv->DeleteGlobalRef(surface);
     surface = nullptr;
@@ -76,6 +108,13 @@ struct SurfaceTextureFactory::State : public Updatable::State, public ResourceGL
   jmethodID attachToGLContextMethod;
   jmethodID detachFromGLContextMethod;
   jmethodID isReleasedMethod;
+  jmethodID getTimestampMethod;
+  jmethodID setListenerMethod;
+  jclass listenerClass;
+  jmethodID listenerCtor;
+  jmethodID listenerReleaseMethod;
+  ClassLoaderAndroidPtr classLoader;
+  bool classesLoaded;
   std::forward_list<SurfaceTextureRecord> textures;
   std::forward_list<SurfaceTextureObserverPtr> observers;
 
@@ -87,10 +126,18 @@ struct SurfaceTextureFactory::State : public Updatable::State, public ResourceGL
       , attachToGLContextMethod(nullptr)
       , detachFromGLContextMethod(nullptr)
       , isReleasedMethod(nullptr)
+      , getTimestampMethod(nullptr)
+      , setListenerMethod(nullptr)
+      , listenerClass(nullptr)
+      , listenerCtor(nullptr)
+      , listenerReleaseMethod(nullptr)
+      , classesLoaded(false)
   {}
 
   bool Contains(const std::string& aName);
-  void Initialize(JNIEnv* aEnv);
+  void Initialize(JNIEnv* aEnv, const ClassLoaderAndroidPtr& aClassLoader);
+  void LoadClasses();
+  void AddListener(SurfaceTextureRecord& aRecord);
   void Shutdown();
 };
 
@@ -105,8 +152,17 @@ SurfaceTextureFactory::State::Contains(const std::string& aName) {
 }
 
 void
-SurfaceTextureFactory::State::Initialize(JNIEnv* aEnv) {
+SurfaceTextureFactory::State::Initialize(JNIEnv* aEnv, const ClassLoaderAndroidPtr& aClassLoader) {
   env = aEnv;
+  classLoader = aClassLoader;
+  classesLoaded = false;
+}
+
+// The JNI lookups wait for the first surface so applications without
+// SurfaceTextures do not pay for them at startup.
+void
+SurfaceTextureFactory::State::LoadClasses() {
+  classesLoaded = true;
   if (!env) {
     return;
   }
@@ -148,6 +204,63 @@ SurfaceTextureFactory::State::Initialize(JNIEnv* aEnv) {
   if (!isReleasedMethod) {
     VRB_ERROR("Failed finding SurfaceTexure.isReleasedMethod function");
   }
+
+  getTimestampMethod = env->GetMethodID(surfaceTextureClass, "getTimestamp", "()J");
+
+  if (!getTimestampMethod) {
+    VRB_ERROR("Failed finding SurfaceTexure.getTimestamp function");
+  }
+
+  // The listener is an application class so it is only found by the
+  // activity class loader.
+  if (!classLoader) {
+    VRB_WARN("No class loader, SurfaceTextures are updated every frame");
+    return;
+  }
+
+  setListenerMethod = env->GetMethodID(surfaceTextureClass, "setOnFrameAvailableListener",
+                                       "(Landroid/graphics/SurfaceTexture$OnFrameAvailableListener;)V");
+
+  if (!setListenerMethod) {
+    VRB_ERROR("Failed finding SurfaceTexure.setOnFrameAvailableListener function");
+    return;
+  }
+
+  jclass localListenerClass = classLoader->FindClass("org/mozilla/vrb/SurfaceTextureListener");
+  listenerClass = localListenerClass ? (jclass)env->NewGlobalRef(localListenerClass) : nullptr;
+
+  if (!listenerClass) {
+    VRB_ERROR("Failed finding class: org/mozilla/vrb/SurfaceTextureListener");
+    return;
+  }
+
+  listenerCtor = env->GetMethodID(listenerClass, "<init>", "(J)V");
+  listenerReleaseMethod = env->GetMethodID(listenerClass, "release", "()V");
+
+  if (!listenerCtor || !listenerReleaseMethod) {
+    VRB_ERROR("Failed finding SurfaceTextureListener functions");
+    env->DeleteGlobalRef(listenerClass);
+    listenerClass = nullptr;
+  }
+}
+
+void
+SurfaceTextureFactory::State::AddListener(SurfaceTextureRecord& aRecord) {
+  if (!listenerClass || !aRecord.surface) {
+    return;
+  }
+  aRecord.frameAvailable.reset(new std::atomic<bool>(false));
+  jobject localListener = env->NewObject(listenerClass, listenerCtor, (jlong)(intptr_t)aRecord.frameAvailable.get());
+  VRB_CHECK_JNI_EXCEPTION(env);
+  if (!localListener) {
+    VRB_ERROR("Failed to create SurfaceTextureListener for: %s", aRecord.name.c_str());
+    aRecord.frameAvailable.reset();
+    return;
+  }
+  aRecord.listener = env->NewGlobalRef(localListener);
+  env->DeleteLocalRef(localListener);
+  env->CallVoidMethod(aRecord.surface, setListenerMethod, aRecord.listener);
+  VRB_CHECK_JNI_EXCEPTION(env);
 }
 
 void
@@ -156,14 +269,27 @@ SurfaceTextureFactory::State::Shutdown() {
     return;
   }
   for (SurfaceTextureRecord& record: textures) {
-    record.Release(env);
+    record.Release(env, listenerReleaseMethod);
+  }
+  if (surfaceTextureClass) {
+    env->DeleteGlobalRef(surfaceTextureClass);
+    surfaceTextureClass = nullptr;
+  }
+  if (listenerClass) {
+    env->DeleteGlobalRef(listenerClass);
+    listenerClass = nullptr;
   }
-  env->DeleteGlobalRef(surfaceTextureClass);
-  surfaceTextureClass = nullptr;
+  listenerCtor = nullptr;
+  listenerReleaseMethod = nullptr;
+  setListenerMethod = nullptr;
+  getTimestampMethod = nullptr;
   surfaceTextureCtor = nullptr;
   updateTexImageMethod = nullptr;
   attachToGLContextMethod = nullptr;
   detachFromGLContextMethod = nullptr;
+  isReleasedMethod = nullptr;
+  classLoader = nullptr;
+  classesLoaded = false;
   env = nullptr;
 }
 
@@ -173,8 +299,8 @@ SurfaceTextureFactory::Create(CreationContextPtr& aContext) {
 }
 
 void
-SurfaceTextureFactory::InitializeJava(JNIEnv* aEnv) {
-  m.Initialize(aEnv);
+SurfaceTextureFactory::InitializeJava(JNIEnv* aEnv, const ClassLoaderAndroidPtr& aClassLoader) {
+  m.Initialize(aEnv, aClassLoader);
 }
 
 void
@@ -199,7 +325,7 @@ SurfaceTextureFactory::DestroySurfaceTexture(const std::string& aName) {
       for (SurfaceTextureObserverPtr& observer: m.observers) {
         observer->SurfaceTextureDestroyed(aRecord.name);
       }
-      aRecord.Release(m.env);
+      aRecord.Release(m.env, m.listenerReleaseMethod);
       return true;
     }
     return false;
@@ -228,6 +354,16 @@ SurfaceTextureFactory::LookupSurfaceTexture(const std::string& aName) {
   return nullptr;
 }
 
+int64_t
+SurfaceTextureFactory::GetSurfaceTimestamp(const std::string& aName) const {
+  for (const SurfaceTextureRecord& record: m.textures) {
+    if (aName == record.name) {
+      return record.timestamp;
+    }
+  }
+  return 0;
+}
+
 SurfaceTextureFactory::SurfaceTextureFactory(State& aState, CreationContextPtr& aContext)
     : Updatable(aState, aContext)
     , ResourceGL(aState, aContext)
@@ -237,9 +373,12 @@ SurfaceTextureFactory::~SurfaceTextureFactory() {}
 
 void
 SurfaceTextureFactory::UpdateResource(RenderContext& aContext) {
-  if (!m.env) {
+  if (!m.env || m.textures.empty()) {
     return;
   }
+  if (!m.classesLoaded) {
+    m.LoadClasses();
+  }
   for(SurfaceTextureRecord& record: m.textures) {
     if (!record.surface) {
       if (!record.texture) {
@@ -270,6 +409,7 @@ SurfaceTextureFactory::UpdateResource(RenderContext& aContext) {
         record.surface = m.env->NewGlobalRef(localSurface);
         record.attached = true;
         m.env->DeleteLocalRef(localSurface);
+        m.AddListener(record);
         if (record.observer) {
           record.observer->SurfaceTextureCreated(record.name, record.texture, record.surface);
         }
@@ -278,11 +418,19 @@ SurfaceTextureFactory::UpdateResource(RenderContext& aContext) {
         }
       }
     }
+    // Idle surfaces cost no JNI calls when frame available events are delivered.
+    if (!record.surface || !record.attached || (record.frameAvailable && !record.frameAvailable->exchange(false))) {
+      continue;
+    }
     bool isReleased = m.env->CallBooleanMethod(record.surface, m.isReleasedMethod);
     VRB_CHECK_JNI_EXCEPTION(m.env);
-    if (record.surface && record.attached && m.updateTexImageMethod && !isReleased) {
+    if (m.updateTexImageMethod && !isReleased) {
       m.env->CallVoidMethod(record.surface, m.updateTexImageMethod);
       VRB_CHECK_JNI_EXCEPTION(m.env);
+      if (m.getTimestampMethod) {
+        record.timestamp = (int64_t)m.env->CallLongMethod(record.surface, m.getTimestampMethod);
+        VRB_CHECK_JNI_EXCEPTION(m.env);
+      }
     }
   }
 }
@@ -297,6 +445,10 @@ SurfaceTextureFactory::InitializeGL() {
       m.env->CallVoidMethod(record.surface, m.attachToGLContextMethod, record.texture);
       VRB_CHECK_JNI_EXCEPTION(m.env);
       record.attached = true;
+      // Frames that arrived while detached are latched by the next update.
+      if (record.frameAvailable) {
+        record.frameAvailable->store(true);
+      }
       if (record.observer) {
         record.observer->SurfaceTextureHandleUpdated(record.name, record.texture);
       }
@@ -311,9 +463,12 @@ void
 SurfaceTextureFactory::ShutdownGL() {
   VRB_LOG("SurfaceTextureFactory::ShutdownGL");
   for(SurfaceTextureRecord& record: m.textures) {
+    if (!record.surface || !record.attached) {
+      continue;
+    }
     bool isReleased = m.env->CallBooleanMethod(record.surface, m.isReleasedMethod);
     VRB_CHECK_JNI_EXCEPTION(m.env);
-    if (record.surface && record.attached && !isReleased) {
+    if (!isReleased) {
       m.env->CallVoidMethod(record.surface, m.detachFromGLContextMethod);
       VRB_CHECK_JNI_EXCEPTION(m.env);
       record.texture = 0;
@@ -329,3 +484,15 @@ SurfaceTextureFactory::ShutdownGL() {
 }
 
 } // namespace vrb
+
+extern "C" {
+
+JNI_METHOD(void, FrameAvailable)
+(JNIEnv*, jclass, jlong aHandle) {
+  std::atomic<bool>* frameAvailable = reinterpret_cast<std::atomic<bool>*>(aHandle);
+  if (frameAvailable) {
+    frameAvailable->store(true);
+  }
+}
+
+} // extern "C"
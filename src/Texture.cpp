@@ -15,6 +15,10 @@ namespace vrb {
 void
 Texture::Bind() {
   AboutToBind();
+  if (!m.texture && m.placeholder) {
+    m.placeholder->Bind();
+    return;
+  }
   VRB_GL_CHECK(glBindTexture(m.target, m.texture));
 }
 
@@ -43,6 +47,11 @@ Texture::SetName(const std::string& aName) {
   m.name = aName;
 }
 
+void
+Texture::SetPlaceholder(const TexturePtr& aTexture) {
+  m.placeholder = aTexture;
+}
+
 void
 Texture::SetTextureParameter(GLenum aName, GLint aParam) {
   m.intMap[aName] = aParam;
@@ -52,6 +61,12 @@ Texture::SetTextureParameter(GLenum aName, GLint aParam) {
   VRB_GL_CHECK(glBindTexture(m.target, 0));
 }
 
+GLint
+Texture::GetTextureParameter(const GLenum aName, const GLint aDefault) const {
+  auto found = m.intMap.find(aName);
+  return found != m.intMap.end() ? found->second : aDefault;
+}
+
 Texture::Texture(State& aState, CreationContextPtr& aContext) : m(aState) {}
 Texture::~Texture() {}
 
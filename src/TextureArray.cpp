@@ -0,0 +1,275 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/TextureArray.h"
+#include "vrb/private/TextureState.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/CreationContext.h"
+#include "vrb/DataCache.h"
+#include "vrb/FileReader.h"
+#include "vrb/GLError.h"
+#include "vrb/Logger.h"
+#include "vrb/MemoryCounter.h"
+#include "vrb/private/ResourceGLState.h"
+
+#include "vrb/gl.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const uint64_t kBytesPerPixel = 4;
+
+class TextureArrayHandler;
+typedef std::shared_ptr<TextureArrayHandler> TextureArrayHandlerPtr;
+
+class TextureArrayHandler : public vrb::FileHandler {
+public:
+  static TextureArrayHandlerPtr Create(const vrb::TextureArrayPtr& aTexture, const int32_t aLayer);
+  void BindFileHandle(const std::string& aFileName, const int aFileHandle) override {};
+  void LoadFailed(const int aFileHandle, const std::string& aReason) override;
+  void ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) override {};
+  void FinishRawFile(const int aFileHandle) override {};
+  void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) override;
+  TextureArrayHandler() : mLayer(-1) {}
+  ~TextureArrayHandler() {}
+protected:
+  vrb::TextureArrayPtr mTexture;
+  int32_t mLayer;
+private:
+  VRB_NO_DEFAULTS(TextureArrayHandler);
+};
+
+TextureArrayHandlerPtr
+TextureArrayHandler::Create(const vrb::TextureArrayPtr& aTexture, const int32_t aLayer) {
+  TextureArrayHandlerPtr result = std::make_shared<TextureArrayHandler>();
+  result->mTexture = aTexture;
+  result->mLayer = aLayer;
+  return result;
+}
+
+void
+TextureArrayHandler::LoadFailed(const int aFileHandle, const std::string& aReason) {
+  VRB_ERROR("Failed to load layer %d of texture array: %s", mLayer, aReason.c_str());
+}
+
+void
+TextureArrayHandler::ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
+  if (mTexture) {
+    mTexture->SetLayerData(mLayer, aImage, aImageLength, aWidth, aHeight, aFormat);
+  }
+}
+
+} // namespace
+
+namespace vrb {
+
+struct TextureArray::State : public Texture::State, public ResourceGL::State {
+  struct Layer {
+    std::unique_ptr<uint8_t[]> data;
+    uint32_t dataCacheHandle;
+    bool dirty;
+    Layer() : dataCacheHandle(0), dirty(false) {}
+  };
+  int width;
+  int height;
+  int32_t reserved;
+  bool dirty;
+  std::vector<Layer> layers;
+  DataCachePtr dataCache;
+  MemoryTracker gpuMemory;
+  MemoryTracker cpuMemory;
+
+  State()
+      : width(0)
+      , height(0)
+      , reserved(0)
+      , dirty(false)
+      , gpuMemory(MemoryType::TextureRGBA)
+      , cpuMemory(MemoryType::ImageData)
+  {}
+  uint64_t LayerSize() const { return (uint64_t)width * (uint64_t)height * kBytesPerPixel; }
+  void CreateTexture();
+  void DestroyTexture();
+  void UpdateMemory();
+};
+
+void
+TextureArray::State::UpdateMemory() {
+  size_t cpu = 0;
+  for (const Layer& layer: layers) {
+    if (layer.data) {
+      cpu += (size_t)LayerSize();
+    }
+  }
+  cpuMemory.Set(cpu);
+  gpuMemory.Set(texture ? (size_t)(LayerSize() * layers.size()) : 0);
+}
+
+void
+TextureArray::State::CreateTexture() {
+  if (!dirty || layers.empty()) {
+    return;
+  }
+  if (!texture) {
+    // Storage for every layer is allocated up front so layers loaded later
+    // are uploaded without reallocating the texture.
+    VRB_GL_CHECK(glGenTextures(1, &texture));
+    VRB_GL_CHECK(glBindTexture(target, texture));
+    VRB_GL_CHECK(glTexStorage3D(target, 1, GL_RGBA8, width, height, (GLsizei)layers.size()));
+    for (auto param = intMap.begin(); param != intMap.end(); param++) {
+      VRB_GL_CHECK(glTexParameteri(target, param->first, param->second));
+    }
+  } else {
+    VRB_GL_CHECK(glBindTexture(target, texture));
+  }
+  for (size_t ix = 0; ix < layers.size(); ix++) {
+    Layer& layer = layers[ix];
+    if (!layer.dirty) {
+      continue;
+    }
+    if (!layer.data && dataCache && (layer.dataCacheHandle > 0)) {
+      dataCache->LoadData(layer.dataCacheHandle, layer.data);
+    }
+    if (!layer.data) {
+      continue;
+    }
+    VRB_GL_CHECK(glTexSubImage3D(target, 0, 0, 0, (GLint)ix, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, (void*)layer.data.get()));
+    VRB_GL_STATS_ADD(TextureUploadBytes, LayerSize());
+    layer.dirty = false;
+    if (!layer.dataCacheHandle && dataCache) {
+      layer.dataCacheHandle = dataCache->CacheData(layer.data, (size_t)LayerSize());
+    } else if (layer.dataCacheHandle > 0) {
+      layer.data = nullptr;
+    }
+  }
+  dirty = false;
+  UpdateMemory();
+}
+
+void
+TextureArray::State::DestroyTexture() {
+  if (texture > 0) {
+    VRB_GL_CHECK(glDeleteTextures(1, &texture));
+    texture = 0;
+  }
+  for (Layer& layer: layers) {
+    layer.dirty = layer.data || (layer.dataCacheHandle > 0);
+  }
+  dirty = true;
+  UpdateMemory();
+}
+
+TextureArrayPtr
+TextureArray::Create(CreationContextPtr& aContext, const int aWidth, const int aHeight, const int32_t aLayerCount) {
+  auto result = std::make_shared<ConcreteClass<TextureArray, TextureArray::State> >(aContext);
+  result->m.width = std::max(aWidth, 1);
+  result->m.height = std::max(aHeight, 1);
+  result->m.layers.resize((size_t)std::max(aLayerCount, 1));
+  // An unloaded array is still allocated so it can be bound.
+  result->m.dirty = true;
+  return result;
+}
+
+int32_t
+TextureArray::Load(CreationContextPtr& aContext, const TextureArrayPtr& aTexture, const std::string& aFileName) {
+  FileReaderPtr reader = aContext->GetFileReader();
+  if (!reader || !aTexture) {
+    VRB_ERROR("FileReaderPtr not found while loading a texture array layer");
+    return -1;
+  }
+  const int32_t kLayer = aTexture->ReserveLayer();
+  if (kLayer < 0) {
+    VRB_ERROR("No free layer in texture array for '%s'", aFileName.c_str());
+    return -1;
+  }
+  reader->ReadImageFile(aFileName, TextureArrayHandler::Create(aTexture, kLayer));
+  return kLayer;
+}
+
+int32_t
+TextureArray::ReserveLayer() {
+  if (m.reserved >= (int32_t)m.layers.size()) {
+    return -1;
+  }
+  return m.reserved++;
+}
+
+bool
+TextureArray::SetLayerData(const int32_t aLayer, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
+  if ((aLayer < 0) || (aLayer >= (int32_t)m.layers.size()) || !aImage) {
+    return false;
+  }
+  if ((aWidth != m.width) || (aHeight != m.height) || (aFormat != GL_RGBA) || (aImageLength < m.LayerSize())) {
+    VRB_ERROR("Texture array layer of %dx%d in format 0x%x does not match the %dx%d RGBA array",
+              aWidth, aHeight, aFormat, m.width, m.height);
+    return false;
+  }
+  State::Layer& layer = m.layers[aLayer];
+  if (m.dataCache && (layer.dataCacheHandle > 0)) {
+    m.dataCache->RemoveData(layer.dataCacheHandle);
+    layer.dataCacheHandle = 0;
+  }
+  layer.data = std::move(aImage);
+  layer.dirty = true;
+  m.dirty = true;
+  m.UpdateMemory();
+  return true;
+}
+
+int
+TextureArray::GetWidth() const {
+  return m.width;
+}
+
+int
+TextureArray::GetHeight() const {
+  return m.height;
+}
+
+int32_t
+TextureArray::GetLayerCount() const {
+  return (int32_t)m.layers.size();
+}
+
+TextureArray::TextureArray(State& aState, CreationContextPtr& aContext) : Texture(aState, aContext), ResourceGL (aState, aContext), m(aState) {
+  m.dataCache = aContext->GetDataCache();
+  m.target = GL_TEXTURE_2D_ARRAY;
+}
+
+TextureArray::~TextureArray() {
+  if (!m.dataCache) {
+    return;
+  }
+  for (State::Layer& layer: m.layers) {
+    if (layer.dataCacheHandle > 0) {
+      m.dataCache->RemoveData(layer.dataCacheHandle);
+      layer.dataCacheHandle = 0;
+    }
+  }
+}
+
+void
+TextureArray::AboutToBind() {
+  m.CreateTexture();
+}
+
+bool
+TextureArray::SupportOffRenderThreadInitialization() {
+  return true;
+}
+
+void
+TextureArray::InitializeGL() {
+  m.CreateTexture();
+}
+
+void
+TextureArray::ShutdownGL() {
+  m.DestroyTexture();
+}
+
+} // namespace vrb
@@ -0,0 +1,309 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/TextureAtlas.h"
+#include "vrb/private/UpdatableState.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/FileReader.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/Mutex.h"
+#include "vrb/RenderContext.h"
+#include "vrb/RenderState.h"
+#include "vrb/TextureGL.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Edge pixels are repeated into a border of this width around each region
+// so linear filtering never reads a neighbour.
+const int32_t kPadding = 2;
+const int32_t kBytesPerPixel = 4;
+
+}
+
+namespace vrb {
+
+struct TextureAtlas::State : public Updatable::State {
+  struct Handler;
+  // Regions are placed left to right on shelves that fill the page top
+  // to bottom. Only the last shelf of a page is open.
+  struct Page {
+    TextureGLPtr texture;
+    std::unique_ptr<uint8_t[]> pixels;
+    int32_t shelfX;
+    int32_t shelfY;
+    int32_t shelfHeight;
+    bool dirty;
+    Page() : shelfX(0), shelfY(0), shelfHeight(0), dirty(false) {}
+  };
+  struct Entry {
+    std::vector<std::weak_ptr<RenderState>> states;
+    bool ready;
+    bool applied;
+    // -1 when the image has a texture of its own.
+    int32_t page;
+    Matrix uvTransform;
+    // Unpacked images until their TextureGL is created.
+    std::vector<ImageLevel> levels;
+    TextureGLPtr texture;
+    Entry() : ready(false), applied(false), page(-1), uvTransform(Matrix::Identity()) {}
+  };
+
+  TextureAtlasWeak self;
+  CreationContextWeak context;
+  int32_t pageSize;
+  int32_t maxSize;
+  Mutex lock;
+  std::vector<Page> pages;
+  std::unordered_map<std::string, Entry> entries;
+  bool dirty;
+
+  State() : pageSize(1024), maxSize(256), dirty(false) {}
+  bool Pack(const int32_t aWidth, const int32_t aHeight, int32_t& aPage, int32_t& aX, int32_t& aY);
+  void Copy(Page& aPage, const int32_t aX, const int32_t aY, const ImageLevel& aImage);
+  void Receive(const std::string& aName, std::vector<ImageLevel>& aLevels);
+  void Fail(const std::string& aName, const std::string& aReason);
+};
+
+struct TextureAtlas::State::Handler : public FileHandler {
+  std::shared_ptr<TextureAtlas::State> atlas;
+  std::string name;
+
+  void BindFileHandle(const std::string& aFileName, const int aFileHandle) override {}
+  void LoadFailed(const int aFileHandle, const std::string& aReason) override {
+    atlas->Fail(name, aReason);
+  }
+  void ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) override {}
+  void FinishRawFile(const int aFileHandle) override {}
+  void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength,
+                        const int aWidth, const int aHeight, const GLenum aFormat) override {
+    std::vector<ImageLevel> levels(1);
+    levels[0].data = std::move(aImage);
+    levels[0].length = aImageLength;
+    levels[0].width = aWidth;
+    levels[0].height = aHeight;
+    levels[0].format = aFormat;
+    atlas->Receive(name, levels);
+  }
+  void ProcessImageLevels(const int aFileHandle, std::vector<ImageLevel>& aLevels) override {
+    atlas->Receive(name, aLevels);
+  }
+  Handler() {}
+  ~Handler() {}
+private:
+  VRB_NO_DEFAULTS(Handler)
+};
+
+bool
+TextureAtlas::State::Pack(const int32_t aWidth, const int32_t aHeight, int32_t& aPage, int32_t& aX, int32_t& aY) {
+  const int32_t kWidth = aWidth + (2 * kPadding);
+  const int32_t kHeight = aHeight + (2 * kPadding);
+  if ((kWidth > pageSize) || (kHeight > pageSize)) {
+    return false;
+  }
+  for (size_t ix = 0; ix < pages.size(); ix++) {
+    Page& page = pages[ix];
+    if ((page.shelfX + kWidth <= pageSize) && (page.shelfY + kHeight <= pageSize)) {
+      aX = page.shelfX;
+      aY = page.shelfY;
+      page.shelfX += kWidth;
+      page.shelfHeight = std::max(page.shelfHeight, kHeight);
+      aPage = (int32_t)ix;
+      return true;
+    }
+    const int32_t kNextShelf = page.shelfY + page.shelfHeight;
+    if (kNextShelf + kHeight <= pageSize) {
+      aX = 0;
+      aY = kNextShelf;
+      page.shelfX = kWidth;
+      page.shelfY = kNextShelf;
+      page.shelfHeight = kHeight;
+      aPage = (int32_t)ix;
+      return true;
+    }
+  }
+  pages.emplace_back();
+  Page& page = pages.back();
+  page.pixels = std::make_unique<uint8_t[]>((size_t)pageSize * pageSize * kBytesPerPixel);
+  page.shelfX = kWidth;
+  page.shelfHeight = kHeight;
+  aX = 0;
+  aY = 0;
+  aPage = (int32_t)pages.size() - 1;
+  return true;
+}
+
+void
+TextureAtlas::State::Copy(Page& aPage, const int32_t aX, const int32_t aY, const ImageLevel& aImage) {
+  const size_t kRowLength = (size_t)aImage.width * kBytesPerPixel;
+  const size_t kPageRowLength = (size_t)pageSize * kBytesPerPixel;
+  for (int32_t row = -kPadding; row < aImage.height + kPadding; row++) {
+    const int32_t kSourceRow = std::min(std::max(row, 0), aImage.height - 1);
+    const uint8_t* source = aImage.data.get() + ((size_t)kSourceRow * kRowLength);
+    uint8_t* dest = aPage.pixels.get() + ((size_t)(aY + kPadding + row) * kPageRowLength) + ((size_t)aX * kBytesPerPixel);
+    for (int32_t ix = 0; ix < kPadding; ix++) {
+      memcpy(dest + (ix * kBytesPerPixel), source, kBytesPerPixel);
+      memcpy(dest + kRowLength + ((kPadding + ix) * kBytesPerPixel), source + kRowLength - kBytesPerPixel, kBytesPerPixel);
+    }
+    memcpy(dest + (kPadding * kBytesPerPixel), source, kRowLength);
+  }
+  aPage.dirty = true;
+}
+
+void
+TextureAtlas::State::Receive(const std::string& aName, std::vector<ImageLevel>& aLevels) {
+  MutexAutoLock autoLock(lock);
+  Entry& entry = entries[aName];
+  entry.ready = true;
+  entry.applied = false;
+  dirty = true;
+  const ImageLevel* image = aLevels.empty() ? nullptr : &aLevels[0];
+  int32_t page = -1;
+  int32_t x = 0;
+  int32_t y = 0;
+  if (image && image->data && (image->target == GL_TEXTURE_2D) && (image->format == GL_RGBA) &&
+      (image->width > 0) && (image->height > 0) && (image->width <= maxSize) && (image->height <= maxSize) &&
+      (image->length >= (uint64_t)image->width * image->height * kBytesPerPixel) &&
+      Pack(image->width, image->height, page, x, y)) {
+    Copy(pages[page], x, y, *image);
+    const float kPageSize = (float)pageSize;
+    entry.page = page;
+    entry.uvTransform = Matrix::Translation(Vector((x + kPadding) / kPageSize, (y + kPadding) / kPageSize, 0.0f))
+        .ScaleInPlace(Vector(image->width / kPageSize, image->height / kPageSize, 1.0f));
+    return;
+  }
+  entry.page = -1;
+  entry.levels = std::move(aLevels);
+}
+
+void
+TextureAtlas::State::Fail(const std::string& aName, const std::string& aReason) {
+  VRB_ERROR("Failed to load atlas texture '%s': %s", aName.c_str(), aReason.c_str());
+  MutexAutoLock autoLock(lock);
+  Entry& entry = entries[aName];
+  // The default texture stays bound.
+  entry.ready = true;
+  entry.applied = true;
+}
+
+TextureAtlasPtr
+TextureAtlas::Create(CreationContextPtr& aContext) {
+  TextureAtlasPtr result = std::make_shared<ConcreteClass<TextureAtlas, TextureAtlas::State> >(aContext);
+  result->m.self = result;
+  result->m.context = aContext;
+  return result;
+}
+
+void
+TextureAtlas::SetPageSize(const int32_t aSize) {
+  MutexAutoLock lock(m.lock);
+  m.pageSize = std::max(aSize, 1);
+}
+
+void
+TextureAtlas::SetMaxTextureSize(const int32_t aSize) {
+  MutexAutoLock lock(m.lock);
+  m.maxSize = aSize;
+}
+
+void
+TextureAtlas::AddTexture(const std::string& aTextureName, const RenderStatePtr& aState) {
+  CreationContextPtr creation = m.context.lock();
+  TextureAtlasPtr self = m.self.lock();
+  if (!aState || !creation || !self) {
+    return;
+  }
+  bool load = false;
+  bool ready = false;
+  {
+    MutexAutoLock lock(m.lock);
+    State::Entry& entry = m.entries[aTextureName];
+    load = entry.states.empty() && !entry.ready;
+    ready = entry.ready;
+    entry.states.push_back(aState);
+    if (ready) {
+      entry.applied = false;
+      m.dirty = true;
+    }
+  }
+  if (!ready) {
+    aState->SetTexture(creation->GetDefaultTexture());
+  }
+  FileReaderPtr reader = creation->GetFileReader();
+  if (load && reader) {
+    std::shared_ptr<State::Handler> handler = std::make_shared<State::Handler>();
+    handler->atlas = std::shared_ptr<State>(self, &m);
+    handler->name = aTextureName;
+    reader->ReadImageFile(aTextureName, handler);
+  }
+}
+
+int32_t
+TextureAtlas::GetPageCount() const {
+  MutexAutoLock lock(m.lock);
+  return (int32_t)m.pages.size();
+}
+
+void
+TextureAtlas::UpdateResource(RenderContext& aContext) {
+  MutexAutoLock lock(m.lock);
+  if (!m.dirty) {
+    return;
+  }
+  CreationContextPtr& creation = aContext.GetRenderThreadCreationContext();
+  for (size_t ix = 0; ix < m.pages.size(); ix++) {
+    State::Page& page = m.pages[ix];
+    if (!page.dirty) {
+      continue;
+    }
+    if (!page.texture) {
+      page.texture = TextureGL::Create(creation);
+      page.texture->SetName("TextureAtlas page " + std::to_string(ix));
+      page.texture->SetTextureParameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      page.texture->SetTextureParameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    // The page keeps its pixels so later textures can still be packed.
+    const size_t kLength = (size_t)m.pageSize * m.pageSize * kBytesPerPixel;
+    std::unique_ptr<uint8_t[]> image = std::make_unique<uint8_t[]>(kLength);
+    memcpy(image.get(), page.pixels.get(), kLength);
+    page.texture->SetImageData(image, kLength, m.pageSize, m.pageSize, GL_RGBA);
+    page.dirty = false;
+  }
+  for (auto& item: m.entries) {
+    State::Entry& entry = item.second;
+    if (!entry.ready || entry.applied) {
+      continue;
+    }
+    if ((entry.page < 0) && !entry.texture) {
+      entry.texture = TextureGL::Create(creation);
+      entry.texture->SetName(item.first);
+      entry.texture->SetImageLevels(entry.levels);
+      entry.levels.clear();
+    }
+    TexturePtr texture = entry.page < 0 ? entry.texture : m.pages[entry.page].texture;
+    for (std::weak_ptr<RenderState>& weak: entry.states) {
+      RenderStatePtr state = weak.lock();
+      if (state) {
+        state->SetTexture(texture);
+        state->SetUVTransform(entry.page < 0 ? Matrix::Identity() : entry.uvTransform);
+      }
+    }
+    entry.applied = true;
+  }
+  m.dirty = false;
+}
+
+TextureAtlas::TextureAtlas(State& aState, CreationContextPtr& aContext) : Updatable(aState, aContext), m(aState) {}
+TextureAtlas::~TextureAtlas() {}
+
+} // namespace vrb
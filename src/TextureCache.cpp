@@ -5,6 +5,7 @@
 
 #include "vrb/TextureCache.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/private/AssetTable.h"
 
 #include "vrb/CreationContext.h"
 #include "vrb/DefaultImageData.h"
@@ -14,17 +15,37 @@
 #include "vrb/Texture.h"
 #include "vrb/TextureGL.h"
 
+#include <algorithm>
 #include <cstring>
-#include <unordered_map>
+#include <vector>
 
 namespace vrb {
 
 struct TextureCache::State {
   Mutex lock;
   TextureGLPtr defaultTexture;
-  std::unordered_map<std::string, TextureGLPtr> cache;
-
+  // Lookups do not take the lock, it only orders Update with other writers.
+  AssetTable<TextureGL> cache;
+  size_t budget;
+  bool deferredLoading;
+  // The bind sequence at the previous Update. Textures bound since then
+  // were used by the last frame and are not evicted.
+  uint64_t frameStart;
+  // The bind sequence at the Update before, so textures of the previous
+  // frame are kept when called between Update and drawing.
+  uint64_t previousFrameStart;
+  State() : budget(0), deferredLoading(false), frameStart(0), previousFrameStart(0) {}
+
+  size_t ReleaseImageData(TextureGL& aTexture) {
+    const size_t kResult = aTexture.ReleaseImageData();
+    if (kResult > 0) {
+      // Bound while a dropped image is read again.
+      aTexture.SetPlaceholder(defaultTexture);
+    }
+    return kResult;
+  }
 };
+
 TextureCachePtr
 TextureCache::Create() {
   return std::make_shared<ConcreteClass<TextureCache, TextureCache::State> >();
@@ -34,36 +55,44 @@ void
 TextureCache::Init(CreationContextPtr& aContext) {
   MutexAutoLock lock(m.lock);
   m.defaultTexture = TextureGL::Create(aContext);
-  const size_t kArraySize = kDefaultImageDataSize * sizeof(uint32_t);
-  std::unique_ptr<uint8_t[]> data = std::make_unique<uint8_t[]>(kArraySize);
-  memcpy(data.get(), (void*)kDefaultImageData, kArraySize);
-  uint64_t length = kDefaultImageDataWidth * kDefaultImageDataHeight * 4;
-  m.defaultTexture->SetImageData(data, length, kDefaultImageDataWidth,  kDefaultImageDataHeight, GL_RGBA);
+  // The image is only copied, and uploaded, once something draws with it.
+  TextureGL* texture = m.defaultTexture.get();
+  m.defaultTexture->SetDeferredLoad([texture]() {
+    const size_t kArraySize = kDefaultImageDataSize * sizeof(uint32_t);
+    std::unique_ptr<uint8_t[]> data = std::make_unique<uint8_t[]>(kArraySize);
+    memcpy(data.get(), (void*)kDefaultImageData, kArraySize);
+    uint64_t length = kDefaultImageDataWidth * kDefaultImageDataHeight * 4;
+    texture->SetImageData(data, length, kDefaultImageDataWidth,  kDefaultImageDataHeight, GL_RGBA);
+  });
 }
 
 void
 TextureCache::Shutdown() {
   m.defaultTexture = nullptr;
-  m.cache.clear();
+  m.cache.Clear();
 }
 
 TextureGLPtr
 TextureCache::FindTexture(const std::string& aTextureName) {
-  MutexAutoLock lock(m.lock);
-  TextureGLPtr result;
-
-  std::unordered_map<std::string, TextureGLPtr>::iterator it = m.cache.find(aTextureName);
-  if (it != m.cache.end()) {
-    return it->second;
-  }
+  return FindTexture(InternAsset(aTextureName));
+}
 
-  return result;
+TextureGLPtr
+TextureCache::FindTexture(const AssetID aTextureID) {
+  return m.cache.Find(aTextureID);
 }
 
 void
 TextureCache::AddTexture(const std::string& aTextureName, TextureGLPtr& aTexture) {
+  AddTexture(InternAsset(aTextureName), aTexture);
+}
+
+void
+TextureCache::AddTexture(const AssetID aTextureID, TextureGLPtr& aTexture) {
   MutexAutoLock lock(m.lock);
-  m.cache[aTextureName] = aTexture;
+  if (!m.cache.Set(aTextureID, aTexture)) {
+    VRB_WARN("Unable to cache texture: %s", GetAssetName(aTextureID).c_str());
+  }
 }
 
 TextureGLPtr
@@ -71,6 +100,87 @@ TextureCache::GetDefaultTexture() {
   return m.defaultTexture;
 }
 
+void
+TextureCache::SetBudget(const size_t aBytes) {
+  MutexAutoLock lock(m.lock);
+  m.budget = aBytes;
+}
+
+size_t
+TextureCache::GetBudget() const {
+  return m.budget;
+}
+
+void
+TextureCache::SetDeferredLoading(const bool aEnabled) {
+  MutexAutoLock lock(m.lock);
+  m.deferredLoading = aEnabled;
+}
+
+bool
+TextureCache::IsDeferredLoading() const {
+  return m.deferredLoading;
+}
+
+void
+TextureCache::Update() {
+  MutexAutoLock lock(m.lock);
+  const uint64_t kFrameStart = m.frameStart;
+  m.previousFrameStart = m.frameStart;
+  m.frameStart = TextureGL::GetBindSequence();
+  if (m.budget == 0) {
+    return;
+  }
+  size_t total = 0;
+  m.cache.ForEach([&](const AssetID, const TextureGLPtr& aTexture) {
+    total += aTexture->GetGPUSize();
+  });
+  if (total <= m.budget) {
+    return;
+  }
+  std::vector<TextureGLPtr> candidates;
+  m.cache.ForEach([&](const AssetID, const TextureGLPtr& aTexture) {
+    if ((aTexture->GetGPUSize() > 0) && (aTexture->GetLastBound() <= kFrameStart)) {
+      candidates.push_back(aTexture);
+    }
+  });
+  std::sort(candidates.begin(), candidates.end(), [](const TextureGLPtr& aLeft, const TextureGLPtr& aRight) {
+    return aLeft->GetLastBound() < aRight->GetLastBound();
+  });
+  for (const TextureGLPtr& texture: candidates) {
+    if (total <= m.budget) {
+      break;
+    }
+    total -= texture->GetGPUSize();
+    texture->Evict();
+  }
+}
+
+size_t
+TextureCache::ReleaseImageData() {
+  MutexAutoLock lock(m.lock);
+  size_t result = 0;
+  m.cache.ForEach([&](const AssetID, const TextureGLPtr& aTexture) {
+    result += m.ReleaseImageData(*aTexture);
+  });
+  return result;
+}
+
+size_t
+TextureCache::EvictUnused() {
+  MutexAutoLock lock(m.lock);
+  size_t result = 0;
+  m.cache.ForEach([&](const AssetID, const TextureGLPtr& aTexture) {
+    if (aTexture->GetLastBound() > m.previousFrameStart) {
+      return;
+    }
+    result += aTexture->GetGPUSize();
+    aTexture->Evict();
+    result += m.ReleaseImageData(*aTexture);
+  });
+  return result;
+}
+
 TextureCache::TextureCache(State& aState) : m(aState) {}
 
 TextureCache::~TextureCache() {}
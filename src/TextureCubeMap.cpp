@@ -11,73 +11,110 @@
 #include "vrb/DataCache.h"
 #include "vrb/FileReader.h"
 #include "vrb/GLError.h"
+#include "vrb/JobSystem.h"
 #include "vrb/Logger.h"
+#include "vrb/MemoryCounter.h"
+#include "vrb/Mutex.h"
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/RenderContext.h"
+#include "vrb/TextureFormat.h"
 
 #include "vrb/gl.h"
+#include <algorithm>
 #include <cstring>
 #include <vector>
 
 namespace {
 
-struct CubeMapFace {
-  GLenum target;
+const int kFaceCount = 6;
+
+struct CubeMapLevel {
   GLint level;
-  GLint internalFormat;
   GLsizei width;
   GLsizei height;
-  GLint border;
   GLenum format;
   GLenum type;
   GLsizei dataSize;
   std::unique_ptr<uint8_t[]> data;
   uint32_t dataCacheHandle;
 
-
-  CubeMapFace()
-      : target(GL_TEXTURE_CUBE_MAP_POSITIVE_X)
-      , level(0)
-      , internalFormat(GL_RGB)
+  CubeMapLevel()
+      : level(0)
       , width(0)
       , height(0)
-      , border(0)
       , format(GL_RGB)
       , type(GL_UNSIGNED_BYTE)
       , dataSize(0)
       , dataCacheHandle(0)
   {}
+  CubeMapLevel(CubeMapLevel&&) = default;
+  CubeMapLevel& operator=(CubeMapLevel&&) = default;
 private:
-  CubeMapFace(const CubeMapFace&) = delete;
-  CubeMapFace& operator=(const CubeMapFace&) = delete;
+  CubeMapLevel(const CubeMapLevel&) = delete;
+  CubeMapLevel& operator=(const CubeMapLevel&) = delete;
 };
 
+// Collects the faces of a six file load so they reach the texture in one
+// SetImageLevels call.
+struct CubeMapLoad {
+  vrb::Mutex lock;
+  vrb::TextureCubeMapPtr texture;
+  std::vector<vrb::ImageLevel> levels;
+  int remaining;
+  bool failed;
+  // Set when the faces are read by jobs. The levels are then handed over by
+  // the thread that waited for them instead of by the last job.
+  bool deferred;
+  CubeMapLoad() : remaining(kFaceCount), failed(false), deferred(false) {}
+  void Finish();
+};
 
+typedef std::shared_ptr<CubeMapLoad> CubeMapLoadPtr;
+
+void
+CubeMapLoad::Finish() {
+  {
+    vrb::MutexAutoLock autoLock(lock);
+    remaining--;
+    if ((remaining > 0) || deferred) {
+      return;
+    }
+  }
+  if (!failed && texture) {
+    texture->SetImageLevels(levels);
+  }
+  levels.clear();
+}
 
 class CubeMapTextureHandler;
 typedef std::shared_ptr<CubeMapTextureHandler> CubeMapTextureHandlerPtr;
 
+// Handles one face of a six file load, or every face of a single file when
+// created without a load.
 class CubeMapTextureHandler : public vrb::FileHandler {
 public:
-  static CubeMapTextureHandlerPtr Create(const vrb::TextureCubeMapPtr& aTexture, GLenum aFaceTarget);
+  static CubeMapTextureHandlerPtr Create(const vrb::TextureCubeMapPtr& aTexture, const CubeMapLoadPtr& aLoad, GLenum aFaceTarget);
   void BindFileHandle(const std::string& aFileName, const int aFileHandle) override;
   void LoadFailed(const int aFileHandle, const std::string& aReason) override;
   void ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) override {};
   void FinishRawFile(const int aFileHandle) override {};
   void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) override;
+  void ProcessImageLevels(const int aFileHandle, std::vector<vrb::ImageLevel>& aLevels) override;
   CubeMapTextureHandler() {}
   ~CubeMapTextureHandler() {}
 protected:
   vrb::TextureCubeMapPtr mTexture;
+  CubeMapLoadPtr mLoad;
   GLenum mFaceTarget;
 private:
   VRB_NO_DEFAULTS(CubeMapTextureHandler);
 };
 
 CubeMapTextureHandlerPtr
-CubeMapTextureHandler::Create(const vrb::TextureCubeMapPtr& aTexture, GLenum aFaceTarget) {
+CubeMapTextureHandler::Create(const vrb::TextureCubeMapPtr& aTexture, const CubeMapLoadPtr& aLoad, GLenum aFaceTarget) {
   CubeMapTextureHandlerPtr result = std::make_shared<CubeMapTextureHandler>();
   result->mTexture = aTexture;
+  result->mLoad = aLoad;
   result->mFaceTarget = aFaceTarget;
   return result;
 }
@@ -90,13 +127,46 @@ CubeMapTextureHandler::BindFileHandle(const std::string& aFileName, const int aF
 void
 CubeMapTextureHandler::LoadFailed(const int aFileHandle, const std::string& aReason) {
   VRB_ERROR("Failed to load CubeMap texture for target %d: %s", mFaceTarget, aReason.c_str());
+  if (mLoad) {
+    {
+      vrb::MutexAutoLock autoLock(mLoad->lock);
+      mLoad->failed = true;
+    }
+    mLoad->Finish();
+  }
 }
 
 void
 CubeMapTextureHandler::ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
-  if (mTexture) {
-    mTexture->SetImageData(mFaceTarget, aImage, aImageLength, aWidth, aHeight, aFormat);
+  std::vector<vrb::ImageLevel> levels(1);
+  levels[0].target = mFaceTarget;
+  levels[0].data = std::move(aImage);
+  levels[0].length = aImageLength;
+  levels[0].width = aWidth;
+  levels[0].height = aHeight;
+  levels[0].format = aFormat;
+  ProcessImageLevels(aFileHandle, levels);
+}
+
+void
+CubeMapTextureHandler::ProcessImageLevels(const int aFileHandle, std::vector<vrb::ImageLevel>& aLevels) {
+  if (!mLoad) {
+    if (mTexture) {
+      mTexture->SetImageLevels(aLevels);
+    }
+    return;
   }
+  // A face file holds a 2D image, possibly with mips.
+  {
+    vrb::MutexAutoLock autoLock(mLoad->lock);
+    for (vrb::ImageLevel& level: aLevels) {
+      if ((level.target == GL_TEXTURE_2D) || (level.target == mFaceTarget)) {
+        level.target = mFaceTarget;
+        mLoad->levels.push_back(std::move(level));
+      }
+    }
+  }
+  mLoad->Finish();
 }
 
 }
@@ -106,84 +176,196 @@ namespace vrb {
 struct TextureCubeMap::State : public Texture::State, public ResourceGL::State {
   bool dirty;
   GLuint externalTexture;
-  CubeMapFace faces[6];
+  // Levels of each face, ordered from the base level.
+  std::vector<CubeMapLevel> faces[kFaceCount];
   DataCachePtr dataCache;
-
+  MemoryTracker gpuMemory;
+  MemoryTracker cpuMemory;
+
+  State()
+      : dirty(false)
+      , externalTexture(0)
+      , gpuMemory(MemoryType::TextureRGBA)
+      , cpuMemory(MemoryType::ImageData)
+  {}
+  bool SetFace(const int aIndex, std::vector<CubeMapLevel>& aLevels);
+  GLsizei GetLevelCount() const;
   void CreateTexture();
   void DestroyTexture();
+  void RemoveCachedData(std::vector<CubeMapLevel>& aLevels);
+  void UpdateMemory();
 };
 
+void
+TextureCubeMap::State::UpdateMemory() {
+  size_t gpu = 0;
+  size_t cpu = 0;
+  for (const std::vector<CubeMapLevel>& face: faces) {
+    for (const CubeMapLevel& level: face) {
+      gpu += (size_t)level.dataSize;
+      if (level.data) {
+        cpu += (size_t)level.dataSize;
+      }
+    }
+  }
+  cpuMemory.Set(cpu);
+  // External textures are owned and accounted for elsewhere.
+  const GLenum kFormat = faces[0].empty() ? (GLenum)GL_RGBA : faces[0][0].format;
+  gpuMemory.Set(GetTextureMemoryType(kFormat), (texture && !externalTexture) ? gpu : 0);
+}
+
+void
+TextureCubeMap::State::RemoveCachedData(std::vector<CubeMapLevel>& aLevels) {
+  if (!dataCache) {
+    return;
+  }
+  for (CubeMapLevel& level: aLevels) {
+    if (level.dataCacheHandle > 0) {
+      dataCache->RemoveData(level.dataCacheHandle);
+      level.dataCacheHandle = 0;
+    }
+  }
+}
+
+bool
+TextureCubeMap::State::SetFace(const int aIndex, std::vector<CubeMapLevel>& aLevels) {
+  if ((aIndex < 0) || (aIndex >= kFaceCount) || aLevels.empty()) {
+    return false;
+  }
+  std::sort(aLevels.begin(), aLevels.end(), [](const CubeMapLevel& aLeft, const CubeMapLevel& aRight) {
+    return aLeft.level < aRight.level;
+  });
+  // Only the complete chain from the base level is kept.
+  size_t count = 0;
+  while ((count < aLevels.size()) && (aLevels[count].level == (GLint)count)) {
+    count++;
+  }
+  if (count == 0) {
+    VRB_ERROR("Cube map face %d has no base level", aIndex);
+    return false;
+  }
+  aLevels.resize(count);
+  RemoveCachedData(faces[aIndex]);
+  faces[aIndex] = std::move(aLevels);
+  return true;
+}
+
+GLsizei
+TextureCubeMap::State::GetLevelCount() const {
+  size_t result = faces[0].size();
+  for (const std::vector<CubeMapLevel>& face: faces) {
+    if (face.empty() || (face[0].width != faces[0][0].width) || (face[0].height != faces[0][0].height) ||
+        (face[0].format != faces[0][0].format)) {
+      return 0;
+    }
+    result = std::min(result, face.size());
+  }
+  return (GLsizei)result;
+}
+
 void
 TextureCubeMap::State::CreateTexture() {
   if (!dirty) {
     return;
   }
-  for (CubeMapFace& face: faces) {
-    if (!face.data) {
-      if (dataCache && (face.dataCacheHandle > 0)) {
-        dataCache->LoadData(face.dataCacheHandle, face.data);
+  const GLsizei kLevelCount = GetLevelCount();
+  if (kLevelCount == 0) {
+    return;
+  }
+  for (std::vector<CubeMapLevel>& face: faces) {
+    for (GLsizei ix = 0; ix < kLevelCount; ix++) {
+      CubeMapLevel& level = face[ix];
+      if (!level.data && dataCache && (level.dataCacheHandle > 0)) {
+        dataCache->LoadData(level.dataCacheHandle, level.data);
       }
-      if (!face.data) {
+      if (!level.data) {
         return;
       }
     }
   }
+  const CubeMapLevel& kBase = faces[0][0];
+  const bool kCompressed = IsCompressedTextureFormat(kBase.format);
+  const GLenum kStorageFormat = GetTextureStorageFormat(kBase.format);
+  const bool kImmutable = !externalTexture && (kStorageFormat != 0);
+  if (kLevelCount > 1) {
+    GLint& minFilter = intMap[GL_TEXTURE_MIN_FILTER];
+    if (minFilter == GL_NEAREST) {
+      minFilter = GL_NEAREST_MIPMAP_LINEAR;
+    } else if (minFilter == GL_LINEAR) {
+      minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    }
+  }
   if (externalTexture) {
     texture = externalTexture;
+    VRB_GL_CHECK(glBindTexture(target, texture));
   } else {
+    if (texture > 0) {
+      VRB_GL_CHECK(glDeleteTextures(1, &texture));
+    }
     VRB_GL_CHECK(glGenTextures(1, &texture));
-  }
-  VRB_GL_CHECK(glBindTexture(target, texture));
-  for (CubeMapFace& face: faces) {
-    const bool isRGB = face.format == GL_RG8 || face.format == GL_RGBA;
-    if (externalTexture && isRGB) {
-      VRB_GL_CHECK(glTexSubImage2D(
-          face.target,
-          face.level,
-          0,
-          0,
-          face.width,
-          face.height,
-          face.format,
-          face.type,
-          (void*)face.data.get()));
-    } else if (isRGB) {
-      VRB_GL_CHECK(glTexImage2D(
-          face.target,
-          face.level,
-          face.internalFormat,
-          face.width,
-          face.height,
-          face.border,
-          face.format,
-          face.type,
-          (void*)face.data.get()));
-    } else if (externalTexture) {
-      VRB_GL_CHECK(glCompressedTexSubImage2D(
-          face.target,
-          face.level,
-          0,
-          0,
-          face.width,
-          face.height,
-          face.format,
-          face.dataSize,
-          (void*)face.data.get()));
+    VRB_GL_CHECK(glBindTexture(target, texture));
+    // Every face and level is then specified into immutable storage in
+    // one pass.
+    if (kImmutable) {
+      VRB_GL_CHECK(glTexStorage2D(target, kLevelCount, kStorageFormat, kBase.width, kBase.height));
     } else {
-      VRB_GL_CHECK(glCompressedTexImage2D(
-          face.target,
-          face.level,
-          face.internalFormat,
-          face.width,
-          face.height,
-          face.border,
-          face.dataSize,
-          (void*)face.data.get()));
+      intMap[GL_TEXTURE_MAX_LEVEL] = kLevelCount - 1;
     }
-    if (!face.dataCacheHandle && dataCache) {
-      face.dataCacheHandle = dataCache->CacheData(face.data, (size_t)face.dataSize);
-    } else if (face.dataCacheHandle > 0) {
-      face.data = nullptr;
+  }
+  for (int face = 0; face < kFaceCount; face++) {
+    const GLenum kFaceTarget = (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face);
+    for (GLsizei ix = 0; ix < kLevelCount; ix++) {
+      CubeMapLevel& level = faces[face][ix];
+      VRB_GL_STATS_ADD(TextureUploadBytes, level.dataSize);
+      if (!kCompressed && !kImmutable && !externalTexture) {
+        VRB_GL_CHECK(glTexImage2D(
+            kFaceTarget,
+            level.level,
+            level.format,
+            level.width,
+            level.height,
+            0,
+            level.format,
+            level.type,
+            (void*)level.data.get()));
+      } else if (kCompressed && !kImmutable && !externalTexture) {
+        VRB_GL_CHECK(glCompressedTexImage2D(
+            kFaceTarget,
+            level.level,
+            level.format,
+            level.width,
+            level.height,
+            0,
+            level.dataSize,
+            (void*)level.data.get()));
+      } else if (kCompressed) {
+        VRB_GL_CHECK(glCompressedTexSubImage2D(
+            kFaceTarget,
+            level.level,
+            0,
+            0,
+            level.width,
+            level.height,
+            level.format,
+            level.dataSize,
+            (void*)level.data.get()));
+      } else {
+        VRB_GL_CHECK(glTexSubImage2D(
+            kFaceTarget,
+            level.level,
+            0,
+            0,
+            level.width,
+            level.height,
+            level.format,
+            level.type,
+            (void*)level.data.get()));
+      }
+      if (!level.dataCacheHandle && dataCache) {
+        level.dataCacheHandle = dataCache->CacheData(level.data, (size_t)level.dataSize);
+      } else if (level.dataCacheHandle > 0) {
+        level.data = nullptr;
+      }
     }
   }
 
@@ -191,6 +373,7 @@ TextureCubeMap::State::CreateTexture() {
     VRB_GL_CHECK(glTexParameteri(target, param->first, param->second));
   }
   dirty = false;
+  UpdateMemory();
 }
 
 void
@@ -203,6 +386,7 @@ TextureCubeMap::State::DestroyTexture() {
     texture = 0;
   }
   dirty = true;
+  UpdateMemory();
 }
 
 TextureCubeMapPtr
@@ -225,56 +409,102 @@ TextureCubeMap::Load(CreationContextPtr& aContext, const TextureCubeMapPtr& aTex
     return;
   }
 
-  reader->ReadImageFile(aFileXPos, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_POSITIVE_X));
-  reader->ReadImageFile(aFileXNeg, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_NEGATIVE_X));
-  reader->ReadImageFile(aFileYPos, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_POSITIVE_Y));
-  reader->ReadImageFile(aFileYNeg, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_NEGATIVE_Y));
-  reader->ReadImageFile(aFileZPos, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_POSITIVE_Z));
-  reader->ReadImageFile(aFileZNeg, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_NEGATIVE_Z));
+  const std::string* files[kFaceCount] = {&aFileXPos, &aFileXNeg, &aFileYPos, &aFileYNeg, &aFileZPos, &aFileZNeg};
+  CubeMapLoadPtr load = std::make_shared<CubeMapLoad>();
+  load->texture = aTexture;
+  JobSystemPtr jobs = aContext->GetJobSystem();
+  if (!jobs || !reader->SupportsConcurrentReads()) {
+    for (int ix = 0; ix < kFaceCount; ix++) {
+      const GLenum kFaceTarget = (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + ix);
+      reader->ReadImageFile(*files[ix], CubeMapTextureHandler::Create(aTexture, load, kFaceTarget));
+    }
+    return;
+  }
+
+  // Each face is read and decoded by its own job.
+  load->deferred = true;
+  JobSystem::JobHandle pass = jobs->Create(nullptr);
+  for (int ix = 0; ix < kFaceCount; ix++) {
+    const GLenum kFaceTarget = (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + ix);
+    const std::string kFile = *files[ix];
+    jobs->Schedule([reader, aTexture, load, kFaceTarget, kFile]() {
+      reader->ReadImageFile(kFile, CubeMapTextureHandler::Create(aTexture, load, kFaceTarget));
+    }, pass);
+  }
+  jobs->Run(pass);
+  jobs->Wait(pass);
+  if (!load->failed && aTexture) {
+    aTexture->SetImageLevels(load->levels);
+  }
 }
 
 void
-TextureCubeMap::SetImageData(const GLenum aFaceTarget, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat){
-  if ((aWidth <= 0) || (aHeight <= 0)) {
-    return;
-  }
+TextureCubeMap::Load(CreationContextPtr& aContext, const TextureCubeMapPtr& aTexture, const std::string& aFile) {
+  FileReaderPtr reader = aContext->GetFileReader();
 
-  if (!aImage) {
+  if (!reader) {
+    VRB_ERROR("FileReaderPtr not found while loading a CubeMap");
     return;
   }
 
-  int index = aFaceTarget - GL_TEXTURE_CUBE_MAP_POSITIVE_X;
-  if (index < 0 || index >= 6) {
+  reader->ReadImageFile(aFile, CubeMapTextureHandler::Create(aTexture, nullptr, GL_TEXTURE_CUBE_MAP_POSITIVE_X));
+}
+
+void
+TextureCubeMap::SetImageData(const GLenum aFaceTarget, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat){
+  std::vector<ImageLevel> levels(1);
+  levels[0].target = aFaceTarget;
+  levels[0].data = std::move(aImage);
+  levels[0].length = aImageLength;
+  levels[0].width = aWidth;
+  levels[0].height = aHeight;
+  levels[0].format = aFormat;
+  SetImageLevels(levels);
+}
+
+void
+TextureCubeMap::SetImageLevels(std::vector<ImageLevel>& aLevels) {
+  std::vector<CubeMapLevel> faces[kFaceCount];
+  for (ImageLevel& image: aLevels) {
+    const int kIndex = (int)image.target - GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+    if ((kIndex < 0) || (kIndex >= kFaceCount) || !image.data || (image.width <= 0) || (image.height <= 0)) {
+      continue;
+    }
+    // Compressed faces must be specified with their exact size.
+    const uint64_t kExpected = GetTextureLevelSize(image.format, image.width, image.height);
+    if (kExpected > image.length) {
+      VRB_ERROR("Cube map face of %dx%d in format 0x%x needs %llu bytes but has %llu",
+                image.width, image.height, image.format, (unsigned long long)kExpected, (unsigned long long)image.length);
+      continue;
+    }
+    CubeMapLevel level;
+    level.level = image.level;
+    level.width = image.width;
+    level.height = image.height;
+    level.format = image.format;
+    level.dataSize = (GLsizei)(kExpected > 0 ? kExpected : image.length);
+    level.data = std::move(image.data);
+    faces[kIndex].push_back(std::move(level));
+  }
+  bool changed = false;
+  for (int ix = 0; ix < kFaceCount; ix++) {
+    changed = m.SetFace(ix, faces[ix]) || changed;
+  }
+  if (!changed) {
     return;
   }
-
-  CubeMapFace& face = m.faces[index];
-  face.width = aWidth;
-  face.height = aHeight;
-  face.internalFormat = aFormat;
-  face.format = aFormat;
-  face.dataSize = (GLsizei) aImageLength;
-  face.data = std::move(aImage);
   m.dirty = true;
+  m.UpdateMemory();
 }
 
 TextureCubeMap::TextureCubeMap(State& aState, CreationContextPtr& aContext) : Texture(aState, aContext), ResourceGL (aState, aContext), m(aState) {
   m.dataCache = aContext->GetDataCache();
   m.target = GL_TEXTURE_CUBE_MAP;
-  for (int i = 0; i < 6; ++i) {
-    m.faces[i].target = (GLenum) GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
-  }
 }
 
 TextureCubeMap::~TextureCubeMap() {
-  if (!m.dataCache) {
-    return;
-  }
-  for (CubeMapFace& face: m.faces) {
-    if (face.dataCacheHandle > 0) {
-      m.dataCache->RemoveData(face.dataCacheHandle);
-      face.dataCacheHandle = 0;
-    }
+  for (std::vector<CubeMapLevel>& face: m.faces) {
+    m.RemoveCachedData(face);
   }
 }
 
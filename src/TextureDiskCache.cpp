@@ -0,0 +1,327 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/TextureDiskCache.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/FileReader.h"
+#include "vrb/Logger.h"
+#include "vrb/MappedFile.h"
+#include "vrb/Mutex.h"
+#include "vrb/private/CacheFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unordered_map>
+
+namespace {
+
+const uint32_t kMagic = 0x54425256; // "VRBT"
+const uint32_t kVersion = 1;
+const uint64_t kDefaultMaxSize = 256ull * 1024ull * 1024ull;
+const char* const kExtension = ".vrbt";
+
+// Eight bytes per step so hashing a source costs a fraction of decoding it.
+uint64_t
+HashContents(const char* aData, const size_t aSize) {
+  uint64_t hash = 0xcbf29ce484222325ull ^ (uint64_t)aSize;
+  size_t place = 0;
+  for (; (place + sizeof(uint64_t)) <= aSize; place += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, aData + place, sizeof(word));
+    hash ^= word;
+    hash *= 0x9e3779b97f4a7c15ull;
+    hash ^= hash >> 32;
+  }
+  for (; place < aSize; place++) {
+    hash ^= (uint8_t)aData[place];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+bool
+EndsWith(const std::string& aValue, const char* aSuffix) {
+  const size_t kLength = strlen(aSuffix);
+  return (aValue.size() >= kLength) && (aValue.compare(aValue.size() - kLength, kLength, aSuffix) == 0);
+}
+
+} // namespace
+
+namespace vrb {
+
+struct TextureDiskCache::State {
+  struct Entry {
+    uint64_t size;
+    // Larger values were used more recently.
+    uint64_t used;
+  };
+  mutable Mutex lock;
+  std::string directory;
+  uint64_t maxSize;
+  // Entries by file name, relative to the directory.
+  std::unordered_map<std::string, Entry> entries;
+  uint64_t useSequence;
+  Stats stats;
+  State() : maxSize(kDefaultMaxSize), useSequence(0) {}
+
+  static std::string GetEntryName(const std::string& aFileName) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx%s", (unsigned long long)CacheFileHash(aFileName), kExtension);
+    return name;
+  }
+
+  // Reads the entries left by earlier runs, oldest modification time first
+  // so they keep their order of use.
+  void Scan() {
+    entries.clear();
+    stats.size = 0;
+    useSequence = 0;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+      VRB_WARN("Unable to open texture cache directory: '%s'", directory.c_str());
+      return;
+    }
+    std::vector<std::pair<int64_t, std::string> > found;
+    struct dirent* item = nullptr;
+    while ((item = readdir(dir)) != nullptr) {
+      const std::string name(item->d_name);
+      const std::string path = directory + "/" + name;
+      if (EndsWith(name, ".tmp")) {
+        // Left by a run that exited while writing.
+        remove(path.c_str());
+        continue;
+      }
+      if (!EndsWith(name, kExtension)) {
+        continue;
+      }
+      struct stat info = {};
+      if ((stat(path.c_str(), &info) != 0) || !S_ISREG(info.st_mode)) {
+        continue;
+      }
+      Entry& entry = entries[name];
+      entry.size = (uint64_t)info.st_size;
+      stats.size += entry.size;
+      found.emplace_back((int64_t)info.st_mtime, name);
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    for (const std::pair<int64_t, std::string>& item: found) {
+      entries[item.second].used = ++useSequence;
+    }
+    Evict(std::string());
+  }
+
+  // Removes the least recently used entries other than aKeep until the
+  // cache fits maxSize. Must hold the lock.
+  void Evict(const std::string& aKeep) {
+    while ((stats.size > maxSize) && !entries.empty()) {
+      auto oldest = entries.end();
+      for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if ((it->first != aKeep) && ((oldest == entries.end()) || (it->second.used < oldest->second.used))) {
+          oldest = it;
+        }
+      }
+      if (oldest == entries.end()) {
+        return;
+      }
+      remove((directory + "/" + oldest->first).c_str());
+      stats.size -= oldest->second.size;
+      stats.evictions++;
+      entries.erase(oldest);
+    }
+  }
+
+  void Used(const std::string& aName, const std::string& aPath) {
+    auto it = entries.find(aName);
+    if (it != entries.end()) {
+      it->second.used = ++useSequence;
+    }
+    // The modification time carries the order of use to the next run.
+    utimensat(AT_FDCWD, aPath.c_str(), nullptr, 0);
+  }
+};
+
+TextureDiskCachePtr
+TextureDiskCache::Create() {
+  return std::make_shared<ConcreteClass<TextureDiskCache, TextureDiskCache::State> >();
+}
+
+void
+TextureDiskCache::SetCacheDirectory(const std::string& aDirectory) {
+  MutexAutoLock lock(m.lock);
+  m.directory = aDirectory;
+  if (m.directory.empty()) {
+    m.entries.clear();
+    m.stats.size = 0;
+    return;
+  }
+  m.Scan();
+}
+
+void
+TextureDiskCache::SetMaxSize(const uint64_t aBytes) {
+  MutexAutoLock lock(m.lock);
+  m.maxSize = aBytes;
+  m.Evict(std::string());
+}
+
+bool
+TextureDiskCache::IsEnabled() const {
+  MutexAutoLock lock(m.lock);
+  return !m.directory.empty();
+}
+
+bool
+TextureDiskCache::GetSourceKey(const std::string& aFileName, FileReader& aReader, uint64_t& aKey) const {
+  if (!IsEnabled()) {
+    return false;
+  }
+  MappedFilePtr mapping = aReader.MapFile(aFileName);
+  if (mapping && mapping->IsValid()) {
+    aKey = HashContents(mapping->Data(), mapping->Size());
+    return true;
+  }
+  // Compressed APK assets can not be mapped.
+  struct stat info = {};
+  if (stat(aFileName.c_str(), &info) != 0) {
+    return false;
+  }
+  const int64_t kValues[2] = { (int64_t)info.st_size, (int64_t)info.st_mtime };
+  aKey = HashContents((const char*)kValues, sizeof(kValues)) ^ 1ull;
+  return true;
+}
+
+bool
+TextureDiskCache::LoadLevels(const std::string& aFileName, const uint64_t aKey, std::vector<ImageLevel>& aLevels) {
+  std::string path;
+  const std::string name = State::GetEntryName(aFileName);
+  {
+    MutexAutoLock lock(m.lock);
+    if (m.directory.empty()) {
+      return false;
+    }
+    if (m.entries.find(name) == m.entries.end()) {
+      m.stats.misses++;
+      return false;
+    }
+    path = m.directory + "/" + name;
+  }
+  // Evicted or replaced files stay mapped until the mapping is released.
+  MappedFile mapping(path);
+  bool valid = mapping.IsValid();
+  std::vector<ImageLevel> levels;
+  if (valid) {
+    CacheFileReader reader(mapping.Data(), mapping.Size());
+    const uint32_t magic = reader.GetU32();
+    const uint32_t version = reader.GetU32();
+    const uint64_t key = reader.GetU64();
+    const std::string source = reader.GetString();
+    const uint32_t count = reader.GetU32();
+    valid = reader.IsValid() && (magic == kMagic) && (version == kVersion) && (key == aKey) && (source == aFileName) && (count > 0);
+    for (uint32_t index = 0; valid && (index < count); index++) {
+      ImageLevel level;
+      level.target = reader.GetU32();
+      level.level = reader.GetI32();
+      level.width = reader.GetI32();
+      level.height = reader.GetI32();
+      level.format = reader.GetU32();
+      level.length = reader.GetU64();
+      const char* data = reader.Skip(level.length);
+      if (!data || (level.length == 0)) {
+        valid = false;
+        break;
+      }
+      level.data = std::unique_ptr<uint8_t[]>(new uint8_t[level.length]);
+      memcpy(level.data.get(), data, level.length);
+      levels.push_back(std::move(level));
+    }
+    valid = valid && reader.AtEnd();
+  }
+  MutexAutoLock lock(m.lock);
+  if (!valid) {
+    // Stale or corrupt, StoreLevels replaces it once the source is decoded.
+    m.stats.misses++;
+    return false;
+  }
+  m.stats.hits++;
+  m.Used(name, path);
+  aLevels = std::move(levels);
+  VRB_DEBUG("Loaded cached texture levels: '%s'", aFileName.c_str());
+  return true;
+}
+
+void
+TextureDiskCache::StoreLevels(const std::string& aFileName, const uint64_t aKey, const std::vector<ImageLevel>& aLevels) {
+  std::string directory;
+  {
+    MutexAutoLock lock(m.lock);
+    directory = m.directory;
+  }
+  if (directory.empty() || aLevels.empty()) {
+    return;
+  }
+  CacheFileWriter header;
+  header.PutU32(kMagic);
+  header.PutU32(kVersion);
+  header.PutU64(aKey);
+  header.PutString(aFileName);
+  header.PutU32((uint32_t)aLevels.size());
+  uint64_t size = header.Buffer().size();
+  for (const ImageLevel& level: aLevels) {
+    if (!level.data || (level.length == 0)) {
+      return;
+    }
+    size += sizeof(uint32_t) * 5 + sizeof(uint64_t) + level.length;
+  }
+  if (size > m.maxSize) {
+    return;
+  }
+  const std::string name = State::GetEntryName(aFileName);
+  const std::string path = directory + "/" + name;
+  CacheFileOutput output(path, "texture cache");
+  if (!output.IsOpen()) {
+    return;
+  }
+  output.Write(header);
+  for (const ImageLevel& level: aLevels) {
+    CacheFileWriter info;
+    info.PutU32(level.target);
+    info.PutI32(level.level);
+    info.PutI32(level.width);
+    info.PutI32(level.height);
+    info.PutU32(level.format);
+    info.PutU64(level.length);
+    output.Write(info);
+    output.Write(level.data.get(), level.length);
+  }
+  MutexAutoLock lock(m.lock);
+  // Dropped if the directory changed while writing.
+  if ((m.directory != directory) || !output.Commit()) {
+    return;
+  }
+  State::Entry& entry = m.entries[name];
+  m.stats.size -= entry.size;
+  entry.size = size;
+  entry.used = ++m.useSequence;
+  m.stats.size += size;
+  m.Evict(name);
+  VRB_DEBUG("Wrote texture cache '%s' for '%s'", path.c_str(), aFileName.c_str());
+}
+
+TextureDiskCache::Stats
+TextureDiskCache::GetStats() const {
+  MutexAutoLock lock(m.lock);
+  return m.stats;
+}
+
+TextureDiskCache::TextureDiskCache(State& aState) : m(aState) {}
+TextureDiskCache::~TextureDiskCache() {}
+
+} // namespace vrb
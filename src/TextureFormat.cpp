@@ -0,0 +1,281 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/TextureFormat.h"
+#include "vrb/FileReader.h"
+#include "vrb/private/LittleEndian.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// ASTC block dimensions in the order of the GL format enums.
+const int kASTCBlocks[][2] = {
+  {4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6},
+  {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}
+};
+const int kASTCBlockCount = sizeof(kASTCBlocks) / sizeof(kASTCBlocks[0]);
+
+const uint8_t kASTCMagic[4] = {0x13, 0xAB, 0xA1, 0x5C};
+const size_t kASTCHeaderSize = 16;
+
+const uint8_t kKTXIdentifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+const size_t kKTXHeaderSize = 64;
+const uint32_t kKTXEndianness = 0x04030201;
+
+// Bytes per block of the compressed formats, zero for other formats.
+uint64_t
+BlockBytes(const GLenum aFormat) {
+  if (aFormat == GL_ETC1_RGB8_OES) {
+    return 8;
+  }
+  if ((aFormat >= GL_COMPRESSED_RGB_S3TC_DXT1_EXT) && (aFormat <= GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)) {
+    return aFormat <= GL_COMPRESSED_RGB_S3TC_DXT1_EXT + 1 ? 8 : 16;
+  }
+  if ((aFormat >= GL_COMPRESSED_R11_EAC) && (aFormat <= GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC)) {
+    // The RG11 and RGBA8 formats have two 64 bit blocks.
+    const GLenum kIndex = aFormat - GL_COMPRESSED_R11_EAC;
+    return ((kIndex == 2) || (kIndex == 3) || (kIndex >= 8)) ? 16 : 8;
+  }
+  int width = 0;
+  int height = 0;
+  if (vrb::GetASTCBlockSize(aFormat, width, height)) {
+    return 16;
+  }
+  return 0;
+}
+
+uint64_t
+PixelBytes(const GLenum aFormat) {
+  switch (aFormat) {
+    case GL_RGBA:
+    case GL_RGBA8:
+      return 4;
+    case GL_RGB:
+    case GL_RGB8:
+      return 3;
+    case GL_RG:
+    case GL_RG8:
+      return 2;
+    case GL_RED:
+    case GL_R8:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+} // namespace
+
+namespace vrb {
+
+bool
+IsCompressedTextureFormat(const GLenum aFormat) {
+  return BlockBytes(aFormat) > 0;
+}
+
+GLenum
+GetTextureStorageFormat(const GLenum aFormat) {
+  switch (aFormat) {
+    case GL_RGBA:
+      return GL_RGBA8;
+    case GL_RGB:
+      return GL_RGB8;
+    case GL_RG:
+      return GL_RG8;
+    case GL_RED:
+      return GL_R8;
+    case GL_RGBA8:
+    case GL_RGB8:
+    case GL_RG8:
+    case GL_R8:
+      return aFormat;
+    default:
+      break;
+  }
+  // OES_compressed_ETC1_RGB8_texture does not allow immutable storage or
+  // sub image updates.
+  if ((aFormat == GL_ETC1_RGB8_OES) || !IsCompressedTextureFormat(aFormat)) {
+    return 0;
+  }
+  return aFormat;
+}
+
+bool
+GetASTCBlockSize(const GLenum aFormat, int& aBlockWidth, int& aBlockHeight) {
+  int index = -1;
+  if ((aFormat >= GL_COMPRESSED_RGBA_ASTC_4x4_KHR) && (aFormat <= GL_COMPRESSED_RGBA_ASTC_12x12_KHR)) {
+    index = (int)(aFormat - GL_COMPRESSED_RGBA_ASTC_4x4_KHR);
+  } else if ((aFormat >= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR) && (aFormat <= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_12x12_KHR)) {
+    index = (int)(aFormat - GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR);
+  }
+  if (index < 0) {
+    return false;
+  }
+  aBlockWidth = kASTCBlocks[index][0];
+  aBlockHeight = kASTCBlocks[index][1];
+  return true;
+}
+
+GLenum
+GetASTCFormat(const int aBlockWidth, const int aBlockHeight, const bool aSRGB) {
+  for (int ix = 0; ix < kASTCBlockCount; ix++) {
+    if ((kASTCBlocks[ix][0] == aBlockWidth) && (kASTCBlocks[ix][1] == aBlockHeight)) {
+      return (aSRGB ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR : GL_COMPRESSED_RGBA_ASTC_4x4_KHR) + (GLenum)ix;
+    }
+  }
+  return 0;
+}
+
+uint64_t
+GetTextureLevelSize(const GLenum aFormat, const int aWidth, const int aHeight) {
+  if ((aWidth <= 0) || (aHeight <= 0)) {
+    return 0;
+  }
+  const uint64_t kBlockBytes = BlockBytes(aFormat);
+  if (kBlockBytes == 0) {
+    return PixelBytes(aFormat) * (uint64_t)aWidth * (uint64_t)aHeight;
+  }
+  int blockWidth = 4;
+  int blockHeight = 4;
+  GetASTCBlockSize(aFormat, blockWidth, blockHeight);
+  const uint64_t kColumns = (uint64_t)((aWidth + blockWidth - 1) / blockWidth);
+  const uint64_t kRows = (uint64_t)((aHeight + blockHeight - 1) / blockHeight);
+  return kColumns * kRows * kBlockBytes;
+}
+
+uint32_t
+GetMipLevelCount(const uint32_t aWidth, const uint32_t aHeight) {
+  uint32_t size = std::max(aWidth, aHeight);
+  uint32_t result = 1;
+  while (size > 1) {
+    size >>= 1;
+    result++;
+  }
+  return result;
+}
+
+bool
+IsASTCFile(const char* aData, const size_t aSize) {
+  return aData && (aSize >= kASTCHeaderSize) && (memcmp(aData, kASTCMagic, sizeof(kASTCMagic)) == 0);
+}
+
+bool
+ReadASTCFile(const char* aData, const size_t aSize, std::vector<ImageLevel>& aLevels, std::string& aError) {
+  if (!IsASTCFile(aData, aSize)) {
+    aError = "Not an ASTC file";
+    return false;
+  }
+  const uint8_t* header = (const uint8_t*)aData;
+  const uint32_t kDepth = ReadLittleEndian24(header + 13);
+  // The file does not record the color space, textures are taken as linear.
+  const GLenum kFormat = GetASTCFormat(header[4], header[5], false);
+  if ((kFormat == 0) || (header[6] != 1) || (kDepth != 1)) {
+    aError = "Unsupported ASTC block size";
+    return false;
+  }
+  ImageLevel level;
+  level.width = (int)ReadLittleEndian24(header + 7);
+  level.height = (int)ReadLittleEndian24(header + 10);
+  level.format = kFormat;
+  level.length = GetTextureLevelSize(kFormat, level.width, level.height);
+  if ((level.length == 0) || (level.length > aSize - kASTCHeaderSize)) {
+    aError = "Truncated ASTC file";
+    return false;
+  }
+  level.data = std::make_unique<uint8_t[]>((size_t)level.length);
+  memcpy(level.data.get(), aData + kASTCHeaderSize, (size_t)level.length);
+  aLevels.push_back(std::move(level));
+  return true;
+}
+
+bool
+ReadKTXFile(const char* aData, const size_t aSize, std::vector<ImageLevel>& aLevels, std::string& aError) {
+  const uint8_t* data = (const uint8_t*)aData;
+  if (!aData || (aSize < kKTXHeaderSize) || (memcmp(aData, kKTXIdentifier, sizeof(kKTXIdentifier)) != 0)) {
+    aError = "Not a KTX file";
+    return false;
+  }
+  if (ReadLittleEndian32(data + 12) != kKTXEndianness) {
+    aError = "Big endian KTX files are not supported";
+    return false;
+  }
+  const uint32_t kType = ReadLittleEndian32(data + 16);
+  const uint32_t kFormat = ReadLittleEndian32(data + 24);
+  const uint32_t kInternalFormat = ReadLittleEndian32(data + 28);
+  const uint32_t kWidth = ReadLittleEndian32(data + 36);
+  const uint32_t kHeight = ReadLittleEndian32(data + 40);
+  const uint32_t kDepth = ReadLittleEndian32(data + 44);
+  const uint32_t kArrayCount = ReadLittleEndian32(data + 48);
+  const uint32_t kFaceCount = ReadLittleEndian32(data + 52);
+  const uint32_t kLevelCount = std::max(ReadLittleEndian32(data + 56), 1u);
+  const uint32_t kKeyValueLength = ReadLittleEndian32(data + 60);
+  // Compressed files have a glType of zero, the rest must be 8 bit per channel.
+  const GLenum kLevelFormat = kType == 0 ? (GLenum)kInternalFormat : (GLenum)kFormat;
+  if ((kType != 0) && (kType != GL_UNSIGNED_BYTE)) {
+    aError = "Unsupported KTX pixel type";
+    return false;
+  }
+  if ((kWidth == 0) || (kHeight == 0) || (kDepth > 1) || (kArrayCount > 0) || ((kFaceCount != 1) && (kFaceCount != 6))) {
+    aError = "Only 2D and cube map KTX textures are supported";
+    return false;
+  }
+  if ((kWidth > (uint32_t)std::numeric_limits<int>::max()) || (kHeight > (uint32_t)std::numeric_limits<int>::max())) {
+    aError = "KTX texture is too large";
+    return false;
+  }
+  if (kLevelCount > GetMipLevelCount(kWidth, kHeight)) {
+    aError = "Invalid KTX level count";
+    return false;
+  }
+  if (GetTextureLevelSize(kLevelFormat, (int)kWidth, (int)kHeight) == 0) {
+    aError = "Unsupported KTX format";
+    return false;
+  }
+
+  std::vector<ImageLevel> levels((size_t)kFaceCount * kLevelCount);
+  size_t offset = kKTXHeaderSize + (size_t)kKeyValueLength;
+  for (uint32_t ix = 0; ix < kLevelCount; ix++) {
+    if ((offset > aSize) || (aSize - offset < 4)) {
+      aError = "Truncated KTX file";
+      return false;
+    }
+    // For cube maps the size is of a single face.
+    const uint64_t kImageSize = ReadLittleEndian32(data + offset);
+    offset += 4;
+    const int kLevelWidth = (int)std::max(kWidth >> ix, 1u);
+    const int kLevelHeight = (int)std::max(kHeight >> ix, 1u);
+    const uint64_t kExpected = GetTextureLevelSize(kLevelFormat, kLevelWidth, kLevelHeight);
+    for (uint32_t face = 0; face < kFaceCount; face++) {
+      if ((kImageSize < kExpected) || (kImageSize > aSize - offset)) {
+        aError = "Truncated KTX level";
+        return false;
+      }
+      if ((kType != 0) && (kImageSize != kExpected)) {
+        aError = "KTX files with padded rows are not supported";
+        return false;
+      }
+      ImageLevel& level = levels[((size_t)face * kLevelCount) + ix];
+      level.target = kFaceCount == 6 ? (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) : (GLenum)GL_TEXTURE_2D;
+      level.level = (int)ix;
+      level.width = kLevelWidth;
+      level.height = kLevelHeight;
+      level.format = kLevelFormat;
+      level.length = kExpected;
+      level.data = std::make_unique<uint8_t[]>((size_t)kExpected);
+      memcpy(level.data.get(), data + offset, (size_t)kExpected);
+      // Faces and levels start on four byte boundaries.
+      offset += (size_t)((kImageSize + 3) & ~(uint64_t)3);
+    }
+  }
+  for (ImageLevel& level: levels) {
+    aLevels.push_back(std::move(level));
+  }
+  return true;
+}
+
+} // namespace vrb
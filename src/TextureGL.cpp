@@ -9,11 +9,19 @@
 #include "vrb/ConcreteClass.h"
 #include "vrb/CreationContext.h"
 #include "vrb/DataCache.h"
+#include "vrb/FileReader.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLError.h"
+#include "vrb/LoadReport.h"
 #include "vrb/Logger.h"
+#include "vrb/MemoryCounter.h"
+#include "vrb/TextureFormat.h"
+#include "vrb/TraceProfiler.h"
+#include "vrb/private/PoolAllocator.h"
 #include "vrb/private/ResourceGLState.h"
 
 #include "vrb/gl.h"
+#include <algorithm>
 #include <cstring>
 #include <vector>
 
@@ -30,6 +38,8 @@ struct MipMap {
   GLenum type;
   GLsizei dataSize;
   std::unique_ptr<uint8_t[]> data;
+  // View into the DataCache mapping while the cached data is in use.
+  const uint8_t* view;
   uint32_t dataCacheHandle;
 
   MipMap()
@@ -42,6 +52,7 @@ struct MipMap {
       , format(GL_RGB)
       , type(GL_UNSIGNED_BYTE)
       , dataSize(0)
+      , view(nullptr)
       , dataCacheHandle(0)
   {}
 
@@ -55,6 +66,7 @@ struct MipMap {
       , format(GL_RGB)
       , type(GL_UNSIGNED_BYTE)
       , dataSize(0)
+      , view(nullptr)
       , dataCacheHandle(0)
   {
     *this = std::move(aSource);
@@ -75,74 +87,380 @@ struct MipMap {
     dataSize = aSource.dataSize;
     dataCacheHandle = aSource.dataCacheHandle;
     data = std::move(aSource.data);
+    view = aSource.view;
+    aSource.view = nullptr;
     return *this;
   }
 
+  const uint8_t* Data() const {
+    return data ? data.get() : view;
+  }
+
 private:
   MipMap(const MipMap&) = delete;
   MipMap& operator=(const MipMap&) = delete;
 };
 
+// Images at least this large are uploaded through a pixel buffer object
+// by AboutToBind.
+const size_t kStagedUploadThreshold = 256 * 1024;
+// Bytes copied into the mapped pixel buffer per AboutToBind call.
+const size_t kStagedCopySize = 1024 * 1024;
+
+void
+AddTextureBytes(const GLsizei aBytes) {
+  vrb::LoadReportCollectorPtr report = vrb::LoadReportCollector::GetCurrent();
+  if (report && (aBytes > 0)) {
+    report->AddValue(vrb::LoadReport::Counter::TextureBytes, (uint64_t)aBytes);
+  }
+}
+
+void
+TexImage(const MipMap& aMipMap, const void* aData) {
+  VRB_GL_STATS_ADD(TextureUploadBytes, aMipMap.dataSize);
+  vrb::LoadReportTimer timer(vrb::LoadReport::Phase::TextureUpload);
+  AddTextureBytes(aMipMap.dataSize);
+  if (!vrb::IsCompressedTextureFormat(aMipMap.format)) {
+    VRB_GL_CHECK(glTexImage2D(
+        aMipMap.target,
+        aMipMap.level,
+        aMipMap.internalFormat,
+        aMipMap.width,
+        aMipMap.height,
+        aMipMap.border,
+        aMipMap.format,
+        aMipMap.type,
+        aData));
+  } else {
+    VRB_GL_CHECK(glCompressedTexImage2D(
+        aMipMap.target,
+        aMipMap.level,
+        aMipMap.internalFormat,
+        aMipMap.width,
+        aMipMap.height,
+        aMipMap.border,
+        aMipMap.dataSize,
+        aData));
+  }
+}
+
+// Specifies a level of a texture whose storage was allocated with
+// glTexStorage2D.
+void
+TexSubImage(const MipMap& aMipMap, const void* aData) {
+  VRB_GL_STATS_ADD(TextureUploadBytes, aMipMap.dataSize);
+  vrb::LoadReportTimer timer(vrb::LoadReport::Phase::TextureUpload);
+  AddTextureBytes(aMipMap.dataSize);
+  if (!vrb::IsCompressedTextureFormat(aMipMap.format)) {
+    VRB_GL_CHECK(glTexSubImage2D(
+        aMipMap.target,
+        aMipMap.level,
+        0,
+        0,
+        aMipMap.width,
+        aMipMap.height,
+        aMipMap.format,
+        aMipMap.type,
+        aData));
+  } else {
+    VRB_GL_CHECK(glCompressedTexSubImage2D(
+        aMipMap.target,
+        aMipMap.level,
+        0,
+        0,
+        aMipMap.width,
+        aMipMap.height,
+        aMipMap.format,
+        aMipMap.dataSize,
+        aData));
+  }
+}
+
+// The sized format to allocate every level of aMipMaps up front with
+// glTexStorage2D, or zero when the texture needs mutable storage. Immutable
+// storage spares the driver from validating the completeness of the mip
+// chain on each draw, but it can only hold levels that start at zero and
+// halve in size, and every level must have data.
+GLenum
+GetStorageFormat(const std::vector<MipMap>& aMipMaps) {
+  if (aMipMaps.empty()) {
+    return 0;
+  }
+  const MipMap& kBase = aMipMaps[0];
+  for (size_t ix = 0; ix < aMipMaps.size(); ix++) {
+    const MipMap& kMipMap = aMipMaps[ix];
+    if (!kMipMap.Data() || (kMipMap.level != (GLint)ix) || (kMipMap.format != kBase.format) ||
+        (kMipMap.width != std::max(kBase.width >> ix, 1)) || (kMipMap.height != std::max(kBase.height >> ix, 1))) {
+      return 0;
+    }
+  }
+  return vrb::GetTextureStorageFormat(kBase.format);
+}
+
+// Incremented by every TextureGL::AboutToBind call. Render thread only.
+uint64_t sBindSequence = 0;
+
+// glCompressedTexImage2D fails unless imageSize matches the level exactly,
+// so data beyond the level, such as KTX padding, is not counted.
+bool
+GetLevelDataSize(const GLenum aFormat, const int aWidth, const int aHeight, const uint64_t aLength, GLsizei& aDataSize) {
+  const uint64_t kExpected = vrb::GetTextureLevelSize(aFormat, aWidth, aHeight);
+  if (kExpected > aLength) {
+    VRB_ERROR("Texture level of %dx%d in format 0x%x needs %llu bytes but has %llu",
+              aWidth, aHeight, aFormat, (unsigned long long)kExpected, (unsigned long long)aLength);
+    return false;
+  }
+  aDataSize = (GLsizei)(kExpected > 0 ? kExpected : aLength);
+  return true;
+}
+
+// Releases the storage of a level by respecifying it as empty.
+void
+FreeTexImage(const MipMap& aMipMap) {
+  if (!vrb::IsCompressedTextureFormat(aMipMap.format)) {
+    VRB_GL_CHECK(glTexImage2D(aMipMap.target, aMipMap.level, aMipMap.internalFormat, 0, 0, 0,
+                              aMipMap.format, aMipMap.type, nullptr));
+  } else {
+    VRB_GL_CHECK(glCompressedTexImage2D(aMipMap.target, aMipMap.level, aMipMap.internalFormat, 0, 0, 0, 0, nullptr));
+  }
+}
+
 }
 
 namespace vrb {
 
 struct TextureGL::State : public Texture::State, public ResourceGL::State {
+  // An upload through a pixel buffer object spread over several
+  // AboutToBind calls. The image is copied into the mapped buffer in
+  // kStagedCopySize steps, then the texture is specified from the buffer.
+  // The previous texture stays bound until the fence signals that the
+  // driver has finished with the buffer.
+  struct StagedUpload {
+    GLuint buffer;
+    GLuint texture;
+    GLsync fence;
+    uint8_t* mapped;
+    size_t size;
+    size_t copied;
+    StagedUpload() : buffer(0), texture(0), fence(nullptr), mapped(nullptr), size(0), copied(0) {}
+  };
   bool dirty;
   DataCachePtr dataCache;
+  GLDeletionQueuePtr glDeletions;
   std::vector<MipMap> mipMaps;
+  StagedUpload staged;
+  // Streaming uploads at most streamingBudget bytes of mip levels per
+  // AboutToBind call, coarsest level first. residentIndex is the index in
+  // mipMaps of the finest level uploaded so far.
+  size_t streamingBudget;
+  int levelLimit;
+  size_t residentIndex;
+  uint64_t lastBound;
+  std::function<void()> deferredLoad;
+  std::function<void()> reload;
+  // Set once ReleaseImageData() dropped the image, reload reads it again.
+  bool imageReleased;
+  MemoryTracker gpuMemory;
+  // Image data held in memory rather than in the DataCache.
+  MemoryTracker cpuMemory;
 
-  State() : dirty(false) {}
+  State()
+      : dirty(false)
+      , streamingBudget(0)
+      , levelLimit(0)
+      , residentIndex(0)
+      , lastBound(0)
+      , imageReleased(false)
+      , gpuMemory(MemoryType::TextureRGBA)
+      , cpuMemory(MemoryType::ImageData)
+  {}
+  size_t GetDataSize(const bool aIncludeCached) const;
+  size_t GetGPUSize() const;
+  void UpdateMemory();
+  void LoadMipMapData();
+  void LoadMipMapData(MipMap& aMipMap);
+  void ReleaseMipMapData();
+  void ReleaseMipMapData(MipMap& aMipMap);
+  bool IsStreaming() const { return (streamingBudget > 0) && (mipMaps.size() > 1); }
+  size_t GetLimitIndex() const;
+  void StreamLevels();
   void CreateTexture();
   void DestroyTexture();
+  void StartStagedUpload();
+  void ContinueStagedUpload();
+  void CancelStagedUpload();
+  bool IsStaging() const { return staged.buffer != 0; }
+  // Hand the names to the GLDeletionQueue, which every CreationContext has.
+  void ReleaseTexture(GLuint& aTexture) {
+    glDeletions->DeleteTexture(aTexture);
+    aTexture = 0;
+  }
+  void ReleaseBuffer(GLuint& aBuffer) {
+    glDeletions->DeleteBuffer(aBuffer);
+    aBuffer = 0;
+  }
 };
 
+size_t
+TextureGL::State::GetDataSize(const bool aIncludeCached) const {
+  size_t result = 0;
+  for (const MipMap& mipMap: mipMaps) {
+    if (mipMap.Data() || (aIncludeCached && (mipMap.dataCacheHandle > 0))) {
+      result += (size_t)mipMap.dataSize;
+    }
+  }
+  return result;
+}
+
+size_t
+TextureGL::State::GetGPUSize() const {
+  if (!texture) {
+    return 0;
+  }
+  if (!IsStreaming() && !imageReleased) {
+    return GetDataSize(true);
+  }
+  // Released levels have no data but are still uploaded.
+  size_t result = 0;
+  for (size_t ix = IsStreaming() ? residentIndex : 0; ix < mipMaps.size(); ix++) {
+    result += (size_t)mipMaps[ix].dataSize;
+  }
+  return result;
+}
+
+void
+TextureGL::State::UpdateMemory() {
+  size_t cpu = 0;
+  for (const MipMap& mipMap: mipMaps) {
+    if (mipMap.data) {
+      cpu += (size_t)mipMap.dataSize;
+    }
+  }
+  cpuMemory.Set(cpu);
+  const MemoryType kType = mipMaps.empty() ? MemoryType::TextureRGBA : GetTextureMemoryType(mipMaps[0].format);
+  gpuMemory.Set(kType, GetGPUSize());
+}
+
+void
+TextureGL::State::LoadMipMapData() {
+  for (MipMap& mipMap: mipMaps) {
+    LoadMipMapData(mipMap);
+  }
+}
+
+void
+TextureGL::State::LoadMipMapData(MipMap& aMipMap) {
+  if (dataCache && (aMipMap.dataCacheHandle > 0) && !aMipMap.Data()) {
+    size_t size = 0;
+    aMipMap.view = dataCache->MapData(aMipMap.dataCacheHandle, size);
+    if (size != (size_t)aMipMap.dataSize) {
+      aMipMap.view = nullptr;
+    }
+    if (!aMipMap.view) {
+      // Compressed entries can not be mapped.
+      dataCache->LoadData(aMipMap.dataCacheHandle, aMipMap.data);
+    }
+  }
+}
+
+void
+TextureGL::State::ReleaseMipMapData() {
+  for (MipMap& mipMap: mipMaps) {
+    ReleaseMipMapData(mipMap);
+  }
+}
+
+void
+TextureGL::State::ReleaseMipMapData(MipMap& aMipMap) {
+  aMipMap.view = nullptr;
+  if (!dataCache || !aMipMap.data) {
+    return;
+  }
+  if (aMipMap.dataCacheHandle == 0) {
+    aMipMap.dataCacheHandle = dataCache->CacheData(aMipMap.data, (size_t)aMipMap.dataSize);
+  } else {
+    aMipMap.data = nullptr;
+  }
+}
+
+size_t
+TextureGL::State::GetLimitIndex() const {
+  // The coarsest level is always kept.
+  size_t result = mipMaps.size() - 1;
+  while ((result > 0) && (mipMaps[result - 1].level >= levelLimit)) {
+    result--;
+  }
+  return result;
+}
+
+void
+TextureGL::State::StreamLevels() {
+  if (dirty) {
+    CancelStagedUpload();
+    ReleaseTexture(texture);
+    VRB_GL_CHECK(glGenTextures(1, &texture));
+    VRB_GL_CHECK(glBindTexture(target, texture));
+    for (auto param = intMap.begin(); param != intMap.end(); param++) {
+      VRB_GL_CHECK(glTexParameteri(target, param->first, param->second));
+    }
+    residentIndex = mipMaps.size();
+    dirty = false;
+  }
+  const size_t kLimitIndex = GetLimitIndex();
+  if (residentIndex == kLimitIndex) {
+    return;
+  }
+  VRB_GL_CHECK(glBindTexture(target, texture));
+  // Evict levels finer than the limit.
+  while (residentIndex < kLimitIndex) {
+    FreeTexImage(mipMaps[residentIndex]);
+    residentIndex++;
+  }
+  // Stream in the next coarser-to-finer levels within the budget, at least
+  // one level per call.
+  size_t uploaded = 0;
+  while ((residentIndex > kLimitIndex) && ((uploaded == 0) || (uploaded < streamingBudget))) {
+    MipMap& mipMap = mipMaps[residentIndex - 1];
+    LoadMipMapData(mipMap);
+    if (!mipMap.Data()) {
+      VRB_ERROR("Missing data for texture level %d", mipMap.level);
+      break;
+    }
+    TexImage(mipMap, (const void*)mipMap.Data());
+    ReleaseMipMapData(mipMap);
+    uploaded += (size_t)mipMap.dataSize;
+    residentIndex--;
+  }
+  if (residentIndex < mipMaps.size()) {
+    VRB_GL_CHECK(glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, mipMaps[residentIndex].level));
+  }
+  UpdateMemory();
+}
+
 void
 TextureGL::State::CreateTexture() {
-  if (!dirty) {
+  // A released image is read again by AboutToBind.
+  if (!dirty || imageReleased) {
     return;
   }
+  VRB_TRACE_ZONE("TextureGL::CreateTexture");
+  CancelStagedUpload();
+  ReleaseTexture(texture);
   VRB_GL_CHECK(glGenTextures(1, &texture));
   VRB_GL_CHECK(glBindTexture(target, texture));
+  LoadMipMapData();
+  const GLenum kStorageFormat = GetStorageFormat(mipMaps);
+  if (kStorageFormat) {
+    VRB_GL_CHECK(glTexStorage2D(target, (GLsizei)mipMaps.size(), kStorageFormat, mipMaps[0].width, mipMaps[0].height));
+  }
   for (MipMap& mipMap: mipMaps) {
-    if (dataCache && (mipMap.dataCacheHandle > 0)) {
-      dataCache->LoadData(mipMap.dataCacheHandle, mipMap.data);
-    }
-    if (!mipMap.data) {
-      continue;
-    }
-
-    if (mipMap.format == GL_RG8 || mipMap.format == GL_RGBA) {
-      VRB_GL_CHECK(glTexImage2D(
-          mipMap.target,
-          mipMap.level,
-          mipMap.internalFormat,
-          mipMap.width,
-          mipMap.height,
-          mipMap.border,
-          mipMap.format,
-          mipMap.type,
-          (void*)mipMap.data.get()));
-    } else {
-      VRB_GL_CHECK(glCompressedTexImage2D(
-          mipMap.target,
-          mipMap.level,
-          mipMap.internalFormat,
-          mipMap.width,
-          mipMap.height,
-          mipMap.border,
-          mipMap.dataSize,
-          (void*)mipMap.data.get()));
-    }
-
-    if (dataCache) {
-      if (mipMap.dataCacheHandle == 0) {
-        mipMap.dataCacheHandle = dataCache->CacheData(mipMap.data, (size_t)mipMap.dataSize);
-      } else {
-        mipMap.data = nullptr;
-      }
+    if (kStorageFormat) {
+      TexSubImage(mipMap, (const void*)mipMap.Data());
+    } else if (mipMap.Data()) {
+      TexImage(mipMap, (const void*)mipMap.Data());
     }
   }
+  ReleaseMipMapData();
 
   for (auto param = intMap.begin(); param != intMap.end(); param++) {
     VRB_GL_CHECK(glTexParameteri(target, param->first, param->second));
@@ -151,17 +469,130 @@ TextureGL::State::CreateTexture() {
 }
 
 void
-TextureGL::State::DestroyTexture() {
-  if (texture > 0) {
-    VRB_GL_CHECK(glDeleteTextures(1, &texture));
-    texture = 0;
+TextureGL::State::StartStagedUpload() {
+  CancelStagedUpload();
+  size_t size = GetDataSize(true);
+  if (size >= kStagedUploadThreshold) {
+    LoadMipMapData();
+    // Cached data that failed to load is skipped.
+    size = GetDataSize(false);
+  }
+  if (size < kStagedUploadThreshold) {
+    CreateTexture();
+    return;
+  }
+  VRB_GL_CHECK(glGenBuffers(1, &staged.buffer));
+  VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staged.buffer));
+  VRB_GL_CHECK(glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, nullptr, GL_STREAM_DRAW));
+  VRB_GL_CHECK(staged.mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)size,
+                                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+  if (!staged.mapped) {
+    VRB_WARN("Failed to map texture upload buffer, uploading directly");
+    CancelStagedUpload();
+    CreateTexture();
+    return;
+  }
+  staged.size = size;
+  staged.copied = 0;
+  dirty = false;
+}
+
+void
+TextureGL::State::ContinueStagedUpload() {
+  if (staged.mapped) {
+    // Copy the next step of the image data into the mapped buffer.
+    size_t remaining = kStagedCopySize;
+    size_t offset = 0;
+    for (MipMap& mipMap: mipMaps) {
+      if (!mipMap.Data()) {
+        continue;
+      }
+      const size_t kEnd = offset + (size_t)mipMap.dataSize;
+      if (staged.copied < kEnd) {
+        const size_t kCount = std::min(remaining, kEnd - staged.copied);
+        memcpy(staged.mapped + staged.copied, mipMap.Data() + (staged.copied - offset), kCount);
+        staged.copied += kCount;
+        remaining -= kCount;
+      }
+      offset = kEnd;
+      if (remaining == 0) {
+        break;
+      }
+    }
+    if (staged.copied < staged.size) {
+      return;
+    }
+    VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staged.buffer));
+    VRB_GL_CHECK(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+    staged.mapped = nullptr;
+    VRB_GL_CHECK(glGenTextures(1, &staged.texture));
+    VRB_GL_CHECK(glBindTexture(target, staged.texture));
+    const GLenum kStorageFormat = GetStorageFormat(mipMaps);
+    if (kStorageFormat) {
+      VRB_GL_CHECK(glTexStorage2D(target, (GLsizei)mipMaps.size(), kStorageFormat, mipMaps[0].width, mipMaps[0].height));
+    }
+    offset = 0;
+    for (MipMap& mipMap: mipMaps) {
+      if (mipMap.Data()) {
+        // With a pixel unpack buffer bound the data pointer is an offset into the buffer.
+        if (kStorageFormat) {
+          TexSubImage(mipMap, (const void*)offset);
+        } else {
+          TexImage(mipMap, (const void*)offset);
+        }
+        offset += (size_t)mipMap.dataSize;
+      }
+    }
+    for (auto param = intMap.begin(); param != intMap.end(); param++) {
+      VRB_GL_CHECK(glTexParameteri(target, param->first, param->second));
+    }
+    VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    VRB_GL_CHECK(staged.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    ReleaseMipMapData();
+    return;
+  }
+  if (!staged.fence) {
+    return;
   }
+  const GLenum kStatus = glClientWaitSync(staged.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (kStatus == GL_TIMEOUT_EXPIRED) {
+    return;
+  }
+  if (kStatus == GL_WAIT_FAILED) {
+    VRB_ERROR("Failed to wait for texture upload fence");
+  }
+  ReleaseTexture(texture);
+  texture = staged.texture;
+  staged.texture = 0;
+  CancelStagedUpload();
+}
+
+void
+TextureGL::State::CancelStagedUpload() {
+  if (staged.fence) {
+    glDeleteSync(staged.fence);
+  }
+  if (staged.mapped) {
+    VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staged.buffer));
+    VRB_GL_CHECK(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+    VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+  }
+  ReleaseBuffer(staged.buffer);
+  ReleaseTexture(staged.texture);
+  staged = StagedUpload();
+}
+
+void
+TextureGL::State::DestroyTexture() {
+  CancelStagedUpload();
+  ReleaseTexture(texture);
   dirty = true;
 }
 
 TextureGLPtr
 TextureGL::Create(CreationContextPtr& aContext) {
-  return std::make_shared<ConcreteClass<TextureGL, TextureGL::State> >(aContext);
+  return std::allocate_shared<ConcreteClass<TextureGL, TextureGL::State> >(PoolAllocator<TextureGL>(), aContext);
 }
 
 void
@@ -175,21 +606,75 @@ TextureGL::SetImageData(std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImag
   }
 
   MipMap mipMap;
+  if (!GetLevelDataSize(aFormat, aWidth, aHeight, aImageLength, mipMap.dataSize)) {
+    return;
+  }
   mipMap.width = aWidth;
   mipMap.height = aHeight;
-  mipMap.dataSize = (GLsizei) aImageLength;
   mipMap.data = std::move(aImage);
   mipMap.internalFormat = aFormat;
   mipMap.format = aFormat;
   m.mipMaps.clear();
   m.mipMaps.push_back(std::move(mipMap));
   m.dirty = true;
+  m.imageReleased = false;
+  m.UpdateMemory();
+}
+
+void
+TextureGL::SetImageLevels(std::vector<ImageLevel>& aLevels) {
+  std::vector<MipMap> mipMaps;
+  for (ImageLevel& level: aLevels) {
+    if ((level.target != GL_TEXTURE_2D) || !level.data || (level.width <= 0) || (level.height <= 0)) {
+      continue;
+    }
+    MipMap mipMap;
+    if (!GetLevelDataSize(level.format, level.width, level.height, level.length, mipMap.dataSize)) {
+      continue;
+    }
+    mipMap.level = level.level;
+    mipMap.width = level.width;
+    mipMap.height = level.height;
+    mipMap.data = std::move(level.data);
+    mipMap.internalFormat = level.format;
+    mipMap.format = level.format;
+    mipMaps.push_back(std::move(mipMap));
+  }
+  if (mipMaps.empty()) {
+    return;
+  }
+  // GetWidth and GetHeight report the base level.
+  std::sort(mipMaps.begin(), mipMaps.end(), [](const MipMap& aLeft, const MipMap& aRight) {
+    return aLeft.level < aRight.level;
+  });
+  if (mipMaps.size() > 1) {
+    GLint& minFilter = m.intMap[GL_TEXTURE_MIN_FILTER];
+    if (minFilter == GL_NEAREST) {
+      minFilter = GL_NEAREST_MIPMAP_LINEAR;
+    } else if (minFilter == GL_LINEAR) {
+      minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    }
+    // Keeps the texture complete when the file has a partial mip chain.
+    m.intMap[GL_TEXTURE_MAX_LEVEL] = mipMaps.back().level;
+  }
+  for (MipMap& mipMap: m.mipMaps) {
+    if (m.dataCache && (mipMap.dataCacheHandle > 0)) {
+      m.dataCache->RemoveData(mipMap.dataCacheHandle);
+    }
+  }
+  m.mipMaps = std::move(mipMaps);
+  m.dirty = true;
+  m.imageReleased = false;
+  m.UpdateMemory();
 }
 
 TextureGL::TextureGL(State& aState, CreationContextPtr& aContext) : Texture(aState, aContext), ResourceGL (aState, aContext), m(aState) {
   m.dataCache = aContext->GetDataCache();
+  m.glDeletions = aContext->GetGLDeletionQueue();
 }
 TextureGL::~TextureGL() {
+  m.CancelStagedUpload();
+  m.ReleaseTexture(m.texture);
   if (!m.dataCache) {
     return;
   }
@@ -217,9 +702,124 @@ TextureGL::GetHeight() const {
   return 0;
 }
 
+void
+TextureGL::SetStreamingBudget(const size_t aBytes) {
+  m.streamingBudget = aBytes;
+}
+
+void
+TextureGL::SetStreamingLevelLimit(const int aLevel) {
+  m.levelLimit = aLevel;
+}
+
+int
+TextureGL::GetResidentLevel() const {
+  if (!m.IsStreaming()) {
+    return m.mipMaps.empty() || !m.texture ? -1 : m.mipMaps.front().level;
+  }
+  if (m.residentIndex >= m.mipMaps.size()) {
+    return -1;
+  }
+  return m.mipMaps[m.residentIndex].level;
+}
+
+size_t
+TextureGL::GetGPUSize() const {
+  return m.GetGPUSize();
+}
+
+void
+TextureGL::SetDeferredLoad(const std::function<void()>& aLoad) {
+  m.deferredLoad = aLoad;
+}
+
+bool
+TextureGL::IsLoadDeferred() const {
+  return (bool)m.deferredLoad;
+}
+
+uint64_t
+TextureGL::GetLastBound() const {
+  return m.lastBound;
+}
+
+void
+TextureGL::Evict() {
+  // The image data stays in memory or in the DataCache so the next
+  // AboutToBind recreates the texture.
+  m.DestroyTexture();
+  m.UpdateMemory();
+}
+
+void
+TextureGL::SetReload(const std::function<void()>& aReload) {
+  m.reload = aReload;
+}
+
+size_t
+TextureGL::ReleaseImageData() {
+  // Streamed levels are moved to the DataCache as they are uploaded.
+  if (m.IsStaging() || m.IsStreaming() || (m.dirty && m.texture)) {
+    return 0;
+  }
+  const size_t kBefore = m.cpuMemory.Get();
+  if (kBefore == 0) {
+    return 0;
+  }
+  if (m.dataCache && m.dataCache->HasCachePath()) {
+    m.ReleaseMipMapData();
+  } else if (m.reload) {
+    // The levels are kept, without data, so the GPU size stays known.
+    for (MipMap& mipMap: m.mipMaps) {
+      mipMap.data = nullptr;
+      mipMap.view = nullptr;
+    }
+    m.imageReleased = true;
+  }
+  m.UpdateMemory();
+  return kBefore - m.cpuMemory.Get();
+}
+
+/* static */ uint64_t
+TextureGL::GetBindSequence() {
+  return sBindSequence;
+}
+
 void
 TextureGL::AboutToBind() {
-  m.CreateTexture();
+  sBindSequence++;
+  m.lastBound = sBindSequence;
+  if (m.deferredLoad) {
+    // Cleared first as the load may complete, and set image data, before
+    // it returns.
+    std::function<void()> load = std::move(m.deferredLoad);
+    m.deferredLoad = nullptr;
+    load();
+  }
+  if (m.imageReleased && m.dirty && m.reload) {
+    // Evicted since the image was dropped. Nothing is created until the
+    // image is set again, the placeholder is bound meanwhile.
+    m.imageReleased = false;
+    m.dirty = false;
+    m.mipMaps.clear();
+    m.reload();
+  }
+  if (m.IsStreaming()) {
+    m.StreamLevels();
+    return;
+  }
+  // Large images are copied and uploaded over several calls so the render
+  // thread does not stall. The previous texture, or none, is used meanwhile.
+  if (!m.dirty && !m.IsStaging()) {
+    return;
+  }
+  if (m.dirty) {
+    m.StartStagedUpload();
+  }
+  if (m.IsStaging()) {
+    m.ContinueStagedUpload();
+  }
+  m.UpdateMemory();
 }
 
 bool
@@ -229,12 +829,17 @@ TextureGL::SupportOffRenderThreadInitialization() {
 
 void
 TextureGL::InitializeGL() {
-  m.CreateTexture();
+  // Streamed levels are uploaded by AboutToBind on the render thread.
+  if (!m.IsStreaming()) {
+    m.CreateTexture();
+  }
+  m.UpdateMemory();
 }
 
 void
 TextureGL::ShutdownGL() {
   m.DestroyTexture();
+  m.UpdateMemory();
 }
 
 } // namespace vrb
@@ -0,0 +1,408 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/TextureImageReader.h"
+#include "vrb/private/ResourceGLState.h"
+#include "vrb/private/TextureState.h"
+#include "vrb/private/UpdatableState.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/EGLError.h"
+#include "vrb/GLError.h"
+#include "vrb/GLExtensions.h"
+#include "vrb/Logger.h"
+#include "vrb/RenderContext.h"
+
+#include "vrb/gl.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#if __ANDROID_API__ >= 26
+#include <android/hardware_buffer.h>
+#include <android/native_window_jni.h>
+#include <media/NdkImage.h>
+#include <media/NdkImageReader.h>
+#endif // __ANDROID_API__ >= 26
+
+namespace {
+
+const int32_t kDefaultWidth = 1920;
+const int32_t kDefaultHeight = 1080;
+// AIMAGE_FORMAT_PRIVATE, the format of video decoders and camera previews.
+const int32_t kDefaultFormat = 0x22;
+const int32_t kDefaultMaxImages = 3;
+
+bool
+HasEGLExtension(EGLDisplay aDisplay, const char* aName) {
+  const char* extensions = eglQueryString(aDisplay, EGL_EXTENSIONS);
+  return extensions && strstr(extensions, aName);
+}
+
+} // namespace
+
+namespace vrb {
+
+struct TextureImageReader::State : public Texture::State, public Updatable::State, public ResourceGL::State {
+#if __ANDROID_API__ >= 26
+  // A buffer of the reader with the EGLImage and texture wrapping it. The
+  // buffer is referenced so its address identifies it while pooled.
+  struct PoolEntry {
+    AHardwareBuffer* buffer;
+    EGLImageKHR image;
+    GLuint texture;
+    uint64_t lastUsed;
+  };
+#endif // __ANDROID_API__ >= 26
+  GLExtensionsPtr glExtensions;
+  int32_t width;
+  int32_t height;
+  int32_t format;
+  int32_t maxImages;
+  bool supported;
+  bool nativeFences;
+  EGLDisplay display;
+  PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC getNativeClientBuffer;
+  PFNEGLCREATEIMAGEKHRPROC createImage;
+  PFNEGLDESTROYIMAGEKHRPROC destroyImage;
+  PFNEGLCREATESYNCKHRPROC createSync;
+  PFNEGLDESTROYSYNCKHRPROC destroySync;
+  PFNEGLWAITSYNCKHRPROC waitSync;
+  PFNEGLDUPNATIVEFENCEFDANDROIDPROC dupNativeFenceFD;
+  // Set on the thread of the reader, cleared on the render thread.
+  std::atomic<bool> frameAvailable;
+  int64_t timestamp;
+  uint64_t frame;
+#if __ANDROID_API__ >= 26
+  AImageReader* reader;
+  AImageReader_ImageListener listener;
+  ANativeWindow* window;
+  // Image shown, released once a newer one is shown.
+  AImage* current;
+  std::vector<PoolEntry> pool;
+#endif // __ANDROID_API__ >= 26
+
+  State()
+      : width(kDefaultWidth)
+      , height(kDefaultHeight)
+      , format(kDefaultFormat)
+      , maxImages(kDefaultMaxImages)
+      , supported(false)
+      , nativeFences(false)
+      , display(EGL_NO_DISPLAY)
+      , getNativeClientBuffer(nullptr)
+      , createImage(nullptr)
+      , destroyImage(nullptr)
+      , createSync(nullptr)
+      , destroySync(nullptr)
+      , waitSync(nullptr)
+      , dupNativeFenceFD(nullptr)
+      , frameAvailable(false)
+      , timestamp(0)
+      , frame(0)
+#if __ANDROID_API__ >= 26
+      , reader(nullptr)
+      , listener()
+      , window(nullptr)
+      , current(nullptr)
+#endif // __ANDROID_API__ >= 26
+  {}
+
+  bool LoadFunctions() {
+    display = eglGetCurrentDisplay();
+    if ((display == EGL_NO_DISPLAY) || !glExtensions ||
+        !glExtensions->IsExtensionSupported(GLExtensions::Ext::OES_EGL_image_external) ||
+        !HasEGLExtension(display, "EGL_ANDROID_get_native_client_buffer") ||
+        !HasEGLExtension(display, "EGL_ANDROID_image_native_buffer")) {
+      return false;
+    }
+    getNativeClientBuffer = (PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC)eglGetProcAddress("eglGetNativeClientBufferANDROID");
+    createImage = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+    destroyImage = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+    if (!getNativeClientBuffer || !createImage || !destroyImage) {
+      return false;
+    }
+    if (HasEGLExtension(display, "EGL_ANDROID_native_fence_sync") && HasEGLExtension(display, "EGL_KHR_wait_sync")) {
+      createSync = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+      destroySync = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+      waitSync = (PFNEGLWAITSYNCKHRPROC)eglGetProcAddress("eglWaitSyncKHR");
+      dupNativeFenceFD = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)eglGetProcAddress("eglDupNativeFenceFDANDROID");
+    }
+    nativeFences = createSync && destroySync && waitSync && dupNativeFenceFD;
+    return true;
+  }
+
+  // Makes the GPU wait for aFenceFd, which is closed. Returns false if the
+  // wait could not be queued.
+  bool WaitFence(const int aFenceFd) {
+    if (aFenceFd < 0) {
+      return true;
+    }
+    const EGLint kAttributes[] = {EGL_SYNC_NATIVE_FENCE_FD_ANDROID, aFenceFd, EGL_NONE};
+    EGLSyncKHR sync = createSync(display, EGL_SYNC_NATIVE_FENCE_ANDROID, kAttributes);
+    if (sync == EGL_NO_SYNC_KHR) {
+      VRB_ERROR("TextureImageReader failed to import the acquire fence: %s", EGLErrorCheck());
+      close(aFenceFd);
+      return false;
+    }
+    // The sync owns the descriptor from here.
+    const bool kResult = waitSync(display, sync, 0) == EGL_TRUE;
+    destroySync(display, sync);
+    return kResult;
+  }
+
+  // Signaled once the GPU is done with the commands issued so far, -1 when
+  // native fences are not available.
+  int CreateReleaseFence() {
+    if (!nativeFences) {
+      return -1;
+    }
+    EGLSyncKHR sync = createSync(display, EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+    if (sync == EGL_NO_SYNC_KHR) {
+      return -1;
+    }
+    // The fence only gets a descriptor once flushed.
+    VRB_GL_CHECK(glFlush());
+    const int kResult = dupNativeFenceFD(display, sync);
+    destroySync(display, sync);
+    return kResult == EGL_NO_NATIVE_FENCE_FD_ANDROID ? -1 : kResult;
+  }
+
+#if __ANDROID_API__ >= 26
+  static void ImageAvailable(void* aContext, AImageReader* aReader) {
+    ((State*)aContext)->frameAvailable = true;
+  }
+
+  void CreateReader() {
+    const uint64_t kUsage = AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE;
+    if (AImageReader_newWithUsage(width, height, format, kUsage, maxImages, &reader) != AMEDIA_OK) {
+      VRB_ERROR("TextureImageReader[%s] failed to create an AImageReader", name.c_str());
+      reader = nullptr;
+      return;
+    }
+    listener.context = this;
+    listener.onImageAvailable = &State::ImageAvailable;
+    AImageReader_setImageListener(reader, &listener);
+    if (AImageReader_getWindow(reader, &window) != AMEDIA_OK) {
+      window = nullptr;
+    }
+  }
+
+  PoolEntry* GetEntry(AHardwareBuffer* aBuffer) {
+    for (PoolEntry& entry: pool) {
+      if (entry.buffer == aBuffer) {
+        return &entry;
+      }
+    }
+    // Buffers no longer used by the reader, after a resize for example, are
+    // replaced least recently shown first. The one shown is the most recent.
+    if (pool.size() >= (size_t)(maxImages + 1)) {
+      auto oldest = std::min_element(pool.begin(), pool.end(), [](const PoolEntry& aLeft, const PoolEntry& aRight) {
+        return aLeft.lastUsed < aRight.lastUsed;
+      });
+      Release(*oldest);
+      pool.erase(oldest);
+    }
+    EGLClientBuffer clientBuffer = getNativeClientBuffer(aBuffer);
+    const EGLint kAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+    EGLImageKHR image = clientBuffer ? createImage(display, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID, clientBuffer, kAttributes) : EGL_NO_IMAGE_KHR;
+    if (image == EGL_NO_IMAGE_KHR) {
+      VRB_ERROR("TextureImageReader[%s] failed to create an EGLImage: %s", name.c_str(), EGLErrorCheck());
+      return nullptr;
+    }
+    PoolEntry entry = {aBuffer, image, 0, 0};
+    VRB_GL_CHECK(glGenTextures(1, &entry.texture));
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_EXTERNAL_OES, entry.texture));
+    VRB_GL_CHECK(glExtensions->GetFunctions().glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, (GLeglImageOES)image));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GetTextureParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR)));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GetTextureParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR)));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0));
+    AHardwareBuffer_acquire(aBuffer);
+    pool.push_back(entry);
+    return &pool.back();
+  }
+
+  GLint GetTextureParameter(const GLenum aName, const GLint aDefault) const {
+    auto found = intMap.find(aName);
+    return found != intMap.end() ? found->second : aDefault;
+  }
+
+  void Release(PoolEntry& aEntry) {
+    if (aEntry.texture) {
+      VRB_GL_CHECK(glDeleteTextures(1, &aEntry.texture));
+    }
+    destroyImage(display, aEntry.image);
+    AHardwareBuffer_release(aEntry.buffer);
+  }
+
+  void ReleaseImage(AImage* aImage) {
+    if (aImage) {
+      // Frees the buffer for the producer once the GPU stops sampling it.
+      AImage_deleteAsync(aImage, CreateReleaseFence());
+    }
+  }
+
+  void Update() {
+    if (!reader || !frameAvailable.exchange(false)) {
+      return;
+    }
+    AImage* image = nullptr;
+    int acquireFence = -1;
+    const media_status_t kStatus = nativeFences ?
+        AImageReader_acquireLatestImageAsync(reader, &image, &acquireFence) :
+        AImageReader_acquireLatestImage(reader, &image);
+    if ((kStatus != AMEDIA_OK) || !image) {
+      if (acquireFence >= 0) {
+        close(acquireFence);
+      }
+      return;
+    }
+    AHardwareBuffer* buffer = nullptr;
+    PoolEntry* entry = nullptr;
+    if (AImage_getHardwareBuffer(image, &buffer) == AMEDIA_OK) {
+      entry = GetEntry(buffer);
+    }
+    if (!entry || !WaitFence(acquireFence)) {
+      if (!entry && (acquireFence >= 0)) {
+        close(acquireFence);
+      }
+      AImage_delete(image);
+      return;
+    }
+    frame++;
+    entry->lastUsed = frame;
+    texture = entry->texture;
+    AImage_getTimestamp(image, &timestamp);
+    ReleaseImage(current);
+    current = image;
+  }
+
+  void Destroy() {
+    if (current) {
+      AImage_delete(current);
+      current = nullptr;
+    }
+    for (PoolEntry& entry: pool) {
+      Release(entry);
+    }
+    pool.clear();
+    texture = 0;
+    if (reader) {
+      // Also releases the window.
+      AImageReader_delete(reader);
+      reader = nullptr;
+      window = nullptr;
+    }
+    frameAvailable = false;
+  }
+#else
+  void CreateReader() {}
+  void Update() {}
+  void Destroy() {}
+#endif // __ANDROID_API__ >= 26
+};
+
+TextureImageReaderPtr
+TextureImageReader::Create(RenderContextPtr& aContext, const std::string& aName) {
+  TextureImageReaderPtr result = std::make_shared<ConcreteClass<TextureImageReader, TextureImageReader::State> >(aContext->GetRenderThreadCreationContext());
+  result->SetName(aName);
+  result->m.glExtensions = aContext->GetGLExtensions();
+  return result;
+}
+
+void
+TextureImageReader::SetImageFormat(const int32_t aWidth, const int32_t aHeight, const int32_t aFormat, const int32_t aMaxImages) {
+  m.width = aWidth;
+  m.height = aHeight;
+  m.format = aFormat;
+  m.maxImages = std::max(aMaxImages, 2);
+}
+
+bool
+TextureImageReader::IsSupported() const {
+  return m.supported;
+}
+
+ANativeWindow*
+TextureImageReader::GetWindow() const {
+#if __ANDROID_API__ >= 26
+  return m.window;
+#else
+  return nullptr;
+#endif // __ANDROID_API__ >= 26
+}
+
+jobject
+TextureImageReader::GetSurface(JNIEnv* aEnv) const {
+#if __ANDROID_API__ >= 26
+  if (m.window && aEnv) {
+    return ANativeWindow_toSurface(aEnv, m.window);
+  }
+#endif // __ANDROID_API__ >= 26
+  return nullptr;
+}
+
+int64_t
+TextureImageReader::GetTimestamp() const {
+  return m.timestamp;
+}
+
+size_t
+TextureImageReader::GetPoolSize() const {
+#if __ANDROID_API__ >= 26
+  return m.pool.size();
+#else
+  return 0;
+#endif // __ANDROID_API__ >= 26
+}
+
+TextureImageReader::TextureImageReader(State& aState, CreationContextPtr& aContext)
+    : Texture(aState, aContext)
+    , Updatable(aState, aContext)
+    , ResourceGL(aState, aContext)
+    , m(aState) {
+  m.target = GL_TEXTURE_EXTERNAL_OES;
+}
+
+TextureImageReader::~TextureImageReader() {
+  m.Destroy();
+}
+
+void
+TextureImageReader::AboutToBind() {
+}
+
+void
+TextureImageReader::UpdateResource(RenderContext& aContext) {
+  m.Update();
+}
+
+void
+TextureImageReader::InitializeGL() {
+  m.Destroy();
+#if __ANDROID_API__ >= 26
+  m.supported = m.LoadFunctions();
+#else
+  m.supported = false;
+#endif // __ANDROID_API__ >= 26
+  if (!m.supported) {
+    VRB_LOG("TextureImageReader[%s] not supported, use a TextureSurface", m.name.c_str());
+    return;
+  }
+  m.CreateReader();
+}
+
+void
+TextureImageReader::ShutdownGL() {
+  m.Destroy();
+}
+
+} // namespace vrb
@@ -0,0 +1,354 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/ThermalGovernor.h"
+#include "vrb/private/UpdatableState.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/LoaderThread.h"
+#include "vrb/Logger.h"
+#include "vrb/RenderContext.h"
+#include "vrb/ResolutionScaler.h"
+#include "vrb/ShaderQualityScaler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <forward_list>
+
+#if defined(ANDROID)
+#include <dlfcn.h>
+#endif // defined(ANDROID)
+
+namespace {
+
+// The headroom may not be read more than about once a second, it returns
+// NaN when read too often.
+const double kPollInterval = 2.0;
+// Pressure must stay below the level for this long before it is lowered,
+// and each lower step waits as long again.
+const double kLowerDelay = 15.0;
+// Headroom thresholds of levels 1 to kMaxLevel, 1.0 is where the device
+// starts severe throttling.
+const float kHeadroomThresholds[vrb::ThermalGovernor::kMaxLevel] = {0.75f, 0.85f, 0.95f};
+// Headroom must drop this far below a threshold to count as lower pressure.
+const float kHysteresis = 0.05f;
+// AThermalStatus values.
+const int32_t kStatusLight = 1;
+const int32_t kStatusModerate = 2;
+const int32_t kStatusSevere = 3;
+
+int32_t
+StatusLevel(const int32_t aStatus) {
+  if (aStatus >= kStatusSevere) {
+    return 3;
+  } else if (aStatus >= kStatusModerate) {
+    return 2;
+  } else if (aStatus >= kStatusLight) {
+    return 1;
+  }
+  return 0;
+}
+
+#if defined(ANDROID)
+// AThermal is only in libandroid from API 30, headroom from API 31, so it is
+// looked up at run time to keep older devices working.
+struct AThermalManager;
+typedef AThermalManager* (*AcquireManagerFunction)();
+typedef void (*ReleaseManagerFunction)(AThermalManager*);
+typedef int (*GetStatusFunction)(AThermalManager*);
+typedef float (*GetHeadroomFunction)(AThermalManager*, int);
+
+class ThermalAPI {
+public:
+  bool Initialize() {
+    library = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+      return false;
+    }
+    AcquireManagerFunction acquire = (AcquireManagerFunction)dlsym(library, "AThermal_acquireManager");
+    release = (ReleaseManagerFunction)dlsym(library, "AThermal_releaseManager");
+    getStatus = (GetStatusFunction)dlsym(library, "AThermal_getCurrentThermalStatus");
+    getHeadroom = (GetHeadroomFunction)dlsym(library, "AThermal_getThermalHeadroom");
+    manager = (acquire && release) ? acquire() : nullptr;
+    if (!manager) {
+      Shutdown();
+      return false;
+    }
+    return true;
+  }
+
+  void Shutdown() {
+    if (manager) {
+      release(manager);
+      manager = nullptr;
+    }
+    if (library) {
+      dlclose(library);
+      library = nullptr;
+    }
+  }
+
+  // Unknown values are negative.
+  void Read(const int32_t aForecast, float& aHeadroom, int32_t& aStatus) const {
+    aHeadroom = -1.0f;
+    aStatus = -1;
+    if (!manager) {
+      return;
+    }
+    if (getHeadroom) {
+      const float kHeadroom = getHeadroom(manager, aForecast);
+      if (std::isfinite(kHeadroom)) {
+        aHeadroom = kHeadroom;
+      }
+    }
+    if (getStatus) {
+      aStatus = getStatus(manager);
+    }
+  }
+
+  ThermalAPI()
+      : library(nullptr)
+      , manager(nullptr)
+      , release(nullptr)
+      , getStatus(nullptr)
+      , getHeadroom(nullptr)
+  {}
+  ~ThermalAPI() { Shutdown(); }
+private:
+  void* library;
+  AThermalManager* manager;
+  ReleaseManagerFunction release;
+  GetStatusFunction getStatus;
+  GetHeadroomFunction getHeadroom;
+  VRB_NO_DEFAULTS(ThermalAPI)
+};
+#endif // defined(ANDROID)
+
+} // namespace
+
+namespace vrb {
+
+struct ThermalGovernor::State : public Updatable::State {
+  std::weak_ptr<ResolutionScaler> resolutionScaler;
+  std::weak_ptr<ShaderQualityScaler> shaderScaler;
+  std::weak_ptr<LoaderThread> loader;
+  std::forward_list<ThermalGovernorObserverPtr> observers;
+  Throttle throttles[kMaxLevel + 1];
+  int32_t forecast;
+  int32_t level;
+  float headroom;
+  bool reported;
+  float reportedHeadroom;
+  int32_t reportedStatus;
+  double lastChange;
+  // When the pressure first dropped below the current level, negative while
+  // it has not.
+  double coolSince;
+#if defined(ANDROID)
+  ThermalAPI thermal;
+  bool thermalAvailable;
+#endif // defined(ANDROID)
+
+  State()
+      : throttles{{0, 0, 0}, {1, -1, 0}, {2, 1, 2}, {3, 1, 1}}
+      , forecast(10)
+      , level(0)
+      , headroom(-1.0f)
+      , reported(false)
+      , reportedHeadroom(-1.0f)
+      , reportedStatus(-1)
+      , lastChange(-1.0)
+      , coolSince(-1.0)
+#if defined(ANDROID)
+      , thermalAvailable(false)
+#endif // defined(ANDROID)
+  {}
+
+  bool HasReadings() const {
+#if defined(ANDROID)
+    return reported || thermalAvailable;
+#else
+    return reported;
+#endif // defined(ANDROID)
+  }
+
+  void Read(int32_t& aStatus) {
+    if (reported) {
+      headroom = reportedHeadroom;
+      aStatus = reportedStatus;
+      return;
+    }
+    headroom = -1.0f;
+    aStatus = -1;
+#if defined(ANDROID)
+    if (thermalAvailable) {
+      thermal.Read(forecast, headroom, aStatus);
+    }
+#endif // defined(ANDROID)
+  }
+
+  // Level of the current readings, with the headroom thresholds lowered by aMargin.
+  int32_t PressureLevel(const int32_t aStatus, const float aMargin) const {
+    int32_t result = StatusLevel(aStatus);
+    if (headroom >= 0.0f) {
+      for (int32_t ix = kMaxLevel; ix > result; ix--) {
+        if (headroom >= (kHeadroomThresholds[ix - 1] - aMargin)) {
+          result = ix;
+          break;
+        }
+      }
+    }
+    return result;
+  }
+
+  void Apply() {
+    const Throttle& throttle = throttles[level];
+    ResolutionScalerPtr resolution = resolutionScaler.lock();
+    if (resolution && (throttle.resolutionStep >= 0)) {
+      resolution->SetStepFloor(throttle.resolutionStep);
+    }
+    ShaderQualityScalerPtr shader = shaderScaler.lock();
+    if (shader && (throttle.shaderTier >= 0)) {
+      shader->SetMinTier(throttle.shaderTier);
+    }
+    LoaderThreadPtr loaderThread = loader.lock();
+    if (loaderThread && (throttle.loaderWorkers >= 0)) {
+      loaderThread->SetActiveWorkerLimit(throttle.loaderWorkers);
+    }
+  }
+
+  void SetLevel(const int32_t aLevel, const double aTimestamp) {
+    level = aLevel;
+    lastChange = aTimestamp;
+    coolSince = -1.0;
+    VRB_LOG("ThermalGovernor level set to %d, headroom %.2f", level, headroom);
+    Apply();
+    for (ThermalGovernorObserverPtr& observer: observers) {
+      observer->ThermalLevelChanged(level, headroom);
+    }
+  }
+};
+
+ThermalGovernorPtr
+ThermalGovernor::Create(RenderContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<ThermalGovernor, ThermalGovernor::State> >(aContext);
+}
+
+void
+ThermalGovernor::SetResolutionScaler(const ResolutionScalerPtr& aScaler) {
+  m.resolutionScaler = aScaler;
+  if (aScaler && (m.throttles[m.level].resolutionStep >= 0)) {
+    aScaler->SetStepFloor(m.throttles[m.level].resolutionStep);
+  }
+}
+
+void
+ThermalGovernor::SetShaderQualityScaler(const ShaderQualityScalerPtr& aScaler) {
+  m.shaderScaler = aScaler;
+  if (aScaler && (m.throttles[m.level].shaderTier >= 0)) {
+    aScaler->SetMinTier(m.throttles[m.level].shaderTier);
+  }
+}
+
+void
+ThermalGovernor::SetLoaderThread(const LoaderThreadPtr& aLoader) {
+  m.loader = aLoader;
+  if (aLoader && (m.throttles[m.level].loaderWorkers >= 0)) {
+    aLoader->SetActiveWorkerLimit(m.throttles[m.level].loaderWorkers);
+  }
+}
+
+void
+ThermalGovernor::SetThrottle(const int32_t aLevel, const Throttle& aThrottle) {
+  if ((aLevel < 1) || (aLevel > kMaxLevel)) {
+    VRB_ERROR("ThermalGovernor::SetThrottle invalid level: %d", aLevel);
+    return;
+  }
+  m.throttles[aLevel] = aThrottle;
+  if (aLevel == m.level) {
+    m.Apply();
+  }
+}
+
+void
+ThermalGovernor::SetForecast(const int32_t aSeconds) {
+  m.forecast = std::max(aSeconds, 0);
+}
+
+void
+ThermalGovernor::ReportThermalState(const float aHeadroom, const int32_t aStatus) {
+  m.reported = true;
+  m.reportedHeadroom = aHeadroom;
+  m.reportedStatus = aStatus;
+  Wake();
+}
+
+int32_t
+ThermalGovernor::GetLevel() const {
+  return m.level;
+}
+
+float
+ThermalGovernor::GetHeadroom() const {
+  return m.headroom;
+}
+
+void
+ThermalGovernor::AddThermalGovernorObserver(ThermalGovernorObserverPtr aObserver) {
+  m.observers.push_front(std::move(aObserver));
+}
+
+void
+ThermalGovernor::RemoveThermalGovernorObserver(const ThermalGovernorObserver& aObserver) {
+  m.observers.remove_if([&](ThermalGovernorObserverPtr& aObserverPtr) -> bool {
+    return &aObserver == aObserverPtr.get();
+  });
+}
+
+void
+ThermalGovernor::UpdateResource(RenderContext& aContext) {
+  const double kNow = aContext.GetTimestamp();
+  int32_t status = -1;
+  m.Read(status);
+  const int32_t kPressure = m.PressureLevel(status, 0.0f);
+  if (kPressure > m.level) {
+    // Raised right away, the point is to act before the clocks drop.
+    m.SetLevel(kPressure, kNow);
+  } else if (m.PressureLevel(status, kHysteresis) < m.level) {
+    if (m.coolSince < 0.0) {
+      m.coolSince = kNow;
+    } else if (((kNow - m.coolSince) >= kLowerDelay) && ((kNow - m.lastChange) >= kLowerDelay)) {
+      m.SetLevel(m.level - 1, kNow);
+    }
+  } else {
+    m.coolSince = -1.0;
+  }
+  if (m.HasReadings()) {
+    SleepUntil(aContext, kNow + kPollInterval);
+  } else {
+    // Nothing to read until a state is reported, which wakes the governor.
+    Sleep(aContext);
+  }
+}
+
+ThermalGovernor::ThermalGovernor(State& aState, RenderContextPtr& aContext)
+    : Updatable(aState, aContext->GetRenderThreadCreationContext())
+    , m(aState) {
+#if defined(ANDROID)
+  m.thermalAvailable = m.thermal.Initialize();
+  if (!m.thermalAvailable) {
+    VRB_LOG("ThermalGovernor: AThermal is not available, waiting for reported states");
+  }
+#endif // defined(ANDROID)
+}
+
+ThermalGovernor::~ThermalGovernor() {
+  if (m.level > 0) {
+    m.level = 0;
+    m.Apply();
+  }
+}
+
+} // namespace vrb
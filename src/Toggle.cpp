@@ -4,19 +4,11 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "vrb/Toggle.h"
-#include "vrb/private/GroupState.h"
+#include "vrb/private/ToggleState.h"
 #include "vrb/ConcreteClass.h"
 
-#include <unordered_set>
-
 namespace vrb {
 
-struct Toggle::State : public Group::State {
-  std::unordered_set<const Node*> toggledOff;
-  bool IsEnabled(const Node& aNode) override { return toggledOff.count(&aNode) == 0; }
-  void Clear() override { toggledOff.clear(); Group::State::Clear(); }
-};
-
 TogglePtr
 Toggle::Create(CreationContextPtr& aContext) {
   TogglePtr toggle = std::make_shared<ConcreteClass<Toggle, Toggle::State> >(aContext);
@@ -24,22 +16,21 @@ Toggle::Create(CreationContextPtr& aContext) {
   return toggle;
 }
 
-// Group interface
-void
-Toggle::RemoveNode(Node& aNode) {
-  m.toggledOff.erase(&aNode);
-  Super::RemoveNode(aNode);
-}
-
 // Toggle interface
 void
 Toggle::ToggleAll(const bool aEnabled) {
+  const uint32_t kCount = (uint32_t)m.children.size();
+  bool changed = false;
+  for (uint32_t ix = 0; (ix < kCount) && !changed; ix++) {
+    changed = m.toggledOff.Test(ix) == aEnabled;
+  }
   if (aEnabled) {
-    m.toggledOff.clear();
-    return;
+    m.toggledOff.Clear();
+  } else {
+    m.toggledOff.Fill(kCount);
   }
-  for (const NodePtr& node: m.children) {
-    m.toggledOff.insert(node.get());
+  if (changed) {
+    InvalidateLayout();
   }
 }
 
@@ -50,15 +41,13 @@ Toggle::IsEnabled(const Node& aNode) {
 
 void
 Toggle::ToggleChild(const Node& aNode, const bool aEnabled) {
-  if (!m.Contains(aNode)) {
+  const int32_t kSlot = m.FindChild(aNode);
+  if (kSlot < 0) {
     return;
   }
-  if (aEnabled) {
-    m.toggledOff.erase(&aNode);
-    return;
+  if (m.toggledOff.Set((uint32_t)kSlot, !aEnabled)) {
+    InvalidateLayout();
   }
-
-  m.toggledOff.insert(&aNode);
 }
 
 Toggle::Toggle(State& aState, CreationContextPtr& aContext) : Group(aState, aContext), m(aState) {}
@@ -0,0 +1,240 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/TraceProfiler.h"
+#include "vrb/private/Clock.h"
+
+#include "vrb/Logger.h"
+#include "vrb/Mutex.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+namespace {
+
+// Events per thread and capture. Further events are dropped.
+const uint32_t kEventCapacity = 16384;
+
+struct Event {
+  const char* name;
+  uint64_t start;
+  uint64_t end;
+};
+
+// Single producer buffer owned by one thread. Events are published by the
+// release store of count, the exporter reads them with an acquire load.
+// Only the owner resets the buffer, when it records the first event of a
+// capture, so the reset is ordered before its writes.
+struct EventBuffer {
+  int32_t thread;
+  // Capture the events belong to, see Registry::generation.
+  std::atomic<uint32_t> generation;
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> dropped;
+  std::array<Event, kEventCapacity> events;
+  explicit EventBuffer(const int32_t aThread) : thread(aThread), generation(0), count(0), dropped(0) {}
+};
+
+struct Registry {
+  vrb::Mutex lock;
+  std::vector<std::unique_ptr<EventBuffer>> buffers;
+  // Buffers of threads that have exited, reused by new threads once their
+  // events are no longer part of the capture.
+  std::vector<EventBuffer*> released;
+  int32_t threadCount;
+  // Incremented by every capture.
+  std::atomic<uint32_t> generation;
+  std::atomic<bool> capturing;
+  std::atomic<int> remainingFrames;
+  Registry() : threadCount(0), generation(0), capturing(false), remainingFrames(0) {}
+};
+
+Registry&
+GetRegistry() {
+  // Never destroyed so threads may record during static destruction.
+  static Registry* sRegistry = new Registry;
+  return *sRegistry;
+}
+
+// Returns the buffer to the registry when the thread exits, loader threads
+// come and go with every load.
+struct ThreadBuffer {
+  EventBuffer* buffer;
+  ThreadBuffer() : buffer(nullptr) {}
+  ~ThreadBuffer() {
+    if (buffer) {
+      Registry& registry = GetRegistry();
+      vrb::MutexAutoLock lock(registry.lock);
+      registry.released.push_back(buffer);
+    }
+  }
+};
+
+thread_local ThreadBuffer sThreadBuffer;
+
+EventBuffer&
+GetThreadBuffer() {
+  if (!sThreadBuffer.buffer) {
+    Registry& registry = GetRegistry();
+    vrb::MutexAutoLock lock(registry.lock);
+    const uint32_t kGeneration = registry.generation.load(std::memory_order_relaxed);
+    for (auto it = registry.released.begin(); it != registry.released.end(); it++) {
+      if ((*it)->generation.load(std::memory_order_relaxed) != kGeneration) {
+        sThreadBuffer.buffer = *it;
+        sThreadBuffer.buffer->thread = registry.threadCount++;
+        registry.released.erase(it);
+        break;
+      }
+    }
+    if (!sThreadBuffer.buffer) {
+      registry.buffers.emplace_back(new EventBuffer(registry.threadCount++));
+      sThreadBuffer.buffer = registry.buffers.back().get();
+    }
+  }
+  return *sThreadBuffer.buffer;
+}
+
+void
+AppendEscaped(std::string& aResult, const char* aValue) {
+  for (const char* ch = aValue; *ch; ch++) {
+    if ((*ch == '"') || (*ch == '\\')) {
+      aResult += '\\';
+    }
+    aResult += ((unsigned char)*ch < 0x20) ? ' ' : *ch;
+  }
+}
+
+} // namespace
+
+namespace vrb {
+
+void
+TraceStartCapture(const int aFrames) {
+  Registry& registry = GetRegistry();
+  registry.capturing = false;
+  // Buffers from earlier captures are reset by their threads.
+  registry.generation.fetch_add(1);
+  registry.remainingFrames = aFrames > 0 ? aFrames : 1;
+  registry.capturing = true;
+}
+
+void
+TraceStopCapture() {
+  GetRegistry().capturing = false;
+}
+
+bool
+TraceIsCapturing() {
+  return GetRegistry().capturing.load(std::memory_order_relaxed);
+}
+
+void
+TraceFrameMark() {
+  Registry& registry = GetRegistry();
+  if (!registry.capturing.load(std::memory_order_relaxed)) {
+    return;
+  }
+  if (registry.remainingFrames.fetch_sub(1) <= 1) {
+    registry.capturing = false;
+    VRB_LOG("Trace capture finished");
+  }
+}
+
+void
+TraceAddEvent(const char* aName, const uint64_t aStart, const uint64_t aEnd) {
+  if (!TraceIsCapturing()) {
+    return;
+  }
+  EventBuffer& buffer = GetThreadBuffer();
+  const uint32_t kGeneration = GetRegistry().generation.load(std::memory_order_relaxed);
+  if (buffer.generation.load(std::memory_order_relaxed) != kGeneration) {
+    buffer.count.store(0, std::memory_order_relaxed);
+    buffer.dropped.store(0, std::memory_order_relaxed);
+    buffer.generation.store(kGeneration, std::memory_order_release);
+  }
+  const uint32_t kIndex = buffer.count.load(std::memory_order_relaxed);
+  if (kIndex >= kEventCapacity) {
+    buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Event& event = buffer.events[kIndex];
+  event.name = aName ? aName : "Unknown";
+  event.start = aStart;
+  event.end = aEnd;
+  buffer.count.store(kIndex + 1, std::memory_order_release);
+}
+
+uint64_t
+TraceGetTime() {
+  return GetMonotonicNanoseconds();
+}
+
+std::string
+TraceGetJSON() {
+  if (TraceIsCapturing()) {
+    VRB_WARN("Trace exported while still capturing");
+  }
+  Registry& registry = GetRegistry();
+  MutexAutoLock lock(registry.lock);
+  std::string result("{\"traceEvents\":[");
+  bool first = true;
+  char values[128];
+  const uint32_t kGeneration = registry.generation.load(std::memory_order_relaxed);
+  for (std::unique_ptr<EventBuffer>& buffer: registry.buffers) {
+    if (buffer->generation.load(std::memory_order_acquire) != kGeneration) {
+      // Nothing recorded by this thread during the capture.
+      continue;
+    }
+    const uint32_t kCount = buffer->count.load(std::memory_order_acquire);
+    for (uint32_t ix = 0; ix < kCount; ix++) {
+      const Event& event = buffer->events[ix];
+      result += first ? "\n" : ",\n";
+      first = false;
+      result += "{\"name\":\"";
+      AppendEscaped(result, event.name);
+      // Complete events with microsecond timestamps.
+      snprintf(values, sizeof(values), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+               buffer->thread, (double)event.start / 1000.0, (double)(event.end - event.start) / 1000.0);
+      result += values;
+    }
+    const uint32_t kDropped = buffer->dropped.load(std::memory_order_relaxed);
+    if (kDropped > 0) {
+      VRB_WARN("Trace dropped %u events on thread %d", kDropped, buffer->thread);
+    }
+  }
+  result += "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return result;
+}
+
+bool
+TraceWriteJSON(const std::string& aFileName) {
+  const std::string json = TraceGetJSON();
+  FILE* file = fopen(aFileName.c_str(), "wb");
+  if (!file) {
+    VRB_ERROR("Failed to open trace file: %s", aFileName.c_str());
+    return false;
+  }
+  const bool result = fwrite(json.data(), 1, json.size(), file) == json.size();
+  fclose(file);
+  if (!result) {
+    VRB_ERROR("Failed to write trace file: %s", aFileName.c_str());
+  }
+  return result;
+}
+
+TraceZone::TraceZone(const char* aName)
+    : mName(aName)
+    , mStart(TraceIsCapturing() ? TraceGetTime() : 0) {}
+
+TraceZone::~TraceZone() {
+  if (mStart) {
+    TraceAddEvent(mName, mStart, TraceGetTime());
+  }
+}
+
+} // namespace vrb
@@ -5,9 +5,12 @@
 
 #include "vrb/Transform.h"
 #include "vrb/private/TransformState.h"
+#include "vrb/private/PoolAllocator.h"
 
+#include "vrb/Bounds.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/CullVisitor.h"
+#include "vrb/RayHit.h"
 
 #include <memory>
 
@@ -15,36 +18,73 @@ namespace vrb {
 
 TransformPtr
 Transform::Create(CreationContextPtr& aContext) {
-  TransformPtr transform = std::make_shared<ConcreteClass<Transform, Transform::State> > (aContext);
+  TransformPtr transform = std::allocate_shared<ConcreteClass<Transform, Transform::State> >(PoolAllocator<Transform>(), aContext);
   transform->m.self = transform;
   return transform;
 }
 
 void
 Transform::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
-  aVisitor.PushTransform(m.transform);
-  Group::Cull(aVisitor, aDrawables);
+  if (!aVisitor.IsVisible(GetBounds())) {
+    return;
+  }
+  if (m.occlusionCulling && aVisitor.IsOccluded(*this, GetBounds())) {
+    return;
+  }
+  if (m.affine) {
+    aVisitor.PushAffineTransform(m.transform);
+  } else {
+    aVisitor.PushTransform(m.transform);
+  }
+  CullChildren(aVisitor, aDrawables);
   aVisitor.PopTransform();
 }
 
-const Matrix
+void
+Transform::Flatten(SceneSnapshot& aSnapshot) {
+  FlattenGroup(aSnapshot, &m.transform);
+}
+
+bool
+Transform::Intersect(const Vector& aOrigin, const Vector& aDirection, RayHit& aHit) {
+  float distance = 0.0f;
+  if (!GetBounds().IntersectsRay(aOrigin, aDirection, distance) || (distance > aHit.distance)) {
+    return false;
+  }
+  // Distances along the ray are unchanged by an affine transform of it.
+  const Matrix kInverse = m.transform.AfineInverse();
+  return IntersectChildren(kInverse.MultiplyPosition(aOrigin), kInverse.MultiplyDirection(aDirection), aHit);
+}
+
+const Matrix&
 Transform::GetWorldTransform() const {
-  Matrix result = m.transform;
-  std::vector<GroupPtr> parents;
-  GetParents(parents);
-  while (parents.size() > 0) {
-    if (parents.size() > 1) {
+  if (!m.worldTransformDirty) {
+    return m.worldTransform;
+  }
+  const Node* node = this;
+  const Transform* ancestor = nullptr;
+  while (node->GetParentCount() > 0) {
+    if (node->GetParentCount() > 1) {
       VRB_WARN("Calculating world transform where node has more than one parent");
     }
-    GroupPtr parent = parents[0];
-    TransformPtr transform = std::dynamic_pointer_cast<Transform>(parent);
+    Group* parent = node->GetParent(0);
+    const Transform* transform = dynamic_cast<const Transform*>(parent);
     if (transform) {
-      result.PreMultiplyInPlace(transform->GetTransform());
+      // The closest Transform ancestor already holds the rest of the chain.
+      ancestor = transform;
+      break;
     }
-    parents.clear();
-    parent->GetParents(parents);
+    node = parent;
   }
-  return result;
+  if (!ancestor) {
+    m.worldTransform = m.transform;
+  } else if (m.affine) {
+    m.worldTransform = ancestor->GetWorldTransform().AffinePostMultiply(m.transform);
+  } else {
+    m.worldTransform = ancestor->GetWorldTransform().PostMultiply(m.transform);
+  }
+  m.worldTransformDirty = false;
+  return m.worldTransform;
 }
 
 const Matrix&
@@ -55,6 +95,30 @@ Transform::GetTransform() const {
 void
 Transform::SetTransform(const Matrix& aTransform) {
   m.transform = aTransform;
+  m.affine = aTransform.IsAffine();
+  InvalidateBounds();
+  InvalidateWorldTransform();
+}
+
+void
+Transform::SetTransform(const Vector& aTranslation, const Quaternion& aRotation, const float aScale) {
+  SetTransform(Matrix::FromTRS(aTranslation, aRotation, aScale));
+}
+
+void
+Transform::ComputeBounds(Bounds& aBounds) const {
+  Bounds local;
+  Group::ComputeBounds(local);
+  aBounds = local.Transform(m.transform);
+}
+
+void
+Transform::InvalidateWorldTransform() {
+  if (m.worldTransformDirty) {
+    return;
+  }
+  m.worldTransformDirty = true;
+  Group::InvalidateWorldTransform();
 }
 
 Transform::Transform(State& aState, CreationContextPtr& aContext) : Group(aState, aContext), m(aState) {}
@@ -0,0 +1,392 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/TransformAnimator.h"
+#include "vrb/private/AnimatedTransformState.h"
+#include "vrb/private/SkeletonState.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/JobSystem.h"
+#include "vrb/KeyframeTrack.h"
+#include "vrb/Matrix.h"
+#include "vrb/TraceProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Below this many playing transforms jobs cost more than they save.
+const size_t kMinParallelCount = 2048;
+const size_t kJobSize = 1024;
+// Palettes are rebuilt in jobs once there are enough skeletons to split.
+const size_t kMinParallelSkeletons = 32;
+const size_t kSkeletonJobSize = 8;
+
+}
+
+namespace vrb {
+
+struct TransformAnimator::State {
+  typedef AnimatedTransform::State::Sampler Sampler;
+  // Each array is indexed by sampler, owner is the index of the playing
+  // transform and value the index of the sampled matrix in values.
+  struct Rotations {
+    std::vector<uint32_t> owner;
+    std::vector<uint32_t> value;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> rate;
+    std::vector<float> angle;
+  };
+  struct Translations {
+    std::vector<uint32_t> owner;
+    std::vector<uint32_t> value;
+    // Normalized direction scaled by the speed.
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+  };
+  TransformAnimatorWeak self;
+  struct Keyframes {
+    std::vector<uint32_t> owner;
+    std::vector<uint32_t> value;
+    // Tracks are kept alive by the samplers of the transforms.
+    std::vector<const KeyframeTrack*> track;
+    std::vector<float> duration;
+    std::vector<uint8_t> loop;
+    std::vector<uint32_t> cursor;
+  };
+  JobSystemPtr jobs;
+  std::vector<AnimatedTransform*> transforms;
+  std::vector<Skeleton*> skeletons;
+  bool dirty = false;
+  double timestamp = -1.0;
+  // Rebuilt when dirty, indexed by playing transform.
+  std::vector<AnimatedTransform*> playing;
+  std::vector<double> startTimes;
+  std::vector<float> previousDeltas;
+  std::vector<float> deltas;
+  std::vector<uint32_t> firstValue;
+  std::vector<uint32_t> valueCount;
+  std::vector<Matrix> results;
+  // Sampler matrices in the order they are multiplied. Static samplers are
+  // written once by Rebuild.
+  std::vector<Matrix> values;
+  Rotations rotations;
+  Translations translations;
+  Keyframes keyframes;
+
+  void Rebuild(const double aTimestamp);
+  void SampleRotations(const size_t aBegin, const size_t aEnd);
+  void SampleTranslations(const size_t aBegin, const size_t aEnd);
+  void SampleKeyframes(const size_t aBegin, const size_t aEnd);
+  void Compose(const size_t aBegin, const size_t aEnd);
+  void Sample(const double aTimestamp);
+  void UpdateSkeletons();
+  // Runs aWork over [0, aCount) in jobs of aJobSize, or directly without aParent.
+  template<typename T>
+  void Split(const size_t aCount, const JobSystem::JobHandle& aParent, T aWork, const size_t aJobSize = kJobSize);
+};
+
+void
+TransformAnimator::State::Rebuild(const double aTimestamp) {
+  VRB_TRACE_ZONE("TransformAnimator::Rebuild");
+  dirty = false;
+  playing.clear();
+  startTimes.clear();
+  previousDeltas.clear();
+  firstValue.clear();
+  valueCount.clear();
+  values.clear();
+  rotations = Rotations();
+  translations = Translations();
+  keyframes = Keyframes();
+  for (AnimatedTransform* transform: transforms) {
+    AnimatedTransform::State& state = transform->m;
+    if (state.state != AnimationState::Play) {
+      continue;
+    }
+    if (state.startTime < 0.0) {
+      state.startTime = aTimestamp;
+    }
+    const uint32_t kOwner = (uint32_t)playing.size();
+    playing.push_back(transform);
+    startTimes.push_back(state.startTime);
+    previousDeltas.push_back(state.previousDeltaTime);
+    firstValue.push_back((uint32_t)values.size());
+    valueCount.push_back((uint32_t)state.samplers.size());
+    for (const Sampler& sampler: state.samplers) {
+      const uint32_t kValue = (uint32_t)values.size();
+      values.push_back(sampler.value);
+      if (sampler.kind == Sampler::Kind::Rotation) {
+        rotations.owner.push_back(kOwner);
+        rotations.value.push_back(kValue);
+        rotations.x.push_back(sampler.axis.x());
+        rotations.y.push_back(sampler.axis.y());
+        rotations.z.push_back(sampler.axis.z());
+        rotations.rate.push_back(sampler.rate);
+      } else if (sampler.kind == Sampler::Kind::Translation) {
+        translations.owner.push_back(kOwner);
+        translations.value.push_back(kValue);
+        translations.x.push_back(sampler.axis.x() * sampler.rate);
+        translations.y.push_back(sampler.axis.y() * sampler.rate);
+        translations.z.push_back(sampler.axis.z() * sampler.rate);
+      } else if (sampler.kind == Sampler::Kind::Keyframe) {
+        keyframes.owner.push_back(kOwner);
+        keyframes.value.push_back(kValue);
+        keyframes.track.push_back(sampler.track.get());
+        keyframes.duration.push_back(sampler.track->GetDuration());
+        keyframes.loop.push_back(sampler.loop ? 1 : 0);
+        keyframes.cursor.push_back(0);
+      }
+    }
+  }
+  rotations.angle.resize(rotations.owner.size());
+  deltas.resize(playing.size());
+  results.resize(playing.size());
+}
+
+void
+TransformAnimator::State::SampleRotations(const size_t aBegin, const size_t aEnd) {
+  const float kFullTurn = 2.0f * PI_FLOAT;
+  for (size_t ix = aBegin; ix < aEnd; ix++) {
+    rotations.angle[ix] = std::fmod(rotations.rate[ix] * deltas[rotations.owner[ix]], kFullTurn);
+  }
+  for (size_t ix = aBegin; ix < aEnd; ix++) {
+    const float x = rotations.x[ix];
+    const float y = rotations.y[ix];
+    const float z = rotations.z[ix];
+    const float angleSin = std::sin(rotations.angle[ix]);
+    const float angleCos = std::cos(rotations.angle[ix]);
+    const float oneMinusAngleCos = 1.0f - angleCos;
+    // Same layout as Matrix::Rotation, the axis is already normalized.
+    values[rotations.value[ix]] = Matrix(
+        angleCos + (x * x * oneMinusAngleCos), (z * angleSin) + (y * x * oneMinusAngleCos), (-y * angleSin) + (z * x * oneMinusAngleCos), 0.0f,
+        (-z * angleSin) + (x * y * oneMinusAngleCos), angleCos + (y * y * oneMinusAngleCos), (x * angleSin) + (z * y * oneMinusAngleCos), 0.0f,
+        (y * angleSin) + (x * z * oneMinusAngleCos), (-x * angleSin) + (y * z * oneMinusAngleCos), angleCos + (z * z * oneMinusAngleCos), 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f);
+  }
+}
+
+void
+TransformAnimator::State::SampleTranslations(const size_t aBegin, const size_t aEnd) {
+  for (size_t ix = aBegin; ix < aEnd; ix++) {
+    const float kDelta = deltas[translations.owner[ix]];
+    values[translations.value[ix]] = Matrix::Translation(
+        Vector(translations.x[ix] * kDelta, translations.y[ix] * kDelta, translations.z[ix] * kDelta));
+  }
+}
+
+void
+TransformAnimator::State::SampleKeyframes(const size_t aBegin, const size_t aEnd) {
+  for (size_t ix = aBegin; ix < aEnd; ix++) {
+    float time = deltas[keyframes.owner[ix]];
+    if (keyframes.loop[ix] && (keyframes.duration[ix] > 0.0f)) {
+      time = std::fmod(time, keyframes.duration[ix]);
+    }
+    values[keyframes.value[ix]] = keyframes.track[ix]->Sample(time, keyframes.cursor[ix]);
+  }
+}
+
+void
+TransformAnimator::State::Compose(const size_t aBegin, const size_t aEnd) {
+  for (size_t ix = aBegin; ix < aEnd; ix++) {
+    const uint32_t kFirst = firstValue[ix];
+    const uint32_t kCount = valueCount[ix];
+    if (kCount == 0) {
+      results[ix] = Matrix::Identity();
+      continue;
+    }
+    // Starts from the first value instead of a product with the identity.
+    // Sampled values are affine, so only static ones may need full products.
+    Matrix result = values[kFirst];
+    for (uint32_t value = kFirst + 1; value < (kFirst + kCount); value++) {
+      result = result.IsAffine() ? values[value].AffinePostMultiply(result) : values[value].PostMultiply(result);
+    }
+    results[ix] = result;
+  }
+}
+
+template<typename T>
+void
+TransformAnimator::State::Split(const size_t aCount, const JobSystem::JobHandle& aParent, T aWork, const size_t aJobSize) {
+  if (!aParent) {
+    aWork(0, aCount);
+    return;
+  }
+  for (size_t begin = 0; begin < aCount; begin += aJobSize) {
+    const size_t kEnd = std::min(aCount, begin + aJobSize);
+    jobs->Schedule([aWork, begin, kEnd]() { aWork(begin, kEnd); }, aParent);
+  }
+}
+
+void
+TransformAnimator::State::Sample(const double aTimestamp) {
+  VRB_TRACE_ZONE("TransformAnimator::Sample");
+  const size_t kCount = playing.size();
+  for (size_t ix = 0; ix < kCount; ix++) {
+    deltas[ix] = static_cast<float>(aTimestamp - startTimes[ix]) + previousDeltas[ix];
+  }
+
+  const bool kParallel = jobs && (jobs->GetWorkerCount() > 0) && (kCount >= kMinParallelCount);
+  State* self = this;
+  JobSystem::JobHandle samples = kParallel ? jobs->Create(nullptr) : nullptr;
+  Split(rotations.owner.size(), samples, [self](const size_t aBegin, const size_t aEnd) {
+    self->SampleRotations(aBegin, aEnd);
+  });
+  Split(translations.owner.size(), samples, [self](const size_t aBegin, const size_t aEnd) {
+    self->SampleTranslations(aBegin, aEnd);
+  });
+  Split(keyframes.owner.size(), samples, [self](const size_t aBegin, const size_t aEnd) {
+    self->SampleKeyframes(aBegin, aEnd);
+  });
+  if (samples) {
+    jobs->Run(samples);
+    jobs->Wait(samples);
+  }
+  JobSystem::JobHandle compose = kParallel ? jobs->Create(nullptr) : nullptr;
+  Split(kCount, compose, [self](const size_t aBegin, const size_t aEnd) {
+    self->Compose(aBegin, aEnd);
+  });
+  if (compose) {
+    jobs->Run(compose);
+    jobs->Wait(compose);
+  }
+
+  // Setting the transform invalidates bounds up the graph, which is not
+  // thread safe.
+  for (size_t ix = 0; ix < kCount; ix++) {
+    AnimatedTransform& transform = *playing[ix];
+    AnimatedTransform::State& state = transform.m;
+    state.currentAnimationTransform = results[ix];
+    transform.Transform::SetTransform(state.startTransform.PreMultiply(results[ix]));
+  }
+}
+
+void
+TransformAnimator::State::UpdateSkeletons() {
+  VRB_TRACE_ZONE("TransformAnimator::UpdateSkeletons");
+  // Joint transforms are only read, each job writes the palettes of its skeletons.
+  const bool kParallel = jobs && (jobs->GetWorkerCount() > 0) && (skeletons.size() >= kMinParallelSkeletons);
+  State* self = this;
+  JobSystem::JobHandle palettes = kParallel ? jobs->Create(nullptr) : nullptr;
+  Split(skeletons.size(), palettes, [self](const size_t aBegin, const size_t aEnd) {
+    for (size_t ix = aBegin; ix < aEnd; ix++) {
+      self->skeletons[ix]->m.UpdatePalette();
+    }
+  }, kSkeletonJobSize);
+  if (palettes) {
+    jobs->Run(palettes);
+    jobs->Wait(palettes);
+  }
+}
+
+TransformAnimatorPtr
+TransformAnimator::Create() {
+  TransformAnimatorPtr result = std::make_shared<ConcreteClass<TransformAnimator, TransformAnimator::State> >();
+  result->m.self = result;
+  return result;
+}
+
+void
+TransformAnimator::SetJobSystem(const JobSystemPtr& aJobs) {
+  m.jobs = aJobs;
+}
+
+double
+TransformAnimator::GetTimestamp() const {
+  return m.timestamp;
+}
+
+int32_t
+TransformAnimator::GetPlayingCount() const {
+  return m.dirty ? -1 : (int32_t)m.playing.size();
+}
+
+void
+TransformAnimator::Update(const double aTimestamp) {
+  m.timestamp = aTimestamp;
+  if (m.dirty) {
+    m.Rebuild(aTimestamp);
+  }
+  if (!m.playing.empty()) {
+    m.Sample(aTimestamp);
+  }
+  if (!m.skeletons.empty()) {
+    m.UpdateSkeletons();
+  }
+}
+
+void
+TransformAnimator::Add(AnimatedTransform& aTransform) {
+  AnimatedTransform::State& state = aTransform.m;
+  if (state.animatorSlot >= 0) {
+    return;
+  }
+  state.animatorSlot = (int32_t)m.transforms.size();
+  state.animator = m.self;
+  m.transforms.push_back(&aTransform);
+  m.dirty = true;
+}
+
+void
+TransformAnimator::Remove(AnimatedTransform& aTransform) {
+  AnimatedTransform::State& state = aTransform.m;
+  const int32_t kSlot = state.animatorSlot;
+  if ((kSlot < 0) || (kSlot >= (int32_t)m.transforms.size()) || (m.transforms[kSlot] != &aTransform)) {
+    return;
+  }
+  m.transforms[kSlot] = m.transforms.back();
+  m.transforms[kSlot]->m.animatorSlot = kSlot;
+  m.transforms.pop_back();
+  state.animatorSlot = -1;
+  state.animator.reset();
+  m.dirty = true;
+}
+
+void
+TransformAnimator::Invalidate() {
+  m.dirty = true;
+}
+
+void
+TransformAnimator::AddSkeleton(Skeleton& aSkeleton) {
+  Skeleton::State& state = aSkeleton.m;
+  if (state.animatorSlot >= 0) {
+    return;
+  }
+  state.animatorSlot = (int32_t)m.skeletons.size();
+  state.animator = m.self;
+  m.skeletons.push_back(&aSkeleton);
+}
+
+void
+TransformAnimator::RemoveSkeleton(Skeleton& aSkeleton) {
+  Skeleton::State& state = aSkeleton.m;
+  const int32_t kSlot = state.animatorSlot;
+  if ((kSlot < 0) || (kSlot >= (int32_t)m.skeletons.size()) || (m.skeletons[kSlot] != &aSkeleton)) {
+    return;
+  }
+  m.skeletons[kSlot] = m.skeletons.back();
+  m.skeletons[kSlot]->m.animatorSlot = kSlot;
+  m.skeletons.pop_back();
+  state.animatorSlot = -1;
+  state.animator.reset();
+}
+
+TransformAnimator::TransformAnimator(State& aState) : m(aState) {}
+TransformAnimator::~TransformAnimator() {
+  for (AnimatedTransform* transform: m.transforms) {
+    transform->m.animatorSlot = -1;
+  }
+  for (Skeleton* skeleton: m.skeletons) {
+    skeleton->m.animatorSlot = -1;
+  }
+}
+
+} // namespace vrb
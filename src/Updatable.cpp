@@ -4,11 +4,24 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "vrb/Updatable.h"
+#include "vrb/private/UpdatableState.h"
 
 #include "vrb/CreationContext.h"
+#include "vrb/RenderContext.h"
 
 namespace vrb {
 
+void
+UpdatableList::UpdateResource(RenderContext& aContext) {
+  const double kNow = aContext.GetTimestamp();
+  Updatable* first = Updatable::State::Next(&mTimedHead);
+  while ((first != &mTimedTail) && (Updatable::State::From(first).wakeTime <= kNow)) {
+    Wake(first);
+    first = Updatable::State::Next(&mTimedHead);
+  }
+  m.CallAllUpdateResources(aContext);
+}
+
 Updatable::Updatable(State& aState, CreationContextPtr& aContext) : m(aState) {
   aContext->AddUpdatable(this);
 }
@@ -16,4 +29,26 @@ Updatable::Updatable(State& aState) : m(aState) {}
 
 Updatable::~Updatable() {}
 
+void
+Updatable::Sleep(RenderContext& aContext) {
+  aContext.GetUpdatableList().Sleep(this, -1.0);
+}
+
+void
+Updatable::SleepUntil(RenderContext& aContext, const double aTimestamp) {
+  aContext.GetUpdatableList().Sleep(this, aTimestamp < 0.0 ? 0.0 : aTimestamp);
+}
+
+void
+Updatable::Wake() {
+  if (m.sleepList) {
+    m.sleepList->Wake(this);
+  }
+}
+
+bool
+Updatable::IsSleeping() const {
+  return m.sleepList != nullptr;
+}
+
 } // namespace vrb
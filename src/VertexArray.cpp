@@ -6,9 +6,15 @@
 #include "vrb/VertexArray.h"
 
 #include "vrb/ConcreteClass.h"
+#include "vrb/private/AlignedAllocator.h"
 #include "vrb/Color.h"
+#include "vrb/MemoryCounter.h"
 #include "vrb/Vector.h"
+#include "vrb/Vector4.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <vector>
 
 namespace vrb {
@@ -22,11 +28,63 @@ struct VertexArray::State {
     NormalState() : count(0.0f) {}
     explicit NormalState(const Vector& aNormal) : normal(aNormal), count(1.0f) {}
   };
+  struct SkinState {
+    float joints[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float weights[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    SkinState() = default;
+    SkinState(const float* aJoints, const float* aWeights) {
+      memcpy(joints, aJoints, sizeof(joints));
+      memcpy(weights, aWeights, sizeof(weights));
+    }
+  };
   int uvLength = 0;
   std::vector<Vector> vertices;
   std::vector<NormalState> normals;
   std::vector<Vector> uvs;
   std::vector<Color> colors;
+  std::vector<SkinState> skins;
+  bool padded = false;
+  // Entries before paddedValid match the vertices.
+  std::vector<Vector4, AlignedAllocator<Vector4>> paddedVertices;
+  size_t paddedValid = 0;
+  // Indexed by Attribute, empty when first >= end.
+  struct DirtyRange {
+    int first = std::numeric_limits<int>::max();
+    int end = 0;
+  };
+  DirtyRange dirty[5];
+  bool isDirty = false;
+  MemoryTracker memory;
+
+  State() : memory(MemoryType::VertexArray) {}
+  void MarkDirty(const Attribute aAttribute, const int aFirst, const int aEnd) {
+    DirtyRange& range = dirty[(size_t)aAttribute];
+    range.first = std::min(range.first, aFirst);
+    range.end = std::max(range.end, aEnd);
+    isDirty = true;
+  }
+  void UpdateMemory() {
+    memory.Set((vertices.capacity() * sizeof(Vector)) + (normals.capacity() * sizeof(NormalState)) +
+               (uvs.capacity() * sizeof(Vector)) + (colors.capacity() * sizeof(Color)) +
+               (skins.capacity() * sizeof(SkinState)) + (paddedVertices.capacity() * sizeof(Vector4)));
+  }
+  void InvalidatePadded(const size_t aIndex) {
+    paddedValid = std::min(paddedValid, aIndex);
+  }
+  void UpdatePadded() {
+    if (paddedValid == vertices.size()) {
+      return;
+    }
+    const size_t kCapacity = paddedVertices.capacity();
+    paddedVertices.resize(vertices.size());
+    for (size_t ix = paddedValid; ix < vertices.size(); ix++) {
+      paddedVertices[ix] = Vector4(vertices[ix], 1.0f);
+    }
+    paddedValid = vertices.size();
+    if (kCapacity != paddedVertices.capacity()) {
+      UpdateMemory();
+    }
+  }
 };
 
 VertexArrayPtr
@@ -54,10 +112,16 @@ VertexArray::GetColorCount() const {
   return m.colors.size();
 }
 
+int
+VertexArray::GetSkinCount() const {
+  return m.skins.size();
+}
+
 void
 VertexArray::SetNormalCount(const int aCount) {
   if (m.normals.size() < aCount) {
     m.normals.resize(aCount);
+    m.UpdateMemory();
   }
 }
 
@@ -116,47 +180,118 @@ VertexArray::GetColor(const int aIndex) const {
   return m.colors[aIndex];
 }
 
+const float*
+VertexArray::GetJoints(const int aIndex) const {
+  static const State::SkinState kEmpty;
+  if ((aIndex < 0) || ((size_t)aIndex >= m.skins.size())) {
+    return kEmpty.joints;
+  }
+  return m.skins[aIndex].joints;
+}
+
+const float*
+VertexArray::GetWeights(const int aIndex) const {
+  static const State::SkinState kEmpty;
+  if ((aIndex < 0) || ((size_t)aIndex >= m.skins.size())) {
+    return kEmpty.weights;
+  }
+  return m.skins[aIndex].weights;
+}
+
+const float*
+VertexArray::GetVertexData() const {
+  static_assert(sizeof(Vector) == sizeof(float) * 3, "Vector must be three packed floats");
+  return m.vertices.empty() ? nullptr : m.vertices[0].Data();
+}
+
+void
+VertexArray::SetPaddedStorage(const bool aEnabled) {
+  m.padded = aEnabled;
+  if (!aEnabled) {
+    std::vector<Vector4, AlignedAllocator<Vector4>>().swap(m.paddedVertices);
+    m.paddedValid = 0;
+    m.UpdateMemory();
+  }
+}
+
+bool
+VertexArray::IsPaddedStorage() const {
+  return m.padded;
+}
+
+const Vector4*
+VertexArray::GetPaddedVertices() const {
+  if (!m.padded || m.vertices.empty()) {
+    return nullptr;
+  }
+  m.UpdatePadded();
+  return m.paddedVertices.data();
+}
+
 void
 VertexArray::SetVertex(const int aIndex, const Vector& aPoint) {
   if (m.vertices.size() < (aIndex + 1)) {
     m.vertices.resize(aIndex + 1);
+    m.UpdateMemory();
   }
   m.vertices[aIndex] = aPoint;
+  m.InvalidatePadded((size_t)aIndex);
+  m.MarkDirty(Attribute::Vertex, aIndex, aIndex + 1);
 }
 
 void
 VertexArray::SetNormal(const int aIndex, const Vector& aNormal) {
   if (m.normals.size() < (aIndex + 1)) {
     m.normals.resize(aIndex + 1);
+    m.UpdateMemory();
   }
   m.normals[aIndex].normal = aNormal;
+  m.MarkDirty(Attribute::Normal, aIndex, aIndex + 1);
 }
 
 void
 VertexArray::SetUV(const int aIndex, const Vector& aUV) {
   if (m.uvs.size() < (aIndex + 1)) {
     m.uvs.resize(aIndex + 1);
+    m.UpdateMemory();
   }
   m.uvs[aIndex] = aUV;
+  m.MarkDirty(Attribute::UV, aIndex, aIndex + 1);
 }
 
 void
 VertexArray::SetColor(const int aIndex, const Color& aColor) {
   if (m.colors.size() < (aIndex + 1)) {
     m.colors.resize(aIndex + 1);
+    m.UpdateMemory();
   }
   m.colors[aIndex] = aColor;
+  m.MarkDirty(Attribute::Color, aIndex, aIndex + 1);
+}
+
+void
+VertexArray::SetSkin(const int aIndex, const float* aJoints, const float* aWeights) {
+  if (m.skins.size() < ((size_t)aIndex + 1)) {
+    m.skins.resize(aIndex + 1);
+    m.UpdateMemory();
+  }
+  m.skins[aIndex] = State::SkinState(aJoints, aWeights);
+  m.MarkDirty(Attribute::Skin, aIndex, aIndex + 1);
 }
 
 int
 VertexArray::AppendVertex(const Vector& aPoint) {
   m.vertices.push_back(aPoint);
+  m.MarkDirty(Attribute::Vertex, (int)m.vertices.size() - 1, (int)m.vertices.size());
+  m.UpdateMemory();
   return m.vertices.size() - 1;
 }
 
 int
 VertexArray::AppendNormal(const Vector& aNormal) {
   m.normals.emplace_back(State::NormalState(aNormal));
+  m.MarkDirty(Attribute::Normal, (int)m.normals.size() - 1, (int)m.normals.size());
+  m.UpdateMemory();
   return m.normals.size() - 1;
 }
 
@@ -164,26 +299,97 @@ void
 VertexArray::AddNormal(const int aIndex, const Vector& aNormal) {
   if (m.normals.size() < (aIndex + 1)) {
     m.normals.resize(aIndex + 1);
+    m.UpdateMemory();
   }
   State::NormalState& ns = m.normals[aIndex];
   const float originalCount = ns.count;
   ns.count++;
   Vector orig = ns.normal;
   ns.normal = (((ns.normal * originalCount) + aNormal) / ns.count).Normalize();
+  m.MarkDirty(Attribute::Normal, aIndex, aIndex + 1);
 }
 
 int
 VertexArray::AppendUV(const Vector& aUV) {
   m.uvs.push_back(aUV);
+  m.MarkDirty(Attribute::UV, (int)m.uvs.size() - 1, (int)m.uvs.size());
+  m.UpdateMemory();
   return m.uvs.size() - 1;
 }
 
 int
 VertexArray::AppendColor(const Color& aColor) {
   m.colors.push_back(aColor);
+  m.MarkDirty(Attribute::Color, (int)m.colors.size() - 1, (int)m.colors.size());
+  m.UpdateMemory();
   return m.colors.size() - 1;
 }
 
+int
+VertexArray::AppendSkin(const float* aJoints, const float* aWeights) {
+  m.skins.emplace_back(aJoints, aWeights);
+  m.MarkDirty(Attribute::Skin, (int)m.skins.size() - 1, (int)m.skins.size());
+  m.UpdateMemory();
+  return m.skins.size() - 1;
+}
+
+void
+VertexArray::AppendVertices(const float* aPoints, const size_t aCount, const size_t aStride) {
+  const int kFirst = (int)m.vertices.size();
+  for (size_t ix = 0; ix < aCount; ix++) {
+    const float* point = aPoints + (ix * aStride);
+    m.vertices.emplace_back(point[0], point[1], point[2]);
+  }
+  m.MarkDirty(Attribute::Vertex, kFirst, (int)m.vertices.size());
+  m.UpdateMemory();
+}
+
+void
+VertexArray::AppendNormals(const float* aNormals, const size_t aCount, const size_t aStride) {
+  const int kFirst = (int)m.normals.size();
+  for (size_t ix = 0; ix < aCount; ix++) {
+    const float* normal = aNormals + (ix * aStride);
+    m.normals.emplace_back(State::NormalState(Vector(normal[0], normal[1], normal[2])));
+  }
+  m.MarkDirty(Attribute::Normal, kFirst, (int)m.normals.size());
+  m.UpdateMemory();
+}
+
+void
+VertexArray::AppendUVs(const float* aUVs, const size_t aCount, const size_t aStride) {
+  const int kFirst = (int)m.uvs.size();
+  for (size_t ix = 0; ix < aCount; ix++) {
+    const float* uv = aUVs + (ix * aStride);
+    m.uvs.emplace_back(uv[0], uv[1], uv[2]);
+  }
+  m.MarkDirty(Attribute::UV, kFirst, (int)m.uvs.size());
+  m.UpdateMemory();
+}
+
+bool
+VertexArray::IsDirty() const {
+  return m.isDirty;
+}
+
+bool
+VertexArray::GetDirtyRange(const Attribute aAttribute, int& aFirst, int& aEnd) const {
+  const State::DirtyRange& kRange = m.dirty[(size_t)aAttribute];
+  if (kRange.first >= kRange.end) {
+    return false;
+  }
+  aFirst = kRange.first;
+  aEnd = kRange.end;
+  return true;
+}
+
+void
+VertexArray::ClearDirty() {
+  for (State::DirtyRange& range: m.dirty) {
+    range = State::DirtyRange();
+  }
+  m.isDirty = false;
+}
+
 VertexArray::VertexArray(State& aState, CreationContextPtr& aContext) : m(aState) {}
 
 }
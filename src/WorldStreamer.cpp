@@ -0,0 +1,452 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/WorldStreamer.h"
+#include "vrb/private/UpdatableState.h"
+
+#include "vrb/Camera.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/Group.h"
+#include "vrb/LoadReport.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/RenderContext.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Seconds over which the viewer velocity is smoothed, so head motion does
+// not swing the prefetch around.
+const float kVelocitySmoothing = 0.5f;
+// Frames longer than this, such as after a pause, do not update the
+// velocity.
+const double kMaxVelocityDelta = 0.25;
+
+uint64_t
+CellKey(const int32_t aX, const int32_t aZ) {
+  return ((uint64_t)(uint32_t)aX << 32) | (uint64_t)(uint32_t)aZ;
+}
+
+float
+PlanarDistance(const vrb::Vector& aPoint, const float aX, const float aZ) {
+  const float kX = aPoint.x() - aX;
+  const float kZ = aPoint.z() - aZ;
+  return std::sqrt((kX * kX) + (kZ * kZ));
+}
+
+} // namespace
+
+namespace vrb {
+
+struct WorldStreamer::State : public Updatable::State {
+  enum class Status {
+    Unloaded,
+    Pending,
+    Loaded,
+    // The task returned nothing, it is not run again.
+    Failed
+  };
+  struct Cell {
+    int32_t x;
+    int32_t z;
+    LoadTask task;
+    size_t estimate;
+    size_t bytes;
+    Status status;
+    GroupPtr node;
+    LoadTokenPtr token;
+    // Set by Evaluate(), lower is more important. Cells wanted around the
+    // viewer come before prefetched ones, which come before cells only kept.
+    float key;
+    bool wanted;
+    bool kept;
+    uint64_t visit;
+    Cell() : x(0), z(0), estimate(0), bytes(0), status(Status::Unloaded), key(0.0f), wanted(false), kept(false), visit(0) {}
+  };
+
+  std::weak_ptr<WorldStreamer> self;
+  CreationContextWeak context;
+  std::weak_ptr<LoaderThread> loader;
+  std::weak_ptr<Camera> camera;
+  GroupPtr root;
+  std::unordered_map<uint64_t, Cell> cells;
+  // Keys of the pending and loaded cells.
+  std::vector<uint64_t> active;
+  std::vector<Cell*> candidates;
+  // Nodes of removed cells, disposed by the next update.
+  std::vector<NodePtr> removed;
+  float cellSize;
+  float loadRadius;
+  float unloadRadius;
+  float prefetchTime;
+  size_t budget;
+  int32_t maxPending;
+  int32_t pendingCount;
+  int32_t loadedCount;
+  size_t loadedBytes;
+  uint64_t visit;
+  bool hasViewer;
+  Vector viewer;
+  Vector velocity;
+  double lastTime;
+
+  State()
+      : cellSize(64.0f)
+      , loadRadius(128.0f)
+      , unloadRadius(160.0f)
+      , prefetchTime(2.0f)
+      , budget(0)
+      , maxPending(2)
+      , pendingCount(0)
+      , loadedCount(0)
+      , loadedBytes(0)
+      , visit(0)
+      , hasViewer(false)
+      , lastTime(-1.0)
+  {}
+
+  size_t CellBytes(const Cell& aCell) const {
+    return aCell.status == Status::Loaded ? aCell.bytes : aCell.estimate;
+  }
+
+  // Returns false when the cell is neither wanted nor kept.
+  bool Evaluate(Cell& aCell, const Vector& aPredicted) {
+    const float kX = ((float)aCell.x + 0.5f) * cellSize;
+    const float kZ = ((float)aCell.z + 0.5f) * cellSize;
+    const float kCurrent = PlanarDistance(viewer, kX, kZ);
+    const float kAhead = PlanarDistance(aPredicted, kX, kZ);
+    aCell.visit = visit;
+    aCell.wanted = (kCurrent <= loadRadius) || (kAhead <= loadRadius);
+    aCell.kept = aCell.wanted || (std::min(kCurrent, kAhead) <= unloadRadius);
+    if (kCurrent <= loadRadius) {
+      aCell.key = kCurrent;
+    } else if (kAhead <= loadRadius) {
+      aCell.key = loadRadius + kAhead;
+    } else {
+      aCell.key = (2.0f * loadRadius) + kCurrent;
+    }
+    return aCell.kept;
+  }
+
+  void Release(RenderContext& aContext, Cell& aCell) {
+    if (aCell.status == Status::Pending) {
+      aCell.token->Cancel();
+      pendingCount--;
+    } else if (aCell.status == Status::Loaded) {
+      aContext.Dispose(aCell.node);
+      loadedCount--;
+      loadedBytes -= aCell.bytes;
+    }
+    aCell.token = nullptr;
+    aCell.node = nullptr;
+    aCell.bytes = 0;
+    if (aCell.status != Status::Failed) {
+      aCell.status = Status::Unloaded;
+    }
+  }
+
+  // Detaches the cell for Remove, the node is disposed by the next update.
+  void Detach(Cell& aCell) {
+    if (aCell.status == Status::Pending) {
+      aCell.token->Cancel();
+      pendingCount--;
+    } else if (aCell.status == Status::Loaded) {
+      aCell.node->RemoveFromParents();
+      removed.push_back(std::move(aCell.node));
+      loadedCount--;
+      loadedBytes -= aCell.bytes;
+    }
+  }
+
+  int32_t Priority(const Cell& aCell) const {
+    return -(int32_t)(aCell.key * 1000.0f / cellSize);
+  }
+
+  void Load(LoaderThread& aLoader, Cell& aCell) {
+    CreationContextPtr create = context.lock();
+    if (!create) {
+      return;
+    }
+    aCell.node = Group::Create(create);
+    aCell.token = LoadToken::Create(Priority(aCell));
+    aCell.status = Status::Pending;
+    pendingCount++;
+    std::weak_ptr<WorldStreamer> weak = self;
+    const uint64_t kKey = CellKey(aCell.x, aCell.z);
+    LoadTokenPtr token = aCell.token;
+    LoadFinishedCallback callback = [weak, kKey, token](GroupPtr& aNode) {
+      WorldStreamerPtr streamer = weak.lock();
+      if (streamer) {
+        streamer->m.Finish(kKey, token);
+      }
+    };
+    aLoader.RunLoadTask(aCell.node, aCell.task, callback, aCell.token);
+  }
+
+  void Finish(const uint64_t aKey, const LoadTokenPtr& aToken) {
+    auto found = cells.find(aKey);
+    // A replaced cell has a new token.
+    if ((found == cells.end()) || (found->second.token != aToken)) {
+      return;
+    }
+    Cell& cell = found->second;
+    pendingCount--;
+    cell.token = nullptr;
+    if (cell.node->GetNodeCount() == 0) {
+      VRB_ERROR("WorldStreamer: cell (%d, %d) loaded nothing", cell.x, cell.z);
+      cell.node = nullptr;
+      cell.status = Status::Failed;
+      return;
+    }
+    cell.bytes = cell.estimate;
+    if (cell.bytes == 0) {
+      LoadReportCollectorPtr counter = LoadReportCollector::Create();
+      counter->CountNodes(cell.node);
+      const LoadReport kReport = counter->GetReport(0.0);
+      cell.bytes = (size_t)(kReport.Get(LoadReport::Counter::VertexBytes) + kReport.Get(LoadReport::Counter::IndexBytes));
+    }
+    cell.status = Status::Loaded;
+    loadedCount++;
+    loadedBytes += cell.bytes;
+    root->AddNode(cell.node);
+  }
+
+  void UpdateViewer(const Vector& aPosition, const double aTimestamp) {
+    const double kDelta = aTimestamp - lastTime;
+    if (hasViewer && (lastTime >= 0.0) && (kDelta > 0.0) && (kDelta <= kMaxVelocityDelta)) {
+      const Vector kInstant = (aPosition - viewer) / (float)kDelta;
+      const float kBlend = std::min((float)kDelta / kVelocitySmoothing, 1.0f);
+      velocity += (kInstant - velocity) * kBlend;
+    }
+    viewer = aPosition;
+    lastTime = aTimestamp;
+    hasViewer = true;
+  }
+};
+
+WorldStreamerPtr
+WorldStreamer::Create(RenderContextPtr& aContext) {
+  WorldStreamerPtr result = std::make_shared<ConcreteClass<WorldStreamer, WorldStreamer::State> >(aContext);
+  result->m.self = result;
+  return result;
+}
+
+GroupPtr
+WorldStreamer::GetRoot() const {
+  return m.root;
+}
+
+void
+WorldStreamer::SetLoaderThread(const LoaderThreadPtr& aLoader) {
+  m.loader = aLoader;
+}
+
+void
+WorldStreamer::SetCamera(const CameraPtr& aCamera) {
+  m.camera = aCamera;
+  m.hasViewer = false;
+}
+
+void
+WorldStreamer::SetCellSize(const float aSize) {
+  if (!m.cells.empty()) {
+    VRB_ERROR("WorldStreamer::SetCellSize called after cells were added");
+    return;
+  }
+  if (aSize <= 0.0f) {
+    VRB_ERROR("WorldStreamer::SetCellSize invalid size: %f", aSize);
+    return;
+  }
+  m.cellSize = aSize;
+}
+
+float
+WorldStreamer::GetCellSize() const {
+  return m.cellSize;
+}
+
+void
+WorldStreamer::SetRadii(const float aLoadRadius, const float aUnloadRadius) {
+  m.loadRadius = std::max(aLoadRadius, 0.0f);
+  m.unloadRadius = std::max(aUnloadRadius, m.loadRadius);
+}
+
+void
+WorldStreamer::SetPrefetchTime(const float aSeconds) {
+  m.prefetchTime = std::max(aSeconds, 0.0f);
+}
+
+void
+WorldStreamer::SetMemoryBudget(const size_t aBytes) {
+  m.budget = aBytes;
+}
+
+void
+WorldStreamer::SetMaxPendingLoads(const int32_t aCount) {
+  m.maxPending = std::max(aCount, 1);
+}
+
+void
+WorldStreamer::AddCell(const int32_t aX, const int32_t aZ, const LoadTask& aTask, const size_t aBytes) {
+  State::Cell& cell = m.cells[CellKey(aX, aZ)];
+  m.Detach(cell);
+  cell = State::Cell();
+  cell.x = aX;
+  cell.z = aZ;
+  cell.task = aTask;
+  cell.estimate = aBytes;
+}
+
+void
+WorldStreamer::RemoveCell(const int32_t aX, const int32_t aZ) {
+  auto found = m.cells.find(CellKey(aX, aZ));
+  if (found == m.cells.end()) {
+    return;
+  }
+  m.Detach(found->second);
+  m.cells.erase(found);
+}
+
+bool
+WorldStreamer::IsCellLoaded(const int32_t aX, const int32_t aZ) const {
+  auto found = m.cells.find(CellKey(aX, aZ));
+  return (found != m.cells.end()) && (found->second.status == State::Status::Loaded);
+}
+
+int32_t
+WorldStreamer::GetLoadedCount() const {
+  return m.loadedCount;
+}
+
+int32_t
+WorldStreamer::GetPendingCount() const {
+  return m.pendingCount;
+}
+
+size_t
+WorldStreamer::GetLoadedBytes() const {
+  return m.loadedBytes;
+}
+
+void
+WorldStreamer::UpdateResource(RenderContext& aContext) {
+  for (NodePtr& node: m.removed) {
+    aContext.Dispose(std::move(node));
+  }
+  m.removed.clear();
+  CameraPtr camera = m.camera.lock();
+  LoaderThreadPtr loader = m.loader.lock();
+  if (!camera || !loader) {
+    return;
+  }
+  m.UpdateViewer(camera->GetTransform().GetTranslation(), aContext.GetTimestamp());
+  Vector ahead = m.velocity * m.prefetchTime;
+  const float kAhead = ahead.Magnitude();
+  if (kAhead > m.loadRadius) {
+    ahead *= m.loadRadius / kAhead;
+  }
+  const Vector kPredicted = m.viewer + ahead;
+
+  // Every cell within the unload radius of the viewer or of the predicted
+  // position is looked up, the cells outside that were active are
+  // released after.
+  m.visit++;
+  m.candidates.clear();
+  const float kRange = m.unloadRadius + (m.cellSize * 0.5f);
+  const int32_t kMinX = (int32_t)std::floor((std::min(m.viewer.x(), kPredicted.x()) - kRange) / m.cellSize);
+  const int32_t kMaxX = (int32_t)std::floor((std::max(m.viewer.x(), kPredicted.x()) + kRange) / m.cellSize);
+  const int32_t kMinZ = (int32_t)std::floor((std::min(m.viewer.z(), kPredicted.z()) - kRange) / m.cellSize);
+  const int32_t kMaxZ = (int32_t)std::floor((std::max(m.viewer.z(), kPredicted.z()) + kRange) / m.cellSize);
+  if ((size_t)(kMaxX - kMinX + 1) * (size_t)(kMaxZ - kMinZ + 1) < m.cells.size()) {
+    for (int32_t x = kMinX; x <= kMaxX; x++) {
+      for (int32_t z = kMinZ; z <= kMaxZ; z++) {
+        auto found = m.cells.find(CellKey(x, z));
+        if ((found != m.cells.end()) && m.Evaluate(found->second, kPredicted)) {
+          m.candidates.push_back(&found->second);
+        }
+      }
+    }
+  } else {
+    // Fewer cells than the range covers.
+    for (auto& entry: m.cells) {
+      if (m.Evaluate(entry.second, kPredicted)) {
+        m.candidates.push_back(&entry.second);
+      }
+    }
+  }
+  for (const uint64_t kKey: m.active) {
+    auto found = m.cells.find(kKey);
+    if (found == m.cells.end()) {
+      continue;
+    }
+    State::Cell& cell = found->second;
+    if ((cell.visit != m.visit) || !cell.kept) {
+      m.Release(aContext, cell);
+    }
+  }
+
+  std::sort(m.candidates.begin(), m.candidates.end(), [](const State::Cell* aLeft, const State::Cell* aRight) {
+    return aLeft->key < aRight->key;
+  });
+  // Nearest first, cells past the budget are released so a nearer cell
+  // that does not fit gets the memory of the farther ones.
+  size_t used = 0;
+  bool full = false;
+  for (State::Cell* cell: m.candidates) {
+    const size_t kBytes = m.CellBytes(*cell);
+    const bool kFits = (m.budget == 0) || ((used + kBytes) <= m.budget);
+    if ((cell->status == State::Status::Loaded) || (cell->status == State::Status::Pending)) {
+      if (full || !kFits) {
+        m.Release(aContext, *cell);
+        continue;
+      }
+      used += kBytes;
+      if (cell->status == State::Status::Pending) {
+        cell->token->SetPriority(m.Priority(*cell));
+      }
+    } else if ((cell->status == State::Status::Unloaded) && cell->wanted && !full) {
+      if (!kFits) {
+        // A cell larger than the budget alone is skipped instead.
+        full = kBytes <= m.budget;
+        continue;
+      }
+      if (m.pendingCount >= m.maxPending) {
+        continue;
+      }
+      used += kBytes;
+      m.Load(*loader, *cell);
+    }
+  }
+
+  m.active.clear();
+  for (State::Cell* cell: m.candidates) {
+    if ((cell->status == State::Status::Loaded) || (cell->status == State::Status::Pending)) {
+      m.active.push_back(CellKey(cell->x, cell->z));
+    }
+  }
+}
+
+WorldStreamer::WorldStreamer(State& aState, RenderContextPtr& aContext)
+    : Updatable(aState, aContext->GetRenderThreadCreationContext())
+    , m(aState) {
+  m.context = aContext->GetRenderThreadCreationContext();
+  m.root = Group::Create(aContext->GetRenderThreadCreationContext());
+}
+
+WorldStreamer::~WorldStreamer() {
+  for (auto& entry: m.cells) {
+    if (entry.second.token) {
+      entry.second.token->Cancel();
+    }
+  }
+}
+
+} // namespace vrb